@@ -0,0 +1,686 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.AsyncIo.cpp
+ * PURPOSE:   Implementation for the asynchronous file I/O queue
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.AsyncIo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /**
+     * @brief The smallest chunk size. It keeps tiny chunks from flooding the
+     *        queue with operations.
+    */
+    const std::size_t MinimumChunkSize = 4 * 1024;
+
+    /**
+     * @brief The largest chunk size. ReadFile and WriteFile take a 32-bit
+     *        length.
+    */
+    const std::size_t MaximumChunkSize = 1024 * 1024 * 1024;
+
+#if !defined(_WIN32)
+
+    /**
+     * @brief The largest number of workers of the thread-pool backend.
+    */
+    const std::size_t MaximumWorkers = 64;
+
+#endif
+}
+
+struct Mile::AsyncIoQueue::RequestState
+{
+    void* UserData;
+    std::atomic<std::size_t> RemainingOperations{ 0 };
+    std::atomic<std::uint64_t> Bytes{ 0 };
+    std::atomic<int> ErrorCode{ 0 };
+};
+
+struct Mile::AsyncIoQueue::Operation
+{
+#if defined(_WIN32)
+    // It must be the first member, because the completion port returns the
+    // address of the OVERLAPPED structure.
+    OVERLAPPED Overlapped;
+#endif
+    RequestState* Request;
+    AsyncIoFileHandle File;
+    AsyncIoOperation Kind;
+    std::uint64_t Offset;
+    std::size_t Length;
+
+    // The pieces of the buffers covered by the operation. There is only one
+    // piece on Windows, because overlapped ReadFile and WriteFile take one
+    // buffer.
+    std::vector<AsyncIoBuffer> Buffers;
+};
+
+Mile::AsyncIoQueue::AsyncIoQueue(
+    AsyncIoQueueOptions const& Options) :
+    m_Options(Options)
+{
+    this->m_Options.QueueDepth = std::max<std::size_t>(
+        this->m_Options.QueueDepth,
+        1);
+    this->m_Options.ChunkSize = (std::min)(
+        (std::max)(this->m_Options.ChunkSize, MinimumChunkSize),
+        MaximumChunkSize);
+
+#if defined(_WIN32)
+    this->m_CompletionPort = ::CreateIoCompletionPort(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        0,
+        1);
+    if (!this->m_CompletionPort)
+    {
+        throw std::system_error(
+            static_cast<int>(::GetLastError()),
+            std::system_category());
+    }
+#else
+    std::size_t NumberOfWorkers = (std::min)(
+        this->m_Options.QueueDepth,
+        MaximumWorkers);
+    this->m_Workers.reserve(NumberOfWorkers);
+    for (std::size_t i = 0; i < NumberOfWorkers; ++i)
+    {
+        this->m_Workers.emplace_back(&AsyncIoQueue::WorkerMain, this);
+    }
+#endif
+}
+
+Mile::AsyncIoQueue::~AsyncIoQueue()
+{
+#if defined(_WIN32)
+    // The OVERLAPPED structures must stay valid until their completion
+    // packets are dequeued.
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            if (!this->m_InFlightOperations &&
+                this->m_PendingOperations.empty())
+            {
+                break;
+            }
+        }
+        this->IssueOperations();
+        this->DrainCompletionPort(true);
+    }
+
+    ::CloseHandle(this->m_CompletionPort);
+#else
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        this->m_Terminating = true;
+    }
+    this->m_OperationAvailable.notify_all();
+
+    for (std::thread& Worker : this->m_Workers)
+    {
+        Worker.join();
+    }
+#endif
+}
+
+int Mile::AsyncIoQueue::OpenFile(
+    NativeString const& Path,
+    AsyncIoAccess Access,
+    AsyncIoFileHandle& File)
+{
+#if defined(_WIN32)
+    File = nullptr;
+
+    DWORD DesiredAccess = 0;
+    DWORD ShareMode = FILE_SHARE_READ;
+    DWORD CreationDisposition = OPEN_EXISTING;
+    switch (Access)
+    {
+    case AsyncIoAccess::Read:
+        DesiredAccess = GENERIC_READ;
+        ShareMode |= FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+        break;
+    case AsyncIoAccess::Write:
+        DesiredAccess = GENERIC_WRITE;
+        CreationDisposition = CREATE_ALWAYS;
+        break;
+    default:
+        DesiredAccess = GENERIC_READ | GENERIC_WRITE;
+        break;
+    }
+
+    HANDLE Handle = ::CreateFileW(
+        Path.c_str(),
+        DesiredAccess,
+        ShareMode,
+        nullptr,
+        CreationDisposition,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+        nullptr);
+    if (Handle == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int>(::GetLastError());
+    }
+#else
+    File = -1;
+
+    int Flags = O_CLOEXEC;
+    switch (Access)
+    {
+    case AsyncIoAccess::Read:
+        Flags |= O_RDONLY;
+        break;
+    case AsyncIoAccess::Write:
+        Flags |= O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+    default:
+        Flags |= O_RDWR;
+        break;
+    }
+
+    int Handle = ::open(Path.c_str(), Flags, 0666);
+    if (Handle == -1)
+    {
+        return errno;
+    }
+#endif
+
+    int Error = this->AttachFile(Handle);
+    if (Error)
+    {
+        AsyncIoQueue::CloseFile(Handle);
+        return Error;
+    }
+
+    File = Handle;
+    return 0;
+}
+
+int Mile::AsyncIoQueue::AttachFile(
+    AsyncIoFileHandle File)
+{
+#if defined(_WIN32)
+    if (!::CreateIoCompletionPort(File, this->m_CompletionPort, 0, 0))
+    {
+        return static_cast<int>(::GetLastError());
+    }
+    return 0;
+#else
+    return File == -1 ? EBADF : 0;
+#endif
+}
+
+void Mile::AsyncIoQueue::CloseFile(
+    AsyncIoFileHandle File) noexcept
+{
+#if defined(_WIN32)
+    if (File && File != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(File);
+    }
+#else
+    if (File != -1)
+    {
+        ::close(File);
+    }
+#endif
+}
+
+int Mile::AsyncIoQueue::GetFileSize(
+    AsyncIoFileHandle File,
+    std::uint64_t& Size) noexcept
+{
+#if defined(_WIN32)
+    LARGE_INTEGER FileSize;
+    if (!::GetFileSizeEx(File, &FileSize))
+    {
+        return static_cast<int>(::GetLastError());
+    }
+    Size = static_cast<std::uint64_t>(FileSize.QuadPart);
+#else
+    struct stat Status;
+    if (-1 == ::fstat(File, &Status))
+    {
+        return errno;
+    }
+    Size = static_cast<std::uint64_t>(Status.st_size);
+#endif
+    return 0;
+}
+
+void Mile::AsyncIoQueue::Submit(
+    AsyncIoRequest const& Request)
+{
+    RequestState* State = new RequestState();
+    State->UserData = Request.UserData;
+
+    // Split the buffers into operations of at most ChunkSize bytes, which
+    // cover consecutive ranges of the file.
+    std::vector<Operation*> Operations;
+    Operation* Current = nullptr;
+    std::uint64_t Offset = Request.Offset;
+    for (std::size_t i = 0; i < Request.BufferCount; ++i)
+    {
+        std::uint8_t* Data = reinterpret_cast<std::uint8_t*>(
+            Request.Buffers[i].Data);
+        std::size_t Remaining = Request.Buffers[i].Size;
+        while (Remaining)
+        {
+#if defined(_WIN32)
+            if (Current && !Current->Buffers.empty())
+            {
+                Operations.push_back(Current);
+                Current = nullptr;
+            }
+#endif
+            if (!Current)
+            {
+                Current = new Operation();
+                Current->Request = State;
+                Current->File = Request.File;
+                Current->Kind = Request.Operation;
+                Current->Offset = Offset;
+                Current->Length = 0;
+            }
+
+            std::size_t Size = (std::min)(
+                Remaining,
+                this->m_Options.ChunkSize - Current->Length);
+            Current->Buffers.push_back(AsyncIoBuffer{ Data, Size });
+            Current->Length += Size;
+            Data += Size;
+            Offset += Size;
+            Remaining -= Size;
+
+            if (Current->Length == this->m_Options.ChunkSize)
+            {
+                Operations.push_back(Current);
+                Current = nullptr;
+            }
+        }
+    }
+    if (Current)
+    {
+        Operations.push_back(Current);
+    }
+
+    State->RemainingOperations = Operations.size();
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        ++this->m_OutstandingRequests;
+
+        if (Operations.empty())
+        {
+            this->m_Completions.push_back(
+                AsyncIoCompletion{ State->UserData, 0, 0 });
+            delete State;
+        }
+        else
+        {
+            this->m_PendingOperations.insert(
+                this->m_PendingOperations.end(),
+                Operations.begin(),
+                Operations.end());
+        }
+    }
+
+    if (Operations.empty())
+    {
+        this->m_CompletionAvailable.notify_all();
+        return;
+    }
+
+#if defined(_WIN32)
+    this->IssueOperations();
+#else
+    if (Operations.size() == 1)
+    {
+        this->m_OperationAvailable.notify_one();
+    }
+    else
+    {
+        this->m_OperationAvailable.notify_all();
+    }
+#endif
+}
+
+std::size_t Mile::AsyncIoQueue::Reap(
+    AsyncIoCompletion* Completions,
+    std::size_t MaximumCount,
+    bool Wait)
+{
+    if (!MaximumCount)
+    {
+        return 0;
+    }
+
+#if defined(_WIN32)
+    bool Polled = false;
+#endif
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> Lock(this->m_Mutex);
+
+#if !defined(_WIN32)
+            if (Wait)
+            {
+                this->m_CompletionAvailable.wait(Lock, [this]()
+                {
+                    return !this->m_Completions.empty() ||
+                        !this->m_OutstandingRequests;
+                });
+            }
+#endif
+
+            if (!this->m_Completions.empty())
+            {
+                std::size_t Count = (std::min)(
+                    MaximumCount,
+                    this->m_Completions.size());
+                std::copy_n(
+                    this->m_Completions.begin(),
+                    Count,
+                    Completions);
+                this->m_Completions.erase(
+                    this->m_Completions.begin(),
+                    this->m_Completions.begin() + Count);
+                this->m_OutstandingRequests -= Count;
+                return Count;
+            }
+
+            if (!this->m_OutstandingRequests)
+            {
+                return 0;
+            }
+
+#if defined(_WIN32)
+            if (!Wait && Polled)
+            {
+                return 0;
+            }
+#else
+            return 0;
+#endif
+        }
+
+#if defined(_WIN32)
+        this->DrainCompletionPort(Wait);
+        Polled = true;
+#endif
+    }
+}
+
+std::size_t Mile::AsyncIoQueue::GetOutstandingRequests()
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_OutstandingRequests;
+}
+
+void Mile::AsyncIoQueue::CompleteOperation(
+    Operation* Item,
+    std::uint64_t Bytes,
+    int ErrorCode)
+{
+    RequestState* State = Item->Request;
+    delete Item;
+
+    State->Bytes += Bytes;
+    if (ErrorCode)
+    {
+        int Expected = 0;
+        State->ErrorCode.compare_exchange_strong(Expected, ErrorCode);
+    }
+
+    if (State->RemainingOperations.fetch_sub(1) != 1)
+    {
+        return;
+    }
+
+    AsyncIoCompletion Completion;
+    Completion.UserData = State->UserData;
+    Completion.Bytes = State->Bytes;
+    Completion.ErrorCode = State->ErrorCode;
+    delete State;
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        this->m_Completions.push_back(Completion);
+    }
+    this->m_CompletionAvailable.notify_all();
+}
+
+#if defined(_WIN32)
+
+void Mile::AsyncIoQueue::IssueOperations()
+{
+    for (;;)
+    {
+        Operation* Item = nullptr;
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            if (this->m_PendingOperations.empty() ||
+                this->m_InFlightOperations >= this->m_Options.QueueDepth)
+            {
+                return;
+            }
+            Item = this->m_PendingOperations.front();
+            this->m_PendingOperations.pop_front();
+            ++this->m_InFlightOperations;
+        }
+
+        std::memset(&Item->Overlapped, 0, sizeof(Item->Overlapped));
+        Item->Overlapped.Offset = static_cast<DWORD>(Item->Offset);
+        Item->Overlapped.OffsetHigh = static_cast<DWORD>(Item->Offset >> 32);
+
+        BOOL Result = FALSE;
+        if (Item->Kind == AsyncIoOperation::Read)
+        {
+            Result = ::ReadFile(
+                Item->File,
+                Item->Buffers[0].Data,
+                static_cast<DWORD>(Item->Length),
+                nullptr,
+                &Item->Overlapped);
+        }
+        else
+        {
+            Result = ::WriteFile(
+                Item->File,
+                Item->Buffers[0].Data,
+                static_cast<DWORD>(Item->Length),
+                nullptr,
+                &Item->Overlapped);
+        }
+
+        // A completion packet is queued unless the call fails immediately.
+        if (!Result)
+        {
+            DWORD Error = ::GetLastError();
+            if (Error != ERROR_IO_PENDING)
+            {
+                {
+                    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+                    --this->m_InFlightOperations;
+                }
+                this->CompleteOperation(
+                    Item,
+                    0,
+                    Error == ERROR_HANDLE_EOF ? 0 : static_cast<int>(Error));
+            }
+        }
+    }
+}
+
+bool Mile::AsyncIoQueue::DrainCompletionPort(
+    bool Wait)
+{
+    // Wake up periodically while waiting, because another thread may drain
+    // the packet which completes the last outstanding request.
+    const DWORD WaitInterval = 100;
+
+    OVERLAPPED_ENTRY Entries[64];
+    ULONG Removed = 0;
+    if (!::GetQueuedCompletionStatusEx(
+        this->m_CompletionPort,
+        Entries,
+        static_cast<ULONG>(sizeof(Entries) / sizeof(*Entries)),
+        &Removed,
+        Wait ? WaitInterval : 0,
+        FALSE))
+    {
+        return false;
+    }
+
+    for (ULONG i = 0; i < Removed; ++i)
+    {
+        Operation* Item = reinterpret_cast<Operation*>(
+            Entries[i].lpOverlapped);
+
+        DWORD Bytes = 0;
+        int Error = 0;
+        if (!::GetOverlappedResult(
+            Item->File,
+            &Item->Overlapped,
+            &Bytes,
+            FALSE))
+        {
+            DWORD LastError = ::GetLastError();
+            if (LastError != ERROR_HANDLE_EOF)
+            {
+                Error = static_cast<int>(LastError);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            --this->m_InFlightOperations;
+        }
+        this->CompleteOperation(Item, Bytes, Error);
+    }
+
+    this->IssueOperations();
+
+    return true;
+}
+
+#else
+
+void Mile::AsyncIoQueue::WorkerMain()
+{
+    for (;;)
+    {
+        Operation* Item = nullptr;
+        {
+            std::unique_lock<std::mutex> Lock(this->m_Mutex);
+            this->m_OperationAvailable.wait(Lock, [this]()
+            {
+                return this->m_Terminating ||
+                    !this->m_PendingOperations.empty();
+            });
+
+            // Finish the pending operations before terminating, so every
+            // request is completed.
+            if (this->m_PendingOperations.empty())
+            {
+                return;
+            }
+            Item = this->m_PendingOperations.front();
+            this->m_PendingOperations.pop_front();
+            ++this->m_InFlightOperations;
+        }
+
+        this->ExecuteOperation(Item);
+    }
+}
+
+void Mile::AsyncIoQueue::ExecuteOperation(
+    Operation* Item)
+{
+    std::vector<iovec> Vectors;
+    Vectors.reserve(Item->Buffers.size());
+    for (AsyncIoBuffer const& Buffer : Item->Buffers)
+    {
+        Vectors.push_back(iovec{ Buffer.Data, Buffer.Size });
+    }
+
+    // preadv and pwritev may transfer fewer bytes than requested, so repeat
+    // them on the remaining pieces.
+    std::uint64_t Bytes = 0;
+    int Error = 0;
+    std::size_t First = 0;
+    while (First < Vectors.size())
+    {
+        int Count = static_cast<int>(std::min<std::size_t>(
+            Vectors.size() - First,
+            IOV_MAX));
+        off_t Offset = static_cast<off_t>(Item->Offset + Bytes);
+        ssize_t Result = Item->Kind == AsyncIoOperation::Read
+            ? ::preadv(Item->File, &Vectors[First], Count, Offset)
+            : ::pwritev(Item->File, &Vectors[First], Count, Offset);
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            Error = errno;
+            break;
+        }
+        if (Result == 0)
+        {
+            // The end of the file.
+            break;
+        }
+
+        Bytes += static_cast<std::uint64_t>(Result);
+
+        std::size_t Transferred = static_cast<std::size_t>(Result);
+        while (First < Vectors.size() &&
+            Transferred >= Vectors[First].iov_len)
+        {
+            Transferred -= Vectors[First].iov_len;
+            ++First;
+        }
+        if (Transferred)
+        {
+            Vectors[First].iov_base =
+                reinterpret_cast<std::uint8_t*>(
+                    Vectors[First].iov_base) + Transferred;
+            Vectors[First].iov_len -= Transferred;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        --this->m_InFlightOperations;
+    }
+    this->CompleteOperation(Item, Bytes, Error);
+}
+
+#endif
@@ -0,0 +1,274 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.AsyncIo.h
+ * PURPOSE:   Definition for the asynchronous file I/O queue
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_ASYNCIO
+#define MILE_PORTABLE_ASYNCIO
+
+#include "Mile.Portable.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Mile
+{
+    /**
+     * @brief The file handle type used by the asynchronous I/O queue. It is
+     *        a HANDLE on Windows and a file descriptor elsewhere.
+    */
+#if defined(_WIN32)
+    typedef void* AsyncIoFileHandle;
+#else
+    typedef int AsyncIoFileHandle;
+#endif
+
+    /**
+     * @brief The kind of an asynchronous I/O request.
+    */
+    enum class AsyncIoOperation : std::uint8_t
+    {
+        Read,
+        Write,
+    };
+
+    /**
+     * @brief How AsyncIoQueue::OpenFile opens a file.
+    */
+    enum class AsyncIoAccess : std::uint8_t
+    {
+        /**
+         * @brief Opens an existing file for reading.
+        */
+        Read,
+
+        /**
+         * @brief Creates a file for writing, or truncates an existing one.
+        */
+        Write,
+
+        /**
+         * @brief Opens an existing file for reading and writing.
+        */
+        ReadWrite,
+    };
+
+    /**
+     * @brief A buffer of an asynchronous I/O request.
+    */
+    struct AsyncIoBuffer
+    {
+        void* Data;
+        std::size_t Size;
+    };
+
+    /**
+     * @brief An asynchronous I/O request. The buffers are read or written
+     *        in order, starting at Offset, so a request with more than one
+     *        buffer is a scatter read or a gather write.
+     * @remark The file and the memory of the buffers must stay valid until
+     *         the completion of the request is reaped. The array of the
+     *         buffers is copied when the request is submitted.
+    */
+    struct AsyncIoRequest
+    {
+        AsyncIoFileHandle File;
+        AsyncIoOperation Operation;
+        std::uint64_t Offset;
+        AsyncIoBuffer const* Buffers;
+        std::size_t BufferCount;
+
+        /**
+         * @brief A value returned with the completion of the request.
+        */
+        void* UserData;
+    };
+
+    /**
+     * @brief The completion of an asynchronous I/O request.
+    */
+    struct AsyncIoCompletion
+    {
+        /**
+         * @brief The UserData of the request.
+        */
+        void* UserData;
+
+        /**
+         * @brief The number of bytes transferred. A read which reaches the
+         *        end of the file transfers fewer bytes than requested.
+        */
+        std::uint64_t Bytes;
+
+        /**
+         * @brief Zero if the request succeeded, otherwise the Win32 error
+         *        code on Windows or the errno value elsewhere.
+        */
+        int ErrorCode;
+    };
+
+    /**
+     * @brief The options of an asynchronous I/O queue.
+    */
+    struct AsyncIoQueueOptions
+    {
+        /**
+         * @brief The maximum number of operations in flight. Use one queue
+         *        per volume to keep every volume busy.
+        */
+        std::size_t QueueDepth = 32;
+
+        /**
+         * @brief Requests are split into operations of at most this many
+         *        bytes, so large transfers are spread over the queue depth.
+        */
+        std::size_t ChunkSize = 1024 * 1024;
+    };
+
+    /**
+     * @brief A queue of asynchronous file I/O requests. Requests are added
+     *        to the submission queue by Submit and their completions are
+     *        retrieved by Reap. The Windows backend uses overlapped I/O and
+     *        an I/O completion port. Other platforms use a pool of threads
+     *        running preadv and pwritev.
+     * @remark Submit can be called from any thread. Reap should be called
+     *         from a single thread at a time.
+    */
+    class AsyncIoQueue : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        struct RequestState;
+        struct Operation;
+
+        AsyncIoQueueOptions m_Options;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_CompletionAvailable;
+        std::deque<Operation*> m_PendingOperations;
+        std::deque<AsyncIoCompletion> m_Completions;
+        std::size_t m_InFlightOperations = 0;
+        std::size_t m_OutstandingRequests = 0;
+
+#if defined(_WIN32)
+        void* m_CompletionPort = nullptr;
+
+        void IssueOperations();
+
+        bool DrainCompletionPort(
+            bool Wait);
+#else
+        std::condition_variable m_OperationAvailable;
+        std::vector<std::thread> m_Workers;
+        bool m_Terminating = false;
+
+        void WorkerMain();
+
+        void ExecuteOperation(
+            Operation* Item);
+#endif
+
+        void CompleteOperation(
+            Operation* Item,
+            std::uint64_t Bytes,
+            int ErrorCode);
+
+    public:
+
+        /**
+         * @brief Creates the queue.
+         * @param Options The options of the queue.
+        */
+        explicit AsyncIoQueue(
+            AsyncIoQueueOptions const& Options = AsyncIoQueueOptions());
+
+        /**
+         * @brief Waits for all requests in flight and destroys the queue.
+         *        Completions which have not been reaped are discarded.
+        */
+        ~AsyncIoQueue();
+
+        /**
+         * @brief Opens a file for asynchronous I/O and associates it with
+         *        the queue.
+         * @param Path The path of the file.
+         * @param Access How to open the file.
+         * @param File The handle of the opened file. Close it with
+         *             CloseFile after all its requests are completed.
+         * @return Zero if successful, otherwise the Win32 error code on
+         *         Windows or the errno value elsewhere.
+        */
+        int OpenFile(
+            NativeString const& Path,
+            AsyncIoAccess Access,
+            AsyncIoFileHandle& File);
+
+        /**
+         * @brief Associates a file opened by the caller with the queue. On
+         *        Windows, it must be opened with FILE_FLAG_OVERLAPPED and
+         *        can only be associated with one queue.
+         * @param File The handle of the file.
+         * @return Zero if successful, otherwise the error code.
+        */
+        int AttachFile(
+            AsyncIoFileHandle File);
+
+        /**
+         * @brief Closes a file opened by OpenFile.
+         * @param File The handle of the file.
+        */
+        static void CloseFile(
+            AsyncIoFileHandle File) noexcept;
+
+        /**
+         * @brief Retrieves the size of a file.
+         * @param File The handle of the file.
+         * @param Size The size of the file, in bytes.
+         * @return Zero if successful, otherwise the error code.
+        */
+        static int GetFileSize(
+            AsyncIoFileHandle File,
+            std::uint64_t& Size) noexcept;
+
+        /**
+         * @brief Adds a request to the submission queue. It does not wait
+         *        for the request.
+         * @param Request The request.
+        */
+        void Submit(
+            AsyncIoRequest const& Request);
+
+        /**
+         * @brief Retrieves completions from the completion queue.
+         * @param Completions The array which receives the completions.
+         * @param MaximumCount The maximum number of completions to
+         *                     retrieve.
+         * @param Wait If true, waits until at least one completion is
+         *             available or no request is in flight.
+         * @return The number of retrieved completions.
+        */
+        std::size_t Reap(
+            AsyncIoCompletion* Completions,
+            std::size_t MaximumCount,
+            bool Wait);
+
+        /**
+         * @brief Retrieves the number of requests which are submitted and
+         *        not reaped yet.
+         * @return The number of outstanding requests.
+        */
+        std::size_t GetOutstandingRequests();
+    };
+}
+
+#endif // !MILE_PORTABLE_ASYNCIO
@@ -0,0 +1,617 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.CaseInsensitive.cpp
+ * PURPOSE:   Implementation for the case-insensitive string primitives
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.CaseInsensitive.h"
+
+#include <cstring>
+#include <type_traits>
+
+// Define MILE_CASE_INSENSITIVE_NO_SSE2 to build the scalar path only, which
+// the tests use to check the paths against each other.
+#if !defined(MILE_CASE_INSENSITIVE_NO_SSE2) && \
+    (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__))
+#define MILE_CASE_INSENSITIVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    /**
+     * @brief A run of characters with the same uppercase mapping delta. The
+     *        run covers every Stride-th character from First to Last.
+    */
+    struct CaseMappingRange
+    {
+        std::uint16_t First;
+        std::uint16_t Last;
+        std::int32_t Delta;
+        std::uint16_t Stride;
+    };
+
+    /**
+     * @brief The simple uppercase mappings of the non-ASCII characters of
+     *        the Basic Multilingual Plane, generated from UnicodeData.txt of
+     *        Unicode 14.0. Mappings to multiple characters like U+00DF are
+     *        not included.
+    */
+    const CaseMappingRange g_UppercaseMappings[] =
+    {
+        { 0x00B5, 0x00B5, 743, 1 },
+        { 0x00E0, 0x00F6, -32, 1 },
+        { 0x00F8, 0x00FE, -32, 1 },
+        { 0x00FF, 0x00FF, 121, 1 },
+        { 0x0101, 0x012F, -1, 2 },
+        { 0x0131, 0x0131, -232, 1 },
+        { 0x0133, 0x0137, -1, 2 },
+        { 0x013A, 0x0148, -1, 2 },
+        { 0x014B, 0x0177, -1, 2 },
+        { 0x017A, 0x017E, -1, 2 },
+        { 0x017F, 0x017F, -300, 1 },
+        { 0x0180, 0x0180, 195, 1 },
+        { 0x0183, 0x0185, -1, 2 },
+        { 0x0188, 0x0188, -1, 1 },
+        { 0x018C, 0x018C, -1, 1 },
+        { 0x0192, 0x0192, -1, 1 },
+        { 0x0195, 0x0195, 97, 1 },
+        { 0x0199, 0x0199, -1, 1 },
+        { 0x019A, 0x019A, 163, 1 },
+        { 0x019E, 0x019E, 130, 1 },
+        { 0x01A1, 0x01A5, -1, 2 },
+        { 0x01A8, 0x01A8, -1, 1 },
+        { 0x01AD, 0x01AD, -1, 1 },
+        { 0x01B0, 0x01B0, -1, 1 },
+        { 0x01B4, 0x01B6, -1, 2 },
+        { 0x01B9, 0x01B9, -1, 1 },
+        { 0x01BD, 0x01BD, -1, 1 },
+        { 0x01BF, 0x01BF, 56, 1 },
+        { 0x01C5, 0x01C5, -1, 1 },
+        { 0x01C6, 0x01C6, -2, 1 },
+        { 0x01C8, 0x01C8, -1, 1 },
+        { 0x01C9, 0x01C9, -2, 1 },
+        { 0x01CB, 0x01CB, -1, 1 },
+        { 0x01CC, 0x01CC, -2, 1 },
+        { 0x01CE, 0x01DC, -1, 2 },
+        { 0x01DD, 0x01DD, -79, 1 },
+        { 0x01DF, 0x01EF, -1, 2 },
+        { 0x01F2, 0x01F2, -1, 1 },
+        { 0x01F3, 0x01F3, -2, 1 },
+        { 0x01F5, 0x01F5, -1, 1 },
+        { 0x01F9, 0x021F, -1, 2 },
+        { 0x0223, 0x0233, -1, 2 },
+        { 0x023C, 0x023C, -1, 1 },
+        { 0x023F, 0x0240, 10815, 1 },
+        { 0x0242, 0x0242, -1, 1 },
+        { 0x0247, 0x024F, -1, 2 },
+        { 0x0250, 0x0250, 10783, 1 },
+        { 0x0251, 0x0251, 10780, 1 },
+        { 0x0252, 0x0252, 10782, 1 },
+        { 0x0253, 0x0253, -210, 1 },
+        { 0x0254, 0x0254, -206, 1 },
+        { 0x0256, 0x0257, -205, 1 },
+        { 0x0259, 0x0259, -202, 1 },
+        { 0x025B, 0x025B, -203, 1 },
+        { 0x025C, 0x025C, 42319, 1 },
+        { 0x0260, 0x0260, -205, 1 },
+        { 0x0261, 0x0261, 42315, 1 },
+        { 0x0263, 0x0263, -207, 1 },
+        { 0x0265, 0x0265, 42280, 1 },
+        { 0x0266, 0x0266, 42308, 1 },
+        { 0x0268, 0x0268, -209, 1 },
+        { 0x0269, 0x0269, -211, 1 },
+        { 0x026A, 0x026A, 42308, 1 },
+        { 0x026B, 0x026B, 10743, 1 },
+        { 0x026C, 0x026C, 42305, 1 },
+        { 0x026F, 0x026F, -211, 1 },
+        { 0x0271, 0x0271, 10749, 1 },
+        { 0x0272, 0x0272, -213, 1 },
+        { 0x0275, 0x0275, -214, 1 },
+        { 0x027D, 0x027D, 10727, 1 },
+        { 0x0280, 0x0280, -218, 1 },
+        { 0x0282, 0x0282, 42307, 1 },
+        { 0x0283, 0x0283, -218, 1 },
+        { 0x0287, 0x0287, 42282, 1 },
+        { 0x0288, 0x0288, -218, 1 },
+        { 0x0289, 0x0289, -69, 1 },
+        { 0x028A, 0x028B, -217, 1 },
+        { 0x028C, 0x028C, -71, 1 },
+        { 0x0292, 0x0292, -219, 1 },
+        { 0x029D, 0x029D, 42261, 1 },
+        { 0x029E, 0x029E, 42258, 1 },
+        { 0x0345, 0x0345, 84, 1 },
+        { 0x0371, 0x0373, -1, 2 },
+        { 0x0377, 0x0377, -1, 1 },
+        { 0x037B, 0x037D, 130, 1 },
+        { 0x03AC, 0x03AC, -38, 1 },
+        { 0x03AD, 0x03AF, -37, 1 },
+        { 0x03B1, 0x03C1, -32, 1 },
+        { 0x03C2, 0x03C2, -31, 1 },
+        { 0x03C3, 0x03CB, -32, 1 },
+        { 0x03CC, 0x03CC, -64, 1 },
+        { 0x03CD, 0x03CE, -63, 1 },
+        { 0x03D0, 0x03D0, -62, 1 },
+        { 0x03D1, 0x03D1, -57, 1 },
+        { 0x03D5, 0x03D5, -47, 1 },
+        { 0x03D6, 0x03D6, -54, 1 },
+        { 0x03D7, 0x03D7, -8, 1 },
+        { 0x03D9, 0x03EF, -1, 2 },
+        { 0x03F0, 0x03F0, -86, 1 },
+        { 0x03F1, 0x03F1, -80, 1 },
+        { 0x03F2, 0x03F2, 7, 1 },
+        { 0x03F3, 0x03F3, -116, 1 },
+        { 0x03F5, 0x03F5, -96, 1 },
+        { 0x03F8, 0x03F8, -1, 1 },
+        { 0x03FB, 0x03FB, -1, 1 },
+        { 0x0430, 0x044F, -32, 1 },
+        { 0x0450, 0x045F, -80, 1 },
+        { 0x0461, 0x0481, -1, 2 },
+        { 0x048B, 0x04BF, -1, 2 },
+        { 0x04C2, 0x04CE, -1, 2 },
+        { 0x04CF, 0x04CF, -15, 1 },
+        { 0x04D1, 0x052F, -1, 2 },
+        { 0x0561, 0x0586, -48, 1 },
+        { 0x10D0, 0x10FA, 3008, 1 },
+        { 0x10FD, 0x10FF, 3008, 1 },
+        { 0x13F8, 0x13FD, -8, 1 },
+        { 0x1C80, 0x1C80, -6254, 1 },
+        { 0x1C81, 0x1C81, -6253, 1 },
+        { 0x1C82, 0x1C82, -6244, 1 },
+        { 0x1C83, 0x1C84, -6242, 1 },
+        { 0x1C85, 0x1C85, -6243, 1 },
+        { 0x1C86, 0x1C86, -6236, 1 },
+        { 0x1C87, 0x1C87, -6181, 1 },
+        { 0x1C88, 0x1C88, 35266, 1 },
+        { 0x1D79, 0x1D79, 35332, 1 },
+        { 0x1D7D, 0x1D7D, 3814, 1 },
+        { 0x1D8E, 0x1D8E, 35384, 1 },
+        { 0x1E01, 0x1E95, -1, 2 },
+        { 0x1E9B, 0x1E9B, -59, 1 },
+        { 0x1EA1, 0x1EFF, -1, 2 },
+        { 0x1F00, 0x1F07, 8, 1 },
+        { 0x1F10, 0x1F15, 8, 1 },
+        { 0x1F20, 0x1F27, 8, 1 },
+        { 0x1F30, 0x1F37, 8, 1 },
+        { 0x1F40, 0x1F45, 8, 1 },
+        { 0x1F51, 0x1F57, 8, 2 },
+        { 0x1F60, 0x1F67, 8, 1 },
+        { 0x1F70, 0x1F71, 74, 1 },
+        { 0x1F72, 0x1F75, 86, 1 },
+        { 0x1F76, 0x1F77, 100, 1 },
+        { 0x1F78, 0x1F79, 128, 1 },
+        { 0x1F7A, 0x1F7B, 112, 1 },
+        { 0x1F7C, 0x1F7D, 126, 1 },
+        { 0x1FB0, 0x1FB1, 8, 1 },
+        { 0x1FBE, 0x1FBE, -7205, 1 },
+        { 0x1FD0, 0x1FD1, 8, 1 },
+        { 0x1FE0, 0x1FE1, 8, 1 },
+        { 0x1FE5, 0x1FE5, 7, 1 },
+        { 0x214E, 0x214E, -28, 1 },
+        { 0x2170, 0x217F, -16, 1 },
+        { 0x2184, 0x2184, -1, 1 },
+        { 0x24D0, 0x24E9, -26, 1 },
+        { 0x2C30, 0x2C5F, -48, 1 },
+        { 0x2C61, 0x2C61, -1, 1 },
+        { 0x2C65, 0x2C65, -10795, 1 },
+        { 0x2C66, 0x2C66, -10792, 1 },
+        { 0x2C68, 0x2C6C, -1, 2 },
+        { 0x2C73, 0x2C73, -1, 1 },
+        { 0x2C76, 0x2C76, -1, 1 },
+        { 0x2C81, 0x2CE3, -1, 2 },
+        { 0x2CEC, 0x2CEE, -1, 2 },
+        { 0x2CF3, 0x2CF3, -1, 1 },
+        { 0x2D00, 0x2D25, -7264, 1 },
+        { 0x2D27, 0x2D27, -7264, 1 },
+        { 0x2D2D, 0x2D2D, -7264, 1 },
+        { 0xA641, 0xA66D, -1, 2 },
+        { 0xA681, 0xA69B, -1, 2 },
+        { 0xA723, 0xA72F, -1, 2 },
+        { 0xA733, 0xA76F, -1, 2 },
+        { 0xA77A, 0xA77C, -1, 2 },
+        { 0xA77F, 0xA787, -1, 2 },
+        { 0xA78C, 0xA78C, -1, 1 },
+        { 0xA791, 0xA793, -1, 2 },
+        { 0xA794, 0xA794, 48, 1 },
+        { 0xA797, 0xA7A9, -1, 2 },
+        { 0xA7B5, 0xA7C3, -1, 2 },
+        { 0xA7C8, 0xA7CA, -1, 2 },
+        { 0xA7D1, 0xA7D1, -1, 1 },
+        { 0xA7D7, 0xA7D9, -1, 2 },
+        { 0xA7F6, 0xA7F6, -1, 1 },
+        { 0xAB53, 0xAB53, -928, 1 },
+        { 0xAB70, 0xABBF, -38864, 1 },
+        { 0xFF41, 0xFF5A, -32, 1 },
+    };
+
+    std::uint32_t FoldCodeUnit(
+        std::uint32_t Value) noexcept
+    {
+        if (Value < 0x80)
+        {
+            return (Value - 'a' < 26u) ? Value - 0x20 : Value;
+        }
+
+        if (Value < g_UppercaseMappings[0].First || Value > 0xFFFF)
+        {
+            return Value;
+        }
+
+        // Find the last range which starts at or before the value.
+        std::size_t Low = 0;
+        std::size_t High =
+            sizeof(g_UppercaseMappings) / sizeof(*g_UppercaseMappings);
+        while (High - Low > 1)
+        {
+            std::size_t Middle = (Low + High) / 2;
+            if (g_UppercaseMappings[Middle].First <= Value)
+            {
+                Low = Middle;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        CaseMappingRange const& Range = g_UppercaseMappings[Low];
+        if (Value <= Range.Last && 0 == (Value - Range.First) % Range.Stride)
+        {
+            return static_cast<std::uint32_t>(
+                static_cast<std::int32_t>(Value) + Range.Delta);
+        }
+
+        return Value;
+    }
+
+    template<typename CharType>
+    using UnitType = typename std::make_unsigned<CharType>::type;
+
+    template<typename CharType>
+    UnitType<CharType> FoldUnit(
+        CharType Character) noexcept
+    {
+        const UnitType<CharType> Value =
+            static_cast<UnitType<CharType>>(Character);
+
+        if constexpr (sizeof(CharType) == 1)
+        {
+            return (static_cast<std::uint32_t>(Value) - 'a' < 26u)
+                ? static_cast<UnitType<CharType>>(Value - 0x20)
+                : Value;
+        }
+
+        return static_cast<UnitType<CharType>>(::FoldCodeUnit(Value));
+    }
+
+    /**
+     * @brief The number of characters processed at a time. The SSE2 and
+     *        the scalar paths use the same blocks, so the hash does not
+     *        depend on the path.
+    */
+    template<typename CharType>
+    constexpr std::size_t BlockLength = 16 / sizeof(CharType);
+
+#ifdef MILE_CASE_INSENSITIVE_SSE2
+
+    template<std::size_t Width>
+    struct SimdTraits;
+
+    template<>
+    struct SimdTraits<1>
+    {
+        static bool IsAscii(__m128i Value) noexcept
+        {
+            return 0 == _mm_movemask_epi8(Value);
+        }
+
+        static __m128i Fold(__m128i Value) noexcept
+        {
+            // The compares are signed, so non-ASCII bytes are never in the
+            // range of the lowercase letters.
+            __m128i IsLowercase = _mm_and_si128(
+                _mm_cmpgt_epi8(Value, _mm_set1_epi8('a' - 1)),
+                _mm_cmplt_epi8(Value, _mm_set1_epi8('z' + 1)));
+            return _mm_sub_epi8(
+                Value,
+                _mm_and_si128(IsLowercase, _mm_set1_epi8(0x20)));
+        }
+    };
+
+    template<>
+    struct SimdTraits<2>
+    {
+        static bool IsAscii(__m128i Value) noexcept
+        {
+            __m128i HighBits = _mm_and_si128(
+                Value,
+                _mm_set1_epi16(static_cast<short>(0xFF80)));
+            return 0xFFFF == _mm_movemask_epi8(
+                _mm_cmpeq_epi16(HighBits, _mm_setzero_si128()));
+        }
+
+        static __m128i Fold(__m128i Value) noexcept
+        {
+            __m128i IsLowercase = _mm_and_si128(
+                _mm_cmpgt_epi16(Value, _mm_set1_epi16('a' - 1)),
+                _mm_cmplt_epi16(Value, _mm_set1_epi16('z' + 1)));
+            return _mm_sub_epi16(
+                Value,
+                _mm_and_si128(IsLowercase, _mm_set1_epi16(0x20)));
+        }
+    };
+
+    template<>
+    struct SimdTraits<4>
+    {
+        static bool IsAscii(__m128i Value) noexcept
+        {
+            __m128i HighBits = _mm_and_si128(
+                Value,
+                _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+            return 0xFFFF == _mm_movemask_epi8(
+                _mm_cmpeq_epi32(HighBits, _mm_setzero_si128()));
+        }
+
+        static __m128i Fold(__m128i Value) noexcept
+        {
+            __m128i IsLowercase = _mm_and_si128(
+                _mm_cmpgt_epi32(Value, _mm_set1_epi32('a' - 1)),
+                _mm_cmplt_epi32(Value, _mm_set1_epi32('z' + 1)));
+            return _mm_sub_epi32(
+                Value,
+                _mm_and_si128(IsLowercase, _mm_set1_epi32(0x20)));
+        }
+    };
+
+    bool IsSameBlock(
+        __m128i Left,
+        __m128i Right) noexcept
+    {
+        return 0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(Left, Right));
+    }
+
+#endif
+
+    template<typename CharType>
+    int CompareScalar(
+        CharType const* Left,
+        CharType const* Right,
+        std::size_t Length) noexcept
+    {
+        for (std::size_t i = 0; i < Length; ++i)
+        {
+            if (Left[i] == Right[i])
+            {
+                continue;
+            }
+
+            UnitType<CharType> LeftUnit = ::FoldUnit(Left[i]);
+            UnitType<CharType> RightUnit = ::FoldUnit(Right[i]);
+            if (LeftUnit != RightUnit)
+            {
+                return LeftUnit < RightUnit ? -1 : 1;
+            }
+        }
+
+        return 0;
+    }
+
+    template<typename CharType>
+    int CompareUnits(
+        CharType const* Left,
+        CharType const* Right,
+        std::size_t Length) noexcept
+    {
+        std::size_t Index = 0;
+
+#ifdef MILE_CASE_INSENSITIVE_SSE2
+        using Traits = SimdTraits<sizeof(CharType)>;
+
+        for (; Index + BlockLength<CharType> <= Length;
+            Index += BlockLength<CharType>)
+        {
+            __m128i LeftBlock = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(Left + Index));
+            __m128i RightBlock = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(Right + Index));
+
+            if (::IsSameBlock(LeftBlock, RightBlock))
+            {
+                continue;
+            }
+
+            if (Traits::IsAscii(_mm_or_si128(LeftBlock, RightBlock)) &&
+                ::IsSameBlock(
+                    Traits::Fold(LeftBlock),
+                    Traits::Fold(RightBlock)))
+            {
+                continue;
+            }
+
+            // There is a difference or a non-ASCII character in the block.
+            int Result = ::CompareScalar(
+                Left + Index,
+                Right + Index,
+                BlockLength<CharType>);
+            if (Result)
+            {
+                return Result;
+            }
+        }
+#endif
+
+        return ::CompareScalar(Left + Index, Right + Index, Length - Index);
+    }
+
+    template<typename CharType>
+    int CompareStrings(
+        std::basic_string_view<CharType> Left,
+        std::basic_string_view<CharType> Right) noexcept
+    {
+        const std::size_t Length =
+            Left.size() < Right.size() ? Left.size() : Right.size();
+
+        int Result = ::CompareUnits(Left.data(), Right.data(), Length);
+        if (Result)
+        {
+            return Result;
+        }
+
+        if (Left.size() == Right.size())
+        {
+            return 0;
+        }
+
+        return Left.size() < Right.size() ? -1 : 1;
+    }
+
+    std::uint64_t MixBlock(
+        std::uint64_t Hash,
+        std::uint64_t Low,
+        std::uint64_t High) noexcept
+    {
+        Hash = (Hash ^ Low) * 0x9E3779B97F4A7C15ULL;
+        Hash = ((Hash << 29) | (Hash >> 35)) ^ High;
+        return Hash * 0xBF58476D1CE4E5B9ULL;
+    }
+
+    template<typename CharType>
+    std::uint64_t MixFoldedBlock(
+        std::uint64_t Hash,
+        CharType const* Block,
+        std::size_t Length) noexcept
+    {
+        UnitType<CharType> Folded[BlockLength<CharType>] = {};
+        for (std::size_t i = 0; i < Length; ++i)
+        {
+            Folded[i] = ::FoldUnit(Block[i]);
+        }
+
+        std::uint64_t Words[2];
+        std::memcpy(Words, Folded, sizeof(Words));
+        return ::MixBlock(Hash, Words[0], Words[1]);
+    }
+
+    template<typename CharType>
+    std::size_t HashString(
+        std::basic_string_view<CharType> String) noexcept
+    {
+        CharType const* Data = String.data();
+        const std::size_t Length = String.size();
+
+        std::uint64_t Hash = 0x84222325CBF29CE4ULL ^ Length;
+        std::size_t Index = 0;
+
+        for (; Index + BlockLength<CharType> <= Length;
+            Index += BlockLength<CharType>)
+        {
+#ifdef MILE_CASE_INSENSITIVE_SSE2
+            using Traits = SimdTraits<sizeof(CharType)>;
+
+            __m128i Block = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(Data + Index));
+            if (Traits::IsAscii(Block))
+            {
+                std::uint64_t Words[2];
+                _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(Words),
+                    Traits::Fold(Block));
+                Hash = ::MixBlock(Hash, Words[0], Words[1]);
+                continue;
+            }
+#endif
+
+            Hash = ::MixFoldedBlock(
+                Hash,
+                Data + Index,
+                BlockLength<CharType>);
+        }
+
+        if (Index < Length)
+        {
+            Hash = ::MixFoldedBlock(Hash, Data + Index, Length - Index);
+        }
+
+        Hash ^= Hash >> 31;
+        Hash *= 0x94D049BB133111EBULL;
+        Hash ^= Hash >> 29;
+        return static_cast<std::size_t>(Hash);
+    }
+}
+
+wchar_t Mile::CaseInsensitiveFold(
+    wchar_t Character) noexcept
+{
+    return static_cast<wchar_t>(::FoldUnit(Character));
+}
+
+char Mile::CaseInsensitiveFold(
+    char Character) noexcept
+{
+    return static_cast<char>(::FoldUnit(Character));
+}
+
+int Mile::CaseInsensitiveCompare(
+    std::wstring_view Left,
+    std::wstring_view Right) noexcept
+{
+    return ::CompareStrings(Left, Right);
+}
+
+int Mile::CaseInsensitiveCompare(
+    std::string_view Left,
+    std::string_view Right) noexcept
+{
+    return ::CompareStrings(Left, Right);
+}
+
+bool Mile::CaseInsensitiveEquals(
+    std::wstring_view Left,
+    std::wstring_view Right) noexcept
+{
+    // The folding maps a code unit to a single code unit, so strings with
+    // different lengths are never equal.
+    return Left.size() == Right.size() &&
+        0 == ::CompareUnits(Left.data(), Right.data(), Left.size());
+}
+
+bool Mile::CaseInsensitiveEquals(
+    std::string_view Left,
+    std::string_view Right) noexcept
+{
+    return Left.size() == Right.size() &&
+        0 == ::CompareUnits(Left.data(), Right.data(), Left.size());
+}
+
+bool Mile::CaseInsensitiveStartsWith(
+    std::wstring_view String,
+    std::wstring_view Prefix) noexcept
+{
+    return String.size() >= Prefix.size() &&
+        0 == ::CompareUnits(String.data(), Prefix.data(), Prefix.size());
+}
+
+bool Mile::CaseInsensitiveStartsWith(
+    std::string_view String,
+    std::string_view Prefix) noexcept
+{
+    return String.size() >= Prefix.size() &&
+        0 == ::CompareUnits(String.data(), Prefix.data(), Prefix.size());
+}
+
+std::size_t Mile::CaseInsensitiveHash(
+    std::wstring_view String) noexcept
+{
+    return ::HashString(String);
+}
+
+std::size_t Mile::CaseInsensitiveHash(
+    std::string_view String) noexcept
+{
+    return ::HashString(String);
+}
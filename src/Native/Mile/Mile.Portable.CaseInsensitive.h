@@ -0,0 +1,197 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.CaseInsensitive.h
+ * PURPOSE:   Definition for the case-insensitive string primitives
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_CASEINSENSITIVE
+#define MILE_PORTABLE_CASEINSENSITIVE
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Mile
+{
+    /**
+     * @brief Folds the case of a character. Wide characters in the Basic
+     *        Multilingual Plane are mapped with the Unicode simple uppercase
+     *        mappings, which matches the case-insensitive comparison of
+     *        file names on Windows. Other characters are not changed.
+     * @param Character The character.
+     * @return The folded character.
+    */
+    wchar_t CaseInsensitiveFold(
+        wchar_t Character) noexcept;
+
+    /**
+     * @brief Folds the case of a character. Only the ASCII letters are
+     *        folded, so multibyte UTF-8 sequences are compared byte by byte.
+     * @param Character The character.
+     * @return The folded character.
+    */
+    char CaseInsensitiveFold(
+        char Character) noexcept;
+
+    /**
+     * @brief Compares two strings without regard to case. It is the
+     *        replacement of _wcsicmp and _stricmp.
+     * @param Left The first string.
+     * @param Right The second string.
+     * @return A negative value if Left is less than Right, zero if they are
+     *         equal, or a positive value if Left is greater than Right. The
+     *         strings are ordered by their folded code units.
+    */
+    int CaseInsensitiveCompare(
+        std::wstring_view Left,
+        std::wstring_view Right) noexcept;
+
+    /**
+     * @brief Compares two strings without regard to case. It is the
+     *        replacement of _wcsicmp and _stricmp.
+     * @param Left The first string.
+     * @param Right The second string.
+     * @return A negative value if Left is less than Right, zero if they are
+     *         equal, or a positive value if Left is greater than Right. The
+     *         strings are ordered by their folded code units.
+    */
+    int CaseInsensitiveCompare(
+        std::string_view Left,
+        std::string_view Right) noexcept;
+
+    /**
+     * @brief Checks whether two strings are equal without regard to case.
+     * @param Left The first string.
+     * @param Right The second string.
+     * @return true if the strings are equal, otherwise false.
+    */
+    bool CaseInsensitiveEquals(
+        std::wstring_view Left,
+        std::wstring_view Right) noexcept;
+
+    /**
+     * @brief Checks whether two strings are equal without regard to case.
+     * @param Left The first string.
+     * @param Right The second string.
+     * @return true if the strings are equal, otherwise false.
+    */
+    bool CaseInsensitiveEquals(
+        std::string_view Left,
+        std::string_view Right) noexcept;
+
+    /**
+     * @brief Checks whether a string starts with a prefix without regard to
+     *        case. It is the replacement of _wcsnicmp with the length of the
+     *        prefix.
+     * @param String The string.
+     * @param Prefix The prefix.
+     * @return true if the string starts with the prefix, otherwise false.
+    */
+    bool CaseInsensitiveStartsWith(
+        std::wstring_view String,
+        std::wstring_view Prefix) noexcept;
+
+    /**
+     * @brief Checks whether a string starts with a prefix without regard to
+     *        case.
+     * @param String The string.
+     * @param Prefix The prefix.
+     * @return true if the string starts with the prefix, otherwise false.
+    */
+    bool CaseInsensitiveStartsWith(
+        std::string_view String,
+        std::string_view Prefix) noexcept;
+
+    /**
+     * @brief Computes the hash of a string without regard to case. Strings
+     *        which are equal by CaseInsensitiveEquals have the same hash.
+     * @param String The string.
+     * @return The hash of the string.
+     * @remark The hash is not stable across versions, so do not persist it.
+    */
+    std::size_t CaseInsensitiveHash(
+        std::wstring_view String) noexcept;
+
+    /**
+     * @brief Computes the hash of a string without regard to case. Strings
+     *        which are equal by CaseInsensitiveEquals have the same hash.
+     * @param String The string.
+     * @return The hash of the string.
+     * @remark The hash is not stable across versions, so do not persist it.
+    */
+    std::size_t CaseInsensitiveHash(
+        std::string_view String) noexcept;
+
+    /**
+     * @brief The case-insensitive comparator for ordered containers like
+     *        std::map and std::set. It supports heterogeneous lookup.
+    */
+    struct CaseInsensitiveLess
+    {
+        using is_transparent = void;
+
+        bool operator()(
+            std::wstring_view Left,
+            std::wstring_view Right) const noexcept
+        {
+            return Mile::CaseInsensitiveCompare(Left, Right) < 0;
+        }
+
+        bool operator()(
+            std::string_view Left,
+            std::string_view Right) const noexcept
+        {
+            return Mile::CaseInsensitiveCompare(Left, Right) < 0;
+        }
+    };
+
+    /**
+     * @brief The case-insensitive equality predicate for unordered
+     *        containers like std::unordered_map.
+    */
+    struct CaseInsensitiveEqual
+    {
+        using is_transparent = void;
+
+        bool operator()(
+            std::wstring_view Left,
+            std::wstring_view Right) const noexcept
+        {
+            return Mile::CaseInsensitiveEquals(Left, Right);
+        }
+
+        bool operator()(
+            std::string_view Left,
+            std::string_view Right) const noexcept
+        {
+            return Mile::CaseInsensitiveEquals(Left, Right);
+        }
+    };
+
+    /**
+     * @brief The case-insensitive hasher for unordered containers like
+     *        std::unordered_map. Use it with CaseInsensitiveEqual.
+    */
+    struct CaseInsensitiveHasher
+    {
+        using is_transparent = void;
+
+        std::size_t operator()(
+            std::wstring_view String) const noexcept
+        {
+            return Mile::CaseInsensitiveHash(String);
+        }
+
+        std::size_t operator()(
+            std::string_view String) const noexcept
+        {
+            return Mile::CaseInsensitiveHash(String);
+        }
+    };
+}
+
+#endif // !MILE_PORTABLE_CASEINSENSITIVE
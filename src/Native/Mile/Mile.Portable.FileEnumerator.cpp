@@ -0,0 +1,355 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.FileEnumerator.cpp
+ * PURPOSE:   Implementation for the batch-returning file enumerator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.FileEnumerator.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+
+    typedef FILE_ID_BOTH_DIR_INFO DirectoryRecord;
+
+    DirectoryRecord const* GetRecord(
+        std::uint8_t const* Record) noexcept
+    {
+        return reinterpret_cast<DirectoryRecord const*>(Record);
+    }
+
+#else
+
+    /**
+     * @brief The layout of the records returned by getdents64.
+    */
+    struct DirectoryRecord
+    {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    DirectoryRecord const* GetRecord(
+        std::uint8_t const* Record) noexcept
+    {
+        return reinterpret_cast<DirectoryRecord const*>(Record);
+    }
+
+#endif
+
+    bool IsDotEntry(
+        Mile::NativeStringView Name) noexcept
+    {
+        return (Name.size() == 1 && Name[0] == '.') ||
+            (Name.size() == 2 && Name[0] == '.' && Name[1] == '.');
+    }
+}
+
+Mile::NativeStringView Mile::FileEnumeratorEntry::GetName() const noexcept
+{
+#if defined(_WIN32)
+    DirectoryRecord const* Record = ::GetRecord(this->m_Record);
+    return NativeStringView(
+        Record->FileName,
+        Record->FileNameLength / sizeof(wchar_t));
+#else
+    return NativeStringView(::GetRecord(this->m_Record)->d_name);
+#endif
+}
+
+Mile::FileEntryType Mile::FileEnumeratorEntry::GetType() const noexcept
+{
+#if defined(_WIN32)
+    DWORD Attributes = ::GetRecord(this->m_Record)->FileAttributes;
+    if (Attributes & FILE_ATTRIBUTE_REPARSE_POINT)
+    {
+        return FileEntryType::Link;
+    }
+    if (Attributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        return FileEntryType::Directory;
+    }
+    if (Attributes & FILE_ATTRIBUTE_DEVICE)
+    {
+        return FileEntryType::Other;
+    }
+    return FileEntryType::File;
+#else
+    switch (::GetRecord(this->m_Record)->d_type)
+    {
+    case DT_REG:
+        return FileEntryType::File;
+    case DT_DIR:
+        return FileEntryType::Directory;
+    case DT_LNK:
+        return FileEntryType::Link;
+    case DT_UNKNOWN:
+        return FileEntryType::Unknown;
+    default:
+        return FileEntryType::Other;
+    }
+#endif
+}
+
+std::uint64_t Mile::FileEnumeratorEntry::GetFileId() const noexcept
+{
+#if defined(_WIN32)
+    return static_cast<std::uint64_t>(
+        ::GetRecord(this->m_Record)->FileId.QuadPart);
+#else
+    return ::GetRecord(this->m_Record)->d_ino;
+#endif
+}
+
+#if defined(_WIN32)
+
+std::uint32_t Mile::FileEnumeratorEntry::GetAttributes() const noexcept
+{
+    return ::GetRecord(this->m_Record)->FileAttributes;
+}
+
+std::uint64_t Mile::FileEnumeratorEntry::GetSize() const noexcept
+{
+    return static_cast<std::uint64_t>(
+        ::GetRecord(this->m_Record)->EndOfFile.QuadPart);
+}
+
+std::uint64_t Mile::FileEnumeratorEntry::GetAllocationSize() const noexcept
+{
+    return static_cast<std::uint64_t>(
+        ::GetRecord(this->m_Record)->AllocationSize.QuadPart);
+}
+
+std::uint64_t Mile::FileEnumeratorEntry::GetLastWriteTime() const noexcept
+{
+    return static_cast<std::uint64_t>(
+        ::GetRecord(this->m_Record)->LastWriteTime.QuadPart);
+}
+
+#endif
+
+void Mile::FileEnumeratorBatch::Iterator::SkipDotEntries() noexcept
+{
+    while (this->m_Current != this->m_End &&
+        ::IsDotEntry(FileEnumeratorEntry(this->m_Current).GetName()))
+    {
+        ++*this;
+    }
+}
+
+Mile::FileEnumeratorBatch::Iterator&
+Mile::FileEnumeratorBatch::Iterator::operator++() noexcept
+{
+#if defined(_WIN32)
+    DWORD NextEntryOffset = ::GetRecord(this->m_Current)->NextEntryOffset;
+    this->m_Current = NextEntryOffset
+        ? this->m_Current + NextEntryOffset
+        : this->m_End;
+#else
+    this->m_Current += ::GetRecord(this->m_Current)->d_reclen;
+#endif
+
+    this->SkipDotEntries();
+
+    return *this;
+}
+
+Mile::FileEnumerator::FileEnumerator(
+    std::size_t BufferSize)
+{
+    if (BufferSize < MinimumBufferSize)
+    {
+        BufferSize = MinimumBufferSize;
+    }
+
+    // Use 8-byte units, because the records need to be aligned.
+    const std::size_t BufferUnits =
+        (BufferSize + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+    this->m_Buffer.reset(new std::uint64_t[BufferUnits]);
+    this->m_BufferSize = BufferUnits * sizeof(std::uint64_t);
+}
+
+Mile::FileEnumerator::~FileEnumerator()
+{
+    this->Close();
+}
+
+bool Mile::FileEnumerator::Open(
+    NativeString const& Path)
+{
+    this->Close();
+
+#if defined(_WIN32)
+    HANDLE Handle = ::CreateFileW(
+        Path.c_str(),
+        FILE_LIST_DIRECTORY | SYNCHRONIZE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS,
+        nullptr);
+    if (Handle == INVALID_HANDLE_VALUE)
+    {
+        this->m_LastError = static_cast<int>(::GetLastError());
+        return false;
+    }
+#elif defined(__linux__)
+    int Handle = ::open(Path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (Handle == -1)
+    {
+        this->m_LastError = errno;
+        return false;
+    }
+#else
+    Mile::UnreferencedParameter(Path);
+    this->m_LastError = ENOSYS;
+    return false;
+#endif
+
+#if defined(_WIN32) || defined(__linux__)
+    this->Attach(Handle);
+    this->m_OwnsHandle = true;
+    return true;
+#endif
+}
+
+#if defined(_WIN32)
+void Mile::FileEnumerator::Attach(
+    void* Handle) noexcept
+#else
+void Mile::FileEnumerator::Attach(
+    int Handle) noexcept
+#endif
+{
+    this->Close();
+
+    this->m_Handle = Handle;
+    this->m_OwnsHandle = false;
+    this->m_Restart = true;
+    this->m_Completed = false;
+    this->m_LastError = 0;
+}
+
+void Mile::FileEnumerator::Close() noexcept
+{
+#if defined(_WIN32)
+    if (this->m_Handle && this->m_OwnsHandle)
+    {
+        ::CloseHandle(this->m_Handle);
+    }
+    this->m_Handle = nullptr;
+#else
+    if (this->m_Handle != -1 && this->m_OwnsHandle)
+    {
+        ::close(this->m_Handle);
+    }
+    this->m_Handle = -1;
+#endif
+
+    this->m_OwnsHandle = false;
+}
+
+bool Mile::FileEnumerator::NextBatch(
+    FileEnumeratorBatch& Batch)
+{
+    Batch = FileEnumeratorBatch();
+
+    if (this->m_Completed)
+    {
+        this->m_LastError = 0;
+        return false;
+    }
+
+    std::uint8_t* Buffer = reinterpret_cast<std::uint8_t*>(
+        this->m_Buffer.get());
+
+#if defined(_WIN32)
+    if (!this->m_Handle)
+    {
+        this->m_LastError = ERROR_INVALID_HANDLE;
+        return false;
+    }
+
+    if (!::GetFileInformationByHandleEx(
+        this->m_Handle,
+        this->m_Restart
+        ? FILE_INFO_BY_HANDLE_CLASS::FileIdBothDirectoryRestartInfo
+        : FILE_INFO_BY_HANDLE_CLASS::FileIdBothDirectoryInfo,
+        Buffer,
+        static_cast<DWORD>(this->m_BufferSize)))
+    {
+        DWORD Error = ::GetLastError();
+        if (Error == ERROR_NO_MORE_FILES)
+        {
+            this->m_Completed = true;
+            Error = ERROR_SUCCESS;
+        }
+        this->m_LastError = static_cast<int>(Error);
+        return false;
+    }
+
+    this->m_Restart = false;
+    Batch = FileEnumeratorBatch(Buffer, Buffer + this->m_BufferSize);
+    return true;
+#elif defined(__linux__)
+    if (this->m_Handle == -1)
+    {
+        this->m_LastError = EBADF;
+        return false;
+    }
+
+    if (this->m_Restart)
+    {
+        if (-1 == ::lseek(this->m_Handle, 0, SEEK_SET))
+        {
+            this->m_LastError = errno;
+            return false;
+        }
+        this->m_Restart = false;
+    }
+
+    long Result = ::syscall(
+        SYS_getdents64,
+        this->m_Handle,
+        Buffer,
+        this->m_BufferSize);
+    if (Result < 0)
+    {
+        this->m_LastError = errno;
+        return false;
+    }
+    if (Result == 0)
+    {
+        this->m_Completed = true;
+        this->m_LastError = 0;
+        return false;
+    }
+
+    Batch = FileEnumeratorBatch(Buffer, Buffer + Result);
+    return true;
+#else
+    Mile::UnreferencedParameter(Buffer);
+    this->m_LastError = ENOSYS;
+    return false;
+#endif
+}
@@ -0,0 +1,410 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.FileEnumerator.h
+ * PURPOSE:   Definition for the batch-returning file enumerator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_FILEENUMERATOR
+#define MILE_PORTABLE_FILEENUMERATOR
+
+#include "Mile.Portable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+
+namespace Mile
+{
+    /**
+     * @brief The type of a directory entry.
+    */
+    enum class FileEntryType : std::uint8_t
+    {
+        /**
+         * @brief The file system does not report the type. Query the entry
+         *        itself if the type is needed.
+        */
+        Unknown,
+
+        /**
+         * @brief A regular file.
+        */
+        File,
+
+        /**
+         * @brief A directory.
+        */
+        Directory,
+
+        /**
+         * @brief A symbolic link. On Windows, it is any file or directory
+         *        with a reparse point, which includes junctions.
+        */
+        Link,
+
+        /**
+         * @brief A device, pipe or socket.
+        */
+        Other,
+    };
+
+    /**
+     * @brief A view of a directory entry in the buffer of a FileEnumerator.
+     *        It is valid until the next call of FileEnumerator::NextBatch.
+    */
+    class FileEnumeratorEntry
+    {
+    private:
+
+        std::uint8_t const* m_Record;
+
+    public:
+
+        /**
+         * @brief Creates a view of a raw directory record.
+         * @param Record The raw directory record.
+        */
+        explicit FileEnumeratorEntry(
+            void const* Record) noexcept :
+            m_Record(reinterpret_cast<std::uint8_t const*>(Record))
+        {
+        }
+
+        /**
+         * @brief Retrieves the name of the entry, without a null terminator
+         *        on Windows. The name is not truncated.
+         * @return The name of the entry.
+        */
+        NativeStringView GetName() const noexcept;
+
+        /**
+         * @brief Retrieves the type of the entry.
+         * @return The type of the entry.
+        */
+        FileEntryType GetType() const noexcept;
+
+        /**
+         * @brief Retrieves the file ID (the inode number on POSIX) of the
+         *        entry.
+         * @return The file ID of the entry.
+        */
+        std::uint64_t GetFileId() const noexcept;
+
+        /**
+         * @brief Retrieves the raw record of the entry. It is a
+         *        FILE_ID_BOTH_DIR_INFO structure on Windows and a
+         *        linux_dirent64 structure on Linux.
+         * @return The raw record of the entry.
+        */
+        void const* GetRawRecord() const noexcept
+        {
+            return this->m_Record;
+        }
+
+#if defined(_WIN32)
+
+        /**
+         * @brief Retrieves the file attributes of the entry.
+         * @return The FILE_ATTRIBUTE_* flags of the entry.
+        */
+        std::uint32_t GetAttributes() const noexcept;
+
+        /**
+         * @brief Retrieves the size of the entry.
+         * @return The size of the entry, in bytes.
+        */
+        std::uint64_t GetSize() const noexcept;
+
+        /**
+         * @brief Retrieves the allocation size of the entry.
+         * @return The allocation size of the entry, in bytes.
+        */
+        std::uint64_t GetAllocationSize() const noexcept;
+
+        /**
+         * @brief Retrieves the time of the last write to the entry.
+         * @return The time in 100-nanosecond intervals since January 1, 1601
+         *         (UTC).
+        */
+        std::uint64_t GetLastWriteTime() const noexcept;
+
+#endif
+    };
+
+    /**
+     * @brief A batch of directory entries returned by
+     *        FileEnumerator::NextBatch. The entries are read in place from
+     *        the buffer of the enumerator, so the batch is valid until the
+     *        next call of FileEnumerator::NextBatch. The "." and ".."
+     *        entries are skipped.
+    */
+    class FileEnumeratorBatch
+    {
+    public:
+
+        /**
+         * @brief The forward iterator over the entries of a batch.
+        */
+        class Iterator
+        {
+        private:
+
+            std::uint8_t const* m_Current;
+            std::uint8_t const* m_End;
+
+            void SkipDotEntries() noexcept;
+
+        public:
+
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = FileEnumeratorEntry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = FileEnumeratorEntry const*;
+            using reference = FileEnumeratorEntry;
+
+            Iterator(
+                std::uint8_t const* Current,
+                std::uint8_t const* End) noexcept :
+                m_Current(Current),
+                m_End(End)
+            {
+                this->SkipDotEntries();
+            }
+
+            FileEnumeratorEntry operator*() const noexcept
+            {
+                return FileEnumeratorEntry(this->m_Current);
+            }
+
+            Iterator& operator++() noexcept;
+
+            Iterator operator++(int) noexcept
+            {
+                Iterator Previous = *this;
+                ++*this;
+                return Previous;
+            }
+
+            bool operator==(Iterator const& Other) const noexcept
+            {
+                return this->m_Current == Other.m_Current;
+            }
+
+            bool operator!=(Iterator const& Other) const noexcept
+            {
+                return this->m_Current != Other.m_Current;
+            }
+        };
+
+    private:
+
+        std::uint8_t const* m_Begin = nullptr;
+        std::uint8_t const* m_End = nullptr;
+
+    public:
+
+        /**
+         * @brief Creates an empty batch.
+        */
+        FileEnumeratorBatch() noexcept = default;
+
+        /**
+         * @brief Creates a batch over the raw records in a buffer.
+         * @param Begin The first raw record.
+         * @param End The end of the raw records.
+        */
+        FileEnumeratorBatch(
+            void const* Begin,
+            void const* End) noexcept :
+            m_Begin(reinterpret_cast<std::uint8_t const*>(Begin)),
+            m_End(reinterpret_cast<std::uint8_t const*>(End))
+        {
+        }
+
+        Iterator begin() const noexcept
+        {
+            return Iterator(this->m_Begin, this->m_End);
+        }
+
+        Iterator end() const noexcept
+        {
+            return Iterator(this->m_End, this->m_End);
+        }
+
+        /**
+         * @brief Checks whether the batch contains no raw records.
+         * @return true if the batch is empty, otherwise false.
+        */
+        bool IsEmpty() const noexcept
+        {
+            return this->m_Begin == this->m_End;
+        }
+    };
+
+    /**
+     * @brief Enumerates the entries of a directory in batches. Each batch is
+     *        filled by a single GetFileInformationByHandleEx call with the
+     *        FileIdBothDirectoryInfo class on Windows and by a single
+     *        getdents64 call on Linux, and its entries are handed out without
+     *        copying them.
+     * @remark The enumerator is designed for a single owner and takes no
+     *         locks. Use one enumerator per thread.
+    */
+    class FileEnumerator : DisableCopyConstruction, DisableMoveConstruction
+    {
+    public:
+
+        /**
+         * @brief The default size of the buffer, in bytes.
+        */
+        static const std::size_t DefaultBufferSize = 64 * 1024;
+
+        /**
+         * @brief The minimum size of the buffer, in bytes. It holds an entry
+         *        with the longest possible name.
+        */
+        static const std::size_t MinimumBufferSize = 4 * 1024;
+
+    private:
+
+        std::unique_ptr<std::uint64_t[]> m_Buffer;
+        std::size_t m_BufferSize;
+
+#if defined(_WIN32)
+        void* m_Handle = nullptr;
+#else
+        int m_Handle = -1;
+#endif
+
+        bool m_OwnsHandle = false;
+        bool m_Restart = true;
+        bool m_Completed = false;
+        int m_LastError = 0;
+
+    public:
+
+        /**
+         * @brief Creates the enumerator.
+         * @param BufferSize The size of the buffer, in bytes. Larger buffers
+         *                   mean fewer system calls. It is rounded up to
+         *                   MinimumBufferSize.
+        */
+        explicit FileEnumerator(
+            std::size_t BufferSize = DefaultBufferSize);
+
+        /**
+         * @brief Closes the directory if it is owned by the enumerator.
+        */
+        ~FileEnumerator();
+
+        /**
+         * @brief Opens a directory for enumeration.
+         * @param Path The path of the directory.
+         * @return true if successful, otherwise false. Call GetLastErrorCode
+         *         for the reason.
+        */
+        bool Open(
+            NativeString const& Path);
+
+#if defined(_WIN32)
+
+        /**
+         * @brief Enumerates a directory opened by the caller. The enumerator
+         *        does not close the handle.
+         * @param Handle The handle of the directory. It must be opened with
+         *               the FILE_LIST_DIRECTORY access right and without
+         *               FILE_FLAG_OVERLAPPED.
+        */
+        void Attach(
+            void* Handle) noexcept;
+
+#else
+
+        /**
+         * @brief Enumerates a directory opened by the caller. The enumerator
+         *        does not close the file descriptor.
+         * @param Handle The file descriptor of the directory.
+        */
+        void Attach(
+            int Handle) noexcept;
+
+#endif
+
+        /**
+         * @brief Closes the directory if it is owned by the enumerator, and
+         *        detaches the enumerator from it.
+        */
+        void Close() noexcept;
+
+        /**
+         * @brief Reads the next batch of entries. It invalidates the previous
+         *        batch.
+         * @param Batch The batch which receives the entries. It is never
+         *              empty if the function succeeds, but it may contain
+         *              only the "." and ".." entries.
+         * @return true if a batch is read, otherwise false. If all entries
+         *         have been read, the last error code is zero.
+        */
+        bool NextBatch(
+            FileEnumeratorBatch& Batch);
+
+        /**
+         * @brief Restarts the enumeration from the first entry.
+        */
+        void Restart() noexcept
+        {
+            this->m_Restart = true;
+            this->m_Completed = false;
+        }
+
+        /**
+         * @brief Retrieves the error code of the last failed operation. It is
+         *        a Win32 error code on Windows and an errno value elsewhere.
+         * @return The error code of the last failed operation.
+        */
+        int GetLastErrorCode() const noexcept
+        {
+            return this->m_LastError;
+        }
+
+        /**
+         * @brief Retrieves the size of the buffer.
+         * @return The size of the buffer, in bytes.
+        */
+        std::size_t GetBufferSize() const noexcept
+        {
+            return this->m_BufferSize;
+        }
+
+#if defined(_WIN32)
+        /**
+         * @brief Retrieves the handle of the directory.
+         * @return The handle of the directory, or nullptr if no directory is
+         *         open.
+        */
+        void* GetHandle() const noexcept
+        {
+            return this->m_Handle;
+        }
+#else
+        /**
+         * @brief Retrieves the file descriptor of the directory, which can
+         *        be used with fstatat to query the entries without resolving
+         *        their paths again.
+         * @return The file descriptor of the directory, or -1 if no
+         *         directory is open.
+        */
+        int GetHandle() const noexcept
+        {
+            return this->m_Handle;
+        }
+#endif
+    };
+}
+
+#endif // !MILE_PORTABLE_FILEENUMERATOR
@@ -0,0 +1,383 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Hash.cpp
+ * PURPOSE:   Implementation for the fast non-cryptographic hash
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.Hash.h"
+
+#include <cstring>
+
+// Define MILE_HASH_NO_SSE2 to build the portable path only, which the tests
+// use to check the paths give the same values.
+#if !defined(MILE_HASH_NO_SSE2) && \
+    (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__))
+#define MILE_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    const std::uint64_t Prime32 = 0x9E3779B1;
+    const std::uint64_t Prime64First = 0x9E3779B185EBCA87;
+    const std::uint64_t Prime64Second = 0xC2B2AE3D27D4EB4F;
+    const std::uint64_t AvalancheMultiplier = 0x165667919E3779F9;
+
+    const std::size_t ScrambleKeys = 23;
+    const std::size_t LowMergeKeys = ScrambleKeys + 8;
+    const std::size_t HighMergeKeys = LowMergeKeys + 8;
+
+#if !defined(MILE_HASH_SSE2)
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source) noexcept
+    {
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        // Not every compiler turns the loop below into one load.
+        std::uint64_t Value;
+        std::memcpy(&Value, Source, sizeof(Value));
+        return Value;
+#else
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+#endif
+    }
+#endif
+
+    std::uint64_t SplitMix64(
+        std::uint64_t& State) noexcept
+    {
+        std::uint64_t Value = (State += 0x9E3779B97F4A7C15);
+        Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9;
+        Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EB;
+        return Value ^ (Value >> 31);
+    }
+
+    /**
+     * @brief Multiplies two 64-bit values and folds the 128-bit product by
+     *        XORing its halves.
+    */
+    std::uint64_t MultiplyFold(
+        std::uint64_t Left,
+        std::uint64_t Right) noexcept
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 Product =
+            static_cast<unsigned __int128>(Left) * Right;
+        return static_cast<std::uint64_t>(Product) ^
+            static_cast<std::uint64_t>(Product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned __int64 High = 0;
+        unsigned __int64 Low = ::_umul128(Left, Right, &High);
+        return Low ^ High;
+#else
+        std::uint64_t LeftLow = Left & 0xFFFFFFFF;
+        std::uint64_t LeftHigh = Left >> 32;
+        std::uint64_t RightLow = Right & 0xFFFFFFFF;
+        std::uint64_t RightHigh = Right >> 32;
+
+        std::uint64_t LowLow = LeftLow * RightLow;
+        std::uint64_t HighLow = LeftHigh * RightLow;
+        std::uint64_t LowHigh = LeftLow * RightHigh;
+        std::uint64_t HighHigh = LeftHigh * RightHigh;
+
+        std::uint64_t Cross =
+            (LowLow >> 32) + (HighLow & 0xFFFFFFFF) + LowHigh;
+        std::uint64_t Low = (Cross << 32) | (LowLow & 0xFFFFFFFF);
+        std::uint64_t High = HighHigh + (HighLow >> 32) + (Cross >> 32);
+        return Low ^ High;
+#endif
+    }
+
+    std::uint64_t Avalanche(
+        std::uint64_t Value) noexcept
+    {
+        Value ^= Value >> 37;
+        Value *= AvalancheMultiplier;
+        return Value ^ (Value >> 32);
+    }
+
+    /**
+     * @brief Mixes stripes into the accumulators. Each lane is added to its
+     *        neighbor, so the data survives a multiplication by 0, and the
+     *        product of the halves of the lane XOR its key is added to the
+     *        lane itself. Stripe n uses the keys from Keys[n].
+     * @remark The accumulators are kept in locals, because the compilers
+     *         must assume that the stores to them alias the data otherwise.
+    */
+    void AccumulateStripes(
+        std::uint64_t* Accumulators,
+        std::uint8_t const* Data,
+        std::size_t Count,
+        std::uint64_t const* Keys) noexcept
+    {
+#if defined(MILE_HASH_SSE2)
+        __m128i Local[4];
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Local[i] = _mm_load_si128(
+                reinterpret_cast<__m128i const*>(&Accumulators[i * 2]));
+        }
+
+        for (std::size_t Stripe = 0; Stripe < Count; ++Stripe)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                __m128i Value = _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(&Data[i * 16]));
+                __m128i Key = _mm_xor_si128(
+                    Value,
+                    _mm_loadu_si128(
+                        reinterpret_cast<__m128i const*>(&Keys[i * 2])));
+                __m128i Product = _mm_mul_epu32(
+                    Key,
+                    _mm_srli_epi64(Key, 32));
+                __m128i Swapped = _mm_shuffle_epi32(
+                    Value,
+                    _MM_SHUFFLE(1, 0, 3, 2));
+                Local[i] = _mm_add_epi64(
+                    Local[i],
+                    _mm_add_epi64(Product, Swapped));
+            }
+            Data += 64;
+            ++Keys;
+        }
+
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(&Accumulators[i * 2]),
+                Local[i]);
+        }
+#else
+        std::uint64_t Local[8];
+        std::memcpy(Local, Accumulators, sizeof(Local));
+
+        for (std::size_t Stripe = 0; Stripe < Count; ++Stripe)
+        {
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                std::uint64_t Value = ::LoadUInt64(&Data[i * 8]);
+                std::uint64_t Key = Value ^ Keys[i];
+                Local[i ^ 1] += Value;
+                Local[i] += (Key & 0xFFFFFFFF) * (Key >> 32);
+            }
+            Data += 64;
+            ++Keys;
+        }
+
+        std::memcpy(Accumulators, Local, sizeof(Local));
+#endif
+    }
+
+    /**
+     * @brief Scrambles the accumulators at the end of a block, so the high
+     *        bits of the products flow into the low bits used by the next
+     *        multiplications.
+    */
+    void ScrambleAccumulators(
+        std::uint64_t* Accumulators,
+        std::uint64_t const* Keys) noexcept
+    {
+#if defined(MILE_HASH_SSE2)
+        __m128i Multiplier = _mm_set1_epi32(static_cast<int>(Prime32));
+        for (std::size_t i = 0; i < 8; i += 2)
+        {
+            __m128i Accumulator = _mm_load_si128(
+                reinterpret_cast<__m128i const*>(&Accumulators[i]));
+            Accumulator = _mm_xor_si128(
+                Accumulator,
+                _mm_srli_epi64(Accumulator, 47));
+            Accumulator = _mm_xor_si128(
+                Accumulator,
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(&Keys[i])));
+            __m128i Low = _mm_mul_epu32(Accumulator, Multiplier);
+            __m128i High = _mm_mul_epu32(
+                _mm_srli_epi64(Accumulator, 32),
+                Multiplier);
+            Accumulator = _mm_add_epi64(Low, _mm_slli_epi64(High, 32));
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(&Accumulators[i]),
+                Accumulator);
+        }
+#else
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            std::uint64_t Accumulator = Accumulators[i];
+            Accumulator ^= Accumulator >> 47;
+            Accumulator ^= Keys[i];
+            Accumulators[i] = Accumulator * Prime32;
+        }
+#endif
+    }
+
+    std::uint64_t MergeAccumulators(
+        std::uint64_t const* Accumulators,
+        std::uint64_t const* Keys,
+        std::uint64_t Start) noexcept
+    {
+        std::uint64_t Result = Start;
+        for (std::size_t i = 0; i < 8; i += 2)
+        {
+            Result += ::MultiplyFold(
+                Accumulators[i] ^ Keys[i],
+                Accumulators[i + 1] ^ Keys[i + 1]);
+        }
+        return ::Avalanche(Result);
+    }
+}
+
+void Mile::FastHasher::ConsumeStripes(
+    std::uint8_t const* Data,
+    std::size_t Count) noexcept
+{
+    while (Count)
+    {
+        std::size_t Stripes = StripesPerBlock - this->m_StripeIndex;
+        if (Stripes > Count)
+        {
+            Stripes = Count;
+        }
+
+        ::AccumulateStripes(
+            this->m_Accumulators,
+            Data,
+            Stripes,
+            &this->m_Keys[this->m_StripeIndex]);
+        Data += Stripes * StripeSize;
+        Count -= Stripes;
+
+        this->m_StripeIndex += Stripes;
+        if (this->m_StripeIndex == StripesPerBlock)
+        {
+            ::ScrambleAccumulators(
+                this->m_Accumulators,
+                &this->m_Keys[ScrambleKeys]);
+            this->m_StripeIndex = 0;
+        }
+    }
+}
+
+Mile::FastHasher::FastHasher(
+    std::uint64_t Seed) noexcept
+{
+    this->Reset(Seed);
+}
+
+void Mile::FastHasher::Reset(
+    std::uint64_t Seed) noexcept
+{
+    static_assert(
+        ScrambleKeys == StripeKeyCount && HighMergeKeys + 8 == KeyCount,
+        "The layout of the keys does not match.");
+
+    std::uint64_t State = Seed;
+    for (std::size_t i = 0; i < KeyCount; ++i)
+    {
+        this->m_Keys[i] = ::SplitMix64(State);
+    }
+
+    this->m_Accumulators[0] = Prime32;
+    this->m_Accumulators[1] = Prime64First;
+    this->m_Accumulators[2] = Prime64Second;
+    this->m_Accumulators[3] = Seed;
+    this->m_Accumulators[4] = ~Seed;
+    this->m_Accumulators[5] = Prime64Second ^ Seed;
+    this->m_Accumulators[6] = Prime64First ^ Seed;
+    this->m_Accumulators[7] = Prime32 ^ Seed;
+
+    this->m_BufferSize = 0;
+    this->m_StripeIndex = 0;
+    this->m_Length = 0;
+}
+
+void Mile::FastHasher::Update(
+    void const* Data,
+    std::size_t Size) noexcept
+{
+    std::uint8_t const* Current = static_cast<std::uint8_t const*>(Data);
+    this->m_Length += Size;
+
+    if (this->m_BufferSize)
+    {
+        std::size_t Length = StripeSize - this->m_BufferSize;
+        if (Length > Size)
+        {
+            Length = Size;
+        }
+        std::memcpy(&this->m_Buffer[this->m_BufferSize], Current, Length);
+        this->m_BufferSize += Length;
+        Current += Length;
+        Size -= Length;
+
+        if (this->m_BufferSize < StripeSize)
+        {
+            return;
+        }
+        this->ConsumeStripes(this->m_Buffer, 1);
+        this->m_BufferSize = 0;
+    }
+
+    std::size_t Stripes = Size / StripeSize;
+    this->ConsumeStripes(Current, Stripes);
+    Current += Stripes * StripeSize;
+    Size -= Stripes * StripeSize;
+
+    if (Size)
+    {
+        std::memcpy(this->m_Buffer, Current, Size);
+        this->m_BufferSize = Size;
+    }
+}
+
+Mile::Hash128 Mile::FastHasher::Finalize() const noexcept
+{
+    alignas(16) std::uint64_t Accumulators[LaneCount];
+    std::memcpy(Accumulators, this->m_Accumulators, sizeof(Accumulators));
+
+    // The last partial stripe is padded with zeros. The length is merged
+    // below, so the padding does not collide with data ending in zeros.
+    if (this->m_BufferSize)
+    {
+        alignas(16) std::uint8_t Stripe[StripeSize] = {};
+        std::memcpy(Stripe, this->m_Buffer, this->m_BufferSize);
+        ::AccumulateStripes(
+            Accumulators,
+            Stripe,
+            1,
+            &this->m_Keys[this->m_StripeIndex]);
+    }
+
+    Hash128 Result;
+    Result.Low = ::MergeAccumulators(
+        Accumulators,
+        &this->m_Keys[LowMergeKeys],
+        this->m_Length * Prime64First);
+    Result.High = ::MergeAccumulators(
+        Accumulators,
+        &this->m_Keys[HighMergeKeys],
+        ~this->m_Length * Prime64Second);
+    return Result;
+}
+
+Mile::Hash128 Mile::ComputeFastHash(
+    void const* Data,
+    std::size_t Size,
+    std::uint64_t Seed) noexcept
+{
+    FastHasher Hasher(Seed);
+    Hasher.Update(Data, Size);
+    return Hasher.Finalize();
+}
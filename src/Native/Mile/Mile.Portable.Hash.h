@@ -0,0 +1,136 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Hash.h
+ * PURPOSE:   Definition for the fast non-cryptographic hash
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_HASH
+#define MILE_PORTABLE_HASH
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Mile
+{
+    /**
+     * @brief A 128-bit hash value.
+    */
+    struct Hash128
+    {
+        std::uint64_t Low;
+        std::uint64_t High;
+    };
+
+    inline bool operator==(
+        Hash128 const& Left,
+        Hash128 const& Right) noexcept
+    {
+        return Left.Low == Right.Low && Left.High == Right.High;
+    }
+
+    inline bool operator!=(
+        Hash128 const& Left,
+        Hash128 const& Right) noexcept
+    {
+        return !(Left == Right);
+    }
+
+    inline bool operator<(
+        Hash128 const& Left,
+        Hash128 const& Right) noexcept
+    {
+        return Left.High != Right.High
+            ? Left.High < Right.High
+            : Left.Low < Right.Low;
+    }
+
+    /**
+     * @brief A streaming 128-bit non-cryptographic hash for comparing file
+     *        contents. It has the structure of XXH3: the data is consumed
+     *        in 64-byte stripes by eight 64-bit accumulators, each lane is
+     *        mixed with a key by a 32x32-bit multiplication, and the
+     *        accumulators are scrambled after every 16 stripes. The keys
+     *        are derived from the seed. The lanes are processed with SSE2
+     *        where it is available, which gives the same values as the
+     *        portable implementation.
+     * @remark It does not resist deliberate collisions, so compare the
+     *         contents before acting on a matching hash of untrusted data.
+     *         The values are not compatible with XXH3.
+    */
+    class FastHasher
+    {
+    public:
+
+        static const std::size_t StripeSize = 64;
+        static const std::size_t StripesPerBlock = 16;
+        static const std::size_t LaneCount = 8;
+
+    private:
+
+        static const std::size_t StripeKeyCount =
+            StripesPerBlock + LaneCount - 1;
+        static const std::size_t KeyCount = StripeKeyCount + 3 * LaneCount;
+
+        alignas(16) std::uint64_t m_Accumulators[LaneCount];
+        alignas(16) std::uint64_t m_Keys[KeyCount];
+        alignas(16) std::uint8_t m_Buffer[StripeSize];
+        std::size_t m_BufferSize;
+        std::size_t m_StripeIndex;
+        std::uint64_t m_Length;
+
+        void ConsumeStripes(
+            std::uint8_t const* Data,
+            std::size_t Count) noexcept;
+
+    public:
+
+        /**
+         * @brief Starts a hash.
+         * @param Seed The seed of the hash.
+        */
+        explicit FastHasher(
+            std::uint64_t Seed = 0) noexcept;
+
+        /**
+         * @brief Starts a new hash.
+         * @param Seed The seed of the hash.
+        */
+        void Reset(
+            std::uint64_t Seed = 0) noexcept;
+
+        /**
+         * @brief Adds data to the hash.
+         * @param Data The data.
+         * @param Size The size of the data, in bytes.
+        */
+        void Update(
+            void const* Data,
+            std::size_t Size) noexcept;
+
+        /**
+         * @brief Retrieves the hash of the data added so far. More data can
+         *        be added afterwards.
+         * @return The hash.
+        */
+        Hash128 Finalize() const noexcept;
+    };
+
+    /**
+     * @brief Computes the hash of a buffer, which is the same as the hash
+     *        of a FastHasher the buffer is added to.
+     * @param Data The data.
+     * @param Size The size of the data, in bytes.
+     * @param Seed The seed of the hash.
+     * @return The hash.
+    */
+    Hash128 ComputeFastHash(
+        void const* Data,
+        std::size_t Size,
+        std::uint64_t Seed = 0) noexcept;
+}
+
+#endif // !MILE_PORTABLE_HASH
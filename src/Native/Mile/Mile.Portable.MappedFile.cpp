@@ -0,0 +1,311 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MappedFile.cpp
+ * PURPOSE:   Implementation for the read-only memory-mapped file view
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.MappedFile.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+
+    /**
+     * @brief The layout of WIN32_MEMORY_RANGE_ENTRY, which is only declared
+     *        when targeting Windows 8 or later.
+    */
+    struct MemoryRangeEntry
+    {
+        PVOID VirtualAddress;
+        SIZE_T NumberOfBytes;
+    };
+
+    typedef BOOL(WINAPI* PrefetchVirtualMemoryType)(
+        HANDLE hProcess,
+        ULONG_PTR NumberOfEntries,
+        MemoryRangeEntry* VirtualAddresses,
+        ULONG Flags);
+
+#else
+
+    int GetAdvice(
+        Mile::MappedFileAccess Access) noexcept
+    {
+        switch (Access)
+        {
+        case Mile::MappedFileAccess::Sequential:
+            return MADV_SEQUENTIAL;
+        case Mile::MappedFileAccess::Random:
+            return MADV_RANDOM;
+        default:
+            return MADV_NORMAL;
+        }
+    }
+
+#endif
+}
+
+Mile::MappedFile::~MappedFile()
+{
+    this->Close();
+}
+
+Mile::MappedFile::MappedFile(
+    MappedFile&& Other) noexcept :
+    m_Data(Other.m_Data),
+    m_Size(Other.m_Size),
+    m_LastError(Other.m_LastError)
+{
+    Other.m_Data = nullptr;
+    Other.m_Size = 0;
+}
+
+Mile::MappedFile& Mile::MappedFile::operator=(
+    MappedFile&& Other) noexcept
+{
+    if (this != &Other)
+    {
+        this->Close();
+        this->m_Data = Other.m_Data;
+        this->m_Size = Other.m_Size;
+        this->m_LastError = Other.m_LastError;
+        Other.m_Data = nullptr;
+        Other.m_Size = 0;
+    }
+    return *this;
+}
+
+bool Mile::MappedFile::Open(
+    NativeString const& Path,
+    MappedFileAccess Access)
+{
+    this->Close();
+
+#if defined(_WIN32)
+    DWORD FlagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+    if (Access == MappedFileAccess::Sequential)
+    {
+        FlagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if (Access == MappedFileAccess::Random)
+    {
+        FlagsAndAttributes |= FILE_FLAG_RANDOM_ACCESS;
+    }
+
+    HANDLE FileHandle = ::CreateFileW(
+        Path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FlagsAndAttributes,
+        nullptr);
+    if (FileHandle == INVALID_HANDLE_VALUE)
+    {
+        this->m_LastError = static_cast<int>(::GetLastError());
+        return false;
+    }
+
+    DWORD Error = ERROR_SUCCESS;
+
+    LARGE_INTEGER FileSize;
+    if (!::GetFileSizeEx(FileHandle, &FileSize))
+    {
+        Error = ::GetLastError();
+    }
+    else if (static_cast<ULONGLONG>(FileSize.QuadPart) > SIZE_MAX)
+    {
+        Error = ERROR_NOT_ENOUGH_MEMORY;
+    }
+    else if (FileSize.QuadPart)
+    {
+        // The view keeps the mapping and the file open, so both handles can
+        // be closed once the view is mapped.
+        HANDLE MappingHandle = ::CreateFileMappingW(
+            FileHandle,
+            nullptr,
+            PAGE_READONLY,
+            0,
+            0,
+            nullptr);
+        if (MappingHandle)
+        {
+            this->m_Data = ::MapViewOfFile(
+                MappingHandle,
+                FILE_MAP_READ,
+                0,
+                0,
+                0);
+            if (this->m_Data)
+            {
+                this->m_Size = static_cast<std::size_t>(FileSize.QuadPart);
+            }
+            else
+            {
+                Error = ::GetLastError();
+            }
+
+            ::CloseHandle(MappingHandle);
+        }
+        else
+        {
+            Error = ::GetLastError();
+        }
+    }
+
+    ::CloseHandle(FileHandle);
+
+    this->m_LastError = static_cast<int>(Error);
+    return Error == ERROR_SUCCESS;
+#else
+    int FileHandle = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (FileHandle == -1)
+    {
+        this->m_LastError = errno;
+        return false;
+    }
+
+    int Error = 0;
+
+    struct stat Status;
+    if (-1 == ::fstat(FileHandle, &Status))
+    {
+        Error = errno;
+    }
+    else if (static_cast<std::uint64_t>(Status.st_size) > SIZE_MAX)
+    {
+        Error = EFBIG;
+    }
+    else if (Status.st_size)
+    {
+        // The mapping keeps a reference to the file, so the file descriptor
+        // can be closed once the file is mapped.
+        void* Data = ::mmap(
+            nullptr,
+            static_cast<std::size_t>(Status.st_size),
+            PROT_READ,
+            MAP_PRIVATE,
+            FileHandle,
+            0);
+        if (Data != MAP_FAILED)
+        {
+            this->m_Data = Data;
+            this->m_Size = static_cast<std::size_t>(Status.st_size);
+            if (Access != MappedFileAccess::Normal)
+            {
+                ::madvise(this->m_Data, this->m_Size, ::GetAdvice(Access));
+            }
+        }
+        else
+        {
+            Error = errno;
+        }
+    }
+
+    ::close(FileHandle);
+
+    this->m_LastError = Error;
+    return Error == 0;
+#endif
+}
+
+void Mile::MappedFile::Close() noexcept
+{
+    if (this->m_Data)
+    {
+#if defined(_WIN32)
+        ::UnmapViewOfFile(this->m_Data);
+#else
+        ::munmap(this->m_Data, this->m_Size);
+#endif
+    }
+
+    this->m_Data = nullptr;
+    this->m_Size = 0;
+}
+
+bool Mile::MappedFile::Prefetch(
+    std::size_t Offset,
+    std::size_t Size) noexcept
+{
+    if (Offset >= this->m_Size)
+    {
+        return this->m_Size == 0;
+    }
+    if (Size > this->m_Size - Offset)
+    {
+        Size = this->m_Size - Offset;
+    }
+
+#if defined(_WIN32)
+    static PrefetchVirtualMemoryType ProcAddress =
+        reinterpret_cast<PrefetchVirtualMemoryType>(::GetProcAddress(
+            ::GetModuleHandleW(L"kernel32.dll"),
+            "PrefetchVirtualMemory"));
+    if (!ProcAddress)
+    {
+        this->m_LastError = ERROR_PROC_NOT_FOUND;
+        return false;
+    }
+
+    MemoryRangeEntry Range;
+    Range.VirtualAddress = reinterpret_cast<std::uint8_t*>(
+        this->m_Data) + Offset;
+    Range.NumberOfBytes = Size;
+    if (!ProcAddress(::GetCurrentProcess(), 1, &Range, 0))
+    {
+        this->m_LastError = static_cast<int>(::GetLastError());
+        return false;
+    }
+    return true;
+#else
+    // madvise needs a page-aligned address.
+    static const std::size_t PageSize =
+        static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t AlignedOffset = Offset - Offset % PageSize;
+    if (-1 == ::madvise(
+        reinterpret_cast<std::uint8_t*>(this->m_Data) + AlignedOffset,
+        Size + (Offset - AlignedOffset),
+        MADV_WILLNEED))
+    {
+        this->m_LastError = errno;
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool Mile::MappedFile::Advise(
+    MappedFileAccess Access) noexcept
+{
+#if defined(_WIN32)
+    Mile::UnreferencedParameter(Access);
+    return true;
+#else
+    if (!this->m_Data)
+    {
+        return true;
+    }
+
+    if (-1 == ::madvise(this->m_Data, this->m_Size, ::GetAdvice(Access)))
+    {
+        this->m_LastError = errno;
+        return false;
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,181 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MappedFile.h
+ * PURPOSE:   Definition for the read-only memory-mapped file view
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_MAPPEDFILE
+#define MILE_PORTABLE_MAPPEDFILE
+
+#include "Mile.Portable.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Mile
+{
+    /**
+     * @brief The expected access pattern of a mapped file.
+    */
+    enum class MappedFileAccess : std::uint8_t
+    {
+        /**
+         * @brief No particular access pattern.
+        */
+        Normal,
+
+        /**
+         * @brief The file is read from the beginning to the end. It makes
+         *        the system read ahead aggressively.
+        */
+        Sequential,
+
+        /**
+         * @brief The file is read at random offsets. It disables the read
+         *        ahead.
+        */
+        Random,
+    };
+
+    /**
+     * @brief A read-only memory-mapped view of a whole file. The view owns
+     *        the mapping and unmaps it when it is destroyed.
+     * @remark Parsing directly from the view avoids copying the file into a
+     *         heap buffer. The pages are read on first access, so call
+     *         Prefetch if the whole file will be touched.
+    */
+    class MappedFile : DisableCopyConstruction
+    {
+    private:
+
+        void* m_Data = nullptr;
+        std::size_t m_Size = 0;
+        int m_LastError = 0;
+
+    public:
+
+        /**
+         * @brief Creates an empty view.
+        */
+        MappedFile() noexcept = default;
+
+        /**
+         * @brief Unmaps the file.
+        */
+        ~MappedFile();
+
+        /**
+         * @brief Takes over the mapping of another view.
+         * @param Other The view to move from. It becomes empty.
+        */
+        MappedFile(
+            MappedFile&& Other) noexcept;
+
+        /**
+         * @brief Unmaps the file and takes over the mapping of another view.
+         * @param Other The view to move from. It becomes empty.
+         * @return A reference to this view.
+        */
+        MappedFile& operator=(
+            MappedFile&& Other) noexcept;
+
+        /**
+         * @brief Maps a whole file. The previous mapping is unmapped.
+         * @param Path The path of the file.
+         * @param Access The expected access pattern.
+         * @return true if successful, otherwise false. Call GetLastErrorCode
+         *         for the reason. An empty file is mapped successfully with
+         *         a null data pointer.
+        */
+        bool Open(
+            NativeString const& Path,
+            MappedFileAccess Access = MappedFileAccess::Normal);
+
+        /**
+         * @brief Unmaps the file.
+        */
+        void Close() noexcept;
+
+        /**
+         * @brief Asks the system to read a range of the file into memory in
+         *        the background. It is advisory and returns immediately.
+         * @param Offset The offset of the range, in bytes.
+         * @param Size The size of the range, in bytes. It is clamped to the
+         *             end of the file.
+         * @return true if the request is accepted, otherwise false. It fails
+         *         on Windows versions earlier than Windows 8.
+        */
+        bool Prefetch(
+            std::size_t Offset = 0,
+            std::size_t Size = SIZE_MAX) noexcept;
+
+        /**
+         * @brief Changes the expected access pattern of the view. It is a
+         *        no-op on Windows, where the pattern is fixed by Open.
+         * @param Access The expected access pattern.
+         * @return true if successful, otherwise false.
+        */
+        bool Advise(
+            MappedFileAccess Access) noexcept;
+
+        /**
+         * @brief Retrieves the address of the view.
+         * @return The address of the first byte of the file, or nullptr if
+         *         nothing is mapped.
+        */
+        void const* GetData() const noexcept
+        {
+            return this->m_Data;
+        }
+
+        /**
+         * @brief Retrieves the size of the view.
+         * @return The size of the file, in bytes.
+        */
+        std::size_t GetSize() const noexcept
+        {
+            return this->m_Size;
+        }
+
+        /**
+         * @brief Checks whether a non-empty file is mapped.
+         * @return true if a non-empty file is mapped, otherwise false.
+        */
+        bool IsMapped() const noexcept
+        {
+            return this->m_Data != nullptr;
+        }
+
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+
+        /**
+         * @brief Retrieves the contents of the view as characters.
+         * @return The contents of the file.
+        */
+        std::string_view GetView() const noexcept
+        {
+            return std::string_view(
+                reinterpret_cast<char const*>(this->m_Data),
+                this->m_Size);
+        }
+
+#endif
+
+        /**
+         * @brief Retrieves the error code of the last failed operation. It is
+         *        a Win32 error code on Windows and an errno value elsewhere.
+         * @return The error code of the last failed operation.
+        */
+        int GetLastErrorCode() const noexcept
+        {
+            return this->m_LastError;
+        }
+    };
+}
+
+#endif // !MILE_PORTABLE_MAPPEDFILE
@@ -0,0 +1,138 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MessageCache.cpp
+ * PURPOSE:   Implementation for the error message cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.MessageCache.h"
+
+#include <utility>
+
+namespace
+{
+    std::uint64_t MakeMessageKey(
+        std::int32_t Code,
+        std::uint32_t LanguageId) noexcept
+    {
+        return (static_cast<std::uint64_t>(LanguageId) << 32) |
+            static_cast<std::uint32_t>(Code);
+    }
+
+    std::size_t HashMessageKey(
+        std::uint64_t Key) noexcept
+    {
+        // The finalizer of SplitMix64, which spreads the bits of HRESULT
+        // codes sharing the same facility over the whole table.
+        Key ^= Key >> 30;
+        Key *= 0xBF58476D1CE4E5B9ULL;
+        Key ^= Key >> 27;
+        Key *= 0x94D049BB133111EBULL;
+        Key ^= Key >> 31;
+        return static_cast<std::size_t>(Key);
+    }
+}
+
+Mile::HResultMessageCache::HResultMessageCache(
+    MessageSource Source,
+    std::size_t Capacity) :
+    m_Source(std::move(Source)),
+    m_Capacity(Capacity ? Capacity : 1)
+{
+    // Keep the load factor at or below one half, so the probe sequences
+    // stay short.
+    std::size_t SlotCount = 2;
+    while (SlotCount < this->m_Capacity * 2)
+    {
+        SlotCount <<= 1;
+    }
+
+    this->m_Mask = SlotCount - 1;
+    this->m_Slots.reset(new std::atomic<Entry const*>[SlotCount]);
+    for (std::size_t i = 0; i < SlotCount; ++i)
+    {
+        this->m_Slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Mile::HResultMessageCache::~HResultMessageCache()
+{
+    for (std::size_t i = 0; i <= this->m_Mask; ++i)
+    {
+        delete this->m_Slots[i].load(std::memory_order_relaxed);
+    }
+}
+
+std::wstring_view Mile::HResultMessageCache::Lookup(
+    std::int32_t Code,
+    std::uint32_t LanguageId)
+{
+    const std::uint64_t Key = ::MakeMessageKey(Code, LanguageId);
+    const std::size_t Start = ::HashMessageKey(Key) & this->m_Mask;
+
+    std::size_t Index = Start;
+    for (;;)
+    {
+        Entry const* Current =
+            this->m_Slots[Index].load(std::memory_order_acquire);
+        if (!Current)
+        {
+            break;
+        }
+        if (Current->Key == Key)
+        {
+            return Current->Message;
+        }
+
+        Index = (Index + 1) & this->m_Mask;
+        if (Index == Start)
+        {
+            break;
+        }
+    }
+
+    std::wstring Message;
+    if (!this->m_Source || !this->m_Source(Code, LanguageId, Message))
+    {
+        Message.clear();
+    }
+
+    // Reserve a place first, so the number of entries never exceeds the
+    // capacity and the table never fills up.
+    if (this->m_Size.fetch_add(1, std::memory_order_relaxed) >=
+        this->m_Capacity)
+    {
+        this->m_Size.fetch_sub(1, std::memory_order_relaxed);
+
+        thread_local std::wstring OverflowMessage;
+        OverflowMessage = std::move(Message);
+        return OverflowMessage;
+    }
+
+    std::unique_ptr<Entry> NewEntry(new Entry{ Key, std::move(Message) });
+
+    for (;;)
+    {
+        Entry const* Expected = nullptr;
+        if (this->m_Slots[Index].compare_exchange_strong(
+            Expected,
+            NewEntry.get(),
+            std::memory_order_acq_rel,
+            std::memory_order_acquire))
+        {
+            return NewEntry.release()->Message;
+        }
+
+        if (Expected->Key == Key)
+        {
+            // Another thread has inserted the same message.
+            this->m_Size.fetch_sub(1, std::memory_order_relaxed);
+            return Expected->Message;
+        }
+
+        Index = (Index + 1) & this->m_Mask;
+    }
+}
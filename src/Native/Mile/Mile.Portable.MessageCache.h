@@ -0,0 +1,117 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MessageCache.h
+ * PURPOSE:   Definition for the error message cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_MESSAGECACHE
+#define MILE_PORTABLE_MESSAGECACHE
+
+#include "Mile.Portable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace Mile
+{
+    /**
+     * @brief A thread-safe and bounded cache of the messages of HRESULT
+     *        codes, keyed by the code and the language. Lookups of cached
+     *        messages are lock-free and do not allocate.
+     * @remark The message source is called without holding any lock, so two
+     *         threads which miss the same key at the same time may both call
+     *         it. Only one of the results is kept.
+    */
+    class HResultMessageCache : DisableCopyConstruction, DisableMoveConstruction
+    {
+    public:
+
+        /**
+         * @brief The type of the function which retrieves a message which is
+         *        not cached yet. It returns true and fills Message if the
+         *        message exists, otherwise false.
+        */
+        using MessageSource = std::function<bool(
+            std::int32_t Code,
+            std::uint32_t LanguageId,
+            std::wstring& Message)>;
+
+    private:
+
+        struct Entry
+        {
+            std::uint64_t Key;
+            std::wstring Message;
+        };
+
+        MessageSource m_Source;
+        std::size_t m_Capacity;
+        std::size_t m_Mask;
+        std::unique_ptr<std::atomic<Entry const*>[]> m_Slots;
+        std::atomic<std::size_t> m_Size{ 0 };
+
+    public:
+
+        /**
+         * @brief Creates the cache.
+         * @param Source The function which retrieves the messages.
+         * @param Capacity The maximum number of cached messages. When the
+         *                 cache is full, new messages are not cached, and
+         *                 Lookup returns a view of a per-thread buffer.
+        */
+        explicit HResultMessageCache(
+            MessageSource Source,
+            std::size_t Capacity = 1024);
+
+        /**
+         * @brief Frees all cached messages. All views returned by Lookup
+         *        become invalid.
+        */
+        ~HResultMessageCache();
+
+        /**
+         * @brief Retrieves the message of a HRESULT code.
+         * @param Code The HRESULT code.
+         * @param LanguageId The language of the message.
+         * @return A view of the message, or an empty view if the message
+         *         source has no message for the code. It is valid as long as
+         *         the cache exists, except when the cache is full. In that
+         *         case it is valid until the next Lookup call on the same
+         *         thread.
+         * @remark Missing messages are cached as well, so a code without a
+         *         message does not call the message source again.
+        */
+        std::wstring_view Lookup(
+            std::int32_t Code,
+            std::uint32_t LanguageId);
+
+        /**
+         * @brief Retrieves the number of cached messages.
+         * @return The number of cached messages.
+        */
+        std::size_t GetSize() const noexcept
+        {
+            return this->m_Size.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Retrieves the maximum number of cached messages.
+         * @return The maximum number of cached messages.
+        */
+        std::size_t GetCapacity() const noexcept
+        {
+            return this->m_Capacity;
+        }
+    };
+}
+
+#endif // !MILE_PORTABLE_MESSAGECACHE
@@ -0,0 +1,596 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ProcessorTopology.cpp
+ * PURPOSE:   Implementation for the processor topology query
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.ProcessorTopology.h"
+
+#include <map>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#endif
+
+namespace
+{
+    /**
+     * @brief Counts the distinct values of a field of the logical processors.
+    */
+    template<typename FieldType>
+    std::uint32_t CountDistinct(
+        std::vector<Mile::LogicalProcessorInformation> const& Processors,
+        FieldType Mile::LogicalProcessorInformation::* Field)
+    {
+        std::set<FieldType> Values;
+        for (Mile::LogicalProcessorInformation const& Processor : Processors)
+        {
+            Values.insert(Processor.*Field);
+        }
+        return static_cast<std::uint32_t>(Values.size());
+    }
+
+    /**
+     * @brief Fills the topology with one core per logical processor, used if
+     *        the platform cannot report the real topology.
+    */
+    void FillFallbackTopology(
+        Mile::ProcessorTopology& Topology)
+    {
+        std::uint32_t Count = std::thread::hardware_concurrency();
+        if (!Count)
+        {
+            Count = 1;
+        }
+
+        Topology.LogicalProcessors.clear();
+        Topology.Caches.clear();
+        Topology.GroupActiveProcessorMasks.clear();
+        for (std::uint32_t i = 0; i < Count; ++i)
+        {
+            Topology.LogicalProcessors.push_back({ 0, i, i, 0, 0, 0 });
+        }
+    }
+
+    /**
+     * @brief Fills the counts of the topology from its logical processors.
+    */
+    void FillTopologyCounts(
+        Mile::ProcessorTopology& Topology)
+    {
+        Topology.GroupCount = ::CountDistinct(
+            Topology.LogicalProcessors,
+            &Mile::LogicalProcessorInformation::Group);
+        Topology.CoreCount = ::CountDistinct(
+            Topology.LogicalProcessors,
+            &Mile::LogicalProcessorInformation::Core);
+        Topology.PackageCount = ::CountDistinct(
+            Topology.LogicalProcessors,
+            &Mile::LogicalProcessorInformation::Package);
+        Topology.NumaNodeCount = ::CountDistinct(
+            Topology.LogicalProcessors,
+            &Mile::LogicalProcessorInformation::NumaNode);
+    }
+
+#if defined(_WIN32)
+
+    /**
+     * @brief Maps each bit of a group affinity to the index of the logical
+     *        processor in the topology.
+    */
+    class LogicalProcessorIndexer
+    {
+    private:
+
+        std::map<std::pair<WORD, DWORD>, std::uint32_t> m_Indices;
+
+    public:
+
+        void Add(
+            WORD Group,
+            DWORD Number,
+            std::uint32_t Index)
+        {
+            this->m_Indices.emplace(std::make_pair(Group, Number), Index);
+        }
+
+        template<typename HandlerType>
+        void ForEach(
+            GROUP_AFFINITY const& Affinity,
+            HandlerType&& Handler) const
+        {
+            for (DWORD Number = 0; Number < sizeof(KAFFINITY) * 8; ++Number)
+            {
+                if (!(Affinity.Mask & (static_cast<KAFFINITY>(1) << Number)))
+                {
+                    continue;
+                }
+
+                auto Iterator = this->m_Indices.find(
+                    std::make_pair(Affinity.Group, Number));
+                if (Iterator != this->m_Indices.end())
+                {
+                    Handler(Iterator->second);
+                }
+            }
+        }
+    };
+
+    bool FillWindowsTopology(
+        Mile::ProcessorTopology& Topology)
+    {
+        DWORD Length = 0;
+        if (::GetLogicalProcessorInformationEx(RelationAll, nullptr, &Length)
+            || ::GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+        {
+            return false;
+        }
+
+        std::vector<BYTE> Buffer(Length);
+        if (!::GetLogicalProcessorInformationEx(
+            RelationAll,
+            reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+                Buffer.data()),
+            &Length))
+        {
+            return false;
+        }
+
+        auto ForEachRecord = [&](
+            LOGICAL_PROCESSOR_RELATIONSHIP Relationship,
+            auto&& Handler)
+        {
+            for (DWORD Offset = 0; Offset < Length;)
+            {
+                auto Record = reinterpret_cast<
+                    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+                        Buffer.data() + Offset);
+                if (Record->Relationship == Relationship)
+                {
+                    Handler(*Record);
+                }
+                Offset += Record->Size;
+            }
+        };
+
+        LogicalProcessorIndexer Indexer;
+
+        ForEachRecord(RelationGroup, [&](
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const& Record)
+        {
+            for (WORD Group = 0;
+                Group < Record.Group.ActiveGroupCount;
+                ++Group)
+            {
+                KAFFINITY Mask =
+                    Record.Group.GroupInfo[Group].ActiveProcessorMask;
+                Topology.GroupActiveProcessorMasks.push_back(Mask);
+                for (DWORD Number = 0; Number < sizeof(KAFFINITY) * 8; ++Number)
+                {
+                    if (!(Mask & (static_cast<KAFFINITY>(1) << Number)))
+                    {
+                        continue;
+                    }
+
+                    Indexer.Add(
+                        Group,
+                        Number,
+                        static_cast<std::uint32_t>(
+                            Topology.LogicalProcessors.size()));
+                    Topology.LogicalProcessors.push_back(
+                        { Group, Number, 0, 0, 0, 0 });
+                }
+            }
+        });
+
+        if (Topology.LogicalProcessors.empty())
+        {
+            return false;
+        }
+
+        std::uint32_t Core = 0;
+        ForEachRecord(RelationProcessorCore, [&](
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const& Record)
+        {
+            for (WORD i = 0; i < Record.Processor.GroupCount; ++i)
+            {
+                Indexer.ForEach(
+                    Record.Processor.GroupMask[i],
+                    [&](std::uint32_t Index)
+                {
+                    Topology.LogicalProcessors[Index].Core = Core;
+                    Topology.LogicalProcessors[Index].EfficiencyClass =
+                        Record.Processor.EfficiencyClass;
+                });
+            }
+            ++Core;
+        });
+
+        std::uint32_t Package = 0;
+        ForEachRecord(RelationProcessorPackage, [&](
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const& Record)
+        {
+            for (WORD i = 0; i < Record.Processor.GroupCount; ++i)
+            {
+                Indexer.ForEach(
+                    Record.Processor.GroupMask[i],
+                    [&](std::uint32_t Index)
+                {
+                    Topology.LogicalProcessors[Index].Package = Package;
+                });
+            }
+            ++Package;
+        });
+
+        ForEachRecord(RelationNumaNode, [&](
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const& Record)
+        {
+            Indexer.ForEach(
+                Record.NumaNode.GroupMask,
+                [&](std::uint32_t Index)
+            {
+                Topology.LogicalProcessors[Index].NumaNode =
+                    Record.NumaNode.NodeNumber;
+            });
+        });
+
+        ForEachRecord(RelationCache, [&](
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const& Record)
+        {
+            Mile::ProcessorCacheInformation Cache;
+            Cache.Level = Record.Cache.Level;
+            switch (Record.Cache.Type)
+            {
+            case CacheInstruction:
+                Cache.Type = Mile::ProcessorCacheType::Instruction;
+                break;
+            case CacheData:
+                Cache.Type = Mile::ProcessorCacheType::Data;
+                break;
+            case CacheTrace:
+                Cache.Type = Mile::ProcessorCacheType::Trace;
+                break;
+            default:
+                Cache.Type = Mile::ProcessorCacheType::Unified;
+                break;
+            }
+            Cache.Size = Record.Cache.CacheSize;
+            Indexer.ForEach(
+                Record.Cache.GroupMask,
+                [&](std::uint32_t Index)
+            {
+                Cache.LogicalProcessors.push_back(Index);
+            });
+            Topology.Caches.push_back(std::move(Cache));
+        });
+
+        return true;
+    }
+
+#elif defined(__linux__)
+
+    const char DefaultSystemPath[] = "/sys/devices/system/";
+
+    bool ReadSystemFile(
+        std::string const& Path,
+        std::string& Content)
+    {
+        std::ifstream Stream(Path);
+        if (!Stream)
+        {
+            return false;
+        }
+
+        std::getline(Stream, Content);
+        return true;
+    }
+
+    bool ReadSystemNumber(
+        std::string const& Path,
+        long& Value)
+    {
+        std::string Content;
+        if (!ReadSystemFile(Path, Content) || Content.empty())
+        {
+            return false;
+        }
+
+        Value = std::strtol(Content.c_str(), nullptr, 10);
+        return true;
+    }
+
+    /**
+     * @brief Parses the Linux CPU list format, for example "0-3,8,10-11".
+    */
+    std::vector<std::uint32_t> ParseCpuList(
+        std::string const& List)
+    {
+        std::vector<std::uint32_t> Result;
+
+        const char* Current = List.c_str();
+        while (*Current)
+        {
+            char* End = nullptr;
+            unsigned long First = std::strtoul(Current, &End, 10);
+            if (End == Current)
+            {
+                break;
+            }
+
+            unsigned long Last = First;
+            Current = End;
+            if (*Current == '-')
+            {
+                Last = std::strtoul(Current + 1, &End, 10);
+                Current = End;
+            }
+
+            for (unsigned long Cpu = First; Cpu <= Last; ++Cpu)
+            {
+                Result.push_back(static_cast<std::uint32_t>(Cpu));
+            }
+
+            while (*Current == ',' || *Current == ' ' || *Current == '\n')
+            {
+                ++Current;
+            }
+        }
+
+        return Result;
+    }
+
+    bool FillLinuxTopology(
+        Mile::ProcessorTopology& Topology,
+        std::string const& SystemPath)
+    {
+        const std::string SystemCpuPath = SystemPath + "cpu/";
+        const std::string SystemNodePath = SystemPath + "node/";
+
+        std::string OnlineList;
+        if (!ReadSystemFile(
+            SystemCpuPath + "online",
+            OnlineList))
+        {
+            return false;
+        }
+
+        std::vector<std::uint32_t> OnlineCpus = ParseCpuList(OnlineList);
+        if (OnlineCpus.empty())
+        {
+            return false;
+        }
+
+        std::map<std::uint32_t, std::uint32_t> CpuToIndex;
+        std::map<std::pair<long, long>, std::uint32_t> CoreIndices;
+        std::map<long, std::uint32_t> PackageIndices;
+
+        for (std::uint32_t Cpu : OnlineCpus)
+        {
+            std::string TopologyPath =
+                SystemCpuPath + "cpu" + std::to_string(Cpu) +
+                "/topology/";
+
+            long PackageId = 0;
+            if (!ReadSystemNumber(
+                TopologyPath + "physical_package_id",
+                PackageId) || PackageId < 0)
+            {
+                PackageId = 0;
+            }
+
+            long CoreId = static_cast<long>(Cpu);
+            if (!ReadSystemNumber(TopologyPath + "core_id", CoreId))
+            {
+                CoreId = static_cast<long>(Cpu);
+            }
+
+            // The core_id is only unique in its package.
+            std::uint32_t Core = CoreIndices.emplace(
+                std::make_pair(PackageId, CoreId),
+                static_cast<std::uint32_t>(CoreIndices.size())).first->second;
+            std::uint32_t Package = PackageIndices.emplace(
+                PackageId,
+                static_cast<std::uint32_t>(PackageIndices.size())).first->second;
+
+            CpuToIndex.emplace(
+                Cpu,
+                static_cast<std::uint32_t>(Topology.LogicalProcessors.size()));
+            Topology.LogicalProcessors.push_back(
+                { 0, Cpu, Core, Package, 0, 0 });
+        }
+
+        if (DIR* NodeDirectory = ::opendir(SystemNodePath.c_str()))
+        {
+            while (dirent* Entry = ::readdir(NodeDirectory))
+            {
+                if (0 != std::strncmp(Entry->d_name, "node", 4))
+                {
+                    continue;
+                }
+
+                char* End = nullptr;
+                unsigned long Node = std::strtoul(Entry->d_name + 4, &End, 10);
+                if (End == Entry->d_name + 4 || *End)
+                {
+                    continue;
+                }
+
+                std::string CpuList;
+                if (!ReadSystemFile(
+                    SystemNodePath + Entry->d_name + "/cpulist",
+                    CpuList))
+                {
+                    continue;
+                }
+
+                for (std::uint32_t Cpu : ParseCpuList(CpuList))
+                {
+                    auto Iterator = CpuToIndex.find(Cpu);
+                    if (Iterator != CpuToIndex.end())
+                    {
+                        Topology.LogicalProcessors[Iterator->second].NumaNode =
+                            static_cast<std::uint32_t>(Node);
+                    }
+                }
+            }
+
+            ::closedir(NodeDirectory);
+        }
+
+        // Every logical processor reports the caches it uses, so the caches
+        // shared by several logical processors are deduplicated.
+        std::set<std::tuple<long, std::string, std::string>> KnownCaches;
+        for (std::uint32_t Cpu : OnlineCpus)
+        {
+            for (int CacheIndex = 0;; ++CacheIndex)
+            {
+                std::string CachePath =
+                    SystemCpuPath + "cpu" + std::to_string(Cpu) +
+                    "/cache/index" + std::to_string(CacheIndex) + "/";
+
+                long Level = 0;
+                if (!ReadSystemNumber(CachePath + "level", Level))
+                {
+                    break;
+                }
+
+                std::string Type;
+                std::string SharedList;
+                std::string Size;
+                ReadSystemFile(CachePath + "type", Type);
+                ReadSystemFile(CachePath + "shared_cpu_list", SharedList);
+                ReadSystemFile(CachePath + "size", Size);
+
+                if (!KnownCaches.emplace(Level, Type, SharedList).second)
+                {
+                    continue;
+                }
+
+                Mile::ProcessorCacheInformation Cache;
+                Cache.Level = static_cast<std::uint8_t>(Level);
+                if (Type == "Instruction")
+                {
+                    Cache.Type = Mile::ProcessorCacheType::Instruction;
+                }
+                else if (Type == "Data")
+                {
+                    Cache.Type = Mile::ProcessorCacheType::Data;
+                }
+                else
+                {
+                    Cache.Type = Mile::ProcessorCacheType::Unified;
+                }
+
+                char* SizeUnit = nullptr;
+                Cache.Size = std::strtoull(Size.c_str(), &SizeUnit, 10);
+                if (SizeUnit && (*SizeUnit == 'K' || *SizeUnit == 'k'))
+                {
+                    Cache.Size *= 1024;
+                }
+                else if (SizeUnit && *SizeUnit == 'M')
+                {
+                    Cache.Size *= 1024 * 1024;
+                }
+
+                for (std::uint32_t SharedCpu : ParseCpuList(SharedList))
+                {
+                    auto Iterator = CpuToIndex.find(SharedCpu);
+                    if (Iterator != CpuToIndex.end())
+                    {
+                        Cache.LogicalProcessors.push_back(Iterator->second);
+                    }
+                }
+
+                Topology.Caches.push_back(std::move(Cache));
+            }
+        }
+
+        return true;
+    }
+
+#endif
+}
+
+Mile::ProcessorTopology Mile::GetProcessorTopology()
+{
+    Mile::ProcessorTopology Topology;
+
+    bool Succeeded = false;
+
+#if defined(_WIN32)
+    Succeeded = ::FillWindowsTopology(Topology);
+#elif defined(__linux__)
+    Succeeded = ::FillLinuxTopology(Topology, ::DefaultSystemPath);
+#endif
+
+    if (!Succeeded)
+    {
+        ::FillFallbackTopology(Topology);
+    }
+
+    ::FillTopologyCounts(Topology);
+
+    return Topology;
+}
+
+#if defined(__linux__)
+
+Mile::ProcessorTopology Mile::GetProcessorTopologyFromSystemPath(
+    std::string const& SystemPath)
+{
+    Mile::ProcessorTopology Topology;
+
+    if (!::FillLinuxTopology(Topology, SystemPath))
+    {
+        ::FillFallbackTopology(Topology);
+    }
+
+    ::FillTopologyCounts(Topology);
+
+    return Topology;
+}
+
+#endif
+
+bool Mile::SetCurrentThreadProcessorGroup(
+    ProcessorTopology const& Topology,
+    std::uint16_t Group)
+{
+#if defined(_WIN32)
+    if (Group >= Topology.GroupActiveProcessorMasks.size() ||
+        !Topology.GroupActiveProcessorMasks[Group])
+    {
+        return false;
+    }
+
+    // The active processors of a group are not always numbered from 0 and
+    // without holes, so the mask comes from the topology instead of the
+    // number of active processors.
+    GROUP_AFFINITY Affinity = { 0 };
+    Affinity.Group = Group;
+    Affinity.Mask = static_cast<KAFFINITY>(
+        Topology.GroupActiveProcessorMasks[Group]);
+
+    return FALSE != ::SetThreadGroupAffinity(
+        ::GetCurrentThread(),
+        &Affinity,
+        nullptr);
+#else
+    static_cast<void>(Topology);
+    return 0 == Group;
+#endif
+}
@@ -0,0 +1,191 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ProcessorTopology.h
+ * PURPOSE:   Definition for the processor topology query
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_PROCESSORTOPOLOGY
+#define MILE_PORTABLE_PROCESSORTOPOLOGY
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Mile
+{
+    /**
+     * @brief The information about a logical processor.
+    */
+    struct LogicalProcessorInformation
+    {
+        /**
+         * @brief The processor group which contains the logical processor.
+         *        Processor groups only exist on Windows, where a group holds
+         *        up to 64 logical processors. It is always zero on other
+         *        platforms.
+        */
+        std::uint16_t Group;
+
+        /**
+         * @brief The number of the logical processor in its group. On
+         *        platforms without processor groups, it is the processor
+         *        number used by the operating system.
+        */
+        std::uint32_t Number;
+
+        /**
+         * @brief The index of the physical core, unique in the machine.
+         *        Logical processors with the same core index are SMT
+         *        siblings.
+        */
+        std::uint32_t Core;
+
+        /**
+         * @brief The index of the physical package (socket), unique in the
+         *        machine.
+        */
+        std::uint32_t Package;
+
+        /**
+         * @brief The NUMA node number of the logical processor.
+        */
+        std::uint32_t NumaNode;
+
+        /**
+         * @brief The efficiency class of the core. Higher values indicate
+         *        faster cores on heterogeneous processors. It is zero if the
+         *        platform does not report it.
+        */
+        std::uint8_t EfficiencyClass;
+    };
+
+    /**
+     * @brief The kind of a processor cache.
+    */
+    enum class ProcessorCacheType : std::uint8_t
+    {
+        Unified,
+        Instruction,
+        Data,
+        Trace,
+    };
+
+    /**
+     * @brief The information about a processor cache and the logical
+     *        processors sharing it.
+    */
+    struct ProcessorCacheInformation
+    {
+        /**
+         * @brief The cache level, 1 for L1 and so on.
+        */
+        std::uint8_t Level;
+
+        /**
+         * @brief The kind of the cache.
+        */
+        ProcessorCacheType Type;
+
+        /**
+         * @brief The size of the cache, in bytes.
+        */
+        std::uint64_t Size;
+
+        /**
+         * @brief The indices into ProcessorTopology::LogicalProcessors of the
+         *        logical processors which share the cache.
+        */
+        std::vector<std::uint32_t> LogicalProcessors;
+    };
+
+    /**
+     * @brief The processor topology of the machine.
+    */
+    struct ProcessorTopology
+    {
+        /**
+         * @brief All active logical processors of the machine, in all
+         *        processor groups, ordered by group and number.
+        */
+        std::vector<LogicalProcessorInformation> LogicalProcessors;
+
+        /**
+         * @brief All processor caches of the machine.
+        */
+        std::vector<ProcessorCacheInformation> Caches;
+
+        /**
+         * @brief The active processor mask of each processor group, indexed
+         *        by the group number. Parked and offline processors leave
+         *        holes in it, so it is not always a run of bits from bit 0.
+         *        It is empty on platforms without processor groups.
+        */
+        std::vector<std::uint64_t> GroupActiveProcessorMasks;
+
+        /**
+         * @brief The number of processor groups.
+        */
+        std::uint32_t GroupCount;
+
+        /**
+         * @brief The number of physical cores.
+        */
+        std::uint32_t CoreCount;
+
+        /**
+         * @brief The number of physical packages.
+        */
+        std::uint32_t PackageCount;
+
+        /**
+         * @brief The number of NUMA nodes.
+        */
+        std::uint32_t NumaNodeCount;
+    };
+
+    /**
+     * @brief Retrieves the processor topology of the machine. Unlike
+     *        GetNumberOfHardwareThreads, it covers all processor groups.
+     * @return The processor topology. If the platform cannot report the
+     *         topology, every logical processor is reported as a separate
+     *         core in a single package, group and NUMA node.
+     * @remark The Windows backend uses GetLogicalProcessorInformationEx, and
+     *         the Linux backend reads /sys/devices/system.
+    */
+    ProcessorTopology GetProcessorTopology();
+
+#if defined(__linux__)
+    /**
+     * @brief Retrieves the processor topology from a copy of the
+     *        /sys/devices/system directory, which is used to test the Linux
+     *        backend with machines other than the current one.
+     * @param SystemPath The path of the directory, with a trailing slash.
+     * @return The processor topology, as GetProcessorTopology returns it.
+    */
+    ProcessorTopology GetProcessorTopologyFromSystemPath(
+        std::string const& SystemPath);
+#endif
+
+    /**
+     * @brief Restricts the calling thread to the logical processors of a
+     *        processor group. Windows starts every thread in a single group,
+     *        so threads need to be assigned to the other groups explicitly to
+     *        use all logical processors of machines with more than 64 of
+     *        them.
+     * @param Topology The processor topology of the machine, whose active
+     *                 processor mask of the group becomes the affinity of
+     *                 the thread.
+     * @param Group The processor group.
+     * @return true if successful, otherwise false. It always succeeds for
+     *         group 0 on platforms without processor groups.
+    */
+    bool SetCurrentThreadProcessorGroup(
+        ProcessorTopology const& Topology,
+        std::uint16_t Group);
+}
+
+#endif // !MILE_PORTABLE_PROCESSORTOPOLOGY
@@ -0,0 +1,684 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Synchronization.cpp
+ * PURPOSE:   Implementation for the portable synchronization primitives
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.Synchronization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <mutex>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <intrin.h>
+#pragma intrinsic(_ReturnAddress)
+#define MILE_NOINLINE __declspec(noinline)
+#define MILE_RETURN_ADDRESS() \
+    reinterpret_cast<std::uintptr_t>(_ReturnAddress())
+#else
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <thread>
+#define MILE_NOINLINE __attribute__((noinline))
+#define MILE_RETURN_ADDRESS() \
+    reinterpret_cast<std::uintptr_t>(__builtin_return_address(0))
+#endif
+
+namespace
+{
+    /**
+     * @brief The registered lock profiles.
+    */
+    struct LockProfileRegistry
+    {
+        std::mutex Mutex;
+        std::vector<Mile::LockProfile*> Profiles;
+    };
+
+    LockProfileRegistry& GetLockProfileRegistry()
+    {
+        static LockProfileRegistry Registry;
+        return Registry;
+    }
+
+    std::uint64_t GetMonotonicNanoseconds() noexcept
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * @brief Waits for a lock in the profiled acquisition path and records
+     *        the statistics.
+    */
+    template<typename TryLockType, typename LockType>
+    void ProfiledAcquire(
+        Mile::LockProfile* Profile,
+        std::atomic<std::uintptr_t>* OwnerSite,
+        std::uintptr_t CallerSite,
+        TryLockType&& TryLock,
+        LockType&& Lock) noexcept
+    {
+        if (TryLock())
+        {
+            if (OwnerSite)
+            {
+                OwnerSite->store(CallerSite, std::memory_order_relaxed);
+            }
+            Profile->RecordAcquisition(0, 0);
+            return;
+        }
+
+        std::uintptr_t BlockingSite = OwnerSite
+            ? OwnerSite->load(std::memory_order_relaxed)
+            : 0;
+        std::uint64_t Start = ::GetMonotonicNanoseconds();
+        Lock();
+        std::uint64_t WaitTime = ::GetMonotonicNanoseconds() - Start;
+
+        if (OwnerSite)
+        {
+            OwnerSite->store(CallerSite, std::memory_order_relaxed);
+        }
+        Profile->RecordAcquisition(WaitTime ? WaitTime : 1, BlockingSite);
+    }
+
+#if defined(__linux__)
+
+    const std::uint32_t SpinCount = 100;
+
+    void FutexWait(
+        std::atomic<std::uint32_t>& Address,
+        std::uint32_t ExpectedValue) noexcept
+    {
+        ::syscall(
+            SYS_futex,
+            reinterpret_cast<std::uint32_t*>(&Address),
+            FUTEX_WAIT_PRIVATE,
+            ExpectedValue,
+            nullptr,
+            nullptr,
+            0);
+    }
+
+    void FutexWake(
+        std::atomic<std::uint32_t>& Address,
+        int Count) noexcept
+    {
+        ::syscall(
+            SYS_futex,
+            reinterpret_cast<std::uint32_t*>(&Address),
+            FUTEX_WAKE_PRIVATE,
+            Count,
+            nullptr,
+            nullptr,
+            0);
+    }
+
+    void CpuRelax() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // The states of the exclusive lock.
+    const std::uint32_t MutexUnlocked = 0;
+    const std::uint32_t MutexLocked = 1;
+    const std::uint32_t MutexContended = 2;
+
+    // The bits of the reader/writer lock state. The reader count is stored
+    // above the flags.
+    const std::uint32_t SharedMutexWriter = 1;
+    const std::uint32_t SharedMutexWaiters = 2;
+    const std::uint32_t SharedMutexWriterPending = 4;
+    const std::uint32_t SharedMutexReader = 8;
+    const std::uint32_t SharedMutexFlags =
+        SharedMutexWaiters | SharedMutexWriterPending;
+
+#endif
+}
+
+Mile::LockProfile::LockProfile(
+    std::string const& Name) :
+    m_Name(Name)
+{
+    for (std::atomic<std::uint64_t>& Bucket : this->m_Histogram)
+    {
+        Bucket.store(0, std::memory_order_relaxed);
+    }
+
+    LockProfileRegistry& Registry = ::GetLockProfileRegistry();
+    std::lock_guard<std::mutex> Lock(Registry.Mutex);
+    Registry.Profiles.push_back(this);
+}
+
+Mile::LockProfile::~LockProfile()
+{
+    LockProfileRegistry& Registry = ::GetLockProfileRegistry();
+    std::lock_guard<std::mutex> Lock(Registry.Mutex);
+    Registry.Profiles.erase(
+        std::remove(Registry.Profiles.begin(), Registry.Profiles.end(), this),
+        Registry.Profiles.end());
+}
+
+void Mile::LockProfile::RecordAcquisition(
+    std::uint64_t WaitNanoseconds,
+    std::uintptr_t OwnerSite) noexcept
+{
+    this->m_Acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    if (!WaitNanoseconds)
+    {
+        return;
+    }
+
+    this->m_Contentions.fetch_add(1, std::memory_order_relaxed);
+    this->m_TotalWaitNanoseconds.fetch_add(
+        WaitNanoseconds,
+        std::memory_order_relaxed);
+
+    std::uint64_t Maximum =
+        this->m_MaximumWaitNanoseconds.load(std::memory_order_relaxed);
+    while (Maximum < WaitNanoseconds &&
+        !this->m_MaximumWaitNanoseconds.compare_exchange_weak(
+            Maximum,
+            WaitNanoseconds,
+            std::memory_order_relaxed))
+    {
+    }
+
+    std::size_t Bucket = 0;
+    for (std::uint64_t Value = WaitNanoseconds; Value > 1; Value >>= 1)
+    {
+        ++Bucket;
+    }
+    if (Bucket >= HistogramBuckets)
+    {
+        Bucket = HistogramBuckets - 1;
+    }
+    this->m_Histogram[Bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (!OwnerSite)
+    {
+        return;
+    }
+
+    for (OwnerSiteEntry& Site : this->m_OwnerSites)
+    {
+        std::uintptr_t Address = Site.Address.load(std::memory_order_relaxed);
+        if (!Address)
+        {
+            if (!Site.Address.compare_exchange_strong(
+                Address,
+                OwnerSite,
+                std::memory_order_relaxed))
+            {
+                if (Address != OwnerSite)
+                {
+                    continue;
+                }
+            }
+            Address = OwnerSite;
+        }
+
+        if (Address == OwnerSite)
+        {
+            Site.Count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // All slots are used by other sites, so this site is not tracked.
+}
+
+Mile::LockProfileSnapshot Mile::LockProfile::GetSnapshot() const
+{
+    LockProfileSnapshot Snapshot;
+
+    Snapshot.Name = this->m_Name;
+    Snapshot.Acquisitions =
+        this->m_Acquisitions.load(std::memory_order_relaxed);
+    Snapshot.Contentions =
+        this->m_Contentions.load(std::memory_order_relaxed);
+    Snapshot.TotalWaitNanoseconds =
+        this->m_TotalWaitNanoseconds.load(std::memory_order_relaxed);
+    Snapshot.MaximumWaitNanoseconds =
+        this->m_MaximumWaitNanoseconds.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < HistogramBuckets; ++i)
+    {
+        Snapshot.WaitHistogram[i] =
+            this->m_Histogram[i].load(std::memory_order_relaxed);
+    }
+
+    for (OwnerSiteEntry const& Site : this->m_OwnerSites)
+    {
+        std::uintptr_t Address = Site.Address.load(std::memory_order_relaxed);
+        if (Address)
+        {
+            Snapshot.OwnerSites.emplace_back(
+                Address,
+                Site.Count.load(std::memory_order_relaxed));
+        }
+    }
+
+    std::sort(
+        Snapshot.OwnerSites.begin(),
+        Snapshot.OwnerSites.end(),
+        [](std::pair<std::uintptr_t, std::uint64_t> const& Left,
+            std::pair<std::uintptr_t, std::uint64_t> const& Right)
+    {
+        return Left.second > Right.second;
+    });
+
+    return Snapshot;
+}
+
+std::vector<Mile::LockProfileSnapshot> Mile::LockProfile::GetAllSnapshots()
+{
+    std::vector<LockProfileSnapshot> Snapshots;
+
+    LockProfileRegistry& Registry = ::GetLockProfileRegistry();
+    std::lock_guard<std::mutex> Lock(Registry.Mutex);
+    for (LockProfile* Profile : Registry.Profiles)
+    {
+        Snapshots.push_back(Profile->GetSnapshot());
+    }
+
+    return Snapshots;
+}
+
+#if defined(_WIN32)
+
+void Mile::Mutex::RawLock() noexcept
+{
+    ::AcquireSRWLockExclusive(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+bool Mile::Mutex::RawTryLock() noexcept
+{
+    return FALSE != ::TryAcquireSRWLockExclusive(
+        reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+void Mile::Mutex::RawUnlock() noexcept
+{
+    ::ReleaseSRWLockExclusive(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+void Mile::SharedMutex::RawLockExclusive() noexcept
+{
+    ::AcquireSRWLockExclusive(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+bool Mile::SharedMutex::RawTryLockExclusive() noexcept
+{
+    return FALSE != ::TryAcquireSRWLockExclusive(
+        reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+void Mile::SharedMutex::RawUnlockExclusive() noexcept
+{
+    ::ReleaseSRWLockExclusive(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+void Mile::SharedMutex::RawLockShared() noexcept
+{
+    ::AcquireSRWLockShared(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+bool Mile::SharedMutex::RawTryLockShared() noexcept
+{
+    return FALSE != ::TryAcquireSRWLockShared(
+        reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+void Mile::SharedMutex::RawUnlockShared() noexcept
+{
+    ::ReleaseSRWLockShared(reinterpret_cast<PSRWLOCK>(&this->m_RawObject));
+}
+
+#elif defined(__linux__)
+
+void Mile::Mutex::RawLock() noexcept
+{
+    std::uint32_t State = MutexUnlocked;
+    if (this->m_RawObject.compare_exchange_strong(
+        State,
+        MutexLocked,
+        std::memory_order_acquire))
+    {
+        return;
+    }
+
+    // Spin for a short time, because most critical sections are short.
+    for (std::uint32_t i = 0; i < SpinCount && State != MutexContended; ++i)
+    {
+        ::CpuRelax();
+        State = MutexUnlocked;
+        if (this->m_RawObject.compare_exchange_weak(
+            State,
+            MutexLocked,
+            std::memory_order_acquire))
+        {
+            return;
+        }
+    }
+
+    // Mark the lock as contended, so the owner knows it has to wake us up.
+    State = this->m_RawObject.exchange(
+        MutexContended,
+        std::memory_order_acquire);
+    while (State != MutexUnlocked)
+    {
+        ::FutexWait(this->m_RawObject, MutexContended);
+        State = this->m_RawObject.exchange(
+            MutexContended,
+            std::memory_order_acquire);
+    }
+}
+
+bool Mile::Mutex::RawTryLock() noexcept
+{
+    std::uint32_t State = MutexUnlocked;
+    return this->m_RawObject.compare_exchange_strong(
+        State,
+        MutexLocked,
+        std::memory_order_acquire);
+}
+
+void Mile::Mutex::RawUnlock() noexcept
+{
+    if (MutexContended == this->m_RawObject.exchange(
+        MutexUnlocked,
+        std::memory_order_release))
+    {
+        ::FutexWake(this->m_RawObject, 1);
+    }
+}
+
+void Mile::SharedMutex::RawLockExclusive() noexcept
+{
+    std::uint32_t SpinRemaining = SpinCount;
+
+    for (;;)
+    {
+        std::uint32_t State = this->m_RawObject.load(std::memory_order_relaxed);
+
+        // Acquire if there is neither a writer nor a reader. The pending flag
+        // is cleared, because it has served its purpose for this writer.
+        if (!(State & ~SharedMutexFlags))
+        {
+            if (this->m_RawObject.compare_exchange_weak(
+                State,
+                (State & SharedMutexWaiters) | SharedMutexWriter,
+                std::memory_order_acquire))
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (SpinRemaining)
+        {
+            --SpinRemaining;
+            ::CpuRelax();
+            continue;
+        }
+
+        std::uint32_t WaitState =
+            State | SharedMutexWaiters | SharedMutexWriterPending;
+        if (WaitState != State && !this->m_RawObject.compare_exchange_weak(
+            State,
+            WaitState,
+            std::memory_order_relaxed))
+        {
+            continue;
+        }
+
+        ::FutexWait(this->m_RawObject, WaitState);
+    }
+}
+
+bool Mile::SharedMutex::RawTryLockExclusive() noexcept
+{
+    std::uint32_t State = this->m_RawObject.load(std::memory_order_relaxed);
+    while (!(State & ~SharedMutexFlags))
+    {
+        if (this->m_RawObject.compare_exchange_weak(
+            State,
+            (State & SharedMutexWaiters) | SharedMutexWriter,
+            std::memory_order_acquire))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Mile::SharedMutex::RawUnlockExclusive() noexcept
+{
+    // No reader can enter while the writer flag is set, so the state only
+    // contains the flags of the waiters.
+    if (SharedMutexWaiters & this->m_RawObject.exchange(
+        0,
+        std::memory_order_release))
+    {
+        ::FutexWake(this->m_RawObject, INT_MAX);
+    }
+}
+
+void Mile::SharedMutex::RawLockShared() noexcept
+{
+    std::uint32_t SpinRemaining = SpinCount;
+
+    for (;;)
+    {
+        std::uint32_t State = this->m_RawObject.load(std::memory_order_relaxed);
+
+        if (!(State & (SharedMutexWriter | SharedMutexWriterPending)))
+        {
+            if (this->m_RawObject.compare_exchange_weak(
+                State,
+                State + SharedMutexReader,
+                std::memory_order_acquire))
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (SpinRemaining)
+        {
+            --SpinRemaining;
+            ::CpuRelax();
+            continue;
+        }
+
+        std::uint32_t WaitState = State | SharedMutexWaiters;
+        if (WaitState != State && !this->m_RawObject.compare_exchange_weak(
+            State,
+            WaitState,
+            std::memory_order_relaxed))
+        {
+            continue;
+        }
+
+        ::FutexWait(this->m_RawObject, WaitState);
+    }
+}
+
+bool Mile::SharedMutex::RawTryLockShared() noexcept
+{
+    std::uint32_t State = this->m_RawObject.load(std::memory_order_relaxed);
+    while (!(State & (SharedMutexWriter | SharedMutexWriterPending)))
+    {
+        if (this->m_RawObject.compare_exchange_weak(
+            State,
+            State + SharedMutexReader,
+            std::memory_order_acquire))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Mile::SharedMutex::RawUnlockShared() noexcept
+{
+    std::uint32_t State = this->m_RawObject.fetch_sub(
+        SharedMutexReader,
+        std::memory_order_release) - SharedMutexReader;
+
+    // The last reader wakes up the waiters, which are waiting for a writer
+    // to get in.
+    while (!(State & ~SharedMutexFlags) && (State & SharedMutexWaiters))
+    {
+        if (this->m_RawObject.compare_exchange_weak(
+            State,
+            State & ~SharedMutexWaiters,
+            std::memory_order_relaxed))
+        {
+            ::FutexWake(this->m_RawObject, INT_MAX);
+            break;
+        }
+    }
+}
+
+#else
+
+void Mile::Mutex::RawLock() noexcept
+{
+    this->m_RawObject.lock();
+}
+
+bool Mile::Mutex::RawTryLock() noexcept
+{
+    return this->m_RawObject.try_lock();
+}
+
+void Mile::Mutex::RawUnlock() noexcept
+{
+    this->m_RawObject.unlock();
+}
+
+void Mile::SharedMutex::RawLockExclusive() noexcept
+{
+    this->m_RawObject.lock();
+}
+
+bool Mile::SharedMutex::RawTryLockExclusive() noexcept
+{
+    return this->m_RawObject.try_lock();
+}
+
+void Mile::SharedMutex::RawUnlockExclusive() noexcept
+{
+    this->m_RawObject.unlock();
+}
+
+void Mile::SharedMutex::RawLockShared() noexcept
+{
+    this->m_RawObject.lock_shared();
+}
+
+bool Mile::SharedMutex::RawTryLockShared() noexcept
+{
+    return this->m_RawObject.try_lock_shared();
+}
+
+void Mile::SharedMutex::RawUnlockShared() noexcept
+{
+    this->m_RawObject.unlock_shared();
+}
+
+#endif
+
+MILE_NOINLINE void Mile::Mutex::ProfiledLock() noexcept
+{
+    ::ProfiledAcquire(
+        this->m_Profile,
+        &this->m_OwnerSite,
+        MILE_RETURN_ADDRESS(),
+        [this]() { return this->RawTryLock(); },
+        [this]() { this->RawLock(); });
+}
+
+MILE_NOINLINE bool Mile::Mutex::ProfiledTryLock() noexcept
+{
+    if (!this->RawTryLock())
+    {
+        return false;
+    }
+
+    this->m_OwnerSite.store(MILE_RETURN_ADDRESS(), std::memory_order_relaxed);
+    this->m_Profile->RecordAcquisition(0, 0);
+    return true;
+}
+
+MILE_NOINLINE void Mile::SharedMutex::ProfiledLockExclusive() noexcept
+{
+    ::ProfiledAcquire(
+        this->m_Profile,
+        &this->m_OwnerSite,
+        MILE_RETURN_ADDRESS(),
+        [this]() { return this->RawTryLockExclusive(); },
+        [this]() { this->RawLockExclusive(); });
+}
+
+MILE_NOINLINE bool Mile::SharedMutex::ProfiledTryLockExclusive() noexcept
+{
+    if (!this->RawTryLockExclusive())
+    {
+        return false;
+    }
+
+    this->m_OwnerSite.store(MILE_RETURN_ADDRESS(), std::memory_order_relaxed);
+    this->m_Profile->RecordAcquisition(0, 0);
+    return true;
+}
+
+MILE_NOINLINE void Mile::SharedMutex::ProfiledLockShared() noexcept
+{
+    // Shared owners are not tracked, so a reader blocked by a writer reports
+    // the site of the last exclusive owner.
+    if (this->RawTryLockShared())
+    {
+        this->m_Profile->RecordAcquisition(0, 0);
+        return;
+    }
+
+    std::uintptr_t BlockingSite =
+        this->m_OwnerSite.load(std::memory_order_relaxed);
+    std::uint64_t Start = ::GetMonotonicNanoseconds();
+    this->RawLockShared();
+    std::uint64_t WaitTime = ::GetMonotonicNanoseconds() - Start;
+    this->m_Profile->RecordAcquisition(WaitTime ? WaitTime : 1, BlockingSite);
+}
+
+MILE_NOINLINE bool Mile::SharedMutex::ProfiledTryLockShared() noexcept
+{
+    if (!this->RawTryLockShared())
+    {
+        return false;
+    }
+
+    this->m_Profile->RecordAcquisition(0, 0);
+    return true;
+}
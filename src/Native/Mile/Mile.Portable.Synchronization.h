@@ -0,0 +1,618 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Synchronization.h
+ * PURPOSE:   Definition for the portable synchronization primitives
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_SYNCHRONIZATION
+#define MILE_PORTABLE_SYNCHRONIZATION
+
+#include "Mile.Portable.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(__linux__)
+#include <mutex>
+#include <shared_mutex>
+#endif
+
+namespace Mile
+{
+    /**
+     * @brief The contention statistics of a lock profile.
+    */
+    struct LockProfileSnapshot
+    {
+        /**
+         * @brief The name of the lock profile.
+        */
+        std::string Name;
+
+        /**
+         * @brief The number of acquisitions.
+        */
+        std::uint64_t Acquisitions;
+
+        /**
+         * @brief The number of acquisitions which had to wait.
+        */
+        std::uint64_t Contentions;
+
+        /**
+         * @brief The total time spent waiting, in nanoseconds.
+        */
+        std::uint64_t TotalWaitNanoseconds;
+
+        /**
+         * @brief The longest time spent waiting, in nanoseconds.
+        */
+        std::uint64_t MaximumWaitNanoseconds;
+
+        /**
+         * @brief The histogram of the wait time of contended acquisitions.
+         *        The bucket N counts the waits in [2^N, 2^(N+1)) nanoseconds.
+        */
+        std::array<std::uint64_t, 32> WaitHistogram;
+
+        /**
+         * @brief The code addresses which owned the lock when another thread
+         *        had to wait for it, and how often each one was seen. The
+         *        address is the return address of the acquisition call.
+        */
+        std::vector<std::pair<std::uintptr_t, std::uint64_t>> OwnerSites;
+    };
+
+    /**
+     * @brief Collects contention statistics for one or more locks. Attach it
+     *        to the locks which need to be profiled. Locks without a profile
+     *        do not pay for the profiling.
+    */
+    class LockProfile : DisableCopyConstruction, DisableMoveConstruction
+    {
+    public:
+
+        /**
+         * @brief The number of buckets of the wait time histogram.
+        */
+        static const std::size_t HistogramBuckets = 32;
+
+        /**
+         * @brief The maximum number of distinct owner sites recorded.
+        */
+        static const std::size_t MaximumOwnerSites = 16;
+
+    private:
+
+        struct OwnerSiteEntry
+        {
+            std::atomic<std::uintptr_t> Address{ 0 };
+            std::atomic<std::uint64_t> Count{ 0 };
+        };
+
+        std::string m_Name;
+
+        std::atomic<std::uint64_t> m_Acquisitions{ 0 };
+        std::atomic<std::uint64_t> m_Contentions{ 0 };
+        std::atomic<std::uint64_t> m_TotalWaitNanoseconds{ 0 };
+        std::atomic<std::uint64_t> m_MaximumWaitNanoseconds{ 0 };
+        std::array<std::atomic<std::uint64_t>, HistogramBuckets> m_Histogram;
+        std::array<OwnerSiteEntry, MaximumOwnerSites> m_OwnerSites;
+
+    public:
+
+        /**
+         * @brief Creates a lock profile and registers it, so it is included
+         *        in GetAllSnapshots.
+         * @param Name The name of the lock profile.
+        */
+        explicit LockProfile(
+            std::string const& Name);
+
+        /**
+         * @brief Unregisters the lock profile.
+        */
+        ~LockProfile();
+
+        /**
+         * @brief Records an acquisition of a lock using the profile.
+         * @param WaitNanoseconds The time spent waiting, in nanoseconds, or
+         *                        zero if the lock was acquired immediately.
+         * @param OwnerSite The site which owned the lock while waiting, or
+         *                  zero if it is unknown.
+        */
+        void RecordAcquisition(
+            std::uint64_t WaitNanoseconds,
+            std::uintptr_t OwnerSite) noexcept;
+
+        /**
+         * @brief Retrieves the statistics of the profile.
+         * @return The statistics of the profile.
+        */
+        LockProfileSnapshot GetSnapshot() const;
+
+        /**
+         * @brief Retrieves the statistics of all registered profiles.
+         * @return The statistics of all registered profiles.
+        */
+        static std::vector<LockProfileSnapshot> GetAllSnapshots();
+    };
+
+    /**
+     * @brief A portable exclusive lock. It uses a slim reader/writer (SRW)
+     *        lock on Windows and a futex on Linux.
+     * @remark The lock is not recursive.
+    */
+    class Mutex : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+#if defined(_WIN32)
+        void* m_RawObject = nullptr;
+#elif defined(__linux__)
+        std::atomic<std::uint32_t> m_RawObject{ 0 };
+#else
+        std::mutex m_RawObject;
+#endif
+
+        LockProfile* m_Profile = nullptr;
+        std::atomic<std::uintptr_t> m_OwnerSite{ 0 };
+
+        void RawLock() noexcept;
+        bool RawTryLock() noexcept;
+        void RawUnlock() noexcept;
+
+        void ProfiledLock() noexcept;
+        bool ProfiledTryLock() noexcept;
+
+    public:
+
+        /**
+         * @brief Initializes the lock.
+         * @param Profile An optional lock profile which receives the
+         *                contention statistics of the lock.
+        */
+        explicit Mutex(
+            LockProfile* Profile = nullptr) noexcept :
+            m_Profile(Profile)
+        {
+        }
+
+        /**
+         * @brief Attaches a lock profile. It should be called before the lock
+         *        is shared with other threads.
+         * @param Profile The lock profile, or nullptr to detach the profile.
+        */
+        void SetProfile(
+            LockProfile* Profile) noexcept
+        {
+            this->m_Profile = Profile;
+        }
+
+        /**
+         * @brief Waits for ownership of the lock.
+        */
+        void Lock() noexcept
+        {
+            if (this->m_Profile)
+            {
+                this->ProfiledLock();
+                return;
+            }
+
+            this->RawLock();
+        }
+
+        /**
+         * @brief Attempts to take ownership of the lock without blocking.
+         * @return true if the lock is acquired, otherwise false.
+        */
+        bool TryLock() noexcept
+        {
+            if (this->m_Profile)
+            {
+                return this->ProfiledTryLock();
+            }
+
+            return this->RawTryLock();
+        }
+
+        /**
+         * @brief Releases ownership of the lock.
+        */
+        void Unlock() noexcept
+        {
+            this->RawUnlock();
+        }
+    };
+
+    /**
+     * @brief A portable reader/writer lock. It uses a slim reader/writer
+     *        (SRW) lock on Windows and a futex on Linux. The method names
+     *        match Mile::SRWLock.
+     * @remark The lock is not recursive. Waiting writers block new readers,
+     *         so readers cannot starve the writers.
+    */
+    class SharedMutex : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+#if defined(_WIN32)
+        void* m_RawObject = nullptr;
+#elif defined(__linux__)
+        std::atomic<std::uint32_t> m_RawObject{ 0 };
+#else
+        std::shared_mutex m_RawObject;
+#endif
+
+        LockProfile* m_Profile = nullptr;
+        std::atomic<std::uintptr_t> m_OwnerSite{ 0 };
+
+        void RawLockExclusive() noexcept;
+        bool RawTryLockExclusive() noexcept;
+        void RawUnlockExclusive() noexcept;
+        void RawLockShared() noexcept;
+        bool RawTryLockShared() noexcept;
+        void RawUnlockShared() noexcept;
+
+        void ProfiledLockExclusive() noexcept;
+        bool ProfiledTryLockExclusive() noexcept;
+        void ProfiledLockShared() noexcept;
+        bool ProfiledTryLockShared() noexcept;
+
+    public:
+
+        /**
+         * @brief Initializes the lock.
+         * @param Profile An optional lock profile which receives the
+         *                contention statistics of the lock.
+        */
+        explicit SharedMutex(
+            LockProfile* Profile = nullptr) noexcept :
+            m_Profile(Profile)
+        {
+        }
+
+        /**
+         * @brief Attaches a lock profile. It should be called before the lock
+         *        is shared with other threads.
+         * @param Profile The lock profile, or nullptr to detach the profile.
+        */
+        void SetProfile(
+            LockProfile* Profile) noexcept
+        {
+            this->m_Profile = Profile;
+        }
+
+        /**
+         * @brief Acquires the lock in exclusive mode.
+        */
+        void LockExclusive() noexcept
+        {
+            if (this->m_Profile)
+            {
+                this->ProfiledLockExclusive();
+                return;
+            }
+
+            this->RawLockExclusive();
+        }
+
+        /**
+         * @brief Attempts to acquire the lock in exclusive mode without
+         *        blocking.
+         * @return true if the lock is acquired, otherwise false.
+        */
+        bool TryLockExclusive() noexcept
+        {
+            if (this->m_Profile)
+            {
+                return this->ProfiledTryLockExclusive();
+            }
+
+            return this->RawTryLockExclusive();
+        }
+
+        /**
+         * @brief Releases the lock acquired in exclusive mode.
+        */
+        void UnlockExclusive() noexcept
+        {
+            this->RawUnlockExclusive();
+        }
+
+        /**
+         * @brief Acquires the lock in shared mode.
+        */
+        void LockShared() noexcept
+        {
+            if (this->m_Profile)
+            {
+                this->ProfiledLockShared();
+                return;
+            }
+
+            this->RawLockShared();
+        }
+
+        /**
+         * @brief Attempts to acquire the lock in shared mode without
+         *        blocking.
+         * @return true if the lock is acquired, otherwise false.
+        */
+        bool TryLockShared() noexcept
+        {
+            if (this->m_Profile)
+            {
+                return this->ProfiledTryLockShared();
+            }
+
+            return this->RawTryLockShared();
+        }
+
+        /**
+         * @brief Releases the lock acquired in shared mode.
+        */
+        void UnlockShared() noexcept
+        {
+            this->RawUnlockShared();
+        }
+    };
+
+    /**
+     * @brief Provides automatic locking and unlocking of a lock with the
+     *        Lock and Unlock methods, like Mile::Mutex and
+     *        Mile::CriticalSection.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoLock : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+
+    public:
+
+        /**
+         * @brief Lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoLock(
+            LockType& Object) noexcept :
+            m_Object(Object)
+        {
+            this->m_Object.Lock();
+        }
+
+        /**
+         * @brief Unlock the lock object.
+        */
+        ~AutoLock() noexcept
+        {
+            this->m_Object.Unlock();
+        }
+    };
+
+    /**
+     * @brief Provides automatic trying to locking and unlocking of a lock
+     *        with the TryLock and Unlock methods.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoTryLock : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+        bool m_IsLocked;
+
+    public:
+
+        /**
+         * @brief Try to lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoTryLock(
+            LockType& Object) noexcept :
+            m_Object(Object),
+            m_IsLocked(Object.TryLock())
+        {
+        }
+
+        /**
+         * @brief Try to unlock the lock object.
+        */
+        ~AutoTryLock() noexcept
+        {
+            if (this->m_IsLocked)
+            {
+                this->m_Object.Unlock();
+            }
+        }
+
+        /**
+         * @brief Check the lock status.
+         * @return The lock status.
+        */
+        bool IsLocked() const noexcept
+        {
+            return this->m_IsLocked;
+        }
+    };
+
+    /**
+     * @brief Provides automatic exclusive locking and unlocking of a
+     *        reader/writer lock, like Mile::SharedMutex and Mile::SRWLock.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoExclusiveLock : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+
+    public:
+
+        /**
+         * @brief Exclusive lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoExclusiveLock(
+            LockType& Object) noexcept :
+            m_Object(Object)
+        {
+            this->m_Object.LockExclusive();
+        }
+
+        /**
+         * @brief Exclusive unlock the lock object.
+        */
+        ~AutoExclusiveLock() noexcept
+        {
+            this->m_Object.UnlockExclusive();
+        }
+    };
+
+    /**
+     * @brief Provides automatic trying to exclusive locking and unlocking of
+     *        a reader/writer lock.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoExclusiveTryLock :
+        DisableCopyConstruction,
+        DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+        bool m_IsLocked;
+
+    public:
+
+        /**
+         * @brief Try to exclusive lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoExclusiveTryLock(
+            LockType& Object) noexcept :
+            m_Object(Object),
+            m_IsLocked(Object.TryLockExclusive())
+        {
+        }
+
+        /**
+         * @brief Try to exclusive unlock the lock object.
+        */
+        ~AutoExclusiveTryLock() noexcept
+        {
+            if (this->m_IsLocked)
+            {
+                this->m_Object.UnlockExclusive();
+            }
+        }
+
+        /**
+         * @brief Check the lock status.
+         * @return The lock status.
+        */
+        bool IsLocked() const noexcept
+        {
+            return this->m_IsLocked;
+        }
+    };
+
+    /**
+     * @brief Provides automatic shared locking and unlocking of a
+     *        reader/writer lock.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoSharedLock : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+
+    public:
+
+        /**
+         * @brief Shared lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoSharedLock(
+            LockType& Object) noexcept :
+            m_Object(Object)
+        {
+            this->m_Object.LockShared();
+        }
+
+        /**
+         * @brief Shared unlock the lock object.
+        */
+        ~AutoSharedLock() noexcept
+        {
+            this->m_Object.UnlockShared();
+        }
+    };
+
+    /**
+     * @brief Provides automatic trying to shared locking and unlocking of a
+     *        reader/writer lock.
+     * @tparam LockType The type of the lock.
+    */
+    template<typename LockType>
+    class AutoSharedTryLock : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        LockType& m_Object;
+        bool m_IsLocked;
+
+    public:
+
+        /**
+         * @brief Try to shared lock the lock object.
+         * @param Object The lock object.
+        */
+        explicit AutoSharedTryLock(
+            LockType& Object) noexcept :
+            m_Object(Object),
+            m_IsLocked(Object.TryLockShared())
+        {
+        }
+
+        /**
+         * @brief Try to shared unlock the lock object.
+        */
+        ~AutoSharedTryLock() noexcept
+        {
+            if (this->m_IsLocked)
+            {
+                this->m_Object.UnlockShared();
+            }
+        }
+
+        /**
+         * @brief Check the lock status.
+         * @return The lock status.
+        */
+        bool IsLocked() const noexcept
+        {
+            return this->m_IsLocked;
+        }
+    };
+}
+
+#endif // !MILE_PORTABLE_SYNCHRONIZATION
@@ -0,0 +1,362 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ThreadPool.cpp
+ * PURPOSE:   Implementation for the work-stealing thread pool
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "Mile.Portable.ThreadPool.h"
+#include "Mile.Portable.ProcessorTopology.h"
+
+#include <chrono>
+
+namespace
+{
+    /**
+     * @brief The thread pool which owns the calling thread, if any.
+    */
+    thread_local Mile::ThreadPool* g_CurrentThreadPool = nullptr;
+
+    /**
+     * @brief The worker index of the calling thread in g_CurrentThreadPool.
+    */
+    thread_local std::size_t g_CurrentWorkerIndex = 0;
+
+    /**
+     * @brief The number of times an idle worker looks for work again before
+     *        it goes to sleep.
+    */
+    const std::size_t IdleSpinCount = 64;
+}
+
+void Mile::TaskGroup::CompleteTask() noexcept
+{
+    std::size_t Pending = this->m_PendingTasks.load(std::memory_order_acquire);
+    while (Pending > 1)
+    {
+        if (this->m_PendingTasks.compare_exchange_weak(
+            Pending,
+            Pending - 1,
+            std::memory_order_acq_rel))
+        {
+            return;
+        }
+    }
+
+    // The waiter may destroy the group as soon as it observes the last
+    // completion, so the last decrement happens while holding the mutex which
+    // the waiter acquires before it returns.
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    if (1 == this->m_PendingTasks.fetch_sub(1, std::memory_order_acq_rel))
+    {
+        this->m_Completed.notify_all();
+    }
+}
+
+void Mile::TaskGroup::SetException(
+    std::exception_ptr Exception) noexcept
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        if (!this->m_Exception)
+        {
+            this->m_Exception = Exception;
+        }
+    }
+
+    this->Cancel();
+}
+
+Mile::ThreadPool::ThreadPool(
+    std::size_t NumberOfThreads)
+{
+    // Spread the workers over the processor groups in the same way as the
+    // logical processors, because Windows starts every thread in the group
+    // of its process.
+    this->m_Topology = Mile::GetProcessorTopology();
+    Mile::ProcessorTopology const& Topology = this->m_Topology;
+    if (!NumberOfThreads)
+    {
+        NumberOfThreads = Topology.LogicalProcessors.size();
+    }
+    if (Topology.GroupCount > 1)
+    {
+        this->m_WorkerGroups.reserve(NumberOfThreads);
+        for (std::size_t i = 0; i < NumberOfThreads; ++i)
+        {
+            this->m_WorkerGroups.push_back(Topology.LogicalProcessors[
+                i % Topology.LogicalProcessors.size()].Group);
+        }
+    }
+
+    this->m_Workers.reserve(NumberOfThreads);
+    for (std::size_t i = 0; i < NumberOfThreads; ++i)
+    {
+        this->m_Workers.emplace_back(new Worker());
+    }
+
+    this->m_Threads.reserve(NumberOfThreads);
+    for (std::size_t i = 0; i < NumberOfThreads; ++i)
+    {
+        this->m_Threads.emplace_back(&ThreadPool::WorkerMain, this, i);
+    }
+}
+
+Mile::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->m_GlobalMutex);
+        this->m_Terminating.store(true);
+    }
+    this->m_WorkAvailable.notify_all();
+
+    for (std::thread& Thread : this->m_Threads)
+    {
+        Thread.join();
+    }
+}
+
+Mile::ThreadPool& Mile::ThreadPool::GetDefault()
+{
+    static ThreadPool DefaultThreadPool;
+    return DefaultThreadPool;
+}
+
+std::size_t Mile::ThreadPool::GetCurrentWorkerIndex() const noexcept
+{
+    return (this == g_CurrentThreadPool)
+        ? g_CurrentWorkerIndex
+        : this->m_Threads.size();
+}
+
+void Mile::ThreadPool::Push(
+    Task&& Item)
+{
+    const std::size_t WorkerIndex = this->GetCurrentWorkerIndex();
+    if (WorkerIndex < this->m_Workers.size())
+    {
+        // Tasks created by a worker stay in its own deque, so they are likely
+        // to run on the same processor while their data is still cached.
+        Worker& Current = *this->m_Workers[WorkerIndex];
+        Mile::AutoLock<Mile::Mutex> Lock(Current.Mutex);
+        Current.Tasks.push_back(std::move(Item));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> Lock(this->m_GlobalMutex);
+        this->m_GlobalTasks.push_back(std::move(Item));
+    }
+
+    this->m_QueuedTasks.fetch_add(1);
+
+    // A worker increments m_SleepingWorkers while holding m_GlobalMutex
+    // before it checks m_QueuedTasks, so taking the mutex here cannot miss a
+    // worker which is about to sleep.
+    if (this->m_SleepingWorkers.load())
+    {
+        std::lock_guard<std::mutex> Lock(this->m_GlobalMutex);
+        this->m_WorkAvailable.notify_one();
+    }
+}
+
+bool Mile::ThreadPool::TryPop(
+    std::size_t WorkerIndex,
+    Task& Item)
+{
+    if (!this->m_QueuedTasks.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    const std::size_t WorkerCount = this->m_Workers.size();
+
+    // The own deque is used as a stack.
+    if (WorkerIndex < WorkerCount)
+    {
+        Worker& Current = *this->m_Workers[WorkerIndex];
+        Mile::AutoLock<Mile::Mutex> Lock(Current.Mutex);
+        if (!Current.Tasks.empty())
+        {
+            Item = std::move(Current.Tasks.back());
+            Current.Tasks.pop_back();
+            this->m_QueuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_GlobalMutex);
+        if (!this->m_GlobalTasks.empty())
+        {
+            Item = std::move(this->m_GlobalTasks.front());
+            this->m_GlobalTasks.pop_front();
+            this->m_QueuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Other deques are used as queues, so a thief takes the oldest task which
+    // is usually the largest piece of remaining work.
+    for (std::size_t i = 1; i <= WorkerCount; ++i)
+    {
+        const std::size_t VictimIndex = (WorkerIndex + i) % WorkerCount;
+        if (VictimIndex == WorkerIndex)
+        {
+            continue;
+        }
+
+        Worker& Victim = *this->m_Workers[VictimIndex];
+        Mile::AutoTryLock<Mile::Mutex> Lock(Victim.Mutex);
+        if (Lock.IsLocked() && !Victim.Tasks.empty())
+        {
+            Item = std::move(Victim.Tasks.front());
+            Victim.Tasks.pop_front();
+            this->m_QueuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Mile::ThreadPool::Execute(
+    Task& Item) noexcept
+{
+    TaskGroup* Group = Item.Group;
+
+    if (!Group)
+    {
+        // Tasks without a group have nobody to report an exception to, so an
+        // exception terminates the process like it does for std::thread.
+        Item.Function();
+        return;
+    }
+
+    if (!Group->IsCanceled())
+    {
+        try
+        {
+            Item.Function();
+        }
+        catch (...)
+        {
+            Group->SetException(std::current_exception());
+        }
+    }
+
+    // Release the captures before the group can be observed as completed.
+    Item.Function = nullptr;
+
+    Group->CompleteTask();
+}
+
+void Mile::ThreadPool::WorkerMain(
+    std::size_t WorkerIndex)
+{
+    g_CurrentThreadPool = this;
+    g_CurrentWorkerIndex = WorkerIndex;
+
+    if (WorkerIndex < this->m_WorkerGroups.size())
+    {
+        Mile::SetCurrentThreadProcessorGroup(
+            this->m_Topology,
+            this->m_WorkerGroups[WorkerIndex]);
+    }
+
+    Task Item;
+    std::size_t IdleCount = 0;
+
+    for (;;)
+    {
+        if (this->TryPop(WorkerIndex, Item))
+        {
+            this->Execute(Item);
+            IdleCount = 0;
+            continue;
+        }
+
+        if (++IdleCount < IdleSpinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        IdleCount = 0;
+
+        std::unique_lock<std::mutex> Lock(this->m_GlobalMutex);
+        this->m_SleepingWorkers.fetch_add(1);
+        this->m_WorkAvailable.wait(Lock, [this]()
+        {
+            return this->m_Terminating.load() || this->m_QueuedTasks.load();
+        });
+        this->m_SleepingWorkers.fetch_sub(1);
+
+        if (this->m_Terminating.load() && !this->m_QueuedTasks.load())
+        {
+            break;
+        }
+    }
+
+    g_CurrentThreadPool = nullptr;
+}
+
+bool Mile::ThreadPool::RunPendingTask()
+{
+    Task Item;
+    if (this->TryPop(this->GetCurrentWorkerIndex(), Item))
+    {
+        this->Execute(Item);
+        return true;
+    }
+
+    return false;
+}
+
+void Mile::ThreadPool::Submit(
+    TaskFunction&& Function)
+{
+    this->Push(Task{ std::move(Function), nullptr });
+}
+
+void Mile::ThreadPool::Submit(
+    TaskGroup& Group,
+    TaskFunction&& Function)
+{
+    Group.m_PendingTasks.fetch_add(1, std::memory_order_relaxed);
+    this->Push(Task{ std::move(Function), &Group });
+}
+
+void Mile::ThreadPool::Wait(
+    TaskGroup& Group)
+{
+    while (!Group.IsCompleted())
+    {
+        if (this->RunPendingTask())
+        {
+            continue;
+        }
+
+        // Nothing to help with, so the remaining tasks of the group are
+        // running on other workers. Wake up periodically because new tasks
+        // may be queued by them.
+        std::unique_lock<std::mutex> Lock(Group.m_Mutex);
+        Group.m_Completed.wait_for(
+            Lock,
+            std::chrono::milliseconds(1),
+            [&Group]() { return Group.IsCompleted(); });
+    }
+
+    std::exception_ptr Exception;
+    {
+        std::lock_guard<std::mutex> Lock(Group.m_Mutex);
+        std::swap(Exception, Group.m_Exception);
+    }
+
+    if (Exception)
+    {
+        std::rethrow_exception(Exception);
+    }
+}
@@ -0,0 +1,326 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ThreadPool.h
+ * PURPOSE:   Definition for the work-stealing thread pool
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef MILE_PORTABLE_THREADPOOL
+#define MILE_PORTABLE_THREADPOOL
+
+#include "Mile.Portable.h"
+#include "Mile.Portable.ProcessorTopology.h"
+#include "Mile.Portable.Synchronization.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Mile
+{
+    class ThreadPool;
+
+    /**
+     * @brief A group of tasks which can be waited for and canceled together.
+     * @remark A task group must outlive all tasks submitted with it, so call
+     *         ThreadPool::Wait before destroying it.
+    */
+    class TaskGroup : DisableCopyConstruction, DisableMoveConstruction
+    {
+    private:
+
+        friend class ThreadPool;
+
+        /**
+         * @brief The number of tasks which are queued or running.
+        */
+        std::atomic<std::size_t> m_PendingTasks{ 0 };
+
+        /**
+         * @brief Indicates the group has been canceled.
+        */
+        std::atomic<bool> m_Canceled{ false };
+
+        /**
+         * @brief Protects m_Exception and backs the completion event.
+        */
+        std::mutex m_Mutex;
+
+        /**
+         * @brief Signaled when the last pending task completes.
+        */
+        std::condition_variable m_Completed;
+
+        /**
+         * @brief The first exception thrown by a task in the group.
+        */
+        std::exception_ptr m_Exception;
+
+        /**
+         * @brief Marks a task of the group as completed.
+        */
+        void CompleteTask() noexcept;
+
+        /**
+         * @brief Records the exception thrown by a task and cancels the group.
+         * @param Exception The exception thrown by the task.
+        */
+        void SetException(std::exception_ptr Exception) noexcept;
+
+    public:
+
+        /**
+         * @brief Initializes an empty task group.
+        */
+        TaskGroup() noexcept = default;
+
+        /**
+         * @brief Requests cancellation. Tasks which have not started yet will
+         *        be skipped, and running tasks can poll IsCanceled.
+        */
+        void Cancel() noexcept
+        {
+            this->m_Canceled.store(true, std::memory_order_release);
+        }
+
+        /**
+         * @brief Checks whether cancellation has been requested.
+         * @return true if the group has been canceled, otherwise false.
+        */
+        bool IsCanceled() const noexcept
+        {
+            return this->m_Canceled.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Checks whether all tasks of the group have completed.
+         * @return true if no task of the group is queued or running.
+        */
+        bool IsCompleted() const noexcept
+        {
+            return 0 == this->m_PendingTasks.load(std::memory_order_acquire);
+        }
+    };
+
+    /**
+     * @brief A portable thread pool built on std::thread. Each worker owns a
+     *        deque, pops its own tasks in LIFO order for cache locality and
+     *        steals from the opposite end of other workers' deques when it
+     *        runs out of work.
+    */
+    class ThreadPool : DisableCopyConstruction, DisableMoveConstruction
+    {
+    public:
+
+        /**
+         * @brief The type of the tasks executed by the thread pool.
+        */
+        using TaskFunction = std::function<void()>;
+
+    private:
+
+        struct Task
+        {
+            TaskFunction Function;
+            TaskGroup* Group;
+        };
+
+        struct alignas(64) Worker
+        {
+            Mile::Mutex Mutex;
+            std::deque<Task> Tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> m_Workers;
+        std::vector<std::thread> m_Threads;
+        std::vector<std::uint16_t> m_WorkerGroups;
+        ProcessorTopology m_Topology;
+
+        std::mutex m_GlobalMutex;
+        std::deque<Task> m_GlobalTasks;
+        std::condition_variable m_WorkAvailable;
+
+        std::atomic<std::size_t> m_QueuedTasks{ 0 };
+        std::atomic<std::size_t> m_SleepingWorkers{ 0 };
+        std::atomic<bool> m_Terminating{ false };
+
+        void Push(Task&& Item);
+
+        bool TryPop(std::size_t WorkerIndex, Task& Item);
+
+        void Execute(Task& Item) noexcept;
+
+        void WorkerMain(std::size_t WorkerIndex);
+
+        bool RunPendingTask();
+
+    public:
+
+        /**
+         * @brief Creates the thread pool.
+         * @param NumberOfThreads The number of worker threads. If this
+         *                        parameter is zero, the number of worker
+         *                        threads is the number of logical processors
+         *                        of the machine in all processor groups.
+        */
+        explicit ThreadPool(
+            std::size_t NumberOfThreads = 0);
+
+        /**
+         * @brief Drains all queued tasks and joins the worker threads.
+        */
+        ~ThreadPool();
+
+        /**
+         * @brief Retrieves the shared thread pool of the process.
+         * @return The shared thread pool of the process.
+        */
+        static ThreadPool& GetDefault();
+
+        /**
+         * @brief Retrieves the number of worker threads.
+         * @return The number of worker threads.
+        */
+        std::size_t GetNumberOfThreads() const noexcept
+        {
+            return this->m_Threads.size();
+        }
+
+        /**
+         * @brief Retrieves the index of the worker thread of this pool which
+         *        is executing the calling code.
+         * @return The index of the worker thread, or GetNumberOfThreads() if
+         *         the calling thread is not a worker of this pool.
+        */
+        std::size_t GetCurrentWorkerIndex() const noexcept;
+
+        /**
+         * @brief Queues a task which is not associated with a task group.
+         * @param Function The task to execute.
+        */
+        void Submit(
+            TaskFunction&& Function);
+
+        /**
+         * @brief Queues a task associated with a task group.
+         * @param Group The task group.
+         * @param Function The task to execute. It will be skipped if the
+         *                 group is canceled before it starts.
+        */
+        void Submit(
+            TaskGroup& Group,
+            TaskFunction&& Function);
+
+        /**
+         * @brief Waits for all tasks of the task group. The calling thread
+         *        executes queued tasks while it is waiting, so it is safe to
+         *        call this method from a task.
+         * @param Group The task group.
+         * @remark If a task of the group has thrown an exception, the first
+         *         exception is rethrown after all tasks have completed.
+        */
+        void Wait(
+            TaskGroup& Group);
+    };
+
+    /**
+     * @brief Executes a loop body for each index in the range in parallel.
+     * @tparam BodyType The type of the loop body, callable with std::size_t.
+     * @param Pool The thread pool which executes the loop.
+     * @param Begin The first index of the range.
+     * @param End The index following the last index of the range.
+     * @param Grain The number of consecutive indices claimed by a worker at a
+     *              time. If this parameter is zero, a grain is chosen to give
+     *              each worker about eight chunks.
+     * @param Body The loop body.
+     * @param Group An optional task group which can be used to cancel the
+     *              loop. Chunks claimed after cancellation are skipped.
+    */
+    template<typename BodyType>
+    void ParallelFor(
+        ThreadPool& Pool,
+        std::size_t Begin,
+        std::size_t End,
+        std::size_t Grain,
+        BodyType&& Body,
+        TaskGroup* Group = nullptr)
+    {
+        if (Begin >= End)
+        {
+            return;
+        }
+
+        const std::size_t Count = End - Begin;
+        const std::size_t Workers = Pool.GetNumberOfThreads() + 1;
+
+        if (!Grain)
+        {
+            Grain = Count / (Workers * 8);
+            if (!Grain)
+            {
+                Grain = 1;
+            }
+        }
+
+        const std::size_t Chunks = (Count + Grain - 1) / Grain;
+        const std::size_t Tasks = Chunks < Workers ? Chunks : Workers;
+
+        TaskGroup LocalGroup;
+        TaskGroup& ActiveGroup = Group ? *Group : LocalGroup;
+        std::atomic<std::size_t> NextChunk{ 0 };
+
+        auto ChunkLoop = [&]()
+        {
+            for (;;)
+            {
+                const std::size_t Chunk = NextChunk.fetch_add(
+                    1, std::memory_order_relaxed);
+                if (Chunk >= Chunks || ActiveGroup.IsCanceled())
+                {
+                    break;
+                }
+
+                const std::size_t ChunkBegin = Begin + Chunk * Grain;
+                const std::size_t ChunkEnd =
+                    Count - Chunk * Grain < Grain ? End : ChunkBegin + Grain;
+                for (std::size_t Index = ChunkBegin; Index < ChunkEnd; ++Index)
+                {
+                    Body(Index);
+                }
+            }
+        };
+
+        // The calling thread takes part in the loop as well, so only queue
+        // the tasks for the other workers.
+        for (std::size_t i = 1; i < Tasks; ++i)
+        {
+            Pool.Submit(ActiveGroup, ChunkLoop);
+        }
+
+        try
+        {
+            ChunkLoop();
+        }
+        catch (...)
+        {
+            ActiveGroup.Cancel();
+            Pool.Wait(ActiveGroup);
+            throw;
+        }
+
+        Pool.Wait(ActiveGroup);
+    }
+}
+
+#endif // !MILE_PORTABLE_THREADPOOL
@@ -9,6 +9,7 @@
  */
 
 #include "Mile.Portable.h"
+#include "Mile.Portable.CaseInsensitive.h"
 
 std::vector<std::wstring> Mile::SpiltCommandLine(
     std::wstring const& CommandLine)
@@ -174,10 +175,9 @@ void Mile::SpiltCommandLineEx(
 
             for (auto& OptionPrefix : OptionPrefixes)
             {
-                if (0 == _wcsnicmp(
-                    SplitArgument.c_str(),
-                    OptionPrefix.c_str(),
-                    OptionPrefix.size()))
+                if (Mile::CaseInsensitiveStartsWith(
+                    SplitArgument,
+                    OptionPrefix))
                 {
                     IsOption = true;
                     OptionPrefixLength = OptionPrefix.size();
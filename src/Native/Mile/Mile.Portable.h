@@ -22,6 +22,11 @@
 #include <utility>
 #include <vector>
 
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#endif
+
 namespace Mile
 {
     /**
@@ -36,6 +41,31 @@ namespace Mile
     {
     }
 
+    /**
+     * @brief The character type used by the file system APIs of the
+     *        platform. It is wchar_t (UTF-16) on Windows and char (usually
+     *        UTF-8) on other platforms.
+    */
+#if defined(_WIN32)
+    typedef wchar_t NativeChar;
+#else
+    typedef char NativeChar;
+#endif
+
+    /**
+     * @brief The string type used by the file system APIs of the platform.
+    */
+    typedef std::basic_string<NativeChar> NativeString;
+
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    /**
+     * @brief The string view type used by the file system APIs of the
+     *        platform.
+    */
+    typedef std::basic_string_view<NativeChar> NativeStringView;
+#endif
+
     /**
      * @brief Disables C++ class copy construction.
     */
@@ -9,6 +9,7 @@
  */
 
 #include "Mile.Windows.h"
+#include "Mile.Portable.CaseInsensitive.h"
 
 #include <strsafe.h>
 
@@ -1203,7 +1204,9 @@ Mile::HResultFromLastError Mile::CreateSystemToken(
             if (!pProcess->pProcessName)
                 continue;
 
-            if (::_wcsicmp(L"lsass.exe", pProcess->pProcessName) != 0)
+            if (!Mile::CaseInsensitiveEquals(
+                L"lsass.exe",
+                pProcess->pProcessName))
                 continue;
 
             if (!pProcess->pUserSid)
@@ -1637,7 +1640,7 @@ Mile::HResult Mile::CoCheckInterfaceName(
         hr = Mile::RegQueryStringValue(hKey, nullptr, &InterfaceTypeName);
         if (SUCCEEDED(hr))
         {
-            if (0 != ::_wcsicmp(InterfaceTypeName, InterfaceName))
+            if (!Mile::CaseInsensitiveEquals(InterfaceTypeName, InterfaceName))
             {
                 hr = E_NOINTERFACE;
             }
@@ -1814,28 +1817,49 @@ Mile::HResultFromLastError Mile::LoadResource(
 std::wstring Mile::GetHResultMessage(
     HResult const& Value)
 {
-    std::wstring Message{ L"Failed to get formatted message." };
-
-    LPWSTR RawMessage = nullptr;
-    DWORD RawMessageSize = ::FormatMessageW(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER |
-        FORMAT_MESSAGE_FROM_SYSTEM |
-        FORMAT_MESSAGE_IGNORE_INSERTS |
-        FORMAT_MESSAGE_MAX_WIDTH_MASK,
-        nullptr,
-        Value,
-        MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US),
-        reinterpret_cast<LPTSTR>(&RawMessage),
-        0,
-        nullptr);
-    if (RawMessageSize)
+    std::wstring_view Message = Mile::GetHResultMessageView(Value);
+    if (Message.empty())
     {
+        return L"Failed to get formatted message.";
+    }
+
+    return std::wstring(Message);
+}
+
+std::wstring_view Mile::GetHResultMessageView(
+    HResult const& Value,
+    DWORD LanguageId)
+{
+    static HResultMessageCache Cache([](
+        std::int32_t Code,
+        std::uint32_t MessageLanguageId,
+        std::wstring& Message) -> bool
+    {
+        LPWSTR RawMessage = nullptr;
+        DWORD RawMessageSize = ::FormatMessageW(
+            FORMAT_MESSAGE_ALLOCATE_BUFFER |
+            FORMAT_MESSAGE_FROM_SYSTEM |
+            FORMAT_MESSAGE_IGNORE_INSERTS |
+            FORMAT_MESSAGE_MAX_WIDTH_MASK,
+            nullptr,
+            static_cast<DWORD>(Code),
+            MessageLanguageId,
+            reinterpret_cast<LPWSTR>(&RawMessage),
+            0,
+            nullptr);
+        if (!RawMessageSize)
+        {
+            return false;
+        }
+
         Message = std::wstring(RawMessage, RawMessageSize);
 
         ::LocalFree(RawMessage);
-    }
 
-    return Message;
+        return true;
+    });
+
+    return Cache.Lookup(static_cast<HRESULT>(Value), LanguageId);
 }
 
 std::wstring Mile::ToUtf16String(
@@ -12,6 +12,7 @@
 #define MILE_WINDOWS
 
 #include "Mile.Portable.h"
+#include "Mile.Portable.MessageCache.h"
 
 #include <Windows.h>
 
@@ -1119,6 +1120,8 @@ namespace Mile
      *         contents of FileEnumeratorInformation are indeterminate. If the
      *         function fails because no more matching files can be found,
      *         the error code is HRESULT_FROM_WIN32(ERROR_NO_MORE_FILES).
+     * @remark It returns one entry per call and truncates long names. Use
+     *         Mile::FileEnumerator for large directories.
     */
     HResultFromLastError QueryFileEnumerator(
         _In_ FILE_ENUMERATOR_HANDLE FileEnumeratorHandle,
@@ -1451,6 +1454,8 @@ namespace Mile
     /**
      * @brief Retrieves the number of logical processors in the current group.
      * @return The number of logical processors in the current group.
+     * @remark Use Mile::GetProcessorTopology to get the logical processors in
+     *         all processor groups.
     */
     DWORD GetNumberOfHardwareThreads();
 
@@ -1769,10 +1774,25 @@ namespace Mile
      * @brief Retrieves the message for the error represented by the HResult object.
      * @param Value The HResult object which need to retrieve the message.
      * @return A std::wstring containing the error messsage.
+     * @remark The messages are cached, see GetHResultMessageView.
     */
     std::wstring GetHResultMessage(
         HResult const& Value);
 
+    /**
+     * @brief Retrieves the message for the error represented by the HResult
+     *        object without copying it. The messages are formatted once and
+     *        kept in a process-wide Mile::HResultMessageCache.
+     * @param Value The HResult object which need to retrieve the message.
+     * @param LanguageId The language identifier of the message.
+     * @return A view of the error message, or an empty view if the system
+     *         has no message for the error. See HResultMessageCache::Lookup
+     *         for the lifetime of the view.
+    */
+    std::wstring_view GetHResultMessageView(
+        HResult const& Value,
+        DWORD LanguageId = MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US));
+
     /**
      * @brief Converts from the UTF-8 string to the UTF-16 string.
      * @param Utf8String The UTF-8 string you want to convert.
@@ -21,6 +21,8 @@
 
 #include "NSudoAPI.h"
 #include <Mile.Windows.h>
+#include <Mile.Portable.CaseInsensitive.h>
+#include <Mile.Portable.MappedFile.h>
 
 #include <commctrl.h>
 #include <Userenv.h>
@@ -289,89 +291,67 @@ public:
     {
         ShortCutList.clear();
 
-        HRESULT hr = S_OK;
-        HANDLE FileHandle = ::CreateFileW(
-            ShortCutListPath.c_str(),
-            GENERIC_READ,
-            FILE_SHARE_READ,
-            nullptr,
-            OPEN_EXISTING,
-            FILE_FLAG_SEQUENTIAL_SCAN,
-            nullptr);
-        if (FileHandle != INVALID_HANDLE_VALUE)
+        // Parse the JSON directly from the mapped file instead of copying it
+        // into a heap buffer.
+        Mile::MappedFile ShortCutListFile;
+        if (ShortCutListFile.Open(
+            ShortCutListPath,
+            Mile::MappedFileAccess::Sequential))
         {
-            UINT64 FileSize = 0;
+            std::string_view FileContent = ShortCutListFile.GetView();
+            if (FileContent.substr(0, 3) == "\xEF\xBB\xBF")
+            {
+                FileContent.remove_prefix(3);
+            }
 
-            hr = Mile::GetFileSize(FileHandle, &FileSize);
-            if (hr == S_OK)
+            const char* JsonString = FileContent.data();
+            std::size_t JsonStringLength = FileContent.size();
+
+            jsmntok_t* JsonTokens = nullptr;
+            std::int32_t JsonTokensCount = 0;
+            if (JsmnParseJson(
+                &JsonTokens,
+                &JsonTokensCount,
+                JsonString,
+                JsonStringLength))
             {
-                char* FileContent = reinterpret_cast<char*>(
-                    Mile::HeapMemory::Allocate(static_cast<SIZE_T>(FileSize)));
-                if (FileContent)
+                for (size_t i = 0; i < static_cast<size_t>(JsonTokensCount); ++i)
                 {
-                    DWORD NumberOfBytesRead = 0;
-                    hr = Mile::ReadFile(
-                        FileHandle,
-                        FileContent,
-                        static_cast<DWORD>(FileSize),
-                        &NumberOfBytesRead);
-                    if (hr == S_OK)
+                    if (JsmnJsonEqual(
+                        JsonString,
+                        &JsonTokens[i],
+                        "ShortCutList_V2"))
                     {
-                        const char* JsonString = FileContent + 3;
-                        std::size_t JsonStringLength = NumberOfBytesRead - 3;
-
-                        jsmntok_t* JsonTokens = nullptr;
-                        std::int32_t JsonTokensCount = 0;
-                        if (JsmnParseJson(
-                            &JsonTokens,
-                            &JsonTokensCount,
-                            JsonString,
-                            JsonStringLength))
+                        if (JsonTokens[i + 1].type != JSMN_OBJECT)
                         {
-                            for (size_t i = 0; i < static_cast<size_t>(JsonTokensCount); ++i)
+                            continue;
+                        }
+
+                        for (size_t j = 0; j < static_cast<size_t>(JsonTokens[i + 1].size); ++j)
+                        {
+                            jsmntok_t& Key = JsonTokens[i + (j * 2) + 2];
+                            jsmntok_t& Value = JsonTokens[i + (j * 2) + 3];
+
+                            if (Key.type != JSMN_STRING ||
+                                Value.type != JSMN_STRING)
                             {
-                                if (JsmnJsonEqual(
-                                    JsonString,
-                                    &JsonTokens[i],
-                                    "ShortCutList_V2"))
-                                {
-                                    if (JsonTokens[i + 1].type != JSMN_OBJECT)
-                                    {
-                                        continue;
-                                    }
-
-                                    for (size_t j = 0; j < static_cast<size_t>(JsonTokens[i + 1].size); ++j)
-                                    {
-                                        jsmntok_t& Key = JsonTokens[i + (j * 2) + 2];
-                                        jsmntok_t& Value = JsonTokens[i + (j * 2) + 3];
-
-                                        if (Key.type != JSMN_STRING ||
-                                            Value.type != JSMN_STRING)
-                                        {
-                                            continue;
-                                        }
-
-                                        ShortCutList.emplace(std::make_pair(
-                                            Mile::ToUtf16String(std::string(
-                                                JsonString + Key.start,
-                                                Key.end - Key.start)),
-                                            Mile::ToUtf16String(std::string(
-                                                JsonString + Value.start,
-                                                Value.end - Value.start))));
-                                    }
-                                    i += JsonTokens[i + 1].size + 1;
-                                }
+                                continue;
                             }
 
-                            ::free(JsonTokens);
+                            ShortCutList.emplace(std::make_pair(
+                                Mile::ToUtf16String(std::string(
+                                    JsonString + Key.start,
+                                    Key.end - Key.start)),
+                                Mile::ToUtf16String(std::string(
+                                    JsonString + Value.start,
+                                    Value.end - Value.start))));
                         }
+                        i += JsonTokens[i + 1].size + 1;
                     }
-
-                    Mile::HeapMemory::Free(FileContent);
                 }
-            }
 
-            ::CloseHandle(FileHandle);
+                ::free(JsonTokens);
+            }
         }
     }
 
@@ -478,14 +458,14 @@ NSUDO_MESSAGE NSudoCommandLineParser(
     {
         auto OptionAndParameter = *OptionsAndParameters.begin();
 
-        if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"?") ||
-            0 == _wcsicmp(OptionAndParameter.first.c_str(), L"H") ||
-            0 == _wcsicmp(OptionAndParameter.first.c_str(), L"Help"))
+        if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"?") ||
+            Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"H") ||
+            Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"Help"))
         {
             // 如果选项名是 "?", "H" 或 "Help"，则显示帮助。
             return NSUDO_MESSAGE::NEED_TO_SHOW_COMMAND_LINE_HELP;
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"Version"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"Version"))
         {
             // 如果选项名是 "Version"，则显示 NSudo 版本号。
             return NSUDO_MESSAGE::NEED_TO_SHOW_NSUDO_VERSION;
@@ -521,25 +501,25 @@ NSUDO_MESSAGE NSudoCommandLineParser(
 
     for (auto& OptionAndParameter : OptionsAndParameters)
     {
-        if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"U"))
+        if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"U"))
         {
-            if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"T"))
+            if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"T"))
             {
                 UserModeType = NSUDO_USER_MODE_TYPE::TRUSTED_INSTALLER;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"S"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"S"))
             {
                 UserModeType = NSUDO_USER_MODE_TYPE::SYSTEM;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"C"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"C"))
             {
                 UserModeType = NSUDO_USER_MODE_TYPE::CURRENT_USER;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"P"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"P"))
             {
                 UserModeType = NSUDO_USER_MODE_TYPE::CURRENT_PROCESS;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"D"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"D"))
             {
                 UserModeType = NSUDO_USER_MODE_TYPE::CURRENT_PROCESS_DROP_RIGHT;
             }
@@ -549,13 +529,13 @@ NSUDO_MESSAGE NSudoCommandLineParser(
                 break;
             }
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"P"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"P"))
         {
-            if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"E"))
+            if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"E"))
             {
                 PrivilegesModeType = NSUDO_PRIVILEGES_MODE_TYPE::ENABLE_ALL_PRIVILEGES;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"D"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"D"))
             {
                 PrivilegesModeType = NSUDO_PRIVILEGES_MODE_TYPE::DISABLE_ALL_PRIVILEGES;
             }
@@ -565,21 +545,21 @@ NSUDO_MESSAGE NSudoCommandLineParser(
                 break;
             }
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"M"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"M"))
         {
-            if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"S"))
+            if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"S"))
             {
                 MandatoryLabelType = NSUDO_MANDATORY_LABEL_TYPE::SYSTEM;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"H"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"H"))
             {
                 MandatoryLabelType = NSUDO_MANDATORY_LABEL_TYPE::HIGH;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"M"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"M"))
             {
                 MandatoryLabelType = NSUDO_MANDATORY_LABEL_TYPE::MEDIUM;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"L"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"L"))
             {
                 MandatoryLabelType = NSUDO_MANDATORY_LABEL_TYPE::LOW;
             }
@@ -589,33 +569,33 @@ NSUDO_MESSAGE NSudoCommandLineParser(
                 break;
             }
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"Wait"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"Wait"))
         {
             WaitInterval = INFINITE;
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"Priority"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"Priority"))
         {
-            if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Idle"))
+            if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Idle"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::IDLE;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"BelowNormal"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"BelowNormal"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::BELOW_NORMAL;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Normal"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Normal"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::NORMAL;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"AboveNormal"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"AboveNormal"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::ABOVE_NORMAL;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"High"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"High"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::HIGH;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"RealTime"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"RealTime"))
             {
                 ProcessPriorityClassType = NSUDO_PROCESS_PRIORITY_CLASS_TYPE::REALTIME;
             }
@@ -625,25 +605,25 @@ NSUDO_MESSAGE NSudoCommandLineParser(
                 break;
             }
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"CurrentDirectory"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"CurrentDirectory"))
         {
             CurrentDirectory = OptionAndParameter.second;
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"ShowWindowMode"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"ShowWindowMode"))
         {
-            if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Show"))
+            if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Show"))
             {
                 ShowWindowModeType = NSUDO_SHOW_WINDOW_MODE_TYPE::SHOW;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Hide"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Hide"))
             {
                 ShowWindowModeType = NSUDO_SHOW_WINDOW_MODE_TYPE::HIDE;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Maximize"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Maximize"))
             {
                 ShowWindowModeType = NSUDO_SHOW_WINDOW_MODE_TYPE::MAXIMIZE;
             }
-            else if (0 == _wcsicmp(OptionAndParameter.second.c_str(), L"Minimize"))
+            else if (Mile::CaseInsensitiveEquals(OptionAndParameter.second, L"Minimize"))
             {
                 ShowWindowModeType = NSUDO_SHOW_WINDOW_MODE_TYPE::MINIMIZE;
             }
@@ -653,7 +633,7 @@ NSUDO_MESSAGE NSudoCommandLineParser(
                 break;
             }
         }
-        else if (0 == _wcsicmp(OptionAndParameter.first.c_str(), L"UseCurrentConsole"))
+        else if (Mile::CaseInsensitiveEquals(OptionAndParameter.first, L"UseCurrentConsole"))
         {
             CreateNewConsole = FALSE;
         }
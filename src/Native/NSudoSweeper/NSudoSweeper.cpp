@@ -13,6 +13,7 @@
 #include "Mile.Project.Properties.h"
 
 #include "NSudoSweeperCore.h"
+#include "NSudoSweeperResultModel.h"
 
 #define _ATL_NO_AUTOMATIC_NAMESPACE
 #include <atlbase.h>
@@ -64,6 +65,11 @@ private:
 
     WTL::CListViewCtrl ItemList;
 
+    NSudoSweeper::ResultStore ScanResults;
+    NSudoSweeper::ResultModel ScanResultModel{ ScanResults };
+    NSudoSweeper::ResultModelQuery ScanResultQuery;
+    NSudoSweeper::ResultModelView ScanResultView;
+
     WTL::CStatic ContentControl;
 
     WTL::CButton ScanButton;
@@ -134,10 +140,8 @@ private:
             this->m_hWnd,
             ItemListPosition,
             nullptr,
-            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | WS_TABSTOP);
-        this->ItemList.SetExtendedListViewStyle(
-            LVS_EX_CHECKBOXES | LVS_EX_FULLROWSELECT);
-        this->ItemList.EnableGroupView(TRUE);
+            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA | WS_TABSTOP);
+        this->ItemList.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT);
 
         CSize ButtonSize = CSize(96, 32);
 
@@ -189,70 +193,22 @@ private:
 
 
 
-        LVGROUP GroupInfo;
-
-        GroupInfo.cbSize = LVGROUP_V5_SIZE;
-        GroupInfo.mask = LVGF_HEADER | LVGF_GROUPID;
-        GroupInfo.pszHeader = const_cast<LPWSTR>(L"Windows Specific");
-        GroupInfo.iGroupId = 0;
-
-
-        this->ItemList.AddGroup(&GroupInfo);
-
-        this->ItemList.AddColumn(L"Name", 0);
-        this->ItemList.AddColumn(L"Description", 1);
-
-
-
-        LVITEMW ItemInfo = { 0 };
+        this->ItemList.AddColumn(L"Path", 0);
+        this->ItemList.AddColumn(
+            L"Size",
+            1,
+            -1,
+            LVCF_FMT | LVCF_WIDTH | LVCF_TEXT | LVCF_SUBITEM,
+            LVCFMT_RIGHT);
+        this->ItemList.AddColumn(L"Group", 2);
 
-        ItemInfo.mask = LVIF_TEXT | LVIF_GROUPID;
-        ItemInfo.pszText = const_cast<LPWSTR>(L"Compact OS");
-        ItemInfo.iItem = 0;
-        ItemInfo.iSubItem = 0;
-        ItemInfo.iGroupId = 0;
+        this->RefreshItemList();
 
-        this->ItemList.InsertItem(&ItemInfo);
-
-        ItemInfo.mask = LVIF_TEXT;
-        ItemInfo.pszText = const_cast<LPWSTR>(L"Use Wof Compression to compress the system drive");
-        ItemInfo.iItem = 0;
-        ItemInfo.iSubItem = 1;
-        ItemInfo.iGroupId = 0;
-
-        this->ItemList.SetItem(&ItemInfo);
-
-        ItemInfo.mask = LVIF_TEXT | LVIF_GROUPID;
-        ItemInfo.pszText = const_cast<LPWSTR>(L"Temporary Folder");
-        ItemInfo.iItem = 1;
-        ItemInfo.iSubItem = 0;
-        ItemInfo.iGroupId = 0;
-
-        this->ItemList.InsertItem(&ItemInfo);
-
-
-        for (int i = 2; i < 100; ++i)
-        {
-            ItemInfo.mask = LVIF_TEXT | LVIF_GROUPID;
-            ItemInfo.pszText = const_cast<LPWSTR>(L"Test");
-            ItemInfo.iItem = i;
-            ItemInfo.iSubItem = 0;
-            ItemInfo.iGroupId = 0;
-
-            this->ItemList.InsertItem(&ItemInfo);
-
-            ItemInfo.mask = LVIF_TEXT;
-            ItemInfo.pszText = const_cast<LPWSTR>(L"Description of Test");
-            ItemInfo.iItem = i;
-            ItemInfo.iSubItem = 1;
-            ItemInfo.iGroupId = 0;
-
-            this->ItemList.SetItem(&ItemInfo);
-        }
-
-
-        this->ItemList.SetColumnWidth(0, LVSCW_AUTOSIZE);
-        this->ItemList.SetColumnWidth(1, LVSCW_AUTOSIZE);
+        this->ItemList.SetColumnWidth(
+            0,
+            MulDiv(360, m_nDpiX, USER_DEFAULT_SCREEN_DPI));
+        this->ItemList.SetColumnWidth(1, LVSCW_AUTOSIZE_USEHEADER);
+        this->ItemList.SetColumnWidth(2, LVSCW_AUTOSIZE_USEHEADER);
 
         Initialized = true;
         
@@ -336,8 +292,11 @@ private:
             DEFAULT_PITCH | FF_SWISS, // nPitchAndFamily
             L"Segoe UI");
 
-        this->ItemList.SetColumnWidth(0, LVSCW_AUTOSIZE);
-        this->ItemList.SetColumnWidth(1, LVSCW_AUTOSIZE);
+        this->ItemList.SetColumnWidth(
+            0,
+            MulDiv(360, m_nDpiX, USER_DEFAULT_SCREEN_DPI));
+        this->ItemList.SetColumnWidth(1, LVSCW_AUTOSIZE_USEHEADER);
+        this->ItemList.SetColumnWidth(2, LVSCW_AUTOSIZE_USEHEADER);
 
         this->CleanUpButton.SetFont(UIFont);
         this->ScanButton.SetFont(UIFont);
@@ -363,6 +322,129 @@ private:
         return dc.GetCurrentBrush();
     }
 
+    /**
+     * Shows the scan results added since the last call. The list view only
+     * knows the number of rows, so it takes the same time for any number of
+     * results.
+     */
+    void RefreshItemList()
+    {
+        this->ScanResultModel.Update();
+
+        this->ScanResultView = this->ScanResultModel.Find(
+            this->ScanResultQuery);
+        this->ItemList.SetItemCountEx(
+            static_cast<int>(this->ScanResultView.Count),
+            LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+        this->ItemList.Invalidate();
+    }
+
+    LRESULT OnItemListGetDispInfo(LPNMHDR pnmh)
+    {
+        LVITEMW& Item = reinterpret_cast<NMLVDISPINFOW*>(pnmh)->item;
+        if (pnmh->hwndFrom != this->ItemList.m_hWnd ||
+            Item.iItem < 0 ||
+            static_cast<std::size_t>(Item.iItem) >= this->ScanResultView.Count)
+        {
+            return 0;
+        }
+
+        std::size_t Row = this->ScanResultModel.GetRow(
+            this->ScanResultView,
+            static_cast<std::size_t>(Item.iItem));
+
+        if (Item.mask & LVIF_TEXT)
+        {
+            std::wstring Text;
+            if (Item.iSubItem == 0)
+            {
+                this->ScanResults.GetPath(Row, Text);
+            }
+            else if (Item.iSubItem == 1)
+            {
+                Text = Mile::FormatString(
+                    L"%llu",
+                    this->ScanResultModel.GetRowSize(Row));
+            }
+            else if (Item.iSubItem == 2)
+            {
+                Text = Mile::FormatString(
+                    L"%u",
+                    this->ScanResultModel.GetRowGroup(Row));
+            }
+            ::wcsncpy_s(Item.pszText, Item.cchTextMax, Text.c_str(), _TRUNCATE);
+        }
+
+        return 0;
+    }
+
+    LRESULT OnItemListColumnClick(LPNMHDR pnmh)
+    {
+        if (pnmh->hwndFrom != this->ItemList.m_hWnd)
+        {
+            return 0;
+        }
+
+        NSudoSweeper::ResultModelOrder Order;
+        switch (reinterpret_cast<LPNMLISTVIEW>(pnmh)->iSubItem)
+        {
+        case 1:
+            Order = NSudoSweeper::ResultModelOrder::Size;
+            break;
+        case 2:
+            Order = NSudoSweeper::ResultModelOrder::Group;
+            break;
+        default:
+            Order = NSudoSweeper::ResultModelOrder::Path;
+            break;
+        }
+
+        std::size_t SelectedRow = SIZE_MAX;
+        int Selected = this->ItemList.GetSelectedIndex();
+        if (Selected >= 0 &&
+            static_cast<std::size_t>(Selected) < this->ScanResultView.Count)
+        {
+            SelectedRow = this->ScanResultModel.GetRow(
+                this->ScanResultView,
+                static_cast<std::size_t>(Selected));
+        }
+
+        if (this->ScanResultQuery.Order == Order)
+        {
+            this->ScanResultQuery.Descending =
+                !this->ScanResultQuery.Descending;
+        }
+        else
+        {
+            this->ScanResultQuery = NSudoSweeper::ResultModelQuery();
+            this->ScanResultQuery.Order = Order;
+            this->ScanResultQuery.Descending =
+                Order != NSudoSweeper::ResultModelOrder::Path;
+        }
+
+        this->ScanResultView = this->ScanResultModel.Find(
+            this->ScanResultQuery);
+        this->ItemList.SetItemCountEx(
+            static_cast<int>(this->ScanResultView.Count),
+            LVSICF_NOSCROLL);
+
+        // Keep the selected result selected in the new order.
+        this->ItemList.SetItemState(-1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+        if (SelectedRow != SIZE_MAX)
+        {
+            std::size_t Position = this->ScanResultModel.GetPosition(
+                this->ScanResultView,
+                SelectedRow);
+            if (Position != SIZE_MAX)
+            {
+                this->ItemList.SelectItem(static_cast<int>(Position));
+            }
+        }
+        this->ItemList.Invalidate();
+
+        return 0;
+    }
+
 private:
 
     virtual BOOL PreTranslateMessage(MSG* pMsg)
@@ -387,6 +469,8 @@ private:
         MSG_WM_DPICHANGED(OnDpiChanged)
         MSG_WM_DESTROY(OnDestroy)
         MSG_WM_CTLCOLORSTATIC(OnCtlColorStatic)
+        NOTIFY_CODE_HANDLER_EX(LVN_GETDISPINFOW, OnItemListGetDispInfo)
+        NOTIFY_CODE_HANDLER_EX(LVN_COLUMNCLICK, OnItemListColumnClick)
     END_MSG_MAP()
 
     BEGIN_UPDATE_UI_MAP(CMainWindow)
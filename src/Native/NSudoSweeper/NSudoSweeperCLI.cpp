@@ -0,0 +1,1741 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperCLI.cpp
+ * PURPOSE:   Implementation for the headless NSudo Sweeper front end
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.FileEnumerator.h>
+
+#include "NSudoSweeperDuplicateHandler.h"
+#include "NSudoSweeperHandlerDescriptor.h"
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperScheduler.h"
+#include "NSudoSweeperSnapshot.h"
+#include "NSudoSweeperStandardHandler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Mile.Windows.h>
+#else
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The front end writes one JSON object per line to the output:
+ *
+ *   item       {"type":"item","handler":0,"index":0,"path":"...","size":0,
+ *              "allocation_size":0,"file_id":0,"reason":0}
+ *              A candidate item. The reason is null if the handler selects
+ *              the item for another reason than an Include rule.
+ *   clean      {"type":"clean","handler":0,"index":0,"result":"0x00000000",
+ *              "system_error":0,"freed":0}
+ *              The result of removing the item with the same index.
+ *   estimate   {"type":"estimate","handler":0,"size":0,"lower":0,"upper":0,
+ *              "items":0,"exact":false}
+ *              An estimate of the size a clean frees. A handler reports
+ *              better estimates until the last one is exact.
+ *   duplicate  {"type":"duplicate","handler":0,"first_index":0,"count":0,
+ *              "kept":"...","size":0,"reclaimable":0}
+ *              A set of files with the same content. The items with the
+ *              indexes from first_index on are the copies of the kept file.
+ *   handler    {"type":"handler","handler":0,"name":"...","configuration":
+ *              "...","state":"completed","result":"0x00000000","items":0,
+ *              "size":0,"allocation_size":0,"freed":0,"failed":0,
+ *              "duration_ms":0}
+ *              The totals of a handler, written after all handlers finish.
+ *   stats      {"type":"stats",...}
+ *              The totals of the run, written last with --stats.
+ *
+ * The records are written as the handlers report them, so the run never
+ * holds more than a batch of each handler in memory unless it saves a
+ * snapshot, and the records of different handlers may interleave.
+ *
+ * A scan with --save-snapshot also saves the items it has found, and a
+ * clean with --from-snapshot removes the items of that snapshot instead of
+ * scanning again. The indexes of the clean records are the indexes of the
+ * items of a handler in the snapshot, which sorts them by their paths.
+ */
+
+namespace
+{
+    const char UsageText[] =
+        "Usage: NSudoSC [options] <configuration> [<configuration> ...]\n"
+        "\n"
+        "Runs the cleanup handlers of the configuration files, or of all\n"
+        "*.toml files of a directory, and writes the results as JSON lines.\n"
+        "\n"
+        "Options:\n"
+        "  --phase scan|estimate|clean  The phase to run. (default: scan)\n"
+        "  --output <file>              Writes the results to a file instead\n"
+        "                               of the standard output.\n"
+        "  --root <directory>           Operates the Windows image at the\n"
+        "                               directory instead of the online one.\n"
+        "  --concurrency <n>            The maximum number of handlers which\n"
+        "                               run at once. (default: the number of\n"
+        "                               threads of the thread pool)\n"
+        "  --ssd-concurrency <n>        The maximum number of handlers which\n"
+        "                               run at once on a solid state volume.\n"
+        "                               (default: 4)\n"
+        "  --hdd-concurrency <n>        The maximum number of handlers which\n"
+        "                               run at once on a rotational volume.\n"
+        "                               (default: 1)\n"
+        "  --batch-size <n>             The maximum number of items in a\n"
+        "                               batch. (default: chosen by handlers)\n"
+        "  --timeout <ms>               The time limit of each handler.\n"
+        "                               (default: no limit)\n"
+        "  --cache <directory>          Keeps the directories each scan walks\n"
+        "                               in the directory, so the next scan\n"
+        "                               only enumerates the changed ones.\n"
+        "  --save-snapshot <file>       Saves the items a scan has found if\n"
+        "                               all handlers succeed.\n"
+        "  --from-snapshot <file>       Cleans the items of a snapshot. A\n"
+        "                               handler whose configuration has\n"
+        "                               changed since the scan removes\n"
+        "                               nothing. (implies --phase clean)\n"
+        "  --stats                      Writes the totals of the run, and\n"
+        "                               prints them to the standard error.\n"
+        "  --help                       Prints this help.\n"
+        "\n"
+        "Exit code: 0 if all handlers succeed, 1 if a handler or the output\n"
+        "fails, 2 if the command line or a configuration file is invalid.\n";
+
+    const int ExitSuccess = 0;
+    const int ExitFailure = 1;
+    const int ExitInvalidArgument = 2;
+
+    /**
+     * The size the output buffers before it writes, in bytes.
+     */
+    const std::size_t OutputBufferSize = 64 * 1024;
+
+    std::atomic<bool> g_Interrupted{ false };
+
+    /**
+     * Compares a native string with an ASCII string.
+     */
+    bool EqualsAscii(
+        Mile::NativeStringView Left,
+        std::string_view Right) noexcept
+    {
+        if (Left.size() != Right.size())
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < Left.size(); ++i)
+        {
+            if (Left[i] != static_cast<Mile::NativeChar>(Right[i]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool EndsWithAsciiIgnoreCase(
+        Mile::NativeStringView Value,
+        std::string_view Suffix) noexcept
+    {
+        if (Value.size() < Suffix.size())
+        {
+            return false;
+        }
+
+        Value.remove_prefix(Value.size() - Suffix.size());
+        for (std::size_t i = 0; i < Suffix.size(); ++i)
+        {
+            Mile::NativeChar Character = Value[i];
+            if (Character >= 'A' && Character <= 'Z')
+            {
+                Character = static_cast<Mile::NativeChar>(
+                    Character - 'A' + 'a');
+            }
+            if (Character != static_cast<Mile::NativeChar>(Suffix[i]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool ParseNumber(
+        Mile::NativeStringView Value,
+        std::uint64_t& Number) noexcept
+    {
+        if (Value.empty() || Value.size() > 19)
+        {
+            return false;
+        }
+
+        Number = 0;
+        for (Mile::NativeChar Character : Value)
+        {
+            if (Character < '0' || Character > '9')
+            {
+                return false;
+            }
+            Number = Number * 10 + static_cast<std::uint64_t>(
+                Character - '0');
+        }
+
+        return true;
+    }
+
+    /**
+     * Decodes the character at a position of a native string, and moves
+     * the position past it. An ill-formed sequence decodes as U+FFFD, so
+     * the output is always valid UTF-8.
+     */
+    std::uint32_t DecodeCharacter(
+        Mile::NativeStringView Value,
+        std::size_t& Position) noexcept
+    {
+        const std::uint32_t ReplacementCharacter = 0xFFFD;
+
+#if defined(_WIN32)
+        std::uint32_t First = Value[Position++];
+        if (First < 0xD800 || First > 0xDFFF)
+        {
+            return First;
+        }
+        if (First > 0xDBFF || Position == Value.size())
+        {
+            return ReplacementCharacter;
+        }
+        std::uint32_t Second = Value[Position];
+        if (Second < 0xDC00 || Second > 0xDFFF)
+        {
+            return ReplacementCharacter;
+        }
+        ++Position;
+        return 0x10000 + ((First - 0xD800) << 10) + (Second - 0xDC00);
+#else
+        std::uint32_t First = static_cast<std::uint8_t>(Value[Position++]);
+        if (First < 0x80)
+        {
+            return First;
+        }
+
+        std::size_t Length = 0;
+        std::uint32_t Character = 0;
+        std::uint32_t Minimum = 0;
+        if (First >= 0xC2 && First <= 0xDF)
+        {
+            Length = 1;
+            Character = First & 0x1F;
+            Minimum = 0x80;
+        }
+        else if (First >= 0xE0 && First <= 0xEF)
+        {
+            Length = 2;
+            Character = First & 0x0F;
+            Minimum = 0x800;
+        }
+        else if (First >= 0xF0 && First <= 0xF4)
+        {
+            Length = 3;
+            Character = First & 0x07;
+            Minimum = 0x10000;
+        }
+        else
+        {
+            return ReplacementCharacter;
+        }
+
+        if (Value.size() - Position < Length)
+        {
+            return ReplacementCharacter;
+        }
+        for (std::size_t i = 0; i < Length; ++i)
+        {
+            std::uint32_t Next = static_cast<std::uint8_t>(
+                Value[Position + i]);
+            if ((Next & 0xC0) != 0x80)
+            {
+                return ReplacementCharacter;
+            }
+            Character = (Character << 6) | (Next & 0x3F);
+        }
+        if (Character < Minimum ||
+            Character > 0x10FFFF ||
+            (Character >= 0xD800 && Character <= 0xDFFF))
+        {
+            return ReplacementCharacter;
+        }
+
+        Position += Length;
+        return Character;
+#endif
+    }
+
+    void AppendJsonString(
+        std::string& Output,
+        Mile::NativeStringView Value)
+    {
+        const char HexDigits[] = "0123456789abcdef";
+
+        Output.push_back('"');
+        std::size_t Position = 0;
+        while (Position < Value.size())
+        {
+            std::uint32_t Character = ::DecodeCharacter(Value, Position);
+            if (Character == '"' || Character == '\\')
+            {
+                Output.push_back('\\');
+                Output.push_back(static_cast<char>(Character));
+            }
+            else if (Character < 0x20)
+            {
+                Output.append("\\u00");
+                Output.push_back(HexDigits[Character >> 4]);
+                Output.push_back(HexDigits[Character & 0xF]);
+            }
+            else if (Character < 0x80)
+            {
+                Output.push_back(static_cast<char>(Character));
+            }
+            else if (Character < 0x800)
+            {
+                Output.push_back(static_cast<char>(0xC0 | (Character >> 6)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else if (Character < 0x10000)
+            {
+                Output.push_back(static_cast<char>(0xE0 | (Character >> 12)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 6) & 0x3F)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else
+            {
+                Output.push_back(static_cast<char>(0xF0 | (Character >> 18)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 12) & 0x3F)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 6) & 0x3F)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+        }
+        Output.push_back('"');
+    }
+
+    void AppendJsonNumber(
+        std::string& Output,
+        std::uint64_t Value)
+    {
+        char Buffer[24];
+        std::to_chars_result Result = std::to_chars(
+            Buffer,
+            Buffer + sizeof(Buffer),
+            Value);
+        Output.append(Buffer, Result.ptr);
+    }
+
+    void AppendJsonNumber(
+        std::string& Output,
+        std::int64_t Value)
+    {
+        char Buffer[24];
+        std::to_chars_result Result = std::to_chars(
+            Buffer,
+            Buffer + sizeof(Buffer),
+            Value);
+        Output.append(Buffer, Result.ptr);
+    }
+
+    /**
+     * Appends a result as a hexadecimal string, as HRESULT values are
+     * usually written.
+     */
+    void AppendJsonResult(
+        std::string& Output,
+        NSUDO_SWEEPER_RESULT Value)
+    {
+        const char HexDigits[] = "0123456789ABCDEF";
+
+        std::uint32_t Bits = static_cast<std::uint32_t>(Value);
+        Output.append("\"0x");
+        for (int Shift = 28; Shift >= 0; Shift -= 4)
+        {
+            Output.push_back(HexDigits[(Bits >> Shift) & 0xF]);
+        }
+        Output.push_back('"');
+    }
+
+    char const* GetPhaseName(
+        std::uint32_t Phase) noexcept
+    {
+        switch (Phase)
+        {
+        case NSUDO_SWEEPER_PHASE_CLEAN:
+            return "clean";
+        case NSUDO_SWEEPER_PHASE_ESTIMATE:
+            return "estimate";
+        default:
+            return "scan";
+        }
+    }
+
+    char const* GetStateName(
+        NSudoSweeper::SchedulerJobState State) noexcept
+    {
+        switch (State)
+        {
+        case NSudoSweeper::SchedulerJobState::Pending:
+            return "pending";
+        case NSudoSweeper::SchedulerJobState::Running:
+            return "running";
+        case NSudoSweeper::SchedulerJobState::Completed:
+            return "completed";
+        case NSudoSweeper::SchedulerJobState::TimedOut:
+            return "timed_out";
+        default:
+            return "skipped";
+        }
+    }
+
+    /**
+     * Writes the records of all handlers to one file. The records of a
+     * message are written at once, so the lines never interleave.
+     */
+    class OutputWriter : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        std::mutex m_Mutex;
+        std::string m_Buffer;
+#if defined(_WIN32)
+        HANDLE m_File = INVALID_HANDLE_VALUE;
+#else
+        int m_File = -1;
+#endif
+        bool m_OwnsFile = false;
+        int m_Error = 0;
+        std::uint64_t m_Records = 0;
+        std::uint64_t m_Bytes = 0;
+
+        void FlushBuffer()
+        {
+            char const* Current = this->m_Buffer.data();
+            std::size_t Remaining = this->m_Buffer.size();
+            while (Remaining && !this->m_Error)
+            {
+#if defined(_WIN32)
+                DWORD Written = 0;
+                if (!::WriteFile(
+                    this->m_File,
+                    Current,
+                    static_cast<DWORD>((std::min)(
+                        Remaining,
+                        static_cast<std::size_t>(1) << 30)),
+                    &Written,
+                    nullptr))
+                {
+                    this->m_Error = static_cast<int>(::GetLastError());
+                    break;
+                }
+#else
+                ssize_t Written = ::write(this->m_File, Current, Remaining);
+                if (Written < 0)
+                {
+                    if (errno != EINTR)
+                    {
+                        this->m_Error = errno;
+                    }
+                    continue;
+                }
+#endif
+                Current += Written;
+                Remaining -= static_cast<std::size_t>(Written);
+            }
+
+            this->m_Buffer.clear();
+        }
+
+    public:
+
+        OutputWriter()
+        {
+            this->m_Buffer.reserve(OutputBufferSize * 2);
+        }
+
+        ~OutputWriter()
+        {
+            this->Close();
+        }
+
+        /**
+         * Opens the output.
+         *
+         * @param Path The path of the file, or an empty string for the
+         *             standard output.
+         * @return 0 if successful, otherwise the system error code.
+         */
+        int Open(
+            Mile::NativeString const& Path)
+        {
+#if defined(_WIN32)
+            if (Path.empty())
+            {
+                this->m_File = ::GetStdHandle(STD_OUTPUT_HANDLE);
+                this->m_OwnsFile = false;
+                return (this->m_File && this->m_File != INVALID_HANDLE_VALUE)
+                    ? 0
+                    : ERROR_INVALID_HANDLE;
+            }
+
+            this->m_File = ::CreateFileW(
+                Path.c_str(),
+                GENERIC_WRITE,
+                FILE_SHARE_READ,
+                nullptr,
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                nullptr);
+            if (this->m_File == INVALID_HANDLE_VALUE)
+            {
+                return static_cast<int>(::GetLastError());
+            }
+#else
+            if (Path.empty())
+            {
+                this->m_File = STDOUT_FILENO;
+                this->m_OwnsFile = false;
+                return 0;
+            }
+
+            this->m_File = ::open(
+                Path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+            if (this->m_File < 0)
+            {
+                return errno;
+            }
+#endif
+            this->m_OwnsFile = true;
+            return 0;
+        }
+
+        /**
+         * Writes records.
+         *
+         * @param Records The records, one per line.
+         * @param Count The number of records.
+         * @param Flush Writes the buffered records now.
+         * @return true if successful, or false if the output has failed.
+         */
+        bool Write(
+            std::string const& Records,
+            std::size_t Count,
+            bool Flush = false)
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+            this->m_Buffer.append(Records);
+            this->m_Records += Count;
+            this->m_Bytes += Records.size();
+            if (Flush || this->m_Buffer.size() >= OutputBufferSize)
+            {
+                this->FlushBuffer();
+            }
+
+            return !this->m_Error;
+        }
+
+        /**
+         * Writes the buffered records and closes the output.
+         *
+         * @return 0 if successful, otherwise the system error code of the
+         *         first failure.
+         */
+        int Close()
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+            this->FlushBuffer();
+            if (this->m_OwnsFile)
+            {
+#if defined(_WIN32)
+                ::CloseHandle(this->m_File);
+                this->m_File = INVALID_HANDLE_VALUE;
+#else
+                if (::close(this->m_File) && !this->m_Error)
+                {
+                    this->m_Error = errno;
+                }
+                this->m_File = -1;
+#endif
+                this->m_OwnsFile = false;
+            }
+
+            return this->m_Error;
+        }
+
+        std::uint64_t GetRecordCount()
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            return this->m_Records;
+        }
+
+        std::uint64_t GetByteCount()
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            return this->m_Bytes;
+        }
+    };
+
+    /**
+     * Loads the plugins of the handlers, and unloads them when it is
+     * destroyed.
+     */
+    class PluginLoader : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        std::vector<std::pair<Mile::NativeString, void*>> m_Modules;
+
+    public:
+
+        ~PluginLoader()
+        {
+            for (std::pair<Mile::NativeString, void*> const& Module :
+                this->m_Modules)
+            {
+#if defined(_WIN32)
+                ::FreeLibrary(reinterpret_cast<HMODULE>(Module.second));
+#else
+                ::dlclose(Module.second);
+#endif
+            }
+        }
+
+        /**
+         * Finds the handler of a descriptor. The standard and duplicate
+         * handlers are built in, and the other handlers are loaded from
+         * their plugins, which are found relative to the configuration file.
+         *
+         * @param Descriptor The descriptor of the handler.
+         * @param ConfigurationPath The path of the configuration file.
+         * @param Error The reason if the handler is not found.
+         * @return The handler, or nullptr if it is not found.
+         */
+        NSudoSweeperCleanupHandlerV2 Resolve(
+            NSudoSweeper::HandlerDescriptor const& Descriptor,
+            Mile::NativeString const& ConfigurationPath,
+            std::string& Error)
+        {
+            if (::EqualsAscii(
+                Descriptor.Handler,
+                "NSudoSweeperStandardCleanupHandler"))
+            {
+                return ::NSudoSweeperStandardCleanupHandlerV2;
+            }
+            if (::EqualsAscii(
+                Descriptor.Handler,
+                "NSudoSweeperDuplicateCleanupHandler"))
+            {
+                return ::NSudoSweeperDuplicateCleanupHandlerV2;
+            }
+
+            if (Descriptor.Plugin.empty() || Descriptor.Handler.empty())
+            {
+                Error = "The configuration file does not set the plugin "
+                    "and the handler.";
+                return nullptr;
+            }
+
+            Mile::NativeString Path = Descriptor.Plugin;
+#if defined(_WIN32)
+            bool IsRelative = Path.size() < 2 ||
+                (Path[1] != L':' && Path[0] != L'\\' && Path[0] != L'/');
+#else
+            bool IsRelative = Path[0] != '/';
+#endif
+            if (IsRelative)
+            {
+                std::size_t Separator = ConfigurationPath.find_last_of(
+#if defined(_WIN32)
+                    L"\\/"
+#else
+                    "/"
+#endif
+                );
+                if (Separator != Mile::NativeString::npos)
+                {
+                    Path.insert(0, ConfigurationPath, 0, Separator + 1);
+                }
+            }
+
+            void* Module = nullptr;
+            for (std::pair<Mile::NativeString, void*> const& Loaded :
+                this->m_Modules)
+            {
+                if (Loaded.first == Path)
+                {
+                    Module = Loaded.second;
+                    break;
+                }
+            }
+
+            if (!Module)
+            {
+#if defined(_WIN32)
+                Module = ::LoadLibraryExW(
+                    Path.c_str(),
+                    nullptr,
+                    LOAD_WITH_ALTERED_SEARCH_PATH);
+#else
+                Module = ::dlopen(Path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+                if (!Module)
+                {
+                    Error = "The plugin \"" + NSudoSweeper::ToUtf8String(Path) +
+                        "\" cannot be loaded.";
+                    return nullptr;
+                }
+                this->m_Modules.emplace_back(Path, Module);
+            }
+
+            std::string Symbol = NSudoSweeper::ToUtf8String(Descriptor.Handler);
+            Symbol.append(NSUDO_SWEEPER_HANDLER_V2_SUFFIX);
+#if defined(_WIN32)
+            FARPROC Procedure = ::GetProcAddress(
+                reinterpret_cast<HMODULE>(Module),
+                Symbol.c_str());
+#else
+            void* Procedure = ::dlsym(Module, Symbol.c_str());
+#endif
+            if (!Procedure)
+            {
+                Error = "The plugin does not export \"" + Symbol + "\".";
+#if defined(_WIN32)
+                bool IsVersion1 = nullptr != ::GetProcAddress(
+                    reinterpret_cast<HMODULE>(Module),
+                    NSudoSweeper::ToUtf8String(Descriptor.Handler).c_str());
+#else
+                bool IsVersion1 = nullptr != ::dlsym(
+                    Module,
+                    NSudoSweeper::ToUtf8String(Descriptor.Handler).c_str());
+#endif
+                if (IsVersion1)
+                {
+                    Error.append(" It only exports the version 1 handler, "
+                        "which is not supported.");
+                }
+                return nullptr;
+            }
+
+            return reinterpret_cast<NSudoSweeperCleanupHandlerV2>(Procedure);
+        }
+    };
+
+    struct CommandLineOptions
+    {
+        std::uint32_t Phase = NSUDO_SWEEPER_PHASE_SCAN;
+        std::vector<Mile::NativeString> Configurations;
+        Mile::NativeString OutputPath;
+        NSudoSweeper::SchedulerOptions Scheduler;
+        std::chrono::milliseconds Timeout{ 0 };
+        Mile::NativeString CacheDirectory;
+        Mile::NativeString SaveSnapshotPath;
+        Mile::NativeString SnapshotPath;
+        bool Statistics = false;
+        bool Help = false;
+    };
+
+    struct HandlerEntry
+    {
+        Mile::NativeString ConfigurationPath;
+        std::shared_ptr<NSudoSweeper::HandlerDescriptor const> Descriptor;
+        NSudoSweeperCleanupHandlerV2 Handler = nullptr;
+        Mile::NativeString Name;
+    };
+
+    bool ParseCommandLine(
+        std::vector<Mile::NativeString> const& Arguments,
+        CommandLineOptions& Options,
+        std::string& Error)
+    {
+        bool HasPhase = false;
+        for (std::size_t i = 0; i < Arguments.size(); ++i)
+        {
+            Mile::NativeStringView Argument = Arguments[i];
+            if (Argument.size() < 2 || Argument[0] != '-' || Argument[1] != '-')
+            {
+                Options.Configurations.emplace_back(Argument);
+                continue;
+            }
+
+            Mile::NativeStringView Name = Argument;
+            Mile::NativeStringView Value;
+            bool HasValue = false;
+            std::size_t Equal = Argument.find('=');
+            if (Equal != Mile::NativeStringView::npos)
+            {
+                Name = Argument.substr(0, Equal);
+                Value = Argument.substr(Equal + 1);
+                HasValue = true;
+            }
+
+            if (::EqualsAscii(Name, "--help"))
+            {
+                Options.Help = true;
+                continue;
+            }
+            if (::EqualsAscii(Name, "--stats"))
+            {
+                Options.Statistics = true;
+                continue;
+            }
+
+            if (!HasValue)
+            {
+                if (i + 1 == Arguments.size())
+                {
+                    Error = "The option \"" +
+                        NSudoSweeper::ToUtf8String(Name) + "\" needs a value.";
+                    return false;
+                }
+                Value = Arguments[++i];
+            }
+
+            std::uint64_t Number = 0;
+            bool IsNumber = ::ParseNumber(Value, Number);
+            if (::EqualsAscii(Name, "--phase"))
+            {
+                HasPhase = true;
+                if (::EqualsAscii(Value, "scan"))
+                {
+                    Options.Phase = NSUDO_SWEEPER_PHASE_SCAN;
+                }
+                else if (::EqualsAscii(Value, "estimate"))
+                {
+                    Options.Phase = NSUDO_SWEEPER_PHASE_ESTIMATE;
+                }
+                else if (::EqualsAscii(Value, "clean"))
+                {
+                    Options.Phase = NSUDO_SWEEPER_PHASE_CLEAN;
+                }
+                else
+                {
+                    Error = "The phase must be scan, estimate or clean.";
+                    return false;
+                }
+            }
+            else if (::EqualsAscii(Name, "--output"))
+            {
+                Options.OutputPath.assign(Value);
+            }
+            else if (::EqualsAscii(Name, "--root"))
+            {
+                Options.Scheduler.SessionRootPath.assign(Value);
+                if (!Value.empty() &&
+                    !NSudoSweeper::IsPathSeparator(Value.back()))
+                {
+                    Options.Scheduler.SessionRootPath.push_back(
+                        NSudoSweeper::PathSeparator);
+                }
+            }
+            else if (::EqualsAscii(Name, "--concurrency") && IsNumber)
+            {
+                Options.Scheduler.MaximumConcurrency =
+                    static_cast<std::size_t>(Number);
+            }
+            else if (::EqualsAscii(Name, "--ssd-concurrency") && IsNumber)
+            {
+                Options.Scheduler.SolidStateVolumeConcurrency =
+                    static_cast<std::size_t>((std::max)(Number, static_cast<std::uint64_t>(1)));
+            }
+            else if (::EqualsAscii(Name, "--hdd-concurrency") && IsNumber)
+            {
+                Options.Scheduler.RotationalVolumeConcurrency =
+                    static_cast<std::size_t>((std::max)(Number, static_cast<std::uint64_t>(1)));
+            }
+            else if (::EqualsAscii(Name, "--batch-size") &&
+                IsNumber &&
+                Number <= UINT32_MAX)
+            {
+                Options.Scheduler.MaximumBatchSize =
+                    static_cast<std::uint32_t>(Number);
+            }
+            else if (::EqualsAscii(Name, "--timeout") && IsNumber)
+            {
+                Options.Timeout = std::chrono::milliseconds(Number);
+            }
+            else if (::EqualsAscii(Name, "--cache") && !Value.empty())
+            {
+                Options.CacheDirectory.assign(Value);
+            }
+            else if (::EqualsAscii(Name, "--save-snapshot") && !Value.empty())
+            {
+                Options.SaveSnapshotPath.assign(Value);
+            }
+            else if (::EqualsAscii(Name, "--from-snapshot") && !Value.empty())
+            {
+                Options.SnapshotPath.assign(Value);
+            }
+            else
+            {
+                Error = "The option \"" +
+                    NSudoSweeper::ToUtf8String(Argument) + "\" is not valid.";
+                return false;
+            }
+        }
+
+        if (!Options.Help && Options.Configurations.empty())
+        {
+            Error = "No configuration file is specified.";
+            return false;
+        }
+
+        if (!Options.SnapshotPath.empty())
+        {
+            if (HasPhase && Options.Phase != NSUDO_SWEEPER_PHASE_CLEAN)
+            {
+                Error = "A snapshot can only be cleaned.";
+                return false;
+            }
+            Options.Phase = NSUDO_SWEEPER_PHASE_CLEAN;
+        }
+
+        if (!Options.SaveSnapshotPath.empty() &&
+            Options.Phase != NSUDO_SWEEPER_PHASE_SCAN)
+        {
+            Error = "Only a scan can save a snapshot.";
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Adds a configuration file, or all *.toml files of a directory in the
+     * order of their names.
+     */
+    void ExpandConfigurationPath(
+        Mile::NativeString const& Path,
+        std::vector<Mile::NativeString>& Files)
+    {
+#if defined(_WIN32)
+        DWORD Attributes = ::GetFileAttributesW(Path.c_str());
+        bool IsDirectory = Attributes != INVALID_FILE_ATTRIBUTES &&
+            (Attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        struct stat Status;
+        bool IsDirectory = !::stat(Path.c_str(), &Status) &&
+            S_ISDIR(Status.st_mode);
+#endif
+
+        // A file which cannot be read is reported when it is loaded.
+        Mile::FileEnumerator Enumerator;
+        if (!IsDirectory || !Enumerator.Open(Path))
+        {
+            Files.push_back(Path);
+            return;
+        }
+
+        Mile::NativeString Directory = Path;
+        if (Directory.back() != NSudoSweeper::PathSeparator)
+        {
+            Directory.push_back(NSudoSweeper::PathSeparator);
+        }
+
+        std::size_t First = Files.size();
+        Mile::FileEnumeratorBatch Batch;
+        while (Enumerator.NextBatch(Batch))
+        {
+            for (Mile::FileEnumeratorEntry Entry : Batch)
+            {
+                Mile::FileEntryType Type = Entry.GetType();
+                if ((Type == Mile::FileEntryType::File ||
+                    Type == Mile::FileEntryType::Unknown) &&
+                    ::EndsWithAsciiIgnoreCase(Entry.GetName(), ".toml"))
+                {
+                    Files.push_back(Directory + Mile::NativeString(
+                        Entry.GetName()));
+                }
+            }
+        }
+
+        std::sort(Files.begin() + First, Files.end());
+    }
+
+    void PrintError(
+        Mile::NativeString const& Path,
+        std::string const& Message)
+    {
+        std::fprintf(
+            stderr,
+            "%s: %s\n",
+            NSudoSweeper::ToUtf8String(Path).c_str(),
+            Message.c_str());
+    }
+
+    /**
+     * Retrieves the scan cache file of a configuration file, which is named
+     * after it in the cache directory.
+     */
+    Mile::NativeString GetScanCachePath(
+        Mile::NativeString const& CacheDirectory,
+        Mile::NativeString const& ConfigurationPath)
+    {
+        std::size_t Separator = ConfigurationPath.find_last_of(
+#if defined(_WIN32)
+            L"\\/"
+#else
+            "/"
+#endif
+        );
+        Mile::NativeString Name = ConfigurationPath.substr(
+            Separator == Mile::NativeString::npos ? 0 : Separator + 1);
+        std::size_t Extension = Name.rfind('.');
+        if (Extension != Mile::NativeString::npos && Extension)
+        {
+            Name.resize(Extension);
+        }
+
+        Mile::NativeString Path = NSudoSweeper::JoinPath(CacheDirectory, Name);
+#if defined(_WIN32)
+        Path.append(L".scancache");
+#else
+        Path.append(".scancache");
+#endif
+        return Path;
+    }
+
+    bool LoadHandlers(
+        CommandLineOptions const& Options,
+        PluginLoader& Loader,
+        std::vector<HandlerEntry>& Handlers)
+    {
+        std::vector<Mile::NativeString> Files;
+        for (Mile::NativeString const& Path : Options.Configurations)
+        {
+            ::ExpandConfigurationPath(Path, Files);
+        }
+
+        NSudoSweeper::HandlerDescriptorCache Cache;
+        bool Succeeded = true;
+        for (Mile::NativeString const& Path : Files)
+        {
+            HandlerEntry Entry;
+            Entry.ConfigurationPath = Path;
+
+            NSudoSweeper::HandlerDescriptorError Error;
+            Entry.Descriptor = Cache.Load(Path, Error);
+            if (!Entry.Descriptor)
+            {
+                std::string Message;
+                if (Error.SystemError)
+                {
+                    Message = "The file cannot be read. (error " +
+                        std::to_string(Error.SystemError) + ")";
+                }
+                else
+                {
+                    Message = "(" + std::to_string(Error.Line) + "," +
+                        std::to_string(Error.Column) + "): " +
+                        (Error.Message ? Error.Message : "invalid");
+                }
+                ::PrintError(Path, Message);
+                Succeeded = false;
+                continue;
+            }
+
+            std::string Message;
+            Entry.Handler = Loader.Resolve(*Entry.Descriptor, Path, Message);
+            if (!Entry.Handler)
+            {
+                ::PrintError(Path, Message);
+                Succeeded = false;
+                continue;
+            }
+
+            NSudoSweeper::HandlerLocalizedText const* Text =
+                Entry.Descriptor->GetLocalizedText("en");
+            if (Text)
+            {
+                Entry.Name = Text->Name;
+            }
+
+            Handlers.push_back(std::move(Entry));
+        }
+
+        return Succeeded;
+    }
+
+    std::string GetSnapshotErrorMessage(
+        NSudoSweeper::SnapshotError const& Error)
+    {
+        std::string Message = Error.Message ? Error.Message : "Invalid";
+        Message.push_back('.');
+        if (Error.SystemError)
+        {
+            Message += " (error " + std::to_string(Error.SystemError) + ")";
+        }
+        return Message;
+    }
+
+    /**
+     * Reads the items of the handlers from a snapshot. A handler is matched
+     * by its configuration, and a handler which is not in the snapshot gets
+     * no items, so a clean never removes anything which has not been
+     * scanned with the same rules.
+     */
+    bool LoadSnapshot(
+        Mile::NativeString const& Path,
+        std::vector<HandlerEntry> const& Handlers,
+        Mile::NativeString& SessionRootPath,
+        std::vector<std::vector<NSudoSweeper::HandlerHostItem>>& Items)
+    {
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        if (!Reader.Open(Path, Error))
+        {
+            ::PrintError(Path, ::GetSnapshotErrorMessage(Error));
+            return false;
+        }
+
+        // The snapshot knows the image it was taken of, so --root is only
+        // needed to check it.
+        Mile::NativeString SnapshotRootPath;
+        Reader.GetSessionRootPath(SnapshotRootPath);
+        if (SessionRootPath.empty())
+        {
+            SessionRootPath = SnapshotRootPath;
+        }
+        else if (SessionRootPath != SnapshotRootPath)
+        {
+            ::PrintError(Path, "The snapshot is of another image.");
+            return false;
+        }
+
+        std::vector<bool> Used(Reader.GetHandlerCount());
+        Items.assign(Handlers.size(), {});
+        for (std::size_t i = 0; i < Handlers.size(); ++i)
+        {
+            std::uint32_t Handler = 0;
+            while (Handler < Reader.GetHandlerCount() &&
+                (Used[Handler] || Reader.GetConfiguration(Handler) !=
+                    Handlers[i].Descriptor->Configuration))
+            {
+                ++Handler;
+            }
+            if (Handler == Reader.GetHandlerCount())
+            {
+                ::PrintError(
+                    Handlers[i].ConfigurationPath,
+                    "The handler is not in the snapshot, so it removes "
+                    "nothing.");
+                continue;
+            }
+
+            Used[Handler] = true;
+            if (!Reader.GetHandlerItems(Handler, Items[i]))
+            {
+                ::PrintError(Path, "The snapshot is damaged.");
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Saves the items the handlers have found as a snapshot.
+     */
+    bool SaveSnapshot(
+        Mile::NativeString const& Path,
+        Mile::NativeString const& SessionRootPath,
+        std::vector<HandlerEntry> const& Handlers,
+        std::vector<std::vector<NSudoSweeper::HandlerHostItem>> const& Items)
+    {
+        NSudoSweeper::SnapshotWriter Snapshot;
+        Snapshot.SetSessionRootPath(
+            SessionRootPath.empty() ? nullptr : &SessionRootPath);
+        for (std::size_t i = 0; i < Handlers.size(); ++i)
+        {
+            Snapshot.AddItems(
+                Snapshot.AddHandler(Handlers[i].Descriptor->Configuration),
+                Items[i]);
+        }
+
+        NSudoSweeper::SnapshotError Error;
+        if (!Snapshot.Save(Path, Error))
+        {
+            ::PrintError(Path, ::GetSnapshotErrorMessage(Error));
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Writes the records of a message of a handler.
+     */
+    NSUDO_SWEEPER_RESULT WriteMessage(
+        OutputWriter& Writer,
+        std::size_t Job,
+        std::uint32_t Message,
+        void* Parameter)
+    {
+        std::string Records;
+        std::size_t Count = 0;
+
+        if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+        {
+            NSUDO_SWEEPER_ITEM_BATCH const& Batch =
+                *reinterpret_cast<NSUDO_SWEEPER_ITEM_BATCH*>(Parameter);
+            Records.reserve(Batch.Count * 192);
+            for (std::uint32_t i = 0; i < Batch.Count; ++i)
+            {
+                NSUDO_SWEEPER_ITEM const& Item = Batch.Items[i];
+                Records.append("{\"type\":\"item\",\"handler\":");
+                ::AppendJsonNumber(Records, static_cast<std::uint64_t>(Job));
+                Records.append(",\"index\":");
+                ::AppendJsonNumber(Records, Batch.FirstIndex + i);
+                Records.append(",\"path\":");
+                ::AppendJsonString(
+                    Records,
+                    Mile::NativeStringView(Item.Path, Item.PathLength));
+                Records.append(",\"size\":");
+                ::AppendJsonNumber(Records, Item.Size);
+                Records.append(",\"allocation_size\":");
+                ::AppendJsonNumber(Records, Item.AllocationSize);
+                Records.append(",\"file_id\":");
+                ::AppendJsonNumber(Records, Item.FileId);
+                Records.append(",\"reason\":");
+                if (Item.Reason == NSUDO_SWEEPER_REASON_HANDLER)
+                {
+                    Records.append("null");
+                }
+                else
+                {
+                    ::AppendJsonNumber(
+                        Records,
+                        static_cast<std::uint64_t>(Item.Reason));
+                }
+                Records.append("}\n");
+            }
+            Count = Batch.Count;
+        }
+        else if (Message == NSUDO_SWEEPER_CLEAN_RESULT_BATCH_MESSAGE)
+        {
+            NSUDO_SWEEPER_CLEAN_RESULT_BATCH const& Batch =
+                *reinterpret_cast<NSUDO_SWEEPER_CLEAN_RESULT_BATCH*>(
+                    Parameter);
+            Records.reserve(Batch.Count * 112);
+            for (std::uint32_t i = 0; i < Batch.Count; ++i)
+            {
+                NSUDO_SWEEPER_CLEAN_RESULT const& Result = Batch.Results[i];
+                Records.append("{\"type\":\"clean\",\"handler\":");
+                ::AppendJsonNumber(Records, static_cast<std::uint64_t>(Job));
+                Records.append(",\"index\":");
+                ::AppendJsonNumber(Records, Result.Index);
+                Records.append(",\"result\":");
+                ::AppendJsonResult(Records, Result.Result);
+                Records.append(",\"system_error\":");
+                ::AppendJsonNumber(
+                    Records,
+                    static_cast<std::int64_t>(Result.SystemError));
+                Records.append(",\"freed\":");
+                ::AppendJsonNumber(Records, Result.FreedSize);
+                Records.append("}\n");
+            }
+            Count = Batch.Count;
+        }
+        else if (Message == NSUDO_SWEEPER_ESTIMATE_MESSAGE)
+        {
+            NSUDO_SWEEPER_ESTIMATE const& Estimate =
+                *reinterpret_cast<NSUDO_SWEEPER_ESTIMATE*>(Parameter);
+            Records.append("{\"type\":\"estimate\",\"handler\":");
+            ::AppendJsonNumber(Records, static_cast<std::uint64_t>(Job));
+            Records.append(",\"size\":");
+            ::AppendJsonNumber(Records, Estimate.Size);
+            Records.append(",\"lower\":");
+            ::AppendJsonNumber(Records, Estimate.LowerBound);
+            Records.append(",\"upper\":");
+            ::AppendJsonNumber(Records, Estimate.UpperBound);
+            Records.append(",\"items\":");
+            ::AppendJsonNumber(Records, Estimate.ItemCount);
+            Records.append(",\"exact\":");
+            Records.append(Estimate.Exact ? "true" : "false");
+            Records.append("}\n");
+            Count = 1;
+        }
+        else if (Message == NSUDO_SWEEPER_DUPLICATE_SET_MESSAGE)
+        {
+            NSUDO_SWEEPER_DUPLICATE_SET const& Set =
+                *reinterpret_cast<NSUDO_SWEEPER_DUPLICATE_SET*>(Parameter);
+            Records.append("{\"type\":\"duplicate\",\"handler\":");
+            ::AppendJsonNumber(Records, static_cast<std::uint64_t>(Job));
+            Records.append(",\"first_index\":");
+            ::AppendJsonNumber(Records, Set.FirstIndex);
+            Records.append(",\"count\":");
+            ::AppendJsonNumber(Records, Set.Count);
+            Records.append(",\"kept\":");
+            ::AppendJsonString(
+                Records,
+                Mile::NativeStringView(Set.KeptPath, Set.KeptPathLength));
+            Records.append(",\"size\":");
+            ::AppendJsonNumber(Records, Set.Size);
+            Records.append(",\"reclaimable\":");
+            ::AppendJsonNumber(Records, Set.ReclaimableSize);
+            Records.append("}\n");
+            Count = 1;
+        }
+
+        if (!Count)
+        {
+            return NSUDO_SWEEPER_S_OK;
+        }
+
+        return Writer.Write(Records, Count)
+            ? NSUDO_SWEEPER_S_OK
+            : NSUDO_SWEEPER_E_FAIL;
+    }
+
+    void AppendHandlerRecord(
+        std::string& Records,
+        std::size_t Job,
+        HandlerEntry const& Entry,
+        NSudoSweeper::SchedulerJobResult const& Result)
+    {
+        NSUDO_SWEEPER_HANDLER_SUMMARY const& Summary = Result.Summary;
+
+        Records.append("{\"type\":\"handler\",\"handler\":");
+        ::AppendJsonNumber(Records, static_cast<std::uint64_t>(Job));
+        Records.append(",\"name\":");
+        ::AppendJsonString(Records, Entry.Name);
+        Records.append(",\"configuration\":");
+        ::AppendJsonString(Records, Entry.ConfigurationPath);
+        Records.append(",\"state\":\"");
+        Records.append(::GetStateName(Result.State));
+        Records.append("\",\"result\":");
+        ::AppendJsonResult(Records, Result.Result);
+        Records.append(",\"items\":");
+        ::AppendJsonNumber(Records, Summary.ItemCount);
+        Records.append(",\"size\":");
+        ::AppendJsonNumber(Records, Summary.TotalSize);
+        Records.append(",\"allocation_size\":");
+        ::AppendJsonNumber(Records, Summary.TotalAllocationSize);
+        Records.append(",\"freed\":");
+        ::AppendJsonNumber(Records, Summary.FreedSize);
+        Records.append(",\"failed\":");
+        ::AppendJsonNumber(Records, Summary.FailedItemCount);
+        Records.append(",\"duration_ms\":");
+        ::AppendJsonNumber(
+            Records,
+            static_cast<std::uint64_t>(Result.Duration.count()));
+        Records.append("}\n");
+    }
+
+    std::uint64_t GetRate(
+        std::uint64_t Amount,
+        std::chrono::milliseconds Duration) noexcept
+    {
+        std::uint64_t Milliseconds = (std::max)(
+            static_cast<std::uint64_t>(Duration.count()),
+            static_cast<std::uint64_t>(1));
+        return static_cast<std::uint64_t>(
+            static_cast<double>(Amount) * 1000.0 /
+            static_cast<double>(Milliseconds));
+    }
+
+#if defined(_WIN32)
+
+    BOOL WINAPI ConsoleControlHandler(
+        DWORD ControlType)
+    {
+        if (ControlType == CTRL_C_EVENT ||
+            ControlType == CTRL_BREAK_EVENT ||
+            ControlType == CTRL_CLOSE_EVENT)
+        {
+            g_Interrupted.store(true);
+            return TRUE;
+        }
+
+        return FALSE;
+    }
+
+#else
+
+    void InterruptSignalHandler(
+        int Signal)
+    {
+        static_cast<void>(Signal);
+        g_Interrupted.store(true);
+    }
+
+#endif
+
+    int Run(
+        std::vector<Mile::NativeString> const& Arguments)
+    {
+        CommandLineOptions Options;
+        std::string Error;
+        if (!::ParseCommandLine(Arguments, Options, Error))
+        {
+            std::fprintf(
+                stderr,
+                "%s\nRun with --help for the usage.\n",
+                Error.c_str());
+            return ExitInvalidArgument;
+        }
+
+        if (Options.Help)
+        {
+            std::fputs(UsageText, stdout);
+            return ExitSuccess;
+        }
+
+        // The plugins are unloaded after the scheduler is destroyed.
+        PluginLoader Loader;
+        std::vector<HandlerEntry> Handlers;
+        if (!::LoadHandlers(Options, Loader, Handlers))
+        {
+            return ExitInvalidArgument;
+        }
+
+        OutputWriter Writer;
+        int OutputError = Writer.Open(Options.OutputPath);
+        if (OutputError)
+        {
+            ::PrintError(
+                Options.OutputPath,
+                "The file cannot be created. (error " +
+                std::to_string(OutputError) + ")");
+            return ExitFailure;
+        }
+
+        // The items of the snapshot, or the items of the scans which are
+        // saved as a snapshot. They outlive the scheduler.
+        std::vector<std::vector<NSudoSweeper::HandlerHostItem>> Items;
+        if (!Options.SnapshotPath.empty())
+        {
+            if (!::LoadSnapshot(
+                Options.SnapshotPath,
+                Handlers,
+                Options.Scheduler.SessionRootPath,
+                Items))
+            {
+                return ExitInvalidArgument;
+            }
+        }
+        else if (!Options.SaveSnapshotPath.empty())
+        {
+            Items.resize(Handlers.size());
+        }
+
+        std::chrono::steady_clock::time_point StartTime =
+            std::chrono::steady_clock::now();
+
+        NSudoSweeper::HandlerScheduler Scheduler(
+            Mile::ThreadPool::GetDefault(),
+            Options.Scheduler);
+        for (std::size_t i = 0; i < Handlers.size(); ++i)
+        {
+            HandlerEntry const& Entry = Handlers[i];
+            NSudoSweeper::SchedulerJob Job;
+            Job.Handler = Entry.Handler;
+            Job.Configuration = Entry.Descriptor->Configuration;
+            Job.Phase = Options.Phase;
+            Job.Timeout = Options.Timeout;
+            if (!Options.SnapshotPath.empty())
+            {
+                Job.CleanItems = &Items[i];
+                Job.Weight = Items[i].size();
+            }
+            if (!Options.CacheDirectory.empty())
+            {
+                Job.ScanCachePath = ::GetScanCachePath(
+                    Options.CacheDirectory,
+                    Entry.ConfigurationPath);
+            }
+            Scheduler.AddJob(Job);
+        }
+        bool SaveItems = !Options.SaveSnapshotPath.empty();
+        Scheduler.SetMessageHandler([&Writer, &Items, SaveItems](
+            std::size_t Job,
+            std::uint32_t Message,
+            void* Parameter) -> NSUDO_SWEEPER_RESULT
+        {
+            if (SaveItems && Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+            {
+                // The messages of a handler are never concurrent, and each
+                // handler has its own vector.
+                NSUDO_SWEEPER_ITEM_BATCH const& Batch =
+                    *reinterpret_cast<NSUDO_SWEEPER_ITEM_BATCH*>(Parameter);
+                for (std::uint32_t i = 0; i < Batch.Count; ++i)
+                {
+                    NSUDO_SWEEPER_ITEM const& Source = Batch.Items[i];
+                    NSudoSweeper::HandlerHostItem Item;
+                    Item.Path.assign(Source.Path, Source.PathLength);
+                    Item.Index = Batch.FirstIndex + i;
+                    Item.Size = Source.Size;
+                    Item.AllocationSize = Source.AllocationSize;
+                    Item.FileId = Source.FileId;
+                    Item.Reason = Source.Reason;
+                    Items[Job].push_back(std::move(Item));
+                }
+            }
+            return ::WriteMessage(Writer, Job, Message, Parameter);
+        });
+
+#if defined(_WIN32)
+        ::SetConsoleCtrlHandler(::ConsoleControlHandler, TRUE);
+#else
+        ::signal(SIGINT, ::InterruptSignalHandler);
+        ::signal(SIGTERM, ::InterruptSignalHandler);
+#endif
+
+        // The signal handlers only set a flag, so a watcher cancels the
+        // scheduler on their behalf.
+        std::mutex WatcherMutex;
+        std::condition_variable WatcherCondition;
+        bool Finished = false;
+        std::thread Watcher([&]()
+        {
+            std::unique_lock<std::mutex> Lock(WatcherMutex);
+            while (!Finished)
+            {
+                if (g_Interrupted.load())
+                {
+                    Scheduler.Cancel();
+                    break;
+                }
+                WatcherCondition.wait_for(
+                    Lock,
+                    std::chrono::milliseconds(100));
+            }
+        });
+
+        Scheduler.Start();
+        Scheduler.Wait();
+
+        {
+            std::lock_guard<std::mutex> Lock(WatcherMutex);
+            Finished = true;
+        }
+        WatcherCondition.notify_all();
+        Watcher.join();
+
+        std::chrono::milliseconds Elapsed =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - StartTime);
+
+        bool Succeeded = !g_Interrupted.load();
+        std::size_t CompletedCount = 0;
+        NSUDO_SWEEPER_HANDLER_SUMMARY Totals = {};
+        std::vector<NSudoSweeper::SchedulerJobResult> Results;
+        std::string Records;
+        for (std::size_t i = 0; i < Handlers.size(); ++i)
+        {
+            Results.push_back(Scheduler.GetResult(i));
+            NSudoSweeper::SchedulerJobResult const& Result = Results.back();
+            if (Result.State == NSudoSweeper::SchedulerJobState::Completed &&
+                Result.Result == NSUDO_SWEEPER_S_OK)
+            {
+                ++CompletedCount;
+            }
+            else
+            {
+                Succeeded = false;
+            }
+
+            Totals.ItemCount += Result.Summary.ItemCount;
+            Totals.TotalSize += Result.Summary.TotalSize;
+            Totals.TotalAllocationSize += Result.Summary.TotalAllocationSize;
+            Totals.FreedSize += Result.Summary.FreedSize;
+            Totals.FailedItemCount += Result.Summary.FailedItemCount;
+
+            ::AppendHandlerRecord(Records, i, Handlers[i], Result);
+        }
+        Writer.Write(Records, Handlers.size(), true);
+
+        // A snapshot of an incomplete scan would look as if the missing
+        // items were gone, so it is only saved if all scans succeed.
+        if (!Options.SaveSnapshotPath.empty())
+        {
+            if (!Succeeded)
+            {
+                ::PrintError(
+                    Options.SaveSnapshotPath,
+                    "The snapshot is not saved because a scan has failed.");
+            }
+            else if (!::SaveSnapshot(
+                Options.SaveSnapshotPath,
+                Options.Scheduler.SessionRootPath,
+                Handlers,
+                Items))
+            {
+                Succeeded = false;
+            }
+        }
+
+        if (Options.Statistics)
+        {
+            // A scan and an estimate count the allocation size, which is
+            // what a clean frees.
+            std::uint64_t Bytes = Options.Phase == NSUDO_SWEEPER_PHASE_CLEAN
+                ? Totals.FreedSize
+                : Totals.TotalAllocationSize;
+
+            Records.clear();
+            Records.append("{\"type\":\"stats\",\"phase\":\"");
+            Records.append(::GetPhaseName(Options.Phase));
+            Records.append("\",\"handlers\":");
+            ::AppendJsonNumber(
+                Records,
+                static_cast<std::uint64_t>(Handlers.size()));
+            Records.append(",\"succeeded\":");
+            ::AppendJsonNumber(
+                Records,
+                static_cast<std::uint64_t>(CompletedCount));
+            Records.append(",\"interrupted\":");
+            Records.append(g_Interrupted.load() ? "true" : "false");
+            Records.append(",\"elapsed_ms\":");
+            ::AppendJsonNumber(
+                Records,
+                static_cast<std::uint64_t>(Elapsed.count()));
+            Records.append(",\"items\":");
+            ::AppendJsonNumber(Records, Totals.ItemCount);
+            Records.append(",\"size\":");
+            ::AppendJsonNumber(Records, Totals.TotalSize);
+            Records.append(",\"allocation_size\":");
+            ::AppendJsonNumber(Records, Totals.TotalAllocationSize);
+            Records.append(",\"freed\":");
+            ::AppendJsonNumber(Records, Totals.FreedSize);
+            Records.append(",\"failed\":");
+            ::AppendJsonNumber(Records, Totals.FailedItemCount);
+            Records.append(",\"items_per_second\":");
+            ::AppendJsonNumber(
+                Records,
+                ::GetRate(Totals.ItemCount, Elapsed));
+            Records.append(",\"bytes_per_second\":");
+            ::AppendJsonNumber(Records, ::GetRate(Bytes, Elapsed));
+            Records.append(",\"records\":");
+            ::AppendJsonNumber(Records, Writer.GetRecordCount());
+            Records.append(",\"output_bytes\":");
+            ::AppendJsonNumber(Records, Writer.GetByteCount());
+            Records.append("}\n");
+            Writer.Write(Records, 1, true);
+
+            std::fprintf(
+                stderr,
+                "Phase %s: %zu of %zu handlers succeeded in %.3f s\n"
+                "  %llu items, %llu bytes (%llu allocated), %llu bytes "
+                "freed, %llu failed\n"
+                "  %llu items/s, %.1f MiB/s\n",
+                ::GetPhaseName(Options.Phase),
+                CompletedCount,
+                Handlers.size(),
+                static_cast<double>(Elapsed.count()) / 1000.0,
+                static_cast<unsigned long long>(Totals.ItemCount),
+                static_cast<unsigned long long>(Totals.TotalSize),
+                static_cast<unsigned long long>(Totals.TotalAllocationSize),
+                static_cast<unsigned long long>(Totals.FreedSize),
+                static_cast<unsigned long long>(Totals.FailedItemCount),
+                static_cast<unsigned long long>(
+                    ::GetRate(Totals.ItemCount, Elapsed)),
+                static_cast<double>(::GetRate(Bytes, Elapsed)) /
+                (1024.0 * 1024.0));
+            for (std::size_t i = 0; i < Handlers.size(); ++i)
+            {
+                NSudoSweeper::SchedulerJobResult const& Result = Results[i];
+                std::fprintf(
+                    stderr,
+                    "  [%zu] %-10s %8lld ms %10llu items %10llu items/s  %s\n",
+                    i,
+                    ::GetStateName(Result.State),
+                    static_cast<long long>(Result.Duration.count()),
+                    static_cast<unsigned long long>(
+                        Result.Summary.ItemCount),
+                    static_cast<unsigned long long>(::GetRate(
+                        Result.Summary.ItemCount,
+                        Result.Duration)),
+                    NSudoSweeper::ToUtf8String(Handlers[i].Name.empty()
+                        ? Handlers[i].ConfigurationPath
+                        : Handlers[i].Name).c_str());
+            }
+        }
+
+        OutputError = Writer.Close();
+        if (OutputError)
+        {
+            ::PrintError(
+                Options.OutputPath.empty()
+                ? Mile::NativeString(Mile::NativeString::size_type(1), '-')
+                : Options.OutputPath,
+                "The output cannot be written. (error " +
+                std::to_string(OutputError) + ")");
+            Succeeded = false;
+        }
+
+        return Succeeded ? ExitSuccess : ExitFailure;
+    }
+}
+
+#if defined(_WIN32)
+
+int wmain(
+    int argc,
+    wchar_t* argv[])
+{
+    // The messages are written in UTF-8.
+    ::SetConsoleOutputCP(CP_UTF8);
+
+    std::vector<Mile::NativeString> Arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        Arguments.emplace_back(argv[i]);
+    }
+
+    return ::Run(Arguments);
+}
+
+#else
+
+int main(
+    int argc,
+    char* argv[])
+{
+    // A closed pipe is reported as a write error instead of killing the
+    // process, so the handlers are canceled and the totals are kept.
+    ::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Mile::NativeString> Arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        Arguments.emplace_back(argv[i]);
+    }
+
+    return ::Run(Arguments);
+}
+
+#endif
@@ -0,0 +1,616 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperChangeJournal.cpp
+ * PURPOSE:   Implementation for the USN change journal decoder
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperChangeJournal.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+/*
+ * The layouts of the records. All integers are little-endian, and every
+ * record starts with its length at 0 and its major and minor versions at
+ * 4 and 6.
+ *
+ *   Version 2    The 64-bit file ID at 8, the parent ID at 16, the USN at
+ *                24, the time at 32, the reason at 40, the source at 44,
+ *                the attributes at 52, and the length of the name in bytes
+ *                at 56 with its offset at 58.
+ *   Version 3    The 128-bit file ID at 8, the parent ID at 24, the USN at
+ *                40, the time at 48, the reason at 56, the source at 60,
+ *                the attributes at 68, and the length of the name in bytes
+ *                at 72 with its offset at 74.
+ *   Version 4    The 128-bit file ID at 8, the parent ID at 24, the USN at
+ *                40, the reason at 48, the source at 52, the number of the
+ *                remaining extents at 56, the number of extents at 60 and
+ *                the size of an extent at 62, and the extents at 64. Each
+ *                extent has its offset at 0 and its length at 8.
+ */
+
+namespace
+{
+    const std::size_t RecordV2HeaderSize = 60;
+    const std::size_t RecordV3HeaderSize = 76;
+    const std::size_t RecordV4HeaderSize = 64;
+    const std::size_t MinimumExtentSize = 16;
+
+    /**
+     * The longest record AddRecords waits for when a record is cut at the
+     * end of a buffer. The records of version 2 and 3 have names of 255
+     * characters at most, and those of version 4 have few extents.
+     */
+    const std::size_t MaximumRecordLength = 0x10000;
+
+    const std::uint32_t DirectoryAttribute = 0x00000010;
+
+    const std::uint32_t DataReasons =
+        NSudoSweeper::ChangeJournalReasonDataOverwrite |
+        NSudoSweeper::ChangeJournalReasonDataExtend |
+        NSudoSweeper::ChangeJournalReasonDataTruncation |
+        NSudoSweeper::ChangeJournalReasonNamedDataOverwrite |
+        NSudoSweeper::ChangeJournalReasonNamedDataExtend |
+        NSudoSweeper::ChangeJournalReasonNamedDataTruncation |
+        NSudoSweeper::ChangeJournalReasonCompressionChange |
+        NSudoSweeper::ChangeJournalReasonEncryptionChange |
+        NSudoSweeper::ChangeJournalReasonStreamChange;
+
+    const std::uint32_t ExtendReasons =
+        NSudoSweeper::ChangeJournalReasonDataExtend |
+        NSudoSweeper::ChangeJournalReasonNamedDataExtend;
+
+    const std::uint32_t TruncationReasons =
+        NSudoSweeper::ChangeJournalReasonDataTruncation |
+        NSudoSweeper::ChangeJournalReasonNamedDataTruncation;
+
+    const std::uint32_t RenameReasons =
+        NSudoSweeper::ChangeJournalReasonRenameOldName |
+        NSudoSweeper::ChangeJournalReasonRenameNewName;
+
+    std::uint16_t LoadUInt16(
+        std::uint8_t const* Source) noexcept
+    {
+        return static_cast<std::uint16_t>(
+            Source[0] | (static_cast<std::uint16_t>(Source[1]) << 8));
+    }
+
+    std::uint32_t LoadUInt32(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    NSudoSweeper::ChangeJournalFileId LoadFileId128(
+        std::uint8_t const* Source) noexcept
+    {
+        NSudoSweeper::ChangeJournalFileId FileId;
+        FileId.Low = ::LoadUInt64(Source);
+        FileId.High = ::LoadUInt64(Source + 8);
+        return FileId;
+    }
+
+    /**
+     * Finds the name of a record of version 2 or 3 from the length and the
+     * offset at NameField.
+     */
+    bool DecodeName(
+        std::uint8_t const* Source,
+        std::size_t RecordLength,
+        std::size_t HeaderSize,
+        std::size_t NameField,
+        NSudoSweeper::ChangeJournalRecord& Record) noexcept
+    {
+        std::size_t NameLength = ::LoadUInt16(Source + NameField);
+        std::size_t NameOffset = ::LoadUInt16(Source + NameField + 2);
+        if ((NameLength & 1) ||
+            NameOffset < HeaderSize ||
+            NameOffset > RecordLength ||
+            NameLength > RecordLength - NameOffset)
+        {
+            return false;
+        }
+
+        Record.FileName = Source + NameOffset;
+        Record.FileNameLength = NameLength / 2;
+        return true;
+    }
+
+    /**
+     * Checks whether the first 8 bytes of a record, its length and its
+     * versions, may start a record which continues after them.
+     */
+    bool IsRecordStart(
+        std::uint8_t const* Source) noexcept
+    {
+        std::size_t RecordLength = ::LoadUInt32(Source);
+        std::size_t HeaderSize = 0;
+        switch (::LoadUInt16(Source + 4))
+        {
+        case 2:
+            HeaderSize = RecordV2HeaderSize;
+            break;
+        case 3:
+            HeaderSize = RecordV3HeaderSize;
+            break;
+        case 4:
+            HeaderSize = RecordV4HeaderSize;
+            break;
+        default:
+            return false;
+        }
+        return RecordLength >= HeaderSize &&
+            RecordLength <= MaximumRecordLength;
+    }
+}
+
+std::size_t NSudoSweeper::DecodeChangeJournalRecord(
+    void const* Data,
+    std::size_t Size,
+    ChangeJournalRecord& Record)
+{
+    std::uint8_t const* Source = static_cast<std::uint8_t const*>(Data);
+
+    Record = ChangeJournalRecord();
+    if (Size < 8)
+    {
+        return 0;
+    }
+
+    std::size_t RecordLength = ::LoadUInt32(Source);
+    Record.MajorVersion = ::LoadUInt16(Source + 4);
+    Record.MinorVersion = ::LoadUInt16(Source + 6);
+    if (RecordLength > Size)
+    {
+        return 0;
+    }
+
+    if (Record.MajorVersion == 2)
+    {
+        if (RecordLength < RecordV2HeaderSize ||
+            !::DecodeName(Source, RecordLength, RecordV2HeaderSize, 56, Record))
+        {
+            return 0;
+        }
+        Record.FileId.Low = ::LoadUInt64(Source + 8);
+        Record.ParentFileId.Low = ::LoadUInt64(Source + 16);
+        Record.Usn = ::LoadUInt64(Source + 24);
+        Record.TimeStamp = ::LoadUInt64(Source + 32);
+        Record.Reason = ::LoadUInt32(Source + 40);
+        Record.SourceInfo = ::LoadUInt32(Source + 44);
+        Record.Attributes = ::LoadUInt32(Source + 52);
+    }
+    else if (Record.MajorVersion == 3)
+    {
+        if (RecordLength < RecordV3HeaderSize ||
+            !::DecodeName(Source, RecordLength, RecordV3HeaderSize, 72, Record))
+        {
+            return 0;
+        }
+        Record.FileId = ::LoadFileId128(Source + 8);
+        Record.ParentFileId = ::LoadFileId128(Source + 24);
+        Record.Usn = ::LoadUInt64(Source + 40);
+        Record.TimeStamp = ::LoadUInt64(Source + 48);
+        Record.Reason = ::LoadUInt32(Source + 56);
+        Record.SourceInfo = ::LoadUInt32(Source + 60);
+        Record.Attributes = ::LoadUInt32(Source + 68);
+    }
+    else if (Record.MajorVersion == 4)
+    {
+        if (RecordLength < RecordV4HeaderSize)
+        {
+            return 0;
+        }
+        Record.ExtentCount = ::LoadUInt16(Source + 60);
+        Record.ExtentSize = ::LoadUInt16(Source + 62);
+        if (Record.ExtentCount &&
+            (Record.ExtentSize < MinimumExtentSize ||
+                Record.ExtentCount > (RecordLength - RecordV4HeaderSize) /
+                Record.ExtentSize))
+        {
+            return 0;
+        }
+        Record.FileId = ::LoadFileId128(Source + 8);
+        Record.ParentFileId = ::LoadFileId128(Source + 24);
+        Record.Usn = ::LoadUInt64(Source + 40);
+        Record.Reason = ::LoadUInt32(Source + 48);
+        Record.SourceInfo = ::LoadUInt32(Source + 52);
+        Record.RemainingExtents = ::LoadUInt32(Source + 56);
+        Record.Extents = Source + RecordV4HeaderSize;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return RecordLength;
+}
+
+Mile::NativeString NSudoSweeper::GetChangeJournalRecordName(
+    ChangeJournalRecord const& Record)
+{
+    Mile::NativeString Name;
+    std::uint8_t const* Source = Record.FileName;
+    std::size_t Count = Record.FileNameLength;
+#if defined(_WIN32)
+    Name.reserve(Count);
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        Name.push_back(static_cast<wchar_t>(::LoadUInt16(Source + i * 2)));
+    }
+#else
+    Name.reserve(Count);
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        std::uint32_t Character = ::LoadUInt16(Source + i * 2);
+        if (Character >= 0xD800 && Character < 0xE000)
+        {
+            std::uint32_t Low = i + 1 < Count
+                ? ::LoadUInt16(Source + (i + 1) * 2)
+                : 0;
+            if (Character < 0xDC00 && Low >= 0xDC00 && Low < 0xE000)
+            {
+                Character = 0x10000 +
+                    ((Character - 0xD800) << 10) +
+                    (Low - 0xDC00);
+                ++i;
+            }
+            else
+            {
+                // The names are not validated by the file system.
+                Character = 0xFFFD;
+            }
+        }
+
+        if (Character < 0x80)
+        {
+            Name.push_back(static_cast<char>(Character));
+        }
+        else if (Character < 0x800)
+        {
+            Name.push_back(static_cast<char>(0xC0 | (Character >> 6)));
+            Name.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+        }
+        else if (Character < 0x10000)
+        {
+            Name.push_back(static_cast<char>(0xE0 | (Character >> 12)));
+            Name.push_back(
+                static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+            Name.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+        }
+        else
+        {
+            Name.push_back(static_cast<char>(0xF0 | (Character >> 18)));
+            Name.push_back(
+                static_cast<char>(0x80 | ((Character >> 12) & 0x3F)));
+            Name.push_back(
+                static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+            Name.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+        }
+    }
+#endif
+    return Name;
+}
+
+void NSudoSweeper::ChangeJournalChangeSet::Add(
+    ChangeJournalRecord const& Record)
+{
+    ++this->m_RecordCount;
+
+    // The IDs of the scans have 64 bits.
+    if (Record.FileId.High || Record.ParentFileId.High)
+    {
+        this->m_Complete = false;
+        return;
+    }
+
+    PendingFile& File = this->m_PendingFiles[Record.FileId.Low];
+    File.Reasons |= Record.Reason;
+
+    if (Record.MajorVersion == 4)
+    {
+        if (!File.HasName)
+        {
+            File.ParentId = Record.ParentFileId.Low;
+        }
+        for (std::size_t i = 0; i < Record.ExtentCount; ++i)
+        {
+            File.WrittenBytes += ::LoadUInt64(
+                Record.Extents + i * Record.ExtentSize + 8);
+        }
+        return;
+    }
+
+    // A hard link is added or removed in the directory of the record,
+    // while the other links of the file stay where they are.
+    if (Record.Reason & ChangeJournalReasonHardLinkChange)
+    {
+        this->m_PendingLinkParents.insert(Record.ParentFileId.Low);
+    }
+
+    File.Attributes = Record.Attributes;
+    if (!File.HasName)
+    {
+        File.HasName = true;
+        File.OldParentId = Record.ParentFileId.Low;
+        File.OldName = NSudoSweeper::GetChangeJournalRecordName(Record);
+        File.ParentId = File.OldParentId;
+        File.Name = File.OldName;
+    }
+    else if (Record.Reason & RenameReasons)
+    {
+        File.ParentId = Record.ParentFileId.Low;
+        File.Name = NSudoSweeper::GetChangeJournalRecordName(Record);
+    }
+}
+
+bool NSudoSweeper::ChangeJournalChangeSet::AddRecords(
+    void const* Data,
+    std::size_t Size,
+    std::uint64_t UsnLimit)
+{
+    std::uint8_t const* Source = static_cast<std::uint8_t const*>(Data);
+
+    std::size_t Offset = 0;
+    std::vector<std::uint8_t>& Partial = this->m_PartialRecord;
+    if (!Partial.empty())
+    {
+        // The length of the cut record is in its first 8 bytes.
+        if (Partial.size() < 8)
+        {
+            std::size_t Part = (std::min)(8 - Partial.size(), Size);
+            Partial.insert(Partial.end(), Source, Source + Part);
+            Offset = Part;
+            if (Partial.size() < 8)
+            {
+                return true;
+            }
+            if (!::IsRecordStart(Partial.data()))
+            {
+                Partial.clear();
+                return false;
+            }
+        }
+
+        std::size_t RecordLength = ::LoadUInt32(Partial.data());
+        std::size_t Part = (std::min)(
+            RecordLength - Partial.size(),
+            Size - Offset);
+        Partial.insert(
+            Partial.end(),
+            Source + Offset,
+            Source + Offset + Part);
+        Offset += Part;
+        if (Partial.size() < RecordLength)
+        {
+            return true;
+        }
+
+        ChangeJournalRecord Record;
+        bool Decoded = NSudoSweeper::DecodeChangeJournalRecord(
+            Partial.data(),
+            Partial.size(),
+            Record) != 0;
+        if (Decoded && Record.Usn < UsnLimit)
+        {
+            this->Add(Record);
+        }
+        Partial.clear();
+        if (!Decoded)
+        {
+            return false;
+        }
+    }
+
+    while (Offset < Size)
+    {
+        ChangeJournalRecord Record;
+        std::size_t RecordLength = NSudoSweeper::DecodeChangeJournalRecord(
+            Source + Offset,
+            Size - Offset,
+            Record);
+        if (!RecordLength)
+        {
+            // A record which goes on after the buffer is kept for the next
+            // call, and any other is damaged.
+            std::size_t Remaining = Size - Offset;
+            if (Remaining >= 8 &&
+                (!::IsRecordStart(Source + Offset) ||
+                    ::LoadUInt32(Source + Offset) <= Remaining))
+            {
+                return false;
+            }
+            Partial.assign(Source + Offset, Source + Size);
+            return true;
+        }
+
+        if (Record.Usn < UsnLimit)
+        {
+            this->Add(Record);
+        }
+
+        Offset += RecordLength;
+    }
+
+    return true;
+}
+
+void NSudoSweeper::ChangeJournalChangeSet::Fold()
+{
+    if (!this->m_PartialRecord.empty())
+    {
+        this->m_PartialRecord.clear();
+        this->m_Complete = false;
+    }
+
+    std::size_t First = this->m_Changes.size();
+
+    for (auto& Pending : this->m_PendingFiles)
+    {
+        std::uint64_t FileId = Pending.first;
+        PendingFile& File = Pending.second;
+
+        bool IsDirectory = (File.Attributes & DirectoryAttribute) != 0;
+        bool Created = (File.Reasons & ChangeJournalReasonFileCreate) != 0;
+        bool Deleted = (File.Reasons & ChangeJournalReasonFileDelete) != 0;
+
+        ChangeJournalChange Change;
+        Change.FileId = FileId;
+        Change.IsDirectory = IsDirectory;
+        Change.Reasons = File.Reasons;
+
+        if (Created && Deleted)
+        {
+            // A temporary file leaves the entries as they were.
+            continue;
+        }
+
+        if (Deleted)
+        {
+            Change.Type = ChangeJournalChangeType::Delete;
+            Change.ParentId = File.OldParentId;
+            Change.Name = std::move(File.OldName);
+            ++this->m_Directories[Change.ParentId].Deleted;
+            if (IsDirectory)
+            {
+                this->m_MovedDirectories.insert(FileId);
+            }
+            this->m_Changes.push_back(std::move(Change));
+            continue;
+        }
+
+        if (Created)
+        {
+            Change.Type = ChangeJournalChangeType::Create;
+            Change.ParentId = File.ParentId;
+            Change.Name = std::move(File.Name);
+            ++this->m_Directories[Change.ParentId].Created;
+            this->m_Changes.push_back(std::move(Change));
+            continue;
+        }
+
+        if (File.HasName &&
+            (File.Reasons & RenameReasons) &&
+            (File.OldParentId != File.ParentId || File.OldName != File.Name))
+        {
+            ChangeJournalChange Rename = Change;
+            Rename.Type = ChangeJournalChangeType::Rename;
+            Rename.ParentId = File.ParentId;
+            Rename.Name = File.Name;
+            Rename.OldParentId = File.OldParentId;
+            Rename.OldName = std::move(File.OldName);
+            ++this->m_Directories[Rename.OldParentId].RenamedOut;
+            ++this->m_Directories[Rename.ParentId].RenamedIn;
+            if (IsDirectory)
+            {
+                this->m_MovedDirectories.insert(FileId);
+            }
+            this->m_Changes.push_back(std::move(Rename));
+        }
+
+        if (File.Reasons & ChangeJournalReasonReparsePointChange)
+        {
+            ++this->m_Directories[File.ParentId].Relinked;
+            if (IsDirectory)
+            {
+                // A directory which becomes a junction shows other entries.
+                this->m_MovedDirectories.insert(FileId);
+            }
+        }
+
+        if (!IsDirectory && (File.Reasons & DataReasons))
+        {
+            Change.Type = ChangeJournalChangeType::Modify;
+            Change.ParentId = File.ParentId;
+            Change.Name = std::move(File.Name);
+            Change.WrittenBytes = File.WrittenBytes;
+
+            ChangeJournalDirectoryChanges& Directory =
+                this->m_Directories[Change.ParentId];
+            ++Directory.Modified;
+            if (File.Reasons & ExtendReasons)
+            {
+                ++Directory.Extended;
+            }
+            if (File.Reasons & TruncationReasons)
+            {
+                ++Directory.Truncated;
+            }
+            Directory.WrittenBytes += File.WrittenBytes;
+
+            this->m_ModifiedFiles.insert(FileId);
+            this->m_Changes.push_back(std::move(Change));
+        }
+    }
+
+    for (std::uint64_t const& ParentId : this->m_PendingLinkParents)
+    {
+        ++this->m_Directories[ParentId].Relinked;
+    }
+
+    this->m_PendingFiles.clear();
+    this->m_PendingLinkParents.clear();
+
+    std::stable_sort(
+        this->m_Changes.begin() + static_cast<std::ptrdiff_t>(First),
+        this->m_Changes.end(),
+        [](ChangeJournalChange const& Left, ChangeJournalChange const& Right)
+    {
+        return Left.ParentId < Right.ParentId;
+    });
+}
+
+void NSudoSweeper::ChangeJournalChangeSet::Clear()
+{
+    this->m_PendingFiles.clear();
+    this->m_PendingLinkParents.clear();
+    this->m_PartialRecord.clear();
+    this->m_RecordCount = 0;
+    this->m_Complete = true;
+    this->m_Changes.clear();
+    this->m_Directories.clear();
+    this->m_MovedDirectories.clear();
+    this->m_ModifiedFiles.clear();
+}
+
+bool NSudoSweeper::ChangeJournalChangeSet::IsDirectoryChanged(
+    std::uint64_t DirectoryId) const
+{
+    if (this->m_MovedDirectories.count(DirectoryId))
+    {
+        return true;
+    }
+
+    auto Iterator = this->m_Directories.find(DirectoryId);
+    return Iterator != this->m_Directories.end() &&
+        Iterator->second.HasEntryChanges();
+}
+
+bool NSudoSweeper::ChangeJournalChangeSet::HasModifiedFiles(
+    std::uint64_t DirectoryId) const
+{
+    auto Iterator = this->m_Directories.find(DirectoryId);
+    return Iterator != this->m_Directories.end() &&
+        Iterator->second.Modified;
+}
@@ -0,0 +1,429 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperChangeJournal.h
+ * PURPOSE:   Definition for the USN change journal decoder
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_CHANGE_JOURNAL
+#define NSUDO_SWEEPER_CHANGE_JOURNAL
+
+#include <Mile.Portable.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The USN_REASON_* flags the change set uses. The reasons of a record
+     * are the union of the changes since the file was opened.
+     */
+    const std::uint32_t ChangeJournalReasonDataOverwrite = 0x00000001;
+    const std::uint32_t ChangeJournalReasonDataExtend = 0x00000002;
+    const std::uint32_t ChangeJournalReasonDataTruncation = 0x00000004;
+    const std::uint32_t ChangeJournalReasonNamedDataOverwrite = 0x00000010;
+    const std::uint32_t ChangeJournalReasonNamedDataExtend = 0x00000020;
+    const std::uint32_t ChangeJournalReasonNamedDataTruncation = 0x00000040;
+    const std::uint32_t ChangeJournalReasonFileCreate = 0x00000100;
+    const std::uint32_t ChangeJournalReasonFileDelete = 0x00000200;
+    const std::uint32_t ChangeJournalReasonRenameOldName = 0x00001000;
+    const std::uint32_t ChangeJournalReasonRenameNewName = 0x00002000;
+    const std::uint32_t ChangeJournalReasonHardLinkChange = 0x00010000;
+    const std::uint32_t ChangeJournalReasonCompressionChange = 0x00020000;
+    const std::uint32_t ChangeJournalReasonEncryptionChange = 0x00040000;
+    const std::uint32_t ChangeJournalReasonReparsePointChange = 0x00100000;
+    const std::uint32_t ChangeJournalReasonStreamChange = 0x00200000;
+    const std::uint32_t ChangeJournalReasonClose = 0x80000000;
+
+    /**
+     * A 128-bit file ID. NTFS uses only the low half, and the high half of
+     * the records of version 2 is always 0.
+     */
+    struct ChangeJournalFileId
+    {
+        std::uint64_t Low = 0;
+        std::uint64_t High = 0;
+    };
+
+    /**
+     * A record of the change journal, which is a USN_RECORD_V2, a
+     * USN_RECORD_V3 or a USN_RECORD_V4 structure. The pointers point into
+     * the buffer the record is decoded from.
+     */
+    struct ChangeJournalRecord
+    {
+        std::uint16_t MajorVersion = 0;
+        std::uint16_t MinorVersion = 0;
+
+        ChangeJournalFileId FileId;
+        ChangeJournalFileId ParentFileId;
+
+        std::uint64_t Usn = 0;
+
+        /**
+         * The time of the record in 100-nanosecond intervals since January
+         * 1, 1601 (UTC), or 0 for version 4.
+         */
+        std::uint64_t TimeStamp = 0;
+
+        std::uint32_t Reason = 0;
+        std::uint32_t SourceInfo = 0;
+
+        /**
+         * The FILE_ATTRIBUTE_* flags of the file, or 0 for version 4.
+         */
+        std::uint32_t Attributes = 0;
+
+        /**
+         * The UTF-16LE name of the file, which is not terminated, and its
+         * length in characters. Version 4 has no name.
+         */
+        std::uint8_t const* FileName = nullptr;
+        std::size_t FileNameLength = 0;
+
+        /**
+         * The ranges of the file written since it was opened, for version
+         * 4. Each USN_RECORD_EXTENT has the offset and the length of a
+         * range in the first 16 of its ExtentSize bytes.
+         */
+        std::uint8_t const* Extents = nullptr;
+        std::size_t ExtentCount = 0;
+        std::size_t ExtentSize = 0;
+
+        /**
+         * The number of extents of the file in the next records.
+         */
+        std::uint32_t RemainingExtents = 0;
+    };
+
+    /**
+     * Decodes the record at the start of a buffer. The records of a buffer
+     * follow each other, and the output of FSCTL_READ_USN_JOURNAL starts
+     * with the 8-byte USN of the next read.
+     *
+     * @param Data The buffer.
+     * @param Size The size of the buffer, in bytes.
+     * @param Record The record, which points into the buffer.
+     * @return The length of the record, or 0 if the buffer does not start
+     *         with a valid record of version 2, 3 or 4.
+     */
+    std::size_t DecodeChangeJournalRecord(
+        void const* Data,
+        std::size_t Size,
+        ChangeJournalRecord& Record);
+
+    /**
+     * Retrieves the name of a record.
+     *
+     * @param Record The record.
+     * @return The name of the record, or an empty string for version 4.
+     */
+    Mile::NativeString GetChangeJournalRecordName(
+        ChangeJournalRecord const& Record);
+
+    /**
+     * The kinds of the changes of a change set.
+     */
+    enum class ChangeJournalChangeType
+    {
+        /**
+         * The file has been created.
+         */
+        Create,
+
+        /**
+         * The file has been deleted.
+         */
+        Delete,
+
+        /**
+         * The file has been renamed or moved to another directory.
+         */
+        Rename,
+
+        /**
+         * The data of the file has changed, so its size may have changed.
+         */
+        Modify,
+    };
+
+    /**
+     * A change of a file since the start of the journal range.
+     */
+    struct ChangeJournalChange
+    {
+        ChangeJournalChangeType Type = ChangeJournalChangeType::Modify;
+
+        std::uint64_t FileId = 0;
+        bool IsDirectory = false;
+
+        /**
+         * The directory and the name of the file at the end of the range,
+         * or at the start for Delete.
+         */
+        std::uint64_t ParentId = 0;
+        Mile::NativeString Name;
+
+        /**
+         * The directory and the name of the file at the start of the range,
+         * for Rename.
+         */
+        std::uint64_t OldParentId = 0;
+        Mile::NativeString OldName;
+
+        /**
+         * The union of the reasons of the records of the file.
+         */
+        std::uint32_t Reasons = 0;
+
+        /**
+         * The number of bytes written to the file, for Modify. It is only
+         * known if the journal tracks ranges, which adds the records of
+         * version 4, and otherwise it is 0.
+         */
+        std::uint64_t WrittenBytes = 0;
+    };
+
+    /**
+     * The changes of the entries of a directory. A rename within the
+     * directory counts as both RenamedOut and RenamedIn.
+     */
+    struct ChangeJournalDirectoryChanges
+    {
+        std::size_t Created = 0;
+        std::size_t Deleted = 0;
+        std::size_t RenamedIn = 0;
+        std::size_t RenamedOut = 0;
+
+        /**
+         * The number of files whose hard links or reparse points have
+         * changed, which changes the entries without a create or a delete.
+         */
+        std::size_t Relinked = 0;
+
+        /**
+         * The number of files whose data has changed, and how many of them
+         * have been extended and truncated. The records have no sizes, so
+         * the new sizes must be queried.
+         */
+        std::size_t Modified = 0;
+        std::size_t Extended = 0;
+        std::size_t Truncated = 0;
+
+        /**
+         * The number of bytes written to the modified files, if the journal
+         * tracks ranges.
+         */
+        std::uint64_t WrittenBytes = 0;
+
+        /**
+         * Checks whether the directory has other entries than before.
+         *
+         * @return true if the entries have changed, otherwise false.
+         */
+        bool HasEntryChanges() const noexcept
+        {
+            return this->Created ||
+                this->Deleted ||
+                this->RenamedIn ||
+                this->RenamedOut ||
+                this->Relinked;
+        }
+    };
+
+    /**
+     * Folds the records of change journals into the net changes of each
+     * file and each directory, so a scan only enumerates the directories
+     * whose entries have changed and only queries the sizes of the files
+     * whose data has changed.
+     *
+     * The records of a file are folded by its ID: a file created and
+     * deleted in the range leaves no change, a chain of renames becomes one
+     * rename, and a rename back to the old name leaves no rename. The IDs
+     * of different volumes may be the same, so Fold must be called after
+     * the records of each journal.
+     */
+    class ChangeJournalChangeSet
+    {
+    private:
+
+        struct PendingFile
+        {
+            std::uint32_t Reasons = 0;
+            std::uint32_t Attributes = 0;
+            bool HasName = false;
+            std::uint64_t OldParentId = 0;
+            Mile::NativeString OldName;
+            std::uint64_t ParentId = 0;
+            Mile::NativeString Name;
+            std::uint64_t WrittenBytes = 0;
+        };
+
+        std::unordered_map<std::uint64_t, PendingFile> m_PendingFiles;
+        std::unordered_set<std::uint64_t> m_PendingLinkParents;
+        std::vector<std::uint8_t> m_PartialRecord;
+        std::size_t m_RecordCount = 0;
+        bool m_Complete = true;
+
+        std::vector<ChangeJournalChange> m_Changes;
+        std::unordered_map<
+            std::uint64_t,
+            ChangeJournalDirectoryChanges> m_Directories;
+        std::unordered_set<std::uint64_t> m_MovedDirectories;
+        std::unordered_set<std::uint64_t> m_ModifiedFiles;
+
+    public:
+
+        /**
+         * Adds a record.
+         *
+         * @param Record The record.
+         */
+        void Add(
+            ChangeJournalRecord const& Record);
+
+        /**
+         * Decodes and adds the records of a buffer, such as the output of
+         * FSCTL_READ_USN_JOURNAL after its first 8 bytes, or a captured
+         * dump of a journal.
+         *
+         * A record cut at the end of the buffer is kept and completed by
+         * the next call, so a dump may be read in pieces of any size. Fold
+         * drops a record which is never completed, and the changes are not
+         * complete then.
+         *
+         * @param Data The records.
+         * @param Size The size of the records, in bytes.
+         * @param UsnLimit The records from this USN on are ignored.
+         * @return true if successful, or false if a record is damaged, and
+         *         the records before it are added.
+         */
+        bool AddRecords(
+            void const* Data,
+            std::size_t Size,
+            std::uint64_t UsnLimit = UINT64_MAX);
+
+        /**
+         * Folds the records added since the last call, which must come
+         * from one journal, into the changes.
+         */
+        void Fold();
+
+        /**
+         * Removes all records and changes.
+         */
+        void Clear();
+
+        /**
+         * Checks whether the changes describe every change of the records.
+         * The records of files with IDs of more than 64 bits, such as the
+         * files of ReFS, cannot be matched with the IDs of the scans.
+         *
+         * @return true if the changes are complete, otherwise false.
+         */
+        bool IsComplete() const noexcept
+        {
+            return this->m_Complete;
+        }
+
+        /**
+         * Retrieves the number of records added.
+         *
+         * @return The number of records.
+         */
+        std::size_t GetRecordCount() const noexcept
+        {
+            return this->m_RecordCount;
+        }
+
+        /**
+         * Retrieves the changes of the files, in the order of the
+         * directories which contain them.
+         *
+         * @return The changes.
+         */
+        std::vector<ChangeJournalChange> const& GetChanges() const noexcept
+        {
+            return this->m_Changes;
+        }
+
+        /**
+         * Retrieves the changes of the directories by their file IDs.
+         *
+         * @return The changes of the directories.
+         */
+        std::unordered_map<std::uint64_t, ChangeJournalDirectoryChanges> const&
+            GetDirectories() const noexcept
+        {
+            return this->m_Directories;
+        }
+
+        /**
+         * Checks whether the entries of a directory have changed, or the
+         * directory itself has been created, deleted or moved.
+         *
+         * @param DirectoryId The file ID of the directory.
+         * @return true if the directory must be enumerated, otherwise
+         *         false.
+         */
+        bool IsDirectoryChanged(
+            std::uint64_t DirectoryId) const;
+
+        /**
+         * Checks whether a directory has been deleted or moved, so the
+         * paths below it name other directories now.
+         *
+         * @param DirectoryId The file ID of the directory.
+         * @return true if the directory has been deleted or moved,
+         *         otherwise false.
+         */
+        bool IsDirectoryMoved(
+            std::uint64_t DirectoryId) const
+        {
+            return this->m_MovedDirectories.count(DirectoryId) != 0;
+        }
+
+        /**
+         * Checks whether any directory has been deleted or moved.
+         *
+         * @return true if any directory has been deleted or moved,
+         *         otherwise false.
+         */
+        bool HasMovedDirectories() const noexcept
+        {
+            return !this->m_MovedDirectories.empty();
+        }
+
+        /**
+         * Checks whether a directory contains files whose data has changed.
+         *
+         * @param DirectoryId The file ID of the directory.
+         * @return true if the directory contains modified files, otherwise
+         *         false.
+         */
+        bool HasModifiedFiles(
+            std::uint64_t DirectoryId) const;
+
+        /**
+         * Checks whether the data of a file has changed.
+         *
+         * @param FileId The file ID of the file.
+         * @return true if the data of the file has changed, otherwise
+         *         false.
+         */
+        bool IsFileModified(
+            std::uint64_t FileId) const
+        {
+            return this->m_ModifiedFiles.count(FileId) != 0;
+        }
+    };
+}
+
+#endif // !NSUDO_SWEEPER_CHANGE_JOURNAL
@@ -14,6 +14,8 @@
 
 #include "NSudoSweeperCore.h"
 
+#include <Mile.Portable.CaseInsensitive.h>
+
 #include <wchar.h>
 
 /**
@@ -23,9 +25,7 @@
 BOOL WINAPI NSudoSweeperIsOnlineImage(
     _In_ LPCWSTR SessionRootPath)
 {
-    UNREFERENCED_PARAMETER(SessionRootPath);
-
-    if (SessionRootPath)
+    if (!SessionRootPath)
     {
         return TRUE;
     }
@@ -37,7 +37,7 @@ BOOL WINAPI NSudoSweeperIsOnlineImage(
     {
         ::wcschr(Buffer, '\\')[1] = '\0';
 
-        return (::_wcsicmp(SessionRootPath, Buffer) == 0);
+        return Mile::CaseInsensitiveEquals(SessionRootPath, Buffer);
     }
 
     return FALSE;
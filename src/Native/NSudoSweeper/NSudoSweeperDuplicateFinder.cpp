@@ -0,0 +1,837 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateFinder.cpp
+ * PURPOSE:   Implementation for the content-hash duplicate file finder
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperDuplicateFinder.h"
+
+#include <Mile.Portable.ThreadPool.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace
+{
+    /**
+     * The chunks smaller than this size are hashed by the thread which
+     * reaps them, because a task costs more than hashing them.
+     */
+    const std::size_t ParallelHashSize = 64 * 1024;
+
+    struct HashJob
+    {
+        std::size_t Index = 0;
+        std::uint64_t Length = 0;
+        std::size_t ChunkCount = 0;
+        std::size_t NextChunk = 0;
+        std::size_t CompletedChunks = 0;
+        Mile::AsyncIoFileHandle Handle;
+        bool Opened = false;
+        bool Failed = false;
+        bool Finished = false;
+        std::vector<Mile::Hash128> ChunkHashes;
+    };
+
+    struct HashSlot
+    {
+        std::uint8_t* Buffer = nullptr;
+        HashJob* Job = nullptr;
+        std::size_t Chunk = 0;
+        std::size_t Length = 0;
+    };
+
+    void StoreUInt64(
+        std::uint8_t* Target,
+        std::uint64_t Value) noexcept
+    {
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Target[i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    /**
+     * Hashes the hashes of the chunks of a file in order, so the chunks can
+     * be hashed in any order and the result does not depend on the byte
+     * order of the platform.
+     */
+    Mile::Hash128 CombineChunkHashes(
+        std::vector<Mile::Hash128> const& ChunkHashes,
+        std::uint64_t Length) noexcept
+    {
+        Mile::FastHasher Hasher(Length);
+        for (Mile::Hash128 const& Hash : ChunkHashes)
+        {
+            std::uint8_t Bytes[16];
+            ::StoreUInt64(&Bytes[0], Hash.Low);
+            ::StoreUInt64(&Bytes[8], Hash.High);
+            Hasher.Update(Bytes, sizeof(Bytes));
+        }
+        return Hasher.Finalize();
+    }
+
+    /**
+     * Waits for the reads in flight and discards their completions.
+     */
+    void DrainQueue(
+        Mile::AsyncIoQueue& Queue)
+    {
+        Mile::AsyncIoCompletion Completions[16];
+        while (Queue.GetOutstandingRequests())
+        {
+            Queue.Reap(Completions, 16, true);
+        }
+    }
+}
+
+void NSudoSweeper::DuplicateFinder::ReportProgress()
+{
+    if (this->m_ProgressHandler)
+    {
+        this->m_ProgressHandler(
+            this->m_Statistics.BytesRead,
+            this->m_BytesPlanned);
+    }
+}
+
+bool NSudoSweeper::DuplicateFinder::HashFiles(
+    Mile::AsyncIoQueue& Queue,
+    std::vector<std::size_t> const& Files,
+    bool Prefix,
+    std::vector<Mile::Hash128>& Hashes,
+    std::vector<bool>& Succeeded)
+{
+    std::size_t ChunkSize = Prefix
+        ? this->m_Options.PrefixSize
+        : this->m_Options.ChunkSize;
+
+    Hashes.assign(Files.size(), Mile::Hash128());
+    Succeeded.assign(Files.size(), false);
+
+    std::vector<HashJob> Jobs(Files.size());
+    for (std::size_t i = 0; i < Files.size(); ++i)
+    {
+        HashJob& Job = Jobs[i];
+        Job.Index = i;
+        Job.Length = this->m_Files[Files[i]].Size;
+        if (Prefix && Job.Length > ChunkSize)
+        {
+            Job.Length = ChunkSize;
+        }
+        Job.ChunkCount = static_cast<std::size_t>(
+            (Job.Length + ChunkSize - 1) / ChunkSize);
+        Job.ChunkHashes.resize(Job.ChunkCount);
+        this->m_BytesPlanned += Job.Length;
+    }
+
+    std::size_t SlotCount = this->m_Options.QueueDepth;
+    std::unique_ptr<std::uint8_t[]> Memory(
+        new std::uint8_t[SlotCount * ChunkSize]);
+    std::vector<HashSlot> Slots(SlotCount);
+    std::vector<HashSlot*> FreeSlots;
+    FreeSlots.reserve(SlotCount);
+    for (std::size_t i = 0; i < SlotCount; ++i)
+    {
+        Slots[i].Buffer = &Memory[i * ChunkSize];
+        FreeSlots.push_back(&Slots[i]);
+    }
+    std::vector<Mile::AsyncIoCompletion> Completions(SlotCount);
+
+    std::mutex Mutex;
+    std::condition_variable SlotReleased;
+    std::size_t HashingSlots = 0;
+    std::size_t ReadsInFlight = 0;
+    Mile::ThreadPool& Pool = Mile::ThreadPool::GetDefault();
+    Mile::TaskGroup Group;
+
+    // Finishes a job after its last chunk, or after the reads in flight of
+    // a failed job. The caller holds the mutex.
+    auto TryFinish = [&](
+        HashJob& Job)
+    {
+        if (Job.Finished ||
+            Job.CompletedChunks != Job.NextChunk ||
+            (!Job.Failed && Job.NextChunk != Job.ChunkCount))
+        {
+            return;
+        }
+
+        Job.Finished = true;
+        if (Job.Opened)
+        {
+            Mile::AsyncIoQueue::CloseFile(Job.Handle);
+            Job.Opened = false;
+        }
+        if (!Job.Failed)
+        {
+            Hashes[Job.Index] = ::CombineChunkHashes(
+                Job.ChunkHashes,
+                Job.Length);
+            Succeeded[Job.Index] = true;
+        }
+    };
+
+    auto HashChunk = [&](
+        HashSlot* Slot,
+        bool Parallel)
+    {
+        Mile::Hash128 Hash = Mile::ComputeFastHash(
+            Slot->Buffer,
+            Slot->Length,
+            Slot->Chunk);
+
+        std::lock_guard<std::mutex> Lock(Mutex);
+        HashJob& Job = *Slot->Job;
+        Job.ChunkHashes[Slot->Chunk] = Hash;
+        ++Job.CompletedChunks;
+        FreeSlots.push_back(Slot);
+        TryFinish(Job);
+        if (Parallel)
+        {
+            --HashingSlots;
+            SlotReleased.notify_one();
+        }
+    };
+
+    try
+    {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        std::size_t NextJob = 0;
+        HashJob* Current = nullptr;
+
+        for (;;)
+        {
+            bool Canceled = this->m_Canceled.load();
+
+            while (!Canceled && !FreeSlots.empty())
+            {
+                if (Current && Current->Failed)
+                {
+                    TryFinish(*Current);
+                    Current = nullptr;
+                }
+
+                if (!Current)
+                {
+                    if (NextJob == Jobs.size())
+                    {
+                        break;
+                    }
+
+                    Current = &Jobs[NextJob++];
+                    DuplicateFile const& File =
+                        this->m_Files[Files[Current->Index]];
+                    std::uint64_t Size = 0;
+                    if (0 != Queue.OpenFile(
+                        File.Path,
+                        Mile::AsyncIoAccess::Read,
+                        Current->Handle))
+                    {
+                        Current->Failed = true;
+                        continue;
+                    }
+                    Current->Opened = true;
+
+                    // The file may have changed since it was scanned.
+                    if (0 != Mile::AsyncIoQueue::GetFileSize(
+                        Current->Handle,
+                        Size) ||
+                        Size != File.Size)
+                    {
+                        Current->Failed = true;
+                        continue;
+                    }
+                }
+
+                HashSlot* Slot = FreeSlots.back();
+                FreeSlots.pop_back();
+                Slot->Job = Current;
+                Slot->Chunk = Current->NextChunk++;
+                std::uint64_t Offset =
+                    static_cast<std::uint64_t>(Slot->Chunk) * ChunkSize;
+                Slot->Length = static_cast<std::size_t>((std::min)(
+                    static_cast<std::uint64_t>(ChunkSize),
+                    Current->Length - Offset));
+
+                Mile::AsyncIoBuffer Buffer;
+                Buffer.Data = Slot->Buffer;
+                Buffer.Size = Slot->Length;
+                Mile::AsyncIoRequest Request;
+                Request.File = Current->Handle;
+                Request.Operation = Mile::AsyncIoOperation::Read;
+                Request.Offset = Offset;
+                Request.Buffers = &Buffer;
+                Request.BufferCount = 1;
+                Request.UserData = Slot;
+                Queue.Submit(Request);
+                ++ReadsInFlight;
+
+                if (Current->NextChunk == Current->ChunkCount)
+                {
+                    Current = nullptr;
+                }
+            }
+
+            if (!ReadsInFlight && !HashingSlots)
+            {
+                if (Canceled || (!Current && NextJob == Jobs.size()))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (!ReadsInFlight)
+            {
+                // Only the hashes are in flight, and only the tasks change
+                // their number now.
+                std::size_t Hashing = HashingSlots;
+                SlotReleased.wait(Lock, [&]()
+                {
+                    return HashingSlots != Hashing;
+                });
+                continue;
+            }
+
+            Lock.unlock();
+            this->ReportProgress();
+            std::size_t Count = Queue.Reap(
+                Completions.data(),
+                Completions.size(),
+                true);
+            Lock.lock();
+
+            for (std::size_t i = 0; i < Count; ++i)
+            {
+                Mile::AsyncIoCompletion const& Completion = Completions[i];
+                HashSlot* Slot = static_cast<HashSlot*>(Completion.UserData);
+                HashJob& Job = *Slot->Job;
+                --ReadsInFlight;
+                this->m_Statistics.BytesRead += Completion.Bytes;
+
+                if (Completion.ErrorCode ||
+                    Completion.Bytes != Slot->Length ||
+                    Job.Failed ||
+                    Canceled)
+                {
+                    Job.Failed = true;
+                    ++Job.CompletedChunks;
+                    FreeSlots.push_back(Slot);
+                    TryFinish(Job);
+                    continue;
+                }
+
+                if (Slot->Length < ParallelHashSize)
+                {
+                    Lock.unlock();
+                    HashChunk(Slot, false);
+                    Lock.lock();
+                    continue;
+                }
+
+                ++HashingSlots;
+                Pool.Submit(Group, [&, Slot]()
+                {
+                    HashChunk(Slot, true);
+                });
+            }
+        }
+
+        Lock.unlock();
+        Pool.Wait(Group);
+        this->ReportProgress();
+    }
+    catch (...)
+    {
+        this->m_Canceled.store(true);
+        ::DrainQueue(Queue);
+        Group.Cancel();
+        Pool.Wait(Group);
+        for (HashJob& Job : Jobs)
+        {
+            if (Job.Opened)
+            {
+                Mile::AsyncIoQueue::CloseFile(Job.Handle);
+            }
+        }
+        throw;
+    }
+
+    for (HashJob& Job : Jobs)
+    {
+        if (Job.Opened)
+        {
+            Mile::AsyncIoQueue::CloseFile(Job.Handle);
+        }
+    }
+
+    return !this->m_Canceled.load();
+}
+
+bool NSudoSweeper::DuplicateFinder::VerifyFiles(
+    Mile::AsyncIoQueue& Queue,
+    std::vector<std::size_t> const& Files,
+    std::vector<bool>& Equal)
+{
+    struct VerifySlot
+    {
+        std::size_t File;
+        std::size_t Length;
+        bool Succeeded;
+    };
+
+    std::uint64_t Size = this->m_Files[Files[0]].Size;
+    std::size_t ChunkSize = this->m_Options.ChunkSize;
+    this->m_BytesPlanned += Size * Files.size();
+
+    Equal.assign(Files.size(), true);
+    std::vector<Mile::AsyncIoFileHandle> Handles(Files.size());
+    std::vector<bool> Opened(Files.size(), false);
+    for (std::size_t i = 0; i < Files.size(); ++i)
+    {
+        std::uint64_t ActualSize = 0;
+        if (0 != Queue.OpenFile(
+            this->m_Files[Files[i]].Path,
+            Mile::AsyncIoAccess::Read,
+            Handles[i]))
+        {
+            Equal[i] = false;
+            continue;
+        }
+        Opened[i] = true;
+        if (0 != Mile::AsyncIoQueue::GetFileSize(Handles[i], ActualSize) ||
+            ActualSize != Size)
+        {
+            Equal[i] = false;
+        }
+    }
+
+    // The first file is read once per chunk and compared with up to
+    // QueueDepth - 1 other files at a time.
+    std::size_t SlotCount = this->m_Options.QueueDepth;
+    std::unique_ptr<std::uint8_t[]> Memory(
+        new std::uint8_t[SlotCount * ChunkSize]);
+    std::vector<VerifySlot> Slots(SlotCount);
+    std::vector<Mile::AsyncIoCompletion> Completions(SlotCount);
+
+    auto CloseFiles = [&]()
+    {
+        for (std::size_t i = 0; i < Files.size(); ++i)
+        {
+            if (Opened[i])
+            {
+                Mile::AsyncIoQueue::CloseFile(Handles[i]);
+                Opened[i] = false;
+            }
+        }
+    };
+
+    try
+    {
+        for (std::uint64_t Offset = 0; Offset < Size; Offset += ChunkSize)
+        {
+            std::size_t Length = static_cast<std::size_t>((std::min)(
+                static_cast<std::uint64_t>(ChunkSize),
+                Size - Offset));
+
+            bool KeeperRead = false;
+            std::size_t Next = 1;
+            for (;;)
+            {
+                if (this->m_Canceled.load() || !Equal[0])
+                {
+                    break;
+                }
+
+                // Fill the slots with the other files which still match.
+                std::size_t Used = 1;
+                std::size_t Submitted = 0;
+                Slots[0].File = 0;
+                while (Used < SlotCount && Next < Files.size())
+                {
+                    if (Equal[Next])
+                    {
+                        Slots[Used++].File = Next;
+                    }
+                    ++Next;
+                }
+                if (Used == 1)
+                {
+                    break;
+                }
+
+                for (std::size_t i = KeeperRead ? 1 : 0; i < Used; ++i)
+                {
+                    VerifySlot& Slot = Slots[i];
+                    Slot.Length = Length;
+                    Slot.Succeeded = false;
+
+                    Mile::AsyncIoBuffer Buffer;
+                    Buffer.Data = &Memory[i * ChunkSize];
+                    Buffer.Size = Length;
+                    Mile::AsyncIoRequest Request;
+                    Request.File = Handles[Slot.File];
+                    Request.Operation = Mile::AsyncIoOperation::Read;
+                    Request.Offset = Offset;
+                    Request.Buffers = &Buffer;
+                    Request.BufferCount = 1;
+                    Request.UserData = &Slot;
+                    Queue.Submit(Request);
+                    ++Submitted;
+                }
+
+                while (Submitted)
+                {
+                    std::size_t Count = Queue.Reap(
+                        Completions.data(),
+                        Completions.size(),
+                        true);
+                    for (std::size_t i = 0; i < Count; ++i)
+                    {
+                        VerifySlot* Slot = static_cast<VerifySlot*>(
+                            Completions[i].UserData);
+                        Slot->Succeeded = !Completions[i].ErrorCode &&
+                            Completions[i].Bytes == Slot->Length;
+                        this->m_Statistics.BytesRead += Completions[i].Bytes;
+                    }
+                    Submitted -= Count;
+                }
+
+                if (!KeeperRead)
+                {
+                    KeeperRead = true;
+                    if (!Slots[0].Succeeded)
+                    {
+                        Equal[0] = false;
+                        break;
+                    }
+                }
+
+                for (std::size_t i = 1; i < Used; ++i)
+                {
+                    if (!Slots[i].Succeeded || 0 != std::memcmp(
+                        &Memory[0],
+                        &Memory[i * ChunkSize],
+                        Length))
+                    {
+                        Equal[Slots[i].File] = false;
+                    }
+                }
+
+                this->ReportProgress();
+            }
+
+            if (this->m_Canceled.load() || !Equal[0])
+            {
+                break;
+            }
+        }
+    }
+    catch (...)
+    {
+        ::DrainQueue(Queue);
+        CloseFiles();
+        throw;
+    }
+
+    CloseFiles();
+
+    // Nothing matches a first file which cannot be read.
+    if (!Equal[0])
+    {
+        Equal.assign(Files.size(), false);
+    }
+
+    return !this->m_Canceled.load();
+}
+
+NSudoSweeper::DuplicateFinder::DuplicateFinder(
+    DuplicateFinderOptions const& Options) :
+    m_Options(Options)
+{
+    this->m_Options.MinimumSize =
+        (std::max)(this->m_Options.MinimumSize, std::uint64_t(1));
+    this->m_Options.ChunkSize =
+        (std::max)(this->m_Options.ChunkSize, std::size_t(4096));
+    this->m_Options.PrefixSize = (std::min)(
+        (std::max)(this->m_Options.PrefixSize, std::size_t(1)),
+        this->m_Options.ChunkSize);
+    this->m_Options.QueueDepth =
+        (std::max)(this->m_Options.QueueDepth, std::size_t(2));
+}
+
+void NSudoSweeper::DuplicateFinder::Add(
+    DuplicateFile&& File)
+{
+    this->m_Files.push_back(std::move(File));
+}
+
+void NSudoSweeper::DuplicateFinder::SetProgressHandler(
+    DuplicateFinderProgressHandler Handler)
+{
+    this->m_ProgressHandler = std::move(Handler);
+}
+
+bool NSudoSweeper::DuplicateFinder::Find()
+{
+    this->m_Sets.clear();
+    this->m_Canceled.store(false);
+    this->m_Statistics = DuplicateFinderStatistics();
+    this->m_Statistics.Files = this->m_Files.size();
+    this->m_BytesPlanned = 0;
+
+    auto IsPathLess = [this](
+        std::size_t Left,
+        std::size_t Right)
+    {
+        return this->m_Files[Left].Path < this->m_Files[Right].Path;
+    };
+
+    // Order the files by size, so the files of a size are adjacent, and the
+    // links to the same data are adjacent within them.
+    std::vector<std::size_t> Order;
+    Order.reserve(this->m_Files.size());
+    for (std::size_t i = 0; i < this->m_Files.size(); ++i)
+    {
+        if (this->m_Files[i].Size >= this->m_Options.MinimumSize)
+        {
+            Order.push_back(i);
+        }
+    }
+    std::sort(Order.begin(), Order.end(), [&](
+        std::size_t Left,
+        std::size_t Right)
+    {
+        DuplicateFile const& LeftFile = this->m_Files[Left];
+        DuplicateFile const& RightFile = this->m_Files[Right];
+        if (LeftFile.Size != RightFile.Size)
+        {
+            return LeftFile.Size < RightFile.Size;
+        }
+        if (LeftFile.FileId != RightFile.FileId)
+        {
+            return LeftFile.FileId < RightFile.FileId;
+        }
+        return LeftFile.Path < RightFile.Path;
+    });
+
+    std::vector<std::vector<std::size_t>> Groups;
+    for (std::size_t Start = 0; Start < Order.size();)
+    {
+        std::uint64_t Size = this->m_Files[Order[Start]].Size;
+        std::vector<std::size_t> Group;
+        std::size_t End = Start;
+        for (; End < Order.size() &&
+            this->m_Files[Order[End]].Size == Size; ++End)
+        {
+            std::uint64_t FileId = this->m_Files[Order[End]].FileId;
+            if (FileId && !Group.empty() &&
+                this->m_Files[Group.back()].FileId == FileId)
+            {
+                ++this->m_Statistics.LinkedFiles;
+                continue;
+            }
+            Group.push_back(Order[End]);
+        }
+        if (Group.size() > 1)
+        {
+            this->m_Statistics.SizeCollisions += Group.size();
+            Groups.push_back(std::move(Group));
+        }
+        Start = End;
+    }
+    std::vector<std::size_t>().swap(Order);
+
+    std::uint64_t FailedFiles = 0;
+
+    // Hashes the files of the groups and splits the groups by the hashes.
+    // The groups whose files have been hashed completely are moved to
+    // Completed with their hashes.
+    std::vector<std::vector<std::size_t>> Completed;
+    std::vector<Mile::Hash128> CompletedHashes;
+    auto SplitGroups = [&](
+        bool Prefix) -> bool
+    {
+        std::vector<std::size_t> Files;
+        for (std::vector<std::size_t> const& Group : Groups)
+        {
+            Files.insert(Files.end(), Group.begin(), Group.end());
+        }
+
+        Mile::AsyncIoQueueOptions QueueOptions;
+        QueueOptions.QueueDepth = this->m_Options.QueueDepth;
+        QueueOptions.ChunkSize = this->m_Options.ChunkSize;
+        Mile::AsyncIoQueue Queue(QueueOptions);
+
+        std::vector<Mile::Hash128> Hashes;
+        std::vector<bool> Succeeded;
+        if (!this->HashFiles(Queue, Files, Prefix, Hashes, Succeeded))
+        {
+            return false;
+        }
+        if (Prefix)
+        {
+            this->m_Statistics.PrefixHashedFiles += Files.size();
+        }
+        else
+        {
+            this->m_Statistics.FullHashedFiles += Files.size();
+        }
+
+        std::vector<std::vector<std::size_t>> Remaining;
+        std::size_t Position = 0;
+        for (std::vector<std::size_t> const& Group : Groups)
+        {
+            std::uint64_t Size = this->m_Files[Group[0]].Size;
+            std::vector<std::pair<Mile::Hash128, std::size_t>> Entries;
+            for (std::size_t File : Group)
+            {
+                if (Succeeded[Position])
+                {
+                    Entries.emplace_back(Hashes[Position], File);
+                }
+                else
+                {
+                    ++FailedFiles;
+                }
+                ++Position;
+            }
+            std::sort(Entries.begin(), Entries.end(), [&](
+                std::pair<Mile::Hash128, std::size_t> const& Left,
+                std::pair<Mile::Hash128, std::size_t> const& Right)
+            {
+                if (Left.first != Right.first)
+                {
+                    return Left.first < Right.first;
+                }
+                return IsPathLess(Left.second, Right.second);
+            });
+
+            for (std::size_t Start = 0; Start < Entries.size();)
+            {
+                std::size_t End = Start + 1;
+                while (End < Entries.size() &&
+                    Entries[End].first == Entries[Start].first)
+                {
+                    ++End;
+                }
+                if (End - Start > 1)
+                {
+                    std::vector<std::size_t> Split;
+                    for (std::size_t i = Start; i < End; ++i)
+                    {
+                        Split.push_back(Entries[i].second);
+                    }
+
+                    // The hash of a prefix which covers the whole file is
+                    // its content hash.
+                    if (!Prefix || Size <= this->m_Options.PrefixSize)
+                    {
+                        Completed.push_back(std::move(Split));
+                        CompletedHashes.push_back(Entries[Start].first);
+                    }
+                    else
+                    {
+                        Remaining.push_back(std::move(Split));
+                    }
+                }
+                Start = End;
+            }
+        }
+        Groups = std::move(Remaining);
+        return true;
+    };
+
+    bool Result = SplitGroups(true) && SplitGroups(false);
+
+    if (Result && this->m_Options.VerifyContents)
+    {
+        Mile::AsyncIoQueueOptions QueueOptions;
+        QueueOptions.QueueDepth = this->m_Options.QueueDepth;
+        QueueOptions.ChunkSize = this->m_Options.ChunkSize;
+        Mile::AsyncIoQueue Queue(QueueOptions);
+
+        for (std::vector<std::size_t>& Group : Completed)
+        {
+            std::vector<bool> Equal;
+            if (!this->VerifyFiles(Queue, Group, Equal))
+            {
+                Result = false;
+                break;
+            }
+            this->m_Statistics.VerifiedFiles += Group.size();
+
+            std::size_t Kept = 0;
+            for (std::size_t i = 0; i < Group.size(); ++i)
+            {
+                if (Equal[i])
+                {
+                    Group[Kept++] = Group[i];
+                }
+                else
+                {
+                    ++FailedFiles;
+                }
+            }
+            Group.resize(Kept);
+        }
+    }
+
+    this->m_Statistics.FailedFiles = FailedFiles;
+    if (!Result)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < Completed.size(); ++i)
+    {
+        if (Completed[i].size() < 2)
+        {
+            continue;
+        }
+
+        DuplicateSet Set;
+        Set.Size = this->m_Files[Completed[i][0]].Size;
+        Set.Hash = CompletedHashes[i];
+        Set.Files = std::move(Completed[i]);
+        for (std::size_t j = 1; j < Set.Files.size(); ++j)
+        {
+            DuplicateFile const& File = this->m_Files[Set.Files[j]];
+            Set.ReclaimableSize += File.AllocationSize
+                ? File.AllocationSize
+                : File.Size;
+        }
+
+        ++this->m_Statistics.DuplicateSets;
+        this->m_Statistics.DuplicateFiles += Set.Files.size() - 1;
+        this->m_Statistics.ReclaimableSize += Set.ReclaimableSize;
+        this->m_Sets.push_back(std::move(Set));
+    }
+
+    std::sort(this->m_Sets.begin(), this->m_Sets.end(), [&](
+        DuplicateSet const& Left,
+        DuplicateSet const& Right)
+    {
+        if (Left.ReclaimableSize != Right.ReclaimableSize)
+        {
+            return Left.ReclaimableSize > Right.ReclaimableSize;
+        }
+        return IsPathLess(Left.Files[0], Right.Files[0]);
+    });
+
+    return true;
+}
+
+void NSudoSweeper::DuplicateFinder::Cancel() noexcept
+{
+    this->m_Canceled.store(true);
+}
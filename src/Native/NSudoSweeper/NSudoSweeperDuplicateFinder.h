@@ -0,0 +1,270 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateFinder.h
+ * PURPOSE:   Definition for the content-hash duplicate file finder
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_DUPLICATE_FINDER
+#define NSUDO_SWEEPER_DUPLICATE_FINDER
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.AsyncIo.h>
+#include <Mile.Portable.Hash.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * A file the duplicate finder compares.
+     */
+    struct DuplicateFile
+    {
+        Mile::NativeString Path;
+        std::uint64_t Size = 0;
+        std::uint64_t AllocationSize = 0;
+
+        /**
+         * The file ID of the file, or 0 if it is not known. The files with
+         * the same file ID and size are links to the same data, so only the
+         * first of them is compared.
+         */
+        std::uint64_t FileId = 0;
+    };
+
+    /**
+     * A set of files with the same content.
+     */
+    struct DuplicateSet
+    {
+        /**
+         * The size of each file, in bytes.
+         */
+        std::uint64_t Size = 0;
+
+        /**
+         * The content hash of the files.
+         */
+        Mile::Hash128 Hash = {};
+
+        /**
+         * The indexes of the files in DuplicateFinder::GetFiles, ordered by
+         * their paths. The first file is the one to keep.
+         */
+        std::vector<std::size_t> Files;
+
+        /**
+         * The size the other files occupy on the volume, in bytes, which is
+         * freed if they are removed or replaced with hard links to the first
+         * file.
+         */
+        std::uint64_t ReclaimableSize = 0;
+    };
+
+    /**
+     * The options of the duplicate finder.
+     */
+    struct DuplicateFinderOptions
+    {
+        /**
+         * The files smaller than this size are not compared. It is at least
+         * 1, because empty files have nothing to reclaim.
+         */
+        std::uint64_t MinimumSize = 1;
+
+        /**
+         * The size of the prefix which is hashed first, in bytes. At most
+         * ChunkSize bytes are used.
+         */
+        std::size_t PrefixSize = 4096;
+
+        /**
+         * The size of each read, in bytes. The chunks of a file are hashed
+         * in parallel.
+         */
+        std::size_t ChunkSize = 1024 * 1024;
+
+        /**
+         * The number of reads in flight, which is also the number of chunk
+         * buffers.
+         */
+        std::size_t QueueDepth = 16;
+
+        /**
+         * Compares the files of each set with the first one byte by byte
+         * after their hashes match, and drops the files which differ. Use
+         * it before removing anything.
+         */
+        bool VerifyContents = false;
+    };
+
+    /**
+     * The statistics of the duplicate finder.
+     */
+    struct DuplicateFinderStatistics
+    {
+        std::uint64_t Files = 0;
+
+        /**
+         * The number of files skipped because an earlier file has the same
+         * file ID and size.
+         */
+        std::uint64_t LinkedFiles = 0;
+
+        /**
+         * The number of files which share their size with another file,
+         * and how many of them needed a hash of the prefix and of the whole
+         * content.
+         */
+        std::uint64_t SizeCollisions = 0;
+        std::uint64_t PrefixHashedFiles = 0;
+        std::uint64_t FullHashedFiles = 0;
+        std::uint64_t VerifiedFiles = 0;
+
+        /**
+         * The number of files which cannot be read or have changed since
+         * they were added, including the files which differ from the first
+         * file of their set when the contents are verified.
+         */
+        std::uint64_t FailedFiles = 0;
+
+        std::uint64_t BytesRead = 0;
+
+        std::uint64_t DuplicateSets = 0;
+        std::uint64_t DuplicateFiles = 0;
+        std::uint64_t ReclaimableSize = 0;
+    };
+
+    /**
+     * A handler called while the duplicate finder reads, from the thread
+     * which calls Find.
+     *
+     * @param BytesRead The number of bytes read so far.
+     * @param BytesPlanned The number of bytes the finder plans to read so
+     *                     far. It grows when a stage starts.
+     */
+    typedef std::function<void(
+        std::uint64_t BytesRead,
+        std::uint64_t BytesPlanned)> DuplicateFinderProgressHandler;
+
+    /**
+     * Finds the files with the same content. The files are grouped by size
+     * first, the groups are split by a hash of the first PrefixSize bytes,
+     * and only the files which still collide are hashed completely, so most
+     * files are never read or only read partially.
+     *
+     * The content hash of a file is a hash of the hashes of its ChunkSize
+     * chunks, which are read through an asynchronous I/O queue and hashed
+     * in parallel on the thread pool.
+     */
+    class DuplicateFinder : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        DuplicateFinderOptions m_Options;
+        DuplicateFinderProgressHandler m_ProgressHandler;
+
+        std::vector<DuplicateFile> m_Files;
+        std::vector<DuplicateSet> m_Sets;
+
+        std::atomic<bool> m_Canceled{ false };
+        DuplicateFinderStatistics m_Statistics;
+        std::uint64_t m_BytesPlanned = 0;
+
+        void ReportProgress();
+
+        bool HashFiles(
+            Mile::AsyncIoQueue& Queue,
+            std::vector<std::size_t> const& Files,
+            bool Prefix,
+            std::vector<Mile::Hash128>& Hashes,
+            std::vector<bool>& Succeeded);
+
+        bool VerifyFiles(
+            Mile::AsyncIoQueue& Queue,
+            std::vector<std::size_t> const& Files,
+            std::vector<bool>& Equal);
+
+    public:
+
+        /**
+         * Creates the duplicate finder.
+         *
+         * @param Options The options of the duplicate finder.
+         */
+        explicit DuplicateFinder(
+            DuplicateFinderOptions const& Options = DuplicateFinderOptions());
+
+        /**
+         * Adds a file to compare.
+         *
+         * @param File The file.
+         */
+        void Add(
+            DuplicateFile&& File);
+
+        /**
+         * Sets the handler which receives the progress.
+         *
+         * @param Handler The handler.
+         */
+        void SetProgressHandler(
+            DuplicateFinderProgressHandler Handler);
+
+        /**
+         * Compares the files added and finds the sets of duplicates, the
+         * largest reclaimable size first.
+         *
+         * @return true if completed, or false if canceled.
+         * @remark The progress handler may throw, which stops the finder,
+         *         and the exception is rethrown.
+         */
+        bool Find();
+
+        /**
+         * Cancels Find. It can be called from any thread, including the
+         * progress handler.
+         */
+        void Cancel() noexcept;
+
+        /**
+         * Retrieves the files added.
+         *
+         * @return The files.
+         */
+        std::vector<DuplicateFile> const& GetFiles() const noexcept
+        {
+            return this->m_Files;
+        }
+
+        /**
+         * Retrieves the sets of duplicates the last Find found.
+         *
+         * @return The sets of duplicates.
+         */
+        std::vector<DuplicateSet> const& GetSets() const noexcept
+        {
+            return this->m_Sets;
+        }
+
+        /**
+         * Retrieves the statistics of the last Find.
+         *
+         * @return The statistics.
+         */
+        DuplicateFinderStatistics GetStatistics() const noexcept
+        {
+            return this->m_Statistics;
+        }
+    };
+}
+
+#endif // !NSUDO_SWEEPER_DUPLICATE_FINDER
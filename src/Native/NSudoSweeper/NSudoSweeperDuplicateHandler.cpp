@@ -0,0 +1,758 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateHandler.cpp
+ * PURPOSE:   Implementation for the duplicate file cleanup handler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperDuplicateHandler.h"
+
+#include "NSudoSweeperDuplicateFinder.h"
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperProgress.h"
+#include "NSudoSweeperStandardHandler.h"
+#include "NSudoSweeperToml.h"
+
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const std::uint32_t DefaultBatchSize = 256;
+
+    /**
+     * The progress the scan of the candidates reports, out of 100. The
+     * comparison reports the rest.
+     */
+    const std::uint32_t CollectProgress = 50;
+
+    /**
+     * Checks whether a file still has the size and the file ID it had when
+     * it was compared.
+     */
+    bool IsUnchanged(
+        NSudoSweeper::DuplicateFile const& File,
+        NSudoSweeper::FileState const& State) noexcept
+    {
+        return State.Size == File.Size &&
+            (!File.FileId || State.FileId == File.FileId);
+    }
+
+    /**
+     * Replaces a file with a hard link to another file. The link is created
+     * with a temporary name next to the file and renamed over it, so the
+     * file is never missing.
+     *
+     * @return 0 if successful, otherwise the system error code.
+     */
+    int ReplaceWithHardLink(
+        Mile::NativeString const& Path,
+        Mile::NativeString const& Target)
+    {
+        Mile::NativeString TemporaryPath(Path);
+#if defined(_WIN32)
+        TemporaryPath.append(L".NSudoSweeper.tmp");
+
+        if (!::CreateHardLinkW(
+            TemporaryPath.c_str(),
+            Target.c_str(),
+            nullptr))
+        {
+            return static_cast<int>(::GetLastError());
+        }
+
+        if (!::MoveFileExW(
+            TemporaryPath.c_str(),
+            Path.c_str(),
+            MOVEFILE_REPLACE_EXISTING))
+        {
+            DWORD Error = ::GetLastError();
+            ::DeleteFileW(TemporaryPath.c_str());
+            return static_cast<int>(Error);
+        }
+#else
+        TemporaryPath.append(".NSudoSweeper.tmp");
+
+        if (-1 == ::link(Target.c_str(), TemporaryPath.c_str()))
+        {
+            return errno;
+        }
+
+        if (-1 == std::rename(TemporaryPath.c_str(), Path.c_str()))
+        {
+            int Error = errno;
+            ::unlink(TemporaryPath.c_str());
+            return Error;
+        }
+#endif
+        return 0;
+    }
+
+    /**
+     * A batch of duplicates with the files they are compared with. The
+     * paths belong to the duplicate finder.
+     */
+    class DuplicateBatch
+    {
+    private:
+
+        std::vector<NSUDO_SWEEPER_ITEM> m_Items;
+        std::vector<NSudoSweeper::DuplicateFile const*> m_Files;
+        std::vector<NSudoSweeper::DuplicateFile const*> m_KeptFiles;
+        std::uint64_t m_FirstIndex = 0;
+
+    public:
+
+        explicit DuplicateBatch(
+            std::uint32_t Capacity)
+        {
+            this->m_Items.reserve(Capacity);
+            this->m_Files.reserve(Capacity);
+            this->m_KeptFiles.reserve(Capacity);
+        }
+
+        bool IsFull() const noexcept
+        {
+            return this->m_Items.size() == this->m_Items.capacity();
+        }
+
+        std::size_t GetCount() const noexcept
+        {
+            return this->m_Items.size();
+        }
+
+        std::uint64_t GetFirstIndex() const noexcept
+        {
+            return this->m_FirstIndex;
+        }
+
+        NSudoSweeper::DuplicateFile const& GetFile(
+            std::size_t Index) const noexcept
+        {
+            return *this->m_Files[Index];
+        }
+
+        NSudoSweeper::DuplicateFile const& GetKeptFile(
+            std::size_t Index) const noexcept
+        {
+            return *this->m_KeptFiles[Index];
+        }
+
+        void Add(
+            NSudoSweeper::DuplicateFile const& File,
+            NSudoSweeper::DuplicateFile const& KeptFile)
+        {
+            NSUDO_SWEEPER_ITEM Item;
+            Item.Path = File.Path.c_str();
+            Item.PathLength = static_cast<std::uint32_t>(File.Path.size());
+            Item.Reason = NSUDO_SWEEPER_REASON_HANDLER;
+            Item.Size = File.Size;
+            Item.AllocationSize = File.AllocationSize;
+            Item.FileId = File.FileId;
+            this->m_Items.push_back(Item);
+            this->m_Files.push_back(&File);
+            this->m_KeptFiles.push_back(&KeptFile);
+        }
+
+        bool Send(
+            NSudoSweeper::CallbackChannel& Channel)
+        {
+            NSUDO_SWEEPER_ITEM_BATCH Batch;
+            Batch.Items = this->m_Items.data();
+            Batch.Count = static_cast<std::uint32_t>(this->m_Items.size());
+            Batch.Reserved = 0;
+            Batch.FirstIndex = this->m_FirstIndex;
+            return Channel.Send(NSUDO_SWEEPER_ITEM_BATCH_MESSAGE, &Batch);
+        }
+
+        void Clear() noexcept
+        {
+            this->m_FirstIndex += this->m_Items.size();
+            this->m_Items.clear();
+            this->m_Files.clear();
+            this->m_KeptFiles.clear();
+        }
+    };
+
+    class DuplicateHandler
+    {
+    private:
+
+        NSUDO_SWEEPER_HANDLER_REQUEST const& m_Request;
+        NSUDO_SWEEPER_HANDLER_SUMMARY& m_Summary;
+        NSudoSweeper::CallbackChannel m_Channel;
+        std::uint32_t m_BatchSize;
+
+        std::uint64_t m_MinimumSize = 1;
+        bool m_ReplaceWithHardLinks = false;
+
+        NSudoSweeper::DuplicateFinder* m_Finder = nullptr;
+
+        /**
+         * The sizes of the items a clean removes. Only the candidates with
+         * these sizes can be duplicates of them.
+         */
+        bool m_RestrictSizes = false;
+        std::unordered_set<std::uint64_t> m_CleanSizes;
+
+        bool ParseOptions()
+        {
+            // The nodes point into the source.
+            std::string Source =
+                NSudoSweeper::ToUtf8String(this->m_Request.Configuration);
+            NSudoSweeper::TomlDocument Document;
+            NSudoSweeper::TomlParseError Error;
+            if (!Document.Parse(Source, Error))
+            {
+                return false;
+            }
+
+            NSudoSweeper::TomlNode const* Configuration =
+                Document.GetChild(Document.GetRoot(), "Configuration");
+            if (!Configuration)
+            {
+                return false;
+            }
+
+            NSudoSweeper::TomlNode const* MinimumSize =
+                Document.GetChild(Configuration, "MinimumSize");
+            if (MinimumSize)
+            {
+                if (MinimumSize->Type != NSudoSweeper::TomlType::Integer ||
+                    MinimumSize->Integer < 0)
+                {
+                    return false;
+                }
+                this->m_MinimumSize =
+                    static_cast<std::uint64_t>(MinimumSize->Integer);
+            }
+
+            NSudoSweeper::TomlNode const* ReplaceWithHardLinks =
+                Document.GetChild(Configuration, "ReplaceWithHardLinks");
+            if (ReplaceWithHardLinks)
+            {
+                if (ReplaceWithHardLinks->Type !=
+                    NSudoSweeper::TomlType::Boolean)
+                {
+                    return false;
+                }
+                this->m_ReplaceWithHardLinks = ReplaceWithHardLinks->Boolean;
+            }
+
+            return true;
+        }
+
+        NSUDO_SWEEPER_RESULT AddCandidates(
+            NSUDO_SWEEPER_ITEM_BATCH const& Batch)
+        {
+            for (std::uint32_t i = 0; i < Batch.Count; ++i)
+            {
+                NSUDO_SWEEPER_ITEM const& Item = Batch.Items[i];
+                if (Item.Size < this->m_MinimumSize ||
+                    (this->m_RestrictSizes &&
+                        !this->m_CleanSizes.count(Item.Size)))
+                {
+                    continue;
+                }
+
+                NSudoSweeper::DuplicateFile File;
+                File.Path.assign(Item.Path, Item.PathLength);
+                File.Size = Item.Size;
+                File.AllocationSize = Item.AllocationSize;
+                File.FileId = Item.FileId;
+                this->m_Finder->Add(std::move(File));
+            }
+            return NSUDO_SWEEPER_S_OK;
+        }
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API CollectCallback(
+            uint32_t Message,
+            void* Parameter,
+            void* UserData)
+        {
+            DuplicateHandler* Handler =
+                reinterpret_cast<DuplicateHandler*>(UserData);
+
+            // No exception may cross the interface.
+            try
+            {
+                if (Message == NSUDO_SWEEPER_PROGRESS_MESSAGE)
+                {
+                    std::uint32_t Progress =
+                        *reinterpret_cast<std::uint32_t*>(Parameter);
+                    Handler->m_Channel.SendProgress(
+                        Progress * CollectProgress / 100);
+                    return Handler->m_Channel.GetResult();
+                }
+                else if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+                {
+                    return Handler->AddCandidates(
+                        *reinterpret_cast<NSUDO_SWEEPER_ITEM_BATCH*>(
+                            Parameter));
+                }
+            }
+            catch (std::bad_alloc const&)
+            {
+                return NSUDO_SWEEPER_E_OUTOFMEMORY;
+            }
+            catch (...)
+            {
+                return NSUDO_SWEEPER_E_FAIL;
+            }
+
+            return NSUDO_SWEEPER_S_OK;
+        }
+
+        /**
+         * Collects the files the standard cleanup handler selects with the
+         * same configuration file.
+         */
+        NSUDO_SWEEPER_RESULT Collect()
+        {
+            NSUDO_SWEEPER_HANDLER_REQUEST Request = this->m_Request;
+            Request.Phase = NSUDO_SWEEPER_PHASE_SCAN;
+            Request.Callback = DuplicateHandler::CollectCallback;
+            Request.UserData = this;
+            Request.CleanItems = nullptr;
+            Request.CleanItemCount = 0;
+            Request.Flags &= ~NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+            return ::NSudoSweeperStandardCleanupHandlerV2(&Request, nullptr);
+        }
+
+        /**
+         * Sends a published progress of the comparison. The final one is
+         * always sent, the others only if nothing else has been sent for the
+         * interval.
+         */
+        bool SendProgress(
+            NSudoSweeper::ProgressSnapshot const& Snapshot)
+        {
+            std::uint32_t Progress = CollectProgress +
+                Snapshot.Percentage * (100 - CollectProgress) / 100;
+            return Snapshot.Completed
+                ? this->m_Channel.SendProgress(Progress)
+                : this->m_Channel.SendProgressIfIdle(Progress);
+        }
+
+        /**
+         * Removes a duplicate, or replaces it with a hard link to the file
+         * which is kept, if neither has changed since they were compared.
+         */
+        void RemoveDuplicate(
+            NSudoSweeper::DuplicateFile const& File,
+            NSudoSweeper::DuplicateFile const& KeptFile,
+            NSUDO_SWEEPER_CLEAN_RESULT& Result)
+        {
+            NSudoSweeper::FileState State;
+            NSudoSweeper::FileState KeptState;
+            int Error = NSudoSweeper::QueryFileState(File.Path, State);
+            if (Error)
+            {
+                Result.Result = NSudoSweeper::IsNotFoundError(Error)
+                    ? NSUDO_SWEEPER_E_ITEM_NOT_FOUND
+                    : NSUDO_SWEEPER_E_FAIL;
+                Result.SystemError = Error;
+            }
+            else if (!::IsUnchanged(File, State) ||
+                NSudoSweeper::QueryFileState(KeptFile.Path, KeptState) ||
+                !::IsUnchanged(KeptFile, KeptState))
+            {
+                // Never remove the last copy.
+                Result.Result = NSUDO_SWEEPER_E_ITEM_CHANGED;
+            }
+            else
+            {
+                Error = this->m_ReplaceWithHardLinks
+                    ? ::ReplaceWithHardLink(File.Path, KeptFile.Path)
+                    : NSudoSweeper::RemoveFile(File.Path);
+                if (Error)
+                {
+                    Result.Result = NSudoSweeper::IsNotFoundError(Error)
+                        ? NSUDO_SWEEPER_E_ITEM_NOT_FOUND
+                        : NSUDO_SWEEPER_E_FAIL;
+                    Result.SystemError = Error;
+                }
+            }
+
+            if (Result.Result != NSUDO_SWEEPER_S_OK)
+            {
+                ++this->m_Summary.FailedItemCount;
+                return;
+            }
+
+            Result.FreedSize = State.AllocationSize
+                ? State.AllocationSize
+                : State.Size;
+            this->m_Summary.FreedSize += Result.FreedSize;
+        }
+
+        bool SendItems(
+            DuplicateBatch& Items,
+            NSudoSweeper::ResultBatch& Results,
+            bool Remove)
+        {
+            if (!Items.GetCount())
+            {
+                return true;
+            }
+
+            if (!Items.Send(this->m_Channel))
+            {
+                return false;
+            }
+
+            if (Remove)
+            {
+                for (std::size_t i = 0; i < Items.GetCount(); ++i)
+                {
+                    NSUDO_SWEEPER_CLEAN_RESULT Result;
+                    Result.Index = Items.GetFirstIndex() + i;
+                    Result.Result = NSUDO_SWEEPER_S_OK;
+                    Result.SystemError = 0;
+                    Result.FreedSize = 0;
+                    this->RemoveDuplicate(
+                        Items.GetFile(i),
+                        Items.GetKeptFile(i),
+                        Result);
+                    if (!Results.Add(this->m_Channel, Result))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            Items.Clear();
+            return true;
+        }
+
+        /**
+         * Reports the sets of duplicates and their items, and removes the
+         * items for a clean.
+         */
+        NSUDO_SWEEPER_RESULT Report(
+            NSudoSweeper::DuplicateFinder const& Finder,
+            bool Remove)
+        {
+            std::vector<NSudoSweeper::DuplicateFile> const& Files =
+                Finder.GetFiles();
+
+            DuplicateBatch Items(this->m_BatchSize);
+            NSudoSweeper::ResultBatch Results(this->m_BatchSize);
+            std::uint64_t NextIndex = 0;
+
+            for (NSudoSweeper::DuplicateSet const& Set : Finder.GetSets())
+            {
+                NSudoSweeper::DuplicateFile const& KeptFile =
+                    Files[Set.Files.front()];
+
+                NSUDO_SWEEPER_DUPLICATE_SET Message;
+                Message.KeptPath = KeptFile.Path.c_str();
+                Message.KeptPathLength =
+                    static_cast<std::uint32_t>(KeptFile.Path.size());
+                Message.Reserved = 0;
+                Message.FirstIndex = NextIndex;
+                Message.Count = Set.Files.size() - 1;
+                Message.Size = Set.Size;
+                Message.ReclaimableSize = Set.ReclaimableSize;
+                if (!this->m_Channel.Send(
+                    NSUDO_SWEEPER_DUPLICATE_SET_MESSAGE,
+                    &Message))
+                {
+                    return this->m_Channel.GetResult();
+                }
+
+                for (std::size_t i = 1; i < Set.Files.size(); ++i)
+                {
+                    NSudoSweeper::DuplicateFile const& File =
+                        Files[Set.Files[i]];
+                    ++this->m_Summary.ItemCount;
+                    this->m_Summary.TotalSize += File.Size;
+                    this->m_Summary.TotalAllocationSize += File.AllocationSize;
+
+                    Items.Add(File, KeptFile);
+                    if (Items.IsFull() &&
+                        !this->SendItems(Items, Results, Remove))
+                    {
+                        return this->m_Channel.GetResult();
+                    }
+                }
+                NextIndex += Message.Count;
+            }
+
+            if (this->SendItems(Items, Results, Remove))
+            {
+                Results.Send(this->m_Channel);
+            }
+
+            return this->m_Channel.GetResult();
+        }
+
+        /**
+         * Removes the items the caller passes which are still duplicates of
+         * another file.
+         */
+        NSUDO_SWEEPER_RESULT Clean(
+            NSudoSweeper::DuplicateFinder const& Finder)
+        {
+            std::vector<NSudoSweeper::DuplicateFile> const& Files =
+                Finder.GetFiles();
+
+            // The files which are kept and the files which are not
+            // duplicates map to nullptr.
+            std::unordered_map<
+                Mile::NativeString,
+                std::pair<std::size_t, NSudoSweeper::DuplicateFile const*>>
+                Candidates;
+            Candidates.reserve(Files.size());
+            for (std::size_t i = 0; i < Files.size(); ++i)
+            {
+                Candidates.emplace(Files[i].Path, std::make_pair(i, nullptr));
+            }
+            for (NSudoSweeper::DuplicateSet const& Set : Finder.GetSets())
+            {
+                NSudoSweeper::DuplicateFile const* KeptFile =
+                    &Files[Set.Files.front()];
+                for (std::size_t i = 1; i < Set.Files.size(); ++i)
+                {
+                    Candidates[Files[Set.Files[i]].Path].second = KeptFile;
+                }
+            }
+
+            NSudoSweeper::ResultBatch Results(this->m_BatchSize);
+
+            std::uint64_t Count = this->m_Request.CleanItemCount;
+            for (std::uint64_t i = 0; i < Count; ++i)
+            {
+                NSUDO_SWEEPER_ITEM const& Item = this->m_Request.CleanItems[i];
+
+                NSUDO_SWEEPER_CLEAN_RESULT Result;
+                Result.Index = i;
+                Result.Result = NSUDO_SWEEPER_S_OK;
+                Result.SystemError = 0;
+                Result.FreedSize = 0;
+
+                ++this->m_Summary.ItemCount;
+                if (!Item.Path)
+                {
+                    Result.Result = NSUDO_SWEEPER_E_INVALIDARG;
+                    ++this->m_Summary.FailedItemCount;
+                }
+                else
+                {
+                    Mile::NativeString Path(Item.Path, Item.PathLength);
+                    auto Candidate = Candidates.find(Path);
+                    NSudoSweeper::FileState State;
+                    if (Candidate == Candidates.end())
+                    {
+                        // Never remove what the configuration does not
+                        // select, whatever the caller passes.
+                        int Error = NSudoSweeper::QueryFileState(Path, State);
+                        if (Error)
+                        {
+                            Result.Result = NSudoSweeper::IsNotFoundError(Error)
+                                ? NSUDO_SWEEPER_E_ITEM_NOT_FOUND
+                                : NSUDO_SWEEPER_E_FAIL;
+                            Result.SystemError = Error;
+                        }
+                        else
+                        {
+                            Result.Result = State.Size != Item.Size
+                                ? NSUDO_SWEEPER_E_ITEM_CHANGED
+                                : NSUDO_SWEEPER_E_ITEM_NOT_SELECTED;
+                        }
+                        ++this->m_Summary.FailedItemCount;
+                    }
+                    else
+                    {
+                        NSudoSweeper::DuplicateFile const& File =
+                            Files[Candidate->second.first];
+                        NSudoSweeper::DuplicateFile const* KeptFile =
+                            Candidate->second.second;
+                        if (!KeptFile ||
+                            File.Size != Item.Size ||
+                            (Item.FileId && Item.FileId != File.FileId))
+                        {
+                            Result.Result = NSUDO_SWEEPER_E_ITEM_CHANGED;
+                            ++this->m_Summary.FailedItemCount;
+                        }
+                        else
+                        {
+                            this->m_Summary.TotalSize += File.Size;
+                            this->m_Summary.TotalAllocationSize +=
+                                File.AllocationSize;
+                            this->RemoveDuplicate(File, *KeptFile, Result);
+
+                            // Another item with the same path is not a
+                            // duplicate any more.
+                            Candidate->second.second = nullptr;
+                        }
+                    }
+                }
+
+                if (!Results.Add(this->m_Channel, Result))
+                {
+                    return this->m_Channel.GetResult();
+                }
+            }
+
+            Results.Send(this->m_Channel);
+            return this->m_Channel.GetResult();
+        }
+
+    public:
+
+        DuplicateHandler(
+            NSUDO_SWEEPER_HANDLER_REQUEST const& Request,
+            NSUDO_SWEEPER_HANDLER_SUMMARY& Summary) :
+            m_Request(Request),
+            m_Summary(Summary),
+            m_Channel(Request.Callback, Request.UserData),
+            m_BatchSize(Request.MaximumBatchSize
+                ? Request.MaximumBatchSize
+                : DefaultBatchSize)
+        {
+        }
+
+        NSUDO_SWEEPER_RESULT Run()
+        {
+            if (!this->ParseOptions())
+            {
+                return NSUDO_SWEEPER_E_INVALIDARG;
+            }
+
+            if (this->m_Request.Phase == NSUDO_SWEEPER_PHASE_ESTIMATE)
+            {
+                return NSUDO_SWEEPER_E_NOTIMPL;
+            }
+
+            const bool Remove =
+                this->m_Request.Phase == NSUDO_SWEEPER_PHASE_CLEAN;
+            const bool Selected = (this->m_Request.Flags &
+                NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) != 0;
+            if (Remove && Selected)
+            {
+                this->m_RestrictSizes = true;
+                std::uint64_t Count = this->m_Request.CleanItemCount;
+                for (std::uint64_t i = 0; i < Count; ++i)
+                {
+                    this->m_CleanSizes.insert(
+                        this->m_Request.CleanItems[i].Size);
+                }
+            }
+
+            // A clean compares the contents instead of trusting the hashes.
+            NSudoSweeper::DuplicateFinderOptions Options;
+            Options.MinimumSize = this->m_MinimumSize;
+            Options.VerifyContents = Remove;
+            NSudoSweeper::DuplicateFinder Finder(Options);
+            this->m_Finder = &Finder;
+
+            NSUDO_SWEEPER_RESULT Result = this->Collect();
+            if (Result != NSUDO_SWEEPER_S_OK)
+            {
+                return Result;
+            }
+
+            NSudoSweeper::ProgressAggregatorOptions ProgressOptions;
+            ProgressOptions.Interval = NSudoSweeper::HandlerProgressInterval;
+            ProgressOptions.PublishUnchanged = true;
+            NSudoSweeper::ProgressAggregator Progress(ProgressOptions);
+
+            std::uint64_t LastBytesRead = 0;
+            Finder.SetProgressHandler([&Progress, &LastBytesRead](
+                std::uint64_t BytesRead,
+                std::uint64_t BytesPlanned)
+            {
+                Progress.SetTotalWork(BytesPlanned);
+                Progress.AddWork(BytesRead - LastBytesRead);
+                LastBytesRead = BytesRead;
+            });
+
+            Progress.Start([this, &Finder](
+                NSudoSweeper::ProgressSnapshot const& Snapshot)
+            {
+                if (!this->SendProgress(Snapshot))
+                {
+                    Finder.Cancel();
+                }
+            });
+
+            if (!Finder.Find())
+            {
+                return this->m_Channel.GetResult();
+            }
+
+            Result = (Remove && Selected)
+                ? this->Clean(Finder)
+                : this->Report(Finder, Remove);
+            if (Result == NSUDO_SWEEPER_S_OK)
+            {
+                Progress.Stop();
+            }
+
+            return this->m_Channel.GetResult();
+        }
+    };
+}
+
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeperDuplicateCleanupHandlerV2(
+    const NSUDO_SWEEPER_HANDLER_REQUEST* Request,
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary)
+{
+    if (!Request ||
+        Request->Size < sizeof(NSUDO_SWEEPER_HANDLER_REQUEST) ||
+        !Request->Configuration ||
+        !Request->Callback ||
+        Request->Phase > NSUDO_SWEEPER_PHASE_ESTIMATE ||
+        (Request->Flags & ~NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) ||
+        Request->Reserved ||
+        (Request->CleanItemCount && !Request->CleanItems) ||
+        (!(Request->Flags & NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) &&
+            (Request->CleanItems || Request->CleanItemCount)) ||
+        (Summary && Summary->Size < sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY)))
+    {
+        return NSUDO_SWEEPER_E_INVALIDARG;
+    }
+
+    NSUDO_SWEEPER_HANDLER_SUMMARY Totals = {};
+    Totals.Size = sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY);
+
+    NSUDO_SWEEPER_RESULT Result = NSUDO_SWEEPER_S_OK;
+
+    // No exception may cross the interface.
+    try
+    {
+        DuplicateHandler Handler(*Request, Totals);
+        Result = Handler.Run();
+    }
+    catch (std::bad_alloc const&)
+    {
+        Result = NSUDO_SWEEPER_E_OUTOFMEMORY;
+    }
+    catch (...)
+    {
+        Result = NSUDO_SWEEPER_E_FAIL;
+    }
+
+    if (Summary)
+    {
+        *Summary = Totals;
+    }
+
+    return Result;
+}
@@ -0,0 +1,54 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateHandler.h
+ * PURPOSE:   Definition for the duplicate file cleanup handler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_DUPLICATE_HANDLER
+#define NSUDO_SWEEPER_DUPLICATE_HANDLER
+
+#include "NSudoSweeperHandlerV2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The NSudo Sweeper duplicate cleanup handler, which removes the files with
+ * the same content as another file.
+ *
+ * The candidates are the files the standard cleanup handler selects with
+ * the same configuration file, so Detect, Include and Exclude rules work
+ * the same way. The candidates are grouped by size, the groups are split by
+ * a hash of the first bytes, and only the files which still collide are
+ * hashed completely. The file with the first path of each set is kept.
+ *
+ * A scan sends NSUDO_SWEEPER_DUPLICATE_SET_MESSAGE for each set, largest
+ * reclaimable size first, and reports the other files of the set as items.
+ * A clean compares the files byte by byte before it removes any of them,
+ * and replaces them with hard links to the kept file instead if the
+ * configuration file sets ReplaceWithHardLinks. Files smaller than the
+ * MinimumSize of the configuration file, in bytes, are not compared.
+ *
+ * An estimate is not supported, and the handler returns
+ * NSUDO_SWEEPER_E_NOTIMPL.
+ *
+ * @param Request The parameters of the handler.
+ * @param Summary A pointer to a structure that receives the totals. It can
+ *                be NULL.
+ * @return NSUDO_SWEEPER_S_OK if the handler succeeds, the value returned by
+ *         the callback if it cancels the handler, otherwise an error.
+ */
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeperDuplicateCleanupHandlerV2(
+    const NSUDO_SWEEPER_HANDLER_REQUEST* Request,
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !NSUDO_SWEEPER_DUPLICATE_HANDLER
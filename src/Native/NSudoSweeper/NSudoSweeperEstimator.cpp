@@ -0,0 +1,738 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperEstimator.cpp
+ * PURPOSE:   Implementation for the sampling freed size estimator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperEstimator.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <cmath>
+#include <deque>
+#include <map>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+struct NSudoSweeper::SizeEstimator::Directory
+{
+    Mile::NativeString Path;
+    std::uint32_t Depth;
+    std::uint32_t MaximumDepth;
+
+    /**
+     * The number of subdirectories of the parent.
+     */
+    std::uint32_t FanOut;
+};
+
+struct NSudoSweeper::SizeEstimator::Stratum
+{
+    /**
+     * The subtrees which are not counted exactly yet.
+     */
+    std::vector<Directory> Directories;
+
+    /**
+     * The number of subtrees which are not counted exactly. It includes the
+     * subtree Refine is counting.
+     */
+    std::size_t Remaining = 0;
+
+    /**
+     * The mean and the sum of squared deviations of the sampled sizes of a
+     * subtree, and the means of the sampled numbers of files and data
+     * sizes.
+     */
+    std::uint64_t Samples = 0;
+    double Mean = 0.0;
+    double SquaredDeviations = 0.0;
+    double FileMean = 0.0;
+    double DataSizeMean = 0.0;
+
+    /**
+     * The totals of the subtrees counted exactly.
+     */
+    std::uint64_t ExactSize = 0;
+    std::uint64_t ExactFiles = 0;
+    std::uint64_t ExactDataSize = 0;
+};
+
+struct NSudoSweeper::SizeEstimator::DirectoryContent
+{
+    std::uint64_t Size = 0;
+    std::uint64_t Files = 0;
+    std::uint64_t DataSize = 0;
+    std::vector<Directory> Subdirectories;
+};
+
+namespace
+{
+#if !defined(_WIN32)
+    /**
+     * Retrieves the type, the freed size and the data size of an entry,
+     * since the file system does not report them in the directory.
+     */
+    void QueryEntry(
+        Mile::NativeString const& Path,
+        Mile::FileEntryType& Type,
+        std::uint64_t& Size,
+        std::uint64_t& DataSize)
+    {
+        Size = 0;
+        DataSize = 0;
+
+        struct stat Status;
+        if (0 != ::lstat(Path.c_str(), &Status))
+        {
+            return;
+        }
+
+        if (Type == Mile::FileEntryType::Unknown)
+        {
+            if (S_ISREG(Status.st_mode))
+            {
+                Type = Mile::FileEntryType::File;
+            }
+            else if (S_ISDIR(Status.st_mode))
+            {
+                Type = Mile::FileEntryType::Directory;
+            }
+            else if (S_ISLNK(Status.st_mode))
+            {
+                Type = Mile::FileEntryType::Link;
+            }
+            else
+            {
+                Type = Mile::FileEntryType::Other;
+            }
+        }
+
+        std::uint64_t AllocationSize =
+            static_cast<std::uint64_t>(Status.st_blocks) * 512;
+        DataSize = static_cast<std::uint64_t>(Status.st_size);
+        Size = AllocationSize ? AllocationSize : DataSize;
+    }
+#endif
+
+    /**
+     * The number of samples each stratum needs before the sampling can stop
+     * for precision, so a few samples which agree by chance do not stop it.
+     */
+    const std::uint64_t MinimumStoppingSamples = 4;
+
+    /**
+     * Groups the fan-outs by their order of magnitude.
+     */
+    std::uint32_t GetFanOutClass(
+        std::uint32_t FanOut) noexcept
+    {
+        std::uint32_t Class = 0;
+        while (FanOut > 1)
+        {
+            FanOut >>= 1;
+            ++Class;
+        }
+        return Class;
+    }
+
+    /**
+     * Finds the z-score of a two-sided confidence level of the normal
+     * distribution.
+     */
+    double GetZScore(
+        double Confidence) noexcept
+    {
+        if (!(Confidence > 0.0))
+        {
+            return 0.0;
+        }
+        if (!(Confidence < 1.0))
+        {
+            Confidence = 0.999999;
+        }
+
+        double Low = 0.0;
+        double High = 10.0;
+        for (int i = 0; i < 64; ++i)
+        {
+            double Middle = (Low + High) / 2.0;
+            if (std::erfc(Middle / std::sqrt(2.0)) > 1.0 - Confidence)
+            {
+                Low = Middle;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+        return (Low + High) / 2.0;
+    }
+
+    std::uint64_t ToSize(
+        double Value) noexcept
+    {
+        if (!(Value > 0.0))
+        {
+            return 0;
+        }
+        if (Value >= 18446744073709551615.0)
+        {
+            return UINT64_MAX;
+        }
+        return static_cast<std::uint64_t>(Value + 0.5);
+    }
+}
+
+void NSudoSweeper::SizeEstimator::ReadDirectory(
+    Directory const& Current,
+    DirectoryContent& Content)
+{
+    Content.Size = 0;
+    Content.Files = 0;
+    Content.DataSize = 0;
+    Content.Subdirectories.clear();
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        ++this->m_Directories;
+    }
+
+    if (!this->m_Enumerator.Open(Current.Path))
+    {
+        return;
+    }
+
+    const bool CanDescend = Current.Depth < Current.MaximumDepth;
+
+    Mile::FileEnumeratorBatch EntryBatch;
+    while (this->m_Enumerator.NextBatch(EntryBatch))
+    {
+        for (Mile::FileEnumeratorEntry Entry : EntryBatch)
+        {
+            TreeWalkerFilterResult Decision = TreeWalkerFilterResult::Include;
+            for (TreeWalkerFilter const& Filter : this->m_Filters)
+            {
+                Decision = Filter(Current.Path, Entry, Current.Depth);
+                if (Decision != TreeWalkerFilterResult::Include)
+                {
+                    break;
+                }
+            }
+            if (Decision == TreeWalkerFilterResult::Prune)
+            {
+                continue;
+            }
+
+            Mile::FileEntryType Type = Entry.GetType();
+            if (Type == Mile::FileEntryType::Directory ||
+                Decision == TreeWalkerFilterResult::Include ||
+                Type == Mile::FileEntryType::Unknown)
+            {
+                Mile::NativeString Path = NSudoSweeper::JoinPath(
+                    Current.Path,
+                    Entry.GetName());
+
+                std::uint64_t Size = 0;
+                std::uint64_t DataSize = 0;
+#if defined(_WIN32)
+                DataSize = Entry.GetSize();
+                Size = Entry.GetAllocationSize();
+                if (!Size)
+                {
+                    Size = DataSize;
+                }
+#else
+                if (Type == Mile::FileEntryType::Unknown ||
+                    Decision == TreeWalkerFilterResult::Include)
+                {
+                    ::QueryEntry(Path, Type, Size, DataSize);
+                }
+#endif
+
+                if (Type == Mile::FileEntryType::Directory)
+                {
+                    if (CanDescend)
+                    {
+                        Content.Subdirectories.push_back(
+                            Directory{
+                                std::move(Path),
+                                Current.Depth + 1,
+                                Current.MaximumDepth,
+                                0 });
+                    }
+                }
+                else if (Decision == TreeWalkerFilterResult::Include)
+                {
+                    Content.Size += Size;
+                    Content.DataSize += DataSize;
+                    ++Content.Files;
+                }
+            }
+        }
+    }
+
+    this->m_Enumerator.Close();
+
+    std::uint32_t FanOut = static_cast<std::uint32_t>(
+        Content.Subdirectories.size());
+    for (Directory& Subdirectory : Content.Subdirectories)
+    {
+        Subdirectory.FanOut = FanOut;
+    }
+}
+
+void NSudoSweeper::SizeEstimator::Expand(
+    std::vector<TreeWalkerRoot> const& Roots,
+    std::chrono::steady_clock::time_point Deadline)
+{
+    std::deque<Directory> Pending;
+    for (TreeWalkerRoot const& Root : Roots)
+    {
+        Pending.push_back(Directory{ Root.Path, 0, Root.MaximumDepth, 1 });
+    }
+
+    // Breadth first, so the frontier is made of whole levels as far as the
+    // limits allow.
+    DirectoryContent Content;
+    std::size_t Expanded = 0;
+    while (!Pending.empty() &&
+        Expanded++ < this->m_Options.ExpansionLimit &&
+        !this->m_Canceled.load(std::memory_order_relaxed) &&
+        std::chrono::steady_clock::now() < Deadline)
+    {
+        Directory Current = std::move(Pending.front());
+        Pending.pop_front();
+
+        this->ReadDirectory(Current, Content);
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            this->m_ExactSize += Content.Size;
+            this->m_ExactFiles += Content.Files;
+            this->m_ExactDataSize += Content.DataSize;
+        }
+        for (Directory& Subdirectory : Content.Subdirectories)
+        {
+            Pending.push_back(std::move(Subdirectory));
+        }
+    }
+
+    std::map<std::pair<std::uint32_t, std::uint32_t>, std::size_t> Indexes;
+    std::vector<Stratum> Strata;
+    for (Directory& Current : Pending)
+    {
+        std::pair<std::uint32_t, std::uint32_t> Key(
+            Current.Depth,
+            ::GetFanOutClass(Current.FanOut));
+        auto Iterator = Indexes.find(Key);
+        if (Iterator == Indexes.end())
+        {
+            Iterator = Indexes.emplace(Key, Strata.size()).first;
+            Strata.emplace_back();
+        }
+
+        Stratum& Target = Strata[Iterator->second];
+        Target.Directories.push_back(std::move(Current));
+        ++Target.Remaining;
+    }
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    this->m_Strata = std::move(Strata);
+}
+
+void NSudoSweeper::SizeEstimator::Probe(
+    std::size_t Index)
+{
+    Stratum& Target = this->m_Strata[Index];
+
+    Directory Current = Target.Directories[std::uniform_int_distribution<
+        std::size_t>(0, Target.Directories.size() - 1)(this->m_Random)];
+
+    // Each level weights what it finds by the number of its siblings, so
+    // the sum is an unbiased estimate of the whole subtree.
+    double Weight = 1.0;
+    double Size = 0.0;
+    double Files = 0.0;
+    double DataSize = 0.0;
+    DirectoryContent Content;
+    for (;;)
+    {
+        this->ReadDirectory(Current, Content);
+        Size += Weight * static_cast<double>(Content.Size);
+        Files += Weight * static_cast<double>(Content.Files);
+        DataSize += Weight * static_cast<double>(Content.DataSize);
+
+        if (Content.Subdirectories.empty() ||
+            this->m_Canceled.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+
+        Weight *= static_cast<double>(Content.Subdirectories.size());
+        Current = std::move(Content.Subdirectories[
+            std::uniform_int_distribution<std::size_t>(
+                0,
+                Content.Subdirectories.size() - 1)(this->m_Random)]);
+    }
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    ++this->m_Probes;
+    ++Target.Samples;
+    double Delta = Size - Target.Mean;
+    Target.Mean += Delta / static_cast<double>(Target.Samples);
+    Target.SquaredDeviations += Delta * (Size - Target.Mean);
+    Target.FileMean +=
+        (Files - Target.FileMean) / static_cast<double>(Target.Samples);
+    Target.DataSizeMean +=
+        (DataSize - Target.DataSizeMean) /
+        static_cast<double>(Target.Samples);
+}
+
+std::size_t NSudoSweeper::SizeEstimator::SelectProbeStratum() const
+{
+    // Every stratum gets two samples first, the largest ones first, so each
+    // has a variance.
+    std::size_t Selected = SIZE_MAX;
+    for (std::size_t i = 0; i < this->m_Strata.size(); ++i)
+    {
+        Stratum const& Current = this->m_Strata[i];
+        if (Current.Remaining && Current.Samples < 2 &&
+            (Selected == SIZE_MAX ||
+                Current.Samples < this->m_Strata[Selected].Samples ||
+                (Current.Samples == this->m_Strata[Selected].Samples &&
+                    Current.Remaining > this->m_Strata[Selected].Remaining)))
+        {
+            Selected = i;
+        }
+    }
+    if (Selected != SIZE_MAX)
+    {
+        return Selected;
+    }
+
+    // Then the sample which reduces the variance of the total most. The
+    // variance of a stratum includes the pooled variance, so a stratum whose
+    // samples agree by chance, such as empty directories, is still sampled.
+    double PooledVariance = this->GetPooledVariance();
+    double Best = -1.0;
+    for (std::size_t i = 0; i < this->m_Strata.size(); ++i)
+    {
+        Stratum const& Current = this->m_Strata[i];
+        if (!Current.Remaining)
+        {
+            continue;
+        }
+
+        double Count = static_cast<double>(Current.Remaining);
+        double Samples = static_cast<double>(Current.Samples);
+        double Variance =
+            Current.SquaredDeviations / (Samples - 1.0) + PooledVariance;
+        double Reduction = Count * Count *
+            (Variance > 0.0 ? Variance : 1.0) / (Samples * (Samples + 1.0));
+        if (Reduction > Best)
+        {
+            Best = Reduction;
+            Selected = i;
+        }
+    }
+    return Selected;
+}
+
+double NSudoSweeper::SizeEstimator::GetPooledVariance() const
+{
+    double Variance = 0.0;
+    double Count = 0.0;
+    for (Stratum const& Current : this->m_Strata)
+    {
+        if (Current.Samples >= 2)
+        {
+            Variance += Current.SquaredDeviations /
+                (static_cast<double>(Current.Samples) - 1.0);
+            Count += 1.0;
+        }
+    }
+    return Count > 0.0 ? Variance / Count : 0.0;
+}
+
+bool NSudoSweeper::SizeEstimator::IsSampled(
+    std::uint64_t MinimumSamples) const
+{
+    for (Stratum const& Current : this->m_Strata)
+    {
+        if (Current.Remaining && Current.Samples < MinimumSamples)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t NSudoSweeper::SizeEstimator::SelectRefineStratum() const
+{
+    std::size_t Selected = SIZE_MAX;
+    double Best = -1.0;
+    for (std::size_t i = 0; i < this->m_Strata.size(); ++i)
+    {
+        Stratum const& Current = this->m_Strata[i];
+        if (Current.Directories.empty())
+        {
+            continue;
+        }
+
+        // The strata which are not sampled are the most uncertain. The
+        // mean counts too, since samples which agree by chance do not make
+        // a large stratum certain.
+        double Uncertainty = HUGE_VAL;
+        if (Current.Samples)
+        {
+            double Count = static_cast<double>(Current.Remaining);
+            double Samples = static_cast<double>(Current.Samples);
+            Uncertainty = Count * Count *
+                (Current.SquaredDeviations + Current.Mean * Current.Mean) /
+                (Samples * Samples);
+        }
+        if (Uncertainty > Best ||
+            (Uncertainty == Best &&
+                Current.Remaining > this->m_Strata[Selected].Remaining))
+        {
+            Best = Uncertainty;
+            Selected = i;
+        }
+    }
+    return Selected;
+}
+
+NSudoSweeper::SizeEstimate NSudoSweeper::SizeEstimator::GetEstimateLocked() const
+{
+    SizeEstimate Result;
+    Result.Probes = this->m_Probes;
+    Result.Directories = this->m_Directories;
+    Result.Strata = this->m_Strata.size();
+
+    // The strata with few samples borrow the variance of the others, so a
+    // stratum whose two samples are equal by chance is not taken as exact.
+    double PooledVariance = this->GetPooledVariance();
+    double SampleSum = 0.0;
+    double FileSum = 0.0;
+    double DataSizeSum = 0.0;
+    double SampleCount = 0.0;
+    for (Stratum const& Current : this->m_Strata)
+    {
+        double Samples = static_cast<double>(Current.Samples);
+        SampleSum += Current.Mean * Samples;
+        FileSum += Current.FileMean * Samples;
+        DataSizeSum += Current.DataSizeMean * Samples;
+        SampleCount += Samples;
+    }
+    double OverallMean = SampleCount > 0.0 ? SampleSum / SampleCount : 0.0;
+    double OverallFileMean =
+        SampleCount > 0.0 ? FileSum / SampleCount : 0.0;
+    double OverallDataSizeMean =
+        SampleCount > 0.0 ? DataSizeSum / SampleCount : 0.0;
+
+    double ExactSize = static_cast<double>(this->m_ExactSize);
+    double Size = ExactSize;
+    double Files = static_cast<double>(this->m_ExactFiles);
+    double DataSize = static_cast<double>(this->m_ExactDataSize);
+    double Variance = 0.0;
+    bool Exact = true;
+
+    for (Stratum const& Current : this->m_Strata)
+    {
+        ExactSize += static_cast<double>(Current.ExactSize);
+        Size += static_cast<double>(Current.ExactSize);
+        Files += static_cast<double>(Current.ExactFiles);
+        DataSize += static_cast<double>(Current.ExactDataSize);
+        if (!Current.Remaining)
+        {
+            continue;
+        }
+        Exact = false;
+
+        double Count = static_cast<double>(Current.Remaining);
+        if (Current.Samples)
+        {
+            double Samples = static_cast<double>(Current.Samples);
+            Size += Count * Current.Mean;
+            Files += Count * Current.FileMean;
+            DataSize += Count * Current.DataSizeMean;
+            Variance += Count * Count *
+                (Current.SquaredDeviations + PooledVariance) /
+                (Samples * Samples);
+        }
+        else
+        {
+            Size += Count * OverallMean;
+            Files += Count * OverallFileMean;
+            DataSize += Count * OverallDataSizeMean;
+            Variance += Count * Count *
+                (PooledVariance + OverallMean * OverallMean);
+        }
+    }
+
+    double HalfWidth = this->m_ZScore * std::sqrt(Variance);
+    double LowerBound = Size - HalfWidth;
+    if (LowerBound < ExactSize)
+    {
+        LowerBound = ExactSize;
+    }
+
+    Result.Size = ::ToSize(Size);
+    Result.LowerBound = ::ToSize(LowerBound);
+    Result.UpperBound = ::ToSize(Size + HalfWidth);
+    Result.DataSize = ::ToSize(DataSize);
+    Result.Files = ::ToSize(Files);
+    Result.ExactSize = ::ToSize(ExactSize);
+    Result.Exact = Exact;
+    return Result;
+}
+
+NSudoSweeper::SizeEstimator::SizeEstimator(
+    SizeEstimatorOptions const& Options) :
+    m_Options(Options),
+    m_ZScore(::GetZScore(Options.Confidence)),
+    m_Enumerator(Options.EnumeratorBufferSize)
+{
+    std::uint64_t Seed = this->m_Options.Seed;
+    if (!Seed)
+    {
+        std::random_device Device;
+        Seed = (static_cast<std::uint64_t>(Device()) << 32) | Device();
+    }
+    this->m_Random.seed(Seed);
+}
+
+NSudoSweeper::SizeEstimator::~SizeEstimator()
+{
+}
+
+void NSudoSweeper::SizeEstimator::AddFilter(
+    TreeWalkerFilter Filter)
+{
+    this->m_Filters.push_back(std::move(Filter));
+}
+
+bool NSudoSweeper::SizeEstimator::Estimate(
+    std::vector<TreeWalkerRoot> const& Roots,
+    std::chrono::milliseconds Budget)
+{
+    std::chrono::steady_clock::time_point Start =
+        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point Deadline = Start + Budget;
+
+    this->Expand(
+        Roots,
+        Start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            Budget * this->m_Options.FrontierShare));
+
+    while (!this->m_Canceled.load(std::memory_order_relaxed) &&
+        std::chrono::steady_clock::now() < Deadline)
+    {
+        std::size_t Index = this->SelectProbeStratum();
+        if (Index == SIZE_MAX)
+        {
+            break;
+        }
+
+        this->Probe(Index);
+
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        if (this->m_Options.TargetPrecision > 0.0 &&
+            this->IsSampled(MinimumStoppingSamples))
+        {
+            SizeEstimate Current = this->GetEstimateLocked();
+            if (static_cast<double>(Current.UpperBound - Current.Size) <=
+                this->m_Options.TargetPrecision *
+                static_cast<double>(Current.Size))
+            {
+                break;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->IsSampled(1);
+}
+
+bool NSudoSweeper::SizeEstimator::Refine(
+    std::chrono::milliseconds Budget)
+{
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() + Budget;
+
+    DirectoryContent Content;
+    do
+    {
+        if (this->m_RefineStack.empty())
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+            std::size_t Index = this->SelectRefineStratum();
+            if (Index == SIZE_MAX)
+            {
+                return true;
+            }
+
+            // A random subtree, so the sampled mean still applies to the
+            // subtrees which are left.
+            std::vector<Directory>& Directories =
+                this->m_Strata[Index].Directories;
+            std::swap(
+                Directories[std::uniform_int_distribution<std::size_t>(
+                    0,
+                    Directories.size() - 1)(this->m_Random)],
+                Directories.back());
+            this->m_RefineStack.push_back(std::move(Directories.back()));
+            Directories.pop_back();
+            this->m_RefineStratum = Index;
+        }
+
+        Directory Current = std::move(this->m_RefineStack.back());
+        this->m_RefineStack.pop_back();
+
+        this->ReadDirectory(Current, Content);
+        this->m_RefineSize += Content.Size;
+        this->m_RefineFiles += Content.Files;
+        this->m_RefineDataSize += Content.DataSize;
+        for (Directory& Subdirectory : Content.Subdirectories)
+        {
+            this->m_RefineStack.push_back(std::move(Subdirectory));
+        }
+
+        if (this->m_RefineStack.empty())
+        {
+            std::lock_guard<std::mutex> Lock(this->m_Mutex);
+            Stratum& Target = this->m_Strata[this->m_RefineStratum];
+            Target.ExactSize += this->m_RefineSize;
+            Target.ExactFiles += this->m_RefineFiles;
+            Target.ExactDataSize += this->m_RefineDataSize;
+            --Target.Remaining;
+            this->m_RefineSize = 0;
+            this->m_RefineFiles = 0;
+            this->m_RefineDataSize = 0;
+        }
+    } while (!this->m_Canceled.load(std::memory_order_relaxed) &&
+        std::chrono::steady_clock::now() < Deadline);
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_RefineStack.empty() &&
+        this->SelectRefineStratum() == SIZE_MAX;
+}
+
+void NSudoSweeper::SizeEstimator::Cancel() noexcept
+{
+    this->m_Canceled.store(true, std::memory_order_relaxed);
+}
+
+NSudoSweeper::SizeEstimate NSudoSweeper::SizeEstimator::GetEstimate() const
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->GetEstimateLocked();
+}
@@ -0,0 +1,245 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperEstimator.h
+ * PURPOSE:   Definition for the sampling freed size estimator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_ESTIMATOR
+#define NSUDO_SWEEPER_ESTIMATOR
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.FileEnumerator.h>
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The options of the size estimator.
+     */
+    struct SizeEstimatorOptions
+    {
+        /**
+         * The maximum number of directories at the top of the trees which
+         * are read breadth first before sampling. They are counted exactly,
+         * and the subtrees below them are grouped into the strata.
+         */
+        std::size_t ExpansionLimit = 4096;
+
+        /**
+         * The share of the time budget used to expand the top of the trees.
+         */
+        double FrontierShare = 0.25;
+
+        /**
+         * The confidence level of the interval, such as 0.95.
+         */
+        double Confidence = 0.95;
+
+        /**
+         * The sampling stops before the time budget when the half width of
+         * the interval is below this share of the estimate.
+         */
+        double TargetPrecision = 0.01;
+
+        /**
+         * The seed of the sampling, or 0 for a random seed.
+         */
+        std::uint64_t Seed = 0;
+
+        /**
+         * The size of the buffer of the file enumerator, in bytes.
+         */
+        std::size_t EnumeratorBufferSize =
+            Mile::FileEnumerator::DefaultBufferSize;
+    };
+
+    /**
+     * An estimate of the size a clean frees.
+     */
+    struct SizeEstimate
+    {
+        /**
+         * The estimated size, in bytes. The size of a file is its allocation
+         * size, or its size if the allocation size is not known, which is the
+         * size its removal frees.
+         */
+        std::uint64_t Size = 0;
+
+        /**
+         * The confidence interval of the size, in bytes. The lower bound is
+         * never below the size counted exactly.
+         */
+        std::uint64_t LowerBound = 0;
+        std::uint64_t UpperBound = 0;
+
+        /**
+         * The estimated sum of the sizes of the files, in bytes, which is
+         * their length rather than the space they occupy.
+         */
+        std::uint64_t DataSize = 0;
+
+        /**
+         * The estimated number of files.
+         */
+        std::uint64_t Files = 0;
+
+        /**
+         * The size counted exactly so far, in bytes.
+         */
+        std::uint64_t ExactSize = 0;
+
+        /**
+         * The number of random descents and of directories read.
+         */
+        std::uint64_t Probes = 0;
+        std::uint64_t Directories = 0;
+
+        /**
+         * The number of strata.
+         */
+        std::size_t Strata = 0;
+
+        /**
+         * Indicates every directory has been counted, so the size is exact.
+         */
+        bool Exact = false;
+    };
+
+    /**
+     * Estimates the size of the files selected by the filters without
+     * walking the whole trees. The top of the trees is expanded breadth
+     * first and counted exactly. The subtrees below it are grouped into
+     * strata by their depth and the fan-out of their parent, and each random
+     * descent picks a subtree of a stratum and follows one random
+     * subdirectory per level, weighting the files it finds by the product of
+     * the fan-outs on its path. The descents go to the strata whose variance
+     * they reduce most, and the interval comes from the variances of the
+     * strata. Refine then counts the subtrees exactly, the most uncertain
+     * first, so the estimate converges to the exact size.
+     */
+    class SizeEstimator : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Directory;
+        struct Stratum;
+        struct DirectoryContent;
+
+        SizeEstimatorOptions m_Options;
+        std::vector<TreeWalkerFilter> m_Filters;
+        double m_ZScore;
+        std::mt19937_64 m_Random;
+        Mile::FileEnumerator m_Enumerator;
+        std::atomic<bool> m_Canceled{ false };
+
+        mutable std::mutex m_Mutex;
+        std::vector<Stratum> m_Strata;
+        std::uint64_t m_ExactSize = 0;
+        std::uint64_t m_ExactFiles = 0;
+        std::uint64_t m_ExactDataSize = 0;
+        std::uint64_t m_Probes = 0;
+        std::uint64_t m_Directories = 0;
+
+        std::vector<Directory> m_RefineStack;
+        std::size_t m_RefineStratum = 0;
+        std::uint64_t m_RefineSize = 0;
+        std::uint64_t m_RefineFiles = 0;
+        std::uint64_t m_RefineDataSize = 0;
+
+        void ReadDirectory(
+            Directory const& Current,
+            DirectoryContent& Content);
+
+        void Expand(
+            std::vector<TreeWalkerRoot> const& Roots,
+            std::chrono::steady_clock::time_point Deadline);
+
+        void Probe(
+            std::size_t Index);
+
+        std::size_t SelectProbeStratum() const;
+
+        double GetPooledVariance() const;
+
+        bool IsSampled(
+            std::uint64_t MinimumSamples) const;
+
+        std::size_t SelectRefineStratum() const;
+
+        SizeEstimate GetEstimateLocked() const;
+
+    public:
+
+        /**
+         * Creates the estimator.
+         *
+         * @param Options The options of the estimator.
+         */
+        explicit SizeEstimator(
+            SizeEstimatorOptions const& Options = SizeEstimatorOptions());
+
+        ~SizeEstimator();
+
+        /**
+         * Adds a filter, with the same meaning as TreeWalker::AddFilter. The
+         * files the filters include are counted, and the directories they
+         * prune are not descended into.
+         *
+         * @param Filter The filter.
+         */
+        void AddFilter(
+            TreeWalkerFilter Filter);
+
+        /**
+         * Samples the trees until the time budget is used or the estimate is
+         * precise enough.
+         *
+         * @param Roots The root directories and their depth limits.
+         * @param Budget The time budget.
+         * @return true if an estimate is available, or false if it was
+         *         canceled before every stratum was sampled.
+         */
+        bool Estimate(
+            std::vector<TreeWalkerRoot> const& Roots,
+            std::chrono::milliseconds Budget);
+
+        /**
+         * Counts the sampled subtrees exactly, the most uncertain first,
+         * until the time budget is used. It can be called repeatedly, such
+         * as from a background thread, and continues where it stopped.
+         *
+         * @param Budget The time budget.
+         * @return true if the estimate is exact.
+         */
+        bool Refine(
+            std::chrono::milliseconds Budget);
+
+        /**
+         * Cancels Estimate and Refine. It can be called from any thread.
+         */
+        void Cancel() noexcept;
+
+        /**
+         * Retrieves the current estimate. It can be called from any thread,
+         * including while Refine runs.
+         *
+         * @return The current estimate.
+         */
+        SizeEstimate GetEstimate() const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_ESTIMATOR
@@ -0,0 +1,602 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerDescriptor.cpp
+ * PURPOSE:   Implementation for the cleanup handler descriptor and its cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperHandlerDescriptor.h"
+
+#include "NSudoSweeperToml.h"
+
+#include <Mile.Portable.MappedFile.h>
+
+#include <utility>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#endif
+
+namespace
+{
+    /**
+     * Converts a UTF-8 string to a native string.
+     */
+    Mile::NativeString ToNativeString(
+        std::string_view Utf8String)
+    {
+#if defined(_WIN32)
+        Mile::NativeString Result;
+        if (Utf8String.empty())
+        {
+            return Result;
+        }
+
+        int Length = ::MultiByteToWideChar(
+            CP_UTF8,
+            0,
+            Utf8String.data(),
+            static_cast<int>(Utf8String.size()),
+            nullptr,
+            0);
+        if (Length > 0)
+        {
+            Result.resize(static_cast<std::size_t>(Length));
+            Length = ::MultiByteToWideChar(
+                CP_UTF8,
+                0,
+                Utf8String.data(),
+                static_cast<int>(Utf8String.size()),
+                &Result[0],
+                Length);
+            Result.resize(static_cast<std::size_t>(Length));
+        }
+        return Result;
+#else
+        return Mile::NativeString(Utf8String);
+#endif
+    }
+
+    /**
+     * Computes the 64-bit FNV-1a hash of the content.
+     */
+    std::uint64_t HashContent(
+        std::string_view Content) noexcept
+    {
+        std::uint64_t Hash = 14695981039346656037ULL;
+        for (char Character : Content)
+        {
+            Hash ^= static_cast<unsigned char>(Character);
+            Hash *= 1099511628211ULL;
+        }
+        return Hash;
+    }
+
+    bool EqualsIgnoreAsciiCase(
+        std::string_view Left,
+        std::string_view Right) noexcept
+    {
+        if (Left.size() != Right.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < Left.size(); ++i)
+        {
+            char LeftCharacter = Left[i];
+            char RightCharacter = Right[i];
+            if (LeftCharacter >= 'A' && LeftCharacter <= 'Z')
+            {
+                LeftCharacter += 'a' - 'A';
+            }
+            if (RightCharacter >= 'A' && RightCharacter <= 'Z')
+            {
+                RightCharacter += 'a' - 'A';
+            }
+            if (LeftCharacter != RightCharacter)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Fail(
+        NSudoSweeper::HandlerDescriptorError& Error,
+        NSudoSweeper::TomlNode const* Node,
+        char const* Message) noexcept
+    {
+        Error.Line = Node ? Node->Line : 0;
+        Error.Column = Node ? 1 : 0;
+        Error.Message = Message;
+        return false;
+    }
+
+    bool GetString(
+        NSudoSweeper::TomlDocument const& Document,
+        NSudoSweeper::TomlNode const* Table,
+        std::string_view Key,
+        bool Required,
+        Mile::NativeString& Value,
+        NSudoSweeper::HandlerDescriptorError& Error)
+    {
+        NSudoSweeper::TomlNode const* Node = Document.GetChild(Table, Key);
+        if (!Node)
+        {
+            return Required
+                ? ::Fail(Error, Table, "A required key is missing")
+                : true;
+        }
+        if (Node->Type != NSudoSweeper::TomlType::String)
+        {
+            return ::Fail(Error, Node, "The value must be a string");
+        }
+
+        Value = ::ToNativeString(Node->String);
+        return true;
+    }
+
+    bool GetRules(
+        NSudoSweeper::TomlDocument const& Document,
+        NSudoSweeper::TomlNode const* Table,
+        std::string_view Key,
+        std::vector<NSudoSweeper::HandlerRule>& Rules,
+        NSudoSweeper::HandlerDescriptorError& Error)
+    {
+        NSudoSweeper::TomlNode const* List = Document.GetChild(Table, Key);
+        if (!List)
+        {
+            return true;
+        }
+        if (List->Type != NSudoSweeper::TomlType::Array)
+        {
+            return ::Fail(Error, List, "The value must be an array");
+        }
+
+        Rules.reserve(List->ChildCount);
+        for (NSudoSweeper::TomlNode const* Node = Document.GetFirstChild(List);
+            Node;
+            Node = Document.GetNextSibling(Node))
+        {
+            if (Node->Type != NSudoSweeper::TomlType::String)
+            {
+                return ::Fail(Error, Node, "A rule must be a string");
+            }
+
+            std::size_t Separator = Node->String.find('|');
+            if (Separator == std::string_view::npos)
+            {
+                return ::Fail(Error, Node, "A rule must be \"Type|Pattern\"");
+            }
+
+            std::string_view Type = Node->String.substr(0, Separator);
+            NSudoSweeper::HandlerRule Rule;
+            if (::EqualsIgnoreAsciiCase(Type, "File"))
+            {
+                Rule.Type = NSudoSweeper::HandlerRuleType::File;
+            }
+            else if (::EqualsIgnoreAsciiCase(Type, "Registry"))
+            {
+                Rule.Type = NSudoSweeper::HandlerRuleType::Registry;
+            }
+            else
+            {
+                return ::Fail(Error, Node, "Unknown rule type");
+            }
+            Rule.Pattern = ::ToNativeString(
+                Node->String.substr(Separator + 1));
+
+            Rules.push_back(std::move(Rule));
+        }
+
+        return true;
+    }
+}
+
+NSudoSweeper::HandlerLocalizedText const*
+NSudoSweeper::HandlerDescriptor::GetLocalizedText(
+    std::string_view Language) const noexcept
+{
+    HandlerLocalizedText const* English = nullptr;
+    for (HandlerLocalizedText const& Text : this->Metadata)
+    {
+        if (::EqualsIgnoreAsciiCase(Text.Language, Language))
+        {
+            return &Text;
+        }
+        if (!English && ::EqualsIgnoreAsciiCase(Text.Language, "en"))
+        {
+            English = &Text;
+        }
+    }
+
+    if (English)
+    {
+        return English;
+    }
+    return this->Metadata.empty() ? nullptr : &this->Metadata.front();
+}
+
+bool NSudoSweeper::ParseHandlerDescriptor(
+    std::string_view Content,
+    HandlerDescriptor& Descriptor,
+    HandlerDescriptorError& Error)
+{
+    Error = HandlerDescriptorError();
+    Descriptor = HandlerDescriptor();
+
+    TomlDocument Document;
+    TomlParseError ParseError;
+    if (!Document.Parse(Content, ParseError))
+    {
+        Error.Line = ParseError.Line;
+        Error.Column = ParseError.Column;
+        Error.Message = ParseError.Message;
+        return false;
+    }
+
+    TomlNode const* Root = Document.GetRoot();
+
+    // Other keys are left to the cleanup handler, which receives the whole
+    // file.
+    TomlNode const* Metadata = Document.GetChild(Root, "Metadata");
+    if (Metadata && Metadata->Type != TomlType::Table)
+    {
+        return ::Fail(Error, Metadata, "[Metadata] must be a table");
+    }
+    for (TomlNode const* Node = Document.GetFirstChild(Metadata);
+        Node;
+        Node = Document.GetNextSibling(Node))
+    {
+        if (Node->Type != TomlType::Table)
+        {
+            continue;
+        }
+
+        HandlerLocalizedText Text;
+        Text.Language = std::string(Node->Key);
+        if (!::GetString(Document, Node, "Name", false, Text.Name, Error) ||
+            !::GetString(
+                Document,
+                Node,
+                "Description",
+                false,
+                Text.Description,
+                Error))
+        {
+            return false;
+        }
+        Descriptor.Metadata.push_back(std::move(Text));
+    }
+
+    TomlNode const* Configuration =
+        Document.GetChild(Root, "Configuration");
+    if (!Configuration || Configuration->Type != TomlType::Table)
+    {
+        return ::Fail(
+            Error,
+            Configuration,
+            "[Configuration] must be a table");
+    }
+
+    if (!::GetString(
+        Document,
+        Configuration,
+        "Plugin",
+        true,
+        Descriptor.Plugin,
+        Error) ||
+        !::GetString(
+            Document,
+            Configuration,
+            "Handler",
+            true,
+            Descriptor.Handler,
+            Error))
+    {
+        return false;
+    }
+
+    TomlNode const* DetectOS = Document.GetChild(Configuration, "DetectOS");
+    if (DetectOS)
+    {
+        TomlNode const* Minimum = Document.GetChild(DetectOS, "Minimum");
+        TomlNode const* Maximum = Document.GetChild(DetectOS, "Maximum");
+        if (DetectOS->Type != TomlType::Table ||
+            (Minimum && Minimum->Type != TomlType::String) ||
+            (Maximum && Maximum->Type != TomlType::String))
+        {
+            return ::Fail(
+                Error,
+                DetectOS,
+                "DetectOS must be { Minimum = \"x.y\", Maximum = \"x.y\" }");
+        }
+
+        Descriptor.HasDetectOS = true;
+        Descriptor.MaximumOS.Major = UINT32_MAX;
+        Descriptor.MaximumOS.Minor = UINT32_MAX;
+        Descriptor.MaximumOS.Build = UINT32_MAX;
+        if ((Minimum && !NSudoSweeper::ParseHandlerVersion(
+            Minimum->String,
+            0,
+            Descriptor.MinimumOS)) ||
+            (Maximum && !NSudoSweeper::ParseHandlerVersion(
+                Maximum->String,
+                UINT32_MAX,
+                Descriptor.MaximumOS)))
+        {
+            return ::Fail(Error, DetectOS, "Invalid version");
+        }
+    }
+
+    TomlNode const* OfflineImageSupport =
+        Document.GetChild(Configuration, "OfflineImageSupport");
+    if (OfflineImageSupport)
+    {
+        if (OfflineImageSupport->Type != TomlType::Boolean)
+        {
+            return ::Fail(
+                Error,
+                OfflineImageSupport,
+                "The value must be a boolean");
+        }
+        Descriptor.OfflineImageSupport = OfflineImageSupport->Boolean;
+    }
+
+    if (!::GetRules(
+        Document,
+        Configuration,
+        "Detect",
+        Descriptor.Detect,
+        Error) ||
+        !::GetRules(
+            Document,
+            Configuration,
+            "Include",
+            Descriptor.Include,
+            Error) ||
+        !::GetRules(
+            Document,
+            Configuration,
+            "Exclude",
+            Descriptor.Exclude,
+            Error))
+    {
+        return false;
+    }
+
+    std::string_view Text = Content;
+    if (Text.substr(0, 3) == "\xEF\xBB\xBF")
+    {
+        Text.remove_prefix(3);
+    }
+    Descriptor.Configuration = ::ToNativeString(Text);
+    Descriptor.ContentHash = ::HashContent(Content);
+
+    return true;
+}
+
+bool NSudoSweeper::ParseHandlerVersion(
+    std::string_view Text,
+    std::uint32_t MissingPart,
+    HandlerVersion& Version) noexcept
+{
+    std::uint32_t* Parts[] =
+    {
+        &Version.Major,
+        &Version.Minor,
+        &Version.Build
+    };
+
+    std::size_t Part = 0;
+    bool HasDigit = false;
+    *Parts[0] = 0;
+    for (char Character : Text)
+    {
+        if (Character == '.')
+        {
+            if (!HasDigit || ++Part >= sizeof(Parts) / sizeof(*Parts))
+            {
+                return false;
+            }
+            *Parts[Part] = 0;
+            HasDigit = false;
+        }
+        else if (Character >= '0' && Character <= '9')
+        {
+            std::uint32_t& Value = *Parts[Part];
+            if (Value > (UINT32_MAX - 9) / 10)
+            {
+                return false;
+            }
+            Value = Value * 10 + static_cast<std::uint32_t>(
+                Character - '0');
+            HasDigit = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    for (std::size_t i = Part + 1; i < sizeof(Parts) / sizeof(*Parts); ++i)
+    {
+        *Parts[i] = MissingPart;
+    }
+
+    return HasDigit;
+}
+
+int NSudoSweeper::CompareHandlerVersion(
+    HandlerVersion const& Left,
+    HandlerVersion const& Right) noexcept
+{
+    std::uint32_t const LeftParts[] = { Left.Major, Left.Minor, Left.Build };
+    std::uint32_t const RightParts[] =
+    {
+        Right.Major,
+        Right.Minor,
+        Right.Build
+    };
+
+    for (std::size_t i = 0; i < sizeof(LeftParts) / sizeof(*LeftParts); ++i)
+    {
+        if (LeftParts[i] != RightParts[i])
+        {
+            return LeftParts[i] < RightParts[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool NSudoSweeper::IsHandlerVersionSupported(
+    HandlerDescriptor const& Descriptor,
+    HandlerVersion const& Version) noexcept
+{
+    if (!Descriptor.HasDetectOS)
+    {
+        return true;
+    }
+
+    return NSudoSweeper::CompareHandlerVersion(
+        Descriptor.MinimumOS,
+        Version) <= 0 && NSudoSweeper::CompareHandlerVersion(
+            Version,
+            Descriptor.MaximumOS) <= 0;
+}
+
+bool NSudoSweeper::GetCurrentHandlerVersion(
+    HandlerVersion& Version) noexcept
+{
+    Version = HandlerVersion();
+
+#if defined(_WIN32)
+    // GetVersionEx is affected by the manifest of the process, so the
+    // version is queried from ntdll.dll directly.
+    typedef LONG(WINAPI* RtlGetVersionType)(PRTL_OSVERSIONINFOW);
+
+    HMODULE ModuleHandle = ::GetModuleHandleW(L"ntdll.dll");
+    if (!ModuleHandle)
+    {
+        return false;
+    }
+
+    RtlGetVersionType RtlGetVersion = reinterpret_cast<RtlGetVersionType>(
+        ::GetProcAddress(ModuleHandle, "RtlGetVersion"));
+    if (!RtlGetVersion)
+    {
+        return false;
+    }
+
+    RTL_OSVERSIONINFOW Information = { 0 };
+    Information.dwOSVersionInfoSize = sizeof(Information);
+    if (RtlGetVersion(&Information) != 0)
+    {
+        return false;
+    }
+
+    Version.Major = Information.dwMajorVersion;
+    Version.Minor = Information.dwMinorVersion;
+    Version.Build = Information.dwBuildNumber;
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<NSudoSweeper::HandlerDescriptor const>
+NSudoSweeper::HandlerDescriptorCache::Load(
+    Mile::NativeString const& Path,
+    HandlerDescriptorError& Error)
+{
+    Mile::MappedFile File;
+    if (!File.Open(Path, Mile::MappedFileAccess::Sequential))
+    {
+        Error = HandlerDescriptorError();
+        Error.SystemError = File.GetLastErrorCode();
+        Error.Message = "The file cannot be read";
+        return nullptr;
+    }
+
+    return this->Parse(File.GetView(), Error);
+}
+
+std::shared_ptr<NSudoSweeper::HandlerDescriptor const>
+NSudoSweeper::HandlerDescriptorCache::Parse(
+    std::string_view Content,
+    HandlerDescriptorError& Error)
+{
+    Error = HandlerDescriptorError();
+
+    std::uint64_t Hash = ::HashContent(Content);
+
+    {
+        Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+        auto Iterator = this->m_Entries.find(Hash);
+        if (Iterator != this->m_Entries.end())
+        {
+            for (Entry const& Current : Iterator->second)
+            {
+                if (Current.Content == Content)
+                {
+                    ++this->m_Hits;
+                    return Current.Descriptor;
+                }
+            }
+        }
+
+        ++this->m_Misses;
+    }
+
+    // Parse without holding the lock, so files are parsed concurrently.
+    std::shared_ptr<HandlerDescriptor> Descriptor =
+        std::make_shared<HandlerDescriptor>();
+    if (!NSudoSweeper::ParseHandlerDescriptor(Content, *Descriptor, Error))
+    {
+        return nullptr;
+    }
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    std::vector<Entry>& Bucket = this->m_Entries[Hash];
+    for (Entry const& Current : Bucket)
+    {
+        if (Current.Content == Content)
+        {
+            // Another thread has parsed the same content.
+            return Current.Descriptor;
+        }
+    }
+
+    Bucket.push_back(Entry{ std::string(Content), Descriptor });
+    ++this->m_Count;
+    return Descriptor;
+}
+
+void NSudoSweeper::HandlerDescriptorCache::Clear()
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    this->m_Entries.clear();
+    this->m_Count = 0;
+}
+
+std::size_t NSudoSweeper::HandlerDescriptorCache::GetSize() const
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    return this->m_Count;
+}
+
+std::uint64_t NSudoSweeper::HandlerDescriptorCache::GetHits() const
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    return this->m_Hits;
+}
+
+std::uint64_t NSudoSweeper::HandlerDescriptorCache::GetMisses() const
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    return this->m_Misses;
+}
@@ -0,0 +1,320 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerDescriptor.h
+ * PURPOSE:   Definition for the cleanup handler descriptor and its cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_HANDLER_DESCRIPTOR
+#define NSUDO_SWEEPER_HANDLER_DESCRIPTOR
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.Synchronization.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The type of the object a Detect, Include or Exclude rule refers to.
+     */
+    enum class HandlerRuleType : std::uint8_t
+    {
+        File,
+        Registry,
+    };
+
+    /**
+     * A "Type|Pattern" entry of a Detect, Include or Exclude list.
+     */
+    struct HandlerRule
+    {
+        /**
+         * The type of the object the rule refers to.
+         */
+        HandlerRuleType Type;
+
+        /**
+         * The pattern of the rule, which uses the syntax of PathRuleSet.
+         */
+        Mile::NativeString Pattern;
+    };
+
+    /**
+     * A Windows version in the "Major.Minor.Build" form. The missing parts
+     * of a minimum version are 0, and the ones of a maximum version are
+     * UINT32_MAX, so the maximum "6.0" includes every build of Windows 6.0.
+     */
+    struct HandlerVersion
+    {
+        std::uint32_t Major = 0;
+        std::uint32_t Minor = 0;
+        std::uint32_t Build = 0;
+    };
+
+    /**
+     * The name and the description of a cleanup handler in a language.
+     */
+    struct HandlerLocalizedText
+    {
+        /**
+         * The language tag, such as "en" or "zh-Hans".
+         */
+        std::string Language;
+
+        /**
+         * The name of the cleanup handler.
+         */
+        Mile::NativeString Name;
+
+        /**
+         * The description of the cleanup handler.
+         */
+        Mile::NativeString Description;
+    };
+
+    /**
+     * The typed content of a cleanup handler configuration file.
+     */
+    struct HandlerDescriptor
+    {
+        /**
+         * The names and the descriptions from the tables in [Metadata].
+         */
+        std::vector<HandlerLocalizedText> Metadata;
+
+        /**
+         * The module which implements the cleanup handler.
+         */
+        Mile::NativeString Plugin;
+
+        /**
+         * The exported function name of the cleanup handler.
+         */
+        Mile::NativeString Handler;
+
+        /**
+         * Whether DetectOS is defined. If it is false, the cleanup handler
+         * supports all versions of Windows.
+         */
+        bool HasDetectOS = false;
+
+        /**
+         * The minimum and maximum versions of Windows which the cleanup
+         * handler supports, both included. A missing Minimum has all parts
+         * set to 0, and a missing Maximum has all parts set to UINT32_MAX.
+         */
+        HandlerVersion MinimumOS;
+        HandlerVersion MaximumOS;
+
+        /**
+         * Whether the cleanup handler supports offline Windows images.
+         */
+        bool OfflineImageSupport = false;
+
+        /**
+         * The rules of the cleanup handler.
+         */
+        std::vector<HandlerRule> Detect;
+        std::vector<HandlerRule> Include;
+        std::vector<HandlerRule> Exclude;
+
+        /**
+         * The whole configuration file, which is passed to the cleanup
+         * handler as the Configuration parameter.
+         */
+        Mile::NativeString Configuration;
+
+        /**
+         * The hash of the configuration file.
+         */
+        std::uint64_t ContentHash = 0;
+
+        /**
+         * Retrieves the name and the description in a language.
+         *
+         * @param Language The language tag, such as "zh-Hans".
+         * @return The text in the language, or in English if the language
+         *         is not defined, or the first one if English is not
+         *         defined either. nullptr if [Metadata] defines no language.
+         */
+        HandlerLocalizedText const* GetLocalizedText(
+            std::string_view Language) const noexcept;
+    };
+
+    /**
+     * The reason a cleanup handler configuration file cannot be loaded.
+     */
+    struct HandlerDescriptorError
+    {
+        /**
+         * The system error code if the file cannot be read, which is a
+         * Win32 error code on Windows and an errno value elsewhere.
+         */
+        int SystemError = 0;
+
+        /**
+         * The line of the error in the file, starting from 1, or 0 if the
+         * error has no position.
+         */
+        std::size_t Line = 0;
+
+        /**
+         * The column of the error in bytes, starting from 1.
+         */
+        std::size_t Column = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * Parses a cleanup handler configuration file.
+     *
+     * @param Content The content of the file, encoded in UTF-8.
+     * @param Descriptor The descriptor which receives the content.
+     * @param Error The reason if the file is not valid.
+     * @return true if the file is valid, otherwise false.
+     */
+    bool ParseHandlerDescriptor(
+        std::string_view Content,
+        HandlerDescriptor& Descriptor,
+        HandlerDescriptorError& Error);
+
+    /**
+     * Parses a Windows version in the "Major.Minor.Build" form.
+     *
+     * @param Text The text of the version, which has one to three parts.
+     * @param MissingPart The value of the parts which the text omits.
+     * @param Version The version.
+     * @return true if the text is valid, otherwise false.
+     */
+    bool ParseHandlerVersion(
+        std::string_view Text,
+        std::uint32_t MissingPart,
+        HandlerVersion& Version) noexcept;
+
+    /**
+     * Compares two Windows versions.
+     *
+     * @param Left The first version.
+     * @param Right The second version.
+     * @return A negative value if Left is less than Right, zero if they are
+     *         equal, or a positive value if Left is greater than Right.
+     */
+    int CompareHandlerVersion(
+        HandlerVersion const& Left,
+        HandlerVersion const& Right) noexcept;
+
+    /**
+     * Checks whether a cleanup handler supports a version of Windows, which
+     * is always the case if it does not define DetectOS.
+     *
+     * @param Descriptor The descriptor of the cleanup handler.
+     * @param Version The version of Windows.
+     * @return true if the cleanup handler supports the version, otherwise
+     *         false.
+     */
+    bool IsHandlerVersionSupported(
+        HandlerDescriptor const& Descriptor,
+        HandlerVersion const& Version) noexcept;
+
+    /**
+     * Retrieves the version of the running Windows, which is not affected
+     * by the compatibility settings of the process.
+     *
+     * @param Version The version of Windows.
+     * @return true if successful. It always fails on other platforms, where
+     *         DetectOS does not apply.
+     */
+    bool GetCurrentHandlerVersion(
+        HandlerVersion& Version) noexcept;
+
+    /**
+     * A cache of parsed cleanup handler descriptors keyed by the hash of
+     * the configuration files, so a file is only parsed again when its
+     * content changes. The cached content is compared with the file on
+     * every hit, so a collision of the hash cannot return the descriptor of
+     * another file. It can be used from multiple threads concurrently.
+     */
+    class HandlerDescriptorCache : Mile::DisableCopyConstruction
+    {
+    private:
+
+        struct Entry
+        {
+            std::string Content;
+            std::shared_ptr<HandlerDescriptor const> Descriptor;
+        };
+
+        mutable Mile::Mutex m_Mutex;
+        std::unordered_map<std::uint64_t, std::vector<Entry>> m_Entries;
+        std::size_t m_Count = 0;
+        std::uint64_t m_Hits = 0;
+        std::uint64_t m_Misses = 0;
+
+    public:
+
+        /**
+         * Loads a configuration file through a memory-mapped view.
+         *
+         * @param Path The path of the file.
+         * @param Error The reason if the file cannot be loaded.
+         * @return The descriptor, or nullptr if the file cannot be loaded.
+         */
+        std::shared_ptr<HandlerDescriptor const> Load(
+            Mile::NativeString const& Path,
+            HandlerDescriptorError& Error);
+
+        /**
+         * Parses the content of a configuration file, or returns the cached
+         * descriptor of the same content.
+         *
+         * @param Content The content of the file, encoded in UTF-8.
+         * @param Error The reason if the content is not valid.
+         * @return The descriptor, or nullptr if the content is not valid.
+         */
+        std::shared_ptr<HandlerDescriptor const> Parse(
+            std::string_view Content,
+            HandlerDescriptorError& Error);
+
+        /**
+         * Removes all descriptors.
+         */
+        void Clear();
+
+        /**
+         * Retrieves the number of cached descriptors.
+         *
+         * @return The number of cached descriptors.
+         */
+        std::size_t GetSize() const;
+
+        /**
+         * Retrieves the number of lookups which found a cached descriptor.
+         *
+         * @return The number of hits.
+         */
+        std::uint64_t GetHits() const;
+
+        /**
+         * Retrieves the number of lookups which parsed the content.
+         *
+         * @return The number of misses.
+         */
+        std::uint64_t GetMisses() const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_HANDLER_DESCRIPTOR
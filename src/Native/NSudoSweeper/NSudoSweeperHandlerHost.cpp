@@ -0,0 +1,298 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerHost.cpp
+ * PURPOSE:   Implementation for the streaming cleanup handler host
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperHandlerHost.h"
+
+#include <utility>
+
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeper::HandlerHost::Callback(
+    std::uint32_t Message,
+    void* Parameter,
+    void* UserData)
+{
+    HandlerHost* Host = reinterpret_cast<HandlerHost*>(UserData);
+
+    try
+    {
+        if (Message == NSUDO_SWEEPER_PROGRESS_MESSAGE)
+        {
+            std::lock_guard<std::mutex> Lock(Host->m_Mutex);
+            if (Parameter)
+            {
+                Host->m_Progress = *reinterpret_cast<std::uint32_t*>(
+                    Parameter);
+            }
+            return Host->m_Canceled
+                ? NSUDO_SWEEPER_E_ABORT
+                : NSUDO_SWEEPER_S_OK;
+        }
+
+        HandlerHostBatch Batch;
+
+        if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+        {
+            NSUDO_SWEEPER_ITEM_BATCH const* Source =
+                reinterpret_cast<NSUDO_SWEEPER_ITEM_BATCH const*>(Parameter);
+            if (!Source)
+            {
+                return NSUDO_SWEEPER_E_INVALIDARG;
+            }
+
+            // The items are only valid during the call, so they are copied
+            // before the handler can be blocked.
+            Batch.Items.resize(Source->Count);
+            for (std::uint32_t i = 0; i < Source->Count; ++i)
+            {
+                NSUDO_SWEEPER_ITEM const& Item = Source->Items[i];
+                HandlerHostItem& Target = Batch.Items[i];
+                Target.Path.assign(Item.Path, Item.PathLength);
+                Target.Index = Source->FirstIndex + i;
+                Target.Size = Item.Size;
+                Target.AllocationSize = Item.AllocationSize;
+                Target.FileId = Item.FileId;
+                Target.Reason = Item.Reason;
+            }
+        }
+        else if (Message == NSUDO_SWEEPER_CLEAN_RESULT_BATCH_MESSAGE)
+        {
+            NSUDO_SWEEPER_CLEAN_RESULT_BATCH const* Source =
+                reinterpret_cast<NSUDO_SWEEPER_CLEAN_RESULT_BATCH const*>(
+                    Parameter);
+            if (!Source)
+            {
+                return NSUDO_SWEEPER_E_INVALIDARG;
+            }
+
+            Batch.CleanResults.assign(
+                Source->Results,
+                Source->Results + Source->Count);
+        }
+        else
+        {
+            // Ignore the messages of later versions.
+            std::lock_guard<std::mutex> Lock(Host->m_Mutex);
+            return Host->m_Canceled
+                ? NSUDO_SWEEPER_E_ABORT
+                : NSUDO_SWEEPER_S_OK;
+        }
+
+        return Host->Push(std::move(Batch));
+    }
+    catch (...)
+    {
+        return NSUDO_SWEEPER_E_OUTOFMEMORY;
+    }
+}
+
+NSUDO_SWEEPER_RESULT NSudoSweeper::HandlerHost::Push(
+    HandlerHostBatch&& Batch)
+{
+    std::unique_lock<std::mutex> Lock(this->m_Mutex);
+
+    if (!this->m_Canceled &&
+        this->m_Batches.size() >= this->m_Options.MaximumPendingBatches)
+    {
+        ++this->m_Statistics.BackPressureWaits;
+        this->m_SpaceAvailable.wait(Lock, [this]()
+        {
+            return this->m_Canceled ||
+                this->m_Batches.size() < this->m_Options.MaximumPendingBatches;
+        });
+    }
+
+    if (this->m_Canceled)
+    {
+        return NSUDO_SWEEPER_E_ABORT;
+    }
+
+    ++this->m_Statistics.Batches;
+    this->m_Statistics.Items += Batch.Items.size();
+    this->m_Statistics.CleanResults += Batch.CleanResults.size();
+    this->m_Batches.push_back(std::move(Batch));
+    this->m_BatchAvailable.notify_one();
+    return NSUDO_SWEEPER_S_OK;
+}
+
+NSudoSweeper::HandlerHost::HandlerHost(
+    NSudoSweeperCleanupHandlerV2 Handler,
+    HandlerHostOptions const& Options) :
+    m_Handler(Handler),
+    m_Options(Options),
+    m_Request(),
+    m_Statistics(),
+    m_Summary()
+{
+    if (!this->m_Options.MaximumPendingBatches)
+    {
+        this->m_Options.MaximumPendingBatches = 1;
+    }
+}
+
+NSudoSweeper::HandlerHost::~HandlerHost()
+{
+    this->Cancel();
+    this->Wait();
+}
+
+bool NSudoSweeper::HandlerHost::Start(
+    std::uint32_t Phase,
+    Mile::NativeStringView Configuration,
+    Mile::NativeString const* SessionRootPath,
+    std::vector<HandlerHostItem> const* CleanItems)
+{
+    // Collect the previous invocation, if any.
+    this->Wait();
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    if (this->m_Running)
+    {
+        return false;
+    }
+
+    this->m_Configuration = Mile::NativeString(Configuration);
+    this->m_HasSessionRootPath = SessionRootPath != nullptr;
+    if (SessionRootPath)
+    {
+        this->m_SessionRootPath = *SessionRootPath;
+    }
+
+    this->m_CleanPaths.clear();
+    this->m_CleanItems.clear();
+    if (CleanItems)
+    {
+        this->m_CleanPaths.reserve(CleanItems->size());
+        this->m_CleanItems.reserve(CleanItems->size());
+        for (HandlerHostItem const& Item : *CleanItems)
+        {
+            this->m_CleanPaths.push_back(Item.Path);
+
+            NSUDO_SWEEPER_ITEM Target;
+            Target.Path = this->m_CleanPaths.back().c_str();
+            Target.PathLength = static_cast<std::uint32_t>(Item.Path.size());
+            Target.Reason = Item.Reason;
+            Target.Size = Item.Size;
+            Target.AllocationSize = Item.AllocationSize;
+            Target.FileId = Item.FileId;
+            this->m_CleanItems.push_back(Target);
+        }
+    }
+
+    this->m_Request = NSUDO_SWEEPER_HANDLER_REQUEST();
+    this->m_Request.Size = sizeof(NSUDO_SWEEPER_HANDLER_REQUEST);
+    this->m_Request.Phase = Phase;
+    this->m_Request.Configuration = this->m_Configuration.c_str();
+    this->m_Request.SessionRootPath = this->m_HasSessionRootPath
+        ? this->m_SessionRootPath.c_str()
+        : nullptr;
+    this->m_Request.Callback = HandlerHost::Callback;
+    this->m_Request.UserData = this;
+    if (CleanItems)
+    {
+        // The flag selects the items even if there are none.
+        this->m_Request.Flags |= NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+        this->m_Request.CleanItems = this->m_CleanItems.empty()
+            ? nullptr
+            : this->m_CleanItems.data();
+        this->m_Request.CleanItemCount = this->m_CleanItems.size();
+    }
+    this->m_Request.MaximumBatchSize = this->m_Options.MaximumBatchSize;
+
+    this->m_Batches.clear();
+    this->m_Running = true;
+    this->m_Canceled = false;
+    this->m_Progress = 0;
+    this->m_Statistics = HandlerHostStatistics();
+    this->m_Result = NSUDO_SWEEPER_S_OK;
+    this->m_Summary = NSUDO_SWEEPER_HANDLER_SUMMARY();
+
+    this->m_Thread = std::thread([this]()
+    {
+        NSUDO_SWEEPER_HANDLER_SUMMARY Summary = {};
+        Summary.Size = sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY);
+        NSUDO_SWEEPER_RESULT Result = this->m_Handler(
+            &this->m_Request,
+            &Summary);
+
+        std::lock_guard<std::mutex> CompletionLock(this->m_Mutex);
+        this->m_Result = Result;
+        this->m_Summary = Summary;
+        this->m_Running = false;
+        this->m_BatchAvailable.notify_all();
+    });
+
+    return true;
+}
+
+bool NSudoSweeper::HandlerHost::Pop(
+    HandlerHostBatch& Batch)
+{
+    std::unique_lock<std::mutex> Lock(this->m_Mutex);
+    this->m_BatchAvailable.wait(Lock, [this]()
+    {
+        return !this->m_Batches.empty() || !this->m_Running;
+    });
+
+    if (this->m_Batches.empty())
+    {
+        return false;
+    }
+
+    Batch = std::move(this->m_Batches.front());
+    this->m_Batches.pop_front();
+    this->m_SpaceAvailable.notify_one();
+    return true;
+}
+
+void NSudoSweeper::HandlerHost::Cancel()
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    this->m_Canceled = true;
+    this->m_SpaceAvailable.notify_all();
+}
+
+NSUDO_SWEEPER_RESULT NSudoSweeper::HandlerHost::Wait(
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary)
+{
+    if (this->m_Thread.joinable())
+    {
+        // Discard the batches nobody takes, so the handler is not blocked.
+        {
+            std::unique_lock<std::mutex> Lock(this->m_Mutex);
+            while (this->m_Running)
+            {
+                this->m_Batches.clear();
+                this->m_SpaceAvailable.notify_all();
+                this->m_BatchAvailable.wait(Lock);
+            }
+        }
+        this->m_Thread.join();
+    }
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    this->m_Batches.clear();
+    if (Summary)
+    {
+        *Summary = this->m_Summary;
+    }
+    return this->m_Result;
+}
+
+std::uint32_t NSudoSweeper::HandlerHost::GetProgress() const
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_Progress;
+}
+
+NSudoSweeper::HandlerHostStatistics
+NSudoSweeper::HandlerHost::GetStatistics() const
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_Statistics;
+}
@@ -0,0 +1,222 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerHost.h
+ * PURPOSE:   Definition for the streaming cleanup handler host
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_HANDLER_HOST
+#define NSUDO_SWEEPER_HANDLER_HOST
+
+#include <Mile.Portable.h>
+
+#include "NSudoSweeperHandlerV2.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * A candidate item reported by a handler.
+     */
+    struct HandlerHostItem
+    {
+        /**
+         * The full path of the item.
+         */
+        Mile::NativeString Path;
+
+        /**
+         * The index of the item in the stream of items the handler reports.
+         */
+        std::uint64_t Index;
+
+        /**
+         * The size and the allocation size of the item, in bytes.
+         */
+        std::uint64_t Size;
+        std::uint64_t AllocationSize;
+
+        /**
+         * The file ID of the item, or 0 if it is not known.
+         */
+        std::uint64_t FileId;
+
+        /**
+         * The index of the Include rule which selects the item, or
+         * NSUDO_SWEEPER_REASON_HANDLER.
+         */
+        std::uint32_t Reason;
+    };
+
+    /**
+     * A batch of items or results delivered by the host. One of the vectors
+     * is empty.
+     */
+    struct HandlerHostBatch
+    {
+        std::vector<HandlerHostItem> Items;
+        std::vector<NSUDO_SWEEPER_CLEAN_RESULT> CleanResults;
+    };
+
+    /**
+     * The options of the handler host.
+     */
+    struct HandlerHostOptions
+    {
+        /**
+         * The maximum number of batches the handler can report before the
+         * consumer takes them. The callback blocks the handler when the
+         * limit is reached.
+         */
+        std::size_t MaximumPendingBatches = 4;
+
+        /**
+         * The maximum number of items or results in a batch, or 0 to let
+         * the handler choose.
+         */
+        std::uint32_t MaximumBatchSize = 0;
+    };
+
+    /**
+     * The statistics of a handler invocation.
+     */
+    struct HandlerHostStatistics
+    {
+        std::uint64_t Batches;
+        std::uint64_t Items;
+        std::uint64_t CleanResults;
+
+        /**
+         * The number of times the handler waited for the consumer.
+         */
+        std::uint64_t BackPressureWaits;
+    };
+
+    /**
+     * Runs a version 2 cleanup handler on its own thread and delivers the
+     * batches it reports through a bounded queue. A consumer which falls
+     * behind blocks the handler in its callback, so the memory used by a
+     * scan does not depend on its size.
+     */
+    class HandlerHost : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        NSudoSweeperCleanupHandlerV2 m_Handler;
+        HandlerHostOptions m_Options;
+
+        Mile::NativeString m_Configuration;
+        Mile::NativeString m_SessionRootPath;
+        bool m_HasSessionRootPath = false;
+        std::vector<Mile::NativeString> m_CleanPaths;
+        std::vector<NSUDO_SWEEPER_ITEM> m_CleanItems;
+        NSUDO_SWEEPER_HANDLER_REQUEST m_Request;
+
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_BatchAvailable;
+        std::condition_variable m_SpaceAvailable;
+        std::deque<HandlerHostBatch> m_Batches;
+        bool m_Running = false;
+        bool m_Canceled = false;
+        std::uint32_t m_Progress = 0;
+        HandlerHostStatistics m_Statistics;
+        NSUDO_SWEEPER_RESULT m_Result = NSUDO_SWEEPER_S_OK;
+        NSUDO_SWEEPER_HANDLER_SUMMARY m_Summary;
+        std::thread m_Thread;
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API Callback(
+            std::uint32_t Message,
+            void* Parameter,
+            void* UserData);
+
+        NSUDO_SWEEPER_RESULT Push(
+            HandlerHostBatch&& Batch);
+
+    public:
+
+        /**
+         * Creates the host.
+         *
+         * @param Handler The handler.
+         * @param Options The options of the host.
+         */
+        explicit HandlerHost(
+            NSudoSweeperCleanupHandlerV2 Handler,
+            HandlerHostOptions const& Options = HandlerHostOptions());
+
+        /**
+         * Cancels the handler and waits for it.
+         */
+        ~HandlerHost();
+
+        /**
+         * Starts the handler.
+         *
+         * @param Phase NSUDO_SWEEPER_PHASE_SCAN or NSUDO_SWEEPER_PHASE_CLEAN.
+         * @param Configuration The configuration file of the handler.
+         * @param SessionRootPath The root directory of an offline image, or
+         *                        nullptr for the online image.
+         * @param CleanItems The items a clean removes, or nullptr to remove
+         *                   all items a scan would report.
+         * @return true if the handler is started, or false if it is already
+         *         running.
+         */
+        bool Start(
+            std::uint32_t Phase,
+            Mile::NativeStringView Configuration,
+            Mile::NativeString const* SessionRootPath = nullptr,
+            std::vector<HandlerHostItem> const* CleanItems = nullptr);
+
+        /**
+         * Takes the next batch, and waits for one if the queue is empty.
+         *
+         * @param Batch The batch.
+         * @return true if a batch is taken, or false if the handler has
+         *         completed and all batches have been taken.
+         */
+        bool Pop(
+            HandlerHostBatch& Batch);
+
+        /**
+         * Cancels the handler. The callback returns NSUDO_SWEEPER_E_ABORT
+         * from then on. It can be called from any thread.
+         */
+        void Cancel();
+
+        /**
+         * Waits for the handler to complete. The batches which are not taken
+         * are discarded.
+         *
+         * @param Summary The totals of the handler. It can be nullptr.
+         * @return The result of the handler.
+         */
+        NSUDO_SWEEPER_RESULT Wait(
+            NSUDO_SWEEPER_HANDLER_SUMMARY* Summary = nullptr);
+
+        /**
+         * Retrieves the last progress reported by the handler.
+         *
+         * @return The progress, from 0 to 100.
+         */
+        std::uint32_t GetProgress() const;
+
+        /**
+         * Retrieves the statistics of the handler invocation.
+         *
+         * @return The statistics.
+         */
+        HandlerHostStatistics GetStatistics() const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_HANDLER_HOST
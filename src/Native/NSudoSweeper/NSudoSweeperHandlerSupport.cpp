@@ -0,0 +1,265 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerSupport.cpp
+ * PURPOSE:   Implementation for the helpers shared by the cleanup handlers
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Mile::NativeString NSudoSweeper::JoinPath(
+    Mile::NativeStringView DirectoryPath,
+    Mile::NativeStringView Name)
+{
+    Mile::NativeString Path;
+    Path.reserve(DirectoryPath.size() + 1 + Name.size());
+    Path.append(DirectoryPath);
+    if (!Path.empty() && !NSudoSweeper::IsPathSeparator(Path.back()))
+    {
+        Path.push_back(PathSeparator);
+    }
+    Path.append(Name);
+    return Path;
+}
+
+std::string NSudoSweeper::ToUtf8String(
+    Mile::NativeStringView String)
+{
+#if defined(_WIN32)
+    std::string Result;
+    if (String.empty())
+    {
+        return Result;
+    }
+
+    int Length = ::WideCharToMultiByte(
+        CP_UTF8,
+        0,
+        String.data(),
+        static_cast<int>(String.size()),
+        nullptr,
+        0,
+        nullptr,
+        nullptr);
+    if (Length > 0)
+    {
+        Result.resize(static_cast<std::size_t>(Length));
+        Length = ::WideCharToMultiByte(
+            CP_UTF8,
+            0,
+            String.data(),
+            static_cast<int>(String.size()),
+            &Result[0],
+            Length,
+            nullptr,
+            nullptr);
+        Result.resize(static_cast<std::size_t>(Length));
+    }
+    return Result;
+#else
+    return std::string(String);
+#endif
+}
+
+int NSudoSweeper::QueryFileState(
+    Mile::NativeString const& Path,
+    FileState& State)
+{
+#if defined(_WIN32)
+    HANDLE FileHandle = ::CreateFileW(
+        Path.c_str(),
+        FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+        nullptr);
+    if (FileHandle == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int>(::GetLastError());
+    }
+
+    int Error = 0;
+    BY_HANDLE_FILE_INFORMATION Information;
+    FILE_STANDARD_INFO StandardInformation;
+    if (::GetFileInformationByHandle(FileHandle, &Information) &&
+        ::GetFileInformationByHandleEx(
+            FileHandle,
+            FileStandardInfo,
+            &StandardInformation,
+            sizeof(StandardInformation)))
+    {
+        State.Size = static_cast<std::uint64_t>(
+            StandardInformation.EndOfFile.QuadPart);
+        State.AllocationSize = static_cast<std::uint64_t>(
+            StandardInformation.AllocationSize.QuadPart);
+        State.FileId =
+            (static_cast<std::uint64_t>(Information.nFileIndexHigh) << 32) |
+            Information.nFileIndexLow;
+    }
+    else
+    {
+        Error = static_cast<int>(::GetLastError());
+    }
+
+    ::CloseHandle(FileHandle);
+    return Error;
+#else
+    struct stat Status;
+    if (-1 == ::lstat(Path.c_str(), &Status))
+    {
+        return errno;
+    }
+
+    State.Size = static_cast<std::uint64_t>(Status.st_size);
+    State.AllocationSize =
+        static_cast<std::uint64_t>(Status.st_blocks) * 512;
+    State.FileId = static_cast<std::uint64_t>(Status.st_ino);
+    return 0;
+#endif
+}
+
+bool NSudoSweeper::IsNotFoundError(
+    int Error) noexcept
+{
+#if defined(_WIN32)
+    return Error == ERROR_FILE_NOT_FOUND || Error == ERROR_PATH_NOT_FOUND;
+#else
+    return Error == ENOENT || Error == ENOTDIR;
+#endif
+}
+
+int NSudoSweeper::RemoveFile(
+    Mile::NativeString const& Path)
+{
+#if defined(_WIN32)
+    if (::DeleteFileW(Path.c_str()))
+    {
+        return 0;
+    }
+
+    DWORD Error = ::GetLastError();
+    if (Error == ERROR_ACCESS_DENIED)
+    {
+        // DeleteFile fails on read-only files.
+        DWORD Attributes = ::GetFileAttributesW(Path.c_str());
+        if (Attributes != INVALID_FILE_ATTRIBUTES &&
+            (Attributes & FILE_ATTRIBUTE_READONLY) &&
+            ::SetFileAttributesW(
+                Path.c_str(),
+                Attributes & ~FILE_ATTRIBUTE_READONLY))
+        {
+            if (::DeleteFileW(Path.c_str()))
+            {
+                return 0;
+            }
+            Error = ::GetLastError();
+            ::SetFileAttributesW(Path.c_str(), Attributes);
+        }
+    }
+    return static_cast<int>(Error);
+#else
+    return (-1 == ::unlink(Path.c_str())) ? errno : 0;
+#endif
+}
+
+NSudoSweeper::CallbackChannel::CallbackChannel(
+    NSudoSweeperCallbackV2 Callback,
+    void* UserData) :
+    m_Callback(Callback),
+    m_UserData(UserData),
+    m_LastCall(std::chrono::steady_clock::now())
+{
+}
+
+bool NSudoSweeper::CallbackChannel::SendLocked(
+    std::uint32_t Message,
+    void* Parameter)
+{
+    if (this->m_Result.load() != NSUDO_SWEEPER_S_OK)
+    {
+        return false;
+    }
+
+    NSUDO_SWEEPER_RESULT Result =
+        this->m_Callback(Message, Parameter, this->m_UserData);
+    this->m_LastCall = std::chrono::steady_clock::now();
+    if (Result != NSUDO_SWEEPER_S_OK)
+    {
+        this->m_Result.store(Result);
+        return false;
+    }
+    return true;
+}
+
+bool NSudoSweeper::CallbackChannel::Send(
+    std::uint32_t Message,
+    void* Parameter)
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    return this->SendLocked(Message, Parameter);
+}
+
+bool NSudoSweeper::CallbackChannel::SendProgress(
+    std::uint32_t Progress)
+{
+    return this->Send(NSUDO_SWEEPER_PROGRESS_MESSAGE, &Progress);
+}
+
+bool NSudoSweeper::CallbackChannel::SendProgressIfIdle(
+    std::uint32_t Progress)
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+    if (std::chrono::steady_clock::now() - this->m_LastCall <
+        HandlerProgressInterval)
+    {
+        return this->m_Result.load() == NSUDO_SWEEPER_S_OK;
+    }
+    return this->SendLocked(NSUDO_SWEEPER_PROGRESS_MESSAGE, &Progress);
+}
+
+NSudoSweeper::ResultBatch::ResultBatch(
+    std::uint32_t Capacity) :
+    m_Capacity(Capacity)
+{
+    this->m_Results.reserve(Capacity);
+}
+
+bool NSudoSweeper::ResultBatch::Add(
+    CallbackChannel& Channel,
+    NSUDO_SWEEPER_CLEAN_RESULT const& Result)
+{
+    this->m_Results.push_back(Result);
+    return this->m_Results.size() < this->m_Capacity ||
+        this->Send(Channel);
+}
+
+bool NSudoSweeper::ResultBatch::Send(
+    CallbackChannel& Channel)
+{
+    if (this->m_Results.empty())
+    {
+        return true;
+    }
+
+    NSUDO_SWEEPER_CLEAN_RESULT_BATCH Batch;
+    Batch.Results = this->m_Results.data();
+    Batch.Count = static_cast<std::uint32_t>(this->m_Results.size());
+    Batch.Reserved = 0;
+    bool Result = Channel.Send(
+        NSUDO_SWEEPER_CLEAN_RESULT_BATCH_MESSAGE,
+        &Batch);
+    this->m_Results.clear();
+    return Result;
+}
@@ -0,0 +1,184 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerSupport.h
+ * PURPOSE:   Definition for the helpers shared by the cleanup handlers
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_HANDLER_SUPPORT
+#define NSUDO_SWEEPER_HANDLER_SUPPORT
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.Synchronization.h>
+
+#include "NSudoSweeperHandlerV2.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * The path, file and callback helpers of the built-in handlers and the
+ * modules they use. They are internal to NSudo Sweeper, so a plugin only
+ * needs NSudoSweeperHandlerV2.h.
+ */
+
+namespace NSudoSweeper
+{
+    /**
+     * The path separator of the platform.
+     */
+#if defined(_WIN32)
+    const wchar_t PathSeparator = L'\\';
+#else
+    const char PathSeparator = '/';
+#endif
+
+    /**
+     * The longest time a handler goes without calling its callback.
+     */
+    const std::chrono::milliseconds HandlerProgressInterval(100);
+
+    /**
+     * Checks whether a character separates the components of a path, which
+     * includes '/' on Windows.
+     */
+    inline bool IsPathSeparator(
+        Mile::NativeChar Character) noexcept
+    {
+#if defined(_WIN32)
+        return Character == L'\\' || Character == L'/';
+#else
+        return Character == '/';
+#endif
+    }
+
+    /**
+     * Appends a name to a directory path, with a separator between them
+     * unless the directory path is empty or already ends with one.
+     */
+    Mile::NativeString JoinPath(
+        Mile::NativeStringView DirectoryPath,
+        Mile::NativeStringView Name);
+
+    /**
+     * Converts a native string to UTF-8. The native strings are UTF-16 on
+     * Windows and already UTF-8 elsewhere.
+     */
+    std::string ToUtf8String(
+        Mile::NativeStringView String);
+
+    /**
+     * The size, the allocation size and the file ID of a file.
+     */
+    struct FileState
+    {
+        std::uint64_t Size = 0;
+        std::uint64_t AllocationSize = 0;
+        std::uint64_t FileId = 0;
+    };
+
+    /**
+     * Queries the size and the file ID of a file without following links.
+     *
+     * @return 0 if successful, otherwise the system error code.
+     */
+    int QueryFileState(
+        Mile::NativeString const& Path,
+        FileState& State);
+
+    /**
+     * Checks whether a system error code means the file or one of its
+     * parent directories does not exist.
+     */
+    bool IsNotFoundError(
+        int Error) noexcept;
+
+    /**
+     * Removes a file or a link. A read-only file is removed as well.
+     *
+     * @return 0 if successful, otherwise the system error code.
+     */
+    int RemoveFile(
+        Mile::NativeString const& Path);
+
+    /**
+     * Serializes the calls to the callback and keeps its first failure,
+     * which cancels the handler.
+     */
+    class CallbackChannel : Mile::DisableCopyConstruction
+    {
+    private:
+
+        NSudoSweeperCallbackV2 m_Callback;
+        void* m_UserData;
+        Mile::Mutex m_Mutex;
+        std::atomic<NSUDO_SWEEPER_RESULT> m_Result{ NSUDO_SWEEPER_S_OK };
+        std::chrono::steady_clock::time_point m_LastCall;
+
+        bool SendLocked(
+            std::uint32_t Message,
+            void* Parameter);
+
+    public:
+
+        CallbackChannel(
+            NSudoSweeperCallbackV2 Callback,
+            void* UserData);
+
+        bool Send(
+            std::uint32_t Message,
+            void* Parameter);
+
+        bool SendProgress(
+            std::uint32_t Progress);
+
+        /**
+         * Sends the progress if nothing has been sent for
+         * HandlerProgressInterval, so the callback can cancel the handler.
+         */
+        bool SendProgressIfIdle(
+            std::uint32_t Progress);
+
+        NSUDO_SWEEPER_RESULT GetResult() const noexcept
+        {
+            return this->m_Result.load();
+        }
+    };
+
+    /**
+     * Collects the results of a clean and sends them in batches.
+     */
+    class ResultBatch
+    {
+    private:
+
+        std::vector<NSUDO_SWEEPER_CLEAN_RESULT> m_Results;
+        std::uint32_t m_Capacity;
+
+    public:
+
+        explicit ResultBatch(
+            std::uint32_t Capacity);
+
+        /**
+         * Adds a result, and sends the batch if it is full.
+         */
+        bool Add(
+            CallbackChannel& Channel,
+            NSUDO_SWEEPER_CLEAN_RESULT const& Result);
+
+        /**
+         * Sends the results which have not been sent yet.
+         */
+        bool Send(
+            CallbackChannel& Channel);
+    };
+}
+
+#endif // !NSUDO_SWEEPER_HANDLER_SUPPORT
@@ -0,0 +1,510 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerV2.h
+ * PURPOSE:   Definition for the streaming cleanup handler interface
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_HANDLER_V2
+#define NSUDO_SWEEPER_HANDLER_V2
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <wchar.h>
+#endif
+
+/*
+ * The version 2 cleanup handler interface. It only uses fixed-size types, so
+ * it is the same on all platforms and can be implemented in C.
+ *
+ * A handler is exported with the name in the Handler key of its
+ * configuration file followed by NSUDO_SWEEPER_HANDLER_V2_SUFFIX. Hosts only
+ * load that export. A handler which only exports the version 1
+ * NSudoSweeperCleanupHandler of NSudoSweeperCore.h cannot stream or select
+ * items, so it is not loaded and needs to be ported.
+ *
+ * A scan streams the candidate items to the callback in batches, so the
+ * host can show them as they are found. A clean receives the items the user
+ * has chosen from a previous scan, revalidates them and removes them, so it
+ * does not need to rediscover anything.
+ *
+ * The callback controls the handler:
+ *
+ *   - It is never called concurrently for one invocation of a handler.
+ *   - It may block to apply back-pressure, and the handler waits for it.
+ *   - It returns NSUDO_SWEEPER_S_OK to continue. Any other value, usually
+ *     NSUDO_SWEEPER_E_ABORT, cancels the handler, which stops as soon as
+ *     possible and returns that value.
+ *   - The handler calls it at least every 100 milliseconds while it works,
+ *     with NSUDO_SWEEPER_PROGRESS_MESSAGE if there is nothing else to send,
+ *     so a cancellation is noticed even if no item is found.
+ *   - The items, the paths and the results in a batch are only valid
+ *     during the call, so the handler can reuse its buffers.
+ */
+
+#if defined(_WIN32)
+#define NSUDO_SWEEPER_API __stdcall
+typedef wchar_t NSUDO_SWEEPER_CHAR;
+#else
+#define NSUDO_SWEEPER_API
+typedef char NSUDO_SWEEPER_CHAR;
+#endif
+
+/**
+ * The result of a handler or a callback. It uses the HRESULT values.
+ */
+typedef int32_t NSUDO_SWEEPER_RESULT;
+
+#define NSUDO_SWEEPER_S_OK ((NSUDO_SWEEPER_RESULT)0x00000000L)
+#define NSUDO_SWEEPER_E_NOTIMPL ((NSUDO_SWEEPER_RESULT)0x80004001L)
+#define NSUDO_SWEEPER_E_ABORT ((NSUDO_SWEEPER_RESULT)0x80004004L)
+#define NSUDO_SWEEPER_E_FAIL ((NSUDO_SWEEPER_RESULT)0x80004005L)
+#define NSUDO_SWEEPER_E_OUTOFMEMORY ((NSUDO_SWEEPER_RESULT)0x8007000EL)
+#define NSUDO_SWEEPER_E_INVALIDARG ((NSUDO_SWEEPER_RESULT)0x80070057L)
+
+/**
+ * The handler has run out of time. A callback returns it to cancel a
+ * handler which has exceeded its time limit.
+ */
+#define NSUDO_SWEEPER_E_TIMEOUT ((NSUDO_SWEEPER_RESULT)0x800705B4L)
+
+/**
+ * The item changed after it was scanned, so it is not removed.
+ */
+#define NSUDO_SWEEPER_E_ITEM_CHANGED ((NSUDO_SWEEPER_RESULT)0x8007000DL)
+
+/**
+ * The item does not exist anymore.
+ */
+#define NSUDO_SWEEPER_E_ITEM_NOT_FOUND ((NSUDO_SWEEPER_RESULT)0x80070002L)
+
+/**
+ * The item is not selected by the rules of the handler, so it is not
+ * removed. It is a FACILITY_ITF value, so it cannot be mistaken for the
+ * E_ACCESSDENIED a removal fails with.
+ */
+#define NSUDO_SWEEPER_E_ITEM_NOT_SELECTED ((NSUDO_SWEEPER_RESULT)0x80040200L)
+
+/**
+ * The suffix of the export name of a version 2 handler.
+ */
+#define NSUDO_SWEEPER_HANDLER_V2_SUFFIX "V2"
+
+/**
+ * The phase a handler runs.
+ */
+#define NSUDO_SWEEPER_PHASE_SCAN 0x00000000
+#define NSUDO_SWEEPER_PHASE_CLEAN 0x00000001
+
+/**
+ * Estimates the size a clean frees without finding every item. The handler
+ * sends NSUDO_SWEEPER_ESTIMATE_MESSAGE with its first estimate within
+ * EstimateTimeBudget, and then with better estimates while it refines them
+ * toward the exact value, until the estimate is exact or the callback
+ * cancels the handler. A handler which does not support it returns
+ * NSUDO_SWEEPER_E_NOTIMPL, and the host can run a scan instead.
+ */
+#define NSUDO_SWEEPER_PHASE_ESTIMATE 0x00000002
+
+/**
+ * A clean removes the items in CleanItems only, even if there are none.
+ * Without it, a clean removes all items a scan would report.
+ */
+#define NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS 0x00000001
+
+#ifndef NSUDO_SWEEPER_PROGRESS_MESSAGE
+/**
+ * The message used to report the progress.
+ *
+ * @param A pointer to a uint32_t variable that receives the reported
+ *        progress, from 0 to 100.
+ */
+#define NSUDO_SWEEPER_PROGRESS_MESSAGE 0x00000001
+#endif
+
+/**
+ * The message used to report a batch of candidate items.
+ *
+ * @param A pointer to a NSUDO_SWEEPER_ITEM_BATCH structure.
+ */
+#define NSUDO_SWEEPER_ITEM_BATCH_MESSAGE 0x00000002
+
+/**
+ * The message used to report the results of removing a batch of items.
+ *
+ * @param A pointer to a NSUDO_SWEEPER_CLEAN_RESULT_BATCH structure.
+ */
+#define NSUDO_SWEEPER_CLEAN_RESULT_BATCH_MESSAGE 0x00000003
+
+/**
+ * The message used to report an estimate of the size a clean frees.
+ *
+ * @param A pointer to a NSUDO_SWEEPER_ESTIMATE structure.
+ */
+#define NSUDO_SWEEPER_ESTIMATE_MESSAGE 0x00000004
+
+/**
+ * The message used to report a set of items with the same content, which
+ * is sent before the items of the set.
+ *
+ * @param A pointer to a NSUDO_SWEEPER_DUPLICATE_SET structure.
+ */
+#define NSUDO_SWEEPER_DUPLICATE_SET_MESSAGE 0x00000005
+
+/**
+ * The reason of an item which is not selected by an Include rule.
+ */
+#define NSUDO_SWEEPER_REASON_HANDLER 0xFFFFFFFF
+
+/**
+ * A candidate item.
+ */
+typedef struct _NSUDO_SWEEPER_ITEM
+{
+    /**
+     * The full path of the item, terminated by a null character.
+     */
+    const NSUDO_SWEEPER_CHAR* Path;
+
+    /**
+     * The length of the path, in characters, without the null character.
+     */
+    uint32_t PathLength;
+
+    /**
+     * The index of the Include rule of the configuration file which selects
+     * the item, or NSUDO_SWEEPER_REASON_HANDLER if the handler selects it
+     * for another reason.
+     */
+    uint32_t Reason;
+
+    /**
+     * The size of the item, in bytes.
+     */
+    uint64_t Size;
+
+    /**
+     * The size the item occupies on the volume, in bytes.
+     */
+    uint64_t AllocationSize;
+
+    /**
+     * The file ID of the item, or 0 if it is not known. A clean does not
+     * remove the item if its file ID has changed.
+     */
+    uint64_t FileId;
+} NSUDO_SWEEPER_ITEM, *PNSUDO_SWEEPER_ITEM;
+
+/**
+ * A batch of candidate items.
+ */
+typedef struct _NSUDO_SWEEPER_ITEM_BATCH
+{
+    /**
+     * The items.
+     */
+    const NSUDO_SWEEPER_ITEM* Items;
+
+    /**
+     * The number of items.
+     */
+    uint32_t Count;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+
+    /**
+     * The index of the first item of the batch in the stream of items the
+     * handler reports.
+     */
+    uint64_t FirstIndex;
+} NSUDO_SWEEPER_ITEM_BATCH, *PNSUDO_SWEEPER_ITEM_BATCH;
+
+/**
+ * The result of removing an item.
+ */
+typedef struct _NSUDO_SWEEPER_CLEAN_RESULT
+{
+    /**
+     * The index of the item in NSUDO_SWEEPER_HANDLER_REQUEST::CleanItems,
+     * or in the stream of items the handler has found if the request does
+     * not have NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS.
+     */
+    uint64_t Index;
+
+    /**
+     * NSUDO_SWEEPER_S_OK if the item is removed, otherwise the reason.
+     */
+    NSUDO_SWEEPER_RESULT Result;
+
+    /**
+     * The system error code if the item cannot be removed, which is a Win32
+     * error code on Windows and an errno value elsewhere.
+     */
+    int32_t SystemError;
+
+    /**
+     * The freed size, in bytes.
+     */
+    uint64_t FreedSize;
+} NSUDO_SWEEPER_CLEAN_RESULT, *PNSUDO_SWEEPER_CLEAN_RESULT;
+
+/**
+ * A batch of results of removing items.
+ */
+typedef struct _NSUDO_SWEEPER_CLEAN_RESULT_BATCH
+{
+    /**
+     * The results.
+     */
+    const NSUDO_SWEEPER_CLEAN_RESULT* Results;
+
+    /**
+     * The number of results.
+     */
+    uint32_t Count;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+} NSUDO_SWEEPER_CLEAN_RESULT_BATCH, *PNSUDO_SWEEPER_CLEAN_RESULT_BATCH;
+
+/**
+ * An estimate of the size a clean frees.
+ */
+typedef struct _NSUDO_SWEEPER_ESTIMATE
+{
+    /**
+     * The estimated size, in bytes.
+     */
+    uint64_t Size;
+
+    /**
+     * The 95% confidence interval of the size, in bytes.
+     */
+    uint64_t LowerBound;
+    uint64_t UpperBound;
+
+    /**
+     * The estimated number of items.
+     */
+    uint64_t ItemCount;
+
+    /**
+     * Nonzero if the estimate is exact.
+     */
+    uint32_t Exact;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+} NSUDO_SWEEPER_ESTIMATE, *PNSUDO_SWEEPER_ESTIMATE;
+
+/**
+ * A set of files with the same content. One file is kept, and the others
+ * are reported as items, which a clean removes or replaces with hard links
+ * to the kept file.
+ */
+typedef struct _NSUDO_SWEEPER_DUPLICATE_SET
+{
+    /**
+     * The full path of the file which is kept, terminated by a null
+     * character.
+     */
+    const NSUDO_SWEEPER_CHAR* KeptPath;
+
+    /**
+     * The length of the path, in characters, without the null character.
+     */
+    uint32_t KeptPathLength;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+
+    /**
+     * The index of the first item of the set in the stream of items the
+     * handler reports, and the number of items. The items follow in later
+     * NSUDO_SWEEPER_ITEM_BATCH_MESSAGE messages.
+     */
+    uint64_t FirstIndex;
+    uint64_t Count;
+
+    /**
+     * The size of each file, in bytes.
+     */
+    uint64_t Size;
+
+    /**
+     * The size the items occupy on the volume, in bytes.
+     */
+    uint64_t ReclaimableSize;
+} NSUDO_SWEEPER_DUPLICATE_SET, *PNSUDO_SWEEPER_DUPLICATE_SET;
+
+/**
+ * A user-defined function that a version 2 handler uses to report
+ * something.
+ *
+ * @param Message The message.
+ * @param Parameter A pointer to the additional message information. The
+ *                  contents of this parameter depend on the value of the
+ *                  Message parameter.
+ * @param UserData User defined custom data.
+ * @return NSUDO_SWEEPER_S_OK to continue, any other value to cancel the
+ *         handler.
+ */
+typedef NSUDO_SWEEPER_RESULT(NSUDO_SWEEPER_API* NSudoSweeperCallbackV2)(
+    uint32_t Message,
+    void* Parameter,
+    void* UserData);
+
+/**
+ * The parameters of a version 2 handler.
+ */
+typedef struct _NSUDO_SWEEPER_HANDLER_REQUEST
+{
+    /**
+     * The size of the structure, in bytes.
+     */
+    uint32_t Size;
+
+    /**
+     * NSUDO_SWEEPER_PHASE_SCAN, NSUDO_SWEEPER_PHASE_CLEAN or
+     * NSUDO_SWEEPER_PHASE_ESTIMATE.
+     */
+    uint32_t Phase;
+
+    /**
+     * A TOML configuration string that holds the information about the
+     * cleanup handler.
+     */
+    const NSUDO_SWEEPER_CHAR* Configuration;
+
+    /**
+     * An absolute path with end of the path separator to the root directory
+     * of a Windows image which you want to operate. If the pointer is NULL,
+     * the handler will operate the online Windows image.
+     */
+    const NSUDO_SWEEPER_CHAR* SessionRootPath;
+
+    /**
+     * A pointer to a user-defined NSudoSweeperCallbackV2. It is required.
+     */
+    NSudoSweeperCallbackV2 Callback;
+
+    /**
+     * User defined custom data used by the Callback parameter.
+     */
+    void* UserData;
+
+    /**
+     * The items a clean removes if Flags has
+     * NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS, usually a filtered subset of the
+     * items a scan has reported. The handler only removes the items which
+     * are still selected by its rules and whose size and file ID have not
+     * changed. It can be NULL if there are no items, and it must be NULL
+     * without the flag.
+     */
+    const NSUDO_SWEEPER_ITEM* CleanItems;
+
+    /**
+     * The number of items in CleanItems.
+     */
+    uint64_t CleanItemCount;
+
+    /**
+     * The maximum number of items or results in a batch, or 0 to let the
+     * handler choose.
+     */
+    uint32_t MaximumBatchSize;
+
+    /**
+     * The time the first estimate of NSUDO_SWEEPER_PHASE_ESTIMATE may take,
+     * in milliseconds, or 0 to let the handler choose.
+     */
+    uint32_t EstimateTimeBudget;
+
+    /**
+     * The path of a file where the handler keeps the directories of its
+     * scans, so a scan only enumerates the directories which have changed
+     * since the previous one, or NULL to enumerate all directories. It is
+     * only used by NSUDO_SWEEPER_PHASE_SCAN. A file which cannot be read or
+     * written is ignored.
+     */
+    const NSUDO_SWEEPER_CHAR* ScanCachePath;
+
+    /**
+     * A combination of the NSUDO_SWEEPER_REQUEST_* flags. The other bits
+     * are reserved and must be 0.
+     */
+    uint32_t Flags;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+} NSUDO_SWEEPER_HANDLER_REQUEST, *PNSUDO_SWEEPER_HANDLER_REQUEST;
+
+/**
+ * The totals of a version 2 handler invocation.
+ */
+typedef struct _NSUDO_SWEEPER_HANDLER_SUMMARY
+{
+    /**
+     * The size of the structure, in bytes. The caller sets it.
+     */
+    uint32_t Size;
+
+    /**
+     * Reserved, must be 0.
+     */
+    uint32_t Reserved;
+
+    /**
+     * The number of items found by a scan, or processed by a clean. It is
+     * the last estimated number for an estimate.
+     */
+    uint64_t ItemCount;
+
+    /**
+     * The total size and allocation size of the items, in bytes. They are
+     * the last estimated sizes for an estimate, whose allocation size is
+     * the estimated size a clean frees.
+     */
+    uint64_t TotalSize;
+    uint64_t TotalAllocationSize;
+
+    /**
+     * The size freed by a clean, in bytes.
+     */
+    uint64_t FreedSize;
+
+    /**
+     * The number of items a clean cannot remove.
+     */
+    uint64_t FailedItemCount;
+} NSUDO_SWEEPER_HANDLER_SUMMARY, *PNSUDO_SWEEPER_HANDLER_SUMMARY;
+
+/**
+ * The NSudo Sweeper version 2 cleanup handler.
+ *
+ * @param Request The parameters of the handler.
+ * @param Summary A pointer to a structure that receives the totals. It can
+ *                be NULL.
+ * @return NSUDO_SWEEPER_S_OK if the handler succeeds, the value returned by
+ *         the callback if it cancels the handler, otherwise an error.
+ */
+typedef NSUDO_SWEEPER_RESULT(NSUDO_SWEEPER_API* NSudoSweeperCleanupHandlerV2)(
+    const NSUDO_SWEEPER_HANDLER_REQUEST* Request,
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary);
+
+#endif // !NSUDO_SWEEPER_HANDLER_V2
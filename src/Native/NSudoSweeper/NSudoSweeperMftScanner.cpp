@@ -0,0 +1,1347 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperMftScanner.cpp
+ * PURPOSE:   Implementation for the NTFS master file table scanner
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperMftScanner.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The parts of the on-disk format the scanner uses. All integers are
+ * little-endian.
+ *
+ *   Boot sector      The OEM ID "NTFS    " at 3, the bytes per sector at
+ *                    11, the sectors per cluster at 13, the cluster of the
+ *                    master file table at 48, and the size of a file record
+ *                    at 64, in clusters or as -log2 of the bytes if it is
+ *                    negative.
+ *   File record      The signature "FILE" at 0, the update sequence array
+ *                    at the offset at 4 with the count at 6, the sequence
+ *                    number at 16, the offset of the first attribute at 20,
+ *                    the flags at 22, the used size at 24, and the base
+ *                    record at 32 for an extension record.
+ *   Attribute        The type at 0, the length at 4, the non-resident flag
+ *                    at 8, the name length at 9 and the flags at 12. A
+ *                    resident value has its length at 16 and its offset at
+ *                    20. A non-resident value has its first VCN at 16, the
+ *                    offset of its runs at 32, its allocated size at 40,
+ *                    its size at 48 and its compressed size at 64.
+ *   $FILE_NAME       The parent reference at 0, the name length at 64, the
+ *                    namespace at 65, and the UTF-16 name at 66.
+ *
+ * A file reference has the record number in its low 48 bits and the
+ * sequence number of the record in its high 16 bits.
+ */
+
+struct NSudoSweeper::MftScanner::Table
+{
+    struct Link
+    {
+        std::uint64_t Parent;
+        std::size_t NameOffset;
+        std::uint32_t Owner;
+        std::uint16_t NameLength;
+        std::uint8_t Namespace;
+    };
+
+    std::vector<std::uint64_t> Sizes;
+    std::vector<std::uint64_t> AllocationSizes;
+    std::vector<std::uint32_t> Attributes;
+    std::vector<std::uint16_t> Sequences;
+    std::vector<std::uint8_t> Flags;
+    std::vector<Link> Links;
+    Mile::NativeString Names;
+};
+
+namespace
+{
+    const std::uint32_t FileRecordSignature = 0x454C4946;
+
+    const std::uint32_t StandardInformationAttribute = 0x10;
+    const std::uint32_t AttributeListAttribute = 0x20;
+    const std::uint32_t FileNameAttribute = 0x30;
+    const std::uint32_t DataAttribute = 0x80;
+    const std::uint32_t EndAttribute = 0xFFFFFFFF;
+
+    const std::uint16_t RecordInUse = 0x0001;
+    const std::uint16_t RecordIsDirectory = 0x0002;
+
+    const std::uint16_t AttributeCompressed = 0x0001;
+    const std::uint16_t AttributeSparse = 0x8000;
+
+    const std::uint8_t DosNamespace = 2;
+
+    const std::uint32_t ReparsePointFileAttribute = 0x00000400;
+
+    /**
+     * The flags of a record in the table.
+     */
+    const std::uint8_t TableInUse = 0x01;
+    const std::uint8_t TableDirectory = 0x02;
+    const std::uint8_t TableLongName = 0x04;
+    const std::uint8_t TableVisited = 0x08;
+
+    const std::uint64_t RootDirectoryRecord = 5;
+
+    /**
+     * The records below this number are the metadata files.
+     */
+    const std::uint64_t FirstUserRecord = 16;
+
+    const std::uint64_t RecordNumberMask = 0x0000FFFFFFFFFFFFULL;
+
+    /**
+     * The update sequence array protects the last two bytes of every 512
+     * bytes of a record, whatever the size of the sectors is.
+     */
+    const std::size_t UpdateSequenceStride = 512;
+
+    /**
+     * The alignment of the buffers, which the reads of a volume device
+     * need.
+     */
+    const std::size_t BufferAlignment = 4096;
+
+    std::uint16_t LoadUInt16(
+        std::uint8_t const* Source) noexcept
+    {
+        return static_cast<std::uint16_t>(
+            Source[0] | (static_cast<std::uint16_t>(Source[1]) << 8));
+    }
+
+    std::uint32_t LoadUInt32(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    bool IsPowerOfTwo(
+        std::uint64_t Value) noexcept
+    {
+        return Value && !(Value & (Value - 1));
+    }
+
+    /**
+     * A buffer aligned for the reads of a volume device.
+     */
+    class AlignedBuffer
+    {
+    private:
+
+        std::unique_ptr<std::uint8_t[]> m_Storage;
+        std::uint8_t* m_Data;
+
+    public:
+
+        explicit AlignedBuffer(
+            std::size_t Size) :
+            m_Storage(new std::uint8_t[Size + BufferAlignment])
+        {
+            std::uintptr_t Address =
+                reinterpret_cast<std::uintptr_t>(this->m_Storage.get());
+            this->m_Data = this->m_Storage.get() +
+                (BufferAlignment - Address % BufferAlignment) %
+                BufferAlignment;
+        }
+
+        std::uint8_t* Get() const noexcept
+        {
+            return this->m_Data;
+        }
+    };
+
+    /**
+     * Restores the bytes the update sequence array protects.
+     *
+     * @return false if the record has been written partially.
+     */
+    bool ApplyFixups(
+        std::uint8_t* Record,
+        std::size_t Size) noexcept
+    {
+        std::size_t Offset = ::LoadUInt16(Record + 4);
+        std::size_t Count = ::LoadUInt16(Record + 6);
+        if (Count < 2 ||
+            (Count - 1) * UpdateSequenceStride != Size ||
+            Offset + Count * 2 > Size)
+        {
+            return false;
+        }
+
+        std::uint8_t const* Array = Record + Offset;
+        for (std::size_t i = 1; i < Count; ++i)
+        {
+            std::uint8_t* End = Record + i * UpdateSequenceStride - 2;
+            if (End[0] != Array[0] || End[1] != Array[1])
+            {
+                return false;
+            }
+            End[0] = Array[i * 2];
+            End[1] = Array[i * 2 + 1];
+        }
+
+        return true;
+    }
+
+    /**
+     * A run of clusters decoded from a mapping pairs array.
+     */
+    struct DecodedRun
+    {
+        std::uint64_t Vcn;
+        std::uint64_t Lcn;
+        std::uint64_t Length;
+        bool Sparse;
+    };
+
+    /**
+     * Decodes the runs of a non-resident attribute. Each run is a header
+     * byte with the sizes of its length and of its offset, the length in
+     * clusters, and the signed offset from the previous run, which is
+     * missing for a sparse run.
+     */
+    bool DecodeRuns(
+        std::uint8_t const* Data,
+        std::size_t Size,
+        std::uint64_t FirstVcn,
+        std::vector<DecodedRun>& Runs)
+    {
+        std::uint64_t Vcn = FirstVcn;
+        std::uint64_t Lcn = 0;
+        std::size_t Offset = 0;
+        while (Offset < Size)
+        {
+            std::uint8_t Header = Data[Offset++];
+            if (!Header)
+            {
+                return true;
+            }
+
+            std::size_t LengthSize = Header & 0x0F;
+            std::size_t DeltaSize = Header >> 4;
+            if (!LengthSize ||
+                LengthSize > 8 ||
+                DeltaSize > 8 ||
+                LengthSize + DeltaSize > Size - Offset)
+            {
+                return false;
+            }
+
+            std::uint64_t Length = 0;
+            for (std::size_t i = 0; i < LengthSize; ++i)
+            {
+                Length |= static_cast<std::uint64_t>(Data[Offset + i]) <<
+                    (i * 8);
+            }
+            Offset += LengthSize;
+            if (!Length)
+            {
+                return false;
+            }
+
+            DecodedRun Run;
+            Run.Vcn = Vcn;
+            Run.Length = Length;
+            Run.Sparse = !DeltaSize;
+            Run.Lcn = 0;
+            if (DeltaSize)
+            {
+                std::uint64_t Delta = 0;
+                for (std::size_t i = 0; i < DeltaSize; ++i)
+                {
+                    Delta |= static_cast<std::uint64_t>(Data[Offset + i]) <<
+                        (i * 8);
+                }
+                if (DeltaSize < 8 && (Data[Offset + DeltaSize - 1] & 0x80))
+                {
+                    Delta |= ~static_cast<std::uint64_t>(0) << (DeltaSize * 8);
+                }
+                Offset += DeltaSize;
+
+                // The offset is signed, so the sum wraps around.
+                Lcn += Delta;
+                Run.Lcn = Lcn;
+            }
+
+            Runs.push_back(Run);
+            Vcn += Length;
+        }
+
+        return true;
+    }
+
+    /**
+     * Appends a UTF-16 name from a record to a native string.
+     */
+    void AppendName(
+        Mile::NativeString& Target,
+        std::uint8_t const* Source,
+        std::size_t Count)
+    {
+#if defined(_WIN32)
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Target.push_back(static_cast<wchar_t>(::LoadUInt16(Source + i * 2)));
+        }
+#else
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::uint32_t Character = ::LoadUInt16(Source + i * 2);
+            if (Character >= 0xD800 && Character < 0xE000)
+            {
+                std::uint32_t Low = i + 1 < Count
+                    ? ::LoadUInt16(Source + (i + 1) * 2)
+                    : 0;
+                if (Character < 0xDC00 && Low >= 0xDC00 && Low < 0xE000)
+                {
+                    Character = 0x10000 +
+                        ((Character - 0xD800) << 10) +
+                        (Low - 0xDC00);
+                    ++i;
+                }
+                else
+                {
+                    // The names are not validated by the file system.
+                    Character = 0xFFFD;
+                }
+            }
+
+            if (Character < 0x80)
+            {
+                Target.push_back(static_cast<char>(Character));
+            }
+            else if (Character < 0x800)
+            {
+                Target.push_back(static_cast<char>(0xC0 | (Character >> 6)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else if (Character < 0x10000)
+            {
+                Target.push_back(static_cast<char>(0xE0 | (Character >> 12)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else
+            {
+                Target.push_back(static_cast<char>(0xF0 | (Character >> 18)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 12) & 0x3F)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+        }
+#endif
+    }
+
+    /**
+     * Walks the attributes of a file record whose fixups are applied.
+     *
+     * @return false if an attribute is malformed.
+     */
+    template<typename Callback>
+    bool ForEachAttribute(
+        std::uint8_t const* Record,
+        std::size_t Size,
+        Callback&& Function)
+    {
+        std::size_t Used = (std::min)(
+            static_cast<std::size_t>(::LoadUInt32(Record + 24)),
+            Size);
+        std::size_t Offset = ::LoadUInt16(Record + 20);
+        while (Offset + 8 <= Used)
+        {
+            std::uint8_t const* Attribute = Record + Offset;
+            std::uint32_t Type = ::LoadUInt32(Attribute);
+            if (Type == EndAttribute)
+            {
+                return true;
+            }
+
+            std::size_t Length = ::LoadUInt32(Attribute + 4);
+            if (Length < 24 || Length > Used - Offset || (Length & 7))
+            {
+                return false;
+            }
+
+            if (!Function(Type, Attribute, Length))
+            {
+                return false;
+            }
+            Offset += Length;
+        }
+        return true;
+    }
+
+    /**
+     * Retrieves the value of a resident attribute.
+     *
+     * @return false if the attribute is not resident or malformed.
+     */
+    bool GetResidentValue(
+        std::uint8_t const* Attribute,
+        std::size_t Length,
+        std::uint8_t const*& Value,
+        std::size_t& ValueLength) noexcept
+    {
+        if (Attribute[8])
+        {
+            return false;
+        }
+
+        ValueLength = ::LoadUInt32(Attribute + 16);
+        std::size_t ValueOffset = ::LoadUInt16(Attribute + 20);
+        if (ValueOffset > Length || ValueLength > Length - ValueOffset)
+        {
+            return false;
+        }
+
+        Value = Attribute + ValueOffset;
+        return true;
+    }
+
+    /**
+     * Decodes the runs of a non-resident attribute.
+     */
+    bool GetNonResidentRuns(
+        std::uint8_t const* Attribute,
+        std::size_t Length,
+        std::vector<DecodedRun>& Runs)
+    {
+        if (!Attribute[8] || Length < 64)
+        {
+            return false;
+        }
+
+        std::size_t RunsOffset = ::LoadUInt16(Attribute + 32);
+        if (RunsOffset > Length)
+        {
+            return false;
+        }
+
+        return ::DecodeRuns(
+            Attribute + RunsOffset,
+            Length - RunsOffset,
+            ::LoadUInt64(Attribute + 16),
+            Runs);
+    }
+}
+
+NSudoSweeper::MftScanner::MftScanner(
+    MftScannerOptions const& Options) :
+    m_Options(Options),
+    m_Statistics()
+{
+    if (!this->m_Options.BatchSize)
+    {
+        this->m_Options.BatchSize = 1;
+    }
+}
+
+NSudoSweeper::MftScanner::~MftScanner()
+{
+    this->Close();
+}
+
+int NSudoSweeper::MftScanner::ReadVolume(
+    std::uint64_t Offset,
+    std::uint8_t* Buffer,
+    std::size_t Size)
+{
+    this->m_Statistics.BytesRead += Size;
+
+#if defined(_WIN32)
+    while (Size)
+    {
+        OVERLAPPED Overlapped = {};
+        Overlapped.Offset = static_cast<DWORD>(Offset);
+        Overlapped.OffsetHigh = static_cast<DWORD>(Offset >> 32);
+
+        DWORD Read = 0;
+        if (!::ReadFile(
+            this->m_File,
+            Buffer,
+            static_cast<DWORD>((std::min)(
+                Size,
+                static_cast<std::size_t>(1) << 30)),
+            &Read,
+            &Overlapped))
+        {
+            return static_cast<int>(::GetLastError());
+        }
+        if (!Read)
+        {
+            return ERROR_HANDLE_EOF;
+        }
+
+        Offset += Read;
+        Buffer += Read;
+        Size -= Read;
+    }
+    return 0;
+#else
+    while (Size)
+    {
+        ssize_t Read = ::pread(
+            this->m_File,
+            Buffer,
+            Size,
+            static_cast<off_t>(Offset));
+        if (Read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        if (!Read)
+        {
+            return EIO;
+        }
+
+        Offset += static_cast<std::uint64_t>(Read);
+        Buffer += Read;
+        Size -= static_cast<std::size_t>(Read);
+    }
+    return 0;
+#endif
+}
+
+int NSudoSweeper::MftScanner::ReadRecord(
+    std::uint64_t Number,
+    std::uint8_t* Buffer)
+{
+    std::uint64_t Offset = Number * this->m_RecordSize;
+    std::size_t Remaining = this->m_RecordSize;
+    while (Remaining)
+    {
+        std::uint64_t Vcn = Offset / this->m_ClusterSize;
+        Run const* Current = nullptr;
+        for (Run const& Candidate : this->m_Runs)
+        {
+            if (Vcn >= Candidate.Vcn && Vcn - Candidate.Vcn < Candidate.Length)
+            {
+                Current = &Candidate;
+                break;
+            }
+        }
+        if (!Current)
+        {
+#if defined(_WIN32)
+            return ERROR_FILE_CORRUPT;
+#else
+            return EIO;
+#endif
+        }
+
+        std::uint64_t RunOffset = Offset -
+            Current->Vcn * this->m_ClusterSize;
+        std::size_t Size = static_cast<std::size_t>((std::min)(
+            static_cast<std::uint64_t>(Remaining),
+            Current->Length * this->m_ClusterSize - RunOffset));
+        if (Current->Sparse)
+        {
+            std::memset(Buffer, 0, Size);
+        }
+        else if (int Error = this->ReadVolume(
+            Current->Lcn * this->m_ClusterSize + RunOffset,
+            Buffer,
+            Size))
+        {
+            return Error;
+        }
+
+        Offset += Size;
+        Buffer += Size;
+        Remaining -= Size;
+    }
+    return 0;
+}
+
+bool NSudoSweeper::MftScanner::LoadTableRuns(
+    std::uint8_t* Record,
+    MftScannerError& Error)
+{
+    Error.Message = "The master file table is damaged";
+
+    if (::LoadUInt32(Record) != FileRecordSignature ||
+        !::ApplyFixups(Record, this->m_RecordSize) ||
+        !(::LoadUInt16(Record + 22) & RecordInUse))
+    {
+        return false;
+    }
+
+    std::vector<DecodedRun> Runs;
+    std::uint64_t DataSize = 0;
+    bool HasData = false;
+    std::vector<std::uint8_t> AttributeList;
+    bool HasAttributeList = false;
+    std::vector<DecodedRun> AttributeListRuns;
+    std::uint64_t AttributeListSize = 0;
+
+    auto CollectData = [&](
+        std::uint32_t Type,
+        std::uint8_t const* Attribute,
+        std::size_t Length)
+    {
+        if (Type != DataAttribute || Attribute[9])
+        {
+            return true;
+        }
+        if (!::GetNonResidentRuns(Attribute, Length, Runs))
+        {
+            return false;
+        }
+        if (!::LoadUInt64(Attribute + 16))
+        {
+            DataSize = ::LoadUInt64(Attribute + 48);
+            HasData = true;
+        }
+        return true;
+    };
+
+    if (!::ForEachAttribute(Record, this->m_RecordSize, [&](
+        std::uint32_t Type,
+        std::uint8_t const* Attribute,
+        std::size_t Length)
+    {
+        if (Type == AttributeListAttribute)
+        {
+            HasAttributeList = true;
+            std::uint8_t const* Value = nullptr;
+            std::size_t ValueLength = 0;
+            if (::GetResidentValue(Attribute, Length, Value, ValueLength))
+            {
+                AttributeList.assign(Value, Value + ValueLength);
+                return true;
+            }
+            AttributeListSize = ::LoadUInt64(Attribute + 48);
+            return ::GetNonResidentRuns(Attribute, Length, AttributeListRuns);
+        }
+        return CollectData(Type, Attribute, Length);
+    }))
+    {
+        return false;
+    }
+
+    // The runs of the first extent locate the records which hold the
+    // runs of the other extents.
+    auto SetRuns = [this](
+        std::vector<DecodedRun> const& Source)
+    {
+        this->m_Runs.clear();
+        for (DecodedRun const& Current : Source)
+        {
+            this->m_Runs.push_back(Run{
+                Current.Vcn,
+                Current.Lcn,
+                Current.Length,
+                Current.Sparse });
+        }
+    };
+    SetRuns(Runs);
+
+    if (HasAttributeList)
+    {
+        if (AttributeList.empty())
+        {
+            // A long attribute list is stored in its own clusters.
+            if (AttributeListSize > 16 * 1024 * 1024)
+            {
+                return false;
+            }
+            AttributeList.resize(static_cast<std::size_t>(AttributeListSize));
+            std::size_t Offset = 0;
+            for (DecodedRun const& Current : AttributeListRuns)
+            {
+                if (Offset >= AttributeList.size())
+                {
+                    break;
+                }
+                std::size_t Size = static_cast<std::size_t>((std::min)(
+                    static_cast<std::uint64_t>(AttributeList.size() - Offset),
+                    Current.Length * this->m_ClusterSize));
+                AlignedBuffer Buffer(static_cast<std::size_t>(
+                    Current.Length * this->m_ClusterSize));
+                if (!Current.Sparse)
+                {
+                    Error.SystemError = this->ReadVolume(
+                        Current.Lcn * this->m_ClusterSize,
+                        Buffer.Get(),
+                        static_cast<std::size_t>(
+                            Current.Length * this->m_ClusterSize));
+                    if (Error.SystemError)
+                    {
+                        return false;
+                    }
+                    std::memcpy(&AttributeList[Offset], Buffer.Get(), Size);
+                }
+                Offset += Size;
+            }
+        }
+
+        // Each entry names the record which holds a part of an attribute.
+        std::vector<std::uint64_t> Extensions;
+        std::size_t Offset = 0;
+        while (Offset + 26 <= AttributeList.size())
+        {
+            std::uint8_t const* Entry = &AttributeList[Offset];
+            std::size_t Length = ::LoadUInt16(Entry + 4);
+            if (Length < 26 || Length > AttributeList.size() - Offset)
+            {
+                return false;
+            }
+
+            std::uint64_t Number = ::LoadUInt64(Entry + 16) & RecordNumberMask;
+            if (::LoadUInt32(Entry) == DataAttribute &&
+                !Entry[6] &&
+                Number &&
+                std::find(
+                    Extensions.begin(),
+                    Extensions.end(),
+                    Number) == Extensions.end())
+            {
+                Extensions.push_back(Number);
+            }
+            Offset += Length;
+        }
+
+        AlignedBuffer Buffer(this->m_RecordSize);
+        for (std::uint64_t Number : Extensions)
+        {
+            Error.SystemError = this->ReadRecord(Number, Buffer.Get());
+            if (Error.SystemError ||
+                ::LoadUInt32(Buffer.Get()) != FileRecordSignature ||
+                !::ApplyFixups(Buffer.Get(), this->m_RecordSize) ||
+                (::LoadUInt64(Buffer.Get() + 32) & RecordNumberMask) ||
+                !::ForEachAttribute(
+                    Buffer.Get(),
+                    this->m_RecordSize,
+                    CollectData))
+            {
+                return false;
+            }
+        }
+
+        std::sort(Runs.begin(), Runs.end(), [](
+            DecodedRun const& Left,
+            DecodedRun const& Right)
+        {
+            return Left.Vcn < Right.Vcn;
+        });
+        SetRuns(Runs);
+    }
+
+    // The extents must cover the records without gaps.
+    std::uint64_t Vcn = 0;
+    for (Run const& Current : this->m_Runs)
+    {
+        if (Current.Vcn != Vcn)
+        {
+            return false;
+        }
+        Vcn += Current.Length;
+    }
+
+    if (!HasData ||
+        DataSize / this->m_ClusterSize > Vcn ||
+        DataSize / this->m_RecordSize > UINT32_MAX)
+    {
+        return false;
+    }
+    this->m_RecordCount = DataSize / this->m_RecordSize;
+
+    Error.Message = nullptr;
+    return true;
+}
+
+bool NSudoSweeper::MftScanner::Open(
+    Mile::NativeString const& Path,
+    MftScannerError& Error)
+{
+    Error = MftScannerError();
+
+    this->Close();
+
+#if defined(_WIN32)
+    HANDLE FileHandle = ::CreateFileW(
+        Path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if (FileHandle == INVALID_HANDLE_VALUE)
+    {
+        Error.SystemError = static_cast<int>(::GetLastError());
+        Error.Message = "The volume cannot be opened";
+        return false;
+    }
+    this->m_File = FileHandle;
+#else
+    this->m_File = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->m_File == -1)
+    {
+        Error.SystemError = errno;
+        Error.Message = "The volume cannot be opened";
+        return false;
+    }
+#endif
+
+    // A device reads whole sectors, which are at most 4096 bytes.
+    AlignedBuffer Boot(4096);
+    Error.SystemError = this->ReadVolume(0, Boot.Get(), 4096);
+    if (Error.SystemError)
+    {
+        Error.Message = "The boot sector cannot be read";
+        this->Close();
+        return false;
+    }
+
+    std::uint8_t const* Sector = Boot.Get();
+    std::uint32_t SectorSize = ::LoadUInt16(Sector + 11);
+    std::uint32_t SectorsPerCluster = Sector[13];
+    if (SectorsPerCluster > 0x80)
+    {
+        // Large clusters are stored as a negative power of two.
+        SectorsPerCluster = 1U << (256 - SectorsPerCluster);
+    }
+    std::uint64_t ClusterSize =
+        static_cast<std::uint64_t>(SectorSize) * SectorsPerCluster;
+    std::int8_t RecordSizeValue = static_cast<std::int8_t>(Sector[64]);
+    std::uint64_t RecordSize = RecordSizeValue > 0
+        ? RecordSizeValue * ClusterSize
+        : (RecordSizeValue > -31
+            ? static_cast<std::uint64_t>(1) << -RecordSizeValue
+            : 0);
+
+    if (0 != std::memcmp(Sector + 3, "NTFS    ", 8) ||
+        SectorSize < 256 ||
+        SectorSize > 4096 ||
+        !::IsPowerOfTwo(SectorSize) ||
+        !::IsPowerOfTwo(ClusterSize) ||
+        ClusterSize > 2 * 1024 * 1024 ||
+        !::IsPowerOfTwo(RecordSize) ||
+        RecordSize < UpdateSequenceStride ||
+        RecordSize > 64 * 1024)
+    {
+        Error.Message = "The volume is not an NTFS volume";
+        this->Close();
+        return false;
+    }
+
+    this->m_SectorSize = SectorSize;
+    this->m_ClusterSize = static_cast<std::uint32_t>(ClusterSize);
+    this->m_RecordSize = static_cast<std::uint32_t>(RecordSize);
+
+    AlignedBuffer Record(this->m_RecordSize);
+    Error.SystemError = this->ReadVolume(
+        ::LoadUInt64(Sector + 48) * ClusterSize,
+        Record.Get(),
+        this->m_RecordSize);
+    if (Error.SystemError)
+    {
+        Error.Message = "The master file table cannot be read";
+        this->Close();
+        return false;
+    }
+
+    if (!this->LoadTableRuns(Record.Get(), Error))
+    {
+        this->Close();
+        return false;
+    }
+
+    this->m_Statistics = MftScannerStatistics();
+    this->m_Statistics.ClusterSize = this->m_ClusterSize;
+    this->m_Statistics.RecordSize = this->m_RecordSize;
+    this->m_Statistics.Records = this->m_RecordCount;
+    return true;
+}
+
+void NSudoSweeper::MftScanner::Close() noexcept
+{
+#if defined(_WIN32)
+    if (this->m_File)
+    {
+        ::CloseHandle(this->m_File);
+        this->m_File = nullptr;
+    }
+#else
+    if (this->m_File != -1)
+    {
+        ::close(this->m_File);
+        this->m_File = -1;
+    }
+#endif
+
+    this->m_Runs.clear();
+    this->m_RecordCount = 0;
+}
+
+void NSudoSweeper::MftScanner::SetRootPath(
+    Mile::NativeString const& Path)
+{
+    this->m_RootPath = Path;
+}
+
+void NSudoSweeper::MftScanner::AddFilter(
+    MftScannerFilter Filter)
+{
+    this->m_Filters.push_back(std::move(Filter));
+}
+
+void NSudoSweeper::MftScanner::SetBatchHandler(
+    TreeWalkerBatchHandler Handler)
+{
+    this->m_BatchHandler = std::move(Handler);
+}
+
+void NSudoSweeper::MftScanner::ParseRecord(
+    std::uint8_t* Record,
+    std::uint64_t Number,
+    Table& Files)
+{
+    std::uint32_t Signature = ::LoadUInt32(Record);
+    if (Signature != FileRecordSignature)
+    {
+        // The records which have never been used are empty.
+        if (Signature)
+        {
+            ++this->m_Statistics.DamagedRecords;
+        }
+        return;
+    }
+
+    std::uint16_t Flags = ::LoadUInt16(Record + 22);
+    if (!(Flags & RecordInUse))
+    {
+        return;
+    }
+
+    if (!::ApplyFixups(Record, this->m_RecordSize))
+    {
+        ++this->m_Statistics.DamagedRecords;
+        return;
+    }
+
+    // The attributes of an extension record belong to its base record.
+    std::uint64_t Owner = ::LoadUInt64(Record + 32) & RecordNumberMask;
+    if (!Owner)
+    {
+        Owner = Number;
+        ++this->m_Statistics.UsedRecords;
+        Files.Sequences[Owner] = ::LoadUInt16(Record + 16);
+        Files.Flags[Owner] |= TableInUse;
+        if (Flags & RecordIsDirectory)
+        {
+            Files.Flags[Owner] |= TableDirectory;
+        }
+    }
+    else if (Owner >= this->m_RecordCount)
+    {
+        ++this->m_Statistics.DamagedRecords;
+        return;
+    }
+
+    if (!::ForEachAttribute(Record, this->m_RecordSize, [&](
+        std::uint32_t Type,
+        std::uint8_t const* Attribute,
+        std::size_t Length)
+    {
+        std::uint8_t const* Value = nullptr;
+        std::size_t ValueLength = 0;
+
+        if (Type == StandardInformationAttribute)
+        {
+            if (::GetResidentValue(Attribute, Length, Value, ValueLength) &&
+                ValueLength >= 36)
+            {
+                Files.Attributes[Owner] = ::LoadUInt32(Value + 32);
+            }
+        }
+        else if (Type == FileNameAttribute)
+        {
+            if (!::GetResidentValue(Attribute, Length, Value, ValueLength) ||
+                ValueLength < 66 ||
+                ValueLength < 66 + Value[64] * static_cast<std::size_t>(2))
+            {
+                return false;
+            }
+
+            Table::Link Link;
+            Link.Parent = ::LoadUInt64(Value);
+            Link.NameOffset = Files.Names.size();
+            Link.Owner = static_cast<std::uint32_t>(Owner);
+            Link.Namespace = Value[65];
+            ::AppendName(Files.Names, Value + 66, Value[64]);
+            Link.NameLength = static_cast<std::uint16_t>(
+                Files.Names.size() - Link.NameOffset);
+            Files.Links.push_back(Link);
+
+            if (Link.Namespace != DosNamespace)
+            {
+                Files.Flags[Owner] |= TableLongName;
+            }
+        }
+        else if (Type == DataAttribute && !Attribute[9])
+        {
+            if (::GetResidentValue(Attribute, Length, Value, ValueLength))
+            {
+                // A small file is stored in its record.
+                Files.Sizes[Owner] = ValueLength;
+                Files.AllocationSizes[Owner] = 0;
+            }
+            else if (Attribute[8] &&
+                Length >= 64 &&
+                !::LoadUInt64(Attribute + 16))
+            {
+                std::uint16_t AttributeFlags = ::LoadUInt16(Attribute + 12);
+                Files.Sizes[Owner] = ::LoadUInt64(Attribute + 48);
+                Files.AllocationSizes[Owner] =
+                    (AttributeFlags & (AttributeCompressed | AttributeSparse)) &&
+                    Length >= 72
+                    ? ::LoadUInt64(Attribute + 64)
+                    : ::LoadUInt64(Attribute + 40);
+            }
+        }
+        return true;
+    }))
+    {
+        ++this->m_Statistics.DamagedRecords;
+    }
+}
+
+bool NSudoSweeper::MftScanner::WalkTable(
+    Table& Files)
+{
+    const std::size_t RecordCount = static_cast<std::size_t>(
+        this->m_RecordCount);
+
+    if (RecordCount <= RootDirectoryRecord ||
+        (Files.Flags[RootDirectoryRecord] & (TableInUse | TableDirectory)) !=
+        (TableInUse | TableDirectory))
+    {
+        return false;
+    }
+
+    // Index the links by their parents, so the tree is walked from the
+    // root and the paths are built once for each directory.
+    const std::uint32_t NoParent = UINT32_MAX;
+    std::vector<std::uint32_t> Parents(Files.Links.size(), NoParent);
+    std::vector<std::size_t> FirstChildren(RecordCount + 1, 0);
+    for (std::size_t i = 0; i < Files.Links.size(); ++i)
+    {
+        Table::Link const& Link = Files.Links[i];
+        std::uint8_t OwnerFlags = Files.Flags[Link.Owner];
+        std::uint64_t Parent = Link.Parent & RecordNumberMask;
+        std::uint16_t Sequence = static_cast<std::uint16_t>(Link.Parent >> 48);
+
+        if (!(OwnerFlags & TableInUse) ||
+            Parent == Link.Owner ||
+            (Link.Namespace == DosNamespace && (OwnerFlags & TableLongName)) ||
+            (!this->m_Options.IncludeMetadata &&
+                Link.Owner < FirstUserRecord &&
+                Link.Owner != RootDirectoryRecord))
+        {
+            continue;
+        }
+
+        if (Parent >= RecordCount ||
+            (Files.Flags[Parent] & (TableInUse | TableDirectory)) !=
+            (TableInUse | TableDirectory) ||
+            (Sequence && Sequence != Files.Sequences[Parent]))
+        {
+            ++this->m_Statistics.OrphanedNames;
+            continue;
+        }
+
+        Parents[i] = static_cast<std::uint32_t>(Parent);
+        ++FirstChildren[Parent + 1];
+    }
+    for (std::size_t i = 0; i < RecordCount; ++i)
+    {
+        FirstChildren[i + 1] += FirstChildren[i];
+    }
+    std::vector<std::uint32_t> Children(FirstChildren[RecordCount]);
+    {
+        std::vector<std::size_t> Next(
+            FirstChildren.begin(),
+            FirstChildren.end() - 1);
+        for (std::size_t i = 0; i < Files.Links.size(); ++i)
+        {
+            if (Parents[i] != NoParent)
+            {
+                Children[Next[Parents[i]]++] = static_cast<std::uint32_t>(i);
+            }
+        }
+    }
+
+    struct PendingDirectory
+    {
+        std::uint32_t Record;
+        std::uint32_t Depth;
+        Mile::NativeString Path;
+    };
+
+    std::vector<PendingDirectory> Pending;
+    Pending.push_back(PendingDirectory{
+        static_cast<std::uint32_t>(RootDirectoryRecord),
+        0,
+        this->m_RootPath.empty()
+            ? Mile::NativeString(1, NSudoSweeper::PathSeparator)
+            : this->m_RootPath });
+    Files.Flags[RootDirectoryRecord] |= TableVisited;
+
+    std::vector<TreeWalkerItem> Batch;
+    Batch.reserve(this->m_Options.BatchSize);
+    auto DeliverBatch = [&]()
+    {
+        this->m_Statistics.ReportedEntries += Batch.size();
+        if (this->m_BatchHandler && !Batch.empty())
+        {
+            this->m_BatchHandler(Batch);
+        }
+        Batch.clear();
+    };
+
+    while (!Pending.empty())
+    {
+        if (this->m_Canceled.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+
+        PendingDirectory Current = std::move(Pending.back());
+        Pending.pop_back();
+        ++this->m_Statistics.Directories;
+
+        const std::size_t FirstSubdirectory = Pending.size();
+        for (std::size_t i = FirstChildren[Current.Record];
+            i < FirstChildren[Current.Record + 1];
+            ++i)
+        {
+            Table::Link const& Link = Files.Links[Children[i]];
+            ++this->m_Statistics.Entries;
+
+            Mile::NativeStringView Name(
+                Files.Names.data() + Link.NameOffset,
+                Link.NameLength);
+
+            Mile::FileEntryType Type = Mile::FileEntryType::File;
+            if (Files.Attributes[Link.Owner] & ReparsePointFileAttribute)
+            {
+                Type = Mile::FileEntryType::Link;
+            }
+            else if (Files.Flags[Link.Owner] & TableDirectory)
+            {
+                Type = Mile::FileEntryType::Directory;
+            }
+
+            TreeWalkerFilterResult Decision = TreeWalkerFilterResult::Include;
+            for (MftScannerFilter const& Filter : this->m_Filters)
+            {
+                Decision = Filter(Current.Path, Name, Type);
+                if (Decision != TreeWalkerFilterResult::Include)
+                {
+                    break;
+                }
+            }
+            if (Decision == TreeWalkerFilterResult::Prune)
+            {
+                continue;
+            }
+
+            Mile::NativeString Path =
+                NSudoSweeper::JoinPath(Current.Path, Name);
+
+            if (Type == Mile::FileEntryType::Directory &&
+                !(Files.Flags[Link.Owner] & TableVisited))
+            {
+                Files.Flags[Link.Owner] |= TableVisited;
+                Pending.push_back(PendingDirectory{
+                    Link.Owner,
+                    Current.Depth + 1,
+                    Path });
+            }
+
+            if (Decision == TreeWalkerFilterResult::Skip)
+            {
+                continue;
+            }
+
+            TreeWalkerItem Item;
+            Item.Path = std::move(Path);
+            Item.Type = Type;
+            Item.Depth = Current.Depth;
+            Item.FileId = Link.Owner |
+                (static_cast<std::uint64_t>(Files.Sequences[Link.Owner]) << 48);
+            Item.Size = Files.Sizes[Link.Owner];
+            Item.AllocationSize = Files.AllocationSizes[Link.Owner];
+            Batch.push_back(std::move(Item));
+
+            if (Batch.size() >= this->m_Options.BatchSize)
+            {
+                DeliverBatch();
+            }
+        }
+
+        // Walk the first subdirectory next, as a tree walker does.
+        std::reverse(Pending.begin() + FirstSubdirectory, Pending.end());
+    }
+
+    DeliverBatch();
+    return true;
+}
+
+bool NSudoSweeper::MftScanner::Scan(
+    MftScannerError& Error)
+{
+    Error = MftScannerError();
+
+    MftScannerStatistics& Statistics = this->m_Statistics;
+    Statistics = MftScannerStatistics();
+    Statistics.ClusterSize = this->m_ClusterSize;
+    Statistics.RecordSize = this->m_RecordSize;
+    Statistics.Records = this->m_RecordCount;
+
+    if (!this->m_RecordCount)
+    {
+        Error.Message = "The volume is not open";
+        return false;
+    }
+
+    this->m_Canceled.store(false, std::memory_order_relaxed);
+
+    const std::size_t RecordCount = static_cast<std::size_t>(
+        this->m_RecordCount);
+    Table Files;
+    Files.Sizes.resize(RecordCount);
+    Files.AllocationSizes.resize(RecordCount);
+    Files.Attributes.resize(RecordCount);
+    Files.Sequences.resize(RecordCount);
+    Files.Flags.resize(RecordCount);
+
+    // Each read holds whole clusters and whole records, and the records
+    // which cross the end of an extent are completed by the next one.
+    const std::size_t Unit = (std::max)(
+        this->m_ClusterSize,
+        this->m_RecordSize);
+    const std::size_t ReadSize = (std::max)(
+        this->m_Options.ReadSize / Unit * Unit,
+        Unit);
+    AlignedBuffer Buffer(ReadSize + this->m_RecordSize);
+
+    const std::uint64_t TableSize = this->m_RecordCount * this->m_RecordSize;
+    std::uint64_t Number = 0;
+    std::size_t Pending = 0;
+    for (Run const& Current : this->m_Runs)
+    {
+        const std::uint64_t RunSize = Current.Length * this->m_ClusterSize;
+        std::uint64_t RunOffset = 0;
+        while (RunOffset < RunSize && Number < this->m_RecordCount)
+        {
+            if (this->m_Canceled.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+
+            std::uint64_t Needed = TableSize -
+                Number * this->m_RecordSize -
+                Pending;
+            Needed = (Needed + this->m_ClusterSize - 1) /
+                this->m_ClusterSize * this->m_ClusterSize;
+            std::size_t Size = static_cast<std::size_t>((std::min)(
+                (std::min)(
+                    static_cast<std::uint64_t>(ReadSize),
+                    RunSize - RunOffset),
+                Needed));
+
+            if (Current.Sparse)
+            {
+                std::memset(Buffer.Get() + Pending, 0, Size);
+            }
+            else
+            {
+                Error.SystemError = this->ReadVolume(
+                    Current.Lcn * this->m_ClusterSize + RunOffset,
+                    Buffer.Get() + Pending,
+                    Size);
+                if (Error.SystemError)
+                {
+                    Error.Message = "The master file table cannot be read";
+                    return false;
+                }
+            }
+            RunOffset += Size;
+
+            std::size_t Available = Pending + Size;
+            std::size_t Offset = 0;
+            while (Available - Offset >= this->m_RecordSize &&
+                Number < this->m_RecordCount)
+            {
+                this->ParseRecord(Buffer.Get() + Offset, Number++, Files);
+                Offset += this->m_RecordSize;
+            }
+
+            Pending = Available - Offset;
+            std::memmove(Buffer.Get(), Buffer.Get() + Offset, Pending);
+        }
+    }
+
+    if (Number < this->m_RecordCount)
+    {
+        Error.Message = "The master file table is damaged";
+        return false;
+    }
+
+    if (!this->WalkTable(Files))
+    {
+        Error.Message = "The root directory is damaged";
+        return false;
+    }
+
+    return !this->m_Canceled.load(std::memory_order_relaxed);
+}
+
+void NSudoSweeper::MftScanner::Cancel() noexcept
+{
+    this->m_Canceled.store(true, std::memory_order_relaxed);
+}
@@ -0,0 +1,281 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperMftScanner.h
+ * PURPOSE:   Definition for the NTFS master file table scanner
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_MFT_SCANNER
+#define NSUDO_SWEEPER_MFT_SCANNER
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.FileEnumerator.h>
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * A filter called for every entry the MFT scanner finds, before it is
+     * reported, in the same way as a tree walker filter.
+     *
+     * @param DirectoryPath The path of the directory which contains the
+     *                      entry.
+     * @param Name The name of the entry.
+     * @param Type The type of the entry.
+     * @return The decision about the entry.
+     */
+    typedef std::function<TreeWalkerFilterResult(
+        Mile::NativeStringView DirectoryPath,
+        Mile::NativeStringView Name,
+        Mile::FileEntryType Type)> MftScannerFilter;
+
+    /**
+     * The options of the MFT scanner.
+     */
+    struct MftScannerOptions
+    {
+        /**
+         * The size of each read of the master file table, in bytes.
+         */
+        std::size_t ReadSize = 4 * 1024 * 1024;
+
+        /**
+         * The number of entries delivered to the batch handler at a time.
+         */
+        std::size_t BatchSize = 1024;
+
+        /**
+         * Reports the metadata files of the volume, such as $MFT and the
+         * files below $Extend.
+         */
+        bool IncludeMetadata = false;
+    };
+
+    /**
+     * The error of an MFT scanner operation.
+     */
+    struct MftScannerError
+    {
+        /**
+         * The system error code if the volume cannot be read, which is a
+         * Win32 error code on Windows and an errno value elsewhere.
+         */
+        int SystemError = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * The statistics of an MFT scan.
+     */
+    struct MftScannerStatistics
+    {
+        /**
+         * The size of a cluster and of a file record, in bytes.
+         */
+        std::uint32_t ClusterSize;
+        std::uint32_t RecordSize;
+
+        /**
+         * The number of file records of the master file table, and the
+         * number of them which are in use.
+         */
+        std::uint64_t Records;
+        std::uint64_t UsedRecords;
+
+        /**
+         * The number of file records which fail their update sequence
+         * check or have malformed attributes.
+         */
+        std::uint64_t DamagedRecords;
+
+        /**
+         * The number of names whose parent directory does not exist.
+         */
+        std::uint64_t OrphanedNames;
+
+        std::uint64_t Directories;
+        std::uint64_t Entries;
+        std::uint64_t ReportedEntries;
+
+        std::uint64_t BytesRead;
+    };
+
+    /**
+     * Finds the files of an NTFS volume by reading its master file table
+     * directly, which is much faster than enumerating its directories. It
+     * reads the file records in large sequential reads, takes the names and
+     * the parents from their $FILE_NAME attributes and the sizes from their
+     * $DATA attributes, and then walks the rebuilt tree from the root
+     * directory.
+     *
+     * The parser only uses byte-level operations, so it reads images of
+     * NTFS volumes on any platform, and volume devices such as "\\.\D:" on
+     * Windows, which need administrative privileges. A volume which is
+     * mounted and changing may be read inconsistently, and the records
+     * which do not pass their checks are skipped.
+     *
+     * Each hard link is reported as an entry. The short names are only
+     * used for the files without a long name.
+     */
+    class MftScanner : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Table;
+
+        /**
+         * A run of contiguous clusters of the master file table.
+         */
+        struct Run
+        {
+            std::uint64_t Vcn;
+            std::uint64_t Lcn;
+            std::uint64_t Length;
+            bool Sparse;
+        };
+
+        MftScannerOptions m_Options;
+        Mile::NativeString m_RootPath;
+        std::vector<MftScannerFilter> m_Filters;
+        TreeWalkerBatchHandler m_BatchHandler;
+
+#if defined(_WIN32)
+        void* m_File = nullptr;
+#else
+        int m_File = -1;
+#endif
+        std::uint32_t m_SectorSize = 0;
+        std::uint32_t m_ClusterSize = 0;
+        std::uint32_t m_RecordSize = 0;
+        std::uint64_t m_RecordCount = 0;
+        std::vector<Run> m_Runs;
+
+        std::atomic<bool> m_Canceled{ false };
+        MftScannerStatistics m_Statistics;
+
+        int ReadVolume(
+            std::uint64_t Offset,
+            std::uint8_t* Buffer,
+            std::size_t Size);
+
+        int ReadRecord(
+            std::uint64_t Number,
+            std::uint8_t* Buffer);
+
+        bool LoadTableRuns(
+            std::uint8_t* Record,
+            MftScannerError& Error);
+
+        void ParseRecord(
+            std::uint8_t* Record,
+            std::uint64_t Number,
+            Table& Files);
+
+        bool WalkTable(
+            Table& Files);
+
+    public:
+
+        /**
+         * Creates the scanner.
+         *
+         * @param Options The options of the scanner.
+         */
+        explicit MftScanner(
+            MftScannerOptions const& Options = MftScannerOptions());
+
+        /**
+         * Closes the volume.
+         */
+        ~MftScanner();
+
+        /**
+         * Opens an NTFS volume and locates its master file table.
+         *
+         * @param Path The path of the volume device or of the image file.
+         * @param Error The error if it fails.
+         * @return true if successful, otherwise false.
+         */
+        bool Open(
+            Mile::NativeString const& Path,
+            MftScannerError& Error);
+
+        /**
+         * Closes the volume.
+         */
+        void Close() noexcept;
+
+        /**
+         * Sets the path where the root directory of the volume is reported,
+         * such as its mount point or the root of an offline image.
+         *
+         * @param Path The path of the root directory.
+         */
+        void SetRootPath(
+            Mile::NativeString const& Path);
+
+        /**
+         * Adds a filter. The filters are called in the order they are added,
+         * and the first decision other than Include is used.
+         *
+         * @param Filter The filter.
+         */
+        void AddFilter(
+            MftScannerFilter Filter);
+
+        /**
+         * Sets the handler which receives the found entries. The calls come
+         * from the thread which calls Scan.
+         *
+         * @param Handler The handler.
+         */
+        void SetBatchHandler(
+            TreeWalkerBatchHandler Handler);
+
+        /**
+         * Reads the master file table and reports the entries below the
+         * root directory.
+         *
+         * @param Error The error if it fails.
+         * @return true if the scan completed, or false if it failed or was
+         *         canceled, in which case Error.Message is nullptr.
+         * @remark The handlers may throw, which stops the scan, and the
+         *         exception is rethrown.
+         */
+        bool Scan(
+            MftScannerError& Error);
+
+        /**
+         * Cancels the scan. It can be called from any thread, including the
+         * filters and handlers.
+         */
+        void Cancel() noexcept;
+
+        /**
+         * Retrieves the statistics of the last scan.
+         *
+         * @return The statistics of the last scan.
+         */
+        MftScannerStatistics GetStatistics() const noexcept
+        {
+            return this->m_Statistics;
+        }
+    };
+}
+
+#endif // !NSUDO_SWEEPER_MFT_SCANNER
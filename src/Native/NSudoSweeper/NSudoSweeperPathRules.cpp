@@ -0,0 +1,737 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRules.cpp
+ * PURPOSE:   Implementation for the compiled path rule automaton
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperPathRules.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <Mile.Portable.CaseInsensitive.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+namespace
+{
+    enum class PathRuleTokenType : std::uint8_t
+    {
+        Character,
+        Separator,
+        AnyCharacter,
+        AnyString,
+        AnyPath,
+
+        // Matches nothing, and either enters the following "**" or skips it
+        // and the separator after it.
+        Branch,
+    };
+
+    typedef std::make_unsigned<Mile::NativeChar>::type NativeUnit;
+
+    /**
+     * The number of characters the deterministic states must have matched
+     * per state before they are discarded and built again. RE2 uses 10, but
+     * a state here costs more to build.
+     */
+    const std::uint64_t MinimumCharactersPerState = 50;
+
+    /**
+     * Maps a character to the code unit the automaton sees, which folds its
+     * case and maps every path separator to the canonical one.
+     *
+     * @param Character The character.
+     * @return The normalized code unit.
+     */
+    std::uint32_t Normalize(
+        Mile::NativeChar Character) noexcept
+    {
+        if (NSudoSweeper::IsPathSeparator(Character))
+        {
+            return static_cast<std::uint32_t>(NSudoSweeper::PathSeparator);
+        }
+        return static_cast<NativeUnit>(Mile::CaseInsensitiveFold(Character));
+    }
+
+    /**
+     * Normalizes the characters in a range and merges the results into
+     * ranges of consecutive code units.
+     *
+     * @param First The first code unit of the range.
+     * @param Last The last code unit of the range.
+     * @param Ranges The array which receives the normalized ranges.
+     */
+    void AddNormalizedRange(
+        std::uint32_t First,
+        std::uint32_t Last,
+        std::vector<std::pair<std::uint32_t, std::uint32_t>>& Ranges)
+    {
+        std::vector<std::uint32_t> Units;
+        Units.reserve(Last - First + 1);
+        for (std::uint32_t Unit = First; Unit <= Last; ++Unit)
+        {
+            Units.push_back(::Normalize(static_cast<Mile::NativeChar>(Unit)));
+        }
+        std::sort(Units.begin(), Units.end());
+        Units.erase(std::unique(Units.begin(), Units.end()), Units.end());
+
+        for (std::size_t i = 0; i < Units.size();)
+        {
+            std::size_t j = i + 1;
+            while (j < Units.size() && Units[j] == Units[j - 1] + 1)
+            {
+                ++j;
+            }
+            Ranges.emplace_back(Units[i], Units[j - 1]);
+            i = j;
+        }
+    }
+}
+
+struct NSudoSweeper::PathRuleSet::Token
+{
+    PathRuleTokenType Type;
+
+    // The set of a Character token is negated.
+    bool Negated = false;
+
+    // The normalized code units matched by a Character token.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> Ranges;
+
+    // Whether the token matches each character class. It is built by
+    // Compile.
+    std::vector<bool> Accept;
+
+    bool IsRepeated() const noexcept
+    {
+        return this->Type == PathRuleTokenType::AnyString ||
+            this->Type == PathRuleTokenType::AnyPath;
+    }
+};
+
+struct NSudoSweeper::PathRuleSet::Rule
+{
+    std::uint32_t Group;
+    PathRuleKind Kind;
+    std::vector<Token> Tokens;
+};
+
+struct NSudoSweeper::PathRuleSet::State
+{
+    // The sorted states of the nondeterministic automaton.
+    std::vector<std::uint32_t> NfaStates;
+
+    std::vector<std::uint32_t> Rules;
+    std::vector<std::uint32_t> SelectedGroups;
+
+    // A Detect or Include rule has not failed yet.
+    bool Reachable = false;
+
+    std::unique_ptr<std::atomic<State*>[]> Transitions;
+};
+
+NSudoSweeper::PathRuleSet::PathRuleSet(
+    std::size_t MaximumStates) :
+    m_MaximumStates(std::max<std::size_t>(MaximumStates, 2))
+{
+    this->Compile();
+}
+
+NSudoSweeper::PathRuleSet::~PathRuleSet() = default;
+
+std::uint32_t NSudoSweeper::PathRuleSet::AddRule(
+    std::uint32_t Group,
+    PathRuleKind Kind,
+    Mile::NativeStringView Pattern)
+{
+    Rule Current;
+    Current.Group = Group;
+    Current.Kind = Kind;
+
+    for (std::size_t i = 0; i < Pattern.size(); ++i)
+    {
+        Token Item;
+
+        Mile::NativeChar Character = Pattern[i];
+        if (Character == '*')
+        {
+            std::size_t Count = 1;
+            while (i + 1 < Pattern.size() && Pattern[i + 1] == '*')
+            {
+                ++Count;
+                ++i;
+            }
+
+            if (Count == 1)
+            {
+                // "**" absorbs an adjacent "*".
+                if (!Current.Tokens.empty() && Current.Tokens.back().IsRepeated())
+                {
+                    continue;
+                }
+                Item.Type = PathRuleTokenType::AnyString;
+            }
+            else
+            {
+                if (!Current.Tokens.empty() && Current.Tokens.back().IsRepeated())
+                {
+                    Current.Tokens.pop_back();
+                }
+                if (i + 1 < Pattern.size() &&
+                    NSudoSweeper::IsPathSeparator(Pattern[i + 1]))
+                {
+                    Token Branch;
+                    Branch.Type = PathRuleTokenType::Branch;
+                    Current.Tokens.push_back(std::move(Branch));
+                }
+                Item.Type = PathRuleTokenType::AnyPath;
+            }
+        }
+        else if (Character == '?')
+        {
+            Item.Type = PathRuleTokenType::AnyCharacter;
+        }
+        else if (NSudoSweeper::IsPathSeparator(Character))
+        {
+            Item.Type = PathRuleTokenType::Separator;
+        }
+        else
+        {
+            Item.Type = PathRuleTokenType::Character;
+
+            // Find the end of a set. A "]" right after "[" or "[!" belongs to
+            // the set.
+            std::size_t Start = i + 1;
+            if (Character == '[' && Start < Pattern.size() &&
+                Pattern[Start] == '!')
+            {
+                Item.Negated = true;
+                ++Start;
+            }
+            std::size_t End = Start + 1;
+            while (Character == '[' && End < Pattern.size() &&
+                Pattern[End] != ']')
+            {
+                ++End;
+            }
+
+            if (Character == '[' && End < Pattern.size())
+            {
+                for (std::size_t j = Start; j < End; ++j)
+                {
+                    std::uint32_t First = static_cast<NativeUnit>(Pattern[j]);
+                    std::uint32_t Last = First;
+                    if (j + 2 < End && Pattern[j + 1] == '-')
+                    {
+                        Last = static_cast<NativeUnit>(Pattern[j + 2]);
+                        j += 2;
+                    }
+                    if (First <= Last)
+                    {
+                        ::AddNormalizedRange(First, Last, Item.Ranges);
+                    }
+                }
+                i = End;
+            }
+            else
+            {
+                Item.Negated = false;
+                Item.Ranges.emplace_back(
+                    ::Normalize(Character),
+                    ::Normalize(Character));
+            }
+        }
+
+        Current.Tokens.push_back(std::move(Item));
+    }
+
+    this->m_Rules.push_back(std::move(Current));
+    return static_cast<std::uint32_t>(this->m_Rules.size() - 1);
+}
+
+void NSudoSweeper::PathRuleSet::Compile()
+{
+    // Split the code units into classes which no rule can tell apart. The
+    // boundaries are the first code units of the classes, except the first
+    // class which starts from 0.
+    this->m_Boundaries.clear();
+    const std::uint32_t Separator =
+        static_cast<std::uint32_t>(NSudoSweeper::PathSeparator);
+    this->m_Boundaries.push_back(Separator);
+    this->m_Boundaries.push_back(Separator + 1);
+    for (Rule const& Current : this->m_Rules)
+    {
+        for (Token const& Item : Current.Tokens)
+        {
+            for (auto const& Range : Item.Ranges)
+            {
+                this->m_Boundaries.push_back(Range.first);
+                this->m_Boundaries.push_back(Range.second + 1);
+            }
+        }
+    }
+    std::sort(this->m_Boundaries.begin(), this->m_Boundaries.end());
+    this->m_Boundaries.erase(
+        std::unique(this->m_Boundaries.begin(), this->m_Boundaries.end()),
+        this->m_Boundaries.end());
+    this->m_ClassCount = this->m_Boundaries.size() + 1;
+
+    for (std::uint32_t Unit = 0; Unit < 256; ++Unit)
+    {
+        this->m_SmallClasses[Unit] = static_cast<std::uint32_t>(
+            std::upper_bound(
+                this->m_Boundaries.begin(),
+                this->m_Boundaries.end(),
+                Unit) - this->m_Boundaries.begin());
+    }
+    this->m_SeparatorClass = this->m_SmallClasses[Separator];
+
+    auto GetUnitClass = [this](std::uint32_t Unit) -> std::size_t
+    {
+        return std::upper_bound(
+            this->m_Boundaries.begin(),
+            this->m_Boundaries.end(),
+            Unit) - this->m_Boundaries.begin();
+    };
+
+    this->m_NfaRules.clear();
+    this->m_NfaTokens.clear();
+    for (std::size_t i = 0; i < this->m_Rules.size(); ++i)
+    {
+        for (Token& Item : this->m_Rules[i].Tokens)
+        {
+            Item.Accept.assign(this->m_ClassCount, false);
+            switch (Item.Type)
+            {
+            case PathRuleTokenType::Character:
+                // The boundaries split the classes at both ends of every
+                // range, so a range covers whole classes.
+                for (auto const& Range : Item.Ranges)
+                {
+                    std::size_t Last = GetUnitClass(Range.second);
+                    for (std::size_t Class = GetUnitClass(Range.first);
+                        Class <= Last;
+                        ++Class)
+                    {
+                        Item.Accept[Class] = true;
+                    }
+                }
+                if (Item.Negated)
+                {
+                    Item.Accept.flip();
+                }
+                Item.Accept[this->m_SeparatorClass] = false;
+                break;
+            case PathRuleTokenType::Separator:
+                Item.Accept[this->m_SeparatorClass] = true;
+                break;
+            case PathRuleTokenType::AnyCharacter:
+            case PathRuleTokenType::AnyString:
+                Item.Accept.assign(this->m_ClassCount, true);
+                Item.Accept[this->m_SeparatorClass] = false;
+                break;
+            case PathRuleTokenType::AnyPath:
+                Item.Accept.assign(this->m_ClassCount, true);
+                break;
+            default:
+                break;
+            }
+
+            this->m_NfaRules.push_back(static_cast<std::uint32_t>(i));
+            this->m_NfaTokens.push_back(&Item);
+        }
+
+        // The state after the last token accepts the path.
+        this->m_NfaRules.push_back(static_cast<std::uint32_t>(i));
+        this->m_NfaTokens.push_back(nullptr);
+    }
+
+    std::vector<std::uint32_t> StartStates;
+    for (std::size_t i = 0; i < this->m_NfaTokens.size(); ++i)
+    {
+        if (i == 0 || !this->m_NfaTokens[i - 1])
+        {
+            StartStates.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+    this->AddClosure(StartStates);
+    this->ResetStates(std::move(StartStates));
+    this->m_CacheResets = 0;
+}
+
+std::size_t NSudoSweeper::PathRuleSet::GetRuleCount() const noexcept
+{
+    return this->m_Rules.size();
+}
+
+std::uint32_t NSudoSweeper::PathRuleSet::GetRuleGroup(
+    std::uint32_t Index) const noexcept
+{
+    return this->m_Rules[Index].Group;
+}
+
+NSudoSweeper::PathRuleKind NSudoSweeper::PathRuleSet::GetRuleKind(
+    std::uint32_t Index) const noexcept
+{
+    return this->m_Rules[Index].Kind;
+}
+
+std::size_t NSudoSweeper::PathRuleSet::GetClass(
+    Mile::NativeChar Character) const noexcept
+{
+    std::uint32_t Unit = ::Normalize(Character);
+    if (Unit < 256)
+    {
+        return this->m_SmallClasses[Unit];
+    }
+    return std::upper_bound(
+        this->m_Boundaries.begin(),
+        this->m_Boundaries.end(),
+        Unit) - this->m_Boundaries.begin();
+}
+
+void NSudoSweeper::PathRuleSet::AddClosure(
+    std::vector<std::uint32_t>& NfaStates) const
+{
+    // The states only lead to later states of the same rule, so the loop
+    // terminates.
+    for (std::size_t i = 0; i < NfaStates.size(); ++i)
+    {
+        std::uint32_t Current = NfaStates[i];
+        Token const* Item = this->m_NfaTokens[Current];
+        if (!Item)
+        {
+            continue;
+        }
+        if (Item->IsRepeated())
+        {
+            NfaStates.push_back(Current + 1);
+        }
+        else if (Item->Type == PathRuleTokenType::Branch)
+        {
+            // Enter the "**", or skip it and the separator after it.
+            NfaStates.push_back(Current + 1);
+            NfaStates.push_back(Current + 3);
+        }
+    }
+
+    std::sort(NfaStates.begin(), NfaStates.end());
+    NfaStates.erase(
+        std::unique(NfaStates.begin(), NfaStates.end()),
+        NfaStates.end());
+}
+
+void NSudoSweeper::PathRuleSet::Advance(
+    std::vector<std::uint32_t> const& Current,
+    std::size_t Class,
+    std::vector<std::uint32_t>& Next) const
+{
+    Next.clear();
+    for (std::uint32_t NfaState : Current)
+    {
+        Token const* Item = this->m_NfaTokens[NfaState];
+        if (Item && Item->Accept[Class])
+        {
+            Next.push_back(Item->IsRepeated() ? NfaState : NfaState + 1);
+        }
+    }
+    this->AddClosure(Next);
+}
+
+std::unique_ptr<NSudoSweeper::PathRuleSet::State>
+NSudoSweeper::PathRuleSet::CreateState(
+    std::vector<std::uint32_t>&& NfaStates) const
+{
+    std::unique_ptr<State> Result(new State());
+    Result->NfaStates = std::move(NfaStates);
+
+    std::vector<std::uint32_t> IncludedGroups;
+    std::vector<std::uint32_t> ExcludedGroups;
+    for (std::uint32_t NfaState : Result->NfaStates)
+    {
+        std::uint32_t Index = this->m_NfaRules[NfaState];
+        Rule const& Current = this->m_Rules[Index];
+        if (Current.Kind != PathRuleKind::Exclude)
+        {
+            Result->Reachable = true;
+        }
+        if (this->m_NfaTokens[NfaState])
+        {
+            continue;
+        }
+
+        Result->Rules.push_back(Index);
+        if (Current.Kind == PathRuleKind::Include)
+        {
+            IncludedGroups.push_back(Current.Group);
+        }
+        else if (Current.Kind == PathRuleKind::Exclude)
+        {
+            ExcludedGroups.push_back(Current.Group);
+        }
+    }
+
+    // A group may have several matching rules of a kind, and one matching
+    // Exclude rule removes the group however many Include rules match, so
+    // the groups are made unique before the difference.
+    std::sort(IncludedGroups.begin(), IncludedGroups.end());
+    IncludedGroups.erase(
+        std::unique(IncludedGroups.begin(), IncludedGroups.end()),
+        IncludedGroups.end());
+    std::sort(ExcludedGroups.begin(), ExcludedGroups.end());
+    ExcludedGroups.erase(
+        std::unique(ExcludedGroups.begin(), ExcludedGroups.end()),
+        ExcludedGroups.end());
+    std::set_difference(
+        IncludedGroups.begin(),
+        IncludedGroups.end(),
+        ExcludedGroups.begin(),
+        ExcludedGroups.end(),
+        std::back_inserter(Result->SelectedGroups));
+
+    Result->Transitions.reset(new std::atomic<State*>[this->m_ClassCount]);
+    for (std::size_t i = 0; i < this->m_ClassCount; ++i)
+    {
+        Result->Transitions[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    return Result;
+}
+
+NSudoSweeper::PathRuleSet::State*
+NSudoSweeper::PathRuleSet::GetOrCreateState(
+    std::vector<std::uint32_t>&& NfaStates) const
+{
+    auto Iterator = this->m_StateIndex.find(NfaStates);
+    if (Iterator != this->m_StateIndex.end())
+    {
+        return Iterator->second;
+    }
+
+    if (this->m_States.size() >= this->m_MaximumStates)
+    {
+        return nullptr;
+    }
+
+    this->m_States.push_back(this->CreateState(std::move(NfaStates)));
+    State* Result = this->m_States.back().get();
+    this->m_StateIndex.emplace(Result->NfaStates, Result);
+    return Result;
+}
+
+NSudoSweeper::PathRuleSet::State*
+NSudoSweeper::PathRuleSet::ResolveTransition(
+    State* Current,
+    std::size_t Class) const
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    State* Next = Current->Transitions[Class].load(std::memory_order_relaxed);
+    if (Next)
+    {
+        return Next;
+    }
+
+    std::vector<std::uint32_t> NfaStates;
+    this->Advance(Current->NfaStates, Class, NfaStates);
+    Next = NfaStates.empty()
+        ? this->m_Dead
+        : this->GetOrCreateState(std::move(NfaStates));
+    if (Next)
+    {
+        // The state is fully built before it is published.
+        Current->Transitions[Class].store(Next, std::memory_order_release);
+    }
+    return Next;
+}
+
+void NSudoSweeper::PathRuleSet::ResetStates(
+    std::vector<std::uint32_t>&& StartStates) const
+{
+    this->m_States.clear();
+    this->m_StateIndex.clear();
+
+    this->m_Dead = this->GetOrCreateState(std::vector<std::uint32_t>());
+    for (std::size_t i = 0; i < this->m_ClassCount; ++i)
+    {
+        this->m_Dead->Transitions[i].store(this->m_Dead);
+    }
+
+    this->m_Start = this->GetOrCreateState(std::move(StartStates));
+}
+
+void NSudoSweeper::PathRuleSet::ResetCache() const
+{
+    Mile::AutoExclusiveLock<Mile::SharedMutex> Lock(this->m_CacheMutex);
+
+    // Another thread may have reset the states while this one was waiting
+    // for the lock.
+    if (this->m_States.size() < this->m_MaximumStates)
+    {
+        return;
+    }
+
+    std::vector<std::uint32_t> StartStates = this->m_Start->NfaStates;
+    this->ResetStates(std::move(StartStates));
+    ++this->m_CacheResets;
+    this->m_CachedCharacters.store(0, std::memory_order_relaxed);
+}
+
+template<typename VisitorType>
+void NSudoSweeper::PathRuleSet::Run(
+    Mile::NativeStringView Path,
+    bool AppendSeparator,
+    VisitorType&& Visitor) const
+{
+    const std::size_t Length = Path.size() + (AppendSeparator ? 1 : 0);
+    std::size_t Position = 0;
+
+    // The states of the nondeterministic automaton where the matching
+    // resumes after the deterministic states have been reset.
+    std::vector<std::uint32_t> Resume;
+    bool Reset = false;
+
+    for (;;)
+    {
+        {
+            Mile::AutoSharedLock<Mile::SharedMutex> Lock(this->m_CacheMutex);
+
+            State* Current = this->m_Start;
+            if (Reset)
+            {
+                Mile::AutoLock<Mile::Mutex> StateLock(this->m_Mutex);
+                Current = this->GetOrCreateState(
+                    std::vector<std::uint32_t>(Resume));
+            }
+
+            const std::size_t First = Position;
+            for (; Current && Position < Length; ++Position)
+            {
+                if (Current == this->m_Dead)
+                {
+                    break;
+                }
+
+                std::size_t Class = Position < Path.size()
+                    ? this->GetClass(Path[Position])
+                    : this->m_SeparatorClass;
+
+                State* Next = Current->Transitions[Class].load(
+                    std::memory_order_acquire);
+                if (!Next)
+                {
+                    Next = this->ResolveTransition(Current, Class);
+                }
+                if (!Next)
+                {
+                    break;
+                }
+                Current = Next;
+            }
+
+            std::uint64_t CachedCharacters =
+                this->m_CachedCharacters.fetch_add(
+                    Position - First,
+                    std::memory_order_relaxed) + (Position - First);
+
+            if (Current &&
+                (Position == Length || Current == this->m_Dead))
+            {
+                Visitor(*Current);
+                return;
+            }
+
+            if (Current)
+            {
+                Resume = Current->NfaStates;
+            }
+
+            // A reset is not worth it if the states would be rebuilt faster
+            // than they are used, or if even the new states cannot hold the
+            // path.
+            if ((Reset && Position == First) ||
+                CachedCharacters <
+                ::MinimumCharactersPerState * this->m_MaximumStates)
+            {
+                // Simulate the nondeterministic automaton for the rest of
+                // the path.
+                std::vector<std::uint32_t> NextNfaStates;
+                for (; Position < Length && !Resume.empty(); ++Position)
+                {
+                    this->Advance(
+                        Resume,
+                        Position < Path.size()
+                        ? this->GetClass(Path[Position])
+                        : this->m_SeparatorClass,
+                        NextNfaStates);
+                    Resume.swap(NextNfaStates);
+                }
+                std::unique_ptr<State> Detached =
+                    this->CreateState(std::move(Resume));
+                Visitor(*Detached);
+                return;
+            }
+        }
+
+        // The deterministic states are exhausted, so discard them and
+        // continue from the current position with new ones.
+        this->ResetCache();
+        Reset = true;
+    }
+}
+
+bool NSudoSweeper::PathRuleSet::Match(
+    Mile::NativeStringView Path,
+    PathRuleMatch& Result) const
+{
+    this->Run(Path, false, [&Result](State const& Final)
+    {
+        Result.Rules = Final.Rules;
+        Result.SelectedGroups = Final.SelectedGroups;
+    });
+    return !Result.SelectedGroups.empty();
+}
+
+bool NSudoSweeper::PathRuleSet::IsSelected(
+    Mile::NativeStringView Path) const
+{
+    bool Result = false;
+    this->Run(Path, false, [&Result](State const& Final)
+    {
+        Result = !Final.SelectedGroups.empty();
+    });
+    return Result;
+}
+
+bool NSudoSweeper::PathRuleSet::MayMatchBelow(
+    Mile::NativeStringView DirectoryPath) const
+{
+    bool AppendSeparator = DirectoryPath.empty() ||
+        !NSudoSweeper::IsPathSeparator(DirectoryPath.back());
+
+    bool Result = false;
+    this->Run(DirectoryPath, AppendSeparator, [&Result](State const& Final)
+    {
+        Result = Final.Reachable;
+    });
+    return Result;
+}
+
+std::size_t NSudoSweeper::PathRuleSet::GetStateCount() const
+{
+    Mile::AutoSharedLock<Mile::SharedMutex> Lock(this->m_CacheMutex);
+    Mile::AutoLock<Mile::Mutex> StateLock(this->m_Mutex);
+    return this->m_States.size();
+}
+
+std::size_t NSudoSweeper::PathRuleSet::GetCacheResetCount() const
+{
+    Mile::AutoSharedLock<Mile::SharedMutex> Lock(this->m_CacheMutex);
+    return this->m_CacheResets;
+}
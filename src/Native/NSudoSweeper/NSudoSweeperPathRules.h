@@ -0,0 +1,265 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRules.h
+ * PURPOSE:   Definition for the compiled path rule automaton
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_PATH_RULES
+#define NSUDO_SWEEPER_PATH_RULES
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.Synchronization.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The kind of a path rule. It matches the key of the rule in the handler
+     * configuration file.
+     */
+    enum class PathRuleKind : std::uint8_t
+    {
+        Detect,
+        Include,
+        Exclude,
+    };
+
+    /**
+     * The result of matching a path against a path rule set.
+     */
+    struct PathRuleMatch
+    {
+        /**
+         * The indexes of the matched rules, in ascending order.
+         */
+        std::vector<std::uint32_t> Rules;
+
+        /**
+         * The groups which select the path, in ascending order. A group
+         * selects a path if one of its Include rules matches the path and
+         * none of its Exclude rules does.
+         */
+        std::vector<std::uint32_t> SelectedGroups;
+    };
+
+    /**
+     * A set of path rules compiled into a single case-insensitive automaton,
+     * so a path is matched against all rules in one pass over its
+     * characters.
+     *
+     * The rules are glob patterns which match whole paths:
+     *
+     *   *      Matches any characters except the path separator.
+     *   **     Matches any characters, including the path separator. "**\"
+     *          also matches nothing, so "C:\A\**\*.log" matches
+     *          "C:\A\B.log".
+     *   ?      Matches a character except the path separator.
+     *   [...]  Matches a character in the set, such as "[abc]" or "[0-9]".
+     *          "[!...]" matches a character not in the set. A set never
+     *          matches the path separator. Use "[*]", "[?]" and "[[]" to
+     *          match these characters literally.
+     *
+     * Other characters match themselves without regard to case. On Windows,
+     * both "\" and "/" are path separators and match each other.
+     *
+     * The rules are compiled into a nondeterministic automaton whose
+     * deterministic states are built lazily while matching and shared by all
+     * threads, so the cost of a path is a table lookup per character once the
+     * states it visits have been built.
+     */
+    class PathRuleSet : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    public:
+
+        /**
+         * The default maximum number of deterministic states. When the limit
+         * is reached, the states are discarded and built again from where
+         * the matching is, like RE2 does. Also like RE2, matching falls back
+         * to simulating the nondeterministic automaton, which is slower but
+         * needs no memory, if the states have matched too few characters
+         * since they were last discarded, because they would be rebuilt
+         * faster than they are used.
+         */
+        static const std::size_t DefaultMaximumStates = 4096;
+
+    private:
+
+        struct Token;
+        struct Rule;
+        struct State;
+
+        std::vector<Rule> m_Rules;
+        std::vector<std::uint32_t> m_NfaRules;
+        std::vector<Token const*> m_NfaTokens;
+        std::vector<std::uint32_t> m_Boundaries;
+        std::uint32_t m_SmallClasses[256];
+        std::size_t m_ClassCount = 0;
+        std::size_t m_SeparatorClass = 0;
+        std::size_t m_MaximumStates;
+
+        // Matching holds the cache lock shared while it walks the states,
+        // and the states are only discarded while it is held exclusively.
+        // The mutex serializes building the states.
+        mutable Mile::SharedMutex m_CacheMutex;
+        mutable Mile::Mutex m_Mutex;
+        mutable std::vector<std::unique_ptr<State>> m_States;
+        mutable std::map<std::vector<std::uint32_t>, State*> m_StateIndex;
+        mutable State* m_Start = nullptr;
+        mutable State* m_Dead = nullptr;
+        mutable std::size_t m_CacheResets = 0;
+        mutable std::atomic<std::uint64_t> m_CachedCharacters{ 0 };
+
+        std::size_t GetClass(
+            Mile::NativeChar Character) const noexcept;
+
+        void AddClosure(
+            std::vector<std::uint32_t>& NfaStates) const;
+
+        void Advance(
+            std::vector<std::uint32_t> const& Current,
+            std::size_t Class,
+            std::vector<std::uint32_t>& Next) const;
+
+        std::unique_ptr<State> CreateState(
+            std::vector<std::uint32_t>&& NfaStates) const;
+
+        State* GetOrCreateState(
+            std::vector<std::uint32_t>&& NfaStates) const;
+
+        State* ResolveTransition(
+            State* Current,
+            std::size_t Class) const;
+
+        void ResetStates(
+            std::vector<std::uint32_t>&& StartStates) const;
+
+        void ResetCache() const;
+
+        template<typename VisitorType>
+        void Run(
+            Mile::NativeStringView Path,
+            bool AppendSeparator,
+            VisitorType&& Visitor) const;
+
+    public:
+
+        /**
+         * Creates an empty rule set.
+         *
+         * @param MaximumStates The maximum number of deterministic states.
+         */
+        explicit PathRuleSet(
+            std::size_t MaximumStates = DefaultMaximumStates);
+
+        ~PathRuleSet();
+
+        /**
+         * Adds a rule. Call Compile after adding the rules.
+         *
+         * @param Group The group of the rule, such as the index of the
+         *              handler which defines it. Include and Exclude rules
+         *              only affect the rules of the same group.
+         * @param Kind The kind of the rule.
+         * @param Pattern The glob pattern of the rule. A "[" without a
+         *                closing "]" matches itself.
+         * @return The index of the rule.
+         */
+        std::uint32_t AddRule(
+            std::uint32_t Group,
+            PathRuleKind Kind,
+            Mile::NativeStringView Pattern);
+
+        /**
+         * Compiles the rules. It must be called after the rules are added
+         * and before the rule set is matched, and it must not be called
+         * concurrently with the matching.
+         */
+        void Compile();
+
+        /**
+         * Retrieves the number of rules.
+         *
+         * @return The number of rules.
+         */
+        std::size_t GetRuleCount() const noexcept;
+
+        /**
+         * Retrieves the group of a rule.
+         *
+         * @param Index The index of the rule.
+         * @return The group of the rule.
+         */
+        std::uint32_t GetRuleGroup(
+            std::uint32_t Index) const noexcept;
+
+        /**
+         * Retrieves the kind of a rule.
+         *
+         * @param Index The index of the rule.
+         * @return The kind of the rule.
+         */
+        PathRuleKind GetRuleKind(
+            std::uint32_t Index) const noexcept;
+
+        /**
+         * Matches a path against the rules. It can be called from multiple
+         * threads concurrently.
+         *
+         * @param Path The path.
+         * @param Result The matched rules and the selecting groups.
+         * @return true if a group selects the path, otherwise false.
+         */
+        bool Match(
+            Mile::NativeStringView Path,
+            PathRuleMatch& Result) const;
+
+        /**
+         * Checks whether a group selects a path, without reporting which
+         * rules match. It can be called from multiple threads concurrently.
+         *
+         * @param Path The path.
+         * @return true if a group selects the path, otherwise false.
+         */
+        bool IsSelected(
+            Mile::NativeStringView Path) const;
+
+        /**
+         * Checks whether a rule may match a path below a directory. The tree
+         * walker uses it to prune directories which no rule can reach. It
+         * can be called from multiple threads concurrently.
+         *
+         * @param DirectoryPath The path of the directory.
+         * @return false if no rule matches any path below the directory,
+         *         otherwise true.
+         */
+        bool MayMatchBelow(
+            Mile::NativeStringView DirectoryPath) const;
+
+        /**
+         * Retrieves the number of deterministic states built so far.
+         *
+         * @return The number of deterministic states.
+         */
+        std::size_t GetStateCount() const;
+
+        /**
+         * Retrieves how often the deterministic states have been discarded
+         * because the limit was reached.
+         *
+         * @return The number of times the states have been discarded.
+         */
+        std::size_t GetCacheResetCount() const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_PATH_RULES
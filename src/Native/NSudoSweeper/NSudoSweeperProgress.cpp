@@ -0,0 +1,231 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperProgress.cpp
+ * PURPOSE:   Implementation for the progress aggregator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperProgress.h"
+
+#include <utility>
+
+namespace
+{
+    /**
+     * The minimum time between two samples of the rate, so a snapshot taken
+     * right after another one does not disturb the estimate.
+     */
+    const std::chrono::milliseconds RateSampleInterval(50);
+
+    /**
+     * The weight of the newest sample in the smoothed rate.
+     */
+    const double RateSmoothing = 0.3;
+
+    bool IsSameSnapshot(
+        NSudoSweeper::ProgressSnapshot const& Left,
+        NSudoSweeper::ProgressSnapshot const& Right) noexcept
+    {
+        return Left.Files == Right.Files &&
+            Left.Bytes == Right.Bytes &&
+            Left.Errors == Right.Errors &&
+            Left.Work == Right.Work &&
+            Left.TotalWork == Right.TotalWork &&
+            Left.Percentage == Right.Percentage;
+    }
+}
+
+std::size_t NSudoSweeper::ProgressAggregator::GetThreadIndex() noexcept
+{
+    static std::atomic<std::size_t> NextIndex{ 0 };
+    thread_local std::size_t Index =
+        NextIndex.fetch_add(1, std::memory_order_relaxed);
+    return Index;
+}
+
+void NSudoSweeper::ProgressAggregator::StopPublisher()
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->m_PublisherMutex);
+        this->m_Stopping = true;
+    }
+    this->m_StopRequested.notify_all();
+
+    if (this->m_Publisher.joinable())
+    {
+        this->m_Publisher.join();
+    }
+}
+
+NSudoSweeper::ProgressAggregator::ProgressAggregator(
+    ProgressAggregatorOptions const& Options) :
+    m_Options(Options),
+    m_StartTime(std::chrono::steady_clock::now()),
+    m_RateTime(m_StartTime)
+{
+    std::size_t Count = this->m_Options.Slots;
+    if (!Count)
+    {
+        // Twice the processors, so few threads share a slot.
+        Count = 2 * static_cast<std::size_t>(
+            std::thread::hardware_concurrency());
+    }
+
+    std::size_t Slots = 1;
+    while (Slots < Count)
+    {
+        Slots <<= 1;
+    }
+
+    this->m_Slots.reset(new Slot[Slots]);
+    this->m_SlotMask = Slots - 1;
+
+    if (this->m_Options.Interval.count() <= 0)
+    {
+        this->m_Options.Interval = std::chrono::milliseconds(1);
+    }
+}
+
+NSudoSweeper::ProgressAggregator::~ProgressAggregator()
+{
+    this->StopPublisher();
+}
+
+NSudoSweeper::ProgressSnapshot NSudoSweeper::ProgressAggregator::GetSnapshot()
+{
+    ProgressSnapshot Snapshot;
+    for (std::size_t i = 0; i <= this->m_SlotMask; ++i)
+    {
+        Slot const& Current = this->m_Slots[i];
+        Snapshot.Files += Current.Files.load(std::memory_order_relaxed);
+        Snapshot.Bytes += Current.Bytes.load(std::memory_order_relaxed);
+        Snapshot.Errors += Current.Errors.load(std::memory_order_relaxed);
+        Snapshot.Work += Current.Work.load(std::memory_order_relaxed);
+    }
+    Snapshot.TotalWork = this->m_TotalWork.load(std::memory_order_relaxed);
+
+    std::chrono::steady_clock::time_point Now =
+        std::chrono::steady_clock::now();
+    Snapshot.Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Now - this->m_StartTime);
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+    Snapshot.Completed = this->m_Completed;
+    if (this->m_Completed)
+    {
+        this->m_Percentage = 100;
+    }
+    else if (Snapshot.TotalWork)
+    {
+        // Only the completion reaches 100, even if the total was too low.
+        std::uint64_t Work = Snapshot.Work < Snapshot.TotalWork
+            ? Snapshot.Work
+            : Snapshot.TotalWork;
+        std::uint32_t Percentage = static_cast<std::uint32_t>(
+            Work * 100 / Snapshot.TotalWork);
+        if (Percentage > 99)
+        {
+            Percentage = 99;
+        }
+        if (Percentage > this->m_Percentage)
+        {
+            this->m_Percentage = Percentage;
+        }
+    }
+    Snapshot.Percentage = this->m_Percentage;
+
+    // The rate is smoothed, so the estimate does not jump with every
+    // directory which is faster or slower than the others.
+    std::chrono::duration<double> SampleTime = Now - this->m_RateTime;
+    if (SampleTime >= RateSampleInterval && Snapshot.Work >= this->m_RateWork)
+    {
+        double Rate = static_cast<double>(
+            Snapshot.Work - this->m_RateWork) / SampleTime.count();
+        this->m_Rate = this->m_Rate > 0.0
+            ? (1.0 - RateSmoothing) * this->m_Rate + RateSmoothing * Rate
+            : Rate;
+        this->m_RateWork = Snapshot.Work;
+        this->m_RateTime = Now;
+    }
+
+    if (Snapshot.Completed)
+    {
+        Snapshot.HasEstimate = true;
+    }
+    else if (Snapshot.TotalWork && this->m_Rate > 0.0)
+    {
+        Snapshot.HasEstimate = true;
+        if (Snapshot.TotalWork > Snapshot.Work)
+        {
+            Snapshot.EstimatedRemaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::duration<double>(
+                        static_cast<double>(
+                            Snapshot.TotalWork - Snapshot.Work) /
+                        this->m_Rate));
+        }
+    }
+
+    return Snapshot;
+}
+
+bool NSudoSweeper::ProgressAggregator::Start(
+    ProgressPublishHandler Handler)
+{
+    if (this->m_Publisher.joinable())
+    {
+        return false;
+    }
+
+    this->m_Handler = std::move(Handler);
+    this->m_Stopping = false;
+
+    this->m_Publisher = std::thread([this]()
+    {
+        ProgressSnapshot Last;
+        bool HasLast = false;
+
+        std::unique_lock<std::mutex> Lock(this->m_PublisherMutex);
+        while (!this->m_StopRequested.wait_for(
+            Lock,
+            this->m_Options.Interval,
+            [this]() { return this->m_Stopping; }))
+        {
+            Lock.unlock();
+
+            ProgressSnapshot Snapshot = this->GetSnapshot();
+            if (!HasLast ||
+                this->m_Options.PublishUnchanged ||
+                !::IsSameSnapshot(Snapshot, Last))
+            {
+                this->m_Handler(Snapshot);
+                Last = Snapshot;
+                HasLast = true;
+            }
+
+            Lock.lock();
+        }
+    });
+
+    return true;
+}
+
+void NSudoSweeper::ProgressAggregator::Stop()
+{
+    this->StopPublisher();
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        this->m_Completed = true;
+    }
+
+    if (this->m_Handler)
+    {
+        this->m_Handler(this->GetSnapshot());
+        this->m_Handler = nullptr;
+    }
+}
@@ -0,0 +1,299 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperProgress.h
+ * PURPOSE:   Definition for the progress aggregator
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_PROGRESS
+#define NSUDO_SWEEPER_PROGRESS
+
+#include <Mile.Portable.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace NSudoSweeper
+{
+    /**
+     * The aggregated progress of a task.
+     */
+    struct ProgressSnapshot
+    {
+        /**
+         * The number of files seen.
+         */
+        std::uint64_t Files = 0;
+
+        /**
+         * The number of bytes of the matched items.
+         */
+        std::uint64_t Bytes = 0;
+
+        /**
+         * The number of errors.
+         */
+        std::uint64_t Errors = 0;
+
+        /**
+         * The amount of work done and the total amount of work, in the unit
+         * the task chooses. The total is 0 if it is not known.
+         */
+        std::uint64_t Work = 0;
+        std::uint64_t TotalWork = 0;
+
+        /**
+         * The progress, from 0 to 100. It never decreases, and it only
+         * reaches 100 when the task is completed.
+         */
+        std::uint32_t Percentage = 0;
+
+        /**
+         * Indicates the task is completed.
+         */
+        bool Completed = false;
+
+        /**
+         * Indicates EstimatedRemaining is available, which needs a known
+         * total and some work done.
+         */
+        bool HasEstimate = false;
+
+        /**
+         * The time since the aggregator was created.
+         */
+        std::chrono::milliseconds Elapsed{ 0 };
+
+        /**
+         * The estimated time until the task is completed.
+         */
+        std::chrono::milliseconds EstimatedRemaining{ 0 };
+    };
+
+    /**
+     * Receives the published snapshots. It is called on the publisher
+     * thread, never concurrently.
+     */
+    typedef std::function<void(
+        ProgressSnapshot const& Snapshot)> ProgressPublishHandler;
+
+    /**
+     * The options of the progress aggregator.
+     */
+    struct ProgressAggregatorOptions
+    {
+        /**
+         * The interval between two published snapshots.
+         */
+        std::chrono::milliseconds Interval{ 100 };
+
+        /**
+         * The number of counter slots. If it is 0, it is chosen from the
+         * number of logical processors.
+         */
+        std::size_t Slots = 0;
+
+        /**
+         * Publishes a snapshot every interval even if nothing has changed,
+         * so the handler can cancel the task while it is stalled.
+         */
+        bool PublishUnchanged = false;
+    };
+
+    /**
+     * Aggregates the progress reported by many threads and publishes it at
+     * a fixed rate. Each thread adds to the counters of its own slot, which
+     * has its own cache line, so reporting never takes a lock and the
+     * threads do not contend. A publisher thread sums the slots and calls
+     * the handler once per interval, and only if something has changed, so
+     * the cost of the handler, such as a callback across modules or a
+     * repaint, does not depend on the number of reports.
+     */
+    class ProgressAggregator : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    public:
+
+        struct alignas(64) Slot
+        {
+            std::atomic<std::uint64_t> Files{ 0 };
+            std::atomic<std::uint64_t> Bytes{ 0 };
+            std::atomic<std::uint64_t> Errors{ 0 };
+            std::atomic<std::uint64_t> Work{ 0 };
+        };
+
+        /**
+         * The counters of a thread. Take it once per thread or per batch of
+         * reports to skip the slot lookup.
+         */
+        class Counter
+        {
+        private:
+
+            Slot* m_Slot;
+
+        public:
+
+            explicit Counter(
+                Slot& Target) noexcept :
+                m_Slot(&Target)
+            {
+            }
+
+            void AddFiles(
+                std::uint64_t Value = 1) noexcept
+            {
+                this->m_Slot->Files.fetch_add(
+                    Value,
+                    std::memory_order_relaxed);
+            }
+
+            void AddBytes(
+                std::uint64_t Value) noexcept
+            {
+                this->m_Slot->Bytes.fetch_add(
+                    Value,
+                    std::memory_order_relaxed);
+            }
+
+            void AddErrors(
+                std::uint64_t Value = 1) noexcept
+            {
+                this->m_Slot->Errors.fetch_add(
+                    Value,
+                    std::memory_order_relaxed);
+            }
+
+            void AddWork(
+                std::uint64_t Value = 1) noexcept
+            {
+                this->m_Slot->Work.fetch_add(
+                    Value,
+                    std::memory_order_relaxed);
+            }
+        };
+
+    private:
+
+        ProgressAggregatorOptions m_Options;
+        std::unique_ptr<Slot[]> m_Slots;
+        std::size_t m_SlotMask;
+        std::atomic<std::uint64_t> m_TotalWork{ 0 };
+        std::chrono::steady_clock::time_point m_StartTime;
+
+        std::mutex m_Mutex;
+        std::uint32_t m_Percentage = 0;
+        bool m_Completed = false;
+        double m_Rate = 0.0;
+        std::uint64_t m_RateWork = 0;
+        std::chrono::steady_clock::time_point m_RateTime;
+
+        std::mutex m_PublisherMutex;
+        std::condition_variable m_StopRequested;
+        bool m_Stopping = false;
+        ProgressPublishHandler m_Handler;
+        std::thread m_Publisher;
+
+        void StopPublisher();
+
+        static std::size_t GetThreadIndex() noexcept;
+
+    public:
+
+        /**
+         * Creates the aggregator.
+         *
+         * @param Options The options of the aggregator.
+         */
+        explicit ProgressAggregator(
+            ProgressAggregatorOptions const& Options =
+                ProgressAggregatorOptions());
+
+        /**
+         * Stops the publisher.
+         */
+        ~ProgressAggregator();
+
+        /**
+         * Retrieves the counters of the calling thread.
+         *
+         * @return The counters.
+         */
+        Counter GetCounter() noexcept
+        {
+            return Counter(
+                this->m_Slots[ProgressAggregator::GetThreadIndex() &
+                this->m_SlotMask]);
+        }
+
+        void AddFiles(
+            std::uint64_t Value = 1) noexcept
+        {
+            this->GetCounter().AddFiles(Value);
+        }
+
+        void AddBytes(
+            std::uint64_t Value) noexcept
+        {
+            this->GetCounter().AddBytes(Value);
+        }
+
+        void AddErrors(
+            std::uint64_t Value = 1) noexcept
+        {
+            this->GetCounter().AddErrors(Value);
+        }
+
+        void AddWork(
+            std::uint64_t Value = 1) noexcept
+        {
+            this->GetCounter().AddWork(Value);
+        }
+
+        /**
+         * Sets the total amount of work. It can be raised while the task
+         * runs, such as when more directories are found.
+         *
+         * @param Value The total amount of work.
+         */
+        void SetTotalWork(
+            std::uint64_t Value) noexcept
+        {
+            this->m_TotalWork.store(Value, std::memory_order_relaxed);
+        }
+
+        /**
+         * Sums the counters.
+         *
+         * @return The aggregated progress.
+         */
+        ProgressSnapshot GetSnapshot();
+
+        /**
+         * Starts the publisher thread.
+         *
+         * @param Handler The handler which receives the snapshots.
+         * @return true if the publisher is started, or false if it is
+         *         already running.
+         */
+        bool Start(
+            ProgressPublishHandler Handler);
+
+        /**
+         * Marks the task as completed, stops the publisher thread and
+         * publishes the final snapshot, whose Percentage is 100.
+         */
+        void Stop();
+    };
+}
+
+#endif // !NSUDO_SWEEPER_PROGRESS
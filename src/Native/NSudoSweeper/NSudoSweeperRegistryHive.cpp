@@ -0,0 +1,1328 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHive.cpp
+ * PURPOSE:   Implementation for the offline registry hive reader
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperRegistryHive.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <Mile.Portable.CaseInsensitive.h>
+#include <Mile.Portable.FileEnumerator.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_set>
+#include <utility>
+
+/*
+ * The parts of the regf format the reader uses. All integers are
+ * little-endian.
+ *
+ *   Base block     4096 bytes: "regf" at 0, the two sequence numbers at 4
+ *                  and 8, which differ if the last write was interrupted,
+ *                  the version at 20 and 24, the type at 28, the format at
+ *                  32, the root key at 36, the size of the hive bins at 40,
+ *                  and the XOR checksum of the first 508 bytes at 508.
+ *   Hive bins      The cells, whose offsets are relative to the end of the
+ *                  base block. A cell starts with its size, which is
+ *                  negative if the cell is allocated.
+ *   nk             A key: the flags at 2, the number of subkeys at 20, the
+ *                  subkey list at 28, the number of values at 36, the value
+ *                  list at 40, and the name with its length at 72 at 76.
+ *   lf, lh, li     A subkey list: the count at 2, and the keys with a hint
+ *                  or a hash each, or the keys alone for li.
+ *   ri             A list of subkey lists.
+ *   vk             A value: the name length at 2, the data size at 4 whose
+ *                  high bit marks data stored in place of its offset at 8,
+ *                  the type at 12, the flags at 16 and the name at 20.
+ *   db             The segments of data larger than 16344 bytes: the count
+ *                  at 2 and the segment list at 4.
+ *
+ * A name is Latin-1 if its compressed flag is set, otherwise UTF-16.
+ */
+
+namespace
+{
+    const std::uint32_t BaseBlockSignature = 0x66676572;
+    const std::uint32_t HiveBinSignature = 0x6E696268;
+
+    const std::size_t BaseBlockSize = 4096;
+    const std::size_t ChecksumOffset = 508;
+
+    const std::uint16_t KeySignature = 0x6B6E;
+    const std::uint16_t FastLeafSignature = 0x666C;
+    const std::uint16_t HashLeafSignature = 0x686C;
+    const std::uint16_t IndexLeafSignature = 0x696C;
+    const std::uint16_t IndexRootSignature = 0x6972;
+    const std::uint16_t ValueSignature = 0x6B76;
+    const std::uint16_t BigDataSignature = 0x6264;
+
+    const std::uint16_t KeyCompressedName = 0x0020;
+    const std::uint16_t ValueCompressedName = 0x0001;
+
+    const std::uint32_t ValueDataInline = 0x80000000;
+
+    /**
+     * The largest data of a cell before it is split into segments.
+     */
+    const std::size_t BigDataSegmentSize = 16344;
+
+    const std::size_t KeyNameOffset = 76;
+    const std::size_t ValueNameOffset = 20;
+
+    const std::uint32_t RegistryDwordType = 4;
+
+    std::uint16_t LoadUInt16(
+        std::uint8_t const* Source) noexcept
+    {
+        return static_cast<std::uint16_t>(
+            Source[0] | (static_cast<std::uint16_t>(Source[1]) << 8));
+    }
+
+    std::uint32_t LoadUInt32(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    Mile::NativeString FromAscii(
+        char const* Text)
+    {
+        return Mile::NativeString(Text, Text + std::strlen(Text));
+    }
+
+    char16_t FoldUnit(
+        std::uint32_t Unit) noexcept
+    {
+        return static_cast<char16_t>(
+            Mile::CaseInsensitiveFold(static_cast<wchar_t>(Unit)));
+    }
+
+    /**
+     * Converts a name to folded UTF-16 code units, the form the names of a
+     * hive are compared in.
+     */
+    void ToFoldedUtf16(
+        Mile::NativeStringView Source,
+        std::u16string& Target)
+    {
+        Target.clear();
+#if defined(_WIN32)
+        for (wchar_t Character : Source)
+        {
+            Target.push_back(::FoldUnit(Character));
+        }
+#else
+        for (std::size_t i = 0; i < Source.size(); ++i)
+        {
+            std::uint32_t Character = static_cast<std::uint8_t>(Source[i]);
+            std::size_t Extra = 0;
+            if (Character >= 0xF0 && Character < 0xF8)
+            {
+                Character &= 0x07;
+                Extra = 3;
+            }
+            else if (Character >= 0xE0)
+            {
+                Character &= 0x0F;
+                Extra = 2;
+            }
+            else if (Character >= 0xC0)
+            {
+                Character &= 0x1F;
+                Extra = 1;
+            }
+            else if (Character >= 0x80)
+            {
+                Character = 0xFFFD;
+            }
+
+            if (Extra)
+            {
+                std::size_t Count = 0;
+                while (Count < Extra &&
+                    i + 1 + Count < Source.size() &&
+                    (static_cast<std::uint8_t>(Source[i + 1 + Count]) & 0xC0) ==
+                    0x80)
+                {
+                    Character = (Character << 6) |
+                        (static_cast<std::uint8_t>(Source[i + 1 + Count]) &
+                            0x3F);
+                    ++Count;
+                }
+                i += Count;
+                if (Count != Extra || Character > 0x10FFFF)
+                {
+                    Character = 0xFFFD;
+                }
+            }
+
+            if (Character >= 0x10000)
+            {
+                Character -= 0x10000;
+                Target.push_back(static_cast<char16_t>(
+                    0xD800 + (Character >> 10)));
+                Target.push_back(static_cast<char16_t>(
+                    0xDC00 + (Character & 0x3FF)));
+            }
+            else
+            {
+                Target.push_back(::FoldUnit(Character));
+            }
+        }
+#endif
+    }
+
+    /**
+     * Checks whether a name of a hive equals a folded name.
+     */
+    bool NameEquals(
+        std::uint8_t const* Name,
+        std::size_t Length,
+        bool Compressed,
+        std::u16string const& Folded) noexcept
+    {
+        std::size_t Count = Compressed ? Length : Length / 2;
+        if (Count != Folded.size())
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::uint32_t Unit = Compressed
+                ? Name[i]
+                : ::LoadUInt16(Name + i * 2);
+            if (::FoldUnit(Unit) != Folded[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Appends a name of a hive to a native string.
+     */
+    void AppendName(
+        Mile::NativeString& Target,
+        std::uint8_t const* Name,
+        std::size_t Length,
+        bool Compressed)
+    {
+        std::size_t Count = Compressed ? Length : Length / 2;
+#if defined(_WIN32)
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Target.push_back(static_cast<wchar_t>(Compressed
+                ? Name[i]
+                : ::LoadUInt16(Name + i * 2)));
+        }
+#else
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::uint32_t Character = Compressed
+                ? Name[i]
+                : ::LoadUInt16(Name + i * 2);
+            if (Character >= 0xD800 && Character < 0xE000)
+            {
+                std::uint32_t Low = !Compressed && i + 1 < Count
+                    ? ::LoadUInt16(Name + (i + 1) * 2)
+                    : 0;
+                if (Character < 0xDC00 && Low >= 0xDC00 && Low < 0xE000)
+                {
+                    Character = 0x10000 +
+                        ((Character - 0xD800) << 10) +
+                        (Low - 0xDC00);
+                    ++i;
+                }
+                else
+                {
+                    Character = 0xFFFD;
+                }
+            }
+
+            if (Character < 0x80)
+            {
+                Target.push_back(static_cast<char>(Character));
+            }
+            else if (Character < 0x800)
+            {
+                Target.push_back(static_cast<char>(0xC0 | (Character >> 6)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else if (Character < 0x10000)
+            {
+                Target.push_back(static_cast<char>(0xE0 | (Character >> 12)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else
+            {
+                Target.push_back(static_cast<char>(0xF0 | (Character >> 18)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 12) & 0x3F)));
+                Target.push_back(
+                    static_cast<char>(0x80 | ((Character >> 6) & 0x3F)));
+                Target.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+        }
+#endif
+    }
+
+    /**
+     * Computes the hash of an lh list, which is only reliable for ASCII
+     * names, because the system folds the other characters with its own
+     * table.
+     */
+    bool GetNameHash(
+        std::u16string const& Folded,
+        std::uint32_t& Hash) noexcept
+    {
+        Hash = 0;
+        for (char16_t Unit : Folded)
+        {
+            if (Unit >= 0x80)
+            {
+                return false;
+            }
+            Hash = Hash * 37 + Unit;
+        }
+        return true;
+    }
+
+    /**
+     * Splits the first segment of a registry path from the rest, which
+     * starts at the next segment.
+     */
+    Mile::NativeStringView SplitFirstSegment(
+        Mile::NativeStringView Path,
+        Mile::NativeStringView& Rest) noexcept
+    {
+        std::size_t Separator = Path.find(static_cast<Mile::NativeChar>('\\'));
+        if (Separator == Mile::NativeStringView::npos)
+        {
+            Rest = Mile::NativeStringView();
+            return Path;
+        }
+        Rest = Path.substr(Separator + 1);
+        while (!Rest.empty() && Rest.front() == '\\')
+        {
+            Rest.remove_prefix(1);
+        }
+        return Path.substr(0, Separator);
+    }
+
+    bool SegmentEquals(
+        Mile::NativeStringView Segment,
+        char const* Name)
+    {
+        return Mile::CaseInsensitiveEquals(Segment, ::FromAscii(Name));
+    }
+
+    /**
+     * Appends an ASCII relative path, whose separators are backslashes, to
+     * a directory path.
+     */
+    Mile::NativeString JoinAsciiPath(
+        Mile::NativeString const& DirectoryPath,
+        char const* Name)
+    {
+        Mile::NativeString RelativePath;
+        for (char const* Current = Name; *Current; ++Current)
+        {
+            RelativePath.push_back(*Current == '\\'
+                ? NSudoSweeper::PathSeparator
+                : static_cast<Mile::NativeChar>(*Current));
+        }
+        return NSudoSweeper::JoinPath(DirectoryPath, RelativePath);
+    }
+}
+
+std::uint8_t const* NSudoSweeper::RegistryHive::GetCell(
+    std::uint32_t Offset,
+    std::size_t MinimumSize,
+    std::size_t& Size) const noexcept
+{
+    if (this->m_BinsSize < 4 || Offset > this->m_BinsSize - 4 || (Offset & 3))
+    {
+        return nullptr;
+    }
+
+    // A free cell may hold stale data.
+    std::int32_t CellSize = static_cast<std::int32_t>(
+        ::LoadUInt32(this->m_Bins + Offset));
+    if (CellSize >= 0)
+    {
+        return nullptr;
+    }
+
+    std::size_t Length = static_cast<std::size_t>(
+        -static_cast<std::int64_t>(CellSize));
+    if (Length < 4 ||
+        Length - 4 < MinimumSize ||
+        Length > this->m_BinsSize - Offset)
+    {
+        return nullptr;
+    }
+
+    Size = Length - 4;
+    return this->m_Bins + Offset + 4;
+}
+
+std::uint8_t const* NSudoSweeper::RegistryHive::GetKeyCell(
+    std::uint32_t Key,
+    std::size_t& Size) const noexcept
+{
+    std::uint8_t const* Cell = this->GetCell(Key, KeyNameOffset, Size);
+    if (!Cell ||
+        ::LoadUInt16(Cell) != KeySignature ||
+        ::LoadUInt16(Cell + 72) > Size - KeyNameOffset)
+    {
+        return nullptr;
+    }
+    return Cell;
+}
+
+int NSudoSweeper::RegistryHive::CompareKeyName(
+    std::uint32_t Key,
+    std::u16string const& Name,
+    bool& Valid) const noexcept
+{
+    std::size_t Size = 0;
+    std::uint8_t const* Cell = this->GetKeyCell(Key, Size);
+    if (!Cell)
+    {
+        Valid = false;
+        return 0;
+    }
+
+    bool Compressed = ::LoadUInt16(Cell + 2) & KeyCompressedName;
+    std::size_t Length = ::LoadUInt16(Cell + 72);
+    std::size_t Count = Compressed ? Length : Length / 2;
+    std::uint8_t const* KeyName = Cell + KeyNameOffset;
+    for (std::size_t i = 0; i < Count && i < Name.size(); ++i)
+    {
+        char16_t Unit = ::FoldUnit(Compressed
+            ? KeyName[i]
+            : ::LoadUInt16(KeyName + i * 2));
+        if (Unit != Name[i])
+        {
+            return Unit < Name[i] ? -1 : 1;
+        }
+    }
+
+    return Count < Name.size() ? -1 : (Count > Name.size() ? 1 : 0);
+}
+
+std::uint32_t NSudoSweeper::RegistryHive::FindSubkey(
+    std::uint32_t List,
+    std::u16string const& Name,
+    std::uint32_t Depth) const
+{
+    std::size_t Size = 0;
+    std::uint8_t const* Cell = this->GetCell(List, 4, Size);
+    if (!Cell)
+    {
+        return RegistryHiveNoKey;
+    }
+
+    std::uint16_t Signature = ::LoadUInt16(Cell);
+    std::size_t Count = ::LoadUInt16(Cell + 2);
+    std::size_t Stride = (Signature == FastLeafSignature ||
+        Signature == HashLeafSignature) ? 8 : 4;
+    if (Count * Stride > Size - 4)
+    {
+        return RegistryHiveNoKey;
+    }
+    auto GetOffset = [Cell, Stride](
+        std::size_t Index)
+    {
+        return ::LoadUInt32(Cell + 4 + Index * Stride);
+    };
+
+    // The lists are sorted by the uppercase names, so a key is found by a
+    // binary search, and a list with a damaged key is searched one by one.
+    bool Valid = true;
+
+    if (Signature == IndexRootSignature)
+    {
+        // An index root only holds leaves.
+        if (Depth)
+        {
+            return RegistryHiveNoKey;
+        }
+
+        // The key can only be in the last leaf which does not start after
+        // it.
+        std::size_t Low = 0;
+        std::size_t High = Count;
+        while (Valid && Low < High)
+        {
+            std::size_t Middle = Low + (High - Low) / 2;
+            std::size_t LeafSize = 0;
+            std::uint8_t const* Leaf = this->GetCell(
+                GetOffset(Middle),
+                8,
+                LeafSize);
+            if (!Leaf || !::LoadUInt16(Leaf + 2))
+            {
+                Valid = false;
+                break;
+            }
+            if (this->CompareKeyName(::LoadUInt32(Leaf + 4), Name, Valid) <= 0)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+        if (Valid)
+        {
+            return Low
+                ? this->FindSubkey(GetOffset(Low - 1), Name, Depth + 1)
+                : RegistryHiveNoKey;
+        }
+
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::uint32_t Key = this->FindSubkey(
+                GetOffset(i),
+                Name,
+                Depth + 1);
+            if (Key != RegistryHiveNoKey)
+            {
+                return Key;
+            }
+        }
+        return RegistryHiveNoKey;
+    }
+
+    if (Signature != FastLeafSignature &&
+        Signature != HashLeafSignature &&
+        Signature != IndexLeafSignature)
+    {
+        return RegistryHiveNoKey;
+    }
+
+    std::size_t Low = 0;
+    std::size_t High = Count;
+    while (Low < High)
+    {
+        std::size_t Middle = Low + (High - Low) / 2;
+        int Result = this->CompareKeyName(GetOffset(Middle), Name, Valid);
+        if (!Valid)
+        {
+            break;
+        }
+        if (!Result)
+        {
+            return GetOffset(Middle);
+        }
+        if (Result < 0)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+    if (Valid)
+    {
+        return RegistryHiveNoKey;
+    }
+
+    std::uint32_t Hash = 0;
+    bool UseHash =
+        Signature == HashLeafSignature && ::GetNameHash(Name, Hash);
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        if (UseHash && ::LoadUInt32(Cell + 8 + i * Stride) != Hash)
+        {
+            continue;
+        }
+
+        bool Current = true;
+        if (!this->CompareKeyName(GetOffset(i), Name, Current) && Current)
+        {
+            return GetOffset(i);
+        }
+    }
+
+    return RegistryHiveNoKey;
+}
+
+void NSudoSweeper::RegistryHive::CollectSubkeys(
+    std::uint32_t List,
+    std::uint32_t Depth,
+    std::vector<std::uint32_t>& Keys) const
+{
+    std::size_t Size = 0;
+    std::uint8_t const* Cell = this->GetCell(List, 4, Size);
+    if (!Cell)
+    {
+        return;
+    }
+
+    std::uint16_t Signature = ::LoadUInt16(Cell);
+    std::size_t Count = ::LoadUInt16(Cell + 2);
+    std::size_t Stride = (Signature == FastLeafSignature ||
+        Signature == HashLeafSignature) ? 8 : 4;
+    if (Count * Stride > Size - 4)
+    {
+        return;
+    }
+
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        std::uint32_t Offset = ::LoadUInt32(Cell + 4 + i * Stride);
+        if (Signature == IndexRootSignature)
+        {
+            if (!Depth)
+            {
+                this->CollectSubkeys(Offset, Depth + 1, Keys);
+            }
+        }
+        else if (Signature == FastLeafSignature ||
+            Signature == HashLeafSignature ||
+            Signature == IndexLeafSignature)
+        {
+            Keys.push_back(Offset);
+        }
+    }
+}
+
+std::uint8_t const* NSudoSweeper::RegistryHive::FindValue(
+    std::uint32_t Key,
+    Mile::NativeStringView Name,
+    std::size_t& Size) const
+{
+    std::size_t KeySize = 0;
+    std::uint8_t const* Cell = this->GetKeyCell(Key, KeySize);
+    if (!Cell)
+    {
+        return nullptr;
+    }
+
+    std::size_t Count = ::LoadUInt32(Cell + 36);
+    std::size_t ListSize = 0;
+    std::uint8_t const* List = Count && Count <= this->m_BinsSize / 4
+        ? this->GetCell(::LoadUInt32(Cell + 40), Count * 4, ListSize)
+        : nullptr;
+    if (!List)
+    {
+        return nullptr;
+    }
+
+    std::u16string Folded;
+    ::ToFoldedUtf16(Name, Folded);
+
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        std::size_t ValueSize = 0;
+        std::uint8_t const* Value = this->GetCell(
+            ::LoadUInt32(List + i * 4),
+            ValueNameOffset,
+            ValueSize);
+        if (!Value || ::LoadUInt16(Value) != ValueSignature)
+        {
+            continue;
+        }
+
+        std::size_t NameLength = ::LoadUInt16(Value + 2);
+        if (NameLength <= ValueSize - ValueNameOffset && ::NameEquals(
+            Value + ValueNameOffset,
+            NameLength,
+            ::LoadUInt16(Value + 16) & ValueCompressedName,
+            Folded))
+        {
+            Size = ValueSize;
+            return Value;
+        }
+    }
+
+    return nullptr;
+}
+
+bool NSudoSweeper::RegistryHive::Open(
+    Mile::NativeString const& Path,
+    RegistryHiveError& Error)
+{
+    Error = RegistryHiveError();
+
+    this->Close();
+
+    if (!this->m_File.Open(Path, Mile::MappedFileAccess::Random))
+    {
+        Error.SystemError = this->m_File.GetLastErrorCode();
+        Error.Message = "The hive cannot be opened";
+        return false;
+    }
+
+    std::uint8_t const* Data =
+        reinterpret_cast<std::uint8_t const*>(this->m_File.GetData());
+    std::size_t Size = this->m_File.GetSize();
+    if (Size < BaseBlockSize + 4096 ||
+        ::LoadUInt32(Data) != BaseBlockSignature ||
+        ::LoadUInt32(Data + 20) != 1 ||
+        ::LoadUInt32(Data + 24) < 3 ||
+        ::LoadUInt32(Data + 24) > 6 ||
+        ::LoadUInt32(Data + 28) != 0 ||
+        ::LoadUInt32(Data + 32) != 1 ||
+        ::LoadUInt32(Data + BaseBlockSize) != HiveBinSignature)
+    {
+        Error.Message = "The file is not a registry hive";
+        this->Close();
+        return false;
+    }
+
+    std::uint32_t Checksum = 0;
+    for (std::size_t i = 0; i < ChecksumOffset; i += 4)
+    {
+        Checksum ^= ::LoadUInt32(Data + i);
+    }
+    if (Checksum == 0xFFFFFFFF)
+    {
+        Checksum = 0xFFFFFFFE;
+    }
+    else if (Checksum == 0)
+    {
+        Checksum = 1;
+    }
+    if (Checksum != ::LoadUInt32(Data + ChecksumOffset))
+    {
+        Error.Message = "The base block of the hive is damaged";
+        this->Close();
+        return false;
+    }
+
+    this->m_Bins = Data + BaseBlockSize;
+    this->m_BinsSize = (std::min)(
+        static_cast<std::size_t>(::LoadUInt32(Data + 40)),
+        Size - BaseBlockSize);
+    this->m_MinorVersion = ::LoadUInt32(Data + 24);
+    this->m_Dirty = ::LoadUInt32(Data + 4) != ::LoadUInt32(Data + 8);
+
+    std::size_t RootSize = 0;
+    this->m_RootKey = ::LoadUInt32(Data + 36);
+    if (!this->GetKeyCell(this->m_RootKey, RootSize))
+    {
+        Error.Message = "The root key of the hive is damaged";
+        this->Close();
+        return false;
+    }
+
+    return true;
+}
+
+void NSudoSweeper::RegistryHive::Close() noexcept
+{
+    this->m_File.Close();
+    this->m_Bins = nullptr;
+    this->m_BinsSize = 0;
+    this->m_RootKey = RegistryHiveNoKey;
+    this->m_MinorVersion = 0;
+    this->m_Dirty = false;
+}
+
+std::uint32_t NSudoSweeper::RegistryHive::OpenKey(
+    std::uint32_t Parent,
+    Mile::NativeStringView Path) const
+{
+    std::size_t Size = 0;
+    if (!this->GetKeyCell(Parent, Size))
+    {
+        return RegistryHiveNoKey;
+    }
+
+    std::uint32_t Key = Parent;
+    std::u16string Folded;
+    while (!Path.empty())
+    {
+        Mile::NativeStringView Rest;
+        Mile::NativeStringView Segment = ::SplitFirstSegment(Path, Rest);
+        Path = Rest;
+        if (Segment.empty())
+        {
+            continue;
+        }
+
+        std::uint8_t const* Cell = this->GetKeyCell(Key, Size);
+        if (!Cell || !::LoadUInt32(Cell + 20))
+        {
+            return RegistryHiveNoKey;
+        }
+
+        ::ToFoldedUtf16(Segment, Folded);
+        Key = this->FindSubkey(::LoadUInt32(Cell + 28), Folded, 0);
+        if (Key == RegistryHiveNoKey)
+        {
+            return RegistryHiveNoKey;
+        }
+    }
+
+    return Key;
+}
+
+bool NSudoSweeper::RegistryHive::ValueExists(
+    std::uint32_t Key,
+    Mile::NativeStringView Name) const
+{
+    std::size_t Size = 0;
+    return this->FindValue(Key, Name, Size) != nullptr;
+}
+
+bool NSudoSweeper::RegistryHive::QueryValue(
+    std::uint32_t Key,
+    Mile::NativeStringView Name,
+    std::uint32_t& Type,
+    std::vector<std::uint8_t>& Data) const
+{
+    Data.clear();
+
+    std::size_t Size = 0;
+    std::uint8_t const* Value = this->FindValue(Key, Name, Size);
+    if (!Value)
+    {
+        return false;
+    }
+
+    Type = ::LoadUInt32(Value + 12);
+    std::uint32_t DataSize = ::LoadUInt32(Value + 4);
+
+    // Up to 4 bytes are stored in place of the offset of the data.
+    if (DataSize & ValueDataInline)
+    {
+        DataSize &= ~ValueDataInline;
+        if (DataSize > 4)
+        {
+            return false;
+        }
+        Data.assign(Value + 8, Value + 8 + DataSize);
+        return true;
+    }
+    if (!DataSize)
+    {
+        return true;
+    }
+
+    std::uint32_t Offset = ::LoadUInt32(Value + 8);
+    std::size_t CellSize = 0;
+    if (DataSize > BigDataSegmentSize && this->m_MinorVersion >= 4)
+    {
+        std::uint8_t const* Cell = this->GetCell(Offset, 8, CellSize);
+        if (!Cell || ::LoadUInt16(Cell) != BigDataSignature)
+        {
+            return false;
+        }
+
+        std::size_t Count = ::LoadUInt16(Cell + 2);
+        std::size_t ListSize = 0;
+        std::uint8_t const* List = this->GetCell(
+            ::LoadUInt32(Cell + 4),
+            Count * 4,
+            ListSize);
+        if (!List)
+        {
+            return false;
+        }
+
+        Data.reserve(DataSize);
+        for (std::size_t i = 0; i < Count && Data.size() < DataSize; ++i)
+        {
+            std::size_t SegmentSize = 0;
+            std::uint8_t const* Segment = this->GetCell(
+                ::LoadUInt32(List + i * 4),
+                0,
+                SegmentSize);
+            if (!Segment)
+            {
+                return false;
+            }
+            SegmentSize = (std::min)(
+                (std::min)(SegmentSize, BigDataSegmentSize),
+                DataSize - Data.size());
+            Data.insert(Data.end(), Segment, Segment + SegmentSize);
+        }
+        return Data.size() == DataSize;
+    }
+
+    std::uint8_t const* Cell = this->GetCell(Offset, DataSize, CellSize);
+    if (!Cell)
+    {
+        return false;
+    }
+    Data.assign(Cell, Cell + DataSize);
+    return true;
+}
+
+bool NSudoSweeper::RegistryHive::EnumerateSubkeys(
+    std::uint32_t Key,
+    std::vector<Mile::NativeString>& Names) const
+{
+    Names.clear();
+
+    std::size_t Size = 0;
+    std::uint8_t const* Cell = this->GetKeyCell(Key, Size);
+    if (!Cell)
+    {
+        return false;
+    }
+
+    std::vector<std::uint32_t> Keys;
+    if (::LoadUInt32(Cell + 20))
+    {
+        this->CollectSubkeys(::LoadUInt32(Cell + 28), 0, Keys);
+    }
+
+    Names.reserve(Keys.size());
+    for (std::uint32_t Subkey : Keys)
+    {
+        std::uint8_t const* Current = this->GetKeyCell(Subkey, Size);
+        if (!Current)
+        {
+            continue;
+        }
+
+        Mile::NativeString Name;
+        ::AppendName(
+            Name,
+            Current + KeyNameOffset,
+            ::LoadUInt16(Current + 72),
+            ::LoadUInt16(Current + 2) & KeyCompressedName);
+        Names.push_back(std::move(Name));
+    }
+
+    return true;
+}
+
+struct NSudoSweeper::OfflineRegistry::Hive
+{
+    Mile::NativeString Path;
+    RegistryHive File;
+    bool Opened = false;
+};
+
+NSudoSweeper::RegistryHive const* NSudoSweeper::OfflineRegistry::GetHive(
+    Mile::NativeString const& Path)
+{
+    for (std::unique_ptr<Hive> const& Current : this->m_Hives)
+    {
+        if (Current->Path == Path)
+        {
+            return Current->Opened ? &Current->File : nullptr;
+        }
+    }
+
+    // A hive which cannot be opened is not tried again.
+    std::unique_ptr<Hive> NewHive(new Hive());
+    NewHive->Path = Path;
+    RegistryHiveError Error;
+    NewHive->Opened = NewHive->File.Open(Path, Error);
+    if (NewHive->Opened)
+    {
+        ++this->m_Statistics.OpenedHives;
+    }
+    this->m_Hives.push_back(std::move(NewHive));
+
+    Hive const& Current = *this->m_Hives.back();
+    return Current.Opened ? &Current.File : nullptr;
+}
+
+std::vector<Mile::NativeString> const&
+NSudoSweeper::OfflineRegistry::GetProfiles()
+{
+    if (this->m_ProfilesLoaded)
+    {
+        return this->m_Profiles;
+    }
+    this->m_ProfilesLoaded = true;
+
+    Mile::NativeString UsersPath = ::JoinAsciiPath(this->m_RootPath, "Users");
+    Mile::FileEnumerator Enumerator;
+    if (!Enumerator.Open(UsersPath))
+    {
+        return this->m_Profiles;
+    }
+
+    // The links, such as "All Users", point to the other profiles.
+    Mile::FileEnumeratorBatch Batch;
+    while (Enumerator.NextBatch(Batch))
+    {
+        for (Mile::FileEnumeratorEntry const& Entry : Batch)
+        {
+            if (Entry.GetType() == Mile::FileEntryType::Directory)
+            {
+                Mile::NativeString Profile(UsersPath);
+                Profile.push_back(NSudoSweeper::PathSeparator);
+                Profile.append(Entry.GetName());
+                this->m_Profiles.push_back(std::move(Profile));
+            }
+        }
+    }
+    std::sort(this->m_Profiles.begin(), this->m_Profiles.end());
+
+    return this->m_Profiles;
+}
+
+bool NSudoSweeper::OfflineRegistry::Resolve(
+    Mile::NativeStringView Path,
+    std::vector<Target>& Targets)
+{
+    Targets.clear();
+
+    auto Add = [this, &Targets](
+        Mile::NativeString const& HivePath,
+        Mile::NativeStringView SubPath)
+    {
+        RegistryHive const* Current = this->GetHive(HivePath);
+        if (!Current)
+        {
+            return;
+        }
+        std::uint32_t Key = Current->OpenKey(Current->GetRootKey(), SubPath);
+        if (Key != RegistryHiveNoKey)
+        {
+            Targets.push_back(Target{ Current, Key });
+        }
+    };
+
+    auto AddClasses = [this, &Add](
+        Mile::NativeStringView SubPath)
+    {
+        for (Mile::NativeString const& Profile : this->GetProfiles())
+        {
+            Add(
+                ::JoinAsciiPath(
+                    Profile,
+                    "AppData\\Local\\Microsoft\\Windows\\UsrClass.dat"),
+                SubPath);
+        }
+    };
+
+    const Mile::NativeString ConfigPath = ::JoinAsciiPath(
+        this->m_RootPath,
+        "Windows\\System32\\config");
+
+    Mile::NativeStringView Rest;
+    Mile::NativeStringView RootName = ::SplitFirstSegment(Path, Rest);
+    Mile::NativeStringView SubPath;
+    Mile::NativeStringView Name = ::SplitFirstSegment(Rest, SubPath);
+
+    if (::SegmentEquals(RootName, "HKLM") ||
+        ::SegmentEquals(RootName, "HKEY_LOCAL_MACHINE"))
+    {
+        static char const* const MachineHives[] =
+        {
+            "SOFTWARE",
+            "SYSTEM",
+            "SAM",
+            "SECURITY",
+            "COMPONENTS",
+            "DRIVERS",
+        };
+
+        for (char const* HiveName : MachineHives)
+        {
+            if (!::SegmentEquals(Name, HiveName))
+            {
+                continue;
+            }
+
+            Mile::NativeString HivePath = ::JoinAsciiPath(ConfigPath, HiveName);
+            Mile::NativeStringView ControlSetRest;
+            Mile::NativeStringView ControlSet = ::SplitFirstSegment(
+                SubPath,
+                ControlSetRest);
+            if (::SegmentEquals(HiveName, "SYSTEM") &&
+                ::SegmentEquals(ControlSet, "CurrentControlSet"))
+            {
+                // The link is only created when the hive is loaded.
+                RegistryHive const* System = this->GetHive(HivePath);
+                std::uint32_t Type = 0;
+                std::vector<std::uint8_t> Data;
+                if (!System || !System->QueryValue(
+                    System->OpenKey(
+                        System->GetRootKey(),
+                        ::FromAscii("Select")),
+                    ::FromAscii("Current"),
+                    Type,
+                    Data) ||
+                    Type != RegistryDwordType ||
+                    Data.size() != 4)
+                {
+                    return false;
+                }
+
+                std::string Resolved = std::to_string(::LoadUInt32(&Data[0]));
+                Resolved.insert(
+                    0,
+                    Resolved.size() < 3 ? 3 - Resolved.size() : 0,
+                    '0');
+                Resolved.insert(0, "ControlSet");
+                Mile::NativeString ResolvedPath = ::FromAscii(
+                    Resolved.c_str());
+                if (!ControlSetRest.empty())
+                {
+                    ResolvedPath.push_back('\\');
+                    ResolvedPath.append(ControlSetRest);
+                }
+                Add(HivePath, ResolvedPath);
+                return false;
+            }
+
+            Add(HivePath, SubPath);
+            return false;
+        }
+
+        return Rest.empty();
+    }
+
+    if (::SegmentEquals(RootName, "HKCU") ||
+        ::SegmentEquals(RootName, "HKEY_CURRENT_USER"))
+    {
+        // The classes of a user are in a hive of their own.
+        Mile::NativeStringView ClassesRest;
+        Mile::NativeStringView Classes = ::SplitFirstSegment(
+            SubPath,
+            ClassesRest);
+        if (::SegmentEquals(Name, "Software") &&
+            ::SegmentEquals(Classes, "Classes"))
+        {
+            AddClasses(ClassesRest);
+        }
+        else
+        {
+            for (Mile::NativeString const& Profile : this->GetProfiles())
+            {
+                Add(::JoinAsciiPath(Profile, "NTUSER.DAT"), Rest);
+            }
+        }
+        return Rest.empty();
+    }
+
+    if (::SegmentEquals(RootName, "HKU") ||
+        ::SegmentEquals(RootName, "HKEY_USERS"))
+    {
+        if (::SegmentEquals(Name, ".DEFAULT") ||
+            ::SegmentEquals(Name, "S-1-5-18"))
+        {
+            Add(::JoinAsciiPath(ConfigPath, "DEFAULT"), SubPath);
+        }
+        else if (::SegmentEquals(Name, "S-1-5-19"))
+        {
+            Add(
+                ::JoinAsciiPath(
+                    this->m_RootPath,
+                    "Windows\\ServiceProfiles\\LocalService\\NTUSER.DAT"),
+                SubPath);
+        }
+        else if (::SegmentEquals(Name, "S-1-5-20"))
+        {
+            Add(
+                ::JoinAsciiPath(
+                    this->m_RootPath,
+                    "Windows\\ServiceProfiles\\NetworkService\\NTUSER.DAT"),
+                SubPath);
+        }
+        return Rest.empty();
+    }
+
+    if (::SegmentEquals(RootName, "HKCR") ||
+        ::SegmentEquals(RootName, "HKEY_CLASSES_ROOT"))
+    {
+        Mile::NativeString MachinePath = ::FromAscii("Classes");
+        if (!Rest.empty())
+        {
+            MachinePath.push_back('\\');
+            MachinePath.append(Rest);
+        }
+        Add(::JoinAsciiPath(ConfigPath, "SOFTWARE"), MachinePath);
+        AddClasses(Rest);
+        return Rest.empty();
+    }
+
+    return false;
+}
+
+bool NSudoSweeper::OfflineRegistry::Query(
+    Mile::NativeStringView Path,
+    Mile::NativeStringView ValueName,
+    bool IsValue)
+{
+    // The paths are folded, so the cache ignores the case as the registry
+    // does.
+    Mile::NativeString CacheKey;
+    CacheKey.reserve(Path.size() + ValueName.size() + 2);
+    CacheKey.push_back(IsValue ? 'V' : 'K');
+    for (Mile::NativeChar Character : Path)
+    {
+        CacheKey.push_back(Mile::CaseInsensitiveFold(Character));
+    }
+    if (IsValue)
+    {
+        CacheKey.push_back('\0');
+        for (Mile::NativeChar Character : ValueName)
+        {
+            CacheKey.push_back(Mile::CaseInsensitiveFold(Character));
+        }
+    }
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+    ++this->m_Statistics.Queries;
+    auto Iterator = this->m_Results.find(CacheKey);
+    if (Iterator != this->m_Results.end())
+    {
+        ++this->m_Statistics.CacheHits;
+        return Iterator->second;
+    }
+
+    std::vector<Target> Targets;
+    bool Result = this->Resolve(Path, Targets) && !IsValue;
+    for (Target const& Current : Targets)
+    {
+        if (!IsValue || Current.Hive->ValueExists(Current.Key, ValueName))
+        {
+            Result = true;
+            break;
+        }
+    }
+
+    this->m_Results.emplace(std::move(CacheKey), Result);
+    return Result;
+}
+
+NSudoSweeper::OfflineRegistry::OfflineRegistry(
+    Mile::NativeString const& SessionRootPath) :
+    m_RootPath(SessionRootPath),
+    m_Statistics()
+{
+}
+
+NSudoSweeper::OfflineRegistry::~OfflineRegistry()
+{
+}
+
+std::shared_ptr<NSudoSweeper::OfflineRegistry>
+NSudoSweeper::OfflineRegistry::Acquire(
+    Mile::NativeString const& SessionRootPath)
+{
+    static std::mutex Mutex;
+    static std::map<Mile::NativeString, std::weak_ptr<OfflineRegistry>>
+        Registries;
+
+    std::lock_guard<std::mutex> Lock(Mutex);
+
+    for (auto Iterator = Registries.begin(); Iterator != Registries.end();)
+    {
+        if (Iterator->second.expired())
+        {
+            Iterator = Registries.erase(Iterator);
+        }
+        else
+        {
+            ++Iterator;
+        }
+    }
+
+    std::weak_ptr<OfflineRegistry>& Slot = Registries[SessionRootPath];
+    std::shared_ptr<OfflineRegistry> Registry = Slot.lock();
+    if (!Registry)
+    {
+        Registry = std::make_shared<OfflineRegistry>(SessionRootPath);
+        Slot = Registry;
+    }
+    return Registry;
+}
+
+bool NSudoSweeper::OfflineRegistry::KeyExists(
+    Mile::NativeStringView Path)
+{
+    return this->Query(Path, Mile::NativeStringView(), false);
+}
+
+bool NSudoSweeper::OfflineRegistry::ValueExists(
+    Mile::NativeStringView Path,
+    Mile::NativeStringView Name)
+{
+    return this->Query(Path, Name, true);
+}
+
+bool NSudoSweeper::OfflineRegistry::QueryValue(
+    Mile::NativeStringView Path,
+    Mile::NativeStringView Name,
+    std::uint32_t& Type,
+    std::vector<std::uint8_t>& Data)
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+    std::vector<Target> Targets;
+    this->Resolve(Path, Targets);
+    for (Target const& Current : Targets)
+    {
+        if (Current.Hive->QueryValue(Current.Key, Name, Type, Data))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool NSudoSweeper::OfflineRegistry::EnumerateSubkeys(
+    Mile::NativeStringView Path,
+    std::vector<Mile::NativeString>& Names)
+{
+    Names.clear();
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+    std::vector<Target> Targets;
+    bool Exists = this->Resolve(Path, Targets) || !Targets.empty();
+
+    // A key of several hives has the subkeys of all of them once.
+    std::unordered_set<Mile::NativeString> FoldedNames;
+    std::vector<Mile::NativeString> Current;
+    for (Target const& Source : Targets)
+    {
+        Source.Hive->EnumerateSubkeys(Source.Key, Current);
+        for (Mile::NativeString& Name : Current)
+        {
+            Mile::NativeString Folded(Name);
+            for (Mile::NativeChar& Character : Folded)
+            {
+                Character = Mile::CaseInsensitiveFold(Character);
+            }
+            if (FoldedNames.insert(std::move(Folded)).second)
+            {
+                Names.push_back(std::move(Name));
+            }
+        }
+    }
+
+    return Exists;
+}
+
+NSudoSweeper::OfflineRegistryStatistics
+NSudoSweeper::OfflineRegistry::GetStatistics()
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_Statistics;
+}
@@ -0,0 +1,352 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHive.h
+ * PURPOSE:   Definition for the offline registry hive reader
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_REGISTRY_HIVE
+#define NSUDO_SWEEPER_REGISTRY_HIVE
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.MappedFile.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The key returned by RegistryHive::OpenKey if the key does not exist.
+     */
+    const std::uint32_t RegistryHiveNoKey = UINT32_MAX;
+
+    /**
+     * The error of a registry hive operation.
+     */
+    struct RegistryHiveError
+    {
+        /**
+         * The system error code if the file cannot be opened, which is a
+         * Win32 error code on Windows and an errno value elsewhere.
+         */
+        int SystemError = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * Reads the keys and the values of a registry hive file, such as
+     * "Windows\System32\config\SOFTWARE" or "NTUSER.DAT" of an offline
+     * image, without loading it into the registry. The file is mapped and
+     * parsed in place, and is never written.
+     *
+     * A key is identified by the offset of its cell in the hive. The names
+     * of keys and values are compared without regard to case, and the
+     * paths are separated by backslashes. The subkeys are found by a binary
+     * search of their sorted lists, which folds the characters outside
+     * ASCII with Mile::CaseInsensitiveFold rather than the table of the
+     * system. The transaction logs of a hive are not applied, so a hive
+     * whose last write was interrupted may miss its latest changes.
+     *
+     * The methods are const and may be called concurrently.
+     */
+    class RegistryHive : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        Mile::MappedFile m_File;
+        std::uint8_t const* m_Bins = nullptr;
+        std::size_t m_BinsSize = 0;
+        std::uint32_t m_RootKey = RegistryHiveNoKey;
+        std::uint32_t m_MinorVersion = 0;
+        bool m_Dirty = false;
+
+        std::uint8_t const* GetCell(
+            std::uint32_t Offset,
+            std::size_t MinimumSize,
+            std::size_t& Size) const noexcept;
+
+        std::uint8_t const* GetKeyCell(
+            std::uint32_t Key,
+            std::size_t& Size) const noexcept;
+
+        int CompareKeyName(
+            std::uint32_t Key,
+            std::u16string const& Name,
+            bool& Valid) const noexcept;
+
+        std::uint32_t FindSubkey(
+            std::uint32_t List,
+            std::u16string const& Name,
+            std::uint32_t Depth) const;
+
+        void CollectSubkeys(
+            std::uint32_t List,
+            std::uint32_t Depth,
+            std::vector<std::uint32_t>& Keys) const;
+
+        std::uint8_t const* FindValue(
+            std::uint32_t Key,
+            Mile::NativeStringView Name,
+            std::size_t& Size) const;
+
+    public:
+
+        RegistryHive() noexcept = default;
+
+        /**
+         * Opens a hive file. The previous file is closed.
+         *
+         * @param Path The path of the hive file.
+         * @param Error The error if it fails.
+         * @return true if successful, otherwise false.
+         */
+        bool Open(
+            Mile::NativeString const& Path,
+            RegistryHiveError& Error);
+
+        /**
+         * Closes the hive file.
+         */
+        void Close() noexcept;
+
+        /**
+         * Checks whether the hive has changes which are only in its
+         * transaction logs.
+         *
+         * @return true if the last write of the hive was interrupted.
+         */
+        bool IsDirty() const noexcept
+        {
+            return this->m_Dirty;
+        }
+
+        /**
+         * Retrieves the root key of the hive.
+         *
+         * @return The root key, or RegistryHiveNoKey if no hive is open.
+         */
+        std::uint32_t GetRootKey() const noexcept
+        {
+            return this->m_RootKey;
+        }
+
+        /**
+         * Opens a key below another key.
+         *
+         * @param Parent The key the path is relative to.
+         * @param Path The path of the key, such as "Software\NSudo". An
+         *             empty path opens the parent.
+         * @return The key, or RegistryHiveNoKey if it does not exist.
+         */
+        std::uint32_t OpenKey(
+            std::uint32_t Parent,
+            Mile::NativeStringView Path) const;
+
+        /**
+         * Checks whether a key has a value.
+         *
+         * @param Key The key.
+         * @param Name The name of the value, or an empty string for the
+         *             default value.
+         * @return true if the value exists, otherwise false.
+         */
+        bool ValueExists(
+            std::uint32_t Key,
+            Mile::NativeStringView Name) const;
+
+        /**
+         * Reads a value of a key.
+         *
+         * @param Key The key.
+         * @param Name The name of the value, or an empty string for the
+         *             default value.
+         * @param Type The REG_* type of the value.
+         * @param Data The data of the value.
+         * @return true if successful, or false if the value does not exist
+         *         or its data is damaged.
+         */
+        bool QueryValue(
+            std::uint32_t Key,
+            Mile::NativeStringView Name,
+            std::uint32_t& Type,
+            std::vector<std::uint8_t>& Data) const;
+
+        /**
+         * Retrieves the names of the subkeys of a key.
+         *
+         * @param Key The key.
+         * @param Names The names of the subkeys, in the order of the hive.
+         * @return true if successful, or false if the key does not exist.
+         */
+        bool EnumerateSubkeys(
+            std::uint32_t Key,
+            std::vector<Mile::NativeString>& Names) const;
+    };
+
+    /**
+     * The statistics of an offline registry.
+     */
+    struct OfflineRegistryStatistics
+    {
+        std::uint64_t Queries;
+        std::uint64_t CacheHits;
+        std::uint64_t OpenedHives;
+    };
+
+    /**
+     * Answers registry queries about an offline Windows image from its hive
+     * files, and remembers the answers, so the Detect rules of many
+     * handlers open each hive once and test each key once.
+     *
+     * The root keys map to the hives of the image:
+     *
+     *   HKLM\SOFTWARE, SYSTEM, SAM, SECURITY, COMPONENTS and DRIVERS
+     *                  Windows\System32\config\<name>. CurrentControlSet
+     *                  is resolved from the Select key of SYSTEM.
+     *   HKCU           NTUSER.DAT of every profile below Users, and
+     *                  UsrClass.dat for Software\Classes. A key exists if
+     *                  any profile has it.
+     *   HKU            .DEFAULT and S-1-5-18 map to config\DEFAULT, and
+     *                  S-1-5-19 and S-1-5-20 to the service profiles.
+     *   HKCR           SOFTWARE\Classes and the classes of every profile.
+     *
+     * The methods may be called concurrently.
+     */
+    class OfflineRegistry : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Hive;
+
+        /**
+         * A key of a hive a path resolves to.
+         */
+        struct Target
+        {
+            RegistryHive const* Hive;
+            std::uint32_t Key;
+        };
+
+        Mile::NativeString m_RootPath;
+
+        std::mutex m_Mutex;
+        std::vector<std::unique_ptr<Hive>> m_Hives;
+        std::vector<Mile::NativeString> m_Profiles;
+        bool m_ProfilesLoaded = false;
+        std::unordered_map<Mile::NativeString, bool> m_Results;
+        OfflineRegistryStatistics m_Statistics;
+
+        RegistryHive const* GetHive(
+            Mile::NativeString const& Path);
+
+        std::vector<Mile::NativeString> const& GetProfiles();
+
+        bool Resolve(
+            Mile::NativeStringView Path,
+            std::vector<Target>& Targets);
+
+        bool Query(
+            Mile::NativeStringView Path,
+            Mile::NativeStringView ValueName,
+            bool IsValue);
+
+    public:
+
+        /**
+         * Creates the registry of an image. No hive is opened until it is
+         * needed.
+         *
+         * @param SessionRootPath The root directory of the image.
+         */
+        explicit OfflineRegistry(
+            Mile::NativeString const& SessionRootPath);
+
+        ~OfflineRegistry();
+
+        /**
+         * Retrieves the registry of an image, which is shared by the
+         * callers while any of them keeps it, such as the handlers of one
+         * scan.
+         *
+         * @param SessionRootPath The root directory of the image.
+         * @return The registry of the image.
+         */
+        static std::shared_ptr<OfflineRegistry> Acquire(
+            Mile::NativeString const& SessionRootPath);
+
+        /**
+         * Checks whether a key exists.
+         *
+         * @param Path The full path of the key, such as
+         *             "HKCU\Software\NSudo".
+         * @return true if the key exists, otherwise false.
+         */
+        bool KeyExists(
+            Mile::NativeStringView Path);
+
+        /**
+         * Checks whether a key has a value.
+         *
+         * @param Path The full path of the key.
+         * @param Name The name of the value, or an empty string for the
+         *             default value.
+         * @return true if the value exists, otherwise false.
+         */
+        bool ValueExists(
+            Mile::NativeStringView Path,
+            Mile::NativeStringView Name);
+
+        /**
+         * Reads a value of a key. The answer is not remembered, since the
+         * values are read far less often than the keys are tested.
+         *
+         * @param Path The full path of the key.
+         * @param Name The name of the value, or an empty string for the
+         *             default value.
+         * @param Type The REG_* type of the value.
+         * @param Data The data of the value, from the first hive the key
+         *             maps to which has it.
+         * @return true if successful, or false if the value does not exist
+         *         or its data is damaged.
+         */
+        bool QueryValue(
+            Mile::NativeStringView Path,
+            Mile::NativeStringView Name,
+            std::uint32_t& Type,
+            std::vector<std::uint8_t>& Data);
+
+        /**
+         * Retrieves the names of the subkeys of a key. The subkeys of all
+         * hives the key maps to are merged.
+         *
+         * @param Path The full path of the key.
+         * @param Names The names of the subkeys.
+         * @return true if the key exists, otherwise false.
+         */
+        bool EnumerateSubkeys(
+            Mile::NativeStringView Path,
+            std::vector<Mile::NativeString>& Names);
+
+        /**
+         * Retrieves the statistics of the registry.
+         *
+         * @return The statistics of the registry.
+         */
+        OfflineRegistryStatistics GetStatistics();
+    };
+}
+
+#endif // !NSUDO_SWEEPER_REGISTRY_HIVE
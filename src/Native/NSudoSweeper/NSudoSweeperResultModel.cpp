@@ -0,0 +1,908 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultModel.cpp
+ * PURPOSE:   Implementation for the indexed scan result model
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperResultModel.h"
+
+#include <Mile.Portable.CaseInsensitive.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    const std::size_t LeafCapacity = 128;
+    const std::size_t BranchCapacity = 64;
+
+    /**
+     * The number of rows of a leaf and of children of a branch built from
+     * sorted rows, which leaves room for the rows inserted later.
+     */
+    const std::size_t LeafFill = 112;
+    const std::size_t BranchFill = 56;
+
+    struct TreeNode
+    {
+        bool Leaf;
+        std::size_t Count = 0;
+
+        /**
+         * The number of rows below the node.
+         */
+        std::size_t Total = 0;
+
+        explicit TreeNode(
+            bool IsLeaf) :
+            Leaf(IsLeaf)
+        {
+        }
+    };
+
+    struct TreeLeaf : TreeNode
+    {
+        TreeLeaf* Previous = nullptr;
+        TreeLeaf* Next = nullptr;
+        std::uint32_t Rows[LeafCapacity];
+
+        TreeLeaf() :
+            TreeNode(true)
+        {
+        }
+    };
+
+    struct TreeBranch : TreeNode
+    {
+        TreeNode* Children[BranchCapacity];
+
+        /**
+         * The number of rows below each child, and the first row of each
+         * child.
+         */
+        std::size_t Totals[BranchCapacity];
+        std::uint32_t Firsts[BranchCapacity];
+
+        TreeBranch() :
+            TreeNode(false)
+        {
+        }
+    };
+
+    std::uint32_t GetFirstRow(
+        TreeNode const* Node) noexcept
+    {
+        return Node->Leaf
+            ? static_cast<TreeLeaf const*>(Node)->Rows[0]
+            : static_cast<TreeBranch const*>(Node)->Firsts[0];
+    }
+
+    int CompareNodeNames(
+        NSudoSweeper::ResultStore const& Store,
+        std::uint32_t Left,
+        std::uint32_t Right) noexcept
+    {
+        Mile::NativeStringView LeftName = Store.GetNodeName(Left);
+        Mile::NativeStringView RightName = Store.GetNodeName(Right);
+        int Result = Mile::CaseInsensitiveCompare(LeftName, RightName);
+        if (!Result)
+        {
+            Result = LeftName.compare(RightName);
+        }
+        if (!Result)
+        {
+            Result = Left < Right ? -1 : 1;
+        }
+        return Result;
+    }
+}
+
+struct NSudoSweeper::ResultModel::Index
+{
+    std::vector<std::unique_ptr<TreeLeaf>> Leaves;
+    std::vector<std::unique_ptr<TreeBranch>> Branches;
+    TreeNode* Root = nullptr;
+
+    std::size_t GetCount() const noexcept
+    {
+        return this->Root ? this->Root->Total : 0;
+    }
+
+    TreeLeaf* CreateLeaf()
+    {
+        this->Leaves.emplace_back(new TreeLeaf());
+        return this->Leaves.back().get();
+    }
+
+    TreeBranch* CreateBranch()
+    {
+        this->Branches.emplace_back(new TreeBranch());
+        return this->Branches.back().get();
+    }
+
+    void Clear()
+    {
+        this->Leaves.clear();
+        this->Branches.clear();
+        this->Root = nullptr;
+    }
+
+    /**
+     * Inserts a row below a node.
+     *
+     * @return The new right sibling of the node if the node is split,
+     *         otherwise nullptr.
+     */
+    template <typename Less>
+    TreeNode* InsertBelow(
+        TreeNode* Node,
+        std::uint32_t Row,
+        Less const& IsLess)
+    {
+        ++Node->Total;
+
+        if (Node->Leaf)
+        {
+            TreeLeaf* Leaf = static_cast<TreeLeaf*>(Node);
+            std::uint32_t* End = Leaf->Rows + Leaf->Count;
+            std::uint32_t* Position =
+                std::upper_bound(Leaf->Rows, End, Row, IsLess);
+            std::copy_backward(Position, End, End + 1);
+            *Position = Row;
+            if (++Leaf->Count < LeafCapacity)
+            {
+                return nullptr;
+            }
+
+            TreeLeaf* Right = this->CreateLeaf();
+            std::size_t Half = Leaf->Count / 2;
+            std::copy(
+                Leaf->Rows + Half,
+                Leaf->Rows + Leaf->Count,
+                Right->Rows);
+            Right->Count = Leaf->Count - Half;
+            Right->Total = Right->Count;
+            Leaf->Count = Half;
+            Leaf->Total = Half;
+
+            Right->Previous = Leaf;
+            Right->Next = Leaf->Next;
+            if (Right->Next)
+            {
+                Right->Next->Previous = Right;
+            }
+            Leaf->Next = Right;
+            return Right;
+        }
+
+        TreeBranch* Branch = static_cast<TreeBranch*>(Node);
+
+        // The last child whose first row is not after the row.
+        std::size_t Child = static_cast<std::size_t>(std::upper_bound(
+            Branch->Firsts,
+            Branch->Firsts + Branch->Count,
+            Row,
+            IsLess) - Branch->Firsts);
+        if (Child)
+        {
+            --Child;
+        }
+
+        TreeNode* Split = this->InsertBelow(
+            Branch->Children[Child],
+            Row,
+            IsLess);
+        Branch->Firsts[Child] = ::GetFirstRow(Branch->Children[Child]);
+        Branch->Totals[Child] = Branch->Children[Child]->Total;
+        if (!Split)
+        {
+            return nullptr;
+        }
+
+        std::size_t Position = Child + 1;
+        std::copy_backward(
+            Branch->Children + Position,
+            Branch->Children + Branch->Count,
+            Branch->Children + Branch->Count + 1);
+        std::copy_backward(
+            Branch->Totals + Position,
+            Branch->Totals + Branch->Count,
+            Branch->Totals + Branch->Count + 1);
+        std::copy_backward(
+            Branch->Firsts + Position,
+            Branch->Firsts + Branch->Count,
+            Branch->Firsts + Branch->Count + 1);
+        Branch->Children[Position] = Split;
+        Branch->Totals[Position] = Split->Total;
+        Branch->Firsts[Position] = ::GetFirstRow(Split);
+        if (++Branch->Count < BranchCapacity)
+        {
+            return nullptr;
+        }
+
+        TreeBranch* Right = this->CreateBranch();
+        std::size_t Half = Branch->Count / 2;
+        Right->Count = Branch->Count - Half;
+        std::copy(
+            Branch->Children + Half,
+            Branch->Children + Branch->Count,
+            Right->Children);
+        std::copy(
+            Branch->Totals + Half,
+            Branch->Totals + Branch->Count,
+            Right->Totals);
+        std::copy(
+            Branch->Firsts + Half,
+            Branch->Firsts + Branch->Count,
+            Right->Firsts);
+        Branch->Count = Half;
+        for (std::size_t i = 0; i < Right->Count; ++i)
+        {
+            Right->Total += Right->Totals[i];
+        }
+        Branch->Total -= Right->Total;
+        return Right;
+    }
+
+    template <typename Less>
+    void Insert(
+        std::uint32_t Row,
+        Less const& IsLess)
+    {
+        if (!this->Root)
+        {
+            TreeLeaf* Leaf = this->CreateLeaf();
+            Leaf->Rows[0] = Row;
+            Leaf->Count = 1;
+            Leaf->Total = 1;
+            this->Root = Leaf;
+            return;
+        }
+
+        TreeNode* Split = this->InsertBelow(this->Root, Row, IsLess);
+        if (Split)
+        {
+            TreeBranch* Branch = this->CreateBranch();
+            Branch->Children[0] = this->Root;
+            Branch->Children[1] = Split;
+            Branch->Totals[0] = this->Root->Total;
+            Branch->Totals[1] = Split->Total;
+            Branch->Firsts[0] = ::GetFirstRow(this->Root);
+            Branch->Firsts[1] = ::GetFirstRow(Split);
+            Branch->Count = 2;
+            Branch->Total = this->Root->Total + Split->Total;
+            this->Root = Branch;
+        }
+    }
+
+    /**
+     * Replaces the tree with a tree of sorted rows.
+     */
+    void Build(
+        std::vector<std::uint32_t> const& Rows)
+    {
+        this->Clear();
+        if (Rows.empty())
+        {
+            return;
+        }
+
+        std::vector<TreeNode*> Level;
+        TreeLeaf* Previous = nullptr;
+        for (std::size_t i = 0; i < Rows.size(); i += LeafFill)
+        {
+            TreeLeaf* Leaf = this->CreateLeaf();
+            Leaf->Count = (std::min)(LeafFill, Rows.size() - i);
+            Leaf->Total = Leaf->Count;
+            std::copy(
+                Rows.begin() + i,
+                Rows.begin() + i + Leaf->Count,
+                Leaf->Rows);
+            Leaf->Previous = Previous;
+            if (Previous)
+            {
+                Previous->Next = Leaf;
+            }
+            Previous = Leaf;
+            Level.push_back(Leaf);
+        }
+
+        while (Level.size() > 1)
+        {
+            std::vector<TreeNode*> Parents;
+            for (std::size_t i = 0; i < Level.size(); i += BranchFill)
+            {
+                TreeBranch* Branch = this->CreateBranch();
+                Branch->Count = (std::min)(BranchFill, Level.size() - i);
+                for (std::size_t j = 0; j < Branch->Count; ++j)
+                {
+                    TreeNode* Child = Level[i + j];
+                    Branch->Children[j] = Child;
+                    Branch->Totals[j] = Child->Total;
+                    Branch->Firsts[j] = ::GetFirstRow(Child);
+                    Branch->Total += Child->Total;
+                }
+                Parents.push_back(Branch);
+            }
+            Level = std::move(Parents);
+        }
+
+        this->Root = Level.front();
+    }
+
+    /**
+     * Retrieves all rows in order.
+     */
+    void GetAllRows(
+        std::vector<std::uint32_t>& Rows) const
+    {
+        Rows.clear();
+        Rows.reserve(this->GetCount());
+
+        TreeNode const* Node = this->Root;
+        if (!Node)
+        {
+            return;
+        }
+        while (!Node->Leaf)
+        {
+            Node = static_cast<TreeBranch const*>(Node)->Children[0];
+        }
+        for (TreeLeaf const* Leaf = static_cast<TreeLeaf const*>(Node);
+            Leaf;
+            Leaf = Leaf->Next)
+        {
+            Rows.insert(Rows.end(), Leaf->Rows, Leaf->Rows + Leaf->Count);
+        }
+    }
+
+    /**
+     * Finds the leaf of a rank.
+     *
+     * @param Rank The rank, which receives the position in the leaf.
+     */
+    TreeLeaf const* Find(
+        std::size_t& Rank) const noexcept
+    {
+        TreeNode const* Node = this->Root;
+        while (!Node->Leaf)
+        {
+            TreeBranch const* Branch = static_cast<TreeBranch const*>(Node);
+            std::size_t Child = 0;
+            while (Rank >= Branch->Totals[Child])
+            {
+                Rank -= Branch->Totals[Child++];
+            }
+            Node = Branch->Children[Child];
+        }
+        return static_cast<TreeLeaf const*>(Node);
+    }
+
+    /**
+     * Counts the rows which come before a key.
+     *
+     * @param IsBefore The predicate which indicates a row comes before the
+     *                 key. It must be true for a prefix of the rows.
+     */
+    template <typename Predicate>
+    std::size_t CountBefore(
+        Predicate const& IsBefore) const
+    {
+        std::size_t Result = 0;
+
+        TreeNode const* Node = this->Root;
+        if (!Node)
+        {
+            return Result;
+        }
+
+        while (!Node->Leaf)
+        {
+            TreeBranch const* Branch = static_cast<TreeBranch const*>(Node);
+
+            // The children before the last one whose first row is before
+            // the key are entirely before the key.
+            std::size_t Child = static_cast<std::size_t>(std::partition_point(
+                Branch->Firsts,
+                Branch->Firsts + Branch->Count,
+                IsBefore) - Branch->Firsts);
+            if (!Child)
+            {
+                return Result;
+            }
+            --Child;
+            for (std::size_t i = 0; i < Child; ++i)
+            {
+                Result += Branch->Totals[i];
+            }
+            Node = Branch->Children[Child];
+        }
+
+        TreeLeaf const* Leaf = static_cast<TreeLeaf const*>(Node);
+        Result += static_cast<std::size_t>(std::partition_point(
+            Leaf->Rows,
+            Leaf->Rows + Leaf->Count,
+            IsBefore) - Leaf->Rows);
+        return Result;
+    }
+};
+
+NSudoSweeper::ResultModel::Index const& NSudoSweeper::ResultModel::GetIndex(
+    ResultModelOrder Order) const noexcept
+{
+    switch (Order)
+    {
+    case ResultModelOrder::Group:
+        return *this->m_ByGroup;
+    case ResultModelOrder::Path:
+        return *this->m_ByPath;
+    default:
+        return *this->m_BySize;
+    }
+}
+
+int NSudoSweeper::ResultModel::ComparePaths(
+    std::uint32_t Left,
+    std::uint32_t Right) const noexcept
+{
+    if (Left == Right)
+    {
+        return 0;
+    }
+
+    // A directory comes before the items below it.
+    int Result = 0;
+    std::uint16_t LeftDepth = this->m_NodeDepths[Left];
+    std::uint16_t RightDepth = this->m_NodeDepths[Right];
+    for (; LeftDepth > RightDepth; --LeftDepth)
+    {
+        Left = this->m_Store.GetNodeParent(Left);
+        Result = 1;
+    }
+    for (; RightDepth > LeftDepth; --RightDepth)
+    {
+        Right = this->m_Store.GetNodeParent(Right);
+        Result = -1;
+    }
+    if (Left == Right)
+    {
+        return Result;
+    }
+
+    for (;;)
+    {
+        std::uint32_t LeftParent = this->m_Store.GetNodeParent(Left);
+        std::uint32_t RightParent = this->m_Store.GetNodeParent(Right);
+        if (LeftParent == RightParent)
+        {
+            break;
+        }
+        Left = LeftParent;
+        Right = RightParent;
+    }
+
+    return ::CompareNodeNames(this->m_Store, Left, Right);
+}
+
+bool NSudoSweeper::ResultModel::IsLess(
+    ResultModelOrder Order,
+    std::uint32_t Left,
+    std::uint32_t Right) const noexcept
+{
+    if (Order == ResultModelOrder::Path)
+    {
+        int Result = this->ComparePaths(
+            this->m_Nodes[Left],
+            this->m_Nodes[Right]);
+        return Result ? Result < 0 : Left < Right;
+    }
+
+    if (Order == ResultModelOrder::Group &&
+        this->m_Groups[Left] != this->m_Groups[Right])
+    {
+        return this->m_Groups[Left] < this->m_Groups[Right];
+    }
+
+    if (this->m_Sizes[Left] != this->m_Sizes[Right])
+    {
+        return this->m_Sizes[Left] < this->m_Sizes[Right];
+    }
+
+    return Left < Right;
+}
+
+void NSudoSweeper::ResultModel::SortByPath(
+    std::vector<std::uint32_t>& Rows) const
+{
+    // Sorting the nodes once is much faster than comparing the paths of the
+    // rows: the children of each node are sorted by name, and the nodes are
+    // numbered in the preorder of the tree, which is the order of the paths.
+    std::size_t NodeCount = this->m_NodeDepths.size();
+    std::size_t TopLevel = NodeCount;
+
+    std::vector<std::uint32_t> Offsets(NodeCount + 2, 0);
+    for (std::size_t i = 0; i < NodeCount; ++i)
+    {
+        std::uint32_t Parent = this->m_Store.GetNodeParent(
+            static_cast<std::uint32_t>(i));
+        ++Offsets[(Parent == ResultStoreNoNode ? TopLevel : Parent) + 1];
+    }
+    for (std::size_t i = 1; i < Offsets.size(); ++i)
+    {
+        Offsets[i] += Offsets[i - 1];
+    }
+
+    std::vector<std::uint32_t> Children(NodeCount);
+    {
+        std::vector<std::uint32_t> Next(Offsets.begin(), Offsets.end() - 1);
+        for (std::size_t i = 0; i < NodeCount; ++i)
+        {
+            std::uint32_t Parent = this->m_Store.GetNodeParent(
+                static_cast<std::uint32_t>(i));
+            Children[Next[Parent == ResultStoreNoNode ? TopLevel : Parent]++] =
+                static_cast<std::uint32_t>(i);
+        }
+    }
+    for (std::size_t i = 0; i <= NodeCount; ++i)
+    {
+        if (Offsets[i + 1] - Offsets[i] > 1)
+        {
+            std::sort(
+                Children.begin() + Offsets[i],
+                Children.begin() + Offsets[i + 1],
+                [this](std::uint32_t Left, std::uint32_t Right)
+            {
+                return ::CompareNodeNames(this->m_Store, Left, Right) < 0;
+            });
+        }
+    }
+
+    std::vector<std::uint32_t> Ranks(NodeCount);
+    {
+        std::uint32_t Rank = 0;
+        std::vector<std::pair<std::size_t, std::uint32_t>> Stack;
+        Stack.emplace_back(TopLevel, Offsets[TopLevel]);
+        while (!Stack.empty())
+        {
+            std::pair<std::size_t, std::uint32_t>& Top = Stack.back();
+            if (Top.second == Offsets[Top.first + 1])
+            {
+                Stack.pop_back();
+                continue;
+            }
+            std::uint32_t Node = Children[Top.second++];
+            Ranks[Node] = Rank++;
+            Stack.emplace_back(Node, Offsets[Node]);
+        }
+    }
+
+    std::vector<std::uint64_t> Keys;
+    Keys.reserve(Rows.size());
+    for (std::uint32_t Row : Rows)
+    {
+        Keys.push_back(
+            (static_cast<std::uint64_t>(Ranks[this->m_Nodes[Row]]) << 32) |
+            Row);
+    }
+    std::sort(Keys.begin(), Keys.end());
+    for (std::size_t i = 0; i < Keys.size(); ++i)
+    {
+        Rows[i] = static_cast<std::uint32_t>(Keys[i]);
+    }
+}
+
+bool NSudoSweeper::ResultModel::IsInDirectory(
+    std::uint32_t Node,
+    std::uint32_t Directory) const noexcept
+{
+    std::uint16_t Depth = this->m_NodeDepths[Node];
+    std::uint16_t DirectoryDepth = this->m_NodeDepths[Directory];
+    if (Depth < DirectoryDepth)
+    {
+        return false;
+    }
+    for (; Depth > DirectoryDepth; --Depth)
+    {
+        Node = this->m_Store.GetNodeParent(Node);
+    }
+    return Node == Directory;
+}
+
+NSudoSweeper::ResultModel::ResultModel(
+    ResultStore& Store) :
+    m_Store(Store),
+    m_BySize(new Index()),
+    m_ByGroup(new Index()),
+    m_ByPath(new Index())
+{
+}
+
+NSudoSweeper::ResultModel::~ResultModel()
+{
+}
+
+std::size_t NSudoSweeper::ResultModel::Update()
+{
+    std::size_t OldCount = this->m_Sizes.size();
+    std::size_t NewCount = this->m_Store.GetCount();
+    if (NewCount <= OldCount)
+    {
+        return 0;
+    }
+
+    std::size_t NodeCount = this->m_Store.GetNodeCount();
+    for (std::size_t i = this->m_NodeDepths.size(); i < NodeCount; ++i)
+    {
+        std::uint32_t Parent = this->m_Store.GetNodeParent(
+            static_cast<std::uint32_t>(i));
+        this->m_NodeDepths.push_back(static_cast<std::uint16_t>(
+            Parent == ResultStoreNoNode ? 0 : this->m_NodeDepths[Parent] + 1));
+    }
+
+    for (std::size_t i = OldCount / ResultStoreChunkSize;
+        i < this->m_Store.GetChunkCount();
+        ++i)
+    {
+        ResultStoreChunk Columns;
+        if (!this->m_Store.GetChunk(i, Columns))
+        {
+            // The rows of a chunk which cannot be read are added by the
+            // next call.
+            break;
+        }
+
+        for (std::size_t Row = this->m_Sizes.size() - Columns.FirstIndex;
+            Row < Columns.Count;
+            ++Row)
+        {
+            this->m_Sizes.push_back(Columns.AllocationSizes[Row]
+                ? Columns.AllocationSizes[Row]
+                : Columns.Sizes[Row]);
+            this->m_Groups.push_back(Columns.Reasons[Row]);
+            this->m_Nodes.push_back(Columns.Nodes[Row]);
+        }
+    }
+    NewCount = this->m_Sizes.size();
+
+    std::vector<std::uint32_t> AddedRows;
+    AddedRows.reserve(NewCount - OldCount);
+    for (std::size_t i = OldCount; i < NewCount; ++i)
+    {
+        AddedRows.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    // A few rows are inserted, and many rows are sorted and merged, which
+    // is faster than inserting them when they are more than an eighth of
+    // the rows.
+    bool Rebuild = (NewCount - OldCount) * 8 >= NewCount;
+
+    const std::pair<ResultModelOrder, Index*> Indexes[] =
+    {
+        { ResultModelOrder::Size, this->m_BySize.get() },
+        { ResultModelOrder::Group, this->m_ByGroup.get() },
+        { ResultModelOrder::Path, this->m_ByPath.get() }
+    };
+    for (auto const& Current : Indexes)
+    {
+        ResultModelOrder Order = Current.first;
+        Index& Target = *Current.second;
+        auto IsLessInOrder = [this, Order](
+            std::uint32_t Left,
+            std::uint32_t Right)
+        {
+            return this->IsLess(Order, Left, Right);
+        };
+
+        if (!Rebuild)
+        {
+            for (std::uint32_t Row : AddedRows)
+            {
+                Target.Insert(Row, IsLessInOrder);
+            }
+        }
+        else if (Order == ResultModelOrder::Path)
+        {
+            std::vector<std::uint32_t> Rows(NewCount);
+            for (std::size_t i = 0; i < NewCount; ++i)
+            {
+                Rows[i] = static_cast<std::uint32_t>(i);
+            }
+            this->SortByPath(Rows);
+            Target.Build(Rows);
+        }
+        else
+        {
+            std::vector<std::uint32_t> Sorted = AddedRows;
+            std::sort(Sorted.begin(), Sorted.end(), IsLessInOrder);
+
+            std::vector<std::uint32_t> Existing;
+            Target.GetAllRows(Existing);
+
+            std::vector<std::uint32_t> Rows(NewCount);
+            std::merge(
+                Existing.begin(),
+                Existing.end(),
+                Sorted.begin(),
+                Sorted.end(),
+                Rows.begin(),
+                IsLessInOrder);
+            Target.Build(Rows);
+        }
+    }
+
+    return NewCount - OldCount;
+}
+
+void NSudoSweeper::ResultModel::Clear()
+{
+    this->m_Sizes.clear();
+    this->m_Groups.clear();
+    this->m_Nodes.clear();
+    this->m_NodeDepths.clear();
+    this->m_BySize->Clear();
+    this->m_ByGroup->Clear();
+    this->m_ByPath->Clear();
+}
+
+NSudoSweeper::ResultModelView NSudoSweeper::ResultModel::Find(
+    ResultModelQuery const& Query) const
+{
+    ResultModelView View;
+    View.Order = Query.Order;
+    View.Descending = Query.Descending;
+
+    Index const& Target = this->GetIndex(Query.Order);
+    std::size_t First = 0;
+    std::size_t Last = Target.GetCount();
+
+    if (Query.Order == ResultModelOrder::Size)
+    {
+        First = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->m_Sizes[Row] < Query.MinimumSize;
+        });
+        Last = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->m_Sizes[Row] <= Query.MaximumSize;
+        });
+    }
+    else if (Query.Order == ResultModelOrder::Group &&
+        Query.Group != ResultModelAllGroups)
+    {
+        First = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->m_Groups[Row] < Query.Group ||
+                (this->m_Groups[Row] == Query.Group &&
+                    this->m_Sizes[Row] < Query.MinimumSize);
+        });
+        Last = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->m_Groups[Row] < Query.Group ||
+                (this->m_Groups[Row] == Query.Group &&
+                    this->m_Sizes[Row] <= Query.MaximumSize);
+        });
+    }
+    else if (Query.Order == ResultModelOrder::Path &&
+        Query.Directory != ResultStoreNoNode)
+    {
+        if (Query.Directory >= this->m_NodeDepths.size())
+        {
+            return View;
+        }
+
+        First = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->ComparePaths(
+                this->m_Nodes[Row],
+                Query.Directory) < 0;
+        });
+        Last = Target.CountBefore([&](std::uint32_t Row)
+        {
+            return this->ComparePaths(
+                this->m_Nodes[Row],
+                Query.Directory) < 0 ||
+                this->IsInDirectory(this->m_Nodes[Row], Query.Directory);
+        });
+    }
+
+    View.First = First;
+    View.Count = Last > First ? Last - First : 0;
+    return View;
+}
+
+std::size_t NSudoSweeper::ResultModel::GetRow(
+    ResultModelView const& View,
+    std::size_t Position) const
+{
+    std::size_t Rank = View.Descending
+        ? View.First + View.Count - 1 - Position
+        : View.First + Position;
+    TreeLeaf const* Leaf = this->GetIndex(View.Order).Find(Rank);
+    return Leaf->Rows[Rank];
+}
+
+void NSudoSweeper::ResultModel::GetRows(
+    ResultModelView const& View,
+    std::size_t Position,
+    std::size_t Count,
+    std::vector<std::size_t>& Rows) const
+{
+    Rows.clear();
+    if (Position >= View.Count)
+    {
+        return;
+    }
+    Count = (std::min)(Count, View.Count - Position);
+    Rows.reserve(Count);
+
+    std::size_t Rank = View.Descending
+        ? View.First + View.Count - 1 - Position
+        : View.First + Position;
+    TreeLeaf const* Leaf = this->GetIndex(View.Order).Find(Rank);
+    while (Rows.size() < Count)
+    {
+        Rows.push_back(Leaf->Rows[Rank]);
+        if (View.Descending)
+        {
+            if (!Rank)
+            {
+                Leaf = Leaf->Previous;
+                if (!Leaf)
+                {
+                    break;
+                }
+                Rank = Leaf->Count;
+            }
+            --Rank;
+        }
+        else if (++Rank == Leaf->Count)
+        {
+            Leaf = Leaf->Next;
+            if (!Leaf)
+            {
+                break;
+            }
+            Rank = 0;
+        }
+    }
+}
+
+std::size_t NSudoSweeper::ResultModel::GetPosition(
+    ResultModelView const& View,
+    std::size_t Row) const
+{
+    if (Row >= this->m_Sizes.size())
+    {
+        return SIZE_MAX;
+    }
+
+    std::uint32_t Key = static_cast<std::uint32_t>(Row);
+    std::size_t Rank = this->GetIndex(View.Order).CountBefore(
+        [&](std::uint32_t Current)
+    {
+        return this->IsLess(View.Order, Current, Key);
+    });
+    if (Rank < View.First || Rank >= View.First + View.Count)
+    {
+        return SIZE_MAX;
+    }
+
+    return View.Descending
+        ? View.First + View.Count - 1 - Rank
+        : Rank - View.First;
+}
+
+void NSudoSweeper::ResultModel::GetTop(
+    std::size_t Count,
+    std::vector<std::size_t>& Rows) const
+{
+    ResultModelView View;
+    View.Order = ResultModelOrder::Size;
+    View.Descending = true;
+    View.Count = this->m_BySize->GetCount();
+    this->GetRows(View, 0, Count, Rows);
+}
@@ -0,0 +1,283 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultModel.h
+ * PURPOSE:   Definition for the indexed scan result model
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_RESULT_MODEL
+#define NSUDO_SWEEPER_RESULT_MODEL
+
+#include <Mile.Portable.h>
+
+#include "NSudoSweeperResultStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The orders of the rows of the result model.
+     */
+    enum class ResultModelOrder
+    {
+        /**
+         * By the size of the row.
+         */
+        Size,
+
+        /**
+         * By the group of the row, then by the size.
+         */
+        Group,
+
+        /**
+         * By the path of the row, segment by segment and without regard to
+         * case, so the items of a directory follow the directory.
+         */
+        Path,
+    };
+
+    /**
+     * The group of a query which selects the rows of all groups.
+     */
+    const std::uint32_t ResultModelAllGroups = UINT32_MAX;
+
+    /**
+     * A query of the result model. Every query selects a contiguous range of
+     * one index, so only the filters of its order apply.
+     */
+    struct ResultModelQuery
+    {
+        ResultModelOrder Order = ResultModelOrder::Size;
+
+        /**
+         * Indicates the largest size, the last group or the last path comes
+         * first.
+         */
+        bool Descending = true;
+
+        /**
+         * The group of the rows, or ResultModelAllGroups. It applies to the
+         * Group order.
+         */
+        std::uint32_t Group = ResultModelAllGroups;
+
+        /**
+         * The inclusive range of the size of the rows. It applies to the Size
+         * order, and to the Group order if a group is selected.
+         */
+        std::uint64_t MinimumSize = 0;
+        std::uint64_t MaximumSize = UINT64_MAX;
+
+        /**
+         * The node of the directory whose subtree is selected, or
+         * ResultStoreNoNode. It applies to the Path order.
+         */
+        std::uint32_t Directory = ResultStoreNoNode;
+    };
+
+    /**
+     * The rows a query selects. It is valid until the next call of
+     * ResultModel::Update or ResultModel::Clear.
+     */
+    struct ResultModelView
+    {
+        ResultModelOrder Order = ResultModelOrder::Size;
+        bool Descending = true;
+
+        /**
+         * The rank of the first row in the index, and the number of rows.
+         */
+        std::size_t First = 0;
+        std::size_t Count = 0;
+    };
+
+    /**
+     * Keeps the items of a result store in three order statistic trees, by
+     * size, by group and by path, so a virtual list view can show any
+     * position of any order and filter without sorting. The row of an item
+     * is its index in the store.
+     *
+     * The trees are counted B+ trees: each branch knows the number of rows
+     * below each of its children, so finding the row at a position and the
+     * position of a key take O(log n). The model is designed for a single
+     * owner, such as the UI thread, and takes no locks.
+     */
+    class ResultModel : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Index;
+
+        ResultStore& m_Store;
+
+        std::vector<std::uint64_t> m_Sizes;
+        std::vector<std::uint32_t> m_Groups;
+        std::vector<std::uint32_t> m_Nodes;
+        std::vector<std::uint16_t> m_NodeDepths;
+
+        std::unique_ptr<Index> m_BySize;
+        std::unique_ptr<Index> m_ByGroup;
+        std::unique_ptr<Index> m_ByPath;
+
+        Index const& GetIndex(
+            ResultModelOrder Order) const noexcept;
+
+        int ComparePaths(
+            std::uint32_t Left,
+            std::uint32_t Right) const noexcept;
+
+        bool IsLess(
+            ResultModelOrder Order,
+            std::uint32_t Left,
+            std::uint32_t Right) const noexcept;
+
+        void SortByPath(
+            std::vector<std::uint32_t>& Rows) const;
+
+        bool IsInDirectory(
+            std::uint32_t Node,
+            std::uint32_t Directory) const noexcept;
+
+    public:
+
+        /**
+         * Creates the model.
+         *
+         * @param Store The store of the items. It must outlive the model.
+         */
+        explicit ResultModel(
+            ResultStore& Store);
+
+        ~ResultModel();
+
+        /**
+         * Adds the items added to the store since the last call. Many items
+         * are merged into the trees at once, and a few are inserted one by
+         * one, so it can be called for each batch of a scan.
+         *
+         * @return The number of rows added.
+         */
+        std::size_t Update();
+
+        /**
+         * Removes all rows. It must be called when the store is cleared.
+         */
+        void Clear();
+
+        /**
+         * Retrieves the number of rows.
+         *
+         * @return The number of rows.
+         */
+        std::size_t GetCount() const noexcept
+        {
+            return this->m_Sizes.size();
+        }
+
+        /**
+         * Retrieves the rows a query selects.
+         *
+         * @param Query The query.
+         * @return The rows the query selects.
+         */
+        ResultModelView Find(
+            ResultModelQuery const& Query) const;
+
+        /**
+         * Retrieves the row at a position of a view.
+         *
+         * @param View The view.
+         * @param Position The position, which must be less than the number
+         *                 of rows of the view.
+         * @return The row, which is the index of the item in the store.
+         */
+        std::size_t GetRow(
+            ResultModelView const& View,
+            std::size_t Position) const;
+
+        /**
+         * Retrieves the rows at consecutive positions of a view, such as the
+         * visible rows of a list view or the top rows.
+         *
+         * @param View The view.
+         * @param Position The first position.
+         * @param Count The maximum number of rows.
+         * @param Rows The rows.
+         */
+        void GetRows(
+            ResultModelView const& View,
+            std::size_t Position,
+            std::size_t Count,
+            std::vector<std::size_t>& Rows) const;
+
+        /**
+         * Retrieves the position of a row in a view, such as to keep the
+         * selection of a list view when its order changes.
+         *
+         * @param View The view.
+         * @param Row The row.
+         * @return The position, or SIZE_MAX if the view does not have the
+         *         row.
+         */
+        std::size_t GetPosition(
+            ResultModelView const& View,
+            std::size_t Row) const;
+
+        /**
+         * Retrieves the largest rows.
+         *
+         * @param Count The maximum number of rows.
+         * @param Rows The rows, the largest first.
+         */
+        void GetTop(
+            std::size_t Count,
+            std::vector<std::size_t>& Rows) const;
+
+        /**
+         * Retrieves the size of a row, which is its allocation size, or its
+         * size if the allocation size is not known.
+         *
+         * @param Row The row.
+         * @return The size of the row.
+         */
+        std::uint64_t GetRowSize(
+            std::size_t Row) const noexcept
+        {
+            return this->m_Sizes[Row];
+        }
+
+        /**
+         * Retrieves the group of a row, which is the reason of its item.
+         *
+         * @param Row The row.
+         * @return The group of the row.
+         */
+        std::uint32_t GetRowGroup(
+            std::size_t Row) const noexcept
+        {
+            return this->m_Groups[Row];
+        }
+
+        /**
+         * Retrieves the node of the path of a row in the store.
+         *
+         * @param Row The row.
+         * @return The node of the row.
+         */
+        std::uint32_t GetRowNode(
+            std::size_t Row) const noexcept
+        {
+            return this->m_Nodes[Row];
+        }
+    };
+}
+
+#endif // !NSUDO_SWEEPER_RESULT_MODEL
@@ -0,0 +1,834 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultStore.cpp
+ * PURPOSE:   Implementation for the columnar scan result store
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperResultStore.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct NSudoSweeper::ResultStore::Chunk
+{
+    /**
+     * The columns, or nullptr if the chunk is spilled.
+     */
+    std::unique_ptr<std::uint64_t[]> Data;
+
+    /**
+     * The offset of the chunk in the spill file.
+     */
+    std::uint64_t SpillOffset = 0;
+
+    std::size_t Count = 0;
+};
+
+namespace
+{
+    const std::uint32_t EmptySlot = UINT32_MAX;
+
+    /**
+     * The hash tables are open addressing tables with linear probing, which
+     * grow when they are three quarters full.
+     */
+    const std::size_t InitialSlotCount = 1024;
+
+    /**
+     * The layout of a chunk, in 64-bit words. The five 64-bit columns come
+     * first, then the three 32-bit columns.
+     */
+    const std::size_t ChunkSize = NSudoSweeper::ResultStoreChunkSize;
+    const std::size_t SizeColumn = 0;
+    const std::size_t AllocationSizeColumn = ChunkSize;
+    const std::size_t FileIdColumn = 2 * ChunkSize;
+    const std::size_t CreationTimeColumn = 3 * ChunkSize;
+    const std::size_t LastWriteTimeColumn = 4 * ChunkSize;
+    const std::size_t NodeColumn = 5 * ChunkSize;
+    const std::size_t ReasonColumn = NodeColumn + ChunkSize / 2;
+    const std::size_t AttributeColumn = ReasonColumn + ChunkSize / 2;
+    const std::size_t ChunkWords = AttributeColumn + ChunkSize / 2;
+    const std::size_t ChunkBytes = ChunkWords * sizeof(std::uint64_t);
+
+    std::uint32_t* GetUInt32Column(
+        std::uint64_t* Data,
+        std::size_t Column) noexcept
+    {
+        return reinterpret_cast<std::uint32_t*>(Data + Column);
+    }
+
+    std::uint32_t const* GetUInt32Column(
+        std::uint64_t const* Data,
+        std::size_t Column) noexcept
+    {
+        return reinterpret_cast<std::uint32_t const*>(Data + Column);
+    }
+
+    std::uint64_t HashName(
+        Mile::NativeStringView Name) noexcept
+    {
+        // FNV-1a
+        std::uint64_t Hash = 14695981039346656037ULL;
+        for (auto Character : Name)
+        {
+            Hash ^= static_cast<std::uint64_t>(Character);
+            Hash *= 1099511628211ULL;
+        }
+        return Hash;
+    }
+
+    std::uint64_t HashNode(
+        std::uint32_t Parent,
+        std::uint32_t Name) noexcept
+    {
+        std::uint64_t Hash =
+            (static_cast<std::uint64_t>(Parent) << 32) | Name;
+        Hash ^= Hash >> 33;
+        Hash *= 0xFF51AFD7ED558CCDULL;
+        Hash ^= Hash >> 33;
+        return Hash;
+    }
+
+#if defined(_WIN32)
+
+    int OpenSpillFile(
+        Mile::NativeString const& Directory,
+        void*& Handle)
+    {
+        Mile::NativeString Path = Directory;
+        if (Path.empty())
+        {
+            wchar_t Buffer[MAX_PATH + 1];
+            DWORD Length = ::GetTempPathW(MAX_PATH + 1, Buffer);
+            if (!Length || Length > MAX_PATH)
+            {
+                return static_cast<int>(::GetLastError());
+            }
+            Path.assign(Buffer, Length);
+        }
+
+        wchar_t FileName[MAX_PATH];
+        if (!::GetTempFileNameW(Path.c_str(), L"NSS", 0, FileName))
+        {
+            return static_cast<int>(::GetLastError());
+        }
+
+        HANDLE FileHandle = ::CreateFileW(
+            FileName,
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+            nullptr);
+        if (FileHandle == INVALID_HANDLE_VALUE)
+        {
+            int Error = static_cast<int>(::GetLastError());
+            ::DeleteFileW(FileName);
+            return Error;
+        }
+
+        Handle = FileHandle;
+        return 0;
+    }
+
+    int WriteAt(
+        void* Handle,
+        std::uint64_t Offset,
+        void const* Data,
+        std::size_t Size)
+    {
+        std::uint8_t const* Current =
+            reinterpret_cast<std::uint8_t const*>(Data);
+        while (Size)
+        {
+            OVERLAPPED Overlapped = {};
+            Overlapped.Offset = static_cast<DWORD>(Offset);
+            Overlapped.OffsetHigh = static_cast<DWORD>(Offset >> 32);
+            DWORD Written = 0;
+            if (!::WriteFile(
+                Handle,
+                Current,
+                static_cast<DWORD>(Size),
+                &Written,
+                &Overlapped))
+            {
+                return static_cast<int>(::GetLastError());
+            }
+            Current += Written;
+            Offset += Written;
+            Size -= Written;
+        }
+        return 0;
+    }
+
+    int ReadAt(
+        void* Handle,
+        std::uint64_t Offset,
+        void* Data,
+        std::size_t Size)
+    {
+        std::uint8_t* Current = reinterpret_cast<std::uint8_t*>(Data);
+        while (Size)
+        {
+            OVERLAPPED Overlapped = {};
+            Overlapped.Offset = static_cast<DWORD>(Offset);
+            Overlapped.OffsetHigh = static_cast<DWORD>(Offset >> 32);
+            DWORD Read = 0;
+            if (!::ReadFile(
+                Handle,
+                Current,
+                static_cast<DWORD>(Size),
+                &Read,
+                &Overlapped))
+            {
+                return static_cast<int>(::GetLastError());
+            }
+            if (!Read)
+            {
+                return ERROR_HANDLE_EOF;
+            }
+            Current += Read;
+            Offset += Read;
+            Size -= Read;
+        }
+        return 0;
+    }
+
+#else
+
+    int OpenSpillFile(
+        Mile::NativeString const& Directory,
+        int& Handle)
+    {
+        Mile::NativeString Path = Directory;
+        if (Path.empty())
+        {
+            char const* TemporaryDirectory = std::getenv("TMPDIR");
+            Path = (TemporaryDirectory && *TemporaryDirectory)
+                ? TemporaryDirectory
+                : "/tmp";
+        }
+        if (Path.back() != NSudoSweeper::PathSeparator)
+        {
+            Path.push_back(NSudoSweeper::PathSeparator);
+        }
+        Path.append("NSudoSweeperXXXXXX");
+
+        int FileDescriptor = ::mkstemp(&Path[0]);
+        if (FileDescriptor == -1)
+        {
+            return errno;
+        }
+
+        // The file is removed when it is closed.
+        ::unlink(Path.c_str());
+        ::fcntl(FileDescriptor, F_SETFD, FD_CLOEXEC);
+
+        Handle = FileDescriptor;
+        return 0;
+    }
+
+    int WriteAt(
+        int Handle,
+        std::uint64_t Offset,
+        void const* Data,
+        std::size_t Size)
+    {
+        std::uint8_t const* Current =
+            reinterpret_cast<std::uint8_t const*>(Data);
+        while (Size)
+        {
+            ssize_t Written = ::pwrite(
+                Handle,
+                Current,
+                Size,
+                static_cast<off_t>(Offset));
+            if (Written == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno;
+            }
+            Current += Written;
+            Offset += static_cast<std::uint64_t>(Written);
+            Size -= static_cast<std::size_t>(Written);
+        }
+        return 0;
+    }
+
+    int ReadAt(
+        int Handle,
+        std::uint64_t Offset,
+        void* Data,
+        std::size_t Size)
+    {
+        std::uint8_t* Current = reinterpret_cast<std::uint8_t*>(Data);
+        while (Size)
+        {
+            ssize_t Read = ::pread(
+                Handle,
+                Current,
+                Size,
+                static_cast<off_t>(Offset));
+            if (Read == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno;
+            }
+            if (!Read)
+            {
+                return EIO;
+            }
+            Current += Read;
+            Offset += static_cast<std::uint64_t>(Read);
+            Size -= static_cast<std::size_t>(Read);
+        }
+        return 0;
+    }
+
+#endif
+}
+
+std::uint32_t NSudoSweeper::ResultStore::InternName(
+    Mile::NativeStringView Name)
+{
+    std::size_t Count = this->m_NameOffsets.size() - 1;
+    if ((Count + 1) * 4 > this->m_NameSlots.size() * 3)
+    {
+        std::vector<std::uint32_t> Slots(
+            this->m_NameSlots.empty()
+                ? InitialSlotCount
+                : this->m_NameSlots.size() * 2,
+            EmptySlot);
+        std::size_t Mask = Slots.size() - 1;
+        for (std::uint32_t i = 0; i < Count; ++i)
+        {
+            std::size_t Slot = static_cast<std::size_t>(
+                ::HashName(this->GetNameById(i))) & Mask;
+            while (Slots[Slot] != EmptySlot)
+            {
+                Slot = (Slot + 1) & Mask;
+            }
+            Slots[Slot] = i;
+        }
+        this->m_NameSlots = std::move(Slots);
+    }
+
+    std::size_t Mask = this->m_NameSlots.size() - 1;
+    std::size_t Slot = static_cast<std::size_t>(::HashName(Name)) & Mask;
+    while (this->m_NameSlots[Slot] != EmptySlot)
+    {
+        if (this->GetNameById(this->m_NameSlots[Slot]) == Name)
+        {
+            return this->m_NameSlots[Slot];
+        }
+        Slot = (Slot + 1) & Mask;
+    }
+
+    std::uint32_t Result = static_cast<std::uint32_t>(Count);
+    this->m_NameData.append(Name.data(), Name.size());
+    this->m_NameOffsets.push_back(
+        static_cast<std::uint32_t>(this->m_NameData.size()));
+    this->m_NameSlots[Slot] = Result;
+    return Result;
+}
+
+std::uint32_t NSudoSweeper::ResultStore::InternNode(
+    std::uint32_t Parent,
+    std::uint32_t Name)
+{
+    std::size_t Count = this->m_NodeParents.size();
+    if ((Count + 1) * 4 > this->m_NodeSlots.size() * 3)
+    {
+        std::vector<std::uint32_t> Slots(
+            this->m_NodeSlots.empty()
+                ? InitialSlotCount
+                : this->m_NodeSlots.size() * 2,
+            EmptySlot);
+        std::size_t Mask = Slots.size() - 1;
+        for (std::uint32_t i = 0; i < Count; ++i)
+        {
+            std::size_t Slot = static_cast<std::size_t>(::HashNode(
+                this->m_NodeParents[i],
+                this->m_NodeNames[i])) & Mask;
+            while (Slots[Slot] != EmptySlot)
+            {
+                Slot = (Slot + 1) & Mask;
+            }
+            Slots[Slot] = i;
+        }
+        this->m_NodeSlots = std::move(Slots);
+    }
+
+    std::size_t Mask = this->m_NodeSlots.size() - 1;
+    std::size_t Slot =
+        static_cast<std::size_t>(::HashNode(Parent, Name)) & Mask;
+    while (this->m_NodeSlots[Slot] != EmptySlot)
+    {
+        std::uint32_t Current = this->m_NodeSlots[Slot];
+        if (this->m_NodeParents[Current] == Parent &&
+            this->m_NodeNames[Current] == Name)
+        {
+            return Current;
+        }
+        Slot = (Slot + 1) & Mask;
+    }
+
+    std::uint32_t Result = static_cast<std::uint32_t>(Count);
+    this->m_NodeParents.push_back(Parent);
+    this->m_NodeNames.push_back(Name);
+    this->m_NodeSlots[Slot] = Result;
+    return Result;
+}
+
+std::uint32_t NSudoSweeper::ResultStore::InternDirectory(
+    Mile::NativeStringView Path)
+{
+    // The items of a directory usually come in a row.
+    if (this->m_LastDirectoryNode != ResultStoreNoNode &&
+        Mile::NativeStringView(this->m_LastDirectory) == Path)
+    {
+        return this->m_LastDirectoryNode;
+    }
+
+    std::uint32_t Node = ResultStoreNoNode;
+    std::size_t Start = 0;
+    for (;;)
+    {
+        std::size_t End = Path.find(NSudoSweeper::PathSeparator, Start);
+        Mile::NativeStringView Segment = Path.substr(
+            Start,
+            End == Mile::NativeStringView::npos
+                ? Mile::NativeStringView::npos
+                : End - Start);
+        Node = this->InternNode(Node, this->InternName(Segment));
+        if (End == Mile::NativeStringView::npos)
+        {
+            break;
+        }
+        Start = End + 1;
+    }
+
+    this->m_LastDirectory.assign(Path.data(), Path.size());
+    this->m_LastDirectoryNode = Node;
+    return Node;
+}
+
+Mile::NativeStringView NSudoSweeper::ResultStore::GetNameById(
+    std::uint32_t Name) const noexcept
+{
+    std::uint32_t Offset = this->m_NameOffsets[Name];
+    return Mile::NativeStringView(
+        this->m_NameData.data() + Offset,
+        this->m_NameOffsets[Name + 1] - Offset);
+}
+
+void NSudoSweeper::ResultStore::Spill()
+{
+    // The last chunk is being filled, so it is never spilled.
+    for (std::size_t i = 0;
+        i + 1 < this->m_Chunks.size() &&
+        this->GetStatistics().MemoryUsage > this->m_Options.MemoryBudget;
+        ++i)
+    {
+        Chunk& Current = *this->m_Chunks[i];
+        if (!Current.Data)
+        {
+            continue;
+        }
+
+#if defined(_WIN32)
+        if (!this->m_SpillFile)
+#else
+        if (this->m_SpillFile == -1)
+#endif
+        {
+            this->m_SpillError = ::OpenSpillFile(
+                this->m_Options.SpillDirectory,
+                this->m_SpillFile);
+            if (this->m_SpillError)
+            {
+                return;
+            }
+        }
+
+        this->m_SpillError = ::WriteAt(
+            this->m_SpillFile,
+            this->m_SpillSize,
+            Current.Data.get(),
+            ChunkBytes);
+        if (this->m_SpillError)
+        {
+            return;
+        }
+
+        Current.SpillOffset = this->m_SpillSize;
+        Current.Data.reset();
+        this->m_SpillSize += ChunkBytes;
+        --this->m_ResidentChunks;
+        ++this->m_SpilledChunks;
+    }
+}
+
+std::uint64_t const* NSudoSweeper::ResultStore::LoadChunk(
+    std::size_t Index)
+{
+    Chunk const& Current = *this->m_Chunks[Index];
+    if (Current.Data)
+    {
+        return Current.Data.get();
+    }
+
+    if (this->m_CachedChunk == Index)
+    {
+        return this->m_Cache.get();
+    }
+
+    if (!this->m_Cache)
+    {
+        this->m_Cache.reset(new std::uint64_t[ChunkWords]);
+    }
+
+    this->m_CachedChunk = SIZE_MAX;
+    if (::ReadAt(
+        this->m_SpillFile,
+        Current.SpillOffset,
+        this->m_Cache.get(),
+        ChunkBytes))
+    {
+        return nullptr;
+    }
+
+    this->m_CachedChunk = Index;
+    return this->m_Cache.get();
+}
+
+bool NSudoSweeper::ResultStore::ReadSpilledValue(
+    std::size_t Index,
+    std::size_t Column,
+    std::size_t ValueSize,
+    void* Value)
+{
+    Chunk const& Current = *this->m_Chunks[Index / ChunkSize];
+    return !::ReadAt(
+        this->m_SpillFile,
+        Current.SpillOffset +
+            Column * sizeof(std::uint64_t) +
+            (Index % ChunkSize) * ValueSize,
+        Value,
+        ValueSize);
+}
+
+std::uint64_t const* NSudoSweeper::ResultStore::LoadChunkForItem(
+    std::size_t Index)
+{
+    Chunk const& Current = *this->m_Chunks[Index];
+    if (Current.Data)
+    {
+        return Current.Data.get();
+    }
+
+    if (this->m_CachedChunk == Index)
+    {
+        return this->m_Cache.get();
+    }
+
+    // A single item of a spilled chunk is read by its fields, and the whole
+    // chunk only if the next item comes from the same chunk, as in a
+    // sequential read.
+    if (this->m_LastReadChunk != Index)
+    {
+        this->m_LastReadChunk = Index;
+        return nullptr;
+    }
+
+    return this->LoadChunk(Index);
+}
+
+void NSudoSweeper::ResultStore::CloseSpillFile() noexcept
+{
+#if defined(_WIN32)
+    if (this->m_SpillFile)
+    {
+        ::CloseHandle(this->m_SpillFile);
+        this->m_SpillFile = nullptr;
+    }
+#else
+    if (this->m_SpillFile != -1)
+    {
+        ::close(this->m_SpillFile);
+        this->m_SpillFile = -1;
+    }
+#endif
+    this->m_SpillSize = 0;
+}
+
+NSudoSweeper::ResultStore::ResultStore(
+    ResultStoreOptions const& Options) :
+    m_Options(Options)
+{
+    this->m_NameOffsets.push_back(0);
+}
+
+NSudoSweeper::ResultStore::~ResultStore()
+{
+    this->CloseSpillFile();
+}
+
+std::size_t NSudoSweeper::ResultStore::Add(
+    Mile::NativeStringView Path,
+    ResultStoreItem const& Item)
+{
+    std::uint32_t Parent = ResultStoreNoNode;
+    Mile::NativeStringView Name = Path;
+    std::size_t Separator = Path.rfind(NSudoSweeper::PathSeparator);
+    if (Separator != Mile::NativeStringView::npos)
+    {
+        Parent = this->InternDirectory(Path.substr(0, Separator));
+        Name = Path.substr(Separator + 1);
+    }
+    std::uint32_t Node = this->InternNode(Parent, this->InternName(Name));
+
+    if (this->m_Chunks.empty() || this->m_Chunks.back()->Count == ChunkSize)
+    {
+        std::unique_ptr<Chunk> NewChunk(new Chunk());
+        NewChunk->Data.reset(new std::uint64_t[ChunkWords]);
+        this->m_Chunks.push_back(std::move(NewChunk));
+        ++this->m_ResidentChunks;
+
+        if (this->m_Options.MemoryBudget)
+        {
+            this->Spill();
+        }
+    }
+
+    Chunk& Target = *this->m_Chunks.back();
+    std::uint64_t* Data = Target.Data.get();
+    std::size_t Row = Target.Count;
+    Data[SizeColumn + Row] = Item.Size;
+    Data[AllocationSizeColumn + Row] = Item.AllocationSize;
+    Data[FileIdColumn + Row] = Item.FileId;
+    Data[CreationTimeColumn + Row] = Item.CreationTime;
+    Data[LastWriteTimeColumn + Row] = Item.LastWriteTime;
+    ::GetUInt32Column(Data, NodeColumn)[Row] = Node;
+    ::GetUInt32Column(Data, ReasonColumn)[Row] = Item.Reason;
+    ::GetUInt32Column(Data, AttributeColumn)[Row] = Item.Attributes;
+    ++Target.Count;
+
+    return this->m_Count++;
+}
+
+void NSudoSweeper::ResultStore::Clear()
+{
+    this->m_NameData.clear();
+    this->m_NameOffsets.assign(1, 0);
+    this->m_NameSlots.clear();
+    this->m_NodeParents.clear();
+    this->m_NodeNames.clear();
+    this->m_NodeSlots.clear();
+    this->m_LastDirectory.clear();
+    this->m_LastDirectoryNode = ResultStoreNoNode;
+    this->m_Chunks.clear();
+    this->m_Count = 0;
+    this->m_ResidentChunks = 0;
+    this->m_SpilledChunks = 0;
+    this->m_SpillError = 0;
+    this->m_Cache.reset();
+    this->m_CachedChunk = SIZE_MAX;
+    this->m_LastReadChunk = SIZE_MAX;
+    this->CloseSpillFile();
+}
+
+bool NSudoSweeper::ResultStore::GetItem(
+    std::size_t Index,
+    ResultStoreItem& Item)
+{
+    if (Index >= this->m_Count)
+    {
+        return false;
+    }
+
+    std::uint64_t const* Data = this->LoadChunkForItem(Index / ChunkSize);
+    if (!Data)
+    {
+        const std::size_t Narrow = sizeof(std::uint32_t);
+        const std::size_t Wide = sizeof(std::uint64_t);
+        return
+            this->ReadSpilledValue(
+                Index, NodeColumn, Narrow, &Item.Node) &&
+            this->ReadSpilledValue(
+                Index, ReasonColumn, Narrow, &Item.Reason) &&
+            this->ReadSpilledValue(
+                Index, AttributeColumn, Narrow, &Item.Attributes) &&
+            this->ReadSpilledValue(
+                Index, SizeColumn, Wide, &Item.Size) &&
+            this->ReadSpilledValue(
+                Index, AllocationSizeColumn, Wide, &Item.AllocationSize) &&
+            this->ReadSpilledValue(
+                Index, FileIdColumn, Wide, &Item.FileId) &&
+            this->ReadSpilledValue(
+                Index, CreationTimeColumn, Wide, &Item.CreationTime) &&
+            this->ReadSpilledValue(
+                Index, LastWriteTimeColumn, Wide, &Item.LastWriteTime);
+    }
+
+    std::size_t Row = Index % ChunkSize;
+    Item.Node = ::GetUInt32Column(Data, NodeColumn)[Row];
+    Item.Reason = ::GetUInt32Column(Data, ReasonColumn)[Row];
+    Item.Attributes = ::GetUInt32Column(Data, AttributeColumn)[Row];
+    Item.Size = Data[SizeColumn + Row];
+    Item.AllocationSize = Data[AllocationSizeColumn + Row];
+    Item.FileId = Data[FileIdColumn + Row];
+    Item.CreationTime = Data[CreationTimeColumn + Row];
+    Item.LastWriteTime = Data[LastWriteTimeColumn + Row];
+    return true;
+}
+
+bool NSudoSweeper::ResultStore::GetPath(
+    std::size_t Index,
+    Mile::NativeString& Path)
+{
+    if (Index >= this->m_Count)
+    {
+        return false;
+    }
+
+    std::uint32_t Node = ResultStoreNoNode;
+    std::uint64_t const* Data = this->LoadChunkForItem(Index / ChunkSize);
+    if (Data)
+    {
+        Node = ::GetUInt32Column(Data, NodeColumn)[Index % ChunkSize];
+    }
+    else if (!this->ReadSpilledValue(Index, NodeColumn, sizeof(Node), &Node))
+    {
+        return false;
+    }
+
+    this->GetNodePath(Node, Path);
+    return true;
+}
+
+bool NSudoSweeper::ResultStore::GetChunk(
+    std::size_t Index,
+    ResultStoreChunk& Columns)
+{
+    if (Index >= this->m_Chunks.size())
+    {
+        return false;
+    }
+
+    std::uint64_t const* Data = this->LoadChunk(Index);
+    if (!Data)
+    {
+        return false;
+    }
+
+    Columns.FirstIndex = Index * ChunkSize;
+    Columns.Count = this->m_Chunks[Index]->Count;
+    Columns.Nodes = ::GetUInt32Column(Data, NodeColumn);
+    Columns.Reasons = ::GetUInt32Column(Data, ReasonColumn);
+    Columns.Attributes = ::GetUInt32Column(Data, AttributeColumn);
+    Columns.Sizes = Data + SizeColumn;
+    Columns.AllocationSizes = Data + AllocationSizeColumn;
+    Columns.FileIds = Data + FileIdColumn;
+    Columns.CreationTimes = Data + CreationTimeColumn;
+    Columns.LastWriteTimes = Data + LastWriteTimeColumn;
+    return true;
+}
+
+void NSudoSweeper::ResultStore::GetNodePath(
+    std::uint32_t Node,
+    Mile::NativeString& Path) const
+{
+    std::uint32_t Nodes[256];
+    std::vector<std::uint32_t> DeepNodes;
+    std::size_t Count = 0;
+    std::size_t Length = 0;
+    for (std::uint32_t Current = Node;
+        Current != ResultStoreNoNode;
+        Current = this->m_NodeParents[Current])
+    {
+        if (Count < 256)
+        {
+            Nodes[Count] = Current;
+        }
+        else
+        {
+            if (DeepNodes.empty())
+            {
+                DeepNodes.assign(Nodes, Nodes + Count);
+            }
+            DeepNodes.push_back(Current);
+        }
+        ++Count;
+        Length += this->GetNameById(this->m_NodeNames[Current]).size() + 1;
+    }
+
+    std::uint32_t const* Chain = DeepNodes.empty()
+        ? Nodes
+        : DeepNodes.data();
+
+    Path.clear();
+    Path.reserve(Length);
+    for (std::size_t i = Count; i > 0; --i)
+    {
+        if (i != Count)
+        {
+            Path.push_back(NSudoSweeper::PathSeparator);
+        }
+        Mile::NativeStringView Name =
+            this->GetNameById(this->m_NodeNames[Chain[i - 1]]);
+        Path.append(Name.data(), Name.size());
+    }
+}
+
+NSudoSweeper::ResultStoreStatistics
+NSudoSweeper::ResultStore::GetStatistics() const noexcept
+{
+    ResultStoreStatistics Statistics;
+    Statistics.Items = this->m_Count;
+    Statistics.Nodes = this->m_NodeParents.size();
+    Statistics.Names = this->m_NameOffsets.size() - 1;
+    Statistics.NameCharacters = this->m_NameData.size();
+    Statistics.SpilledChunks = this->m_SpilledChunks;
+    Statistics.SpilledBytes = this->m_SpillSize;
+
+    std::size_t Usage = this->m_ResidentChunks * ChunkBytes;
+    if (this->m_Cache)
+    {
+        Usage += ChunkBytes;
+    }
+    Usage += this->m_Chunks.capacity() * sizeof(std::unique_ptr<Chunk>);
+    Usage += this->m_Chunks.size() * sizeof(Chunk);
+    Usage += this->m_NameData.capacity() *
+        sizeof(Mile::NativeString::value_type);
+    Usage += (this->m_NameOffsets.capacity() +
+        this->m_NameSlots.capacity() +
+        this->m_NodeParents.capacity() +
+        this->m_NodeNames.capacity() +
+        this->m_NodeSlots.capacity()) * sizeof(std::uint32_t);
+    Statistics.MemoryUsage = Usage;
+
+    return Statistics;
+}
@@ -0,0 +1,371 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultStore.h
+ * PURPOSE:   Definition for the columnar scan result store
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_RESULT_STORE
+#define NSUDO_SWEEPER_RESULT_STORE
+
+#include <Mile.Portable.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * The result store keeps the items of a scan in a few bytes each.
+ *
+ *   Names          Every distinct path segment once, in one buffer.
+ *   Nodes          A tree of path segments: the parent node and the name of
+ *                  each node, 8 bytes per node. An item points to the node
+ *                  of its path, and the files of a directory share the
+ *                  nodes of the directory.
+ *   Chunks         ResultStoreChunkSize items each, with one array per
+ *                  column, 52 bytes per item. The full chunks are written
+ *                  to a temporary spill file, oldest first, while the store
+ *                  uses more than its memory budget.
+ *
+ * The names and the nodes always stay in memory.
+ */
+
+namespace NSudoSweeper
+{
+    /**
+     * The number of items in a chunk.
+     */
+    const std::size_t ResultStoreChunkSize = 16384;
+
+    /**
+     * The node of the parent of a top-level path segment.
+     */
+    const std::uint32_t ResultStoreNoNode = UINT32_MAX;
+
+    /**
+     * The metadata of an item.
+     */
+    struct ResultStoreItem
+    {
+        /**
+         * The node of the path of the item. It is ignored by Add.
+         */
+        std::uint32_t Node = ResultStoreNoNode;
+
+        /**
+         * The reason of the item, such as the index of the Include rule of
+         * the handler which selects it.
+         */
+        std::uint32_t Reason = 0;
+
+        /**
+         * The FILE_ATTRIBUTE_* flags on Windows, or the st_mode value
+         * elsewhere.
+         */
+        std::uint32_t Attributes = 0;
+
+        std::uint64_t Size = 0;
+        std::uint64_t AllocationSize = 0;
+        std::uint64_t FileId = 0;
+
+        /**
+         * The times in 100-nanosecond intervals since January 1, 1601 (UTC).
+         */
+        std::uint64_t CreationTime = 0;
+        std::uint64_t LastWriteTime = 0;
+    };
+
+    /**
+     * The columns of a chunk of items. The arrays are valid until the next
+     * call of ResultStore::GetChunk, ResultStore::Add or ResultStore::Clear.
+     */
+    struct ResultStoreChunk
+    {
+        /**
+         * The index of the first item of the chunk, and the number of items.
+         */
+        std::size_t FirstIndex = 0;
+        std::size_t Count = 0;
+
+        std::uint32_t const* Nodes = nullptr;
+        std::uint32_t const* Reasons = nullptr;
+        std::uint32_t const* Attributes = nullptr;
+        std::uint64_t const* Sizes = nullptr;
+        std::uint64_t const* AllocationSizes = nullptr;
+        std::uint64_t const* FileIds = nullptr;
+        std::uint64_t const* CreationTimes = nullptr;
+        std::uint64_t const* LastWriteTimes = nullptr;
+    };
+
+    /**
+     * The options of the result store.
+     */
+    struct ResultStoreOptions
+    {
+        /**
+         * The memory the store may use before it spills the full chunks, in
+         * bytes, or 0 for no limit.
+         */
+        std::size_t MemoryBudget = 0;
+
+        /**
+         * The directory of the spill file, or an empty string for the
+         * temporary directory of the system.
+         */
+        Mile::NativeString SpillDirectory;
+    };
+
+    /**
+     * The statistics of the result store.
+     */
+    struct ResultStoreStatistics
+    {
+        std::size_t Items;
+        std::size_t Nodes;
+        std::size_t Names;
+
+        /**
+         * The size of the distinct path segments, in characters.
+         */
+        std::size_t NameCharacters;
+
+        /**
+         * The memory the store uses, in bytes.
+         */
+        std::size_t MemoryUsage;
+
+        std::size_t SpilledChunks;
+        std::uint64_t SpilledBytes;
+    };
+
+    /**
+     * Keeps the items of a scan as a tree of interned path segments and
+     * metadata columns. The store is designed for a single owner and takes
+     * no locks, and the reading methods are not const because they may load
+     * spilled chunks.
+     */
+    class ResultStore : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Chunk;
+
+        ResultStoreOptions m_Options;
+
+        Mile::NativeString m_NameData;
+        std::vector<std::uint32_t> m_NameOffsets;
+        std::vector<std::uint32_t> m_NameSlots;
+
+        std::vector<std::uint32_t> m_NodeParents;
+        std::vector<std::uint32_t> m_NodeNames;
+        std::vector<std::uint32_t> m_NodeSlots;
+
+        Mile::NativeString m_LastDirectory;
+        std::uint32_t m_LastDirectoryNode = ResultStoreNoNode;
+
+        std::vector<std::unique_ptr<Chunk>> m_Chunks;
+        std::size_t m_Count = 0;
+        std::size_t m_ResidentChunks = 0;
+        std::size_t m_SpilledChunks = 0;
+
+#if defined(_WIN32)
+        void* m_SpillFile = nullptr;
+#else
+        int m_SpillFile = -1;
+#endif
+        std::uint64_t m_SpillSize = 0;
+        int m_SpillError = 0;
+
+        std::unique_ptr<std::uint64_t[]> m_Cache;
+        std::size_t m_CachedChunk = SIZE_MAX;
+        std::size_t m_LastReadChunk = SIZE_MAX;
+
+        std::uint32_t InternName(
+            Mile::NativeStringView Name);
+
+        std::uint32_t InternNode(
+            std::uint32_t Parent,
+            std::uint32_t Name);
+
+        std::uint32_t InternDirectory(
+            Mile::NativeStringView Path);
+
+        Mile::NativeStringView GetNameById(
+            std::uint32_t Name) const noexcept;
+
+        void Spill();
+
+        std::uint64_t const* LoadChunk(
+            std::size_t Index);
+
+        bool ReadSpilledValue(
+            std::size_t Index,
+            std::size_t Column,
+            std::size_t ValueSize,
+            void* Value);
+
+        std::uint64_t const* LoadChunkForItem(
+            std::size_t Index);
+
+        void CloseSpillFile() noexcept;
+
+    public:
+
+        /**
+         * Creates the store.
+         *
+         * @param Options The options of the store.
+         */
+        explicit ResultStore(
+            ResultStoreOptions const& Options = ResultStoreOptions());
+
+        /**
+         * Deletes the spill file.
+         */
+        ~ResultStore();
+
+        /**
+         * Adds an item. The items of a directory are added fastest in a
+         * row, as a tree walker reports them.
+         *
+         * @param Path The full path of the item.
+         * @param Item The metadata of the item.
+         * @return The index of the item.
+         */
+        std::size_t Add(
+            Mile::NativeStringView Path,
+            ResultStoreItem const& Item);
+
+        /**
+         * Removes all items and deletes the spill file.
+         */
+        void Clear();
+
+        /**
+         * Retrieves the number of items.
+         *
+         * @return The number of items.
+         */
+        std::size_t GetCount() const noexcept
+        {
+            return this->m_Count;
+        }
+
+        /**
+         * Retrieves the metadata of an item.
+         *
+         * @param Index The index of the item.
+         * @param Item The metadata of the item.
+         * @return true if successful, or false if the index is out of range
+         *         or the spilled chunk cannot be read.
+         */
+        bool GetItem(
+            std::size_t Index,
+            ResultStoreItem& Item);
+
+        /**
+         * Retrieves the full path of an item.
+         *
+         * @param Index The index of the item.
+         * @param Path The path of the item.
+         * @return true if successful, otherwise false.
+         */
+        bool GetPath(
+            std::size_t Index,
+            Mile::NativeString& Path);
+
+        /**
+         * Retrieves the number of chunks.
+         *
+         * @return The number of chunks.
+         */
+        std::size_t GetChunkCount() const noexcept
+        {
+            return this->m_Chunks.size();
+        }
+
+        /**
+         * Retrieves the columns of a chunk, which is the fastest way to read
+         * all items.
+         *
+         * @param Index The index of the chunk.
+         * @param Columns The columns of the chunk.
+         * @return true if successful, or false if the index is out of range
+         *         or the spilled chunk cannot be read.
+         */
+        bool GetChunk(
+            std::size_t Index,
+            ResultStoreChunk& Columns);
+
+        /**
+         * Retrieves the number of nodes. The parent of a node always has a
+         * lower number than the node.
+         *
+         * @return The number of nodes.
+         */
+        std::size_t GetNodeCount() const noexcept
+        {
+            return this->m_NodeParents.size();
+        }
+
+        /**
+         * Retrieves the full path of a node.
+         *
+         * @param Node The node.
+         * @param Path The path of the node.
+         */
+        void GetNodePath(
+            std::uint32_t Node,
+            Mile::NativeString& Path) const;
+
+        /**
+         * Retrieves the parent of a node.
+         *
+         * @param Node The node.
+         * @return The parent, or ResultStoreNoNode for a top-level segment.
+         */
+        std::uint32_t GetNodeParent(
+            std::uint32_t Node) const noexcept
+        {
+            return this->m_NodeParents[Node];
+        }
+
+        /**
+         * Retrieves the name of a node.
+         *
+         * @param Node The node.
+         * @return The name of the node. It is valid until the next call of
+         *         Add or Clear.
+         */
+        Mile::NativeStringView GetNodeName(
+            std::uint32_t Node) const noexcept
+        {
+            return this->GetNameById(this->m_NodeNames[Node]);
+        }
+
+        /**
+         * Retrieves the statistics of the store.
+         *
+         * @return The statistics of the store.
+         */
+        ResultStoreStatistics GetStatistics() const noexcept;
+
+        /**
+         * Retrieves the error of the last failed spill. The chunks stay in
+         * memory if they cannot be spilled.
+         *
+         * @return 0, or the Win32 error code on Windows and the errno value
+         *         elsewhere.
+         */
+        int GetSpillError() const noexcept
+        {
+            return this->m_SpillError;
+        }
+    };
+}
+
+#endif // !NSUDO_SWEEPER_RESULT_STORE
@@ -0,0 +1,1056 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperScanCache.cpp
+ * PURPOSE:   Implementation for the incremental scan cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperScanCache.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperVolume.h"
+
+#include <Mile.Portable.MappedFile.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#include <Mile.Windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /**
+     * "NSSCACHE" as a little-endian integer.
+     */
+    const std::uint64_t ScanCacheMagic = 0x454843414353534EULL;
+
+    const std::uint32_t ScanCacheVersion = 1;
+
+    /**
+     * The layout of the header. The members are stored at the offsets in
+     * this order without padding.
+     *
+     *   0    Magic                  uint64
+     *   8    Version                uint32
+     *   12   HeaderSize             uint32
+     *   16   FileSize               uint64
+     *   24   Key                    uint64
+     *   32   ScanTime               uint64
+     *   40   JournalCount           uint64
+     *   48   DirectoryCount         uint64
+     *   56   Reserved               uint64
+     *   64   Hash                   uint64
+     *
+     * The journals and then the directories follow the header. Their
+     * members are variable-length integers, and a string is its length in
+     * bytes followed by its UTF-8 characters.
+     *
+     *   Journal    VolumeKey, JournalId, NextUsn
+     *   Directory  Path, ChangeTime, FileId, EntryCount, SubdirectoryCount,
+     *              the names of the subdirectories, ItemCount, and the
+     *              items
+     *   Item       Name, Type, Size, AllocationSize, FileId
+     */
+    const std::size_t HeaderSize = 72;
+    const std::size_t HashOffset = 64;
+
+    /**
+     * The difference between January 1, 1601 and January 1, 1970, in
+     * 100-nanosecond intervals.
+     */
+    const std::uint64_t UnixEpochOffset = 116444736000000000ULL;
+
+    /**
+     * Removes the trailing separators, so the root of a walk and the parent
+     * of its items have the same key.
+     */
+    Mile::NativeStringView GetDirectoryKey(
+        Mile::NativeStringView Path) noexcept
+    {
+        while (!Path.empty() && NSudoSweeper::IsPathSeparator(Path.back()))
+        {
+            Path.remove_suffix(1);
+        }
+        return Path;
+    }
+
+    /**
+     * Splits the full path of an entry into the key of its directory and
+     * its name.
+     */
+    void SplitPath(
+        Mile::NativeStringView Path,
+        Mile::NativeStringView& Directory,
+        Mile::NativeStringView& Name) noexcept
+    {
+        std::size_t Separator = Path.size();
+        while (Separator && !NSudoSweeper::IsPathSeparator(Path[Separator - 1]))
+        {
+            --Separator;
+        }
+        Name = Path.substr(Separator);
+        Directory = ::GetDirectoryKey(Path.substr(0, Separator));
+    }
+
+    std::uint64_t GetCurrentFileTime() noexcept
+    {
+        return UnixEpochOffset + static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()
+            / 100);
+    }
+
+    void StoreUInt32(
+        std::uint8_t* Target,
+        std::uint32_t Value) noexcept
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Target[i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    void StoreUInt64(
+        std::uint8_t* Target,
+        std::uint64_t Value) noexcept
+    {
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Target[i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    std::uint32_t LoadUInt32(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    void AppendVarUInt(
+        std::vector<std::uint8_t>& Target,
+        std::uint64_t Value)
+    {
+        while (Value >= 0x80)
+        {
+            Target.push_back(static_cast<std::uint8_t>(Value | 0x80));
+            Value >>= 7;
+        }
+        Target.push_back(static_cast<std::uint8_t>(Value));
+    }
+
+    bool ReadVarUInt(
+        std::uint8_t const* Data,
+        std::size_t Size,
+        std::size_t& Offset,
+        std::uint64_t& Value) noexcept
+    {
+        Value = 0;
+        for (std::uint32_t Shift = 0; Shift < 64; Shift += 7)
+        {
+            if (Offset >= Size)
+            {
+                return false;
+            }
+
+            std::uint8_t Byte = Data[Offset++];
+            Value |= static_cast<std::uint64_t>(Byte & 0x7F) << Shift;
+            if (!(Byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Computes the 64-bit FNV-1a hash of a range of bytes, without the hash
+     * member of the header if the range is a whole file.
+     */
+    std::uint64_t Hash(
+        std::uint8_t const* Data,
+        std::size_t Size,
+        bool SkipHashMember) noexcept
+    {
+        std::uint64_t Value = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            if (SkipHashMember && i == HashOffset)
+            {
+                i += 7;
+                continue;
+            }
+            Value ^= Data[i];
+            Value *= 1099511628211ULL;
+        }
+        return Value;
+    }
+
+    Mile::NativeString ToNativeString(
+        std::string const& String)
+    {
+#if defined(_WIN32)
+        return Mile::ToUtf16String(String);
+#else
+        return String;
+#endif
+    }
+
+    void AppendString(
+        std::vector<std::uint8_t>& Target,
+        Mile::NativeStringView String)
+    {
+        std::string Utf8String = NSudoSweeper::ToUtf8String(String);
+        ::AppendVarUInt(Target, Utf8String.size());
+        Target.insert(Target.end(), Utf8String.begin(), Utf8String.end());
+    }
+
+    bool ReadString(
+        std::uint8_t const* Data,
+        std::size_t Size,
+        std::size_t& Offset,
+        Mile::NativeString& String)
+    {
+        std::uint64_t Length = 0;
+        if (!::ReadVarUInt(Data, Size, Offset, Length) ||
+            Length > Size - Offset)
+        {
+            return false;
+        }
+
+        String = ::ToNativeString(std::string(
+            reinterpret_cast<char const*>(Data + Offset),
+            static_cast<std::size_t>(Length)));
+        Offset += static_cast<std::size_t>(Length);
+        return true;
+    }
+
+    /**
+     * Writes a file under a temporary name and renames it.
+     *
+     * @return 0 if successful, otherwise the system error code.
+     */
+    int WriteFileAtomically(
+        Mile::NativeString const& Path,
+        std::vector<std::uint8_t> const& Content)
+    {
+        Mile::NativeString TemporaryPath = Path;
+#if defined(_WIN32)
+        TemporaryPath.append(L".tmp");
+
+        HANDLE FileHandle = ::CreateFileW(
+            TemporaryPath.c_str(),
+            GENERIC_WRITE,
+            0,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+        if (FileHandle == INVALID_HANDLE_VALUE)
+        {
+            return static_cast<int>(::GetLastError());
+        }
+
+        int Error = 0;
+        std::size_t Offset = 0;
+        while (!Error && Offset < Content.size())
+        {
+            DWORD Size = static_cast<DWORD>((std::min)(
+                Content.size() - Offset,
+                static_cast<std::size_t>(1) << 30));
+            DWORD Written = 0;
+            if (!::WriteFile(
+                FileHandle,
+                &Content[Offset],
+                Size,
+                &Written,
+                nullptr))
+            {
+                Error = static_cast<int>(::GetLastError());
+            }
+            Offset += Written;
+        }
+        if (!Error && !::FlushFileBuffers(FileHandle))
+        {
+            Error = static_cast<int>(::GetLastError());
+        }
+        ::CloseHandle(FileHandle);
+
+        if (!Error && !::MoveFileExW(
+            TemporaryPath.c_str(),
+            Path.c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            Error = static_cast<int>(::GetLastError());
+        }
+        if (Error)
+        {
+            ::DeleteFileW(TemporaryPath.c_str());
+        }
+        return Error;
+#else
+        TemporaryPath.append(".tmp");
+
+        int FileDescriptor = ::open(
+            TemporaryPath.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+        if (FileDescriptor == -1)
+        {
+            return errno;
+        }
+
+        int Error = 0;
+        std::size_t Offset = 0;
+        while (!Error && Offset < Content.size())
+        {
+            ssize_t Written = ::write(
+                FileDescriptor,
+                &Content[Offset],
+                Content.size() - Offset);
+            if (Written == -1)
+            {
+                if (errno != EINTR)
+                {
+                    Error = errno;
+                }
+                continue;
+            }
+            Offset += static_cast<std::size_t>(Written);
+        }
+        if (!Error && -1 == ::fsync(FileDescriptor))
+        {
+            Error = errno;
+        }
+        if (-1 == ::close(FileDescriptor) && !Error)
+        {
+            Error = errno;
+        }
+
+        if (!Error && -1 == ::rename(TemporaryPath.c_str(), Path.c_str()))
+        {
+            Error = errno;
+        }
+        if (Error)
+        {
+            ::unlink(TemporaryPath.c_str());
+        }
+        return Error;
+#endif
+    }
+
+#if defined(_WIN32)
+    /**
+     * Opens the device of a volume to control its change journal.
+     *
+     * @return The handle, or INVALID_HANDLE_VALUE.
+     */
+    HANDLE OpenVolumeDevice(
+        Mile::NativeString const& VolumeKey)
+    {
+        Mile::NativeString DevicePath =
+            NSudoSweeper::GetVolumeDevicePath(VolumeKey);
+        if (DevicePath.empty())
+        {
+            ::SetLastError(ERROR_INVALID_NAME);
+            return INVALID_HANDLE_VALUE;
+        }
+
+        return ::CreateFileW(
+            DevicePath.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            0,
+            nullptr);
+    }
+#endif
+}
+
+int NSudoSweeper::QueryDirectoryFingerprint(
+    Mile::NativeString const& Path,
+    DirectoryFingerprint& Fingerprint)
+{
+    Fingerprint = DirectoryFingerprint();
+
+#if defined(_WIN32)
+    HANDLE FileHandle = ::CreateFileW(
+        Path.c_str(),
+        FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS,
+        nullptr);
+    if (FileHandle == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int>(::GetLastError());
+    }
+
+    int Error = 0;
+    BY_HANDLE_FILE_INFORMATION Information;
+    FILE_BASIC_INFO BasicInformation;
+    if (::GetFileInformationByHandle(FileHandle, &Information) &&
+        ::GetFileInformationByHandleEx(
+            FileHandle,
+            FileBasicInfo,
+            &BasicInformation,
+            sizeof(BasicInformation)))
+    {
+        // Not every file system maintains the change time.
+        Fingerprint.ChangeTime = static_cast<std::uint64_t>((std::max)(
+            BasicInformation.LastWriteTime.QuadPart,
+            BasicInformation.ChangeTime.QuadPart));
+        Fingerprint.FileId =
+            (static_cast<std::uint64_t>(Information.nFileIndexHigh) << 32) |
+            Information.nFileIndexLow;
+    }
+    else
+    {
+        Error = static_cast<int>(::GetLastError());
+    }
+
+    ::CloseHandle(FileHandle);
+    return Error;
+#else
+    struct stat Status;
+    if (-1 == ::stat(Path.c_str(), &Status))
+    {
+        return errno;
+    }
+    if (!S_ISDIR(Status.st_mode))
+    {
+        return ENOTDIR;
+    }
+
+    // A rename of an entry may only change the change time.
+    struct timespec const& Time =
+        (Status.st_ctim.tv_sec > Status.st_mtim.tv_sec ||
+            (Status.st_ctim.tv_sec == Status.st_mtim.tv_sec &&
+                Status.st_ctim.tv_nsec > Status.st_mtim.tv_nsec))
+        ? Status.st_ctim
+        : Status.st_mtim;
+    if (Time.tv_sec >= 0)
+    {
+        Fingerprint.ChangeTime = UnixEpochOffset +
+            static_cast<std::uint64_t>(Time.tv_sec) * 10000000 +
+            static_cast<std::uint64_t>(Time.tv_nsec) / 100;
+    }
+    Fingerprint.FileId = static_cast<std::uint64_t>(Status.st_ino);
+    return 0;
+#endif
+}
+
+int NSudoSweeper::QueryChangeJournal(
+    ScanCacheJournal& Journal)
+{
+#if defined(_WIN32)
+    HANDLE VolumeHandle = ::OpenVolumeDevice(Journal.VolumeKey);
+    if (VolumeHandle == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int>(::GetLastError());
+    }
+
+    USN_JOURNAL_DATA_V0 Data;
+    DWORD BytesReturned = 0;
+    Mile::HResult Result = Mile::DeviceIoControl(
+        VolumeHandle,
+        FSCTL_QUERY_USN_JOURNAL,
+        nullptr,
+        0,
+        &Data,
+        sizeof(Data),
+        &BytesReturned);
+    ::CloseHandle(VolumeHandle);
+    if (Result.IsFailed())
+    {
+        return static_cast<int>(Result.GetCode());
+    }
+
+    Journal.JournalId = Data.UsnJournalID;
+    Journal.NextUsn = static_cast<std::uint64_t>(Data.NextUsn);
+    return 0;
+#else
+    Mile::UnreferencedParameter(Journal);
+    return ENOTSUP;
+#endif
+}
+
+int NSudoSweeper::ReadChangeJournal(
+    ScanCacheJournal const& From,
+    ScanCacheJournal const& To,
+    ChangeJournalChangeSet& Changes)
+{
+#if defined(_WIN32)
+    if (From.JournalId != To.JournalId)
+    {
+        // The journal has been deleted and created again.
+        return ERROR_JOURNAL_ENTRY_DELETED;
+    }
+
+    HANDLE VolumeHandle = ::OpenVolumeDevice(To.VolumeKey);
+    if (VolumeHandle == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int>(::GetLastError());
+    }
+
+    // The version 1 of the request asks for the records with 128-bit file
+    // IDs and the ranges of the writes as well, and the version 0 is the
+    // only one before Windows 8.
+    READ_USN_JOURNAL_DATA_V1 Read = {};
+    Read.StartUsn = static_cast<USN>(From.NextUsn);
+    Read.ReasonMask = 0xFFFFFFFF;
+    Read.UsnJournalID = To.JournalId;
+    Read.MinMajorVersion = 2;
+    Read.MaxMajorVersion = 4;
+    DWORD ReadSize = sizeof(READ_USN_JOURNAL_DATA_V1);
+
+    // The records are aligned to 8 bytes.
+    std::vector<std::uint64_t> Buffer(64 * 1024 / sizeof(std::uint64_t));
+    DWORD BufferSize = static_cast<DWORD>(
+        Buffer.size() * sizeof(std::uint64_t));
+    std::uint8_t const* Data =
+        reinterpret_cast<std::uint8_t const*>(Buffer.data());
+
+    int Error = 0;
+    while (!Error && static_cast<std::uint64_t>(Read.StartUsn) < To.NextUsn)
+    {
+        DWORD BytesReturned = 0;
+        Mile::HResult Result = Mile::DeviceIoControl(
+            VolumeHandle,
+            FSCTL_READ_USN_JOURNAL,
+            &Read,
+            ReadSize,
+            Buffer.data(),
+            BufferSize,
+            &BytesReturned);
+        if (Result.IsFailed())
+        {
+            if (ReadSize == sizeof(READ_USN_JOURNAL_DATA_V1) &&
+                (Result.GetCode() == ERROR_INVALID_PARAMETER ||
+                    Result.GetCode() == ERROR_INVALID_FUNCTION))
+            {
+                ReadSize = sizeof(READ_USN_JOURNAL_DATA_V0);
+                continue;
+            }
+            Error = static_cast<int>(Result.GetCode());
+            break;
+        }
+        if (BytesReturned <= sizeof(USN))
+        {
+            break;
+        }
+
+        if (!Changes.AddRecords(
+            Data + sizeof(USN),
+            BytesReturned - sizeof(USN),
+            To.NextUsn))
+        {
+            Error = ERROR_INVALID_DATA;
+            break;
+        }
+
+        USN NextUsn = *reinterpret_cast<USN const*>(Data);
+        if (NextUsn <= Read.StartUsn)
+        {
+            break;
+        }
+        Read.StartUsn = NextUsn;
+    }
+
+    ::CloseHandle(VolumeHandle);
+
+    // The file IDs are only unique on a volume.
+    Changes.Fold();
+    return Error;
+#else
+    Mile::UnreferencedParameter(From);
+    Mile::UnreferencedParameter(To);
+    Mile::UnreferencedParameter(Changes);
+    return ENOTSUP;
+#endif
+}
+
+NSudoSweeper::ScanCache::ScanCache(
+    ScanCacheOptions const& Options) :
+    m_Options(Options)
+{
+}
+
+void NSudoSweeper::ScanCache::SetIdentity(
+    Mile::NativeStringView Identity)
+{
+    std::string Utf8String = NSudoSweeper::ToUtf8String(Identity);
+    this->m_Key = ::Hash(
+        reinterpret_cast<std::uint8_t const*>(Utf8String.data()),
+        Utf8String.size(),
+        false);
+}
+
+bool NSudoSweeper::ScanCache::Load(
+    Mile::NativeString const& Path,
+    ScanCacheError& Error)
+{
+    Error = ScanCacheError();
+
+    this->m_Previous.clear();
+    this->m_PreviousJournals.clear();
+    this->m_PreviousScanTime = 0;
+
+    Mile::MappedFile File;
+    if (!File.Open(Path, Mile::MappedFileAccess::Sequential))
+    {
+        Error.SystemError = File.GetLastErrorCode();
+        Error.Message = "The file cannot be read";
+        return false;
+    }
+
+    std::uint8_t const* Data =
+        static_cast<std::uint8_t const*>(File.GetData());
+    std::size_t Size = File.GetSize();
+
+    if (Size < HeaderSize || ::LoadUInt64(Data) != ScanCacheMagic)
+    {
+        Error.Message = "The file is not a scan cache";
+        return false;
+    }
+
+    if (::LoadUInt32(Data + 8) != ScanCacheVersion ||
+        ::LoadUInt32(Data + 12) != HeaderSize)
+    {
+        Error.Message = "The version of the scan cache is not supported";
+        return false;
+    }
+
+    if (::LoadUInt64(Data + 16) != Size ||
+        ::LoadUInt64(Data + HashOffset) != ::Hash(Data, Size, true))
+    {
+        Error.Message = "The scan cache is damaged";
+        return false;
+    }
+
+    if (::LoadUInt64(Data + 24) != this->m_Key)
+    {
+        Error.Message = "The scan cache belongs to another configuration";
+        return false;
+    }
+
+    std::uint64_t ScanTime = ::LoadUInt64(Data + 32);
+    std::uint64_t JournalCount = ::LoadUInt64(Data + 40);
+    std::uint64_t DirectoryCount = ::LoadUInt64(Data + 48);
+
+    std::vector<ScanCacheJournal> Journals;
+    std::unordered_map<Mile::NativeString, ScanCacheDirectory> Directories;
+
+    bool Valid = true;
+    std::size_t Offset = HeaderSize;
+    for (std::uint64_t i = 0; Valid && i < JournalCount; ++i)
+    {
+        ScanCacheJournal Journal;
+        Valid = ::ReadString(Data, Size, Offset, Journal.VolumeKey) &&
+            ::ReadVarUInt(Data, Size, Offset, Journal.JournalId) &&
+            ::ReadVarUInt(Data, Size, Offset, Journal.NextUsn);
+        Journals.push_back(std::move(Journal));
+    }
+
+    for (std::uint64_t i = 0; Valid && i < DirectoryCount; ++i)
+    {
+        Mile::NativeString DirectoryPath;
+        ScanCacheDirectory Directory;
+        DirectoryFingerprint& Fingerprint = Directory.Fingerprint;
+        std::uint64_t SubdirectoryCount = 0;
+        std::uint64_t ItemCount = 0;
+        Valid = ::ReadString(Data, Size, Offset, DirectoryPath) &&
+            ::ReadVarUInt(Data, Size, Offset, Fingerprint.ChangeTime) &&
+            ::ReadVarUInt(Data, Size, Offset, Fingerprint.FileId) &&
+            ::ReadVarUInt(Data, Size, Offset, Fingerprint.EntryCount) &&
+            ::ReadVarUInt(Data, Size, Offset, SubdirectoryCount) &&
+            SubdirectoryCount <= Size - Offset;
+        for (std::uint64_t j = 0; Valid && j < SubdirectoryCount; ++j)
+        {
+            Mile::NativeString Name;
+            Valid = ::ReadString(Data, Size, Offset, Name);
+            Directory.Subdirectories.push_back(std::move(Name));
+        }
+
+        Valid = Valid &&
+            ::ReadVarUInt(Data, Size, Offset, ItemCount) &&
+            ItemCount <= Size - Offset;
+        Fingerprint.AggregateSize = 0;
+        for (std::uint64_t j = 0; Valid && j < ItemCount; ++j)
+        {
+            ScanCacheItem Item;
+            std::uint64_t Type = 0;
+            Valid = ::ReadString(Data, Size, Offset, Item.Name) &&
+                ::ReadVarUInt(Data, Size, Offset, Type) &&
+                Type <= static_cast<std::uint64_t>(
+                    Mile::FileEntryType::Other) &&
+                ::ReadVarUInt(Data, Size, Offset, Item.Size) &&
+                ::ReadVarUInt(Data, Size, Offset, Item.AllocationSize) &&
+                ::ReadVarUInt(Data, Size, Offset, Item.FileId);
+            Item.Type = static_cast<Mile::FileEntryType>(Type);
+            Fingerprint.AggregateSize += Item.Size;
+            Directory.Items.push_back(std::move(Item));
+        }
+
+        Directory.Complete = true;
+        Directories.emplace(std::move(DirectoryPath), std::move(Directory));
+    }
+
+    if (!Valid || Offset != Size)
+    {
+        Error.Message = "The scan cache is damaged";
+        return false;
+    }
+
+    this->m_Previous = std::move(Directories);
+    this->m_PreviousJournals = std::move(Journals);
+    this->m_PreviousScanTime = ScanTime;
+    return true;
+}
+
+void NSudoSweeper::ScanCache::BeginScan()
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    this->m_HasChangedDirectories = false;
+    this->m_Changes.Clear();
+    this->m_Current.clear();
+    this->m_Journals.clear();
+    this->m_ScanTime = ::GetCurrentFileTime();
+    this->m_EnumeratedDirectories = 0;
+    this->m_RefreshedDirectories = 0;
+    this->m_ReusedDirectories = 0;
+}
+
+void NSudoSweeper::ScanCache::AddJournal(
+    ScanCacheJournal const& Journal)
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    this->m_Journals.push_back(Journal);
+}
+
+void NSudoSweeper::ScanCache::SetChangedDirectories(
+    ChangeJournalChangeSet Changes)
+{
+    this->m_Changes = std::move(Changes);
+    this->m_HasChangedDirectories = true;
+}
+
+bool NSudoSweeper::ScanCache::IsInMovedDirectory(
+    Mile::NativeStringView Path) const
+{
+    if (!this->m_Changes.HasMovedDirectories())
+    {
+        return false;
+    }
+
+    // The entries of the directories below a moved directory have not
+    // changed, but their paths name other directories now.
+    Mile::NativeStringView Directory = ::GetDirectoryKey(Path);
+    for (;;)
+    {
+        std::size_t Separator = Directory.size();
+        while (Separator &&
+            !NSudoSweeper::IsPathSeparator(Directory[Separator - 1]))
+        {
+            --Separator;
+        }
+        if (!Separator)
+        {
+            return false;
+        }
+        Directory = ::GetDirectoryKey(Directory.substr(0, Separator));
+
+        auto Iterator = this->m_Previous.find(Mile::NativeString(Directory));
+        if (Iterator != this->m_Previous.end() &&
+            Iterator->second.Fingerprint.FileId &&
+            this->m_Changes.IsDirectoryMoved(
+                Iterator->second.Fingerprint.FileId))
+        {
+            return true;
+        }
+    }
+}
+
+NSudoSweeper::ScanCacheDecision NSudoSweeper::ScanCache::Decide(
+    Mile::NativeStringView Path,
+    DirectoryFingerprint const& Fingerprint,
+    ScanCacheDirectory const*& Previous) const
+{
+    Previous = nullptr;
+
+    auto Iterator = this->m_Previous.find(
+        Mile::NativeString(::GetDirectoryKey(Path)));
+    if (Iterator == this->m_Previous.end())
+    {
+        return ScanCacheDecision::Enumerate;
+    }
+    ScanCacheDirectory const& Directory = Iterator->second;
+    DirectoryFingerprint const& Cached = Directory.Fingerprint;
+
+    if (this->m_HasChangedDirectories)
+    {
+        if (!Cached.FileId ||
+            this->m_Changes.IsDirectoryChanged(Cached.FileId) ||
+            this->IsInMovedDirectory(Path))
+        {
+            return ScanCacheDecision::Enumerate;
+        }
+
+        Previous = &Directory;
+        return this->m_Changes.HasModifiedFiles(Cached.FileId)
+            ? ScanCacheDecision::Refresh
+            : ScanCacheDecision::Reuse;
+    }
+
+    if (!Fingerprint.ChangeTime ||
+        Fingerprint.ChangeTime != Cached.ChangeTime ||
+        Fingerprint.FileId != Cached.FileId)
+    {
+        return ScanCacheDecision::Enumerate;
+    }
+
+    // A change in the same tick as the previous scan leaves the time as it
+    // is, so a time that close to the scan does not prove anything.
+    if (Cached.ChangeTime + this->m_Options.TimestampGranularity >=
+        this->m_PreviousScanTime)
+    {
+        return ScanCacheDecision::Enumerate;
+    }
+
+    if ((Fingerprint.EntryCount != ScanCacheUnknown &&
+        Fingerprint.EntryCount != Cached.EntryCount) ||
+        (Fingerprint.AggregateSize != ScanCacheUnknown &&
+            Fingerprint.AggregateSize != Cached.AggregateSize))
+    {
+        return ScanCacheDecision::Enumerate;
+    }
+
+    Previous = &Directory;
+    return ScanCacheDecision::Refresh;
+}
+
+bool NSudoSweeper::ScanCache::IsItemChanged(
+    ScanCacheDecision Decision,
+    std::uint64_t FileId) const
+{
+    if (Decision == ScanCacheDecision::Enumerate)
+    {
+        return false;
+    }
+
+    // The journal names the changed files, and an item without an ID may
+    // be any of them. A file with hard links may have changed through a
+    // link in another directory.
+    if (this->m_HasChangedDirectories && FileId)
+    {
+        return this->m_Changes.IsFileModified(FileId);
+    }
+
+    return Decision == ScanCacheDecision::Refresh;
+}
+
+void NSudoSweeper::ScanCache::AddDirectory(
+    Mile::NativeStringView Path,
+    DirectoryFingerprint const& Fingerprint)
+{
+    Mile::NativeString Key(::GetDirectoryKey(Path));
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    ScanCacheDirectory& Directory = this->m_Current[Key];
+    Directory.Fingerprint = Fingerprint;
+    Directory.Complete = false;
+    ++this->m_EnumeratedDirectories;
+}
+
+void NSudoSweeper::ScanCache::CompleteDirectory(
+    Mile::NativeStringView Path,
+    std::uint64_t EntryCount,
+    std::vector<Mile::NativeStringView> const& Subdirectories)
+{
+    std::vector<Mile::NativeString> Names;
+    Names.reserve(Subdirectories.size());
+    for (Mile::NativeStringView Subdirectory : Subdirectories)
+    {
+        Mile::NativeStringView Parent;
+        Mile::NativeStringView Name;
+        ::SplitPath(::GetDirectoryKey(Subdirectory), Parent, Name);
+        Names.emplace_back(Name);
+    }
+
+    Mile::NativeString Key(::GetDirectoryKey(Path));
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    auto Iterator = this->m_Current.find(Key);
+    if (Iterator == this->m_Current.end() ||
+        !Iterator->second.Fingerprint.ChangeTime)
+    {
+        // A directory without a fingerprint is never reused.
+        return;
+    }
+
+    ScanCacheDirectory& Directory = Iterator->second;
+    Directory.Fingerprint.EntryCount = EntryCount;
+    Directory.Subdirectories = std::move(Names);
+    Directory.Complete = true;
+}
+
+void NSudoSweeper::ScanCache::ReuseDirectory(
+    Mile::NativeStringView Path,
+    ScanCacheDecision Decision,
+    ScanCacheDirectory const& Previous)
+{
+    Mile::NativeString Key(::GetDirectoryKey(Path));
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    ScanCacheDirectory& Directory = this->m_Current[Key];
+    Directory.Fingerprint = Previous.Fingerprint;
+    Directory.Subdirectories = Previous.Subdirectories;
+    Directory.Complete = true;
+
+    if (Decision == ScanCacheDecision::Reuse)
+    {
+        ++this->m_ReusedDirectories;
+    }
+    else
+    {
+        ++this->m_RefreshedDirectories;
+    }
+}
+
+void NSudoSweeper::ScanCache::AddItem(
+    Mile::NativeStringView Path,
+    ScanCacheItem const& Item)
+{
+    Mile::NativeStringView DirectoryPath;
+    Mile::NativeStringView Name;
+    ::SplitPath(Path, DirectoryPath, Name);
+
+    Mile::NativeString Key(DirectoryPath);
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    ScanCacheDirectory& Directory = this->m_Current[Key];
+    Directory.Items.push_back(Item);
+    Directory.Items.back().Name.assign(Name);
+}
+
+bool NSudoSweeper::ScanCache::Save(
+    Mile::NativeString const& Path,
+    ScanCacheError& Error)
+{
+    Error = ScanCacheError();
+
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    std::vector<std::uint8_t> Content(HeaderSize);
+
+    for (ScanCacheJournal const& Journal : this->m_Journals)
+    {
+        ::AppendString(Content, Journal.VolumeKey);
+        ::AppendVarUInt(Content, Journal.JournalId);
+        ::AppendVarUInt(Content, Journal.NextUsn);
+    }
+
+    std::uint64_t DirectoryCount = 0;
+    for (auto const& Current : this->m_Current)
+    {
+        ScanCacheDirectory const& Directory = Current.second;
+        if (!Directory.Complete)
+        {
+            continue;
+        }
+        ++DirectoryCount;
+
+        ::AppendString(Content, Current.first);
+        ::AppendVarUInt(Content, Directory.Fingerprint.ChangeTime);
+        ::AppendVarUInt(Content, Directory.Fingerprint.FileId);
+        ::AppendVarUInt(Content, Directory.Fingerprint.EntryCount);
+
+        ::AppendVarUInt(Content, Directory.Subdirectories.size());
+        for (Mile::NativeString const& Name : Directory.Subdirectories)
+        {
+            ::AppendString(Content, Name);
+        }
+
+        ::AppendVarUInt(Content, Directory.Items.size());
+        for (ScanCacheItem const& Item : Directory.Items)
+        {
+            ::AppendString(Content, Item.Name);
+            ::AppendVarUInt(Content, static_cast<std::uint64_t>(Item.Type));
+            ::AppendVarUInt(Content, Item.Size);
+            ::AppendVarUInt(Content, Item.AllocationSize);
+            ::AppendVarUInt(Content, Item.FileId);
+        }
+    }
+
+    std::uint8_t* Header = &Content[0];
+    ::StoreUInt64(Header, ScanCacheMagic);
+    ::StoreUInt32(Header + 8, ScanCacheVersion);
+    ::StoreUInt32(Header + 12, static_cast<std::uint32_t>(HeaderSize));
+    ::StoreUInt64(Header + 16, Content.size());
+    ::StoreUInt64(Header + 24, this->m_Key);
+    ::StoreUInt64(Header + 32, this->m_ScanTime);
+    ::StoreUInt64(Header + 40, this->m_Journals.size());
+    ::StoreUInt64(Header + 48, DirectoryCount);
+    ::StoreUInt64(Header + 56, 0);
+    ::StoreUInt64(
+        Header + HashOffset,
+        ::Hash(Content.data(), Content.size(), true));
+
+    Error.SystemError = ::WriteFileAtomically(Path, Content);
+    if (Error.SystemError)
+    {
+        Error.Message = "The file cannot be written";
+        return false;
+    }
+
+    return true;
+}
+
+NSudoSweeper::ScanCacheStatistics NSudoSweeper::ScanCache::GetStatistics()
+{
+    Mile::AutoLock<Mile::Mutex> Lock(this->m_Mutex);
+
+    ScanCacheStatistics Statistics;
+    Statistics.CachedDirectories = this->m_Previous.size();
+    Statistics.EnumeratedDirectories = this->m_EnumeratedDirectories;
+    Statistics.RefreshedDirectories = this->m_RefreshedDirectories;
+    Statistics.ReusedDirectories = this->m_ReusedDirectories;
+    return Statistics;
+}
@@ -0,0 +1,450 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperScanCache.h
+ * PURPOSE:   Definition for the incremental scan cache
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_SCAN_CACHE
+#define NSUDO_SWEEPER_SCAN_CACHE
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.FileEnumerator.h>
+#include <Mile.Portable.Synchronization.h>
+
+#include "NSudoSweeperChangeJournal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The value of a member of a fingerprint which is not known.
+     */
+    const std::uint64_t ScanCacheUnknown = UINT64_MAX;
+
+    /**
+     * The state of a directory which changes when its entries change.
+     */
+    struct DirectoryFingerprint
+    {
+        /**
+         * The later of the last write time and the change time of the
+         * directory, in 100-nanosecond intervals since January 1, 1601
+         * (UTC), or 0 if it is not known.
+         */
+        std::uint64_t ChangeTime = 0;
+
+        /**
+         * The file ID of the directory, or 0 if it is not known.
+         */
+        std::uint64_t FileId = 0;
+
+        /**
+         * The number of entries of the directory, or ScanCacheUnknown.
+         */
+        std::uint64_t EntryCount = ScanCacheUnknown;
+
+        /**
+         * The total size of the items of the directory, in bytes, or
+         * ScanCacheUnknown.
+         */
+        std::uint64_t AggregateSize = ScanCacheUnknown;
+    };
+
+    /**
+     * An item of a directory kept by the scan cache.
+     */
+    struct ScanCacheItem
+    {
+        /**
+         * The name of the item in its directory.
+         */
+        Mile::NativeString Name;
+
+        Mile::FileEntryType Type = Mile::FileEntryType::File;
+        std::uint64_t Size = 0;
+        std::uint64_t AllocationSize = 0;
+        std::uint64_t FileId = 0;
+    };
+
+    /**
+     * A directory kept by the scan cache.
+     */
+    struct ScanCacheDirectory
+    {
+        DirectoryFingerprint Fingerprint;
+
+        /**
+         * The names of the subdirectories the scan walked.
+         */
+        std::vector<Mile::NativeString> Subdirectories;
+
+        /**
+         * The items the scan reported.
+         */
+        std::vector<ScanCacheItem> Items;
+
+        /**
+         * Indicates the directory has been enumerated without errors. Only
+         * complete directories are saved.
+         */
+        bool Complete = false;
+    };
+
+    /**
+     * The position of a scan in the change journal of a volume.
+     */
+    struct ScanCacheJournal
+    {
+        /**
+         * The key of the volume returned by GetVolumeKey.
+         */
+        Mile::NativeString VolumeKey;
+
+        std::uint64_t JournalId = 0;
+
+        /**
+         * The sequence number of the first change after the position.
+         */
+        std::uint64_t NextUsn = 0;
+    };
+
+    /**
+     * The decision of the scan cache about a directory.
+     */
+    enum class ScanCacheDecision
+    {
+        /**
+         * Enumerate the directory.
+         */
+        Enumerate,
+
+        /**
+         * Use the cached entries of the directory, but query the sizes of
+         * its items again, because a change of a file does not change its
+         * directory. With a change journal, only the items IsItemChanged
+         * selects are queried.
+         */
+        Refresh,
+
+        /**
+         * Use the cached entries of the directory and the sizes of its
+         * items, because the change journal shows that none of them has
+         * changed.
+         */
+        Reuse,
+    };
+
+    /**
+     * The options of the scan cache.
+     */
+    struct ScanCacheOptions
+    {
+        /**
+         * The resolution of the directory timestamps of the file systems,
+         * in 100-nanosecond intervals. A directory whose change time is
+         * this close to the start of the previous scan may have changed
+         * again without a new time, so it is enumerated. The default is
+         * the 2 seconds of FAT.
+         */
+        std::uint64_t TimestampGranularity = 20000000;
+    };
+
+    /**
+     * The error of a scan cache operation.
+     */
+    struct ScanCacheError
+    {
+        /**
+         * The system error code if the file cannot be read or written,
+         * which is a Win32 error code on Windows and an errno value
+         * elsewhere.
+         */
+        int SystemError = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * The statistics of the scan cache.
+     */
+    struct ScanCacheStatistics
+    {
+        /**
+         * The number of directories loaded from the file.
+         */
+        std::size_t CachedDirectories;
+
+        std::size_t EnumeratedDirectories;
+        std::size_t RefreshedDirectories;
+        std::size_t ReusedDirectories;
+    };
+
+    /**
+     * Retrieves the fingerprint of a directory. Only the change time and
+     * the file ID are known, because the other members need the directory
+     * to be enumerated.
+     *
+     * @param Path The path of the directory.
+     * @param Fingerprint The fingerprint of the directory.
+     * @return 0 if successful, otherwise the Win32 error code on Windows and
+     *         the errno value elsewhere.
+     */
+    int QueryDirectoryFingerprint(
+        Mile::NativeString const& Path,
+        DirectoryFingerprint& Fingerprint);
+
+    /**
+     * Retrieves the current position of the USN change journal of a
+     * volume. It needs administrative privileges, and it is only supported
+     * on NTFS and ReFS volumes on Windows.
+     *
+     * @param Journal The position, whose VolumeKey member selects the
+     *                volume.
+     * @return 0 if successful, otherwise the Win32 error code on Windows and
+     *         ENOTSUP elsewhere.
+     */
+    int QueryChangeJournal(
+        ScanCacheJournal& Journal);
+
+    /**
+     * Reads the records of the USN change journal of a volume between two
+     * positions, of versions 2 to 4, and folds them into a change set.
+     *
+     * @param From The position of the previous scan.
+     * @param To The current position returned by QueryChangeJournal.
+     * @param Changes The change set the records are folded into.
+     * @return 0 if successful, otherwise the Win32 error code on Windows and
+     *         ENOTSUP elsewhere. ERROR_JOURNAL_ENTRY_DELETED means the
+     *         journal has dropped the changes since the previous scan.
+     */
+    int ReadChangeJournal(
+        ScanCacheJournal const& From,
+        ScanCacheJournal const& To,
+        ChangeJournalChangeSet& Changes);
+
+    /**
+     * Keeps the entries of the directories of the previous scan of a
+     * handler, so a new scan only enumerates the directories which have
+     * changed since then.
+     *
+     * A scan loads the cache, then asks Decide about each directory before
+     * it enumerates it. It adds every directory it walks with AddDirectory
+     * or ReuseDirectory, completes the enumerated ones with
+     * CompleteDirectory, and adds the items it reports with AddItem. The
+     * cache is saved only after the scan succeeds, and the directories
+     * which are not complete are left out, so the next scan enumerates
+     * them.
+     *
+     * Decide and IsItemChanged are thread-safe and take no locks. The
+     * other methods which add to the scan are thread-safe.
+     */
+    class ScanCache : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        ScanCacheOptions m_Options;
+        std::uint64_t m_Key = 0;
+
+        std::unordered_map<Mile::NativeString, ScanCacheDirectory> m_Previous;
+        std::vector<ScanCacheJournal> m_PreviousJournals;
+        std::uint64_t m_PreviousScanTime = 0;
+
+        bool m_HasChangedDirectories = false;
+        ChangeJournalChangeSet m_Changes;
+
+        Mile::Mutex m_Mutex;
+        std::unordered_map<Mile::NativeString, ScanCacheDirectory> m_Current;
+        std::vector<ScanCacheJournal> m_Journals;
+        std::uint64_t m_ScanTime = 0;
+        std::size_t m_EnumeratedDirectories = 0;
+        std::size_t m_RefreshedDirectories = 0;
+        std::size_t m_ReusedDirectories = 0;
+
+        bool IsInMovedDirectory(
+            Mile::NativeStringView Path) const;
+
+    public:
+
+        /**
+         * Creates an empty cache.
+         *
+         * @param Options The options of the cache.
+         */
+        explicit ScanCache(
+            ScanCacheOptions const& Options = ScanCacheOptions());
+
+        /**
+         * Sets the identity of the scans the cache belongs to, such as the
+         * configuration of the handler and the root of the image. A cache
+         * file of another identity is not loaded.
+         *
+         * @param Identity The identity.
+         */
+        void SetIdentity(
+            Mile::NativeStringView Identity);
+
+        /**
+         * Loads the directories of the previous scan.
+         *
+         * @param Path The path of the cache file.
+         * @param Error The error if it fails.
+         * @return true if successful, otherwise false, and the cache stays
+         *         empty.
+         */
+        bool Load(
+            Mile::NativeString const& Path,
+            ScanCacheError& Error);
+
+        /**
+         * Starts a new scan. It must be called before the scan queries the
+         * fingerprints of the directories.
+         */
+        void BeginScan();
+
+        /**
+         * Retrieves the positions of the change journals of the previous
+         * scan.
+         *
+         * @return The positions.
+         */
+        std::vector<ScanCacheJournal> const& GetPreviousJournals() const
+        {
+            return this->m_PreviousJournals;
+        }
+
+        /**
+         * Adds the position of a change journal at the start of the scan.
+         *
+         * @param Journal The position.
+         */
+        void AddJournal(
+            ScanCacheJournal const& Journal);
+
+        /**
+         * Sets the changes since the previous scan, which must be read from
+         * the change journals of all volumes the scan walks. Then Decide
+         * needs no fingerprints, and only enumerates the directories whose
+         * entries have changed and the directories below a moved one.
+         *
+         * @param Changes The complete changes of all volumes.
+         */
+        void SetChangedDirectories(
+            ChangeJournalChangeSet Changes);
+
+        /**
+         * Checks whether the scan needs the fingerprints of the directories.
+         *
+         * @return false if the changed directories are set, otherwise true.
+         */
+        bool NeedsFingerprints() const noexcept
+        {
+            return !this->m_HasChangedDirectories;
+        }
+
+        /**
+         * Decides whether a directory must be enumerated.
+         *
+         * @param Path The path of the directory.
+         * @param Fingerprint The current fingerprint of the directory. It is
+         *                    ignored if the changed directories are set.
+         * @param Previous The cached directory if the result is not
+         *                 Enumerate. It is valid until the next call of
+         *                 Load.
+         * @return The decision.
+         */
+        ScanCacheDecision Decide(
+            Mile::NativeStringView Path,
+            DirectoryFingerprint const& Fingerprint,
+            ScanCacheDirectory const*& Previous) const;
+
+        /**
+         * Checks whether the size of a cached item must be queried again.
+         *
+         * @param Decision The decision about the directory of the item.
+         * @param FileId The file ID of the item.
+         * @return true if the item must be queried, otherwise false.
+         */
+        bool IsItemChanged(
+            ScanCacheDecision Decision,
+            std::uint64_t FileId) const;
+
+        /**
+         * Adds a directory which the scan enumerates.
+         *
+         * @param Path The path of the directory.
+         * @param Fingerprint The fingerprint of the directory, queried
+         *                    before the enumeration.
+         */
+        void AddDirectory(
+            Mile::NativeStringView Path,
+            DirectoryFingerprint const& Fingerprint);
+
+        /**
+         * Completes a directory after it has been enumerated without
+         * errors.
+         *
+         * @param Path The path of the directory.
+         * @param EntryCount The number of entries of the directory.
+         * @param Subdirectories The full paths of the subdirectories the
+         *                       scan walks.
+         */
+        void CompleteDirectory(
+            Mile::NativeStringView Path,
+            std::uint64_t EntryCount,
+            std::vector<Mile::NativeStringView> const& Subdirectories);
+
+        /**
+         * Adds a directory whose cached entries the scan uses. Its items are
+         * added with AddItem as they are reported again.
+         *
+         * @param Path The path of the directory.
+         * @param Decision The decision returned by Decide.
+         * @param Previous The cached directory returned by Decide.
+         */
+        void ReuseDirectory(
+            Mile::NativeStringView Path,
+            ScanCacheDecision Decision,
+            ScanCacheDirectory const& Previous);
+
+        /**
+         * Adds an item the scan reports.
+         *
+         * @param Path The full path of the item.
+         * @param Item The item. Its name is ignored.
+         */
+        void AddItem(
+            Mile::NativeStringView Path,
+            ScanCacheItem const& Item);
+
+        /**
+         * Saves the directories of the scan.
+         *
+         * @param Path The path of the cache file.
+         * @param Error The error if it fails.
+         * @return true if successful, otherwise false.
+         */
+        bool Save(
+            Mile::NativeString const& Path,
+            ScanCacheError& Error);
+
+        /**
+         * Retrieves the statistics of the cache.
+         *
+         * @return The statistics of the cache.
+         */
+        ScanCacheStatistics GetStatistics();
+    };
+}
+
+#endif // !NSUDO_SWEEPER_SCAN_CACHE
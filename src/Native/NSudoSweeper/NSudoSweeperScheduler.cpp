@@ -0,0 +1,517 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperScheduler.cpp
+ * PURPOSE:   Implementation for the concurrent cleanup handler scheduler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperScheduler.h"
+
+#include "NSudoSweeperHandlerDescriptor.h"
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperVolume.h"
+#include "NSudoSweeperWalkPlanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#if defined(_WIN32)
+#include <Mile.Windows.h>
+#endif
+
+struct NSudoSweeper::HandlerScheduler::Volume
+{
+    Mile::NativeString Key;
+    std::size_t ActiveJobs = 0;
+    std::size_t MaximumJobs = 1;
+};
+
+struct NSudoSweeper::HandlerScheduler::Job
+{
+    HandlerScheduler* Scheduler = nullptr;
+    std::size_t Index = 0;
+    SchedulerJob Definition;
+    std::uint64_t Weight = 1;
+    std::vector<Volume*> Volumes;
+
+    /**
+     * The progress of the handler, from 0 to 100. It never decreases.
+     */
+    std::atomic<std::uint32_t> Progress{ 0 };
+
+    bool HasDeadline = false;
+    std::chrono::steady_clock::time_point Deadline;
+    std::atomic<bool> TimedOut{ false };
+
+    /**
+     * Protected by the mutex of the scheduler.
+     */
+    SchedulerJobResult Result;
+};
+
+namespace
+{
+    /**
+     * Finds the directories a handler walks from the File Include rules of
+     * its configuration file.
+     */
+    std::vector<Mile::NativeString> GetIncludeRoots(
+        Mile::NativeString const& Configuration)
+    {
+        std::vector<Mile::NativeString> Roots;
+
+        NSudoSweeper::HandlerDescriptor Descriptor;
+        NSudoSweeper::HandlerDescriptorError Error;
+        if (!NSudoSweeper::ParseHandlerDescriptor(
+            NSudoSweeper::ToUtf8String(Configuration),
+            Descriptor,
+            Error))
+        {
+            return Roots;
+        }
+
+        NSudoSweeper::WalkPlanner Planner;
+        for (NSudoSweeper::HandlerRule const& Rule : Descriptor.Include)
+        {
+            if (Rule.Type == NSudoSweeper::HandlerRuleType::File)
+            {
+                Planner.AddInclude(0, Rule.Pattern);
+            }
+        }
+
+        for (NSudoSweeper::TreeWalkerRoot const& Root :
+            Planner.Plan().GetTreeWalkerRoots())
+        {
+            Roots.push_back(Root.Path);
+        }
+
+        return Roots;
+    }
+}
+
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeper::HandlerScheduler::Callback(
+    std::uint32_t Message,
+    void* Parameter,
+    void* UserData)
+{
+    Job& Target = *reinterpret_cast<Job*>(UserData);
+    HandlerScheduler& Scheduler = *Target.Scheduler;
+
+    if (Scheduler.m_Canceled.load())
+    {
+        return NSUDO_SWEEPER_E_ABORT;
+    }
+
+    if (Target.HasDeadline &&
+        std::chrono::steady_clock::now() >= Target.Deadline)
+    {
+        Target.TimedOut.store(true);
+        return NSUDO_SWEEPER_E_TIMEOUT;
+    }
+
+    if (Message == NSUDO_SWEEPER_PROGRESS_MESSAGE)
+    {
+        if (Parameter)
+        {
+            std::uint32_t Progress = (std::min)(
+                *reinterpret_cast<std::uint32_t*>(Parameter),
+                static_cast<std::uint32_t>(100));
+            std::uint32_t Current = Target.Progress.load();
+            while (Current < Progress &&
+                !Target.Progress.compare_exchange_weak(Current, Progress))
+            {
+            }
+            Scheduler.ReportProgress();
+        }
+        return NSUDO_SWEEPER_S_OK;
+    }
+
+    if (!Scheduler.m_MessageHandler)
+    {
+        return NSUDO_SWEEPER_S_OK;
+    }
+
+    // No exception may cross the interface.
+    try
+    {
+        return Scheduler.m_MessageHandler(Target.Index, Message, Parameter);
+    }
+    catch (...)
+    {
+        return NSUDO_SWEEPER_E_FAIL;
+    }
+}
+
+void NSudoSweeper::HandlerScheduler::ResolveVolumes(
+    Job& Target)
+{
+    std::vector<Mile::NativeString> Paths = Target.Definition.Volumes;
+    if (Paths.empty())
+    {
+        if (!this->m_Options.SessionRootPath.empty())
+        {
+            // All paths of an offline image are below its root.
+            Paths.push_back(this->m_Options.SessionRootPath);
+        }
+        else
+        {
+            Paths = ::GetIncludeRoots(Target.Definition.Configuration);
+        }
+    }
+
+    for (Mile::NativeString const& Path : Paths)
+    {
+        Mile::NativeString Key = NSudoSweeper::GetVolumeKey(Path);
+
+        Volume* Current = nullptr;
+        for (std::unique_ptr<Volume> const& Candidate : this->m_Volumes)
+        {
+            if (NSudoSweeper::IsSameVolumeKey(Candidate->Key, Key))
+            {
+                Current = Candidate.get();
+                break;
+            }
+        }
+
+        if (!Current)
+        {
+            std::unique_ptr<Volume> NewVolume(new Volume());
+            NewVolume->MaximumJobs = NSudoSweeper::IsRotationalVolume(Key)
+                ? this->m_Options.RotationalVolumeConcurrency
+                : this->m_Options.SolidStateVolumeConcurrency;
+            if (!NewVolume->MaximumJobs)
+            {
+                NewVolume->MaximumJobs = 1;
+            }
+            NewVolume->Key = std::move(Key);
+            Current = NewVolume.get();
+            this->m_Volumes.push_back(std::move(NewVolume));
+        }
+
+        if (Target.Volumes.end() == std::find(
+            Target.Volumes.begin(),
+            Target.Volumes.end(),
+            Current))
+        {
+            Target.Volumes.push_back(Current);
+        }
+    }
+}
+
+bool NSudoSweeper::HandlerScheduler::CanStart(
+    Job const& Target) const
+{
+    if (this->m_RunningJobs >= this->m_Options.MaximumConcurrency)
+    {
+        return false;
+    }
+
+    for (Volume const* Current : Target.Volumes)
+    {
+        if (Current->ActiveJobs >= Current->MaximumJobs)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void NSudoSweeper::HandlerScheduler::Dispatch()
+{
+    // A job which waits for a busy volume does not hold back the jobs on
+    // other volumes.
+    auto Iterator = this->m_PendingJobs.begin();
+    while (Iterator != this->m_PendingJobs.end())
+    {
+        Job& Target = *this->m_Jobs[*Iterator];
+
+        if (this->m_Canceled.load())
+        {
+            Target.Result.State = SchedulerJobState::Skipped;
+            Target.Result.Result = NSUDO_SWEEPER_E_ABORT;
+            Target.Progress.store(100);
+            Iterator = this->m_PendingJobs.erase(Iterator);
+            continue;
+        }
+
+        if (!this->CanStart(Target))
+        {
+            ++Iterator;
+            continue;
+        }
+
+        Target.Result.State = SchedulerJobState::Running;
+        ++this->m_RunningJobs;
+        for (Volume* Current : Target.Volumes)
+        {
+            ++Current->ActiveJobs;
+        }
+        Iterator = this->m_PendingJobs.erase(Iterator);
+
+        Job* RunningJob = &Target;
+        this->m_Pool.Submit(this->m_Group, [this, RunningJob]()
+        {
+            this->Run(*RunningJob);
+        });
+    }
+}
+
+void NSudoSweeper::HandlerScheduler::Run(
+    Job& Target)
+{
+    std::chrono::steady_clock::time_point StartTime =
+        std::chrono::steady_clock::now();
+    if (Target.Definition.Timeout.count() > 0)
+    {
+        Target.HasDeadline = true;
+        Target.Deadline = StartTime + Target.Definition.Timeout;
+    }
+
+    NSUDO_SWEEPER_HANDLER_SUMMARY Summary = {};
+    Summary.Size = sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY);
+
+    NSUDO_SWEEPER_RESULT Result = NSUDO_SWEEPER_E_ABORT;
+    if (!this->m_Canceled.load())
+    {
+        std::vector<NSUDO_SWEEPER_ITEM> CleanItems;
+        if (Target.Definition.CleanItems)
+        {
+            CleanItems.reserve(Target.Definition.CleanItems->size());
+            for (HandlerHostItem const& Item : *Target.Definition.CleanItems)
+            {
+                NSUDO_SWEEPER_ITEM Current;
+                Current.Path = Item.Path.c_str();
+                Current.PathLength = static_cast<std::uint32_t>(
+                    Item.Path.size());
+                Current.Reason = Item.Reason;
+                Current.Size = Item.Size;
+                Current.AllocationSize = Item.AllocationSize;
+                Current.FileId = Item.FileId;
+                CleanItems.push_back(Current);
+            }
+        }
+
+        NSUDO_SWEEPER_HANDLER_REQUEST Request = {};
+        Request.Size = sizeof(NSUDO_SWEEPER_HANDLER_REQUEST);
+        Request.Phase = Target.Definition.Phase;
+        Request.Configuration = Target.Definition.Configuration.c_str();
+        Request.SessionRootPath = this->m_Options.SessionRootPath.empty()
+            ? nullptr
+            : this->m_Options.SessionRootPath.c_str();
+        Request.Callback = HandlerScheduler::Callback;
+        Request.UserData = &Target;
+        if (Target.Definition.CleanItems)
+        {
+            // The flag selects the items even if there are none.
+            Request.Flags |= NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+            Request.CleanItems = CleanItems.empty()
+                ? nullptr
+                : CleanItems.data();
+            Request.CleanItemCount = CleanItems.size();
+        }
+        Request.MaximumBatchSize = this->m_Options.MaximumBatchSize;
+        Request.ScanCachePath = Target.Definition.ScanCachePath.empty()
+            ? nullptr
+            : Target.Definition.ScanCachePath.c_str();
+
+        Result = Target.Definition.Handler(&Request, &Summary);
+    }
+
+    Target.Progress.store(100);
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+        Target.Result.State = Target.TimedOut.load()
+            ? SchedulerJobState::TimedOut
+            : SchedulerJobState::Completed;
+        Target.Result.Result = Result;
+        Target.Result.Summary = Summary;
+        Target.Result.Duration =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - StartTime);
+
+        --this->m_RunningJobs;
+        for (Volume* Current : Target.Volumes)
+        {
+            --Current->ActiveJobs;
+        }
+
+        this->Dispatch();
+    }
+
+    this->ReportProgress();
+}
+
+void NSudoSweeper::HandlerScheduler::ReportProgress()
+{
+    std::lock_guard<std::mutex> Lock(this->m_ProgressMutex);
+
+    std::uint32_t Progress = this->GetProgress();
+    if (Progress <= this->m_ReportedProgress)
+    {
+        return;
+    }
+
+    this->m_ReportedProgress = Progress;
+    if (this->m_ProgressHandler)
+    {
+        this->m_ProgressHandler(Progress);
+    }
+}
+
+NSudoSweeper::HandlerScheduler::HandlerScheduler(
+    Mile::ThreadPool& Pool,
+    SchedulerOptions const& Options) :
+    m_Pool(Pool),
+    m_Options(Options)
+{
+    if (!this->m_Options.MaximumConcurrency)
+    {
+        this->m_Options.MaximumConcurrency = Pool.GetNumberOfThreads();
+    }
+    if (!this->m_Options.MaximumConcurrency)
+    {
+        this->m_Options.MaximumConcurrency = 1;
+    }
+}
+
+NSudoSweeper::HandlerScheduler::~HandlerScheduler()
+{
+    this->Cancel();
+    this->Wait();
+}
+
+std::size_t NSudoSweeper::HandlerScheduler::AddJob(
+    SchedulerJob const& NewJob)
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    if (this->m_Started)
+    {
+        return SIZE_MAX;
+    }
+
+    std::unique_ptr<Job> Target(new Job());
+    Target->Scheduler = this;
+    Target->Index = this->m_Jobs.size();
+    Target->Definition = NewJob;
+    Target->Weight = NewJob.Weight ? NewJob.Weight : 1;
+    this->m_Jobs.push_back(std::move(Target));
+    return this->m_Jobs.size() - 1;
+}
+
+void NSudoSweeper::HandlerScheduler::SetMessageHandler(
+    SchedulerMessageHandler Handler)
+{
+    this->m_MessageHandler = std::move(Handler);
+}
+
+void NSudoSweeper::HandlerScheduler::SetProgressHandler(
+    SchedulerProgressHandler Handler)
+{
+    this->m_ProgressHandler = std::move(Handler);
+}
+
+bool NSudoSweeper::HandlerScheduler::Start()
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+        if (this->m_Started)
+        {
+            return false;
+        }
+        this->m_Started = true;
+    }
+
+    // The jobs cannot change after they are started, so they are prepared
+    // without the lock.
+    for (std::unique_ptr<Job> const& Target : this->m_Jobs)
+    {
+        this->ResolveVolumes(*Target);
+        this->m_TotalWeight += Target->Weight;
+    }
+
+    if (!this->m_Options.SessionRootPath.empty())
+    {
+        this->m_Registry = NSudoSweeper::OfflineRegistry::Acquire(
+            this->m_Options.SessionRootPath);
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(this->m_Mutex);
+
+        for (std::size_t i = 0; i < this->m_Jobs.size(); ++i)
+        {
+            this->m_PendingJobs.push_back(i);
+        }
+
+        // Start the heavier jobs first, so a long job does not start last
+        // and run alone at the end.
+        std::stable_sort(
+            this->m_PendingJobs.begin(),
+            this->m_PendingJobs.end(),
+            [this](std::size_t Left, std::size_t Right)
+        {
+            return this->m_Jobs[Left]->Weight > this->m_Jobs[Right]->Weight;
+        });
+
+        this->Dispatch();
+    }
+
+    this->ReportProgress();
+    return true;
+}
+
+void NSudoSweeper::HandlerScheduler::Cancel()
+{
+    this->m_Canceled.store(true);
+
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    this->Dispatch();
+}
+
+void NSudoSweeper::HandlerScheduler::Wait()
+{
+    // Each job dispatches the next ones before it completes, so the group
+    // is only empty when all jobs have completed.
+    this->m_Pool.Wait(this->m_Group);
+}
+
+std::uint32_t NSudoSweeper::HandlerScheduler::GetProgress() const
+{
+    if (!this->m_TotalWeight)
+    {
+        return this->m_Jobs.empty() ? 100 : 0;
+    }
+
+    double Work = 0.0;
+    for (std::unique_ptr<Job> const& Target : this->m_Jobs)
+    {
+        Work += static_cast<double>(Target->Weight) * Target->Progress.load();
+    }
+
+    return static_cast<std::uint32_t>(
+        Work / static_cast<double>(this->m_TotalWeight));
+}
+
+NSudoSweeper::SchedulerJobResult NSudoSweeper::HandlerScheduler::GetResult(
+    std::size_t Index) const
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    if (Index >= this->m_Jobs.size())
+    {
+        return SchedulerJobResult();
+    }
+    return this->m_Jobs[Index]->Result;
+}
+
+std::size_t NSudoSweeper::HandlerScheduler::GetJobCount() const
+{
+    std::lock_guard<std::mutex> Lock(this->m_Mutex);
+    return this->m_Jobs.size();
+}
@@ -0,0 +1,327 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperScheduler.h
+ * PURPOSE:   Definition for the concurrent cleanup handler scheduler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_SCHEDULER
+#define NSUDO_SWEEPER_SCHEDULER
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.ThreadPool.h>
+
+#include "NSudoSweeperHandlerHost.h"
+#include "NSudoSweeperHandlerV2.h"
+#include "NSudoSweeperRegistryHive.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * A handler invocation run by the scheduler.
+     */
+    struct SchedulerJob
+    {
+        /**
+         * The handler.
+         */
+        NSudoSweeperCleanupHandlerV2 Handler = nullptr;
+
+        /**
+         * The configuration file of the handler.
+         */
+        Mile::NativeString Configuration;
+
+        /**
+         * NSUDO_SWEEPER_PHASE_SCAN, NSUDO_SWEEPER_PHASE_CLEAN or
+         * NSUDO_SWEEPER_PHASE_ESTIMATE.
+         */
+        std::uint32_t Phase = NSUDO_SWEEPER_PHASE_SCAN;
+
+        /**
+         * The items a clean removes, or nullptr to remove all items a scan
+         * would report. The vector must outlive the run.
+         */
+        std::vector<HandlerHostItem> const* CleanItems = nullptr;
+
+        /**
+         * The expected amount of work of the handler, such as the number of
+         * items of its last scan, which weights its share of the combined
+         * progress. The heavier jobs start first. 0 is the same as 1.
+         */
+        std::uint64_t Weight = 0;
+
+        /**
+         * The time limit of the handler, or 0 for no limit. The callback
+         * returns NSUDO_SWEEPER_E_TIMEOUT when it is exceeded, so the limit
+         * is enforced within the callback interval of the handler.
+         */
+        std::chrono::milliseconds Timeout{ 0 };
+
+        /**
+         * The scan cache file of the handler, or an empty string to
+         * enumerate all directories. It is only used by a scan.
+         */
+        Mile::NativeString ScanCachePath;
+
+        /**
+         * The paths of the volumes the handler uses. If it is empty, they
+         * are found from the File Include rules of the configuration file.
+         */
+        std::vector<Mile::NativeString> Volumes;
+    };
+
+    /**
+     * The options of the scheduler.
+     */
+    struct SchedulerOptions
+    {
+        /**
+         * The maximum number of handlers which run concurrently. If it is
+         * 0, the number of threads of the thread pool is used.
+         */
+        std::size_t MaximumConcurrency = 0;
+
+        /**
+         * The maximum number of handlers which use a volume on a solid state
+         * disk concurrently.
+         */
+        std::size_t SolidStateVolumeConcurrency = 4;
+
+        /**
+         * The maximum number of handlers which use a volume on a rotational
+         * disk concurrently. Concurrent handlers make a rotational disk seek
+         * between them, which is slower than running them in turn.
+         */
+        std::size_t RotationalVolumeConcurrency = 1;
+
+        /**
+         * The root directory of the offline image the handlers operate, or
+         * an empty string for the online image.
+         */
+        Mile::NativeString SessionRootPath;
+
+        /**
+         * The maximum number of items or results in a batch, or 0 to let
+         * the handlers choose.
+         */
+        std::uint32_t MaximumBatchSize = 0;
+    };
+
+    /**
+     * The state of a job.
+     */
+    enum class SchedulerJobState : std::uint8_t
+    {
+        Pending,
+        Running,
+        Completed,
+        TimedOut,
+
+        /**
+         * The job is canceled before it starts.
+         */
+        Skipped,
+    };
+
+    /**
+     * The result of a job.
+     */
+    struct SchedulerJobResult
+    {
+        SchedulerJobState State = SchedulerJobState::Pending;
+
+        /**
+         * The result of the handler.
+         */
+        NSUDO_SWEEPER_RESULT Result = NSUDO_SWEEPER_S_OK;
+
+        /**
+         * The totals of the handler.
+         */
+        NSUDO_SWEEPER_HANDLER_SUMMARY Summary = {};
+
+        /**
+         * The time the handler has run.
+         */
+        std::chrono::milliseconds Duration{ 0 };
+    };
+
+    /**
+     * Receives the messages of the handlers other than the progress, such
+     * as NSUDO_SWEEPER_ITEM_BATCH_MESSAGE. It is called concurrently for
+     * different jobs, but never for one job. A result other than
+     * NSUDO_SWEEPER_S_OK cancels the job.
+     */
+    typedef std::function<NSUDO_SWEEPER_RESULT(
+        std::size_t Job,
+        std::uint32_t Message,
+        void* Parameter)> SchedulerMessageHandler;
+
+    /**
+     * Receives the combined progress of all jobs, from 0 to 100. It is only
+     * called when the value increases, and never concurrently.
+     */
+    typedef std::function<void(
+        std::uint32_t Progress)> SchedulerProgressHandler;
+
+    /**
+     * Runs cleanup handlers concurrently on a thread pool. A job starts
+     * when the number of running jobs and the number of running jobs on each
+     * of its volumes are below their limits, so the handlers on a solid
+     * state disk run in parallel while the handlers on a rotational disk
+     * run in turn.
+     */
+    class HandlerScheduler : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Job;
+        struct Volume;
+
+        Mile::ThreadPool& m_Pool;
+        SchedulerOptions m_Options;
+        SchedulerMessageHandler m_MessageHandler;
+        SchedulerProgressHandler m_ProgressHandler;
+
+        std::vector<std::unique_ptr<Job>> m_Jobs;
+        std::vector<std::unique_ptr<Volume>> m_Volumes;
+        std::uint64_t m_TotalWeight = 0;
+
+        /**
+         * The hives of an offline image, which are kept open for the whole
+         * scan so the handlers share them and their cached queries.
+         */
+        std::shared_ptr<OfflineRegistry> m_Registry;
+
+        mutable std::mutex m_Mutex;
+        std::vector<std::size_t> m_PendingJobs;
+        std::size_t m_RunningJobs = 0;
+        bool m_Started = false;
+        std::atomic<bool> m_Canceled{ false };
+        Mile::TaskGroup m_Group;
+
+        std::mutex m_ProgressMutex;
+        std::uint32_t m_ReportedProgress = 0;
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API Callback(
+            std::uint32_t Message,
+            void* Parameter,
+            void* UserData);
+
+        void ResolveVolumes(
+            Job& Target);
+
+        bool CanStart(
+            Job const& Target) const;
+
+        void Dispatch();
+
+        void Run(
+            Job& Target);
+
+        void ReportProgress();
+
+    public:
+
+        /**
+         * Creates the scheduler.
+         *
+         * @param Pool The thread pool which runs the handlers.
+         * @param Options The options of the scheduler.
+         */
+        explicit HandlerScheduler(
+            Mile::ThreadPool& Pool = Mile::ThreadPool::GetDefault(),
+            SchedulerOptions const& Options = SchedulerOptions());
+
+        /**
+         * Cancels the jobs and waits for them.
+         */
+        ~HandlerScheduler();
+
+        /**
+         * Adds a job. Jobs can only be added before Start.
+         *
+         * @param NewJob The job.
+         * @return The index of the job, or SIZE_MAX if the jobs have been
+         *         started.
+         */
+        std::size_t AddJob(
+            SchedulerJob const& NewJob);
+
+        /**
+         * Sets the handler which receives the messages of the jobs. It must
+         * be set before Start.
+         *
+         * @param Handler The handler.
+         */
+        void SetMessageHandler(
+            SchedulerMessageHandler Handler);
+
+        /**
+         * Sets the handler which receives the combined progress. It must be
+         * set before Start.
+         *
+         * @param Handler The handler.
+         */
+        void SetProgressHandler(
+            SchedulerProgressHandler Handler);
+
+        /**
+         * Starts the jobs.
+         *
+         * @return true if the jobs are started, or false if they have
+         *         already been started.
+         */
+        bool Start();
+
+        /**
+         * Cancels the jobs. The pending jobs are skipped, and the callbacks
+         * of the running jobs return NSUDO_SWEEPER_E_ABORT. It can be
+         * called from any thread.
+         */
+        void Cancel();
+
+        /**
+         * Waits for all jobs.
+         */
+        void Wait();
+
+        /**
+         * Retrieves the combined progress of all jobs.
+         *
+         * @return The progress, from 0 to 100.
+         */
+        std::uint32_t GetProgress() const;
+
+        /**
+         * Retrieves the result of a job.
+         *
+         * @param Index The index of the job.
+         * @return The result of the job.
+         */
+        SchedulerJobResult GetResult(
+            std::size_t Index) const;
+
+        /**
+         * Retrieves the number of jobs.
+         *
+         * @return The number of jobs.
+         */
+        std::size_t GetJobCount() const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_SCHEDULER
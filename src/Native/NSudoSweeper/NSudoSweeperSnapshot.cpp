@@ -0,0 +1,744 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperSnapshot.cpp
+ * PURPOSE:   Implementation for the scan result snapshot
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperSnapshot.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+#if defined(_WIN32)
+#include <Mile.Windows.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /**
+     * "NSSWSNAP" as a little-endian integer.
+     */
+    const std::uint64_t SnapshotMagic = 0x50414E535753534EULL;
+
+    const std::uint32_t SnapshotVersion = 1;
+
+    const std::uint32_t SnapshotHasSessionRootPath = 0x00000001;
+
+    /**
+     * The layout of the header. The members are stored at the offsets in
+     * this order without padding.
+     *
+     *   0    Magic                  uint64
+     *   8    Version                uint32
+     *   12   HeaderSize             uint32
+     *   16   FileSize               uint64
+     *   24   CreationTime           uint64
+     *   32   Flags                  uint32
+     *   36   HandlerCount           uint32
+     *   40   ItemCount              uint64
+     *   48   SessionRootPathOffset  uint64
+     *   56   SessionRootPathSize    uint64
+     *   64   HandlersOffset         uint64
+     *   72   ItemsOffset            uint64
+     *   80   PathsOffset            uint64
+     *   88   PathsSize              uint64
+     *   96   Reserved               uint64
+     *   104  Hash                   uint64
+     */
+    const std::size_t HeaderSize = 112;
+    const std::size_t HashOffset = 104;
+
+    const std::size_t HandlerRecordSize = 32;
+    const std::size_t ItemRecordSize = 40;
+
+    void StoreUInt32(
+        std::uint8_t* Target,
+        std::uint32_t Value) noexcept
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Target[i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    void StoreUInt64(
+        std::uint8_t* Target,
+        std::uint64_t Value) noexcept
+    {
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Target[i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    std::uint32_t LoadUInt32(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source) noexcept
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    void AppendVarUInt(
+        std::vector<std::uint8_t>& Target,
+        std::uint64_t Value)
+    {
+        while (Value >= 0x80)
+        {
+            Target.push_back(static_cast<std::uint8_t>(Value | 0x80));
+            Value >>= 7;
+        }
+        Target.push_back(static_cast<std::uint8_t>(Value));
+    }
+
+    bool ReadVarUInt(
+        std::uint8_t const* Data,
+        std::size_t Size,
+        std::size_t& Offset,
+        std::uint64_t& Value) noexcept
+    {
+        Value = 0;
+        for (std::uint32_t Shift = 0; Shift < 64; Shift += 7)
+        {
+            if (Offset >= Size)
+            {
+                return false;
+            }
+
+            std::uint8_t Byte = Data[Offset++];
+            Value |= static_cast<std::uint64_t>(Byte & 0x7F) << Shift;
+            if (!(Byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Computes the 64-bit FNV-1a hash of the file without the hash member.
+     */
+    std::uint64_t HashSnapshot(
+        std::uint8_t const* Data,
+        std::size_t Size) noexcept
+    {
+        std::uint64_t Hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            if (i == HashOffset)
+            {
+                i += 7;
+                continue;
+            }
+            Hash ^= Data[i];
+            Hash *= 1099511628211ULL;
+        }
+        return Hash;
+    }
+
+    /**
+     * Checks whether a range of Count records of RecordSize bytes at Offset
+     * is in a file of Size bytes.
+     */
+    bool IsRangeValid(
+        std::uint64_t Offset,
+        std::uint64_t Count,
+        std::size_t RecordSize,
+        std::size_t Size) noexcept
+    {
+        return Offset <= Size && Count <= (Size - Offset) / RecordSize;
+    }
+
+    Mile::NativeString ToNativeString(
+        std::string const& String)
+    {
+#if defined(_WIN32)
+        return Mile::ToUtf16String(String);
+#else
+        return String;
+#endif
+    }
+
+    /**
+     * Writes a file under a temporary name and renames it.
+     *
+     * @return 0 if successful, otherwise the system error code.
+     */
+    int WriteFileAtomically(
+        Mile::NativeString const& Path,
+        std::vector<std::uint8_t> const& Content)
+    {
+        Mile::NativeString TemporaryPath = Path;
+#if defined(_WIN32)
+        TemporaryPath.append(L".tmp");
+
+        HANDLE FileHandle = ::CreateFileW(
+            TemporaryPath.c_str(),
+            GENERIC_WRITE,
+            0,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+        if (FileHandle == INVALID_HANDLE_VALUE)
+        {
+            return static_cast<int>(::GetLastError());
+        }
+
+        int Error = 0;
+        std::size_t Offset = 0;
+        while (!Error && Offset < Content.size())
+        {
+            DWORD Size = static_cast<DWORD>((std::min)(
+                Content.size() - Offset,
+                static_cast<std::size_t>(1) << 30));
+            DWORD Written = 0;
+            if (!::WriteFile(
+                FileHandle,
+                &Content[Offset],
+                Size,
+                &Written,
+                nullptr))
+            {
+                Error = static_cast<int>(::GetLastError());
+            }
+            Offset += Written;
+        }
+        if (!Error && !::FlushFileBuffers(FileHandle))
+        {
+            Error = static_cast<int>(::GetLastError());
+        }
+        ::CloseHandle(FileHandle);
+
+        if (!Error && !::MoveFileExW(
+            TemporaryPath.c_str(),
+            Path.c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            Error = static_cast<int>(::GetLastError());
+        }
+        if (Error)
+        {
+            ::DeleteFileW(TemporaryPath.c_str());
+        }
+        return Error;
+#else
+        TemporaryPath.append(".tmp");
+
+        int FileDescriptor = ::open(
+            TemporaryPath.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+        if (FileDescriptor == -1)
+        {
+            return errno;
+        }
+
+        int Error = 0;
+        std::size_t Offset = 0;
+        while (!Error && Offset < Content.size())
+        {
+            ssize_t Written = ::write(
+                FileDescriptor,
+                &Content[Offset],
+                Content.size() - Offset);
+            if (Written == -1)
+            {
+                if (errno != EINTR)
+                {
+                    Error = errno;
+                }
+                continue;
+            }
+            Offset += static_cast<std::size_t>(Written);
+        }
+        if (!Error && -1 == ::fsync(FileDescriptor))
+        {
+            Error = errno;
+        }
+        if (-1 == ::close(FileDescriptor) && !Error)
+        {
+            Error = errno;
+        }
+
+        if (!Error && -1 == ::rename(TemporaryPath.c_str(), Path.c_str()))
+        {
+            Error = errno;
+        }
+        if (Error)
+        {
+            ::unlink(TemporaryPath.c_str());
+        }
+        return Error;
+#endif
+    }
+}
+
+void NSudoSweeper::SnapshotWriter::SetSessionRootPath(
+    Mile::NativeString const* SessionRootPath)
+{
+    this->m_HasSessionRootPath = SessionRootPath != nullptr;
+    this->m_SessionRootPath = SessionRootPath
+        ? NSudoSweeper::ToUtf8String(*SessionRootPath)
+        : std::string();
+}
+
+std::uint32_t NSudoSweeper::SnapshotWriter::AddHandler(
+    Mile::NativeStringView Configuration)
+{
+    this->m_Configurations.push_back(NSudoSweeper::ToUtf8String(Configuration));
+    return static_cast<std::uint32_t>(this->m_Configurations.size() - 1);
+}
+
+void NSudoSweeper::SnapshotWriter::AddItems(
+    std::uint32_t Handler,
+    std::vector<HandlerHostItem> const& Items)
+{
+    this->m_Items.reserve(this->m_Items.size() + Items.size());
+    for (HandlerHostItem const& Source : Items)
+    {
+        Item Target;
+        Target.Path = NSudoSweeper::ToUtf8String(Source.Path);
+        Target.Size = Source.Size;
+        Target.AllocationSize = Source.AllocationSize;
+        Target.FileId = Source.FileId;
+        Target.Reason = Source.Reason;
+        Target.Handler = Handler;
+        this->m_Items.push_back(std::move(Target));
+    }
+}
+
+bool NSudoSweeper::SnapshotWriter::Save(
+    Mile::NativeString const& Path,
+    SnapshotError& Error) const
+{
+    Error = SnapshotError();
+
+    for (Item const& Current : this->m_Items)
+    {
+        if (Current.Handler >= this->m_Configurations.size())
+        {
+            Error.Message = "An item belongs to an unknown handler";
+            return false;
+        }
+    }
+
+    std::vector<Item const*> Items;
+    Items.reserve(this->m_Items.size());
+    for (Item const& Current : this->m_Items)
+    {
+        Items.push_back(&Current);
+    }
+    std::sort(Items.begin(), Items.end(), [](
+        Item const* Left,
+        Item const* Right)
+    {
+        if (Left->Handler != Right->Handler)
+        {
+            return Left->Handler < Right->Handler;
+        }
+        return Left->Path < Right->Path;
+    });
+
+    std::vector<std::uint8_t> Content(HeaderSize);
+
+    std::uint64_t SessionRootPathOffset = Content.size();
+    Content.insert(
+        Content.end(),
+        this->m_SessionRootPath.begin(),
+        this->m_SessionRootPath.end());
+
+    std::vector<std::uint64_t> ConfigurationOffsets;
+    for (std::string const& Configuration : this->m_Configurations)
+    {
+        ConfigurationOffsets.push_back(Content.size());
+        Content.insert(
+            Content.end(),
+            Configuration.begin(),
+            Configuration.end());
+    }
+
+    // Keep the records aligned, so they can be read in place.
+    Content.resize((Content.size() + 7) & ~static_cast<std::size_t>(7));
+
+    std::uint64_t HandlersOffset = Content.size();
+    Content.resize(Content.size() +
+        this->m_Configurations.size() * HandlerRecordSize);
+
+    std::uint64_t ItemsOffset = Content.size();
+    Content.resize(Content.size() + Items.size() * ItemRecordSize);
+
+    std::uint64_t PathsOffset = Content.size();
+    std::vector<std::uint8_t> Paths;
+    std::vector<std::uint64_t> FirstItems(this->m_Configurations.size());
+    std::vector<std::uint64_t> ItemCounts(this->m_Configurations.size());
+    std::string const* Previous = nullptr;
+    for (std::size_t i = 0; i < Items.size(); ++i)
+    {
+        Item const& Current = *Items[i];
+
+        if (!ItemCounts[Current.Handler]++)
+        {
+            FirstItems[Current.Handler] = i;
+        }
+
+        std::size_t Shared = 0;
+        if (Previous && i % SnapshotRestartInterval)
+        {
+            std::size_t Limit = (std::min)(
+                Previous->size(),
+                Current.Path.size());
+            while (Shared < Limit &&
+                (*Previous)[Shared] == Current.Path[Shared])
+            {
+                ++Shared;
+            }
+        }
+        Previous = &Current.Path;
+
+        std::uint8_t* Record = &Content[ItemsOffset + i * ItemRecordSize];
+        ::StoreUInt64(Record, Current.Size);
+        ::StoreUInt64(Record + 8, Current.AllocationSize);
+        ::StoreUInt64(Record + 16, Current.FileId);
+        ::StoreUInt64(Record + 24, Paths.size());
+        ::StoreUInt32(Record + 32, Current.Reason);
+        ::StoreUInt32(Record + 36, Current.Handler);
+
+        ::AppendVarUInt(Paths, Shared);
+        ::AppendVarUInt(Paths, Current.Path.size() - Shared);
+        Paths.insert(
+            Paths.end(),
+            Current.Path.begin() + Shared,
+            Current.Path.end());
+    }
+    Content.insert(Content.end(), Paths.begin(), Paths.end());
+
+    for (std::size_t i = 0; i < this->m_Configurations.size(); ++i)
+    {
+        std::uint8_t* Record = &Content[HandlersOffset + i * HandlerRecordSize];
+        ::StoreUInt64(Record, ConfigurationOffsets[i]);
+        ::StoreUInt64(Record + 8, this->m_Configurations[i].size());
+        ::StoreUInt64(Record + 16, FirstItems[i]);
+        ::StoreUInt64(Record + 24, ItemCounts[i]);
+    }
+
+    std::uint8_t* Header = &Content[0];
+    ::StoreUInt64(Header, SnapshotMagic);
+    ::StoreUInt32(Header + 8, SnapshotVersion);
+    ::StoreUInt32(Header + 12, static_cast<std::uint32_t>(HeaderSize));
+    ::StoreUInt64(Header + 16, Content.size());
+    ::StoreUInt64(Header + 24, static_cast<std::uint64_t>(std::time(nullptr)));
+    ::StoreUInt32(Header + 32, this->m_HasSessionRootPath
+        ? SnapshotHasSessionRootPath
+        : 0);
+    ::StoreUInt32(
+        Header + 36,
+        static_cast<std::uint32_t>(this->m_Configurations.size()));
+    ::StoreUInt64(Header + 40, Items.size());
+    ::StoreUInt64(Header + 48, SessionRootPathOffset);
+    ::StoreUInt64(Header + 56, this->m_SessionRootPath.size());
+    ::StoreUInt64(Header + 64, HandlersOffset);
+    ::StoreUInt64(Header + 72, ItemsOffset);
+    ::StoreUInt64(Header + 80, PathsOffset);
+    ::StoreUInt64(Header + 88, Paths.size());
+    ::StoreUInt64(
+        Header + HashOffset,
+        ::HashSnapshot(Content.data(), Content.size()));
+
+    Error.SystemError = ::WriteFileAtomically(Path, Content);
+    if (Error.SystemError)
+    {
+        Error.Message = "The file cannot be written";
+        return false;
+    }
+
+    return true;
+}
+
+void NSudoSweeper::SnapshotWriter::Clear()
+{
+    this->m_HasSessionRootPath = false;
+    this->m_SessionRootPath.clear();
+    this->m_Configurations.clear();
+    this->m_Items.clear();
+}
+
+std::uint8_t const* NSudoSweeper::SnapshotReader::GetItemRecord(
+    std::uint64_t Index) const noexcept
+{
+    return this->m_Data +
+        this->m_ItemsOffset +
+        static_cast<std::size_t>(Index) * ItemRecordSize;
+}
+
+bool NSudoSweeper::SnapshotReader::DecodePath(
+    std::size_t& Offset,
+    std::string& Path) const
+{
+    std::uint8_t const* Data = this->m_Data + this->m_PathsOffset;
+
+    std::uint64_t Shared = 0;
+    std::uint64_t Rest = 0;
+    if (!::ReadVarUInt(Data, this->m_PathsSize, Offset, Shared) ||
+        !::ReadVarUInt(Data, this->m_PathsSize, Offset, Rest) ||
+        Shared > Path.size() ||
+        Rest > this->m_PathsSize - Offset)
+    {
+        return false;
+    }
+
+    Path.resize(static_cast<std::size_t>(Shared));
+    Path.append(
+        reinterpret_cast<char const*>(Data + Offset),
+        static_cast<std::size_t>(Rest));
+    Offset += static_cast<std::size_t>(Rest);
+    return true;
+}
+
+bool NSudoSweeper::SnapshotReader::Open(
+    Mile::NativeString const& Path,
+    SnapshotError& Error)
+{
+    this->Close();
+    Error = SnapshotError();
+
+    if (!this->m_File.Open(Path, Mile::MappedFileAccess::Random))
+    {
+        Error.SystemError = this->m_File.GetLastErrorCode();
+        Error.Message = "The file cannot be read";
+        return false;
+    }
+
+    std::uint8_t const* Data =
+        reinterpret_cast<std::uint8_t const*>(this->m_File.GetData());
+    std::size_t Size = this->m_File.GetSize();
+
+    if (Size < HeaderSize ||
+        ::LoadUInt64(Data) != SnapshotMagic ||
+        ::LoadUInt32(Data + 12) != HeaderSize)
+    {
+        this->Close();
+        Error.Message = "The file is not a snapshot";
+        return false;
+    }
+
+    if (::LoadUInt32(Data + 8) != SnapshotVersion)
+    {
+        this->Close();
+        Error.Message = "The version of the snapshot is not supported";
+        return false;
+    }
+
+    std::uint64_t HandlerCount = ::LoadUInt32(Data + 36);
+    std::uint64_t ItemCount = ::LoadUInt64(Data + 40);
+    std::uint64_t SessionRootPathOffset = ::LoadUInt64(Data + 48);
+    std::uint64_t SessionRootPathSize = ::LoadUInt64(Data + 56);
+    std::uint64_t HandlersOffset = ::LoadUInt64(Data + 64);
+    std::uint64_t ItemsOffset = ::LoadUInt64(Data + 72);
+    std::uint64_t PathsOffset = ::LoadUInt64(Data + 80);
+    std::uint64_t PathsSize = ::LoadUInt64(Data + 88);
+
+    if (::LoadUInt64(Data + 16) != Size ||
+        !::IsRangeValid(SessionRootPathOffset, SessionRootPathSize, 1, Size) ||
+        !::IsRangeValid(HandlersOffset, HandlerCount, HandlerRecordSize, Size) ||
+        !::IsRangeValid(ItemsOffset, ItemCount, ItemRecordSize, Size) ||
+        !::IsRangeValid(PathsOffset, PathsSize, 1, Size) ||
+        ::LoadUInt64(Data + HashOffset) != ::HashSnapshot(Data, Size))
+    {
+        this->Close();
+        Error.Message = "The snapshot is damaged";
+        return false;
+    }
+
+    this->m_Data = Data;
+    this->m_HandlerCount = static_cast<std::uint32_t>(HandlerCount);
+    this->m_ItemCount = ItemCount;
+    this->m_CreationTime = ::LoadUInt64(Data + 24);
+    this->m_HasSessionRootPath =
+        (::LoadUInt32(Data + 32) & SnapshotHasSessionRootPath) != 0;
+    this->m_HandlersOffset = static_cast<std::size_t>(HandlersOffset);
+    this->m_ItemsOffset = static_cast<std::size_t>(ItemsOffset);
+    this->m_PathsOffset = static_cast<std::size_t>(PathsOffset);
+    this->m_PathsSize = static_cast<std::size_t>(PathsSize);
+    this->m_SessionRootPathOffset =
+        static_cast<std::size_t>(SessionRootPathOffset);
+    this->m_SessionRootPathSize =
+        static_cast<std::size_t>(SessionRootPathSize);
+
+    return true;
+}
+
+void NSudoSweeper::SnapshotReader::Close() noexcept
+{
+    this->m_File.Close();
+    this->m_Data = nullptr;
+    this->m_HandlerCount = 0;
+    this->m_ItemCount = 0;
+    this->m_CreationTime = 0;
+    this->m_HasSessionRootPath = false;
+}
+
+bool NSudoSweeper::SnapshotReader::GetSessionRootPath(
+    Mile::NativeString& SessionRootPath) const
+{
+    if (!this->m_HasSessionRootPath)
+    {
+        SessionRootPath.clear();
+        return false;
+    }
+
+    SessionRootPath = ::ToNativeString(std::string(
+        reinterpret_cast<char const*>(
+            this->m_Data + this->m_SessionRootPathOffset),
+        this->m_SessionRootPathSize));
+    return true;
+}
+
+Mile::NativeString NSudoSweeper::SnapshotReader::GetConfiguration(
+    std::uint32_t Handler) const
+{
+    if (Handler >= this->m_HandlerCount)
+    {
+        return Mile::NativeString();
+    }
+
+    std::uint8_t const* Record =
+        this->m_Data + this->m_HandlersOffset + Handler * HandlerRecordSize;
+    std::uint64_t Offset = ::LoadUInt64(Record);
+    std::uint64_t Size = ::LoadUInt64(Record + 8);
+    if (!::IsRangeValid(Offset, Size, 1, this->m_File.GetSize()))
+    {
+        return Mile::NativeString();
+    }
+
+    return ::ToNativeString(std::string(
+        reinterpret_cast<char const*>(
+            this->m_Data + static_cast<std::size_t>(Offset)),
+        static_cast<std::size_t>(Size)));
+}
+
+bool NSudoSweeper::SnapshotReader::GetItem(
+    std::uint64_t Index,
+    HandlerHostItem& Item,
+    std::uint32_t& Handler) const
+{
+    if (Index >= this->m_ItemCount)
+    {
+        return false;
+    }
+
+    // Decode from the nearest entry which shares nothing.
+    std::string Path;
+    for (std::uint64_t Current = Index - Index % SnapshotRestartInterval;
+        Current <= Index;
+        ++Current)
+    {
+        std::size_t Offset = static_cast<std::size_t>(
+            ::LoadUInt64(this->GetItemRecord(Current) + 24));
+        if (!this->DecodePath(Offset, Path))
+        {
+            return false;
+        }
+    }
+
+    std::uint8_t const* Record = this->GetItemRecord(Index);
+    Handler = ::LoadUInt32(Record + 36);
+    if (Handler >= this->m_HandlerCount)
+    {
+        return false;
+    }
+
+    std::uint64_t FirstItem = ::LoadUInt64(
+        this->m_Data + this->m_HandlersOffset +
+        Handler * HandlerRecordSize + 16);
+
+    Item.Path = ::ToNativeString(Path);
+    Item.Index = Index - FirstItem;
+    Item.Size = ::LoadUInt64(Record);
+    Item.AllocationSize = ::LoadUInt64(Record + 8);
+    Item.FileId = ::LoadUInt64(Record + 16);
+    Item.Reason = ::LoadUInt32(Record + 32);
+    return true;
+}
+
+bool NSudoSweeper::SnapshotReader::GetHandlerItems(
+    std::uint32_t Handler,
+    std::vector<HandlerHostItem>& Items) const
+{
+    Items.clear();
+
+    if (Handler >= this->m_HandlerCount)
+    {
+        return false;
+    }
+
+    std::uint8_t const* HandlerRecord =
+        this->m_Data + this->m_HandlersOffset + Handler * HandlerRecordSize;
+    std::uint64_t FirstItem = ::LoadUInt64(HandlerRecord + 16);
+    std::uint64_t ItemCount = ::LoadUInt64(HandlerRecord + 24);
+    if (FirstItem > this->m_ItemCount ||
+        ItemCount > this->m_ItemCount - FirstItem)
+    {
+        return false;
+    }
+
+    Items.reserve(static_cast<std::size_t>(ItemCount));
+
+    // The paths are decoded in order, so each one only costs its own
+    // entry after the first.
+    std::string Path;
+    for (std::uint64_t Current = FirstItem - FirstItem % SnapshotRestartInterval;
+        Current < FirstItem + ItemCount;
+        ++Current)
+    {
+        std::uint8_t const* Record = this->GetItemRecord(Current);
+        std::size_t Offset = static_cast<std::size_t>(
+            ::LoadUInt64(Record + 24));
+        if (!this->DecodePath(Offset, Path))
+        {
+            Items.clear();
+            return false;
+        }
+
+        if (Current < FirstItem)
+        {
+            continue;
+        }
+
+        HandlerHostItem Item;
+        Item.Path = ::ToNativeString(Path);
+        Item.Index = Current - FirstItem;
+        Item.Size = ::LoadUInt64(Record);
+        Item.AllocationSize = ::LoadUInt64(Record + 8);
+        Item.FileId = ::LoadUInt64(Record + 16);
+        Item.Reason = ::LoadUInt32(Record + 32);
+        Items.push_back(std::move(Item));
+    }
+
+    return true;
+}
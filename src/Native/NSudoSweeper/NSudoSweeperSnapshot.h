@@ -0,0 +1,272 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperSnapshot.h
+ * PURPOSE:   Definition for the scan result snapshot
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_SNAPSHOT
+#define NSUDO_SWEEPER_SNAPSHOT
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.MappedFile.h>
+
+#include "NSudoSweeperHandlerHost.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * The snapshot file keeps the items found by the scans of one or more
+ * handlers, so a clean can run later without scanning again. All integers
+ * are little-endian and all strings are UTF-8, so a snapshot can be read on
+ * any platform.
+ *
+ *   Header         112 bytes, see SnapshotHeader in the implementation.
+ *   Strings        The session root path and the handler configurations.
+ *   Handlers       32 bytes per handler: the offset and the size of the
+ *                  configuration, and the range of its items.
+ *   Items          40 bytes per item: Size, AllocationSize, FileId, the
+ *                  offset of the path entry, Reason and the handler index.
+ *   Paths          One entry per item: the number of bytes shared with the
+ *                  previous path and the number of the other bytes as
+ *                  LEB128 values, then the other bytes.
+ *
+ * The items are sorted by the handler and the path, so neighbouring paths
+ * share long prefixes. Every SnapshotRestartInterval-th entry shares
+ * nothing, so an item is decoded from the nearest such entry instead of the
+ * start of the file. The header holds the 64-bit FNV-1a hash of the whole
+ * file except the hash itself.
+ */
+
+namespace NSudoSweeper
+{
+    /**
+     * The number of items between two path entries which share nothing.
+     */
+    const std::uint32_t SnapshotRestartInterval = 16;
+
+    /**
+     * The error of a snapshot operation.
+     */
+    struct SnapshotError
+    {
+        /**
+         * The system error code if the file cannot be read or written,
+         * which is a Win32 error code on Windows and an errno value
+         * elsewhere.
+         */
+        int SystemError = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * Collects the items of scans and saves them as a snapshot.
+     */
+    class SnapshotWriter : Mile::DisableCopyConstruction
+    {
+    private:
+
+        struct Item
+        {
+            std::string Path;
+            std::uint64_t Size;
+            std::uint64_t AllocationSize;
+            std::uint64_t FileId;
+            std::uint32_t Reason;
+            std::uint32_t Handler;
+        };
+
+        bool m_HasSessionRootPath = false;
+        std::string m_SessionRootPath;
+        std::vector<std::string> m_Configurations;
+        std::vector<Item> m_Items;
+
+    public:
+
+        /**
+         * Sets the root directory of the offline image the scans ran on.
+         *
+         * @param SessionRootPath The root directory, or nullptr for the
+         *                        online image.
+         */
+        void SetSessionRootPath(
+            Mile::NativeString const* SessionRootPath);
+
+        /**
+         * Adds a handler.
+         *
+         * @param Configuration The configuration file of the handler, which
+         *                      is passed to the handler when it cleans.
+         * @return The index of the handler.
+         */
+        std::uint32_t AddHandler(
+            Mile::NativeStringView Configuration);
+
+        /**
+         * Adds the items a handler has found.
+         *
+         * @param Handler The index returned by AddHandler.
+         * @param Items The items. The Index members are not saved.
+         */
+        void AddItems(
+            std::uint32_t Handler,
+            std::vector<HandlerHostItem> const& Items);
+
+        /**
+         * Saves the snapshot. The file is written under a temporary name
+         * and renamed, so an existing snapshot is only replaced by a
+         * complete one.
+         *
+         * @param Path The path of the snapshot file.
+         * @param Error The error if the snapshot cannot be saved.
+         * @return true if successful, otherwise false.
+         */
+        bool Save(
+            Mile::NativeString const& Path,
+            SnapshotError& Error) const;
+
+        /**
+         * Removes all handlers and items.
+         */
+        void Clear();
+    };
+
+    /**
+     * Reads a snapshot from a memory-mapped file. Nothing is decoded until
+     * it is asked for, so opening a large snapshot only costs checking its
+     * hash.
+     */
+    class SnapshotReader : Mile::DisableCopyConstruction
+    {
+    private:
+
+        Mile::MappedFile m_File;
+        std::uint8_t const* m_Data = nullptr;
+        std::uint32_t m_HandlerCount = 0;
+        std::uint64_t m_ItemCount = 0;
+        std::uint64_t m_CreationTime = 0;
+        bool m_HasSessionRootPath = false;
+        std::size_t m_HandlersOffset = 0;
+        std::size_t m_ItemsOffset = 0;
+        std::size_t m_PathsOffset = 0;
+        std::size_t m_PathsSize = 0;
+        std::size_t m_SessionRootPathOffset = 0;
+        std::size_t m_SessionRootPathSize = 0;
+
+        std::uint8_t const* GetItemRecord(
+            std::uint64_t Index) const noexcept;
+
+        bool DecodePath(
+            std::size_t& Offset,
+            std::string& Path) const;
+
+    public:
+
+        /**
+         * Opens and checks a snapshot. The previous snapshot is closed.
+         *
+         * @param Path The path of the snapshot file.
+         * @param Error The error if the snapshot cannot be opened.
+         * @return true if successful, otherwise false.
+         */
+        bool Open(
+            Mile::NativeString const& Path,
+            SnapshotError& Error);
+
+        /**
+         * Closes the snapshot.
+         */
+        void Close() noexcept;
+
+        /**
+         * Retrieves the time the snapshot was saved.
+         *
+         * @return The number of seconds since 1970-01-01 00:00:00 UTC.
+         */
+        std::uint64_t GetCreationTime() const noexcept
+        {
+            return this->m_CreationTime;
+        }
+
+        /**
+         * Retrieves the root directory of the offline image the scans ran
+         * on.
+         *
+         * @param SessionRootPath The root directory.
+         * @return true if the scans ran on an offline image, or false if
+         *         they ran on the online image.
+         */
+        bool GetSessionRootPath(
+            Mile::NativeString& SessionRootPath) const;
+
+        /**
+         * Retrieves the number of handlers.
+         *
+         * @return The number of handlers.
+         */
+        std::uint32_t GetHandlerCount() const noexcept
+        {
+            return this->m_HandlerCount;
+        }
+
+        /**
+         * Retrieves the configuration file of a handler.
+         *
+         * @param Handler The index of the handler.
+         * @return The configuration file.
+         */
+        Mile::NativeString GetConfiguration(
+            std::uint32_t Handler) const;
+
+        /**
+         * Retrieves the total number of items.
+         *
+         * @return The number of items.
+         */
+        std::uint64_t GetItemCount() const noexcept
+        {
+            return this->m_ItemCount;
+        }
+
+        /**
+         * Retrieves an item.
+         *
+         * @param Index The index of the item, from 0 to GetItemCount() - 1.
+         * @param Item The item. Its Index member is the index of the item
+         *             among the items of its handler.
+         * @param Handler The index of the handler of the item.
+         * @return true if successful, or false if the index is out of range
+         *         or the item is damaged.
+         */
+        bool GetItem(
+            std::uint64_t Index,
+            HandlerHostItem& Item,
+            std::uint32_t& Handler) const;
+
+        /**
+         * Retrieves the items of a handler, which can be passed to
+         * HandlerHost::Start to clean them. The handler revalidates each
+         * item by its size and file ID before it removes it.
+         *
+         * @param Handler The index of the handler.
+         * @param Items The items.
+         * @return true if successful, or false if the index is out of range
+         *         or an item is damaged.
+         */
+        bool GetHandlerItems(
+            std::uint32_t Handler,
+            std::vector<HandlerHostItem>& Items) const;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_SNAPSHOT
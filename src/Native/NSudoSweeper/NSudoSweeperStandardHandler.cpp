@@ -0,0 +1,1320 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperStandardHandler.cpp
+ * PURPOSE:   Implementation for the standard cleanup handler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperStandardHandler.h"
+
+#include "NSudoSweeperEstimator.h"
+#include "NSudoSweeperHandlerDescriptor.h"
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperMftScanner.h"
+#include "NSudoSweeperPathRules.h"
+#include "NSudoSweeperProgress.h"
+#include "NSudoSweeperRegistryHive.h"
+#include "NSudoSweeperScanCache.h"
+#include "NSudoSweeperTreeWalker.h"
+#include "NSudoSweeperVolume.h"
+#include "NSudoSweeperWalkPlanner.h"
+
+#include <Mile.Portable.ThreadPool.h>
+
+#include <chrono>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <Mile.Portable.CaseInsensitive.h>
+#endif
+
+namespace
+{
+    const std::uint32_t DefaultBatchSize = 256;
+
+    const std::chrono::milliseconds DefaultEstimateTimeBudget(1000);
+
+    bool RegistryKeyExists(
+        Mile::NativeStringView Path)
+    {
+#if defined(_WIN32)
+        struct RootKey
+        {
+            wchar_t const* Name;
+            HKEY Key;
+        };
+
+        static const RootKey RootKeys[] =
+        {
+            { L"HKCU", HKEY_CURRENT_USER },
+            { L"HKEY_CURRENT_USER", HKEY_CURRENT_USER },
+            { L"HKLM", HKEY_LOCAL_MACHINE },
+            { L"HKEY_LOCAL_MACHINE", HKEY_LOCAL_MACHINE },
+            { L"HKCR", HKEY_CLASSES_ROOT },
+            { L"HKEY_CLASSES_ROOT", HKEY_CLASSES_ROOT },
+            { L"HKU", HKEY_USERS },
+            { L"HKEY_USERS", HKEY_USERS },
+        };
+
+        std::size_t Separator = Path.find(L'\\');
+        Mile::NativeStringView RootName = Path.substr(0, Separator);
+        std::wstring SubKey;
+        if (Separator != Mile::NativeStringView::npos)
+        {
+            SubKey = std::wstring(Path.substr(Separator + 1));
+        }
+
+        for (RootKey const& Root : RootKeys)
+        {
+            if (!Mile::CaseInsensitiveEquals(RootName, Root.Name))
+            {
+                continue;
+            }
+
+            HKEY Key = nullptr;
+            if (ERROR_SUCCESS != ::RegOpenKeyExW(
+                Root.Key,
+                SubKey.c_str(),
+                0,
+                KEY_READ,
+                &Key))
+            {
+                return false;
+            }
+            ::RegCloseKey(Key);
+            return true;
+        }
+
+        return false;
+#else
+        Mile::UnreferencedParameter(Path);
+        return false;
+#endif
+    }
+
+    /**
+     * The REG_SZ and REG_DWORD value types.
+     */
+    const std::uint32_t RegistryStringType = 1;
+    const std::uint32_t RegistryDwordType = 4;
+
+    /**
+     * The key which has the version of Windows.
+     */
+    const char CurrentVersionKeyPath[] =
+        "HKLM\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion";
+
+    Mile::NativeString FromAscii(
+        char const* Text)
+    {
+        Mile::NativeString Result;
+        for (; *Text; ++Text)
+        {
+            Result.push_back(static_cast<Mile::NativeChar>(*Text));
+        }
+        return Result;
+    }
+
+    /**
+     * Reads a value of the CurrentVersion key of an offline image as ASCII
+     * text, or as a decimal number if it is a REG_DWORD value.
+     */
+    bool QueryVersionValue(
+        NSudoSweeper::OfflineRegistry& Registry,
+        char const* Name,
+        std::string& Text)
+    {
+        std::uint32_t Type = 0;
+        std::vector<std::uint8_t> Data;
+        if (!Registry.QueryValue(
+            ::FromAscii(CurrentVersionKeyPath),
+            ::FromAscii(Name),
+            Type,
+            Data))
+        {
+            return false;
+        }
+
+        if (Type == RegistryDwordType && Data.size() >= 4)
+        {
+            Text = std::to_string(
+                static_cast<std::uint32_t>(Data[0]) |
+                (static_cast<std::uint32_t>(Data[1]) << 8) |
+                (static_cast<std::uint32_t>(Data[2]) << 16) |
+                (static_cast<std::uint32_t>(Data[3]) << 24));
+            return true;
+        }
+
+        if (Type != RegistryStringType)
+        {
+            return false;
+        }
+
+        // The data is a UTF-16LE string, usually terminated by a null
+        // character.
+        Text.clear();
+        for (std::size_t i = 0; i + 1 < Data.size(); i += 2)
+        {
+            std::uint32_t Character = static_cast<std::uint32_t>(Data[i]) |
+                (static_cast<std::uint32_t>(Data[i + 1]) << 8);
+            if (!Character)
+            {
+                break;
+            }
+            if (Character > 0x7F)
+            {
+                return false;
+            }
+            Text.push_back(static_cast<char>(Character));
+        }
+        return true;
+    }
+
+    /**
+     * Reads the version of Windows of an offline image from its SOFTWARE
+     * hive.
+     *
+     * @return true if successful, otherwise false.
+     */
+    bool GetImageVersion(
+        NSudoSweeper::OfflineRegistry& Registry,
+        NSudoSweeper::HandlerVersion& Version)
+    {
+        // Windows 10 and later keep "6.3" in CurrentVersion for the
+        // compatibility, and their version in the number values.
+        std::string Text;
+        std::string Minor;
+        if (::QueryVersionValue(Registry, "CurrentMajorVersionNumber", Text) &&
+            ::QueryVersionValue(Registry, "CurrentMinorVersionNumber", Minor))
+        {
+            Text += "." + Minor;
+        }
+        else if (!::QueryVersionValue(Registry, "CurrentVersion", Text))
+        {
+            return false;
+        }
+
+        std::string Build;
+        if (::QueryVersionValue(Registry, "CurrentBuildNumber", Build))
+        {
+            Text += "." + Build;
+        }
+
+        return NSudoSweeper::ParseHandlerVersion(Text, 0, Version);
+    }
+
+    /**
+     * Replaces the drive of an absolute path with the root of an offline
+     * image.
+     */
+    Mile::NativeString RebasePath(
+        Mile::NativeString const& Path,
+        NSUDO_SWEEPER_CHAR const* SessionRootPath)
+    {
+        if (!SessionRootPath)
+        {
+            return Path;
+        }
+
+        std::size_t DriveLength = 0;
+#if defined(_WIN32)
+        if (Path.size() >= 3 &&
+            Path[1] == L':' &&
+            NSudoSweeper::IsPathSeparator(Path[2]))
+        {
+            DriveLength = 3;
+        }
+#else
+        if (!Path.empty() && Path[0] == '/')
+        {
+            DriveLength = 1;
+        }
+#endif
+        if (!DriveLength)
+        {
+            return Path;
+        }
+
+        Mile::NativeString Result(SessionRootPath);
+        if (Result.empty() || !NSudoSweeper::IsPathSeparator(Result.back()))
+        {
+            Result.push_back(NSudoSweeper::PathSeparator);
+        }
+        Result.append(Path, DriveLength, Mile::NativeString::npos);
+        return Result;
+    }
+
+    /**
+     * Retrieves the literal directories at the start of a pattern, or the
+     * pattern itself if it has no wildcard.
+     */
+    Mile::NativeString GetLiteralPrefix(
+        Mile::NativeString const& Pattern)
+    {
+        std::size_t Wildcard = Pattern.find_first_of(
+#if defined(_WIN32)
+            L"*?["
+#else
+            "*?["
+#endif
+        );
+        if (Wildcard == Mile::NativeString::npos)
+        {
+            return Pattern;
+        }
+
+        std::size_t End = Wildcard;
+        while (End && !NSudoSweeper::IsPathSeparator(Pattern[End - 1]))
+        {
+            --End;
+        }
+        return Pattern.substr(0, End);
+    }
+
+    /**
+     * A batch of items whose paths are kept until the batch is cleared, so
+     * a clean can remove them after they are reported.
+     */
+    class ItemBatch
+    {
+    private:
+
+        std::vector<NSUDO_SWEEPER_ITEM> m_Items;
+        std::vector<Mile::NativeString> m_Paths;
+        std::size_t m_Count = 0;
+        std::uint64_t m_FirstIndex = 0;
+
+    public:
+
+        explicit ItemBatch(
+            std::uint32_t Capacity) :
+            m_Items(Capacity),
+            m_Paths(Capacity)
+        {
+        }
+
+        bool IsFull() const noexcept
+        {
+            return this->m_Count == this->m_Items.size();
+        }
+
+        std::size_t GetCount() const noexcept
+        {
+            return this->m_Count;
+        }
+
+        std::uint64_t GetFirstIndex() const noexcept
+        {
+            return this->m_FirstIndex;
+        }
+
+        NSUDO_SWEEPER_ITEM const& GetItem(
+            std::size_t Index) const noexcept
+        {
+            return this->m_Items[Index];
+        }
+
+        Mile::NativeString const& GetPath(
+            std::size_t Index) const noexcept
+        {
+            return this->m_Paths[Index];
+        }
+
+        void Add(
+            Mile::NativeString&& Path,
+            NSudoSweeper::FileState const& State,
+            std::uint32_t Reason)
+        {
+            NSUDO_SWEEPER_ITEM& Item = this->m_Items[this->m_Count];
+            Item.Path = nullptr;
+            Item.PathLength = static_cast<std::uint32_t>(Path.size());
+            Item.Reason = Reason;
+            Item.Size = State.Size;
+            Item.AllocationSize = State.AllocationSize;
+            Item.FileId = State.FileId;
+            this->m_Paths[this->m_Count] = std::move(Path);
+            ++this->m_Count;
+        }
+
+        bool Send(
+            NSudoSweeper::CallbackChannel& Channel)
+        {
+            // The strings may have moved since they were added, so the
+            // pointers are only taken now.
+            for (std::size_t i = 0; i < this->m_Count; ++i)
+            {
+                this->m_Items[i].Path = this->m_Paths[i].c_str();
+            }
+
+            NSUDO_SWEEPER_ITEM_BATCH Batch;
+            Batch.Items = this->m_Items.data();
+            Batch.Count = static_cast<std::uint32_t>(this->m_Count);
+            Batch.Reserved = 0;
+            Batch.FirstIndex = this->m_FirstIndex;
+            return Channel.Send(NSUDO_SWEEPER_ITEM_BATCH_MESSAGE, &Batch);
+        }
+
+        void Clear() noexcept
+        {
+            this->m_FirstIndex += this->m_Count;
+            this->m_Count = 0;
+        }
+    };
+
+    class StandardHandler
+    {
+    private:
+
+        NSUDO_SWEEPER_HANDLER_REQUEST const& m_Request;
+        NSUDO_SWEEPER_HANDLER_SUMMARY& m_Summary;
+        NSudoSweeper::CallbackChannel m_Channel;
+        std::uint32_t m_BatchSize;
+
+        NSudoSweeper::HandlerDescriptor m_Descriptor;
+        std::vector<Mile::NativeString> m_Includes;
+        std::vector<Mile::NativeString> m_Excludes;
+        std::vector<std::uint32_t> m_IncludeReasons;
+        NSudoSweeper::PathRuleSet m_Rules;
+
+        bool IsDetected() const
+        {
+            std::shared_ptr<NSudoSweeper::OfflineRegistry> OfflineRegistry;
+            if (this->m_Request.SessionRootPath)
+            {
+                OfflineRegistry = NSudoSweeper::OfflineRegistry::Acquire(
+                    this->m_Request.SessionRootPath);
+            }
+
+            // DetectOS only applies if the version of Windows is known, which
+            // is not the case on other platforms or for an image without a
+            // SOFTWARE hive.
+            if (this->m_Descriptor.HasDetectOS)
+            {
+                NSudoSweeper::HandlerVersion Version;
+                bool Known = OfflineRegistry
+                    ? ::GetImageVersion(*OfflineRegistry, Version)
+                    : NSudoSweeper::GetCurrentHandlerVersion(Version);
+                if (Known && !NSudoSweeper::IsHandlerVersionSupported(
+                    this->m_Descriptor,
+                    Version))
+                {
+                    return false;
+                }
+            }
+
+            if (this->m_Descriptor.Detect.empty())
+            {
+                return true;
+            }
+
+            for (NSudoSweeper::HandlerRule const& Rule :
+                this->m_Descriptor.Detect)
+            {
+                if (Rule.Type == NSudoSweeper::HandlerRuleType::Registry)
+                {
+                    if (!this->m_Request.SessionRootPath)
+                    {
+                        if (::RegistryKeyExists(Rule.Pattern))
+                        {
+                            return true;
+                        }
+                        continue;
+                    }
+
+                    // The registry of an offline image is not loaded, so
+                    // its hive files are read directly.
+                    if (OfflineRegistry->KeyExists(Rule.Pattern))
+                    {
+                        return true;
+                    }
+                    continue;
+                }
+
+                Mile::NativeString Path = ::GetLiteralPrefix(
+                    ::RebasePath(
+                        Rule.Pattern,
+                        this->m_Request.SessionRootPath));
+                NSudoSweeper::FileState State;
+                if (!Path.empty() && !NSudoSweeper::QueryFileState(Path, State))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        std::uint32_t GetReason(
+            Mile::NativeStringView Path,
+            NSudoSweeper::PathRuleMatch& Match) const
+        {
+            this->m_Rules.Match(Path, Match);
+            for (std::uint32_t Rule : Match.Rules)
+            {
+                if (Rule < this->m_IncludeReasons.size())
+                {
+                    return this->m_IncludeReasons[Rule];
+                }
+            }
+            return NSUDO_SWEEPER_REASON_HANDLER;
+        }
+
+        /**
+         * Sends a published progress. The final one is always sent, the
+         * others only if nothing else has been sent for the interval.
+         */
+        bool SendProgress(
+            NSudoSweeper::ProgressSnapshot const& Snapshot)
+        {
+            return Snapshot.Completed
+                ? this->m_Channel.SendProgress(Snapshot.Percentage)
+                : this->m_Channel.SendProgressIfIdle(Snapshot.Percentage);
+        }
+
+        void RemoveItem(
+            Mile::NativeString const& Path,
+            NSudoSweeper::FileState const& State,
+            NSUDO_SWEEPER_CLEAN_RESULT& Result)
+        {
+            int Error = NSudoSweeper::RemoveFile(Path);
+            if (Error)
+            {
+                Result.Result = NSudoSweeper::IsNotFoundError(Error)
+                    ? NSUDO_SWEEPER_E_ITEM_NOT_FOUND
+                    : NSUDO_SWEEPER_E_FAIL;
+                Result.SystemError = Error;
+                ++this->m_Summary.FailedItemCount;
+                return;
+            }
+
+            Result.FreedSize = State.AllocationSize
+                ? State.AllocationSize
+                : State.Size;
+            this->m_Summary.FreedSize += Result.FreedSize;
+        }
+
+        bool SendItems(
+            ItemBatch& Items,
+            NSudoSweeper::ResultBatch& Results,
+            bool Remove)
+        {
+            if (!Items.GetCount())
+            {
+                return true;
+            }
+
+            if (!Items.Send(this->m_Channel))
+            {
+                return false;
+            }
+
+            if (Remove)
+            {
+                for (std::size_t i = 0; i < Items.GetCount(); ++i)
+                {
+                    NSUDO_SWEEPER_ITEM const& Item = Items.GetItem(i);
+                    NSudoSweeper::FileState State;
+                    State.Size = Item.Size;
+                    State.AllocationSize = Item.AllocationSize;
+                    State.FileId = Item.FileId;
+
+                    NSUDO_SWEEPER_CLEAN_RESULT Result;
+                    Result.Index = Items.GetFirstIndex() + i;
+                    Result.Result = NSUDO_SWEEPER_S_OK;
+                    Result.SystemError = 0;
+                    Result.FreedSize = 0;
+                    this->RemoveItem(Items.GetPath(i), State, Result);
+                    if (!Results.Add(this->m_Channel, Result))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            Items.Clear();
+            return true;
+        }
+
+        NSudoSweeper::WalkPlan PlanWalk() const
+        {
+            NSudoSweeper::WalkPlanner Planner;
+            for (Mile::NativeString const& Include : this->m_Includes)
+            {
+                Planner.AddInclude(0, Include);
+            }
+            for (Mile::NativeString const& Exclude : this->m_Excludes)
+            {
+                Planner.AddExclude(0, Exclude);
+            }
+            return Planner.Plan();
+        }
+
+        /**
+         * Includes the selected files, and prunes the directories below
+         * which no rule can match.
+         */
+        NSudoSweeper::TreeWalkerFilterResult FilterEntry(
+            Mile::NativeStringView DirectoryPath,
+            Mile::NativeStringView Name,
+            Mile::FileEntryType Type) const
+        {
+            Mile::NativeString Path(DirectoryPath);
+            if (!Path.empty() && !NSudoSweeper::IsPathSeparator(Path.back()))
+            {
+                Path.push_back(NSudoSweeper::PathSeparator);
+            }
+            Path.append(Name.data(), Name.size());
+
+            if (Type == Mile::FileEntryType::Directory)
+            {
+                return this->m_Rules.MayMatchBelow(Path)
+                    ? NSudoSweeper::TreeWalkerFilterResult::Skip
+                    : NSudoSweeper::TreeWalkerFilterResult::Prune;
+            }
+
+            return this->m_Rules.IsSelected(Path)
+                ? NSudoSweeper::TreeWalkerFilterResult::Include
+                : NSudoSweeper::TreeWalkerFilterResult::Skip;
+        }
+
+        NSudoSweeper::TreeWalkerFilterResult FilterEntry(
+            Mile::NativeStringView DirectoryPath,
+            Mile::FileEnumeratorEntry const& Entry) const
+        {
+            return this->FilterEntry(
+                DirectoryPath,
+                Entry.GetName(),
+                Entry.GetType());
+        }
+
+        /**
+         * Opens the volume of an offline image for reading its master file
+         * table, if the root of the image is the root of an NTFS volume.
+         */
+        bool OpenVolumeScanner(
+            NSudoSweeper::MftScanner& Scanner) const
+        {
+            if (!this->m_Request.SessionRootPath)
+            {
+                return false;
+            }
+
+            // The root directory of the table is the root of the volume.
+            Mile::NativeString Root(this->m_Request.SessionRootPath);
+            if (Root.empty() || !NSudoSweeper::IsPathSeparator(Root.back()))
+            {
+                Root.push_back(NSudoSweeper::PathSeparator);
+            }
+            Mile::NativeString VolumeKey = NSudoSweeper::GetVolumeKey(Root);
+            if (!NSudoSweeper::IsSameVolumeKey(VolumeKey, Root))
+            {
+                return false;
+            }
+
+            Mile::NativeString DevicePath =
+                NSudoSweeper::GetVolumeDevicePath(VolumeKey);
+            if (DevicePath.empty())
+            {
+                return false;
+            }
+
+            // The tree walker scans a volume which cannot be read directly.
+            NSudoSweeper::MftScannerError Error;
+            if (!Scanner.Open(DevicePath, Error))
+            {
+                return false;
+            }
+
+            Scanner.SetRootPath(Root);
+            return true;
+        }
+
+        /**
+         * Loads the directories of the previous scan, and reads the change
+         * journals of the volumes since then if it can.
+         */
+        void PrepareScanCache(
+            NSudoSweeper::ScanCache& Cache,
+            std::vector<NSudoSweeper::TreeWalkerRoot> const& Roots) const
+        {
+            // The cache of other rules or another image is not valid.
+            Mile::NativeString Identity(this->m_Request.Configuration);
+            if (this->m_Request.SessionRootPath)
+            {
+                Identity.push_back('\0');
+                Identity.append(this->m_Request.SessionRootPath);
+            }
+            Cache.SetIdentity(Identity);
+
+            // A full scan replaces a cache which cannot be loaded.
+            NSudoSweeper::ScanCacheError Error;
+            bool Loaded = Cache.Load(this->m_Request.ScanCachePath, Error);
+
+            Cache.BeginScan();
+
+            std::vector<Mile::NativeString> VolumeKeys;
+            for (NSudoSweeper::TreeWalkerRoot const& Root : Roots)
+            {
+                Mile::NativeString Key = NSudoSweeper::GetVolumeKey(Root.Path);
+                bool Found = false;
+                for (Mile::NativeString const& Current : VolumeKeys)
+                {
+                    if (NSudoSweeper::IsSameVolumeKey(Current, Key))
+                    {
+                        Found = true;
+                        break;
+                    }
+                }
+                if (!Found)
+                {
+                    VolumeKeys.push_back(std::move(Key));
+                }
+            }
+
+            // The journals replace the fingerprints only if the changes of
+            // every volume since the previous scan are known.
+            bool Complete = Loaded && !VolumeKeys.empty();
+            NSudoSweeper::ChangeJournalChangeSet Changes;
+            for (Mile::NativeString const& Key : VolumeKeys)
+            {
+                NSudoSweeper::ScanCacheJournal Journal;
+                Journal.VolumeKey = Key;
+                if (NSudoSweeper::QueryChangeJournal(Journal))
+                {
+                    Complete = false;
+                    continue;
+                }
+                Cache.AddJournal(Journal);
+
+                NSudoSweeper::ScanCacheJournal const* Previous = nullptr;
+                for (NSudoSweeper::ScanCacheJournal const& Current :
+                    Cache.GetPreviousJournals())
+                {
+                    if (NSudoSweeper::IsSameVolumeKey(
+                        Current.VolumeKey,
+                        Key))
+                    {
+                        Previous = &Current;
+                    }
+                }
+                if (Complete && (!Previous || NSudoSweeper::ReadChangeJournal(
+                    *Previous,
+                    Journal,
+                    Changes)))
+                {
+                    Complete = false;
+                }
+            }
+            if (Complete && Changes.IsComplete())
+            {
+                Cache.SetChangedDirectories(std::move(Changes));
+            }
+        }
+
+        /**
+         * Provides the entries of a directory from the previous scan if it
+         * has not changed since then.
+         */
+        bool ProvideDirectory(
+            NSudoSweeper::ScanCache& Cache,
+            Mile::NativeStringView Path,
+            std::vector<NSudoSweeper::TreeWalkerItem>& Items,
+            std::vector<Mile::NativeString>& Subdirectories) const
+        {
+            Mile::NativeString DirectoryPath(Path);
+
+            // The enumeration reports a directory which cannot be queried.
+            NSudoSweeper::DirectoryFingerprint Fingerprint;
+            if (Cache.NeedsFingerprints() &&
+                NSudoSweeper::QueryDirectoryFingerprint(
+                    DirectoryPath,
+                    Fingerprint))
+            {
+                return false;
+            }
+
+            NSudoSweeper::ScanCacheDirectory const* Previous = nullptr;
+            NSudoSweeper::ScanCacheDecision Decision = Cache.Decide(
+                Path,
+                Fingerprint,
+                Previous);
+            if (Decision == NSudoSweeper::ScanCacheDecision::Enumerate)
+            {
+                if (!Cache.NeedsFingerprints() &&
+                    NSudoSweeper::QueryDirectoryFingerprint(
+                        DirectoryPath,
+                        Fingerprint))
+                {
+                    return false;
+                }
+                Cache.AddDirectory(Path, Fingerprint);
+                return false;
+            }
+
+            Cache.ReuseDirectory(Path, Decision, *Previous);
+
+            for (Mile::NativeString const& Name : Previous->Subdirectories)
+            {
+                Subdirectories.push_back(NSudoSweeper::JoinPath(Path, Name));
+            }
+
+            Items.reserve(Previous->Items.size());
+            for (NSudoSweeper::ScanCacheItem const& Cached : Previous->Items)
+            {
+                NSudoSweeper::TreeWalkerItem Item;
+                Item.Path = NSudoSweeper::JoinPath(Path, Cached.Name);
+                Item.Type = Cached.Type;
+                Item.Depth = 0;
+                Item.FileId = Cached.FileId;
+                Item.Size = Cached.Size;
+                Item.AllocationSize = Cached.AllocationSize;
+                // A file which is written or truncated in place does not
+                // change its directory, and the batch handler reports the
+                // sizes of the items as they are.
+                if (Cache.IsItemChanged(Decision, Cached.FileId))
+                {
+                    NSudoSweeper::FileState State;
+                    if (NSudoSweeper::QueryFileState(Item.Path, State))
+                    {
+                        continue;
+                    }
+                    Item.FileId = State.FileId;
+                    Item.Size = State.Size;
+                    Item.AllocationSize = State.AllocationSize;
+                }
+                Items.push_back(std::move(Item));
+            }
+
+            return true;
+        }
+
+        NSUDO_SWEEPER_RESULT Scan(
+            bool Remove)
+        {
+            NSudoSweeper::WalkPlan Plan = this->PlanWalk();
+            std::vector<NSudoSweeper::TreeWalkerRoot> Roots =
+                Plan.GetTreeWalkerRoots();
+
+            // An offline image reads the table of its volume once instead of
+            // enumerating its directories, which also reports the sizes.
+            NSudoSweeper::MftScannerOptions ScannerOptions;
+            ScannerOptions.BatchSize = this->m_BatchSize;
+            NSudoSweeper::MftScanner Scanner(ScannerOptions);
+            bool UseScanner = this->OpenVolumeScanner(Scanner);
+
+            // A clean changes the directories it walks.
+            NSudoSweeper::ScanCache Cache;
+            const bool UseCache =
+                !UseScanner &&
+                !Remove &&
+                this->m_Request.ScanCachePath;
+            if (UseCache)
+            {
+                this->PrepareScanCache(Cache, Roots);
+            }
+
+            NSudoSweeper::TreeWalkerOptions Options;
+            Options.BatchSize = this->m_BatchSize;
+            NSudoSweeper::TreeWalker Walker(
+                Mile::ThreadPool::GetDefault(),
+                Options);
+
+            NSudoSweeper::ProgressAggregatorOptions ProgressOptions;
+            ProgressOptions.Interval = NSudoSweeper::HandlerProgressInterval;
+            ProgressOptions.PublishUnchanged = true;
+            NSudoSweeper::ProgressAggregator Progress(ProgressOptions);
+
+            Walker.AddFilter([this, &Progress](
+                Mile::NativeStringView DirectoryPath,
+                Mile::FileEnumeratorEntry const& Entry,
+                std::uint32_t Depth)
+            {
+                Mile::UnreferencedParameter(Depth);
+
+                if (Entry.GetType() != Mile::FileEntryType::Directory)
+                {
+                    Progress.AddFiles();
+                }
+                return this->FilterEntry(DirectoryPath, Entry);
+            });
+
+            Scanner.AddFilter([this, &Progress](
+                Mile::NativeStringView DirectoryPath,
+                Mile::NativeStringView Name,
+                Mile::FileEntryType Type)
+            {
+                if (Type != Mile::FileEntryType::Directory)
+                {
+                    Progress.AddFiles();
+                }
+                return this->FilterEntry(DirectoryPath, Name, Type);
+            });
+
+            Walker.SetErrorHandler([&Progress](
+                Mile::NativeStringView Path,
+                int ErrorCode)
+            {
+                Mile::UnreferencedParameter(Path);
+                Mile::UnreferencedParameter(ErrorCode);
+
+                Progress.AddErrors();
+            });
+
+            if (UseCache)
+            {
+                Walker.SetDirectoryFilter([this, &Cache, &Progress](
+                    Mile::NativeStringView Path,
+                    std::uint32_t Depth,
+                    std::vector<NSudoSweeper::TreeWalkerItem>& Items,
+                    std::vector<Mile::NativeString>& Subdirectories)
+                {
+                    Mile::UnreferencedParameter(Depth);
+
+                    if (!this->ProvideDirectory(
+                        Cache,
+                        Path,
+                        Items,
+                        Subdirectories))
+                    {
+                        return false;
+                    }
+                    Progress.AddFiles(Items.size());
+                    return true;
+                });
+
+                Walker.SetDirectoryHandler([&Cache](
+                    Mile::NativeStringView Path,
+                    std::uint64_t EntryCount,
+                    std::vector<Mile::NativeStringView> const& Subdirectories)
+                {
+                    Cache.CompleteDirectory(Path, EntryCount, Subdirectories);
+                });
+            }
+
+            ItemBatch Items(this->m_BatchSize);
+            NSudoSweeper::ResultBatch Results(this->m_BatchSize);
+            NSudoSweeper::PathRuleMatch Match;
+
+            auto CancelScan = [&Walker, &Scanner]()
+            {
+                Walker.Cancel();
+                Scanner.Cancel();
+            };
+
+            auto HandleBatch = [&](
+                std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+            {
+                // The walker may deliver the batches it has already found
+                // after it is canceled.
+                if (this->m_Channel.GetResult() != NSUDO_SWEEPER_S_OK)
+                {
+                    return;
+                }
+
+                for (NSudoSweeper::TreeWalkerItem& Item : Batch)
+                {
+                    if (Item.Type == Mile::FileEntryType::Directory)
+                    {
+                        continue;
+                    }
+
+                    NSudoSweeper::FileState State;
+                    State.Size = Item.Size;
+                    State.AllocationSize = Item.AllocationSize;
+                    State.FileId = Item.FileId;
+
+                    if (UseCache)
+                    {
+                        NSudoSweeper::ScanCacheItem Cached;
+                        Cached.Type = Item.Type;
+                        Cached.Size = State.Size;
+                        Cached.AllocationSize = State.AllocationSize;
+                        Cached.FileId = State.FileId;
+                        Cache.AddItem(Item.Path, Cached);
+                    }
+
+                    ++this->m_Summary.ItemCount;
+                    this->m_Summary.TotalSize += State.Size;
+                    this->m_Summary.TotalAllocationSize +=
+                        State.AllocationSize;
+                    Progress.AddBytes(State.Size);
+
+                    std::uint32_t Reason = this->GetReason(Item.Path, Match);
+                    Items.Add(std::move(Item.Path), State, Reason);
+                    if (Items.IsFull() &&
+                        !this->SendItems(Items, Results, Remove))
+                    {
+                        CancelScan();
+                        return;
+                    }
+                }
+            };
+            Walker.SetBatchHandler(HandleBatch);
+            Scanner.SetBatchHandler(HandleBatch);
+
+            // The total is not known before the walk, so the scan only
+            // reports 0 and then 100, but the callback can cancel it.
+            Progress.Start([this, &CancelScan](
+                NSudoSweeper::ProgressSnapshot const& Snapshot)
+            {
+                if (!this->SendProgress(Snapshot))
+                {
+                    CancelScan();
+                }
+            });
+
+            bool Completed = false;
+            if (UseScanner)
+            {
+                NSudoSweeper::MftScannerError Error;
+                Completed = Scanner.Scan(Error);
+
+                // A table which cannot be read has not reported any entry.
+                UseScanner = Completed || !Error.Message;
+            }
+            if (!UseScanner)
+            {
+                Completed = Walker.Walk(Roots);
+            }
+
+            if (this->SendItems(Items, Results, Remove) &&
+                Results.Send(this->m_Channel))
+            {
+                Progress.Stop();
+            }
+
+            // The cache of a canceled scan misses the directories it has
+            // not walked, and it is only an optimization.
+            if (UseCache &&
+                Completed &&
+                this->m_Channel.GetResult() == NSUDO_SWEEPER_S_OK)
+            {
+                NSudoSweeper::ScanCacheError Error;
+                Cache.Save(this->m_Request.ScanCachePath, Error);
+            }
+
+            return this->m_Channel.GetResult();
+        }
+
+        NSUDO_SWEEPER_RESULT Estimate()
+        {
+            NSudoSweeper::WalkPlan Plan = this->PlanWalk();
+
+            NSudoSweeper::SizeEstimator Estimator;
+            Estimator.AddFilter([this](
+                Mile::NativeStringView DirectoryPath,
+                Mile::FileEnumeratorEntry const& Entry,
+                std::uint32_t Depth)
+            {
+                Mile::UnreferencedParameter(Depth);
+
+                return this->FilterEntry(DirectoryPath, Entry);
+            });
+
+            // Only keeps the callback called while the estimator works.
+            NSudoSweeper::ProgressAggregatorOptions ProgressOptions;
+            ProgressOptions.Interval = NSudoSweeper::HandlerProgressInterval;
+            ProgressOptions.PublishUnchanged = true;
+            NSudoSweeper::ProgressAggregator Progress(ProgressOptions);
+            Progress.Start([this, &Estimator](
+                NSudoSweeper::ProgressSnapshot const& Snapshot)
+            {
+                if (!this->SendProgress(Snapshot))
+                {
+                    Estimator.Cancel();
+                }
+            });
+
+            Estimator.Estimate(
+                Plan.GetTreeWalkerRoots(),
+                this->m_Request.EstimateTimeBudget
+                    ? std::chrono::milliseconds(
+                        this->m_Request.EstimateTimeBudget)
+                    : DefaultEstimateTimeBudget);
+
+            while (this->m_Channel.GetResult() == NSUDO_SWEEPER_S_OK)
+            {
+                NSudoSweeper::SizeEstimate Current = Estimator.GetEstimate();
+                this->m_Summary.ItemCount = Current.Files;
+                this->m_Summary.TotalSize = Current.DataSize;
+                this->m_Summary.TotalAllocationSize = Current.Size;
+
+                NSUDO_SWEEPER_ESTIMATE Message;
+                Message.Size = Current.Size;
+                Message.LowerBound = Current.LowerBound;
+                Message.UpperBound = Current.UpperBound;
+                Message.ItemCount = Current.Files;
+                Message.Exact = Current.Exact ? 1 : 0;
+                Message.Reserved = 0;
+                if (!this->m_Channel.Send(
+                    NSUDO_SWEEPER_ESTIMATE_MESSAGE,
+                    &Message) ||
+                    Current.Exact)
+                {
+                    break;
+                }
+
+                Estimator.Refine(NSudoSweeper::HandlerProgressInterval);
+            }
+
+            if (this->m_Channel.GetResult() == NSUDO_SWEEPER_S_OK)
+            {
+                Progress.Stop();
+            }
+
+            return this->m_Channel.GetResult();
+        }
+
+        NSUDO_SWEEPER_RESULT Clean()
+        {
+            NSudoSweeper::ResultBatch Results(this->m_BatchSize);
+
+            std::uint64_t Count = this->m_Request.CleanItemCount;
+
+            NSudoSweeper::ProgressAggregatorOptions ProgressOptions;
+            ProgressOptions.Interval = NSudoSweeper::HandlerProgressInterval;
+            ProgressOptions.PublishUnchanged = true;
+            NSudoSweeper::ProgressAggregator Progress(ProgressOptions);
+            Progress.SetTotalWork(Count);
+            Progress.Start([this](
+                NSudoSweeper::ProgressSnapshot const& Snapshot)
+            {
+                this->SendProgress(Snapshot);
+            });
+
+            for (std::uint64_t i = 0; i < Count; ++i)
+            {
+                NSUDO_SWEEPER_ITEM const& Item = this->m_Request.CleanItems[i];
+
+                NSUDO_SWEEPER_CLEAN_RESULT Result;
+                Result.Index = i;
+                Result.Result = NSUDO_SWEEPER_S_OK;
+                Result.SystemError = 0;
+                Result.FreedSize = 0;
+
+                NSudoSweeper::FileState State;
+                Mile::NativeString Path;
+                if (Item.Path)
+                {
+                    Path.assign(Item.Path, Item.PathLength);
+                }
+
+                if (!Item.Path)
+                {
+                    Result.Result = NSUDO_SWEEPER_E_INVALIDARG;
+                }
+                else if (!this->m_Rules.IsSelected(Path))
+                {
+                    // Never remove what the configuration does not select,
+                    // whatever the caller passes.
+                    Result.Result = NSUDO_SWEEPER_E_ITEM_NOT_SELECTED;
+                }
+                else if (int Error = NSudoSweeper::QueryFileState(Path, State))
+                {
+                    Result.Result = NSudoSweeper::IsNotFoundError(Error)
+                        ? NSUDO_SWEEPER_E_ITEM_NOT_FOUND
+                        : NSUDO_SWEEPER_E_FAIL;
+                    Result.SystemError = Error;
+                }
+                else if (State.Size != Item.Size ||
+                    (Item.FileId && Item.FileId != State.FileId))
+                {
+                    Result.Result = NSUDO_SWEEPER_E_ITEM_CHANGED;
+                }
+
+                ++this->m_Summary.ItemCount;
+                if (Result.Result == NSUDO_SWEEPER_S_OK)
+                {
+                    this->m_Summary.TotalSize += State.Size;
+                    this->m_Summary.TotalAllocationSize +=
+                        State.AllocationSize;
+                    this->RemoveItem(Path, State, Result);
+                }
+                else
+                {
+                    ++this->m_Summary.FailedItemCount;
+                }
+
+                NSudoSweeper::ProgressAggregator::Counter Counter =
+                    Progress.GetCounter();
+                if (Result.Result == NSUDO_SWEEPER_S_OK)
+                {
+                    Counter.AddBytes(Result.FreedSize);
+                }
+                else
+                {
+                    Counter.AddErrors();
+                }
+                Counter.AddWork();
+
+                // The publisher may have been canceled by the callback.
+                if (!Results.Add(this->m_Channel, Result) ||
+                    this->m_Channel.GetResult() != NSUDO_SWEEPER_S_OK)
+                {
+                    return this->m_Channel.GetResult();
+                }
+            }
+
+            if (Results.Send(this->m_Channel))
+            {
+                Progress.Stop();
+            }
+
+            return this->m_Channel.GetResult();
+        }
+
+    public:
+
+        StandardHandler(
+            NSUDO_SWEEPER_HANDLER_REQUEST const& Request,
+            NSUDO_SWEEPER_HANDLER_SUMMARY& Summary) :
+            m_Request(Request),
+            m_Summary(Summary),
+            m_Channel(Request.Callback, Request.UserData),
+            m_BatchSize(Request.MaximumBatchSize
+                ? Request.MaximumBatchSize
+                : DefaultBatchSize)
+        {
+        }
+
+        NSUDO_SWEEPER_RESULT Run()
+        {
+            NSudoSweeper::HandlerDescriptorError Error;
+            if (!NSudoSweeper::ParseHandlerDescriptor(
+                NSudoSweeper::ToUtf8String(this->m_Request.Configuration),
+                this->m_Descriptor,
+                Error))
+            {
+                return NSUDO_SWEEPER_E_INVALIDARG;
+            }
+
+            if (this->m_Request.SessionRootPath &&
+                !this->m_Descriptor.OfflineImageSupport)
+            {
+                return NSUDO_SWEEPER_E_NOTIMPL;
+            }
+
+            if (!this->m_Channel.SendProgress(0))
+            {
+                return this->m_Channel.GetResult();
+            }
+
+            if (!this->IsDetected())
+            {
+                this->m_Channel.SendProgress(100);
+                return this->m_Channel.GetResult();
+            }
+
+            for (std::size_t i = 0; i < this->m_Descriptor.Include.size(); ++i)
+            {
+                NSudoSweeper::HandlerRule const& Rule =
+                    this->m_Descriptor.Include[i];
+                if (Rule.Type == NSudoSweeper::HandlerRuleType::File)
+                {
+                    this->m_Includes.push_back(::RebasePath(
+                        Rule.Pattern,
+                        this->m_Request.SessionRootPath));
+                    this->m_IncludeReasons.push_back(
+                        static_cast<std::uint32_t>(i));
+                }
+            }
+            for (NSudoSweeper::HandlerRule const& Rule :
+                this->m_Descriptor.Exclude)
+            {
+                if (Rule.Type == NSudoSweeper::HandlerRuleType::File)
+                {
+                    this->m_Excludes.push_back(::RebasePath(
+                        Rule.Pattern,
+                        this->m_Request.SessionRootPath));
+                }
+            }
+
+            // The Include rules come first, so the index of a rule is the
+            // index of its reason.
+            for (Mile::NativeString const& Include : this->m_Includes)
+            {
+                this->m_Rules.AddRule(
+                    0,
+                    NSudoSweeper::PathRuleKind::Include,
+                    Include);
+            }
+            for (Mile::NativeString const& Exclude : this->m_Excludes)
+            {
+                this->m_Rules.AddRule(
+                    0,
+                    NSudoSweeper::PathRuleKind::Exclude,
+                    Exclude);
+            }
+            this->m_Rules.Compile();
+
+            if (this->m_Request.Phase == NSUDO_SWEEPER_PHASE_ESTIMATE)
+            {
+                return this->Estimate();
+            }
+
+            if (this->m_Request.Phase == NSUDO_SWEEPER_PHASE_CLEAN &&
+                (this->m_Request.Flags & NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS))
+            {
+                return this->Clean();
+            }
+
+            return this->Scan(
+                this->m_Request.Phase == NSUDO_SWEEPER_PHASE_CLEAN);
+        }
+    };
+}
+
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeperStandardCleanupHandlerV2(
+    const NSUDO_SWEEPER_HANDLER_REQUEST* Request,
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary)
+{
+    if (!Request ||
+        Request->Size < sizeof(NSUDO_SWEEPER_HANDLER_REQUEST) ||
+        !Request->Configuration ||
+        !Request->Callback ||
+        Request->Phase > NSUDO_SWEEPER_PHASE_ESTIMATE ||
+        (Request->Flags & ~NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) ||
+        Request->Reserved ||
+        (Request->CleanItemCount && !Request->CleanItems) ||
+        (!(Request->Flags & NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) &&
+            (Request->CleanItems || Request->CleanItemCount)) ||
+        (Summary && Summary->Size < sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY)))
+    {
+        return NSUDO_SWEEPER_E_INVALIDARG;
+    }
+
+    NSUDO_SWEEPER_HANDLER_SUMMARY Totals = {};
+    Totals.Size = sizeof(NSUDO_SWEEPER_HANDLER_SUMMARY);
+
+    NSUDO_SWEEPER_RESULT Result = NSUDO_SWEEPER_S_OK;
+
+    // No exception may cross the interface.
+    try
+    {
+        StandardHandler Handler(*Request, Totals);
+        Result = Handler.Run();
+    }
+    catch (std::bad_alloc const&)
+    {
+        Result = NSUDO_SWEEPER_E_OUTOFMEMORY;
+    }
+    catch (...)
+    {
+        Result = NSUDO_SWEEPER_E_FAIL;
+    }
+
+    if (Summary)
+    {
+        *Summary = Totals;
+    }
+
+    return Result;
+}
@@ -0,0 +1,55 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperStandardHandler.h
+ * PURPOSE:   Definition for the standard cleanup handler
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_STANDARD_HANDLER
+#define NSUDO_SWEEPER_STANDARD_HANDLER
+
+#include "NSudoSweeperHandlerV2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The NSudo Sweeper standard cleanup handler, which is the reference
+ * implementation of the version 2 cleanup handler interface.
+ *
+ * It removes the files selected by the File rules of its configuration
+ * file. The handler is skipped if DetectOS excludes the version of Windows,
+ * which is read from the SOFTWARE hive for an offline image and is unknown
+ * on other platforms, or if no Detect rule matches. A File Detect rule
+ * matches if the path exists, or if the literal directory at the start of
+ * the pattern exists when it has wildcards. A Registry Detect rule matches
+ * if the key exists, which is only checked for the online image on Windows.
+ *
+ * An estimate samples the directories the File rules select within the
+ * time budget, and then counts them exactly, the most uncertain first, until
+ * the estimate is exact or the callback cancels it.
+ *
+ * For an offline image, the drive of each absolute path ("C:\" on Windows,
+ * "/" elsewhere) is replaced by SessionRootPath if the configuration file
+ * sets OfflineImageSupport, otherwise the handler returns
+ * NSUDO_SWEEPER_E_NOTIMPL.
+ *
+ * @param Request The parameters of the handler.
+ * @param Summary A pointer to a structure that receives the totals. It can
+ *                be NULL.
+ * @return NSUDO_SWEEPER_S_OK if the handler succeeds, the value returned by
+ *         the callback if it cancels the handler, otherwise an error.
+ */
+NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API NSudoSweeperStandardCleanupHandlerV2(
+    const NSUDO_SWEEPER_HANDLER_REQUEST* Request,
+    NSUDO_SWEEPER_HANDLER_SUMMARY* Summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !NSUDO_SWEEPER_STANDARD_HANDLER
@@ -0,0 +1,1613 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperToml.cpp
+ * PURPOSE:   Implementation for the TOML document parser
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperToml.h"
+
+#include <charconv>
+#include <limits>
+
+namespace
+{
+    /**
+     * The table is defined by a table header.
+     */
+    const std::uint8_t TableDefined = 0x01;
+
+    /**
+     * The table is created as a parent of a table header, and may be defined
+     * later.
+     */
+    const std::uint8_t TableImplicit = 0x02;
+
+    /**
+     * The table is created by a dotted key.
+     */
+    const std::uint8_t TableDotted = 0x04;
+
+    /**
+     * The table or the array is an inline value, so it cannot be extended.
+     */
+    const std::uint8_t NodeInline = 0x08;
+
+    /**
+     * The array is an array of tables.
+     */
+    const std::uint8_t ArrayOfTables = 0x10;
+
+    /**
+     * The maximum nesting of arrays and inline tables, which bounds the
+     * recursion of the parser.
+     */
+    const std::size_t MaximumNesting = 128;
+
+    bool IsDigit(
+        char Character) noexcept
+    {
+        return Character >= '0' && Character <= '9';
+    }
+
+    bool IsHexDigit(
+        char Character) noexcept
+    {
+        return IsDigit(Character) ||
+            (Character >= 'a' && Character <= 'f') ||
+            (Character >= 'A' && Character <= 'F');
+    }
+
+    bool IsBareKeyCharacter(
+        char Character) noexcept
+    {
+        return IsDigit(Character) ||
+            (Character >= 'a' && Character <= 'z') ||
+            (Character >= 'A' && Character <= 'Z') ||
+            Character == '_' ||
+            Character == '-';
+    }
+
+    bool IsControlCharacter(
+        char Character) noexcept
+    {
+        unsigned char Value = static_cast<unsigned char>(Character);
+        return (Value < 0x20 && Value != '\t') || Value == 0x7F;
+    }
+
+    /**
+     * Checks whether a character ends a value which is not a string, an
+     * array or an inline table.
+     */
+    bool IsValueDelimiter(
+        char Character) noexcept
+    {
+        switch (Character)
+        {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '#':
+        case ',':
+        case ']':
+        case '}':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * Finds the first byte which is not part of a valid UTF-8 sequence.
+     *
+     * @param Source The bytes.
+     * @return The offset of the byte, or the size of the bytes if all of
+     *         them are valid.
+     */
+    std::size_t FindInvalidUtf8(
+        std::string_view Source) noexcept
+    {
+        const unsigned char* Data =
+            reinterpret_cast<const unsigned char*>(Source.data());
+        std::size_t Size = Source.size();
+
+        std::size_t i = 0;
+        while (i < Size)
+        {
+            unsigned char Lead = Data[i];
+            if (Lead < 0x80)
+            {
+                ++i;
+                continue;
+            }
+
+            std::size_t Length = 0;
+            unsigned char Minimum = 0x80;
+            unsigned char Maximum = 0xBF;
+            if (Lead >= 0xC2 && Lead <= 0xDF)
+            {
+                Length = 2;
+            }
+            else if (Lead >= 0xE0 && Lead <= 0xEF)
+            {
+                Length = 3;
+                if (Lead == 0xE0)
+                {
+                    // Overlong encodings.
+                    Minimum = 0xA0;
+                }
+                else if (Lead == 0xED)
+                {
+                    // Surrogates.
+                    Maximum = 0x9F;
+                }
+            }
+            else if (Lead >= 0xF0 && Lead <= 0xF4)
+            {
+                Length = 4;
+                if (Lead == 0xF0)
+                {
+                    Minimum = 0x90;
+                }
+                else if (Lead == 0xF4)
+                {
+                    Maximum = 0x8F;
+                }
+            }
+            else
+            {
+                return i;
+            }
+
+            if (Size - i < Length ||
+                Data[i + 1] < Minimum ||
+                Data[i + 1] > Maximum)
+            {
+                return i;
+            }
+            for (std::size_t j = 2; j < Length; ++j)
+            {
+                if ((Data[i + j] & 0xC0) != 0x80)
+                {
+                    return i;
+                }
+            }
+
+            i += Length;
+        }
+
+        return Size;
+    }
+
+    void AppendUtf8(
+        std::string& Target,
+        std::uint32_t CodePoint)
+    {
+        if (CodePoint < 0x80)
+        {
+            Target.push_back(static_cast<char>(CodePoint));
+        }
+        else if (CodePoint < 0x800)
+        {
+            Target.push_back(static_cast<char>(0xC0 | (CodePoint >> 6)));
+            Target.push_back(static_cast<char>(0x80 | (CodePoint & 0x3F)));
+        }
+        else if (CodePoint < 0x10000)
+        {
+            Target.push_back(static_cast<char>(0xE0 | (CodePoint >> 12)));
+            Target.push_back(
+                static_cast<char>(0x80 | ((CodePoint >> 6) & 0x3F)));
+            Target.push_back(static_cast<char>(0x80 | (CodePoint & 0x3F)));
+        }
+        else
+        {
+            Target.push_back(static_cast<char>(0xF0 | (CodePoint >> 18)));
+            Target.push_back(
+                static_cast<char>(0x80 | ((CodePoint >> 12) & 0x3F)));
+            Target.push_back(
+                static_cast<char>(0x80 | ((CodePoint >> 6) & 0x3F)));
+            Target.push_back(static_cast<char>(0x80 | (CodePoint & 0x3F)));
+        }
+    }
+
+    /**
+     * Reads a fixed number of decimal digits.
+     */
+    bool ReadDigits(
+        std::string_view Text,
+        std::size_t Offset,
+        std::size_t Count,
+        std::uint32_t& Value) noexcept
+    {
+        if (Offset + Count > Text.size())
+        {
+            return false;
+        }
+
+        Value = 0;
+        for (std::size_t i = Offset; i < Offset + Count; ++i)
+        {
+            if (!IsDigit(Text[i]))
+            {
+                return false;
+            }
+            Value = Value * 10 + static_cast<std::uint32_t>(Text[i] - '0');
+        }
+        return true;
+    }
+
+    /**
+     * Checks a time in the form "HH:MM:SS" with an optional fraction.
+     *
+     * @return The length of the time, or 0 if it is not valid.
+     */
+    std::size_t CheckTime(
+        std::string_view Text,
+        std::size_t Offset) noexcept
+    {
+        std::uint32_t Hour = 0;
+        std::uint32_t Minute = 0;
+        std::uint32_t Second = 0;
+        if (!ReadDigits(Text, Offset, 2, Hour) ||
+            Offset + 2 >= Text.size() || Text[Offset + 2] != ':' ||
+            !ReadDigits(Text, Offset + 3, 2, Minute) ||
+            Offset + 5 >= Text.size() || Text[Offset + 5] != ':' ||
+            !ReadDigits(Text, Offset + 6, 2, Second) ||
+            Hour > 23 || Minute > 59 || Second > 60)
+        {
+            return 0;
+        }
+
+        std::size_t End = Offset + 8;
+        if (End < Text.size() && Text[End] == '.')
+        {
+            ++End;
+            std::size_t FractionStart = End;
+            while (End < Text.size() && IsDigit(Text[End]))
+            {
+                ++End;
+            }
+            if (End == FractionStart)
+            {
+                return 0;
+            }
+        }
+
+        return End - Offset;
+    }
+
+    /**
+     * Checks whether a token is an offset date-time, a local date-time, a
+     * local date or a local time.
+     */
+    bool IsDateTime(
+        std::string_view Text) noexcept
+    {
+        if (Text.size() > 2 && Text[2] == ':')
+        {
+            return CheckTime(Text, 0) == Text.size();
+        }
+
+        std::uint32_t Year = 0;
+        std::uint32_t Month = 0;
+        std::uint32_t Day = 0;
+        if (!ReadDigits(Text, 0, 4, Year) ||
+            Text.size() < 10 || Text[4] != '-' ||
+            !ReadDigits(Text, 5, 2, Month) ||
+            Text[7] != '-' ||
+            !ReadDigits(Text, 8, 2, Day) ||
+            Month < 1 || Month > 12 || Day < 1)
+        {
+            return false;
+        }
+
+        static const std::uint32_t DaysInMonth[] =
+        {
+            31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+        };
+        bool LeapYear =
+            (Year % 4 == 0 && Year % 100 != 0) || Year % 400 == 0;
+        if (Day > DaysInMonth[Month - 1] ||
+            (Month == 2 && Day == 29 && !LeapYear))
+        {
+            return false;
+        }
+
+        if (Text.size() == 10)
+        {
+            return true;
+        }
+
+        char Separator = Text[10];
+        if (Separator != 'T' && Separator != 't' && Separator != ' ')
+        {
+            return false;
+        }
+
+        std::size_t TimeLength = CheckTime(Text, 11);
+        if (!TimeLength)
+        {
+            return false;
+        }
+
+        std::size_t Offset = 11 + TimeLength;
+        if (Offset == Text.size())
+        {
+            return true;
+        }
+        if ((Text[Offset] == 'Z' || Text[Offset] == 'z') &&
+            Offset + 1 == Text.size())
+        {
+            return true;
+        }
+
+        std::uint32_t Hour = 0;
+        std::uint32_t Minute = 0;
+        return (Text[Offset] == '+' || Text[Offset] == '-') &&
+            Offset + 6 == Text.size() &&
+            ReadDigits(Text, Offset + 1, 2, Hour) &&
+            Text[Offset + 3] == ':' &&
+            ReadDigits(Text, Offset + 4, 2, Minute) &&
+            Hour <= 23 &&
+            Minute <= 59;
+    }
+
+    /**
+     * Removes the underscores between the digits of a number.
+     *
+     * @param Text The digits, which may contain underscores.
+     * @param Base The base of the digits, or 0 for the digits of a float.
+     * @param Target The buffer which receives the digits.
+     * @return true if every underscore is between two digits and the digits
+     *         are valid, otherwise false.
+     */
+    bool RemoveUnderscores(
+        std::string_view Text,
+        int Base,
+        std::string& Target)
+    {
+        if (Text.empty())
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < Text.size(); ++i)
+        {
+            char Character = Text[i];
+            if (Character == '_')
+            {
+                bool Valid = i > 0 && i + 1 < Text.size();
+                if (Valid)
+                {
+                    char Previous = Text[i - 1];
+                    char Next = Text[i + 1];
+                    Valid = (Base == 16)
+                        ? (IsHexDigit(Previous) && IsHexDigit(Next))
+                        : (IsDigit(Previous) && IsDigit(Next));
+                }
+                if (!Valid)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            bool Valid = false;
+            switch (Base)
+            {
+            case 2:
+                Valid = Character == '0' || Character == '1';
+                break;
+            case 8:
+                Valid = Character >= '0' && Character <= '7';
+                break;
+            case 10:
+                Valid = IsDigit(Character);
+                break;
+            case 16:
+                Valid = IsHexDigit(Character);
+                break;
+            default:
+                Valid = IsDigit(Character) ||
+                    Character == '.' ||
+                    Character == 'e' ||
+                    Character == 'E' ||
+                    Character == '+' ||
+                    Character == '-';
+                break;
+            }
+            if (!Valid)
+            {
+                return false;
+            }
+
+            Target.push_back(Character);
+        }
+
+        return true;
+    }
+
+    /**
+     * Checks the syntax of the digits of a float after the underscores are
+     * removed: an integer part without leading zeros, then a fraction, an
+     * exponent or both.
+     */
+    bool IsFloatSyntax(
+        std::string_view Text) noexcept
+    {
+        std::size_t i = 0;
+        while (i < Text.size() && IsDigit(Text[i]))
+        {
+            ++i;
+        }
+        if (i == 0 || (i > 1 && Text[0] == '0'))
+        {
+            return false;
+        }
+
+        bool HasFraction = false;
+        if (i < Text.size() && Text[i] == '.')
+        {
+            std::size_t Start = ++i;
+            while (i < Text.size() && IsDigit(Text[i]))
+            {
+                ++i;
+            }
+            if (i == Start)
+            {
+                return false;
+            }
+            HasFraction = true;
+        }
+
+        bool HasExponent = false;
+        if (i < Text.size() && (Text[i] == 'e' || Text[i] == 'E'))
+        {
+            ++i;
+            if (i < Text.size() && (Text[i] == '+' || Text[i] == '-'))
+            {
+                ++i;
+            }
+            std::size_t Start = i;
+            while (i < Text.size() && IsDigit(Text[i]))
+            {
+                ++i;
+            }
+            if (i == Start)
+            {
+                return false;
+            }
+            HasExponent = true;
+        }
+
+        return i == Text.size() && (HasFraction || HasExponent);
+    }
+}
+
+struct NSudoSweeper::TomlDocument::Parser
+{
+    TomlDocument& Document;
+    std::string_view Source;
+    TomlParseError& Error;
+    std::size_t Position = 0;
+    std::size_t Line = 1;
+    std::size_t LineStart = 0;
+    std::size_t Nesting = 0;
+    std::vector<std::string_view> KeyPath;
+    std::string Digits;
+
+    Parser(
+        TomlDocument& TargetDocument,
+        std::string_view SourceText,
+        TomlParseError& TargetError) :
+        Document(TargetDocument),
+        Source(SourceText),
+        Error(TargetError)
+    {
+    }
+
+    bool Fail(
+        char const* Message)
+    {
+        this->Error.Line = this->Line;
+        this->Error.Column = this->Position - this->LineStart + 1;
+        this->Error.Message = Message;
+        return false;
+    }
+
+    char Peek(
+        std::size_t Offset = 0) const noexcept
+    {
+        std::size_t Index = this->Position + Offset;
+        return Index < this->Source.size() ? this->Source[Index] : '\0';
+    }
+
+    bool AtEnd() const noexcept
+    {
+        return this->Position >= this->Source.size();
+    }
+
+    TomlNode& GetNode(
+        std::uint32_t Index) noexcept
+    {
+        return this->Document.m_Nodes[Index];
+    }
+
+    std::uint32_t AddNode(
+        TomlType Type,
+        std::uint32_t Parent,
+        std::string_view Key)
+    {
+        TomlNode Node;
+        Node.Type = Type;
+        Node.Flags = 0;
+        Node.Line = static_cast<std::uint32_t>(this->Line);
+        Node.Key = Key;
+        Node.Integer = 0;
+        Node.Float = 0.0;
+        Node.Boolean = false;
+        Node.ChildCount = 0;
+        Node.FirstChild = TomlDocument::InvalidIndex;
+        Node.LastChild = TomlDocument::InvalidIndex;
+        Node.NextSibling = TomlDocument::InvalidIndex;
+
+        std::uint32_t Index =
+            static_cast<std::uint32_t>(this->Document.m_Nodes.size());
+        this->Document.m_Nodes.push_back(Node);
+
+        if (Parent != TomlDocument::InvalidIndex)
+        {
+            TomlNode& ParentNode = this->GetNode(Parent);
+            if (ParentNode.LastChild == TomlDocument::InvalidIndex)
+            {
+                ParentNode.FirstChild = Index;
+            }
+            else
+            {
+                this->GetNode(ParentNode.LastChild).NextSibling = Index;
+            }
+            ParentNode.LastChild = Index;
+            ++ParentNode.ChildCount;
+        }
+
+        return Index;
+    }
+
+    std::uint32_t FindChild(
+        std::uint32_t Table,
+        std::string_view Key) noexcept
+    {
+        std::uint32_t Current = this->GetNode(Table).FirstChild;
+        while (Current != TomlDocument::InvalidIndex)
+        {
+            TomlNode& Node = this->GetNode(Current);
+            if (Node.Key == Key)
+            {
+                return Current;
+            }
+            Current = Node.NextSibling;
+        }
+        return TomlDocument::InvalidIndex;
+    }
+
+    void SkipWhitespace() noexcept
+    {
+        while (!this->AtEnd())
+        {
+            char Character = this->Source[this->Position];
+            if (Character != ' ' && Character != '\t')
+            {
+                break;
+            }
+            ++this->Position;
+        }
+    }
+
+    /**
+     * Consumes a newline, which is "\n" or "\r\n".
+     */
+    bool ParseNewline() noexcept
+    {
+        if (this->Peek() == '\n')
+        {
+            this->Position += 1;
+        }
+        else if (this->Peek() == '\r' && this->Peek(1) == '\n')
+        {
+            this->Position += 2;
+        }
+        else
+        {
+            return false;
+        }
+
+        ++this->Line;
+        this->LineStart = this->Position;
+        return true;
+    }
+
+    /**
+     * Consumes a comment up to the end of the line.
+     */
+    bool SkipComment()
+    {
+        ++this->Position;
+        while (!this->AtEnd())
+        {
+            char Character = this->Source[this->Position];
+            if (Character == '\n' ||
+                (Character == '\r' && this->Peek(1) == '\n'))
+            {
+                break;
+            }
+            if (IsControlCharacter(Character))
+            {
+                return this->Fail("Control character in a comment");
+            }
+            ++this->Position;
+        }
+        return true;
+    }
+
+    /**
+     * Consumes the whitespace, the comments and the newlines between the
+     * elements of an array.
+     */
+    bool SkipBlank()
+    {
+        for (;;)
+        {
+            this->SkipWhitespace();
+            if (this->Peek() == '#')
+            {
+                if (!this->SkipComment())
+                {
+                    return false;
+                }
+            }
+            else if (!this->ParseNewline())
+            {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Parses a basic string. The position is at the opening quotation mark.
+     */
+    bool ParseBasicString(
+        bool Multiline,
+        std::string_view& Value)
+    {
+        if (Multiline)
+        {
+            this->Position += 3;
+
+            // A newline immediately after the opening delimiter is trimmed.
+            this->ParseNewline();
+        }
+        else
+        {
+            this->Position += 1;
+        }
+
+        std::size_t Start = this->Position;
+        std::string* Buffer = nullptr;
+
+        for (;;)
+        {
+            if (this->AtEnd())
+            {
+                return this->Fail("Unterminated string");
+            }
+
+            char Character = this->Source[this->Position];
+
+            if (Character == '"')
+            {
+                std::size_t Quotes = 1;
+                if (Multiline)
+                {
+                    while (Quotes < 6 && this->Peek(Quotes) == '"')
+                    {
+                        ++Quotes;
+                    }
+                    if (Quotes < 3)
+                    {
+                        if (Buffer)
+                        {
+                            Buffer->append(Quotes, '"');
+                        }
+                        this->Position += Quotes;
+                        continue;
+                    }
+                    if (Quotes > 5)
+                    {
+                        return this->Fail("Too many quotation marks");
+                    }
+
+                    // Up to two quotation marks before the closing delimiter
+                    // belong to the string.
+                    Quotes -= 3;
+                    if (Buffer)
+                    {
+                        Buffer->append(Quotes, '"');
+                    }
+                    this->Position += Quotes;
+                }
+
+                Value = Buffer
+                    ? std::string_view(*Buffer)
+                    : this->Source.substr(Start, this->Position - Start);
+                this->Position += Multiline ? 3 : 1;
+                return true;
+            }
+
+            if (Character == '\\')
+            {
+                if (!Buffer)
+                {
+                    Buffer = &this->Document.m_Strings.emplace_back(
+                        this->Source.substr(Start, this->Position - Start));
+                }
+                if (!this->ParseEscape(Multiline, *Buffer))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (Character == '\n' || Character == '\r')
+            {
+                std::size_t NewlineStart = this->Position;
+                if (!Multiline || !this->ParseNewline())
+                {
+                    return this->Fail("Newline in a string");
+                }
+                if (Buffer)
+                {
+                    Buffer->append(
+                        this->Source.substr(
+                            NewlineStart,
+                            this->Position - NewlineStart));
+                }
+                continue;
+            }
+
+            if (IsControlCharacter(Character))
+            {
+                return this->Fail("Control character in a string");
+            }
+
+            if (Buffer)
+            {
+                Buffer->push_back(Character);
+            }
+            ++this->Position;
+        }
+    }
+
+    /**
+     * Parses an escape sequence. The position is at the backslash.
+     */
+    bool ParseEscape(
+        bool Multiline,
+        std::string& Buffer)
+    {
+        ++this->Position;
+
+        char Character = this->Peek();
+        switch (Character)
+        {
+        case 'b':
+            Buffer.push_back('\b');
+            break;
+        case 't':
+            Buffer.push_back('\t');
+            break;
+        case 'n':
+            Buffer.push_back('\n');
+            break;
+        case 'f':
+            Buffer.push_back('\f');
+            break;
+        case 'r':
+            Buffer.push_back('\r');
+            break;
+        case '"':
+            Buffer.push_back('"');
+            break;
+        case '\\':
+            Buffer.push_back('\\');
+            break;
+        case 'u':
+        case 'U':
+        {
+            std::size_t Length = (Character == 'u') ? 4 : 8;
+            std::uint32_t CodePoint = 0;
+            for (std::size_t i = 1; i <= Length; ++i)
+            {
+                char Digit = this->Peek(i);
+                if (!IsHexDigit(Digit))
+                {
+                    return this->Fail("Invalid Unicode escape");
+                }
+                CodePoint = CodePoint * 16 + static_cast<std::uint32_t>(
+                    IsDigit(Digit) ? Digit - '0' : (Digit | 0x20) - 'a' + 10);
+            }
+            if (CodePoint > 0x10FFFF ||
+                (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))
+            {
+                return this->Fail("Invalid Unicode scalar value");
+            }
+            ::AppendUtf8(Buffer, CodePoint);
+            this->Position += Length;
+            break;
+        }
+        default:
+        {
+            if (!Multiline)
+            {
+                return this->Fail("Invalid escape sequence");
+            }
+
+            // A line ending backslash trims the newline and the whitespace
+            // after it.
+            this->SkipWhitespace();
+            if (!this->ParseNewline())
+            {
+                return this->Fail("Invalid escape sequence");
+            }
+            for (;;)
+            {
+                this->SkipWhitespace();
+                if (!this->ParseNewline())
+                {
+                    break;
+                }
+            }
+            return true;
+        }
+        }
+
+        ++this->Position;
+        return true;
+    }
+
+    /**
+     * Parses a literal string. The position is at the opening apostrophe.
+     */
+    bool ParseLiteralString(
+        bool Multiline,
+        std::string_view& Value)
+    {
+        if (Multiline)
+        {
+            this->Position += 3;
+            this->ParseNewline();
+        }
+        else
+        {
+            this->Position += 1;
+        }
+
+        std::size_t Start = this->Position;
+
+        for (;;)
+        {
+            if (this->AtEnd())
+            {
+                return this->Fail("Unterminated string");
+            }
+
+            char Character = this->Source[this->Position];
+
+            if (Character == '\'')
+            {
+                std::size_t Quotes = 1;
+                if (Multiline)
+                {
+                    while (Quotes < 6 && this->Peek(Quotes) == '\'')
+                    {
+                        ++Quotes;
+                    }
+                    if (Quotes < 3)
+                    {
+                        this->Position += Quotes;
+                        continue;
+                    }
+                    if (Quotes > 5)
+                    {
+                        return this->Fail("Too many apostrophes");
+                    }
+                    this->Position += Quotes - 3;
+                }
+
+                Value = this->Source.substr(Start, this->Position - Start);
+                this->Position += Multiline ? 3 : 1;
+                return true;
+            }
+
+            if (Character == '\n' || Character == '\r')
+            {
+                if (!Multiline || !this->ParseNewline())
+                {
+                    return this->Fail("Newline in a string");
+                }
+                continue;
+            }
+
+            if (IsControlCharacter(Character))
+            {
+                return this->Fail("Control character in a string");
+            }
+
+            ++this->Position;
+        }
+    }
+
+    bool ParseSimpleKey(
+        std::string_view& Key)
+    {
+        char Character = this->Peek();
+        if (Character == '"')
+        {
+            return this->ParseBasicString(false, Key);
+        }
+        if (Character == '\'')
+        {
+            return this->ParseLiteralString(false, Key);
+        }
+
+        std::size_t Start = this->Position;
+        while (!this->AtEnd() &&
+            ::IsBareKeyCharacter(this->Source[this->Position]))
+        {
+            ++this->Position;
+        }
+        if (this->Position == Start)
+        {
+            return this->Fail("Invalid key");
+        }
+
+        Key = this->Source.substr(Start, this->Position - Start);
+        return true;
+    }
+
+    /**
+     * Parses a key, which may be a dotted key, into the key path.
+     */
+    bool ParseKey()
+    {
+        this->KeyPath.clear();
+        for (;;)
+        {
+            this->SkipWhitespace();
+
+            std::string_view Key;
+            if (!this->ParseSimpleKey(Key))
+            {
+                return false;
+            }
+            this->KeyPath.push_back(Key);
+
+            this->SkipWhitespace();
+            if (this->Peek() != '.')
+            {
+                return true;
+            }
+            ++this->Position;
+        }
+    }
+
+    bool ParseKeyValue(
+        std::uint32_t Table)
+    {
+        if (!this->ParseKey())
+        {
+            return false;
+        }
+
+        // Each part of a dotted key before the last one names a table, which
+        // is created unless a previous dotted key has created it.
+        std::uint32_t Current = Table;
+        for (std::size_t i = 0; i + 1 < this->KeyPath.size(); ++i)
+        {
+            std::uint32_t Child = this->FindChild(Current, this->KeyPath[i]);
+            if (Child == TomlDocument::InvalidIndex)
+            {
+                Child = this->AddNode(
+                    TomlType::Table,
+                    Current,
+                    this->KeyPath[i]);
+                this->GetNode(Child).Flags = TableDotted;
+            }
+            else
+            {
+                TomlNode& Node = this->GetNode(Child);
+                if (Node.Type != TomlType::Table ||
+                    !(Node.Flags & TableDotted))
+                {
+                    return this->Fail("Cannot add keys to a defined value");
+                }
+            }
+            Current = Child;
+        }
+
+        std::string_view Key = this->KeyPath.back();
+        if (this->FindChild(Current, Key) != TomlDocument::InvalidIndex)
+        {
+            return this->Fail("Duplicate key");
+        }
+
+        if (this->Peek() != '=')
+        {
+            return this->Fail("Expected '='");
+        }
+        ++this->Position;
+        this->SkipWhitespace();
+
+        return this->ParseValue(
+            this->AddNode(TomlType::String, Current, Key));
+    }
+
+    bool ParseTableHeader(
+        std::uint32_t& Current)
+    {
+        bool IsArray = this->Peek(1) == '[';
+        this->Position += IsArray ? 2 : 1;
+
+        if (!this->ParseKey())
+        {
+            return false;
+        }
+        if (this->Peek() != ']' || (IsArray && this->Peek(1) != ']'))
+        {
+            return this->Fail("Expected ']'");
+        }
+        this->Position += IsArray ? 2 : 1;
+
+        std::uint32_t Table = 0;
+        for (std::size_t i = 0; i + 1 < this->KeyPath.size(); ++i)
+        {
+            std::uint32_t Child = this->FindChild(Table, this->KeyPath[i]);
+            if (Child == TomlDocument::InvalidIndex)
+            {
+                Child = this->AddNode(
+                    TomlType::Table,
+                    Table,
+                    this->KeyPath[i]);
+                this->GetNode(Child).Flags = TableImplicit;
+            }
+            else
+            {
+                TomlNode& Node = this->GetNode(Child);
+                if (Node.Type == TomlType::Array &&
+                    (Node.Flags & ArrayOfTables))
+                {
+                    // A header below an array of tables extends its last
+                    // element.
+                    Child = Node.LastChild;
+                }
+                else if (Node.Type != TomlType::Table ||
+                    (Node.Flags & NodeInline))
+                {
+                    return this->Fail("Cannot extend a defined value");
+                }
+            }
+            Table = Child;
+        }
+
+        std::string_view Key = this->KeyPath.back();
+        std::uint32_t Child = this->FindChild(Table, Key);
+
+        if (IsArray)
+        {
+            if (Child == TomlDocument::InvalidIndex)
+            {
+                Child = this->AddNode(TomlType::Array, Table, Key);
+                this->GetNode(Child).Flags = ArrayOfTables;
+            }
+            else
+            {
+                TomlNode& Node = this->GetNode(Child);
+                if (Node.Type != TomlType::Array ||
+                    !(Node.Flags & ArrayOfTables))
+                {
+                    return this->Fail("Cannot extend a defined value");
+                }
+            }
+
+            Current = this->AddNode(
+                TomlType::Table,
+                Child,
+                std::string_view());
+            this->GetNode(Current).Flags = TableDefined;
+            return true;
+        }
+
+        if (Child == TomlDocument::InvalidIndex)
+        {
+            Child = this->AddNode(TomlType::Table, Table, Key);
+        }
+        else
+        {
+            TomlNode& Node = this->GetNode(Child);
+            if (Node.Type != TomlType::Table || Node.Flags != TableImplicit)
+            {
+                return this->Fail("Table is defined more than once");
+            }
+            Node.Line = static_cast<std::uint32_t>(this->Line);
+        }
+        this->GetNode(Child).Flags = TableDefined;
+
+        Current = Child;
+        return true;
+    }
+
+    bool ParseArray(
+        std::uint32_t Node)
+    {
+        this->GetNode(Node).Type = TomlType::Array;
+        ++this->Position;
+
+        for (;;)
+        {
+            if (!this->SkipBlank())
+            {
+                return false;
+            }
+            if (this->Peek() == ']')
+            {
+                break;
+            }
+
+            if (!this->ParseValue(this->AddNode(
+                TomlType::String,
+                Node,
+                std::string_view())))
+            {
+                return false;
+            }
+
+            if (!this->SkipBlank())
+            {
+                return false;
+            }
+            if (this->Peek() == ',')
+            {
+                ++this->Position;
+                continue;
+            }
+            if (this->Peek() != ']')
+            {
+                return this->Fail("Expected ',' or ']'");
+            }
+            break;
+        }
+
+        ++this->Position;
+        this->GetNode(Node).Flags = NodeInline;
+        return true;
+    }
+
+    bool ParseInlineTable(
+        std::uint32_t Node)
+    {
+        this->GetNode(Node).Type = TomlType::Table;
+        ++this->Position;
+
+        this->SkipWhitespace();
+        if (this->Peek() != '}')
+        {
+            for (;;)
+            {
+                if (!this->ParseKeyValue(Node))
+                {
+                    return false;
+                }
+
+                this->SkipWhitespace();
+                if (this->Peek() == ',')
+                {
+                    ++this->Position;
+                    continue;
+                }
+                if (this->Peek() != '}')
+                {
+                    return this->Fail("Expected ',' or '}'");
+                }
+                break;
+            }
+        }
+
+        ++this->Position;
+        this->GetNode(Node).Flags = NodeInline;
+        return true;
+    }
+
+    bool ParseKeyword(
+        std::string_view Keyword)
+    {
+        if (this->Source.substr(this->Position, Keyword.size()) != Keyword)
+        {
+            return false;
+        }
+        char Next = this->Peek(Keyword.size());
+        if (Next != '\0' && !::IsValueDelimiter(Next))
+        {
+            return false;
+        }
+        this->Position += Keyword.size();
+        return true;
+    }
+
+    bool ParseNumberOrDateTime(
+        std::uint32_t Node)
+    {
+        std::size_t Start = this->Position;
+        while (!this->AtEnd() &&
+            !::IsValueDelimiter(this->Source[this->Position]))
+        {
+            ++this->Position;
+        }
+
+        // A date and a time may be separated by a space.
+        if (this->Position - Start == 10 &&
+            this->Peek() == ' ' &&
+            ::IsDigit(this->Peek(1)) &&
+            ::IsDigit(this->Peek(2)) &&
+            this->Peek(3) == ':' &&
+            ::IsDateTime(this->Source.substr(Start, 10)))
+        {
+            ++this->Position;
+            while (!this->AtEnd() &&
+                !::IsValueDelimiter(this->Source[this->Position]))
+            {
+                ++this->Position;
+            }
+        }
+
+        std::string_view Token =
+            this->Source.substr(Start, this->Position - Start);
+        TomlNode& Value = this->GetNode(Node);
+
+        if (::IsDateTime(Token))
+        {
+            Value.Type = TomlType::DateTime;
+            Value.String = Token;
+            return true;
+        }
+
+        bool Negative = false;
+        std::string_view Number = Token;
+        if (!Number.empty() && (Number[0] == '+' || Number[0] == '-'))
+        {
+            Negative = Number[0] == '-';
+            Number.remove_prefix(1);
+        }
+
+        if (Number == "inf" || Number == "nan")
+        {
+            Value.Type = TomlType::Float;
+            Value.Float = (Number == "inf")
+                ? std::numeric_limits<double>::infinity()
+                : std::numeric_limits<double>::quiet_NaN();
+            if (Negative)
+            {
+                Value.Float = -Value.Float;
+            }
+            return true;
+        }
+
+        int Base = 10;
+        if (Number.size() > 2 && Number[0] == '0')
+        {
+            switch (Number[1])
+            {
+            case 'x':
+                Base = 16;
+                break;
+            case 'o':
+                Base = 8;
+                break;
+            case 'b':
+                Base = 2;
+                break;
+            default:
+                break;
+            }
+        }
+
+        this->Digits.clear();
+
+        if (Base != 10)
+        {
+            if (Number.size() != Token.size())
+            {
+                this->Position = Start;
+                return this->Fail("Sign before a prefixed integer");
+            }
+
+            std::uint64_t Result = 0;
+            if (!::RemoveUnderscores(Number.substr(2), Base, this->Digits) ||
+                std::from_chars(
+                    this->Digits.data(),
+                    this->Digits.data() + this->Digits.size(),
+                    Result,
+                    Base).ec != std::errc() ||
+                Result > static_cast<std::uint64_t>(INT64_MAX))
+            {
+                this->Position = Start;
+                return this->Fail("Invalid integer");
+            }
+
+            Value.Type = TomlType::Integer;
+            Value.Integer = static_cast<std::int64_t>(Result);
+            return true;
+        }
+
+        if (Negative)
+        {
+            this->Digits.push_back('-');
+        }
+
+        bool IsFloat =
+            Number.find_first_of(".eE") != std::string_view::npos;
+        if (!::RemoveUnderscores(Number, IsFloat ? 0 : 10, this->Digits))
+        {
+            this->Position = Start;
+            return this->Fail("Invalid number");
+        }
+
+        char const* First = this->Digits.data();
+        char const* Last = First + this->Digits.size();
+
+        if (IsFloat)
+        {
+            if (!::IsFloatSyntax(std::string_view(
+                First + (Negative ? 1 : 0),
+                this->Digits.size() - (Negative ? 1 : 0))) ||
+                std::from_chars(First, Last, Value.Float).ptr != Last)
+            {
+                this->Position = Start;
+                return this->Fail("Invalid float");
+            }
+            Value.Type = TomlType::Float;
+            return true;
+        }
+
+        if ((Number.size() > 1 && Number[0] == '0') ||
+            std::from_chars(First, Last, Value.Integer).ec != std::errc())
+        {
+            this->Position = Start;
+            return this->Fail("Invalid integer");
+        }
+        Value.Type = TomlType::Integer;
+        return true;
+    }
+
+    bool ParseValue(
+        std::uint32_t Node)
+    {
+        char Character = this->Peek();
+
+        if (Character == '"' || Character == '\'')
+        {
+            bool Multiline =
+                this->Peek(1) == Character && this->Peek(2) == Character;
+
+            std::string_view Value;
+            bool Result = (Character == '"')
+                ? this->ParseBasicString(Multiline, Value)
+                : this->ParseLiteralString(Multiline, Value);
+            if (Result)
+            {
+                TomlNode& String = this->GetNode(Node);
+                String.Type = TomlType::String;
+                String.String = Value;
+            }
+            return Result;
+        }
+
+        if (Character == '[' || Character == '{')
+        {
+            if (this->Nesting >= MaximumNesting)
+            {
+                return this->Fail("Values are nested too deeply");
+            }
+
+            ++this->Nesting;
+            bool Result = (Character == '[')
+                ? this->ParseArray(Node)
+                : this->ParseInlineTable(Node);
+            --this->Nesting;
+            return Result;
+        }
+
+        if (Character == 't' || Character == 'f')
+        {
+            bool Value = Character == 't';
+            if (!this->ParseKeyword(Value ? "true" : "false"))
+            {
+                return this->Fail("Invalid value");
+            }
+            TomlNode& Boolean = this->GetNode(Node);
+            Boolean.Type = TomlType::Boolean;
+            Boolean.Boolean = Value;
+            return true;
+        }
+
+        if (::IsDigit(Character) ||
+            Character == '+' ||
+            Character == '-' ||
+            Character == 'i' ||
+            Character == 'n')
+        {
+            return this->ParseNumberOrDateTime(Node);
+        }
+
+        return this->Fail("Invalid value");
+    }
+
+    bool ParseDocument()
+    {
+        if (this->Source.substr(0, 3) == "\xEF\xBB\xBF")
+        {
+            this->Position = 3;
+            this->LineStart = 3;
+        }
+
+        std::size_t InvalidOffset = ::FindInvalidUtf8(this->Source);
+        if (InvalidOffset != this->Source.size())
+        {
+            for (std::size_t i = 0; i < InvalidOffset; ++i)
+            {
+                if (this->Source[i] == '\n')
+                {
+                    ++this->Line;
+                    this->LineStart = i + 1;
+                }
+            }
+            this->Position = InvalidOffset;
+            return this->Fail("Invalid UTF-8 sequence");
+        }
+
+        std::uint32_t Current = this->AddNode(
+            TomlType::Table,
+            TomlDocument::InvalidIndex,
+            std::string_view());
+        this->GetNode(Current).Flags = TableDefined;
+
+        for (;;)
+        {
+            this->SkipWhitespace();
+            if (this->AtEnd())
+            {
+                return true;
+            }
+
+            char Character = this->Peek();
+            if (Character == '[')
+            {
+                if (!this->ParseTableHeader(Current))
+                {
+                    return false;
+                }
+            }
+            else if (Character != '#' &&
+                Character != '\n' &&
+                Character != '\r')
+            {
+                if (!this->ParseKeyValue(Current))
+                {
+                    return false;
+                }
+            }
+
+            this->SkipWhitespace();
+            if (this->Peek() == '#' && !this->SkipComment())
+            {
+                return false;
+            }
+            if (this->AtEnd())
+            {
+                return true;
+            }
+            if (!this->ParseNewline())
+            {
+                return this->Fail("Expected a newline");
+            }
+        }
+    }
+};
+
+bool NSudoSweeper::TomlDocument::Parse(
+    std::string_view Source,
+    TomlParseError& Error)
+{
+    this->Clear();
+    Error = TomlParseError();
+
+    if (Source.size() >= InvalidIndex)
+    {
+        Error.Message = "Document is too large";
+        return false;
+    }
+
+    // Most nodes come from lines, so it saves the reallocations of the node
+    // array for typical documents.
+    this->m_Nodes.reserve(Source.size() / 32 + 16);
+
+    Parser Context(*this, Source, Error);
+    if (!Context.ParseDocument())
+    {
+        this->Clear();
+        return false;
+    }
+
+    return true;
+}
+
+void NSudoSweeper::TomlDocument::Clear() noexcept
+{
+    this->m_Nodes.clear();
+    this->m_Strings.clear();
+}
+
+NSudoSweeper::TomlNode const*
+NSudoSweeper::TomlDocument::GetRoot() const noexcept
+{
+    return this->m_Nodes.empty() ? nullptr : &this->m_Nodes[0];
+}
+
+NSudoSweeper::TomlNode const* NSudoSweeper::TomlDocument::GetChild(
+    TomlNode const* Table,
+    std::string_view Key) const noexcept
+{
+    if (!Table || Table->Type != TomlType::Table)
+    {
+        return nullptr;
+    }
+
+    for (TomlNode const* Child = this->GetFirstChild(Table);
+        Child;
+        Child = this->GetNextSibling(Child))
+    {
+        if (Child->Key == Key)
+        {
+            return Child;
+        }
+    }
+
+    return nullptr;
+}
+
+NSudoSweeper::TomlNode const* NSudoSweeper::TomlDocument::GetFirstChild(
+    TomlNode const* Node) const noexcept
+{
+    if (!Node || Node->FirstChild == InvalidIndex)
+    {
+        return nullptr;
+    }
+    return &this->m_Nodes[Node->FirstChild];
+}
+
+NSudoSweeper::TomlNode const* NSudoSweeper::TomlDocument::GetNextSibling(
+    TomlNode const* Node) const noexcept
+{
+    if (!Node || Node->NextSibling == InvalidIndex)
+    {
+        return nullptr;
+    }
+    return &this->m_Nodes[Node->NextSibling];
+}
+
+std::size_t NSudoSweeper::TomlDocument::GetNodeCount() const noexcept
+{
+    return this->m_Nodes.size();
+}
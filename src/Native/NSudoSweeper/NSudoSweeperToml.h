@@ -0,0 +1,214 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperToml.h
+ * PURPOSE:   Definition for the TOML document parser
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_TOML
+#define NSUDO_SWEEPER_TOML
+
+#include <Mile.Portable.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * The type of a TOML node.
+     */
+    enum class TomlType : std::uint8_t
+    {
+        Table,
+        Array,
+        String,
+        Integer,
+        Float,
+        Boolean,
+        DateTime,
+    };
+
+    /**
+     * A node of a parsed TOML document. The nodes of a document are stored
+     * in one array and linked by indexes, so parsing a document needs a few
+     * allocations only.
+     */
+    struct TomlNode
+    {
+        /**
+         * The type of the node.
+         */
+        TomlType Type;
+
+        /**
+         * The internal state used while parsing the document.
+         */
+        std::uint8_t Flags;
+
+        /**
+         * The line of the node in the document, starting from 1.
+         */
+        std::uint32_t Line;
+
+        /**
+         * The key of the node. It is empty for the root and the elements of
+         * arrays.
+         */
+        std::string_view Key;
+
+        /**
+         * The value of a String node, or the text of a DateTime node. It is
+         * encoded in UTF-8.
+         */
+        std::string_view String;
+
+        /**
+         * The value of an Integer node.
+         */
+        std::int64_t Integer;
+
+        /**
+         * The value of a Float node.
+         */
+        double Float;
+
+        /**
+         * The value of a Boolean node.
+         */
+        bool Boolean;
+
+        /**
+         * The number of children of a Table or Array node.
+         */
+        std::uint32_t ChildCount;
+
+        /**
+         * The indexes of the first and the last children, and of the next
+         * sibling of the node.
+         */
+        std::uint32_t FirstChild;
+        std::uint32_t LastChild;
+        std::uint32_t NextSibling;
+    };
+
+    /**
+     * The position and the reason of a TOML parsing error.
+     */
+    struct TomlParseError
+    {
+        /**
+         * The line of the error, starting from 1.
+         */
+        std::size_t Line = 0;
+
+        /**
+         * The column of the error in bytes, starting from 1.
+         */
+        std::size_t Column = 0;
+
+        /**
+         * The description of the error, or nullptr if there is no error.
+         */
+        char const* Message = nullptr;
+    };
+
+    /**
+     * A parsed TOML v1.0.0 document.
+     *
+     * The strings and the keys without escape sequences refer to the source
+     * directly, so the source must outlive the document. A memory-mapped
+     * file can be parsed without copying it. Date and time values are
+     * validated and kept as text.
+     */
+    class TomlDocument : Mile::DisableCopyConstruction
+    {
+    public:
+
+        /**
+         * The index which refers to no node.
+         */
+        static const std::uint32_t InvalidIndex = UINT32_MAX;
+
+    private:
+
+        struct Parser;
+
+        std::vector<TomlNode> m_Nodes;
+        std::deque<std::string> m_Strings;
+
+    public:
+
+        /**
+         * Parses a document and replaces the content of this one.
+         *
+         * @param Source The document, encoded in UTF-8. A byte order mark is
+         *               skipped.
+         * @param Error The position and the reason of the error if the
+         *              document is not valid.
+         * @return true if the document is valid, otherwise false, and this
+         *         document is empty.
+         */
+        bool Parse(
+            std::string_view Source,
+            TomlParseError& Error);
+
+        /**
+         * Empties the document.
+         */
+        void Clear() noexcept;
+
+        /**
+         * Retrieves the root table.
+         *
+         * @return The root table, or nullptr if the document is empty.
+         */
+        TomlNode const* GetRoot() const noexcept;
+
+        /**
+         * Retrieves a child of a table by its key.
+         *
+         * @param Table The table.
+         * @param Key The key of the child.
+         * @return The child, or nullptr if the node is not a table or has no
+         *         such child.
+         */
+        TomlNode const* GetChild(
+            TomlNode const* Table,
+            std::string_view Key) const noexcept;
+
+        /**
+         * Retrieves the first child of a table or an array.
+         *
+         * @param Node The table or the array.
+         * @return The first child, or nullptr if there is no child.
+         */
+        TomlNode const* GetFirstChild(
+            TomlNode const* Node) const noexcept;
+
+        /**
+         * Retrieves the next sibling of a node.
+         *
+         * @param Node The node.
+         * @return The next sibling, or nullptr if it is the last one.
+         */
+        TomlNode const* GetNextSibling(
+            TomlNode const* Node) const noexcept;
+
+        /**
+         * Retrieves the number of nodes, which includes the root.
+         *
+         * @return The number of nodes.
+         */
+        std::size_t GetNodeCount() const noexcept;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_TOML
@@ -0,0 +1,555 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperTreeWalker.cpp
+ * PURPOSE:   Implementation for the parallel directory tree walker
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+#include "NSudoSweeperVolume.h"
+
+#include <utility>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+struct NSudoSweeper::TreeWalker::PendingDirectory
+{
+    Mile::NativeString Path;
+    std::uint32_t Depth;
+    std::uint32_t MaximumDepth;
+};
+
+struct NSudoSweeper::TreeWalker::Volume
+{
+    Mile::NativeString Key;
+    Mile::Mutex Mutex;
+    std::vector<PendingDirectory> Pending;
+    std::size_t ActiveWorkers = 0;
+    std::size_t MaximumWorkers = 1;
+};
+
+namespace
+{
+    /**
+     * Checks whether a link points to a directory.
+     */
+    bool IsDirectoryLink(
+        Mile::FileEnumeratorEntry const& Entry,
+        Mile::NativeString const& Path)
+    {
+#if defined(_WIN32)
+        Mile::UnreferencedParameter(Path);
+        return 0 != (Entry.GetAttributes() & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        Mile::UnreferencedParameter(Entry);
+        struct stat Status;
+        return 0 == ::stat(Path.c_str(), &Status) && S_ISDIR(Status.st_mode);
+#endif
+    }
+
+#if !defined(_WIN32)
+    /**
+     * Queries an entry relative to the descriptor of its directory, which
+     * does not resolve the path of the directory again. The name of the
+     * entry is null-terminated in the buffer of the enumerator.
+     */
+    bool QueryEntryStatus(
+        Mile::FileEnumerator const& Enumerator,
+        Mile::FileEnumeratorEntry const& Entry,
+        struct stat& Status)
+    {
+        return 0 == ::fstatat(
+            Enumerator.GetHandle(),
+            Entry.GetName().data(),
+            &Status,
+            AT_SYMLINK_NOFOLLOW);
+    }
+
+    Mile::FileEntryType GetEntryType(
+        struct stat const& Status)
+    {
+        if (S_ISREG(Status.st_mode))
+        {
+            return Mile::FileEntryType::File;
+        }
+        if (S_ISDIR(Status.st_mode))
+        {
+            return Mile::FileEntryType::Directory;
+        }
+        if (S_ISLNK(Status.st_mode))
+        {
+            return Mile::FileEntryType::Link;
+        }
+        return Mile::FileEntryType::Other;
+    }
+#endif
+}
+
+NSudoSweeper::TreeWalker::TreeWalker(
+    Mile::ThreadPool& Pool,
+    TreeWalkerOptions const& Options) :
+    m_Pool(Pool),
+    m_Options(Options)
+{
+    if (!this->m_Options.MaximumConcurrencyPerVolume)
+    {
+        this->m_Options.MaximumConcurrencyPerVolume =
+            this->m_Pool.GetNumberOfThreads();
+    }
+    if (!this->m_Options.MaximumConcurrencyPerVolume)
+    {
+        this->m_Options.MaximumConcurrencyPerVolume = 1;
+    }
+    if (!this->m_Options.BatchSize)
+    {
+        this->m_Options.BatchSize = 1;
+    }
+}
+
+void NSudoSweeper::TreeWalker::AddFilter(
+    TreeWalkerFilter Filter)
+{
+    this->m_Filters.push_back(std::move(Filter));
+}
+
+void NSudoSweeper::TreeWalker::SetDirectoryFilter(
+    TreeWalkerDirectoryFilter Filter)
+{
+    this->m_DirectoryFilter = std::move(Filter);
+}
+
+void NSudoSweeper::TreeWalker::SetDirectoryHandler(
+    TreeWalkerDirectoryHandler Handler)
+{
+    this->m_DirectoryHandler = std::move(Handler);
+}
+
+void NSudoSweeper::TreeWalker::SetBatchHandler(
+    TreeWalkerBatchHandler Handler)
+{
+    this->m_BatchHandler = std::move(Handler);
+}
+
+void NSudoSweeper::TreeWalker::SetErrorHandler(
+    TreeWalkerErrorHandler Handler)
+{
+    this->m_ErrorHandler = std::move(Handler);
+}
+
+void NSudoSweeper::TreeWalker::StartWorker(
+    std::shared_ptr<Volume> const& Target)
+{
+    this->m_Pool.Submit(*this->m_Group, [this, Target]()
+    {
+        this->WorkerMain(Target);
+    });
+}
+
+void NSudoSweeper::TreeWalker::WorkerMain(
+    std::shared_ptr<Volume> const& Target)
+{
+    Mile::FileEnumerator Enumerator(this->m_Options.EnumeratorBufferSize);
+
+    std::vector<PendingDirectory> Local;
+    std::vector<PendingDirectory> Subdirectories;
+    std::vector<TreeWalkerItem> Batch;
+    Batch.reserve(this->m_Options.BatchSize);
+
+    for (;;)
+    {
+        const bool Canceled =
+            this->m_Canceled.load(std::memory_order_relaxed) ||
+            this->m_Group->IsCanceled();
+
+        if (Local.empty() || Canceled)
+        {
+            Mile::AutoLock<Mile::Mutex> Lock(Target->Mutex);
+
+            // Leave under the lock, so a worker which shares directories
+            // either sees this worker as active or starts a new one.
+            if (Target->Pending.empty() || Canceled)
+            {
+                --Target->ActiveWorkers;
+                break;
+            }
+
+            Local.push_back(std::move(Target->Pending.back()));
+            Target->Pending.pop_back();
+        }
+
+        PendingDirectory Current = std::move(Local.back());
+        Local.pop_back();
+
+        Subdirectories.clear();
+        if (!this->ProvideDirectory(Current, Subdirectories, Batch))
+        {
+            this->EnumerateDirectory(
+                Enumerator,
+                Current,
+                Subdirectories,
+                Batch);
+        }
+
+        // Push in reverse order, so the first subdirectory is walked next.
+        for (auto Iterator = Subdirectories.rbegin();
+            Iterator != Subdirectories.rend();
+            ++Iterator)
+        {
+            Local.push_back(std::move(*Iterator));
+        }
+
+        if (Local.size() > 1)
+        {
+            bool StartAnotherWorker = false;
+
+            {
+                Mile::AutoLock<Mile::Mutex> Lock(Target->Mutex);
+
+                if (Target->ActiveWorkers < Target->MaximumWorkers)
+                {
+                    // The oldest directories are the closest to the root, so
+                    // they are likely the largest subtrees.
+                    const std::size_t SharedCount = Local.size() / 2;
+                    for (std::size_t i = 0; i < SharedCount; ++i)
+                    {
+                        Target->Pending.push_back(std::move(Local[i]));
+                    }
+                    Local.erase(Local.begin(), Local.begin() + SharedCount);
+
+                    ++Target->ActiveWorkers;
+                    StartAnotherWorker = true;
+                }
+            }
+
+            if (StartAnotherWorker)
+            {
+                this->StartWorker(Target);
+            }
+        }
+    }
+
+    this->DeliverBatch(Batch);
+}
+
+bool NSudoSweeper::TreeWalker::ProvideDirectory(
+    PendingDirectory const& Directory,
+    std::vector<PendingDirectory>& Subdirectories,
+    std::vector<TreeWalkerItem>& Batch)
+{
+    if (!this->m_DirectoryFilter || Directory.Depth >= Directory.MaximumDepth)
+    {
+        return false;
+    }
+
+    std::vector<TreeWalkerItem> Items;
+    std::vector<Mile::NativeString> Paths;
+    if (!this->m_DirectoryFilter(
+        Directory.Path,
+        Directory.Depth,
+        Items,
+        Paths))
+    {
+        return false;
+    }
+
+    this->m_ProvidedDirectories.fetch_add(1, std::memory_order_relaxed);
+
+    for (Mile::NativeString& Path : Paths)
+    {
+        Subdirectories.push_back(
+            PendingDirectory{
+                std::move(Path),
+                Directory.Depth + 1,
+                Directory.MaximumDepth });
+    }
+
+    for (TreeWalkerItem& Item : Items)
+    {
+        Item.Depth = Directory.Depth;
+        Batch.push_back(std::move(Item));
+
+        if (Batch.size() >= this->m_Options.BatchSize)
+        {
+            this->DeliverBatch(Batch);
+        }
+    }
+
+    return true;
+}
+
+void NSudoSweeper::TreeWalker::EnumerateDirectory(
+    Mile::FileEnumerator& Enumerator,
+    PendingDirectory const& Directory,
+    std::vector<PendingDirectory>& Subdirectories,
+    std::vector<TreeWalkerItem>& Batch)
+{
+    if (!Enumerator.Open(Directory.Path))
+    {
+        this->m_Errors.fetch_add(1, std::memory_order_relaxed);
+        if (this->m_ErrorHandler)
+        {
+            Mile::AutoLock<Mile::Mutex> Lock(this->m_HandlerMutex);
+            this->m_ErrorHandler(
+                Directory.Path,
+                Enumerator.GetLastErrorCode());
+        }
+        return;
+    }
+
+    this->m_Directories.fetch_add(1, std::memory_order_relaxed);
+
+    const bool CanDescend = Directory.Depth < Directory.MaximumDepth;
+    std::uint64_t Entries = 0;
+
+    Mile::FileEnumeratorBatch EntryBatch;
+    while (Enumerator.NextBatch(EntryBatch))
+    {
+        for (Mile::FileEnumeratorEntry Entry : EntryBatch)
+        {
+            ++Entries;
+
+            TreeWalkerFilterResult Decision = TreeWalkerFilterResult::Include;
+            for (TreeWalkerFilter const& Filter : this->m_Filters)
+            {
+                Decision = Filter(Directory.Path, Entry, Directory.Depth);
+                if (Decision != TreeWalkerFilterResult::Include)
+                {
+                    break;
+                }
+            }
+            if (Decision == TreeWalkerFilterResult::Prune)
+            {
+                continue;
+            }
+
+            Mile::NativeString Path = NSudoSweeper::JoinPath(
+                Directory.Path,
+                Entry.GetName());
+
+            Mile::FileEntryType Type = Entry.GetType();
+#if !defined(_WIN32)
+            struct stat Status;
+            bool HasStatus = false;
+            if (Type == Mile::FileEntryType::Unknown)
+            {
+                HasStatus = ::QueryEntryStatus(Enumerator, Entry, Status);
+                if (HasStatus)
+                {
+                    Type = ::GetEntryType(Status);
+                }
+            }
+#endif
+
+            if (CanDescend)
+            {
+                if (Type == Mile::FileEntryType::Directory ||
+                    (Type == Mile::FileEntryType::Link &&
+                        this->m_Options.FollowLinks &&
+                        ::IsDirectoryLink(Entry, Path)))
+                {
+                    Subdirectories.push_back(
+                        PendingDirectory{
+                            Path,
+                            Directory.Depth + 1,
+                            Directory.MaximumDepth });
+                }
+            }
+
+            if (Decision == TreeWalkerFilterResult::Skip)
+            {
+                continue;
+            }
+
+            TreeWalkerItem Item;
+            Item.Path = std::move(Path);
+            Item.Type = Type;
+            Item.Depth = Directory.Depth;
+            Item.FileId = Entry.GetFileId();
+#if defined(_WIN32)
+            Item.Size = Entry.GetSize();
+            Item.AllocationSize = Entry.GetAllocationSize();
+#else
+            // The directory records of POSIX have no sizes, so only the
+            // files which are reported are queried.
+            Item.Size = 0;
+            Item.AllocationSize = 0;
+            if (Type == Mile::FileEntryType::File && !HasStatus)
+            {
+                HasStatus = ::QueryEntryStatus(Enumerator, Entry, Status);
+            }
+            if (HasStatus && S_ISREG(Status.st_mode))
+            {
+                Item.Size = static_cast<std::uint64_t>(Status.st_size);
+                Item.AllocationSize =
+                    static_cast<std::uint64_t>(Status.st_blocks) * 512;
+            }
+#endif
+            Batch.push_back(std::move(Item));
+
+            if (Batch.size() >= this->m_Options.BatchSize)
+            {
+                this->DeliverBatch(Batch);
+            }
+        }
+    }
+
+    this->m_Entries.fetch_add(Entries, std::memory_order_relaxed);
+
+    if (Enumerator.GetLastErrorCode())
+    {
+        this->m_Errors.fetch_add(1, std::memory_order_relaxed);
+        if (this->m_ErrorHandler)
+        {
+            Mile::AutoLock<Mile::Mutex> Lock(this->m_HandlerMutex);
+            this->m_ErrorHandler(
+                Directory.Path,
+                Enumerator.GetLastErrorCode());
+        }
+    }
+    else if (this->m_DirectoryHandler && CanDescend)
+    {
+        std::vector<Mile::NativeStringView> Paths;
+        Paths.reserve(Subdirectories.size());
+        for (PendingDirectory const& Subdirectory : Subdirectories)
+        {
+            Paths.push_back(Subdirectory.Path);
+        }
+        this->m_DirectoryHandler(Directory.Path, Entries, Paths);
+    }
+
+    Enumerator.Close();
+}
+
+void NSudoSweeper::TreeWalker::DeliverBatch(
+    std::vector<TreeWalkerItem>& Batch)
+{
+    if (Batch.empty())
+    {
+        return;
+    }
+
+    this->m_ReportedEntries.fetch_add(
+        Batch.size(),
+        std::memory_order_relaxed);
+
+    if (this->m_BatchHandler)
+    {
+        Mile::AutoLock<Mile::Mutex> Lock(this->m_HandlerMutex);
+        this->m_BatchHandler(Batch);
+    }
+
+    Batch.clear();
+}
+
+bool NSudoSweeper::TreeWalker::Walk(
+    std::vector<Mile::NativeString> const& Roots)
+{
+    std::vector<TreeWalkerRoot> DepthLimitedRoots;
+    DepthLimitedRoots.reserve(Roots.size());
+    for (Mile::NativeString const& Root : Roots)
+    {
+        DepthLimitedRoots.push_back(TreeWalkerRoot{ Root, UINT32_MAX });
+    }
+    return this->Walk(DepthLimitedRoots);
+}
+
+bool NSudoSweeper::TreeWalker::Walk(
+    std::vector<TreeWalkerRoot> const& Roots)
+{
+    this->m_Canceled.store(false, std::memory_order_relaxed);
+    this->m_Directories.store(0, std::memory_order_relaxed);
+    this->m_Entries.store(0, std::memory_order_relaxed);
+    this->m_ReportedEntries.store(0, std::memory_order_relaxed);
+    this->m_Errors.store(0, std::memory_order_relaxed);
+    this->m_ProvidedDirectories.store(0, std::memory_order_relaxed);
+
+    std::vector<std::shared_ptr<Volume>> Volumes;
+    for (TreeWalkerRoot const& Root : Roots)
+    {
+        Mile::NativeString Key = NSudoSweeper::GetVolumeKey(Root.Path);
+
+        std::shared_ptr<Volume> Target;
+        for (std::shared_ptr<Volume> const& Candidate : Volumes)
+        {
+            if (NSudoSweeper::IsSameVolumeKey(Candidate->Key, Key))
+            {
+                Target = Candidate;
+                break;
+            }
+        }
+        if (!Target)
+        {
+            Target = std::make_shared<Volume>();
+            Target->Key = std::move(Key);
+            Target->MaximumWorkers =
+                this->m_Options.MaximumConcurrencyPerVolume;
+            Volumes.push_back(Target);
+        }
+
+        Target->Pending.push_back(PendingDirectory{
+            Root.Path,
+            0,
+            Root.MaximumDepth < this->m_Options.MaximumDepth
+            ? Root.MaximumDepth
+            : this->m_Options.MaximumDepth });
+    }
+
+    Mile::TaskGroup Group;
+    this->m_Group = &Group;
+
+    try
+    {
+        for (std::shared_ptr<Volume> const& Target : Volumes)
+        {
+            Target->ActiveWorkers = 1;
+            this->StartWorker(Target);
+        }
+
+        this->m_Pool.Wait(Group);
+    }
+    catch (...)
+    {
+        Group.Cancel();
+        this->m_Pool.Wait(Group);
+        this->m_Group = nullptr;
+        throw;
+    }
+
+    this->m_Group = nullptr;
+
+    return !this->m_Canceled.load(std::memory_order_relaxed);
+}
+
+void NSudoSweeper::TreeWalker::Cancel() noexcept
+{
+    this->m_Canceled.store(true, std::memory_order_relaxed);
+}
+
+NSudoSweeper::TreeWalkerStatistics
+NSudoSweeper::TreeWalker::GetStatistics() const noexcept
+{
+    TreeWalkerStatistics Statistics;
+
+    Statistics.Directories =
+        this->m_Directories.load(std::memory_order_relaxed);
+    Statistics.Entries =
+        this->m_Entries.load(std::memory_order_relaxed);
+    Statistics.ReportedEntries =
+        this->m_ReportedEntries.load(std::memory_order_relaxed);
+    Statistics.Errors =
+        this->m_Errors.load(std::memory_order_relaxed);
+    Statistics.ProvidedDirectories =
+        this->m_ProvidedDirectories.load(std::memory_order_relaxed);
+
+    return Statistics;
+}
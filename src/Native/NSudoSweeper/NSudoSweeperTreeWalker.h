@@ -0,0 +1,381 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperTreeWalker.h
+ * PURPOSE:   Definition for the parallel directory tree walker
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_TREE_WALKER
+#define NSUDO_SWEEPER_TREE_WALKER
+
+#include <Mile.Portable.h>
+#include <Mile.Portable.FileEnumerator.h>
+#include <Mile.Portable.Synchronization.h>
+#include <Mile.Portable.ThreadPool.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * An entry found by the tree walker.
+     */
+    struct TreeWalkerItem
+    {
+        /**
+         * The full path of the entry.
+         */
+        Mile::NativeString Path;
+
+        /**
+         * The type of the entry.
+         */
+        Mile::FileEntryType Type;
+
+        /**
+         * The depth of the entry. The entries in a root directory have the
+         * depth 0.
+         */
+        std::uint32_t Depth;
+
+        /**
+         * The file ID of the entry.
+         */
+        std::uint64_t FileId;
+
+        /**
+         * The size of the entry, in bytes. It comes from the directory
+         * record on Windows, and from fstatat elsewhere, where it is only
+         * queried for files and is 0 for other entries.
+         */
+        std::uint64_t Size;
+
+        /**
+         * The allocation size of the entry, in bytes. Elsewhere than on
+         * Windows, it is the number of allocated 512-byte blocks of a file
+         * times 512.
+         */
+        std::uint64_t AllocationSize;
+    };
+
+    /**
+     * A root directory of a walk.
+     */
+    struct TreeWalkerRoot
+    {
+        /**
+         * The path of the root directory.
+         */
+        Mile::NativeString Path;
+
+        /**
+         * The maximum depth of the reported entries below this root. It is
+         * combined with TreeWalkerOptions::MaximumDepth, and the smaller one
+         * is used.
+         */
+        std::uint32_t MaximumDepth = UINT32_MAX;
+    };
+
+    /**
+     * The decision of a tree walker filter about an entry.
+     */
+    enum class TreeWalkerFilterResult
+    {
+        /**
+         * Report the entry, and descend into it if it is a directory.
+         */
+        Include,
+
+        /**
+         * Do not report the entry, but descend into it if it is a directory.
+         */
+        Skip,
+
+        /**
+         * Do not report the entry, and do not descend into it.
+         */
+        Prune,
+    };
+
+    /**
+     * A filter called for every entry before it is reported. It is called
+     * from the worker threads concurrently.
+     *
+     * @param DirectoryPath The path of the directory which contains the
+     *                      entry.
+     * @param Entry The entry.
+     * @param Depth The depth of the entry.
+     * @return The decision about the entry.
+     */
+    typedef std::function<TreeWalkerFilterResult(
+        Mile::NativeStringView DirectoryPath,
+        Mile::FileEnumeratorEntry const& Entry,
+        std::uint32_t Depth)> TreeWalkerFilter;
+
+    /**
+     * A filter called for every directory whose subdirectories are walked,
+     * before it is enumerated, which can provide its entries instead, such
+     * as from the results of a previous walk. It is called from the worker
+     * threads concurrently.
+     *
+     * @param Path The path of the directory.
+     * @param Depth The depth of the entries of the directory.
+     * @param Items The entries to report. The walker sets their depth, and
+     *              the entry filters are not called for them.
+     * @param Subdirectories The full paths of the subdirectories to walk.
+     * @return true if the filter provides the entries, or false to
+     *         enumerate the directory.
+     */
+    typedef std::function<bool(
+        Mile::NativeStringView Path,
+        std::uint32_t Depth,
+        std::vector<TreeWalkerItem>& Items,
+        std::vector<Mile::NativeString>& Subdirectories)> TreeWalkerDirectoryFilter;
+
+    /**
+     * A handler called for every directory whose subdirectories are walked,
+     * after it is enumerated without errors. It is called from the worker
+     * threads concurrently, and it may be called before the entries of the
+     * directory are delivered.
+     *
+     * @param Path The path of the directory.
+     * @param EntryCount The number of entries of the directory.
+     * @param Subdirectories The full paths of the subdirectories the walker
+     *                       walks.
+     */
+    typedef std::function<void(
+        Mile::NativeStringView Path,
+        std::uint64_t EntryCount,
+        std::vector<Mile::NativeStringView> const& Subdirectories)> TreeWalkerDirectoryHandler;
+
+    /**
+     * A handler which receives the found entries in batches. The calls are
+     * serialized, so the handler does not need to be thread-safe.
+     *
+     * @param Batch The entries.
+     */
+    typedef std::function<void(
+        std::vector<TreeWalkerItem>& Batch)> TreeWalkerBatchHandler;
+
+    /**
+     * A handler which receives the directories which cannot be enumerated.
+     * The calls are serialized.
+     *
+     * @param Path The path of the directory.
+     * @param ErrorCode The Win32 error code on Windows, or the errno value
+     *                  elsewhere.
+     */
+    typedef std::function<void(
+        Mile::NativeStringView Path,
+        int ErrorCode)> TreeWalkerErrorHandler;
+
+    /**
+     * The options of the tree walker.
+     */
+    struct TreeWalkerOptions
+    {
+        /**
+         * The maximum number of directories enumerated concurrently on a
+         * volume. If it is 0, the number of threads of the thread pool is
+         * used. Use 1 or 2 for rotational disks.
+         */
+        std::size_t MaximumConcurrencyPerVolume = 0;
+
+        /**
+         * The number of entries delivered to the batch handler at a time.
+         */
+        std::size_t BatchSize = 1024;
+
+        /**
+         * The size of the buffer of the file enumerators, in bytes.
+         */
+        std::size_t EnumeratorBufferSize =
+            Mile::FileEnumerator::DefaultBufferSize;
+
+        /**
+         * The maximum depth of the reported entries.
+         */
+        std::uint32_t MaximumDepth = UINT32_MAX;
+
+        /**
+         * Descend into symbolic links, junctions and other reparse points.
+         * It may visit a directory more than once and never terminate on a
+         * link cycle, so it is disabled by default.
+         */
+        bool FollowLinks = false;
+    };
+
+    /**
+     * The statistics of a walk.
+     */
+    struct TreeWalkerStatistics
+    {
+        std::uint64_t Directories;
+        std::uint64_t Entries;
+        std::uint64_t ReportedEntries;
+        std::uint64_t Errors;
+
+        /**
+         * The number of directories whose entries are provided by the
+         * directory filter.
+         */
+        std::uint64_t ProvidedDirectories;
+    };
+
+    /**
+     * Walks directory trees in parallel. Each volume has a shared stack of
+     * pending directories and up to MaximumConcurrencyPerVolume workers.
+     * A worker keeps the subdirectories it finds on a private stack and
+     * walks them depth first, which keeps the directory metadata it touches
+     * close together. It gives the oldest half of its stack, the largest
+     * subtrees, to the shared stack when the volume has room for another
+     * worker.
+     */
+    class TreeWalker : Mile::DisableCopyConstruction, Mile::DisableMoveConstruction
+    {
+    private:
+
+        struct Volume;
+        struct PendingDirectory;
+
+        Mile::ThreadPool& m_Pool;
+        TreeWalkerOptions m_Options;
+        std::vector<TreeWalkerFilter> m_Filters;
+        TreeWalkerDirectoryFilter m_DirectoryFilter;
+        TreeWalkerDirectoryHandler m_DirectoryHandler;
+        TreeWalkerBatchHandler m_BatchHandler;
+        TreeWalkerErrorHandler m_ErrorHandler;
+
+        Mile::TaskGroup* m_Group = nullptr;
+        std::atomic<bool> m_Canceled{ false };
+
+        Mile::Mutex m_HandlerMutex;
+
+        std::atomic<std::uint64_t> m_Directories{ 0 };
+        std::atomic<std::uint64_t> m_Entries{ 0 };
+        std::atomic<std::uint64_t> m_ReportedEntries{ 0 };
+        std::atomic<std::uint64_t> m_Errors{ 0 };
+        std::atomic<std::uint64_t> m_ProvidedDirectories{ 0 };
+
+        void StartWorker(
+            std::shared_ptr<Volume> const& Target);
+
+        void WorkerMain(
+            std::shared_ptr<Volume> const& Target);
+
+        bool ProvideDirectory(
+            PendingDirectory const& Directory,
+            std::vector<PendingDirectory>& Subdirectories,
+            std::vector<TreeWalkerItem>& Batch);
+
+        void EnumerateDirectory(
+            Mile::FileEnumerator& Enumerator,
+            PendingDirectory const& Directory,
+            std::vector<PendingDirectory>& Subdirectories,
+            std::vector<TreeWalkerItem>& Batch);
+
+        void DeliverBatch(
+            std::vector<TreeWalkerItem>& Batch);
+
+    public:
+
+        /**
+         * Creates the tree walker.
+         *
+         * @param Pool The thread pool which runs the workers.
+         * @param Options The options of the tree walker.
+         */
+        TreeWalker(
+            Mile::ThreadPool& Pool,
+            TreeWalkerOptions const& Options = TreeWalkerOptions());
+
+        /**
+         * Adds a filter. The filters are called in the order they are added,
+         * and the first decision other than Include is used.
+         *
+         * @param Filter The filter.
+         */
+        void AddFilter(
+            TreeWalkerFilter Filter);
+
+        /**
+         * Sets the filter which can provide the entries of a directory.
+         *
+         * @param Filter The filter.
+         */
+        void SetDirectoryFilter(
+            TreeWalkerDirectoryFilter Filter);
+
+        /**
+         * Sets the handler which receives the enumerated directories.
+         *
+         * @param Handler The handler.
+         */
+        void SetDirectoryHandler(
+            TreeWalkerDirectoryHandler Handler);
+
+        /**
+         * Sets the handler which receives the found entries.
+         *
+         * @param Handler The handler.
+         */
+        void SetBatchHandler(
+            TreeWalkerBatchHandler Handler);
+
+        /**
+         * Sets the handler which receives the enumeration errors.
+         *
+         * @param Handler The handler.
+         */
+        void SetErrorHandler(
+            TreeWalkerErrorHandler Handler);
+
+        /**
+         * Walks the directory trees and waits for the walk to complete.
+         *
+         * @param Roots The root directories. The roots are grouped by the
+         *              volume which contains them. On Windows, use the
+         *              "\\?\" prefix to walk paths longer than MAX_PATH.
+         * @return true if the walk completed, or false if it was canceled.
+         * @remark The handlers may throw, which cancels the walk. The first
+         *         exception is rethrown.
+         */
+        bool Walk(
+            std::vector<Mile::NativeString> const& Roots);
+
+        /**
+         * Walks the directory trees with a depth limit for each root and
+         * waits for the walk to complete.
+         *
+         * @param Roots The root directories and their depth limits.
+         * @return true if the walk completed, or false if it was canceled.
+         * @remark The handlers may throw, which cancels the walk. The first
+         *         exception is rethrown.
+         */
+        bool Walk(
+            std::vector<TreeWalkerRoot> const& Roots);
+
+        /**
+         * Cancels the walk. It can be called from any thread, including the
+         * filters and handlers.
+         */
+        void Cancel() noexcept;
+
+        /**
+         * Retrieves the statistics of the last walk.
+         *
+         * @return The statistics of the last walk.
+         */
+        TreeWalkerStatistics GetStatistics() const noexcept;
+    };
+}
+
+#endif // !NSUDO_SWEEPER_TREE_WALKER
@@ -0,0 +1,158 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperVolume.cpp
+ * PURPOSE:   Implementation for the volume helpers
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperVolume.h"
+
+#if defined(_WIN32)
+#include <Mile.Windows.h>
+#include <Mile.Portable.CaseInsensitive.h>
+#else
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+Mile::NativeString NSudoSweeper::GetVolumeKey(
+    Mile::NativeString const& Path)
+{
+#if defined(_WIN32)
+    wchar_t VolumePath[MAX_PATH + 1];
+    if (::GetVolumePathNameW(
+        Path.c_str(),
+        VolumePath,
+        sizeof(VolumePath) / sizeof(*VolumePath)))
+    {
+        return VolumePath;
+    }
+
+    return Path;
+#else
+    struct stat Status;
+    if (0 == ::stat(Path.c_str(), &Status))
+    {
+        return std::to_string(static_cast<unsigned long long>(
+            Status.st_dev));
+    }
+
+    return Path;
+#endif
+}
+
+bool NSudoSweeper::IsSameVolumeKey(
+    Mile::NativeString const& Left,
+    Mile::NativeString const& Right)
+{
+#if defined(_WIN32)
+    return Mile::CaseInsensitiveEquals(Left, Right);
+#else
+    return Left == Right;
+#endif
+}
+
+Mile::NativeString NSudoSweeper::GetVolumeDevicePath(
+    Mile::NativeString const& VolumeKey)
+{
+#if defined(_WIN32)
+    wchar_t VolumeName[MAX_PATH + 1];
+    if (!::GetVolumeNameForVolumeMountPointW(
+        VolumeKey.c_str(),
+        VolumeName,
+        sizeof(VolumeName) / sizeof(*VolumeName)))
+    {
+        return Mile::NativeString();
+    }
+
+    // The volume device is opened without the trailing backslash.
+    Mile::NativeString DevicePath(VolumeName);
+    if (!DevicePath.empty() && DevicePath.back() == L'\\')
+    {
+        DevicePath.pop_back();
+    }
+
+    return DevicePath;
+#else
+    Mile::UnreferencedParameter(VolumeKey);
+    return Mile::NativeString();
+#endif
+}
+
+bool NSudoSweeper::IsRotationalVolume(
+    Mile::NativeString const& VolumeKey)
+{
+#if defined(_WIN32)
+    Mile::NativeString DevicePath =
+        NSudoSweeper::GetVolumeDevicePath(VolumeKey);
+    if (DevicePath.empty())
+    {
+        return false;
+    }
+
+    HANDLE DeviceHandle = ::CreateFileW(
+        DevicePath.c_str(),
+        0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        0,
+        nullptr);
+    if (DeviceHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    STORAGE_PROPERTY_QUERY Query = {};
+    Query.PropertyId = StorageDeviceSeekPenaltyProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    DEVICE_SEEK_PENALTY_DESCRIPTOR Descriptor = {};
+    DWORD BytesReturned = 0;
+    Mile::HResult hr = Mile::DeviceIoControl(
+        DeviceHandle,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &Descriptor,
+        sizeof(Descriptor),
+        &BytesReturned);
+
+    ::CloseHandle(DeviceHandle);
+
+    return hr.IsSucceeded() &&
+        BytesReturned >= sizeof(Descriptor) &&
+        Descriptor.IncursSeekPenalty;
+#else
+    char* End = nullptr;
+    unsigned long long Device = std::strtoull(VolumeKey.c_str(), &End, 10);
+    if (VolumeKey.empty() || *End)
+    {
+        return false;
+    }
+
+    std::string BlockPath =
+        "/sys/dev/block/" +
+        std::to_string(major(static_cast<dev_t>(Device))) + ":" +
+        std::to_string(minor(static_cast<dev_t>(Device)));
+
+    // A partition has no queue of its own, so try the disk which holds it.
+    for (char const* Suffix : { "/queue/rotational", "/../queue/rotational" })
+    {
+        std::ifstream File(BlockPath + Suffix);
+        int Rotational = 0;
+        if (File >> Rotational)
+        {
+            return Rotational != 0;
+        }
+    }
+
+    return false;
+#endif
+}
@@ -0,0 +1,64 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperVolume.h
+ * PURPOSE:   Definition for the volume helpers
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_VOLUME
+#define NSUDO_SWEEPER_VOLUME
+
+#include <Mile.Portable.h>
+
+namespace NSudoSweeper
+{
+    /**
+     * Retrieves a key which identifies the volume which contains a path. It
+     * is the mount point of the volume on Windows and the device number
+     * elsewhere.
+     *
+     * @param Path The path.
+     * @return The key of the volume, or the path itself if the volume
+     *         cannot be found.
+     */
+    Mile::NativeString GetVolumeKey(
+        Mile::NativeString const& Path);
+
+    /**
+     * Checks whether two volume keys identify the same volume.
+     *
+     * @param Left The first key.
+     * @param Right The second key.
+     * @return true if the keys identify the same volume, otherwise false.
+     */
+    bool IsSameVolumeKey(
+        Mile::NativeString const& Left,
+        Mile::NativeString const& Right);
+
+    /**
+     * Retrieves the path of the device of a volume, which can be opened to
+     * read the volume directly, such as "\\?\Volume{GUID}" on Windows.
+     *
+     * @param VolumeKey The key returned by GetVolumeKey.
+     * @return The path of the device, or an empty string if it cannot be
+     *         found or the platform does not support it.
+     */
+    Mile::NativeString GetVolumeDevicePath(
+        Mile::NativeString const& VolumeKey);
+
+    /**
+     * Checks whether a volume is on a rotational disk, which has a seek
+     * penalty, so concurrent I/O on it is slower than sequential I/O.
+     *
+     * @param VolumeKey The key returned by GetVolumeKey.
+     * @return true if the volume is on a rotational disk, or false if it is
+     *         not or if it cannot be determined.
+     */
+    bool IsRotationalVolume(
+        Mile::NativeString const& VolumeKey);
+}
+
+#endif // !NSUDO_SWEEPER_VOLUME
@@ -0,0 +1,426 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperWalkPlanner.cpp
+ * PURPOSE:   Implementation for the walk root planner
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperWalkPlanner.h"
+
+#include "NSudoSweeperHandlerSupport.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(_WIN32)
+#include <Mile.Portable.CaseInsensitive.h>
+#endif
+
+namespace
+{
+    const std::uint32_t UnlimitedDepth = UINT32_MAX;
+
+    bool IsSameComponent(
+        Mile::NativeStringView Left,
+        Mile::NativeStringView Right) noexcept
+    {
+#if defined(_WIN32)
+        return Mile::CaseInsensitiveEquals(Left, Right);
+#else
+        return Left == Right;
+#endif
+    }
+
+    bool IsLiteralComponent(
+        Mile::NativeStringView Component) noexcept
+    {
+        for (Mile::NativeChar Character : Component)
+        {
+            if (Character == '*' || Character == '?' || Character == '[')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsRecursiveComponent(
+        Mile::NativeStringView Component) noexcept
+    {
+        for (std::size_t i = 1; i < Component.size(); ++i)
+        {
+            if (Component[i - 1] == '*' && Component[i] == '*')
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Splits a pattern into its components. The first component is empty
+     * for an absolute POSIX path, and it keeps the "\\?\" or "\\.\" prefix
+     * of a Windows path.
+     *
+     * @param Pattern The pattern.
+     * @return The components of the pattern.
+     */
+    std::vector<Mile::NativeStringView> SplitPattern(
+        Mile::NativeStringView Pattern)
+    {
+        std::vector<Mile::NativeStringView> Components;
+
+        std::size_t Start = 0;
+#if defined(_WIN32)
+        if (Pattern.size() >= 4 &&
+            NSudoSweeper::IsPathSeparator(Pattern[0]) &&
+            NSudoSweeper::IsPathSeparator(Pattern[1]) &&
+            (Pattern[2] == L'?' || Pattern[2] == L'.') &&
+            NSudoSweeper::IsPathSeparator(Pattern[3]))
+        {
+            Start = 4;
+        }
+#endif
+
+        std::size_t Current = Start;
+        for (std::size_t i = Start; i <= Pattern.size(); ++i)
+        {
+            if (i < Pattern.size() &&
+                !NSudoSweeper::IsPathSeparator(Pattern[i]))
+            {
+                continue;
+            }
+
+            if (Components.empty())
+            {
+                Components.push_back(Pattern.substr(0, i));
+            }
+            else if (i > Current)
+            {
+                Components.push_back(Pattern.substr(Current, i - Current));
+            }
+            Current = i + 1;
+        }
+
+        return Components;
+    }
+
+    struct Candidate
+    {
+        std::vector<Mile::NativeString> Components;
+        NSudoSweeper::WalkPlanRoot Root;
+    };
+
+    Mile::NativeString BuildPath(
+        std::vector<Mile::NativeString> const& Components)
+    {
+        Mile::NativeString Path;
+        for (std::size_t i = 0; i < Components.size(); ++i)
+        {
+            if (i)
+            {
+                Path.push_back(NSudoSweeper::PathSeparator);
+            }
+            Path.append(Components[i]);
+        }
+
+        // Keep the separator after a drive or at the root of a POSIX path,
+        // because "C:" names the current directory of the drive.
+        if (Path.empty() || Path.back() == ':')
+        {
+            Path.push_back(NSudoSweeper::PathSeparator);
+        }
+
+        return Path;
+    }
+
+    /**
+     * Checks whether a directory is an ancestor of another one or the same
+     * directory.
+     *
+     * @param Ancestor The components of the first directory.
+     * @param Descendant The components of the second directory.
+     * @return true if the first directory is an ancestor of the second one
+     *         or the same directory, otherwise false.
+     */
+    bool IsAncestorOrSelf(
+        std::vector<Mile::NativeString> const& Ancestor,
+        std::vector<Mile::NativeString> const& Descendant) noexcept
+    {
+        if (Ancestor.size() > Descendant.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < Ancestor.size(); ++i)
+        {
+            if (!::IsSameComponent(Ancestor[i], Descendant[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::uint32_t AddDepth(
+        std::uint32_t Depth,
+        std::size_t Distance) noexcept
+    {
+        if (Depth == UnlimitedDepth ||
+            Distance >= static_cast<std::size_t>(UnlimitedDepth - Depth))
+        {
+            return UnlimitedDepth;
+        }
+        return Depth + static_cast<std::uint32_t>(Distance);
+    }
+
+    void MergeGroups(
+        std::vector<std::uint32_t>& Target,
+        std::vector<std::uint32_t> const& Source)
+    {
+        std::vector<std::uint32_t> Result;
+        std::set_union(
+            Target.begin(),
+            Target.end(),
+            Source.begin(),
+            Source.end(),
+            std::back_inserter(Result));
+        Target.swap(Result);
+    }
+}
+
+std::vector<NSudoSweeper::TreeWalkerRoot>
+NSudoSweeper::WalkPlan::GetTreeWalkerRoots() const
+{
+    std::vector<TreeWalkerRoot> Result;
+    Result.reserve(this->Roots.size());
+    for (WalkPlanRoot const& Root : this->Roots)
+    {
+        Result.push_back(TreeWalkerRoot{ Root.Path, Root.MaximumDepth });
+    }
+    return Result;
+}
+
+void NSudoSweeper::WalkPlanner::AddInclude(
+    std::uint32_t Group,
+    Mile::NativeStringView Pattern)
+{
+    this->m_Includes.push_back(WalkPlanner::PatternEntry{
+        Group,
+        Mile::NativeString(Pattern.data(), Pattern.size()) });
+}
+
+void NSudoSweeper::WalkPlanner::AddExclude(
+    std::uint32_t Group,
+    Mile::NativeStringView Pattern)
+{
+    this->m_Excludes.push_back(WalkPlanner::PatternEntry{
+        Group,
+        Mile::NativeString(Pattern.data(), Pattern.size()) });
+}
+
+NSudoSweeper::WalkPlan NSudoSweeper::WalkPlanner::Plan() const
+{
+    WalkPlan Result;
+
+    // The subtrees removed by the Exclude patterns, which are literal
+    // directories followed by "**".
+    std::vector<std::pair<std::uint32_t, std::vector<Mile::NativeString>>>
+        ExcludedSubtrees;
+    for (WalkPlanner::PatternEntry const& Exclude : this->m_Excludes)
+    {
+        std::vector<Mile::NativeStringView> Components =
+            ::SplitPattern(Exclude.Text);
+        if (Components.size() < 2 ||
+            Components.back().find_first_not_of('*') !=
+            Mile::NativeStringView::npos ||
+            Components.back().size() < 2)
+        {
+            continue;
+        }
+
+        std::vector<Mile::NativeString> Subtree;
+        for (std::size_t i = 0; i + 1 < Components.size(); ++i)
+        {
+            if (!::IsLiteralComponent(Components[i]))
+            {
+                Subtree.clear();
+                break;
+            }
+            Subtree.emplace_back(Components[i]);
+        }
+        if (!Subtree.empty())
+        {
+            ExcludedSubtrees.emplace_back(Exclude.Group, std::move(Subtree));
+        }
+    }
+
+    std::vector<Candidate> Candidates;
+    for (WalkPlanner::PatternEntry const& Include : this->m_Includes)
+    {
+        std::vector<Mile::NativeStringView> Components =
+            ::SplitPattern(Include.Text);
+
+        // The last component names the matched entries, so it never belongs
+        // to the root.
+        std::size_t RootLength = 0;
+        while (RootLength + 1 < Components.size() &&
+            ::IsLiteralComponent(Components[RootLength]))
+        {
+            ++RootLength;
+        }
+        if (!RootLength)
+        {
+            ++Result.UnplannablePatterns;
+            continue;
+        }
+
+        Candidate Current;
+        for (std::size_t i = 0; i < RootLength; ++i)
+        {
+            Current.Components.emplace_back(Components[i]);
+        }
+        Current.Root.Path = ::BuildPath(Current.Components);
+        Current.Root.MaximumDepth = static_cast<std::uint32_t>(
+            Components.size() - RootLength - 1);
+        for (std::size_t i = RootLength; i < Components.size(); ++i)
+        {
+            if (::IsRecursiveComponent(Components[i]))
+            {
+                Current.Root.MaximumDepth = UnlimitedDepth;
+                break;
+            }
+        }
+        Current.Root.Groups.push_back(Include.Group);
+
+        bool Excluded = false;
+        for (auto const& Subtree : ExcludedSubtrees)
+        {
+            if (Subtree.first == Include.Group &&
+                ::IsAncestorOrSelf(Subtree.second, Current.Components))
+            {
+                Excluded = true;
+                break;
+            }
+        }
+        if (Excluded)
+        {
+            ++Result.ExcludedRoots;
+            continue;
+        }
+
+        Candidates.push_back(std::move(Current));
+    }
+
+    for (Candidate const& Current : Candidates)
+    {
+        Result.CandidateRoots.push_back(Current.Root);
+    }
+
+    // Merge every root which another root reaches into it. Extending the
+    // depth of a root may make it reach more roots, so repeat until nothing
+    // changes. Shorter roots come first, so ancestors absorb descendants.
+    std::stable_sort(
+        Candidates.begin(),
+        Candidates.end(),
+        [](Candidate const& Left, Candidate const& Right)
+    {
+        return Left.Components.size() < Right.Components.size();
+    });
+
+    bool Changed = true;
+    while (Changed)
+    {
+        Changed = false;
+        for (std::size_t i = 0; i < Candidates.size() && !Changed; ++i)
+        {
+            for (std::size_t j = i + 1; j < Candidates.size(); ++j)
+            {
+                Candidate& Ancestor = Candidates[i];
+                Candidate& Descendant = Candidates[j];
+                if (!::IsAncestorOrSelf(
+                    Ancestor.Components,
+                    Descendant.Components))
+                {
+                    continue;
+                }
+
+                std::size_t Distance =
+                    Descendant.Components.size() - Ancestor.Components.size();
+                if (Ancestor.Root.MaximumDepth != UnlimitedDepth &&
+                    Ancestor.Root.MaximumDepth < Distance)
+                {
+                    // The ancestor stops above the descendant, so they never
+                    // enumerate the same directory.
+                    continue;
+                }
+
+                Ancestor.Root.MaximumDepth = (std::max)(
+                    Ancestor.Root.MaximumDepth,
+                    ::AddDepth(Descendant.Root.MaximumDepth, Distance));
+                ::MergeGroups(Ancestor.Root.Groups, Descendant.Root.Groups);
+                Candidates.erase(Candidates.begin() + j);
+                Changed = true;
+                break;
+            }
+        }
+    }
+
+    for (Candidate& Current : Candidates)
+    {
+        Result.Roots.push_back(std::move(Current.Root));
+    }
+    std::sort(
+        Result.Roots.begin(),
+        Result.Roots.end(),
+        [](WalkPlanRoot const& Left, WalkPlanRoot const& Right)
+    {
+        return Left.Path < Right.Path;
+    });
+
+    return Result;
+}
+
+NSudoSweeper::WalkPlanEstimate NSudoSweeper::EstimateVisitedDirectories(
+    WalkPlan const& Plan,
+    WalkPlanDirectoryCounter const& Counter)
+{
+    WalkPlanEstimate Result = { 0, 0, 0 };
+
+    for (WalkPlanRoot const& Root : Plan.Roots)
+    {
+        Result.PlannedDirectories += Counter(Root.Path, Root.MaximumDepth);
+    }
+
+    for (WalkPlanRoot const& Root : Plan.CandidateRoots)
+    {
+        Result.UnmergedDirectories += Counter(Root.Path, Root.MaximumDepth);
+    }
+
+    std::vector<Mile::NativeString> Volumes;
+    for (WalkPlanRoot const& Root : Plan.Roots)
+    {
+        std::vector<Mile::NativeString> Components;
+        Components.emplace_back(::SplitPattern(Root.Path).front());
+        Mile::NativeString Volume = ::BuildPath(Components);
+
+        bool Found = false;
+        for (Mile::NativeString const& Existing : Volumes)
+        {
+            if (::IsSameComponent(Existing, Volume))
+            {
+                Found = true;
+                break;
+            }
+        }
+        if (!Found)
+        {
+            Result.VolumeDirectories += Counter(Volume, UnlimitedDepth);
+            Volumes.push_back(std::move(Volume));
+        }
+    }
+
+    return Result;
+}
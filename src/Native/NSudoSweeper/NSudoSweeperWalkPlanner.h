@@ -0,0 +1,191 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperWalkPlanner.h
+ * PURPOSE:   Definition for the walk root planner
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_SWEEPER_WALK_PLANNER
+#define NSUDO_SWEEPER_WALK_PLANNER
+
+#include <Mile.Portable.h>
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace NSudoSweeper
+{
+    /**
+     * A directory the scan enumerates.
+     */
+    struct WalkPlanRoot
+    {
+        /**
+         * The path of the directory.
+         */
+        Mile::NativeString Path;
+
+        /**
+         * The maximum depth below the directory which the patterns can
+         * reach. The entries in the directory have the depth 0, and
+         * UINT32_MAX means the depth is not limited.
+         */
+        std::uint32_t MaximumDepth;
+
+        /**
+         * The groups whose patterns need the directory, in ascending order.
+         */
+        std::vector<std::uint32_t> Groups;
+    };
+
+    /**
+     * The directories a scan enumerates, derived from the Include and
+     * Exclude patterns of the handlers.
+     */
+    struct WalkPlan
+    {
+        /**
+         * The directories to enumerate. No directory is enumerated by more
+         * than one root.
+         */
+        std::vector<WalkPlanRoot> Roots;
+
+        /**
+         * The directories each pattern needs before they are merged, with
+         * the ones inside excluded subtrees removed. They are what the
+         * handlers would enumerate if each walked its own patterns.
+         */
+        std::vector<WalkPlanRoot> CandidateRoots;
+
+        /**
+         * The number of Include patterns which start with a wildcard, so no
+         * directory can be derived from them. They need explicit roots.
+         */
+        std::size_t UnplannablePatterns = 0;
+
+        /**
+         * The number of candidate roots removed because an Exclude pattern
+         * of the same group covers them.
+         */
+        std::size_t ExcludedRoots = 0;
+
+        /**
+         * Converts the roots into the roots of a tree walk.
+         *
+         * @return The roots of a tree walk.
+         */
+        std::vector<TreeWalkerRoot> GetTreeWalkerRoots() const;
+    };
+
+    /**
+     * A function which estimates the number of directories a walk visits,
+     * such as a lookup in the snapshot of a previous scan.
+     *
+     * @param Path The root of the walk.
+     * @param MaximumDepth The maximum depth of the walk.
+     * @return The estimated number of directories, including the root.
+     */
+    typedef std::function<std::uint64_t(
+        Mile::NativeStringView Path,
+        std::uint32_t MaximumDepth)> WalkPlanDirectoryCounter;
+
+    /**
+     * The estimated numbers of directories visited by a scan.
+     */
+    struct WalkPlanEstimate
+    {
+        /**
+         * The directories visited by walking the planned roots.
+         */
+        std::uint64_t PlannedDirectories;
+
+        /**
+         * The directories visited if each pattern walked its own root.
+         */
+        std::uint64_t UnmergedDirectories;
+
+        /**
+         * The directories visited by walking the whole volumes which contain
+         * the planned roots.
+         */
+        std::uint64_t VolumeDirectories;
+    };
+
+    /**
+     * Derives the directories a scan enumerates from the Include and Exclude
+     * patterns of the handlers, which use the syntax of PathRuleSet.
+     *
+     * The literal directories at the start of each Include pattern become a
+     * root, limited to the depth the rest of the pattern can reach. A
+     * pattern without "**" reaches a fixed depth, so "C:\A\*\*.log" only
+     * needs "C:\A" down to depth 1. Roots covered by an Exclude pattern of
+     * the same group which ends with "\**" are removed. A root which another
+     * root reaches is merged into it, across all groups, so each directory
+     * is enumerated at most once per scan.
+     */
+    class WalkPlanner
+    {
+    private:
+
+        struct PatternEntry
+        {
+            std::uint32_t Group;
+            Mile::NativeString Text;
+        };
+
+        std::vector<PatternEntry> m_Includes;
+        std::vector<PatternEntry> m_Excludes;
+
+    public:
+
+        /**
+         * Adds an Include pattern.
+         *
+         * @param Group The group of the pattern, such as the index of the
+         *              handler which defines it.
+         * @param Pattern The glob pattern.
+         */
+        void AddInclude(
+            std::uint32_t Group,
+            Mile::NativeStringView Pattern);
+
+        /**
+         * Adds an Exclude pattern. Only the patterns which end with "\**"
+         * remove roots.
+         *
+         * @param Group The group of the pattern.
+         * @param Pattern The glob pattern.
+         */
+        void AddExclude(
+            std::uint32_t Group,
+            Mile::NativeStringView Pattern);
+
+        /**
+         * Plans the directories to enumerate.
+         *
+         * @return The plan.
+         */
+        WalkPlan Plan() const;
+    };
+
+    /**
+     * Estimates the saving of a plan in directories visited.
+     *
+     * @param Plan The plan.
+     * @param Counter The function which estimates the directories a walk
+     *                visits.
+     * @return The estimated numbers of directories visited.
+     */
+    WalkPlanEstimate EstimateVisitedDirectories(
+        WalkPlan const& Plan,
+        WalkPlanDirectoryCounter const& Counter);
+}
+
+#endif // !NSUDO_SWEEPER_WALK_PLANNER
@@ -0,0 +1,258 @@
+#
+# PROJECT:   NSudo Sweeper
+# FILE:      GenerateDumps.py
+# PURPOSE:   Generates the change journal dumps of the tests
+#
+# LICENSE:   The MIT License
+#
+# DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+#
+
+# Writes the records of the changes below as the output of
+# FSCTL_READ_USN_JOURNAL without its first 8 bytes, one dump per record
+# version. The layouts follow USN_RECORD_V2, USN_RECORD_V3 and USN_RECORD_V4
+# of winioctl.h, and every record is padded to 8 bytes as the system pads it.
+# The expected records and changes of each dump are written by hand in the
+# .txt file of the same name. Run it after changing the records:
+#
+#   python3 GenerateDumps.py
+
+import pathlib
+import struct
+
+OVERWRITE = 0x00000001
+EXTEND = 0x00000002
+TRUNCATION = 0x00000004
+CREATE = 0x00000100
+DELETE = 0x00000200
+OLD_NAME = 0x00001000
+NEW_NAME = 0x00002000
+HARD_LINK = 0x00010000
+REPARSE_POINT = 0x00100000
+CLOSE = 0x80000000
+
+DIRECTORY = 0x00000010
+ARCHIVE = 0x00000020
+
+# The first USN and the time of the first record, 2024-01-01 00:00:00 UTC.
+FIRST_USN = 0x20000000
+FIRST_TIME = 133485408000000000
+
+
+def file_id(record, sequence):
+    return record | (sequence << 48)
+
+
+ROOT = file_id(5, 5)
+DOCS = file_id(40, 1)
+ARCHIVE_DIRECTORY = file_id(41, 1)
+CACHE = file_id(42, 2)
+LINKS = file_id(43, 1)
+OLD = file_id(44, 1)
+JUNCTION = file_id(113, 1)
+
+# The changes of a volume: (file, parent, name, reason, attributes).
+CHANGES = [
+    # Created.
+    (file_id(100, 1), DOCS, 'a.tmp', CREATE, ARCHIVE),
+    (file_id(100, 1), DOCS, 'a.tmp', CREATE | EXTEND, ARCHIVE),
+    # Created and deleted while a.tmp is open.
+    (file_id(101, 1), DOCS, 'temp.txt', CREATE, ARCHIVE),
+    (file_id(101, 1), DOCS, 'temp.txt', CREATE | EXTEND, ARCHIVE),
+    # Moved to another directory, as a pair of an old and a new name.
+    (file_id(102, 1), DOCS, 'old.txt', OLD_NAME, ARCHIVE),
+    (file_id(102, 1), ARCHIVE_DIRECTORY, 'new.txt', NEW_NAME, ARCHIVE),
+    (file_id(100, 1), DOCS, 'a.tmp', CREATE | EXTEND | CLOSE, ARCHIVE),
+    (file_id(101, 1), DOCS, 'temp.txt',
+     CREATE | EXTEND | DELETE | CLOSE, ARCHIVE),
+    (file_id(102, 1), ARCHIVE_DIRECTORY, 'new.txt',
+     NEW_NAME | CLOSE, ARCHIVE),
+    # Renamed and renamed back.
+    (file_id(103, 1), DOCS, 'x.log', OLD_NAME, ARCHIVE),
+    (file_id(103, 1), DOCS, 'y.log', NEW_NAME, ARCHIVE),
+    (file_id(103, 1), DOCS, 'y.log', NEW_NAME | CLOSE, ARCHIVE),
+    (file_id(103, 1), DOCS, 'y.log', OLD_NAME, ARCHIVE),
+    (file_id(103, 1), DOCS, 'x.log', NEW_NAME, ARCHIVE),
+    (file_id(103, 1), DOCS, 'x.log', NEW_NAME | CLOSE, ARCHIVE),
+    # Renamed in its directory.
+    (file_id(104, 1), DOCS, 'b.txt', OLD_NAME, ARCHIVE),
+    (file_id(104, 1), DOCS, 'c.txt', NEW_NAME, ARCHIVE),
+    (file_id(104, 1), DOCS, 'c.txt', NEW_NAME | CLOSE, ARCHIVE),
+    # A renamed directory.
+    (CACHE, ROOT, 'Cache', OLD_NAME, DIRECTORY),
+    (CACHE, ROOT, 'Cache.old', NEW_NAME, DIRECTORY),
+    (CACHE, ROOT, 'Cache.old', NEW_NAME | CLOSE, DIRECTORY),
+    # Deleted.
+    (file_id(105, 3), ARCHIVE_DIRECTORY, 'gone.bin', DELETE | CLOSE, ARCHIVE),
+    # Extended and truncated.
+    (file_id(106, 1), ARCHIVE_DIRECTORY, 'log.txt', EXTEND, ARCHIVE),
+    (file_id(106, 1), ARCHIVE_DIRECTORY, 'log.txt', EXTEND | CLOSE, ARCHIVE),
+    (file_id(107, 1), ARCHIVE_DIRECTORY, 'big.dat', TRUNCATION, ARCHIVE),
+    (file_id(107, 1), ARCHIVE_DIRECTORY, 'big.dat',
+     TRUNCATION | CLOSE, ARCHIVE),
+    # A hard link added.
+    (file_id(108, 1), LINKS, 'link.txt', HARD_LINK, ARCHIVE),
+    (file_id(108, 1), LINKS, 'link.txt', HARD_LINK | CLOSE, ARCHIVE),
+    # A deleted directory.
+    (OLD, ROOT, 'Old', DELETE | CLOSE, DIRECTORY),
+    # Moved and then deleted, which the scan finds at its old name.
+    (file_id(109, 1), DOCS, 'r1.txt', OLD_NAME, ARCHIVE),
+    (file_id(109, 1), ARCHIVE_DIRECTORY, 'r2.txt', NEW_NAME, ARCHIVE),
+    (file_id(109, 1), ARCHIVE_DIRECTORY, 'r2.txt', NEW_NAME | CLOSE, ARCHIVE),
+    (file_id(109, 1), ARCHIVE_DIRECTORY, 'r2.txt', DELETE | CLOSE, ARCHIVE),
+    # Created and then moved, which the scan finds at its new name.
+    (file_id(110, 1), DOCS, 'draft.txt', CREATE, ARCHIVE),
+    (file_id(110, 1), DOCS, 'draft.txt', CREATE | EXTEND | CLOSE, ARCHIVE),
+    (file_id(110, 1), DOCS, 'draft.txt', OLD_NAME, ARCHIVE),
+    (file_id(110, 1), ARCHIVE_DIRECTORY, 'final.txt', NEW_NAME, ARCHIVE),
+    (file_id(110, 1), ARCHIVE_DIRECTORY, 'final.txt',
+     NEW_NAME | CLOSE, ARCHIVE),
+    # Names outside ASCII, one with a surrogate pair and one with an
+    # unpaired surrogate.
+    (file_id(111, 1), DOCS, 'Ünï \U0001f600.txt', CREATE, ARCHIVE),
+    (file_id(111, 1), DOCS, 'Ünï \U0001f600.txt',
+     CREATE | CLOSE, ARCHIVE),
+    (file_id(114, 1), DOCS, 'bad\ud800.txt', CREATE | CLOSE, ARCHIVE),
+    # Written and renamed in its directory.
+    (file_id(112, 1), ARCHIVE_DIRECTORY, 'notes.txt', OVERWRITE, ARCHIVE),
+    (file_id(112, 1), ARCHIVE_DIRECTORY, 'notes.txt',
+     OVERWRITE | CLOSE, ARCHIVE),
+    (file_id(112, 1), ARCHIVE_DIRECTORY, 'notes.txt', OLD_NAME, ARCHIVE),
+    (file_id(112, 1), ARCHIVE_DIRECTORY, 'notes.bak', NEW_NAME, ARCHIVE),
+    (file_id(112, 1), ARCHIVE_DIRECTORY, 'notes.bak',
+     NEW_NAME | CLOSE, ARCHIVE),
+    # A directory which becomes a junction.
+    (JUNCTION, ROOT, 'Junction', REPARSE_POINT | CLOSE, DIRECTORY),
+]
+
+# The changes of a volume which tracks the ranges of the writes, where the
+# records of version 4 come with those of version 3. A record of version 4
+# is (file, parent, reason, remaining extents, extent size, extents).
+RANGE_CHANGES = [
+    (file_id(120, 1), DOCS, OVERWRITE, 0, 16, [(4096, 4096)]),
+    (file_id(120, 1), DOCS, 'data.bin', OVERWRITE | CLOSE, ARCHIVE),
+    (file_id(106, 1), ARCHIVE_DIRECTORY, 'log.txt', EXTEND, ARCHIVE),
+    (file_id(106, 1), ARCHIVE_DIRECTORY, EXTEND | CLOSE, 1, 16,
+     [(0, 4096), (8192, 100)]),
+    # A larger extent, whose fields after the first 16 bytes are unknown.
+    (file_id(106, 1), ARCHIVE_DIRECTORY, EXTEND | CLOSE, 0, 24,
+     [(65536, 1000)]),
+    (file_id(106, 1), ARCHIVE_DIRECTORY, 'log.txt', EXTEND | CLOSE, ARCHIVE),
+    # Records of version 4 alone have no names.
+    (file_id(121, 1), ARCHIVE_DIRECTORY, OVERWRITE | CLOSE, 0, 16, [(0, 10)]),
+    (file_id(122, 1), DOCS, TRUNCATION | CLOSE, 0, 16, []),
+]
+
+# The changes of a ReFS volume, whose file IDs have 128 bits.
+REFS_CHANGES = [
+    ((0x10, 0x1), (0x5, 0x1), 'refs.txt', CREATE, ARCHIVE),
+    ((0x10, 0x1), (0x5, 0x1), 'refs.txt', CREATE | CLOSE, ARCHIVE),
+    ((0x20, 0x0), (0x5, 0x0), 'other.txt', DELETE | CLOSE, ARCHIVE),
+]
+
+
+def pad(record):
+    return record + b'\0' * (-len(record) % 8)
+
+
+def split_id(value):
+    if isinstance(value, tuple):
+        return value
+    return (value, 0)
+
+
+def record_v2(usn, time, file, parent, name, reason, attributes):
+    encoded = name.encode('utf-16-le', 'surrogatepass')
+    body = struct.pack(
+        '<QQqqIIIIHH',
+        file,
+        parent,
+        usn,
+        time,
+        reason,
+        0,
+        0,
+        attributes,
+        len(encoded),
+        60) + encoded
+    body = pad(struct.pack('<IHH', 0, 2, 0) + body)
+    return struct.pack('<I', len(body)) + body[4:]
+
+
+def record_v3(usn, time, file, parent, name, reason, attributes):
+    encoded = name.encode('utf-16-le', 'surrogatepass')
+    file_low, file_high = split_id(file)
+    parent_low, parent_high = split_id(parent)
+    body = struct.pack(
+        '<QQQQqqIIIIHH',
+        file_low,
+        file_high,
+        parent_low,
+        parent_high,
+        usn,
+        time,
+        reason,
+        0,
+        0,
+        attributes,
+        len(encoded),
+        76) + encoded
+    body = pad(struct.pack('<IHH', 0, 3, 0) + body)
+    return struct.pack('<I', len(body)) + body[4:]
+
+
+def record_v4(usn, file, parent, reason, remaining, extent_size, extents):
+    body = struct.pack(
+        '<QQQQqIIIHH',
+        file,
+        0,
+        parent,
+        0,
+        usn,
+        reason,
+        0,
+        remaining,
+        len(extents),
+        extent_size)
+    for offset, length in extents:
+        extent = struct.pack('<qq', offset, length)
+        body += extent + b'\0' * (extent_size - len(extent))
+    body = pad(struct.pack('<IHH', 0, 4, 0) + body)
+    return struct.pack('<I', len(body)) + body[4:]
+
+
+def write_dump(name, changes, encode):
+    dump = b''
+    usn = FIRST_USN
+    for index, change in enumerate(changes):
+        record = encode(usn, FIRST_TIME + index * 10000000, change)
+        dump += record
+        usn += len(record)
+    path = pathlib.Path(__file__).parent / name
+    path.write_bytes(dump)
+
+
+def encode_range_change(usn, time, change):
+    if isinstance(change[2], str):
+        return record_v3(usn, time, *change)
+    return record_v4(usn, *change)
+
+
+def main():
+    write_dump(
+        'V2.bin',
+        CHANGES,
+        lambda usn, time, change: record_v2(usn, time, *change))
+    write_dump(
+        'V3.bin',
+        CHANGES,
+        lambda usn, time, change: record_v3(usn, time, *change))
+    write_dump('V4.bin', RANGE_CHANGES, encode_range_change)
+    write_dump(
+        'ReFS.bin',
+        REFS_CHANGES,
+        lambda usn, time, change: record_v3(usn, time, *change))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,81 @@
+#
+# PROJECT:   NSudo Sweeper
+# FILE:      GenerateExpected.py
+# PURPOSE:   Generates the expected values of the TOML conformance corpus
+#
+# LICENSE:   The MIT License
+#
+# DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+#
+
+# Every document in Valid is parsed with tomllib of Python 3.11 or later, and
+# its values are written next to it as JSON in the form NSudoSweeperTomlTests
+# prints them. Every document in Invalid is checked to be rejected by tomllib,
+# except the ones listed below. Run it after adding a document:
+#
+#   python3 GenerateExpected.py
+
+import json
+import math
+import pathlib
+import sys
+import tomllib
+
+# TOML requires a parser to reject integers which do not fit in 64 bits,
+# which tomllib accepts.
+REJECTED_BY_TOML_ONLY = {'IntegerOverflow'}
+
+
+def convert(value):
+    if isinstance(value, dict):
+        return {key: convert(item) for key, item in value.items()}
+    if isinstance(value, list):
+        return [convert(item) for item in value]
+    if isinstance(value, bool):
+        return {'b': value}
+    if isinstance(value, int):
+        return {'i': value}
+    if isinstance(value, float):
+        if math.isnan(value):
+            return {'f': 'nan'}
+        if math.isinf(value):
+            return {'f': '-inf' if value < 0 else 'inf'}
+        return {'f': format(value, '.17g')}
+    if isinstance(value, str):
+        return {'s': value}
+
+    # The parser keeps date-times as their text, which tomllib does not, so
+    # only their type is compared.
+    return {'d': None}
+
+
+def main():
+    root = pathlib.Path(__file__).resolve().parent
+    failed = False
+
+    for path in sorted((root / 'Valid').glob('*.toml')):
+        text = path.read_bytes().decode('utf-8')
+        value = convert(tomllib.loads(text))
+        path.with_suffix('.json').write_text(
+            json.dumps(
+                value,
+                ensure_ascii=False,
+                sort_keys=True,
+                separators=(',', ':')) + '\n',
+            encoding='utf-8',
+            newline='\n')
+
+    for path in sorted((root / 'Invalid').glob('*.toml')):
+        try:
+            tomllib.loads(path.read_bytes().decode('utf-8'))
+        except (tomllib.TOMLDecodeError, UnicodeDecodeError):
+            continue
+        if path.stem not in REJECTED_BY_TOML_ONLY:
+            print(f'{path.name} is accepted by tomllib', file=sys.stderr)
+            failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
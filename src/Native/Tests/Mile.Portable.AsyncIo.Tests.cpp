@@ -0,0 +1,494 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.AsyncIo.Tests.cpp
+ * PURPOSE:   Implementation for the asynchronous file I/O queue tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.AsyncIo.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const std::size_t KiB = 1024;
+
+    std::string CreateContent(
+        std::size_t Size,
+        std::uint32_t Seed)
+    {
+        std::string Content(Size, '\0');
+        std::mt19937 Generator(Seed);
+        for (char& Byte : Content)
+        {
+            Byte = static_cast<char>(Generator() & 0xFF);
+        }
+        return Content;
+    }
+
+    void* ToUserData(
+        std::size_t Value)
+    {
+        return reinterpret_cast<void*>(static_cast<std::uintptr_t>(Value));
+    }
+
+    std::size_t FromUserData(
+        void* UserData)
+    {
+        return static_cast<std::size_t>(
+            reinterpret_cast<std::uintptr_t>(UserData));
+    }
+
+    /**
+     * Splits a range of a string into buffers of the given sizes. The last
+     * buffer takes what is left.
+     */
+    std::vector<Mile::AsyncIoBuffer> SplitBuffers(
+        std::string& Content,
+        std::vector<std::size_t> const& Sizes)
+    {
+        std::vector<Mile::AsyncIoBuffer> Buffers;
+        std::size_t Offset = 0;
+        for (std::size_t Size : Sizes)
+        {
+            Buffers.push_back(Mile::AsyncIoBuffer{ &Content[Offset], Size });
+            Offset += Size;
+        }
+        Buffers.push_back(Mile::AsyncIoBuffer{
+            &Content[Offset],
+            Content.size() - Offset });
+        return Buffers;
+    }
+
+    Mile::AsyncIoRequest CreateRequest(
+        Mile::AsyncIoFileHandle File,
+        Mile::AsyncIoOperation Operation,
+        std::uint64_t Offset,
+        std::vector<Mile::AsyncIoBuffer> const& Buffers,
+        std::size_t UserData)
+    {
+        Mile::AsyncIoRequest Request;
+        Request.File = File;
+        Request.Operation = Operation;
+        Request.Offset = Offset;
+        Request.Buffers = Buffers.empty() ? nullptr : Buffers.data();
+        Request.BufferCount = Buffers.size();
+        Request.UserData = ::ToUserData(UserData);
+        return Request;
+    }
+
+    /**
+     * Reaps the completions of all outstanding requests, indexed by their
+     * user data.
+     */
+    std::vector<Mile::AsyncIoCompletion> ReapAll(
+        Mile::AsyncIoQueue& Queue,
+        std::size_t Count)
+    {
+        std::vector<Mile::AsyncIoCompletion> Result(
+            Count,
+            Mile::AsyncIoCompletion{ nullptr, 0, -1 });
+        Mile::AsyncIoCompletion Completions[4];
+        std::size_t Reaped = 0;
+        for (;;)
+        {
+            std::size_t Current = Queue.Reap(Completions, 4, true);
+            if (!Current)
+            {
+                break;
+            }
+            for (std::size_t i = 0; i < Current; ++i)
+            {
+                std::size_t Index = ::FromUserData(Completions[i].UserData);
+                if (NSUDO_TEST_CHECK(Index < Count))
+                {
+                    Result[Index] = Completions[i];
+                }
+            }
+            Reaped += Current;
+        }
+        NSUDO_TEST_CHECK_EQUAL(Reaped, Count);
+        NSUDO_TEST_CHECK_EQUAL(Queue.GetOutstandingRequests(), 0U);
+        return Result;
+    }
+}
+
+NSUDO_TEST_CASE(GatherWriteAndScatterReadRoundTrip)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Path = Directory.Join("RoundTrip.bin");
+    Mile::AsyncIoQueue Queue;
+
+    std::string Content = ::CreateContent(200 * KiB + 7, 1);
+    {
+        Mile::AsyncIoFileHandle File;
+        NSUDO_TEST_CHECK_EQUAL(
+            Queue.OpenFile(Path, Mile::AsyncIoAccess::Write, File),
+            0);
+        std::vector<Mile::AsyncIoBuffer> Buffers =
+            ::SplitBuffers(Content, { 1, 4095, 70000, 3 });
+        Queue.Submit(::CreateRequest(
+            File,
+            Mile::AsyncIoOperation::Write,
+            0,
+            Buffers,
+            0));
+        std::vector<Mile::AsyncIoCompletion> Completions =
+            ::ReapAll(Queue, 1);
+        NSUDO_TEST_CHECK_EQUAL(Completions[0].ErrorCode, 0);
+        NSUDO_TEST_CHECK_EQUAL(Completions[0].Bytes, Content.size());
+        Mile::AsyncIoQueue::CloseFile(File);
+    }
+
+    std::string Written;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+    NSUDO_TEST_CHECK(Written == Content);
+
+    // Read it back with buffers of other sizes, and then overwrite the
+    // middle of the file.
+    Mile::AsyncIoFileHandle File;
+    NSUDO_TEST_CHECK_EQUAL(
+        Queue.OpenFile(Path, Mile::AsyncIoAccess::ReadWrite, File),
+        0);
+    std::uint64_t Size = 0;
+    NSUDO_TEST_CHECK_EQUAL(Mile::AsyncIoQueue::GetFileSize(File, Size), 0);
+    NSUDO_TEST_CHECK_EQUAL(Size, Content.size());
+
+    std::string Read(Content.size(), '\0');
+    std::vector<Mile::AsyncIoBuffer> ReadBuffers =
+        ::SplitBuffers(Read, { 10, 50000, 1, 8192 });
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Read,
+        0,
+        ReadBuffers,
+        0));
+
+    std::vector<Mile::AsyncIoCompletion> Completions =
+        ::ReapAll(Queue, 1);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].ErrorCode, 0);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].Bytes, Content.size());
+    NSUDO_TEST_CHECK(Read == Content);
+
+    std::string Patch = ::CreateContent(3 * KiB, 2);
+    std::vector<Mile::AsyncIoBuffer> PatchBuffers =
+        ::SplitBuffers(Patch, { KiB });
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Write,
+        100 * KiB,
+        PatchBuffers,
+        0));
+    Completions = ::ReapAll(Queue, 1);
+    Mile::AsyncIoQueue::CloseFile(File);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].ErrorCode, 0);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].Bytes, Patch.size());
+
+    Content.replace(100 * KiB, Patch.size(), Patch);
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+    NSUDO_TEST_CHECK(Written == Content);
+}
+
+NSUDO_TEST_CASE(ReadPastTheEndIsShort)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Path = Directory.Join("Short.bin");
+    const std::string Content = ::CreateContent(5000, 3);
+    NSudoTest::WriteFile(Path, Content);
+
+    // The small chunks make the reads span operations which end past the
+    // file, or start past it.
+    Mile::AsyncIoQueueOptions Options;
+    Options.ChunkSize = 4 * KiB;
+    Options.QueueDepth = 2;
+    Mile::AsyncIoQueue Queue(Options);
+    Mile::AsyncIoFileHandle File;
+    NSUDO_TEST_CHECK_EQUAL(
+        Queue.OpenFile(Path, Mile::AsyncIoAccess::Read, File),
+        0);
+
+    struct Case
+    {
+        std::uint64_t Offset;
+        std::size_t Size;
+        std::uint64_t Bytes;
+    };
+    const Case Cases[] =
+    {
+        { 0, 16 * KiB, 5000 },
+        { 4000, 8 * KiB, 1000 },
+        { 4999, 2, 1 },
+        { 5000, 4 * KiB, 0 },
+        { 1024 * KiB, 4 * KiB, 0 },
+    };
+    const std::size_t CaseCount = sizeof(Cases) / sizeof(Cases[0]);
+
+    std::vector<std::string> Reads;
+    std::vector<std::vector<Mile::AsyncIoBuffer>> Buffers;
+    for (Case const& Current : Cases)
+    {
+        Reads.emplace_back(Current.Size, '\0');
+    }
+    for (std::size_t i = 0; i < CaseCount; ++i)
+    {
+        Buffers.push_back(::SplitBuffers(Reads[i], {}));
+        Queue.Submit(::CreateRequest(
+            File,
+            Mile::AsyncIoOperation::Read,
+            Cases[i].Offset,
+            Buffers[i],
+            i));
+    }
+    std::vector<Mile::AsyncIoCompletion> Completions =
+        ::ReapAll(Queue, CaseCount);
+    Mile::AsyncIoQueue::CloseFile(File);
+
+    for (std::size_t i = 0; i < CaseCount; ++i)
+    {
+        NSUDO_TEST_CHECK_EQUAL(Completions[i].ErrorCode, 0);
+        if (NSUDO_TEST_CHECK_EQUAL(Completions[i].Bytes, Cases[i].Bytes))
+        {
+            std::size_t Bytes = static_cast<std::size_t>(Cases[i].Bytes);
+            NSUDO_TEST_CHECK(!Bytes || 0 == Reads[i].compare(
+                0,
+                Bytes,
+                Content,
+                static_cast<std::size_t>(Cases[i].Offset),
+                Bytes));
+        }
+    }
+}
+
+NSUDO_TEST_CASE(EmptyRequestsComplete)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Path = Directory.Join("Empty.bin");
+    NSudoTest::WriteFile(Path, "Content");
+
+    Mile::AsyncIoQueue Queue;
+    Mile::AsyncIoFileHandle File;
+    NSUDO_TEST_CHECK_EQUAL(
+        Queue.OpenFile(Path, Mile::AsyncIoAccess::ReadWrite, File),
+        0);
+
+    // No buffers, and buffers without bytes, transfer nothing and touch
+    // neither the file nor the memory.
+    const std::vector<Mile::AsyncIoBuffer> NoBuffers;
+    const std::vector<Mile::AsyncIoBuffer> EmptyBuffers =
+    {
+        Mile::AsyncIoBuffer{ nullptr, 0 },
+        Mile::AsyncIoBuffer{ nullptr, 0 },
+    };
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Read,
+        0,
+        NoBuffers,
+        0));
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Write,
+        0,
+        EmptyBuffers,
+        1));
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Read,
+        1024 * KiB,
+        EmptyBuffers,
+        2));
+    NSUDO_TEST_CHECK_EQUAL(Queue.GetOutstandingRequests(), 3U);
+
+    // They are completed when they are submitted, so even a reap which
+    // does not wait finds them.
+    Mile::AsyncIoCompletion Completions[4];
+    NSUDO_TEST_CHECK_EQUAL(Queue.Reap(Completions, 0, false), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Queue.Reap(Completions, 4, false), 3U);
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        NSUDO_TEST_CHECK_EQUAL(::FromUserData(Completions[i].UserData), i);
+        NSUDO_TEST_CHECK_EQUAL(Completions[i].Bytes, 0U);
+        NSUDO_TEST_CHECK_EQUAL(Completions[i].ErrorCode, 0);
+    }
+
+    // Nothing is outstanding, so waiting returns at once.
+    NSUDO_TEST_CHECK_EQUAL(Queue.GetOutstandingRequests(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Queue.Reap(Completions, 4, true), 0U);
+    Mile::AsyncIoQueue::CloseFile(File);
+
+    std::string Written;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+    NSUDO_TEST_CHECK_EQUAL(Written, "Content");
+}
+
+NSUDO_TEST_CASE(RequestsAreSplitIntoChunks)
+{
+    // The chunk size is clamped to 4 KiB, so every request below is split
+    // into many operations, which run a few at a time.
+    const std::size_t ChunkSizes[] = { 1, 4 * KiB, 12 * KiB + 5 };
+    const std::size_t QueueDepths[] = { 0, 1, 3 };
+    std::uint32_t Seed = 10;
+    for (std::size_t ChunkSize : ChunkSizes)
+    {
+        for (std::size_t QueueDepth : QueueDepths)
+        {
+            NSudoTest::TemporaryDirectory Directory;
+            const std::string Path = Directory.Join("Chunks.bin");
+
+            Mile::AsyncIoQueueOptions Options;
+            Options.ChunkSize = ChunkSize;
+            Options.QueueDepth = QueueDepth;
+            Mile::AsyncIoQueue Queue(Options);
+
+            // One large request whose buffers cross the chunk boundaries,
+            // followed by small requests for the rest of the file.
+            const std::size_t LargeSize = 256 * KiB + 123;
+            const std::size_t SmallSize = 3 * KiB;
+            const std::size_t SmallCount = 20;
+            std::string Content = ::CreateContent(
+                LargeSize + SmallSize * SmallCount,
+                ++Seed);
+
+            Mile::AsyncIoFileHandle File;
+            NSUDO_TEST_CHECK_EQUAL(
+                Queue.OpenFile(Path, Mile::AsyncIoAccess::Write, File),
+                0);
+            std::string Large = Content.substr(0, LargeSize);
+            std::vector<Mile::AsyncIoBuffer> LargeBuffers =
+                ::SplitBuffers(Large, { 100, 4096, 4000, 9000, 65536, 1 });
+            Queue.Submit(::CreateRequest(
+                File,
+                Mile::AsyncIoOperation::Write,
+                0,
+                LargeBuffers,
+                0));
+
+            std::vector<std::string> Smalls;
+            std::vector<std::vector<Mile::AsyncIoBuffer>> SmallBuffers;
+            for (std::size_t i = 0; i < SmallCount; ++i)
+            {
+                Smalls.push_back(Content.substr(
+                    LargeSize + i * SmallSize,
+                    SmallSize));
+            }
+            for (std::size_t i = 0; i < SmallCount; ++i)
+            {
+                SmallBuffers.push_back(::SplitBuffers(Smalls[i], {}));
+                Queue.Submit(::CreateRequest(
+                    File,
+                    Mile::AsyncIoOperation::Write,
+                    LargeSize + i * SmallSize,
+                    SmallBuffers[i],
+                    i + 1));
+            }
+
+            std::vector<Mile::AsyncIoCompletion> Completions =
+                ::ReapAll(Queue, SmallCount + 1);
+            Mile::AsyncIoQueue::CloseFile(File);
+            NSUDO_TEST_CHECK_EQUAL(Completions[0].ErrorCode, 0);
+            NSUDO_TEST_CHECK_EQUAL(Completions[0].Bytes, LargeSize);
+            for (std::size_t i = 1; i <= SmallCount; ++i)
+            {
+                NSUDO_TEST_CHECK_EQUAL(Completions[i].ErrorCode, 0);
+                NSUDO_TEST_CHECK_EQUAL(Completions[i].Bytes, SmallSize);
+            }
+
+            std::string Written;
+            NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+            NSUDO_TEST_CHECK(Written == Content);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(DestroyingTheQueueCompletesRequestsInFlight)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Path = Directory.Join("InFlight.bin");
+
+    const std::size_t RequestSize = 64 * KiB;
+    const std::size_t RequestCount = 64;
+    std::string Content = ::CreateContent(RequestSize * RequestCount, 4);
+    std::vector<std::vector<Mile::AsyncIoBuffer>> Buffers;
+
+    Mile::AsyncIoFileHandle File;
+    {
+        Mile::AsyncIoQueueOptions Options;
+        Options.ChunkSize = 16 * KiB;
+        Options.QueueDepth = 2;
+        Mile::AsyncIoQueue Queue(Options);
+        NSUDO_TEST_CHECK_EQUAL(
+            Queue.OpenFile(Path, Mile::AsyncIoAccess::Write, File),
+            0);
+        for (std::size_t i = 0; i < RequestCount; ++i)
+        {
+            Buffers.push_back(std::vector<Mile::AsyncIoBuffer>{
+                Mile::AsyncIoBuffer{
+                    &Content[i * RequestSize],
+                    RequestSize } });
+            Queue.Submit(::CreateRequest(
+                File,
+                Mile::AsyncIoOperation::Write,
+                i * RequestSize,
+                Buffers.back(),
+                i));
+        }
+
+        // Leave the completions unreaped. The destructor waits for the
+        // operations, since the buffers are the caller's.
+        NSUDO_TEST_CHECK(Queue.GetOutstandingRequests() > 0);
+    }
+    Mile::AsyncIoQueue::CloseFile(File);
+
+    std::string Written;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+    NSUDO_TEST_CHECK(Written == Content);
+}
+
+NSUDO_TEST_CASE(ErrorsAreReported)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Path = Directory.Join("Errors.bin");
+    NSudoTest::WriteFile(Path, "Content");
+
+    Mile::AsyncIoQueue Queue;
+    Mile::AsyncIoFileHandle File;
+    NSUDO_TEST_CHECK_EQUAL(
+        Queue.OpenFile(
+            Directory.Join("Missing.bin"),
+            Mile::AsyncIoAccess::Read,
+            File),
+        ENOENT);
+    NSUDO_TEST_CHECK_EQUAL(File, -1);
+    NSUDO_TEST_CHECK_EQUAL(Queue.AttachFile(-1), EBADF);
+
+    // A write to a file which is open for reading fails, and the error is
+    // the one of the request.
+    NSUDO_TEST_CHECK_EQUAL(
+        Queue.OpenFile(Path, Mile::AsyncIoAccess::Read, File),
+        0);
+    std::string Data = ::CreateContent(12 * KiB, 5);
+    std::vector<Mile::AsyncIoBuffer> Buffers = ::SplitBuffers(Data, {});
+    Queue.Submit(::CreateRequest(
+        File,
+        Mile::AsyncIoOperation::Write,
+        0,
+        Buffers,
+        0));
+    std::vector<Mile::AsyncIoCompletion> Completions = ::ReapAll(Queue, 1);
+    Mile::AsyncIoQueue::CloseFile(File);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].ErrorCode, EBADF);
+    NSUDO_TEST_CHECK_EQUAL(Completions[0].Bytes, 0U);
+
+    std::string Written;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Written));
+    NSUDO_TEST_CHECK_EQUAL(Written, "Content");
+}
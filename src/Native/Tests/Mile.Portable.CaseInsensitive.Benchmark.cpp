@@ -0,0 +1,288 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.CaseInsensitive.Benchmark.cpp
+ * PURPOSE:   Implementation for the case-insensitive comparison benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.CaseInsensitive.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cwctype>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#include <cstring>
+#include <cwchar>
+#define NSUDO_TEST_STRICMP _stricmp
+#define NSUDO_TEST_WCSICMP _wcsicmp
+#else
+#include <strings.h>
+#include <wchar.h>
+#define NSUDO_TEST_STRICMP strcasecmp
+#define NSUDO_TEST_WCSICMP wcscasecmp
+#endif
+
+// This file is built twice, with the SSE2 path and with the scalar path
+// only, so the two builds print comparable measurements.
+
+#if defined(MILE_CASE_INSENSITIVE_NO_SSE2)
+#define NSUDO_TEST_PATH_NAME " (scalar)"
+#else
+#define NSUDO_TEST_PATH_NAME " (default)"
+#endif
+
+namespace
+{
+    /**
+     * The sum of the results of the measured functions, which is printed so
+     * the optimizer cannot drop the work.
+     */
+    std::size_t g_Checksum = 0;
+
+    /**
+     * Creates paths which look like the ones the cleanup handlers see.
+     */
+    std::vector<std::wstring> CreatePaths(
+        std::size_t Count,
+        bool NonAscii)
+    {
+        const wchar_t* const Components[] =
+        {
+            L"Windows", L"System32", L"WinSxS", L"Temp", L"Users",
+            L"AppData", L"Local", L"Microsoft", L"Windows", L"INetCache",
+            L"SoftwareDistribution", L"Download", L"Logs", L"CBS",
+            L"Prefetch", L"DriverStore", L"FileRepository", L"Packages",
+        };
+
+        std::mt19937 Generator(42);
+        std::uniform_int_distribution<std::size_t> PickComponent(
+            0,
+            sizeof(Components) / sizeof(*Components) - 1);
+        std::uniform_int_distribution<int> PickDepth(3, 8);
+
+        std::vector<std::wstring> Result;
+        Result.reserve(Count);
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::wstring Path = L"C:";
+            for (int Depth = PickDepth(Generator); Depth; --Depth)
+            {
+                Path += L'\\';
+                Path += Components[PickComponent(Generator)];
+            }
+            Path += L'\\';
+            if (NonAscii)
+            {
+                Path += L"\x00C9l\x00E9ment-";
+            }
+            Path += std::to_wstring(Generator()) + L".tmp";
+            Result.push_back(std::move(Path));
+        }
+
+        return Result;
+    }
+
+    std::wstring ToOtherCase(
+        std::wstring const& Path)
+    {
+        std::wstring Result = Path;
+        for (wchar_t& Character : Result)
+        {
+            Character = std::iswupper(Character)
+                ? std::towlower(Character)
+                : std::towupper(Character);
+        }
+        return Result;
+    }
+
+    std::string ToNarrow(
+        std::wstring const& Path)
+    {
+        std::string Result;
+        for (wchar_t Character : Path)
+        {
+            Result.push_back(static_cast<char>(Character));
+        }
+        return Result;
+    }
+
+    template<typename FunctionType>
+    void Measure(
+        std::string const& Name,
+        std::size_t Repeat,
+        std::size_t Characters,
+        FunctionType&& Function)
+    {
+        NSudoTest::Stopwatch Timer;
+        std::size_t Checksum = 0;
+        for (std::size_t i = 0; i < Repeat; ++i)
+        {
+            Checksum += Function();
+        }
+        double Seconds = Timer.GetSeconds();
+
+        NSudoTest::PrintMeasurement(
+            Name + NSUDO_TEST_PATH_NAME,
+            Seconds,
+            static_cast<double>(Repeat * Characters),
+            "chars");
+
+        g_Checksum += Checksum;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t PathCount = Options.Quick ? 2000 : 200000;
+    const std::size_t Repeat = Options.Quick ? 1 : 10;
+
+    for (bool NonAscii : { false, true })
+    {
+        std::vector<std::wstring> Paths = ::CreatePaths(PathCount, NonAscii);
+        std::vector<std::wstring> OtherPaths;
+        std::vector<std::string> NarrowPaths;
+        std::vector<std::string> OtherNarrowPaths;
+        std::size_t Characters = 0;
+        for (std::wstring const& Path : Paths)
+        {
+            OtherPaths.push_back(::ToOtherCase(Path));
+            NarrowPaths.push_back(::ToNarrow(Path));
+            OtherNarrowPaths.push_back(::ToNarrow(OtherPaths.back()));
+            Characters += Path.size();
+        }
+
+        std::string Kind = NonAscii ? "non-ASCII" : "ASCII";
+
+        // Equal strings in other cases, which is the worst case because
+        // every character is compared.
+        ::Measure(
+            "Equals, wide, " + Kind,
+            Repeat,
+            Characters,
+            [&]()
+        {
+            std::size_t Count = 0;
+            for (std::size_t i = 0; i < PathCount; ++i)
+            {
+                Count += Mile::CaseInsensitiveEquals(
+                    std::wstring_view(Paths[i]),
+                    std::wstring_view(OtherPaths[i]));
+            }
+            if (Count != PathCount)
+            {
+                NSUDO_TEST_CHECK_EQUAL(Count, PathCount);
+            }
+            return Count;
+        });
+
+        ::Measure(
+            "wcscasecmp, wide, " + Kind,
+            Repeat,
+            Characters,
+            [&]()
+        {
+            std::size_t Count = 0;
+            for (std::size_t i = 0; i < PathCount; ++i)
+            {
+                Count += 0 == NSUDO_TEST_WCSICMP(
+                    Paths[i].c_str(),
+                    OtherPaths[i].c_str());
+            }
+            return Count;
+        });
+
+        ::Measure(
+            "Equals, narrow, " + Kind,
+            Repeat,
+            Characters,
+            [&]()
+        {
+            std::size_t Count = 0;
+            for (std::size_t i = 0; i < PathCount; ++i)
+            {
+                Count += Mile::CaseInsensitiveEquals(
+                    std::string_view(NarrowPaths[i]),
+                    std::string_view(OtherNarrowPaths[i]));
+            }
+            if (Count != PathCount)
+            {
+                NSUDO_TEST_CHECK_EQUAL(Count, PathCount);
+            }
+            return Count;
+        });
+
+        ::Measure(
+            "strcasecmp, narrow, " + Kind,
+            Repeat,
+            Characters,
+            [&]()
+        {
+            std::size_t Count = 0;
+            for (std::size_t i = 0; i < PathCount; ++i)
+            {
+                Count += 0 == NSUDO_TEST_STRICMP(
+                    NarrowPaths[i].c_str(),
+                    OtherNarrowPaths[i].c_str());
+            }
+            return Count;
+        });
+
+        ::Measure(
+            "Hash, wide, " + Kind,
+            Repeat,
+            2 * Characters,
+            [&]()
+        {
+            std::size_t Result = 0;
+            for (std::size_t i = 0; i < PathCount; ++i)
+            {
+                std::size_t Hash = Mile::CaseInsensitiveHash(
+                    std::wstring_view(Paths[i]));
+                if (Hash != Mile::CaseInsensitiveHash(
+                    std::wstring_view(OtherPaths[i])))
+                {
+                    NSUDO_TEST_CHECK(!"The hash depends on the case.");
+                }
+                Result ^= Hash;
+            }
+            return Result;
+        });
+
+        std::vector<std::wstring> Sorted = OtherPaths;
+        NSudoTest::Stopwatch Timer;
+        std::sort(
+            Sorted.begin(),
+            Sorted.end(),
+            Mile::CaseInsensitiveLess());
+        NSudoTest::PrintMeasurement(
+            "Sort, wide, " + Kind + NSUDO_TEST_PATH_NAME,
+            Timer.GetSeconds(),
+            static_cast<double>(PathCount),
+            "paths");
+        NSUDO_TEST_CHECK(std::is_sorted(
+            Sorted.begin(),
+            Sorted.end(),
+            Mile::CaseInsensitiveLess()));
+    }
+
+    std::printf("\nChecksum: %zx\n", g_Checksum);
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
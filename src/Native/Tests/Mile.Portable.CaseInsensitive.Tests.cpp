@@ -0,0 +1,291 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.CaseInsensitive.Tests.cpp
+ * PURPOSE:   Implementation for the case-insensitive comparison tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.CaseInsensitive.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// This file is built twice, with the SSE2 path and with the scalar path
+// only, so both are checked against the same reference.
+
+namespace
+{
+    /**
+     * The definition of the comparison, one folded code unit at a time.
+     */
+    template<typename CharType>
+    int ReferenceCompare(
+        std::basic_string_view<CharType> Left,
+        std::basic_string_view<CharType> Right)
+    {
+        using UnitType = typename std::make_unsigned<CharType>::type;
+
+        std::size_t Length = (std::min)(Left.size(), Right.size());
+        for (std::size_t i = 0; i < Length; ++i)
+        {
+            UnitType LeftUnit = static_cast<UnitType>(
+                Mile::CaseInsensitiveFold(Left[i]));
+            UnitType RightUnit = static_cast<UnitType>(
+                Mile::CaseInsensitiveFold(Right[i]));
+            if (LeftUnit != RightUnit)
+            {
+                return LeftUnit < RightUnit ? -1 : 1;
+            }
+        }
+
+        if (Left.size() == Right.size())
+        {
+            return 0;
+        }
+
+        return Left.size() < Right.size() ? -1 : 1;
+    }
+
+    int Sign(
+        int Value)
+    {
+        return (Value > 0) - (Value < 0);
+    }
+
+    /**
+     * Pairs of characters which are equal without regard to case, and
+     * characters without another case.
+     */
+    template<typename CharType>
+    std::vector<std::pair<CharType, CharType>> GetAlphabet()
+    {
+        std::vector<std::pair<CharType, CharType>> Result;
+        for (CharType Letter = 'a'; Letter <= 'z'; ++Letter)
+        {
+            Result.emplace_back(Letter, static_cast<CharType>(Letter - 0x20));
+        }
+
+        for (char Other : std::string_view("0189 ._-\\/:@[`{~"))
+        {
+            Result.emplace_back(Other, Other);
+        }
+
+        if constexpr (sizeof(CharType) == 1)
+        {
+            // Bytes of UTF-8 sequences are compared as they are.
+            for (int Byte : { 0x80, 0xA9, 0xC3, 0xC9, 0xE9, 0xFF })
+            {
+                Result.emplace_back(
+                    static_cast<CharType>(Byte),
+                    static_cast<CharType>(Byte));
+            }
+        }
+        else
+        {
+            const std::pair<int, int> Pairs[] =
+            {
+                { 0x00E9, 0x00C9 }, // é and É
+                { 0x00FF, 0x0178 }, // ÿ and Ÿ
+                { 0x0101, 0x0100 }, // ā and Ā
+                { 0x03C3, 0x03A3 }, // σ and Σ
+                { 0x03C2, 0x03A3 }, // ς and Σ
+                { 0x0434, 0x0414 }, // д and Д
+                { 0x1F00, 0x1F08 }, // ἀ and Ἀ
+                { 0xFF41, 0xFF21 }, // ａ and Ａ
+                { 0x00DF, 0x00DF }, // ß has no single uppercase letter
+                { 0x4E2D, 0x4E2D }, // 中
+                { 0xFFFF, 0xFFFF },
+            };
+            for (std::pair<int, int> const& Pair : Pairs)
+            {
+                Result.emplace_back(
+                    static_cast<CharType>(Pair.first),
+                    static_cast<CharType>(Pair.second));
+            }
+        }
+
+        return Result;
+    }
+
+    template<typename CharType>
+    void CheckAgainstReference(
+        std::basic_string_view<CharType> Left,
+        std::basic_string_view<CharType> Right)
+    {
+        int Expected = ::ReferenceCompare(Left, Right);
+
+        if (!NSUDO_TEST_CHECK_EQUAL(
+            ::Sign(Mile::CaseInsensitiveCompare(Left, Right)),
+            Expected))
+        {
+            return;
+        }
+
+        NSUDO_TEST_CHECK_EQUAL(
+            ::Sign(Mile::CaseInsensitiveCompare(Right, Left)),
+            -Expected);
+        NSUDO_TEST_CHECK_EQUAL(
+            Mile::CaseInsensitiveEquals(Left, Right),
+            0 == Expected);
+
+        bool IsPrefix = Left.size() >= Right.size() && 0 == ::ReferenceCompare(
+            Left.substr(0, Right.size()),
+            Right);
+        NSUDO_TEST_CHECK_EQUAL(
+            Mile::CaseInsensitiveStartsWith(Left, Right),
+            IsPrefix);
+
+        if (0 == Expected)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Mile::CaseInsensitiveHash(Left),
+                Mile::CaseInsensitiveHash(Right));
+        }
+    }
+
+    template<typename CharType>
+    void RunDifferentialTest()
+    {
+        std::vector<std::pair<CharType, CharType>> Alphabet =
+            ::GetAlphabet<CharType>();
+
+        std::mt19937 Generator(0x4D696C65);
+        std::uniform_int_distribution<std::size_t> PickLength(0, 80);
+        std::uniform_int_distribution<std::size_t> PickCharacter(
+            0,
+            Alphabet.size() - 1);
+        std::uniform_int_distribution<int> PickPercent(0, 99);
+
+        // The strings start at every offset in a block, so the loads are
+        // unaligned and the differences fall everywhere in the blocks.
+        std::basic_string<CharType> LeftBuffer;
+        std::basic_string<CharType> RightBuffer;
+
+        for (int Iteration = 0; Iteration < 20000; ++Iteration)
+        {
+            std::size_t Offset = static_cast<std::size_t>(Iteration % 16);
+            std::size_t Length = PickLength(Generator);
+
+            LeftBuffer.assign(Offset, CharType('#'));
+            RightBuffer.assign(Offset / 2, CharType('#'));
+            for (std::size_t i = 0; i < Length; ++i)
+            {
+                std::pair<CharType, CharType> const& Pair =
+                    Alphabet[PickCharacter(Generator)];
+                LeftBuffer.push_back(
+                    PickPercent(Generator) < 50 ? Pair.first : Pair.second);
+                RightBuffer.push_back(
+                    PickPercent(Generator) < 50 ? Pair.first : Pair.second);
+            }
+
+            // Most pairs are equal, the others differ at a random place or
+            // in their length.
+            int Mutation = PickPercent(Generator);
+            if (Length && Mutation < 30)
+            {
+                std::size_t Index =
+                    Offset / 2 + PickLength(Generator) % Length;
+                RightBuffer[Index] = Alphabet[PickCharacter(Generator)].first;
+            }
+            else if (Length && Mutation < 40)
+            {
+                RightBuffer.resize(
+                    RightBuffer.size() - 1 - PickLength(Generator) % Length);
+            }
+
+            std::basic_string_view<CharType> Left(LeftBuffer);
+            std::basic_string_view<CharType> Right(RightBuffer);
+            ::CheckAgainstReference(
+                Left.substr(Offset),
+                Right.substr(Offset / 2));
+        }
+    }
+}
+
+NSUDO_TEST_CASE(FoldCharacters)
+{
+    NSUDO_TEST_CHECK_EQUAL(Mile::CaseInsensitiveFold('a'), 'A');
+    NSUDO_TEST_CHECK_EQUAL(Mile::CaseInsensitiveFold('Z'), 'Z');
+    NSUDO_TEST_CHECK_EQUAL(Mile::CaseInsensitiveFold('@'), '@');
+    NSUDO_TEST_CHECK_EQUAL(Mile::CaseInsensitiveFold('{'), '{');
+    NSUDO_TEST_CHECK_EQUAL(
+        Mile::CaseInsensitiveFold(static_cast<char>(0xE9)),
+        static_cast<char>(0xE9));
+
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'a') == L'A');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\x00E9') == L'\x00C9');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\x00FF') == L'\x0178');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\x03C2') == L'\x03A3');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\x00DF') == L'\x00DF');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\x0131') == L'I');
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveFold(L'\xFF5A') == L'\xFF3A');
+}
+
+NSUDO_TEST_CASE(CompareExamples)
+{
+    using namespace std::string_view_literals;
+
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveEquals(
+        L"C:\\Windows\\System32\\DriverStore\\FileRepository"sv,
+        L"c:\\WINDOWS\\system32\\driverstore\\filerepository"sv));
+    NSUDO_TEST_CHECK(!Mile::CaseInsensitiveEquals(
+        L"C:\\Windows\\Temp"sv,
+        L"C:\\Windows\\Tmp"sv));
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveStartsWith(
+        L"C:\\Users\\Public\\Desktop"sv,
+        L"c:\\users\\"sv));
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveEquals(
+        L"\x00C9t\x00E9 \x03A3\x03C3"sv,
+        L"\x00E9T\x00C9 \x03C3\x03A3"sv));
+
+    // The order is the order of the uppercase letters, so '_' is greater
+    // than the letters, as in _wcsicmp.
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveCompare("abc"sv, "ABD"sv) < 0);
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveCompare("a_"sv, "aZ"sv) > 0);
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveCompare("ab"sv, "ABC"sv) < 0);
+    NSUDO_TEST_CHECK(Mile::CaseInsensitiveCompare(""sv, ""sv) == 0);
+
+    Mile::CaseInsensitiveLess Less;
+    NSUDO_TEST_CHECK(Less(L"alpha"sv, L"BETA"sv));
+    NSUDO_TEST_CHECK(!Less(L"BETA"sv, L"alpha"sv));
+}
+
+NSUDO_TEST_CASE(NarrowAgainstReference)
+{
+    ::RunDifferentialTest<char>();
+}
+
+NSUDO_TEST_CASE(WideAgainstReference)
+{
+    ::RunDifferentialTest<wchar_t>();
+}
+
+NSUDO_TEST_CASE(HashIsTheSameOnBothPaths)
+{
+    // The SSE2 and the scalar paths fold the same blocks, so both builds of
+    // this test expect the same values.
+    using namespace std::string_view_literals;
+
+    if constexpr (sizeof(std::size_t) == 8 && sizeof(wchar_t) == 4)
+    {
+        NSUDO_TEST_CHECK_EQUAL(
+            Mile::CaseInsensitiveHash(
+                "c:\\windows\\SoftwareDistribution\\Download\\x.cab"sv),
+            static_cast<std::size_t>(0xA64A3C6D17693B83ULL));
+        NSUDO_TEST_CHECK_EQUAL(
+            Mile::CaseInsensitiveHash(
+                L"C:\\Users\\\x00C9lodie\\AppData\\Local\\Temp\\a.tmp"sv),
+            static_cast<std::size_t>(0xC5AC38B85473E938ULL));
+    }
+}
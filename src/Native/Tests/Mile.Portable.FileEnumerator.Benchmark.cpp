@@ -0,0 +1,196 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.FileEnumerator.Benchmark.cpp
+ * PURPOSE:   Implementation for the directory enumerator benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.FileEnumerator.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    void CreateFiles(
+        NSudoTest::TemporaryDirectory const& Directory,
+        std::size_t Count)
+    {
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::string Path = Directory.Join(
+                "Cache-" + std::to_string(i) + "-" +
+                std::to_string(i * 2654435761U % 1000003) + ".tmp");
+            int Handle = ::open(
+                Path.c_str(),
+                O_WRONLY | O_CREAT | O_CLOEXEC,
+                0644);
+            if (Handle != -1)
+            {
+                ::close(Handle);
+            }
+        }
+    }
+
+    std::size_t EnumerateWithFileEnumerator(
+        std::string const& Path,
+        std::size_t BufferSize)
+    {
+        std::size_t Count = 0;
+
+        Mile::FileEnumerator Enumerator(BufferSize);
+        if (!Enumerator.Open(Path))
+        {
+            return 0;
+        }
+
+        Mile::FileEnumeratorBatch Batch;
+        while (Enumerator.NextBatch(Batch))
+        {
+            for (Mile::FileEnumeratorEntry Entry : Batch)
+            {
+                Count += Entry.GetType() == Mile::FileEntryType::File;
+            }
+        }
+
+        return Count;
+    }
+
+    std::size_t EnumerateWithReadDirectory(
+        std::string const& Path)
+    {
+        std::size_t Count = 0;
+
+        DIR* Directory = ::opendir(Path.c_str());
+        if (!Directory)
+        {
+            return 0;
+        }
+
+        while (dirent* Entry = ::readdir(Directory))
+        {
+            Count += Entry->d_type == DT_REG;
+        }
+
+        ::closedir(Directory);
+        return Count;
+    }
+
+    std::size_t EnumerateWithDirectoryIterator(
+        std::string const& Path)
+    {
+        std::size_t Count = 0;
+
+        for (std::filesystem::directory_entry const& Entry
+            : std::filesystem::directory_iterator(Path))
+        {
+            // The type is cached from the directory entry, so this does
+            // not query the file.
+            Count += Entry.is_regular_file();
+        }
+
+        return Count;
+    }
+
+    template<typename FunctionType>
+    void Measure(
+        char const* Name,
+        std::size_t Repeat,
+        std::size_t Expected,
+        FunctionType&& Function)
+    {
+        // Warm the directory cache first, so all methods read from it.
+        NSUDO_TEST_CHECK_EQUAL(Function(), Expected);
+
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < Repeat; ++i)
+        {
+            if (Function() != Expected)
+            {
+                NSUDO_TEST_CHECK(!"The number of entries changed.");
+            }
+        }
+
+        NSudoTest::PrintMeasurement(
+            Name,
+            Timer.GetSeconds(),
+            static_cast<double>(Repeat * Expected),
+            "entries");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t FileCount = Options.Quick ? 2000 : 200000;
+    const std::size_t Repeat = Options.Quick ? 2 : 10;
+
+    NSudoTest::TemporaryDirectory Directory;
+    ::CreateFiles(Directory, FileCount);
+    std::string const& Path = Directory.GetPath();
+
+    std::printf("%zu files in %s\n\n", FileCount, Path.c_str());
+
+    ::Measure(
+        "FileEnumerator, 4 KiB buffer",
+        Repeat,
+        FileCount,
+        [&]()
+    {
+        return ::EnumerateWithFileEnumerator(
+            Path,
+            Mile::FileEnumerator::MinimumBufferSize);
+    });
+    ::Measure(
+        "FileEnumerator, 64 KiB buffer",
+        Repeat,
+        FileCount,
+        [&]()
+    {
+        return ::EnumerateWithFileEnumerator(
+            Path,
+            Mile::FileEnumerator::DefaultBufferSize);
+    });
+    ::Measure(
+        "FileEnumerator, 1 MiB buffer",
+        Repeat,
+        FileCount,
+        [&]()
+    {
+        return ::EnumerateWithFileEnumerator(Path, 1024 * 1024);
+    });
+    ::Measure(
+        "readdir",
+        Repeat,
+        FileCount,
+        [&]()
+    {
+        return ::EnumerateWithReadDirectory(Path);
+    });
+    ::Measure(
+        "std::filesystem::directory_iterator",
+        Repeat,
+        FileCount,
+        [&]()
+    {
+        return ::EnumerateWithDirectoryIterator(Path);
+    });
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.FileEnumerator.Tests.cpp
+ * PURPOSE:   Implementation for the directory enumerator tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.FileEnumerator.h"
+
+#include <cerrno>
+#include <map>
+#include <set>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    struct ExpectedEntry
+    {
+        Mile::FileEntryType Type;
+        std::uint64_t FileId;
+    };
+
+    using EntryMap = std::map<std::string, ExpectedEntry>;
+
+    std::uint64_t GetFileId(
+        std::string const& Path)
+    {
+        struct stat Status;
+        if (0 != ::lstat(Path.c_str(), &Status))
+        {
+            return 0;
+        }
+        return static_cast<std::uint64_t>(Status.st_ino);
+    }
+
+    /**
+     * Creates the entries of every type, with names of every length up to
+     * the longest name the file system allows.
+     */
+    EntryMap CreateEntries(
+        NSudoTest::TemporaryDirectory const& Directory,
+        std::size_t FileCount)
+    {
+        EntryMap Result;
+
+        for (std::size_t i = 0; i < FileCount; ++i)
+        {
+            std::string Name = "File" + std::to_string(i) + "-";
+            Name.append(i % 246, static_cast<char>('a' + i % 26));
+            NSudoTest::WriteFile(Directory.Join(Name), Name);
+            Result[Name] = { Mile::FileEntryType::File, 0 };
+        }
+
+        ::mkdir(Directory.Join("Directory").c_str(), 0755);
+        Result["Directory"] = { Mile::FileEntryType::Directory, 0 };
+
+        ::symlink("File0-", Directory.Join("Link").c_str());
+        Result["Link"] = { Mile::FileEntryType::Link, 0 };
+
+        ::mkfifo(Directory.Join("Pipe").c_str(), 0644);
+        Result["Pipe"] = { Mile::FileEntryType::Other, 0 };
+
+        // A name which is not valid UTF-8 is still returned as it is.
+        std::string Invalid = "Invalid\xFF\xFE";
+        NSudoTest::WriteFile(Directory.Join(Invalid), "");
+        Result[Invalid] = { Mile::FileEntryType::File, 0 };
+
+        for (auto& Entry : Result)
+        {
+            Entry.second.FileId = ::GetFileId(Directory.Join(Entry.first));
+        }
+
+        return Result;
+    }
+
+    /**
+     * Enumerates all entries and checks each of them against the expected
+     * entries.
+     *
+     * @return The number of batches.
+     */
+    std::size_t CheckEnumeration(
+        Mile::FileEnumerator& Enumerator,
+        EntryMap const& Expected)
+    {
+        std::set<std::string> Seen;
+        std::size_t Batches = 0;
+
+        Mile::FileEnumeratorBatch Batch;
+        while (Enumerator.NextBatch(Batch))
+        {
+            NSUDO_TEST_CHECK(!Batch.IsEmpty());
+            ++Batches;
+
+            for (Mile::FileEnumeratorEntry Entry : Batch)
+            {
+                std::string Name(Entry.GetName());
+                NSUDO_TEST_CHECK(Name != "." && Name != "..");
+                NSUDO_TEST_CHECK(Seen.insert(Name).second);
+
+                auto Iterator = Expected.find(Name);
+                if (!NSUDO_TEST_CHECK(Iterator != Expected.end()))
+                {
+                    continue;
+                }
+
+                // Every Linux file system which the tests run on reports
+                // the type, so Unknown is not expected here.
+                NSUDO_TEST_CHECK(Entry.GetType() == Iterator->second.Type);
+                NSUDO_TEST_CHECK_EQUAL(
+                    Entry.GetFileId(),
+                    Iterator->second.FileId);
+            }
+        }
+
+        NSUDO_TEST_CHECK_EQUAL(Enumerator.GetLastErrorCode(), 0);
+        NSUDO_TEST_CHECK_EQUAL(Seen.size(), Expected.size());
+
+        return Batches;
+    }
+}
+
+NSUDO_TEST_CASE(EnumeratesEveryType)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    EntryMap Expected = ::CreateEntries(Directory, 16);
+
+    Mile::FileEnumerator Enumerator;
+    NSUDO_TEST_CHECK(Enumerator.Open(Directory.GetPath()));
+    NSUDO_TEST_CHECK_EQUAL(::CheckEnumeration(Enumerator, Expected), 1U);
+
+    // The enumeration stays completed until it is restarted.
+    Mile::FileEnumeratorBatch Batch;
+    NSUDO_TEST_CHECK(!Enumerator.NextBatch(Batch));
+    NSUDO_TEST_CHECK_EQUAL(Enumerator.GetLastErrorCode(), 0);
+}
+
+NSUDO_TEST_CASE(SmallBufferNeedsManyBatches)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    EntryMap Expected = ::CreateEntries(Directory, 600);
+
+    // The buffer is rounded up to the minimum size, which still holds the
+    // longest name.
+    const std::size_t MinimumBufferSize =
+        Mile::FileEnumerator::MinimumBufferSize;
+    Mile::FileEnumerator Enumerator(1);
+    NSUDO_TEST_CHECK_EQUAL(Enumerator.GetBufferSize(), MinimumBufferSize);
+
+    NSUDO_TEST_CHECK(Enumerator.Open(Directory.GetPath()));
+    std::size_t Batches = ::CheckEnumeration(Enumerator, Expected);
+    NSUDO_TEST_CHECK(Batches > 10);
+
+    // A restart reads the same entries again.
+    Enumerator.Restart();
+    NSUDO_TEST_CHECK_EQUAL(::CheckEnumeration(Enumerator, Expected), Batches);
+}
+
+NSUDO_TEST_CASE(EmptyDirectory)
+{
+    NSudoTest::TemporaryDirectory Directory;
+
+    Mile::FileEnumerator Enumerator;
+    NSUDO_TEST_CHECK(Enumerator.Open(Directory.GetPath()));
+
+    // The only batch holds "." and "..", which are skipped.
+    std::size_t Entries = 0;
+    Mile::FileEnumeratorBatch Batch;
+    while (Enumerator.NextBatch(Batch))
+    {
+        for (Mile::FileEnumeratorEntry Entry : Batch)
+        {
+            static_cast<void>(Entry);
+            ++Entries;
+        }
+    }
+    NSUDO_TEST_CHECK_EQUAL(Entries, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Enumerator.GetLastErrorCode(), 0);
+}
+
+NSUDO_TEST_CASE(AttachDoesNotCloseTheDescriptor)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    EntryMap Expected = ::CreateEntries(Directory, 4);
+
+    int Handle = ::open(
+        Directory.GetPath().c_str(),
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    NSUDO_TEST_CHECK(Handle >= 0);
+
+    {
+        Mile::FileEnumerator Enumerator;
+        Enumerator.Attach(Handle);
+        ::CheckEnumeration(Enumerator, Expected);
+    }
+
+    NSUDO_TEST_CHECK(-1 != ::fcntl(Handle, F_GETFD));
+    ::close(Handle);
+}
+
+NSUDO_TEST_CASE(OpenFailures)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::WriteFile(Directory.Join("File"), "");
+
+    Mile::FileEnumerator Enumerator;
+    NSUDO_TEST_CHECK(!Enumerator.Open(Directory.Join("Missing")));
+    NSUDO_TEST_CHECK_EQUAL(Enumerator.GetLastErrorCode(), ENOENT);
+
+    NSUDO_TEST_CHECK(!Enumerator.Open(Directory.Join("File")));
+    NSUDO_TEST_CHECK_EQUAL(Enumerator.GetLastErrorCode(), ENOTDIR);
+
+    // A closed enumerator has nothing to read.
+    Mile::FileEnumeratorBatch Batch;
+    NSUDO_TEST_CHECK(!Enumerator.NextBatch(Batch));
+}
@@ -0,0 +1,163 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Hash.Benchmark.cpp
+ * PURPOSE:   Implementation for the fast non-cryptographic hash benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.Hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// This file is built twice, with the SSE2 path and with the portable path
+// only, so the two builds print comparable measurements.
+
+#if defined(MILE_HASH_NO_SSE2)
+#define NSUDO_TEST_PATH_NAME " (portable)"
+#else
+#define NSUDO_TEST_PATH_NAME " (default)"
+#endif
+
+namespace
+{
+    /**
+     * The hashes of every measurement added up. main prints it, so none of
+     * the hashing can be optimized away.
+     */
+    std::uint64_t g_Checksum = 0;
+
+    template<typename FunctionType>
+    void Measure(
+        std::string const& Name,
+        std::size_t Repeat,
+        std::size_t Bytes,
+        FunctionType&& Function)
+    {
+        NSudoTest::Stopwatch Timer;
+        std::uint64_t Checksum = 0;
+        for (std::size_t i = 0; i < Repeat; ++i)
+        {
+            Mile::Hash128 Hash = Function();
+            Checksum += Hash.Low ^ Hash.High;
+        }
+        double Seconds = Timer.GetSeconds();
+
+        NSudoTest::PrintMeasurement(
+            Name + NSUDO_TEST_PATH_NAME,
+            Seconds,
+            static_cast<double>(Repeat * Bytes),
+            "B");
+
+        g_Checksum += Checksum;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t Size = Options.Quick ? 1024 * 1024 : 64 * 1024 * 1024;
+    const std::size_t Repeat = Options.Quick ? 1 : 8;
+
+    std::vector<std::uint8_t> Data(Size);
+    std::mt19937 Generator(1);
+    for (std::uint8_t& Byte : Data)
+    {
+        Byte = static_cast<std::uint8_t>(Generator() & 0xFF);
+    }
+
+    Mile::Hash128 Whole = Mile::ComputeFastHash(Data.data(), Size);
+
+    ::Measure("ComputeFastHash, whole buffer", Repeat, Size, [&]()
+    {
+        return Mile::ComputeFastHash(Data.data(), Size);
+    });
+
+    // The chunks of the duplicate finder are hashed one by one, each with
+    // its index as the seed.
+    for (std::size_t ChunkSize : { 4096, 64 * 1024, 1024 * 1024 })
+    {
+        ::Measure(
+            "ComputeFastHash, chunks of " + std::to_string(ChunkSize) + " B",
+            Repeat,
+            Size,
+            [&]()
+        {
+            Mile::Hash128 Result = {};
+            for (std::size_t Offset = 0; Offset < Size; Offset += ChunkSize)
+            {
+                Mile::Hash128 Hash = Mile::ComputeFastHash(
+                    Data.data() + Offset,
+                    ChunkSize,
+                    Offset / ChunkSize);
+                Result.Low ^= Hash.Low;
+                Result.High ^= Hash.High;
+            }
+            return Result;
+        });
+    }
+
+    // Pieces which are not whole stripes, which the hasher buffers.
+    for (std::size_t PieceSize : { 100, 4000 })
+    {
+        Mile::Hash128 Streamed = {};
+        ::Measure(
+            "FastHasher, pieces of " + std::to_string(PieceSize) + " B",
+            Repeat,
+            Size,
+            [&]()
+        {
+            Mile::FastHasher Hasher;
+            for (std::size_t Offset = 0; Offset < Size; Offset += PieceSize)
+            {
+                Hasher.Update(
+                    Data.data() + Offset,
+                    (std::min)(PieceSize, Size - Offset));
+            }
+            Streamed = Hasher.Finalize();
+            return Streamed;
+        });
+        NSUDO_TEST_CHECK(Streamed == Whole);
+    }
+
+    // The prefixes of the files of the same size, hashed before the files.
+    const std::size_t SmallSize = 64;
+    const std::size_t SmallCount = Size / SmallSize;
+    ::Measure(
+        "ComputeFastHash, " + std::to_string(SmallSize) + " B inputs",
+        Repeat,
+        SmallCount * SmallSize,
+        [&]()
+    {
+        Mile::Hash128 Result = {};
+        for (std::size_t i = 0; i < SmallCount; ++i)
+        {
+            Mile::Hash128 Hash = Mile::ComputeFastHash(
+                Data.data() + i * SmallSize,
+                SmallSize);
+            Result.Low += Hash.Low;
+            Result.High += Hash.High;
+        }
+        return Result;
+    });
+
+    std::printf(
+        "\nChecksum: %016llx\n",
+        static_cast<unsigned long long>(g_Checksum));
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
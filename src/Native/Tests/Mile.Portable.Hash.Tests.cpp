@@ -0,0 +1,273 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Hash.Tests.cpp
+ * PURPOSE:   Implementation for the fast non-cryptographic hash tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.Hash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    /**
+     * Creates the data of the tests. The values of std::mt19937 are the
+     * same on every platform, unlike those of the distributions.
+     */
+    std::vector<std::uint8_t> CreateData(
+        std::size_t Size)
+    {
+        std::vector<std::uint8_t> Data(Size);
+        std::mt19937 Generator(2024);
+        for (std::uint8_t& Byte : Data)
+        {
+            Byte = static_cast<std::uint8_t>(Generator() & 0xFF);
+        }
+        return Data;
+    }
+
+    std::string ToString(
+        Mile::Hash128 const& Hash)
+    {
+        return NSudoTest::ToString(Hash.High) +
+            ":" +
+            NSudoTest::ToString(Hash.Low);
+    }
+
+    /**
+     * Hashes the data in pieces of the given sizes, repeated until the end.
+     */
+    Mile::Hash128 HashInPieces(
+        std::vector<std::uint8_t> const& Data,
+        std::size_t Size,
+        std::vector<std::size_t> const& Pieces,
+        std::uint64_t Seed = 0)
+    {
+        Mile::FastHasher Hasher(Seed);
+        std::size_t Offset = 0;
+        for (std::size_t i = 0; Offset < Size; ++i)
+        {
+            std::size_t Length = Pieces[i % Pieces.size()];
+            if (Length > Size - Offset)
+            {
+                Length = Size - Offset;
+            }
+            Hasher.Update(Data.data() + Offset, Length);
+            Offset += Length;
+        }
+        return Hasher.Finalize();
+    }
+
+    /**
+     * The sizes around the ends of the stripes of 64 bytes and the blocks
+     * of 16 stripes, where the hasher changes how it consumes the data.
+     */
+    std::vector<std::size_t> GetBoundarySizes()
+    {
+        std::vector<std::size_t> Sizes;
+        for (std::size_t Size = 0; Size <= 130; ++Size)
+        {
+            Sizes.push_back(Size);
+        }
+        for (std::size_t Boundary : { 1024, 2048, 3072, 16384 })
+        {
+            for (std::size_t Size = Boundary - 65; Size <= Boundary + 65;
+                ++Size)
+            {
+                Sizes.push_back(Size);
+            }
+        }
+        return Sizes;
+    }
+}
+
+NSUDO_TEST_CASE(HashIsTheSameOnBothPaths)
+{
+    // The SSE2 and the portable paths mix the same lanes, so both builds of
+    // this test expect the same values. The content hashes of the duplicate
+    // finder depend on them.
+    struct KnownHash
+    {
+        std::size_t Size;
+        std::uint64_t Seed;
+        std::uint64_t Low;
+        std::uint64_t High;
+    };
+    const KnownHash KnownHashes[] =
+    {
+        { 0, 0x0, 0xED098A5899AAEC96, 0x9917EF55AEBB0F4E },
+        { 1, 0x0, 0x6652EB09F4F8DF07, 0x37253B2EF2B2BF88 },
+        { 7, 0x0, 0x139A9F49B2314D8B, 0x17EF2E20CEFB4599 },
+        { 8, 0x0, 0x7945F7272AFD78CF, 0x744442427773C298 },
+        { 63, 0x0, 0x2AE0D41FF883A80A, 0x1E4225CE7DF621F1 },
+        { 64, 0x0, 0xEA657F5293D41547, 0x3F8EC07B09092461 },
+        { 65, 0x0, 0x865B34794070F0F7, 0xB5075788758441F5 },
+        { 128, 0x0, 0x8D4751806C39572C, 0x1CB261EB1A968F69 },
+        { 1023, 0x0, 0x67E86D882B4F7D67, 0xF4D5A01F3DA981B0 },
+        { 1024, 0x0, 0x77054783DBF5A0C2, 0x89A8794A19D6C3CD },
+        { 1025, 0x0, 0x173D0FB507E8A65D, 0xC55AE7023F5054E0 },
+        { 1088, 0x0, 0xD84B837826CE135F, 0xDB79CA45BCD08313 },
+        { 4096, 0x0, 0x3182D43BCD8A239C, 0xB15C3362029887FD },
+        { 65537, 0x0, 0xA70FB82EF0D221FF, 0xC4A9CA8ED8F44252 },
+        { 0, 0x1, 0x2494C192C4C0C00D, 0x6E52C86F1449D4DC },
+        { 64, 0x1, 0x10FC4488607047F8, 0x1AE6A5B58A59750F },
+        { 1000, 0x123456789ABCDEF0, 0xED44910712325C1F, 0x580E6D5B4B9DD128 },
+    };
+
+    std::vector<std::uint8_t> Data = ::CreateData(70000);
+    for (KnownHash const& Known : KnownHashes)
+    {
+        Mile::Hash128 Hash = Mile::ComputeFastHash(
+            Data.data(),
+            Known.Size,
+            Known.Seed);
+        NSUDO_TEST_CHECK_EQUAL(Hash.Low, Known.Low);
+        NSUDO_TEST_CHECK_EQUAL(Hash.High, Known.High);
+    }
+}
+
+NSUDO_TEST_CASE(PiecesDoNotChangeTheHash)
+{
+    // The duplicate finder hashes the chunks of a file as they are read, so
+    // the hash must not depend on where the data is split.
+    const std::vector<std::vector<std::size_t>> Splits =
+    {
+        { 1 },
+        { 3 },
+        { 63 },
+        { 64 },
+        { 65 },
+        { 1000 },
+        { 1024 },
+        { 1, 64, 7, 1023, 128 },
+        { 0, 5 },
+    };
+
+    std::vector<std::uint8_t> Data = ::CreateData(20000);
+    for (std::size_t Size : ::GetBoundarySizes())
+    {
+        Mile::Hash128 Expected = Mile::ComputeFastHash(Data.data(), Size);
+        for (std::vector<std::size_t> const& Pieces : Splits)
+        {
+            Mile::Hash128 Hash = ::HashInPieces(Data, Size, Pieces);
+            if (Hash != Expected)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "HashInPieces(Data, Size, Pieces) == Expected",
+                    "size " + std::to_string(Size) +
+                        ", first piece " + std::to_string(Pieces[0]));
+            }
+        }
+    }
+
+    // Random splits of a buffer which spans many blocks.
+    std::mt19937 Generator(7);
+    for (int Round = 0; Round < 50; ++Round)
+    {
+        std::vector<std::size_t> Pieces;
+        for (int i = 0; i < 16; ++i)
+        {
+            Pieces.push_back(1 + Generator() % 3000);
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            ::ToString(::HashInPieces(Data, Data.size(), Pieces, Round)),
+            ::ToString(Mile::ComputeFastHash(
+                Data.data(),
+                Data.size(),
+                Round)));
+    }
+}
+
+NSUDO_TEST_CASE(FinalizeDoesNotEndTheHash)
+{
+    std::vector<std::uint8_t> Data = ::CreateData(5000);
+    for (std::size_t Split : { 0, 1, 63, 64, 1024, 1030, 4999 })
+    {
+        Mile::FastHasher Hasher;
+        Hasher.Update(Data.data(), Split);
+        NSUDO_TEST_CHECK_EQUAL(
+            ::ToString(Hasher.Finalize()),
+            ::ToString(Mile::ComputeFastHash(Data.data(), Split)));
+        Hasher.Update(Data.data() + Split, Data.size() - Split);
+        NSUDO_TEST_CHECK_EQUAL(
+            ::ToString(Hasher.Finalize()),
+            ::ToString(Mile::ComputeFastHash(Data.data(), Data.size())));
+
+        Hasher.Reset(1);
+        Hasher.Update(Data.data(), Data.size());
+        NSUDO_TEST_CHECK_EQUAL(
+            ::ToString(Hasher.Finalize()),
+            ::ToString(Mile::ComputeFastHash(Data.data(), Data.size(), 1)));
+    }
+}
+
+NSUDO_TEST_CASE(AlignmentDoesNotChangeTheHash)
+{
+    std::vector<std::uint8_t> Data = ::CreateData(3000);
+    std::vector<std::uint8_t> Buffer(Data.size() + 16);
+    for (std::size_t Size : { 15, 64, 100, 1024, 2999 })
+    {
+        Mile::Hash128 Expected = Mile::ComputeFastHash(Data.data(), Size);
+        for (std::size_t Offset = 1; Offset < 16; ++Offset)
+        {
+            std::memcpy(Buffer.data() + Offset, Data.data(), Size);
+            NSUDO_TEST_CHECK_EQUAL(
+                ::ToString(Mile::ComputeFastHash(
+                    Buffer.data() + Offset,
+                    Size)),
+                ::ToString(Expected));
+        }
+    }
+}
+
+NSUDO_TEST_CASE(EveryBitChangesTheHash)
+{
+    // Each bit of the data, the length, trailing zeros and the seed give
+    // another hash.
+    std::vector<std::uint8_t> Data = ::CreateData(1100);
+    std::set<std::pair<std::uint64_t, std::uint64_t>> Hashes;
+    std::size_t Count = 0;
+    auto Add = [&](
+        Mile::Hash128 const& Hash)
+    {
+        Hashes.emplace(Hash.High, Hash.Low);
+        ++Count;
+    };
+
+    Add(Mile::ComputeFastHash(Data.data(), Data.size()));
+    for (std::size_t i = 0; i < Data.size(); ++i)
+    {
+        for (int Bit = 0; Bit < 8; Bit += 3)
+        {
+            Data[i] ^= static_cast<std::uint8_t>(1 << Bit);
+            Add(Mile::ComputeFastHash(Data.data(), Data.size()));
+            Data[i] ^= static_cast<std::uint8_t>(1 << Bit);
+        }
+    }
+
+    std::vector<std::uint8_t> Zeros(200);
+    for (std::size_t Size = 0; Size <= Zeros.size(); ++Size)
+    {
+        Add(Mile::ComputeFastHash(Zeros.data(), Size));
+    }
+    for (std::uint64_t Seed = 1; Seed <= 100; ++Seed)
+    {
+        Add(Mile::ComputeFastHash(Data.data(), Data.size(), Seed));
+    }
+
+    NSUDO_TEST_CHECK_EQUAL(Hashes.size(), Count);
+}
@@ -0,0 +1,275 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MappedFile.Benchmark.cpp
+ * PURPOSE:   Implementation for the memory-mapped file benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.MappedFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string CreateContent(
+        std::size_t Size)
+    {
+        std::mt19937 Generator(42);
+        std::string Result(Size, '\0');
+        for (char& Character : Result)
+        {
+            Character = static_cast<char>(Generator());
+        }
+        return Result;
+    }
+
+    /**
+     * Sums every byte, which stands for a parser that reads the whole file.
+     */
+    std::uint64_t Consume(
+        void const* Data,
+        std::size_t Size)
+    {
+        std::uint64_t Result = 0;
+        unsigned char const* Bytes =
+            reinterpret_cast<unsigned char const*>(Data);
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            Result += Bytes[i];
+        }
+        return Result;
+    }
+
+    /**
+     * Writes the file back and drops its pages from the page cache, so the
+     * next load reads it from the disk. This has no effect on file systems
+     * which only live in memory, such as tmpfs.
+     */
+    bool Evict(
+        std::string const& Path)
+    {
+        int Handle = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (Handle == -1)
+        {
+            return false;
+        }
+        ::fdatasync(Handle);
+        bool Result = 0 == ::posix_fadvise(
+            Handle,
+            0,
+            0,
+            POSIX_FADV_DONTNEED);
+        ::close(Handle);
+        return Result;
+    }
+
+    std::uint64_t LoadWithMappedFile(
+        std::string const& Path,
+        Mile::MappedFileAccess Access,
+        bool Prefetch)
+    {
+        Mile::MappedFile File;
+        if (!File.Open(Path, Access))
+        {
+            return 0;
+        }
+        if (Prefetch)
+        {
+            File.Prefetch();
+        }
+        return ::Consume(File.GetData(), File.GetSize());
+    }
+
+    /**
+     * Reads the whole file into a heap buffer, which is how the launchers
+     * loaded their settings before they were mapped.
+     */
+    std::uint64_t LoadWithRead(
+        std::string const& Path)
+    {
+        int Handle = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (Handle == -1)
+        {
+            return 0;
+        }
+
+        std::uint64_t Result = 0;
+        struct stat Status;
+        if (0 == ::fstat(Handle, &Status))
+        {
+            std::vector<char> Buffer(static_cast<std::size_t>(Status.st_size));
+            std::size_t Offset = 0;
+            while (Offset < Buffer.size())
+            {
+                ssize_t Read = ::read(
+                    Handle,
+                    &Buffer[Offset],
+                    Buffer.size() - Offset);
+                if (Read <= 0)
+                {
+                    break;
+                }
+                Offset += static_cast<std::size_t>(Read);
+            }
+            Result = ::Consume(Buffer.data(), Offset);
+        }
+
+        ::close(Handle);
+        return Result;
+    }
+
+    template<typename FunctionType>
+    void Measure(
+        std::string const& Name,
+        std::string const& Path,
+        bool Cold,
+        std::size_t Repeat,
+        std::size_t Size,
+        std::uint64_t Expected,
+        FunctionType&& Function)
+    {
+        if (!Cold)
+        {
+            // Load the file once, so every repetition reads from the cache.
+            NSUDO_TEST_CHECK_EQUAL(Function(), Expected);
+        }
+
+        double Seconds = 0.0;
+        for (std::size_t i = 0; i < Repeat; ++i)
+        {
+            if (Cold)
+            {
+                ::Evict(Path);
+            }
+
+            NSudoTest::Stopwatch Timer;
+            std::uint64_t Result = Function();
+            Seconds += Timer.GetSeconds();
+
+            if (Result != Expected)
+            {
+                NSUDO_TEST_CHECK_EQUAL(Result, Expected);
+            }
+        }
+
+        NSudoTest::PrintMeasurement(
+            Name + (Cold ? ", cold" : ", warm"),
+            Seconds,
+            static_cast<double>(Repeat * Size) / (1024 * 1024),
+            "MiB");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    // The settings of the launchers, a cache, and an index.
+    std::vector<std::size_t> Sizes = { 4 * 1024, 1024 * 1024 };
+    if (!Options.Quick)
+    {
+        Sizes.push_back(64 * 1024 * 1024);
+    }
+
+    // The number of bytes each measurement reads in total.
+    const std::size_t WarmBudget =
+        Options.Quick ? 8 * 1024 * 1024 : 1024 * 1024 * 1024;
+    const std::size_t ColdBudget =
+        Options.Quick ? 2 * 1024 * 1024 : 256 * 1024 * 1024;
+
+    NSudoTest::TemporaryDirectory Directory;
+
+    // A file of no bytes is mapped to nothing, and still opens.
+    std::string EmptyPath = Directory.Join("Empty.bin");
+    NSudoTest::WriteFile(EmptyPath, "");
+    {
+        Mile::MappedFile File;
+        NSUDO_TEST_CHECK(File.Open(EmptyPath));
+        NSUDO_TEST_CHECK(!File.IsMapped());
+        NSUDO_TEST_CHECK_EQUAL(File.GetSize(), 0U);
+    }
+
+    std::printf("Files in %s\n\n", Directory.GetPath().c_str());
+
+    for (std::size_t Size : Sizes)
+    {
+        std::string Path = Directory.Join(
+            "File" + std::to_string(Size) + ".bin");
+        std::string Content = ::CreateContent(Size);
+        NSudoTest::WriteFile(Path, Content);
+        const std::uint64_t Expected = ::Consume(Content.data(), Size);
+
+        std::string Label = std::to_string(Size / 1024) + " KiB";
+
+        for (bool Cold : { false, true })
+        {
+            std::size_t Repeat = (std::max)(
+                static_cast<std::size_t>(1),
+                (std::min)(
+                    static_cast<std::size_t>(Cold ? 100 : 10000),
+                    (Cold ? ColdBudget : WarmBudget) / Size));
+
+            ::Measure(
+                "MappedFile, " + Label,
+                Path,
+                Cold,
+                Repeat,
+                Size,
+                Expected,
+                [&]()
+            {
+                return ::LoadWithMappedFile(
+                    Path,
+                    Mile::MappedFileAccess::Normal,
+                    false);
+            });
+            ::Measure(
+                "MappedFile, prefetched, " + Label,
+                Path,
+                Cold,
+                Repeat,
+                Size,
+                Expected,
+                [&]()
+            {
+                return ::LoadWithMappedFile(
+                    Path,
+                    Mile::MappedFileAccess::Sequential,
+                    true);
+            });
+            ::Measure(
+                "read into a heap buffer, " + Label,
+                Path,
+                Cold,
+                Repeat,
+                Size,
+                Expected,
+                [&]()
+            {
+                return ::LoadWithRead(Path);
+            });
+        }
+
+        std::printf("\n");
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MappedFile.Tests.cpp
+ * PURPOSE:   Implementation for the memory-mapped file view tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.MappedFile.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace
+{
+    std::string CreateContent(
+        std::size_t Size)
+    {
+        std::string Content(Size, '\0');
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            Content[i] = static_cast<char>('a' + i % 26);
+        }
+        return Content;
+    }
+}
+
+NSUDO_TEST_CASE(MapsTheWholeFile)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Content = ::CreateContent(3 * 4096 + 17);
+    NSudoTest::WriteFile(Directory.Join("File.txt"), Content);
+
+    const Mile::MappedFileAccess Accesses[] =
+    {
+        Mile::MappedFileAccess::Normal,
+        Mile::MappedFileAccess::Sequential,
+        Mile::MappedFileAccess::Random,
+    };
+    for (Mile::MappedFileAccess Access : Accesses)
+    {
+        Mile::MappedFile File;
+        NSUDO_TEST_CHECK(File.Open(Directory.Join("File.txt"), Access));
+        NSUDO_TEST_CHECK(File.IsMapped());
+        NSUDO_TEST_CHECK_EQUAL(File.GetSize(), Content.size());
+        NSUDO_TEST_CHECK(File.GetView() == Content);
+        NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), 0);
+        NSUDO_TEST_CHECK(File.Advise(Mile::MappedFileAccess::Random));
+
+        File.Close();
+        NSUDO_TEST_CHECK(!File.IsMapped());
+        NSUDO_TEST_CHECK(nullptr == File.GetData());
+        NSUDO_TEST_CHECK_EQUAL(File.GetSize(), 0U);
+    }
+}
+
+NSUDO_TEST_CASE(EmptyFileIsMappedWithoutData)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::WriteFile(Directory.Join("Empty.txt"), std::string());
+
+    Mile::MappedFile File;
+    NSUDO_TEST_CHECK(File.Open(Directory.Join("Empty.txt")));
+    NSUDO_TEST_CHECK(!File.IsMapped());
+    NSUDO_TEST_CHECK(nullptr == File.GetData());
+    NSUDO_TEST_CHECK_EQUAL(File.GetSize(), 0U);
+    NSUDO_TEST_CHECK(File.GetView().empty());
+    NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), 0);
+
+    // There is nothing to read, so every range is accepted.
+    NSUDO_TEST_CHECK(File.Prefetch());
+    NSUDO_TEST_CHECK(File.Prefetch(0, 0));
+    NSUDO_TEST_CHECK(File.Prefetch(4096, 4096));
+    NSUDO_TEST_CHECK(File.Prefetch(SIZE_MAX, SIZE_MAX));
+    NSUDO_TEST_CHECK(File.Advise(Mile::MappedFileAccess::Sequential));
+}
+
+NSUDO_TEST_CASE(MissingFileReportsTheError)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::WriteFile(Directory.Join("File.txt"), "Content");
+
+    Mile::MappedFile File;
+    NSUDO_TEST_CHECK(!File.Open(Directory.Join("Missing.txt")));
+    NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), ENOENT);
+    NSUDO_TEST_CHECK(!File.IsMapped());
+    NSUDO_TEST_CHECK_EQUAL(File.GetSize(), 0U);
+
+    // A failed open unmaps the previous file, and a later one succeeds
+    // and clears the error.
+    NSUDO_TEST_CHECK(File.Open(Directory.Join("File.txt")));
+    NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), 0);
+    NSUDO_TEST_CHECK(!File.Open(Directory.Join("Missing.txt")));
+    NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), ENOENT);
+    NSUDO_TEST_CHECK(!File.IsMapped());
+    NSUDO_TEST_CHECK_EQUAL(File.GetSize(), 0U);
+
+    // A directory cannot be mapped.
+    NSUDO_TEST_CHECK(!File.Open(Directory.GetPath()));
+    NSUDO_TEST_CHECK(File.GetLastErrorCode() != 0);
+    NSUDO_TEST_CHECK(!File.IsMapped());
+}
+
+NSUDO_TEST_CASE(MoveTransfersTheMapping)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string First = ::CreateContent(100);
+    const std::string Second = ::CreateContent(5000);
+    NSudoTest::WriteFile(Directory.Join("First.txt"), First);
+    NSudoTest::WriteFile(Directory.Join("Second.txt"), Second);
+
+    Mile::MappedFile Source;
+    NSUDO_TEST_CHECK(Source.Open(Directory.Join("First.txt")));
+    void const* Data = Source.GetData();
+
+    Mile::MappedFile Constructed(std::move(Source));
+    NSUDO_TEST_CHECK(Constructed.GetData() == Data);
+    NSUDO_TEST_CHECK(Constructed.GetView() == First);
+    NSUDO_TEST_CHECK(!Source.IsMapped());
+    NSUDO_TEST_CHECK_EQUAL(Source.GetSize(), 0U);
+
+    // The assignment unmaps the mapping of the target.
+    Mile::MappedFile Assigned;
+    NSUDO_TEST_CHECK(Assigned.Open(Directory.Join("Second.txt")));
+    Assigned = std::move(Constructed);
+    NSUDO_TEST_CHECK(Assigned.GetData() == Data);
+    NSUDO_TEST_CHECK(Assigned.GetView() == First);
+    NSUDO_TEST_CHECK(!Constructed.IsMapped());
+    NSUDO_TEST_CHECK_EQUAL(Constructed.GetSize(), 0U);
+
+    // Assigning a view to itself keeps the mapping.
+    Mile::MappedFile& Alias = Assigned;
+    Assigned = std::move(Alias);
+    NSUDO_TEST_CHECK(Assigned.GetView() == First);
+
+    // An empty view can be moved, and the moved-from views can be used
+    // again.
+    Assigned = Mile::MappedFile();
+    NSUDO_TEST_CHECK(!Assigned.IsMapped());
+    NSUDO_TEST_CHECK(Source.Open(Directory.Join("Second.txt")));
+    NSUDO_TEST_CHECK(Source.GetView() == Second);
+}
+
+NSUDO_TEST_CASE(PrefetchClampsTheRange)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    const std::string Content = ::CreateContent(5 * 4096 + 100);
+    NSudoTest::WriteFile(Directory.Join("File.txt"), Content);
+
+    Mile::MappedFile File;
+    NSUDO_TEST_CHECK(File.Open(Directory.Join("File.txt")));
+    const std::size_t Size = File.GetSize();
+
+    // Ranges which start in the file are clamped to its end, and need not
+    // be aligned.
+    NSUDO_TEST_CHECK(File.Prefetch());
+    NSUDO_TEST_CHECK(File.Prefetch(0, Size));
+    NSUDO_TEST_CHECK(File.Prefetch(0, 0));
+    NSUDO_TEST_CHECK(File.Prefetch(1, 1));
+    NSUDO_TEST_CHECK(File.Prefetch(4095, 2));
+    NSUDO_TEST_CHECK(File.Prefetch(4097, SIZE_MAX));
+    NSUDO_TEST_CHECK(File.Prefetch(Size - 1, SIZE_MAX));
+    NSUDO_TEST_CHECK(File.Prefetch(Size - 1, Size * 2));
+
+    // Ranges which start at or past the end have nothing to read.
+    NSUDO_TEST_CHECK(!File.Prefetch(Size, 1));
+    NSUDO_TEST_CHECK(!File.Prefetch(Size + 4096, 4096));
+    NSUDO_TEST_CHECK(!File.Prefetch(SIZE_MAX, SIZE_MAX));
+    NSUDO_TEST_CHECK_EQUAL(File.GetLastErrorCode(), 0);
+
+    // The view is unchanged.
+    NSUDO_TEST_CHECK(File.GetView() == Content);
+}
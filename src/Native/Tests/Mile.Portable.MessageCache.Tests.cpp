@@ -0,0 +1,205 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.MessageCache.Tests.cpp
+ * PURPOSE:   Implementation for the message cache tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.MessageCache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**
+     * A message source which knows the messages of the even codes, and
+     * counts how often it is called.
+     */
+    class StubMessageSource
+    {
+    private:
+
+        std::atomic<std::size_t> m_Calls{ 0 };
+
+    public:
+
+        static std::wstring GetExpectedMessage(
+            std::int32_t Code,
+            std::uint32_t LanguageId)
+        {
+            return L"Message " + std::to_wstring(
+                static_cast<std::uint32_t>(Code)) + L" in " +
+                std::to_wstring(LanguageId);
+        }
+
+        Mile::HResultMessageCache::MessageSource GetSource()
+        {
+            return [this](
+                std::int32_t Code,
+                std::uint32_t LanguageId,
+                std::wstring& Message)
+            {
+                this->m_Calls.fetch_add(1, std::memory_order_relaxed);
+                if (Code & 1)
+                {
+                    return false;
+                }
+
+                Message = StubMessageSource::GetExpectedMessage(
+                    Code,
+                    LanguageId);
+                return true;
+            };
+        }
+
+        std::size_t GetCalls() const noexcept
+        {
+            return this->m_Calls.load(std::memory_order_relaxed);
+        }
+    };
+}
+
+NSUDO_TEST_CASE(CachedMessagesCallTheSourceOnce)
+{
+    ::StubMessageSource Source;
+    Mile::HResultMessageCache Cache(Source.GetSource(), 16);
+
+    const std::int32_t OutOfMemory = static_cast<std::int32_t>(0x8007000E);
+
+    std::wstring_view First = Cache.Lookup(OutOfMemory, 1033);
+    NSUDO_TEST_CHECK(First == ::StubMessageSource::GetExpectedMessage(
+        OutOfMemory,
+        1033));
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 1U);
+
+    // The view of a cached message stays valid, and it is the same view.
+    std::wstring_view Second = Cache.Lookup(OutOfMemory, 1033);
+    NSUDO_TEST_CHECK(First.data() == Second.data());
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 1U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 1U);
+}
+
+NSUDO_TEST_CASE(MissingMessagesAreCached)
+{
+    ::StubMessageSource Source;
+    Mile::HResultMessageCache Cache(Source.GetSource(), 16);
+
+    NSUDO_TEST_CHECK(Cache.Lookup(1, 1033).empty());
+    NSUDO_TEST_CHECK(Cache.Lookup(1, 1033).empty());
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 1U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 1U);
+}
+
+NSUDO_TEST_CASE(LanguagesAreSeparateKeys)
+{
+    ::StubMessageSource Source;
+    Mile::HResultMessageCache Cache(Source.GetSource(), 16);
+
+    std::wstring_view English = Cache.Lookup(2, 1033);
+    std::wstring_view Chinese = Cache.Lookup(2, 2052);
+    NSUDO_TEST_CHECK(English == ::StubMessageSource::GetExpectedMessage(
+        2,
+        1033));
+    NSUDO_TEST_CHECK(Chinese == ::StubMessageSource::GetExpectedMessage(
+        2,
+        2052));
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 2U);
+
+    // Codes which only differ in the severity bit are separate keys.
+    Cache.Lookup(static_cast<std::int32_t>(0x80000002), 1033);
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 3U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 3U);
+}
+
+NSUDO_TEST_CASE(FullCacheStillReturnsMessages)
+{
+    ::StubMessageSource Source;
+    Mile::HResultMessageCache Cache(Source.GetSource(), 4);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetCapacity(), 4U);
+
+    for (std::int32_t Code = 0; Code < 20; Code += 2)
+    {
+        NSUDO_TEST_CHECK(Cache.Lookup(Code, 0) ==
+            ::StubMessageSource::GetExpectedMessage(Code, 0));
+    }
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 4U);
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 10U);
+
+    // The cached messages are still hits, and the others call the source
+    // again.
+    for (std::int32_t Code = 0; Code < 20; Code += 2)
+    {
+        NSUDO_TEST_CHECK(Cache.Lookup(Code, 0) ==
+            ::StubMessageSource::GetExpectedMessage(Code, 0));
+    }
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 4U);
+    NSUDO_TEST_CHECK_EQUAL(Source.GetCalls(), 16U);
+}
+
+NSUDO_TEST_CASE(NoSource)
+{
+    Mile::HResultMessageCache Cache(nullptr, 0);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetCapacity(), 1U);
+    NSUDO_TEST_CHECK(Cache.Lookup(2, 1033).empty());
+}
+
+NSUDO_TEST_CASE(ConcurrentLookups)
+{
+    const std::size_t ThreadCount = 8;
+    const std::int32_t CodeCount = 512;
+
+    ::StubMessageSource Source;
+    Mile::HResultMessageCache Cache(Source.GetSource(), 1024);
+
+    std::atomic<std::size_t> Mismatches{ 0 };
+    std::vector<std::thread> Threads;
+    for (std::size_t i = 0; i < ThreadCount; ++i)
+    {
+        Threads.emplace_back([&, i]()
+        {
+            for (int Round = 0; Round < 4; ++Round)
+            {
+                for (std::int32_t j = 0; j < CodeCount; ++j)
+                {
+                    // Each thread starts at a different code, so the
+                    // threads race on both misses and hits.
+                    std::int32_t Code = static_cast<std::int32_t>(
+                        (j + i * 61) % CodeCount);
+                    std::wstring_view Message = Cache.Lookup(Code, 1033);
+                    bool Matched = (Code & 1)
+                        ? Message.empty()
+                        : Message == ::StubMessageSource::GetExpectedMessage(
+                            Code,
+                            1033);
+                    if (!Matched)
+                    {
+                        Mismatches.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    NSUDO_TEST_CHECK_EQUAL(Mismatches.load(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), static_cast<std::size_t>(
+        CodeCount));
+
+    // Two threads which miss the same key at the same time may both call
+    // the source, but every key is only kept once.
+    NSUDO_TEST_CHECK(Source.GetCalls() >= static_cast<std::size_t>(
+        CodeCount));
+    NSUDO_TEST_CHECK(Source.GetCalls() <= CodeCount * ThreadCount);
+}
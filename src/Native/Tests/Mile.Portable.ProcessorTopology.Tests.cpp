@@ -0,0 +1,307 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ProcessorTopology.Tests.cpp
+ * PURPOSE:   Implementation for the processor topology tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.ProcessorTopology.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    /**
+     * Checks the invariants every topology satisfies, whichever backend
+     * reports it.
+     */
+    void CheckInvariants(
+        Mile::ProcessorTopology const& Topology)
+    {
+        NSUDO_TEST_CHECK(!Topology.LogicalProcessors.empty());
+        NSUDO_TEST_CHECK(Topology.GroupCount >= 1);
+        NSUDO_TEST_CHECK(Topology.CoreCount >= 1);
+        NSUDO_TEST_CHECK(Topology.PackageCount >= 1);
+        NSUDO_TEST_CHECK(Topology.NumaNodeCount >= 1);
+        NSUDO_TEST_CHECK(
+            Topology.CoreCount <= Topology.LogicalProcessors.size());
+        NSUDO_TEST_CHECK(Topology.PackageCount <= Topology.CoreCount);
+
+        std::set<std::pair<std::uint16_t, std::uint32_t>> Numbers;
+        for (std::size_t i = 0; i < Topology.LogicalProcessors.size(); ++i)
+        {
+            Mile::LogicalProcessorInformation const& Processor =
+                Topology.LogicalProcessors[i];
+
+            NSUDO_TEST_CHECK(Numbers.emplace(
+                Processor.Group,
+                Processor.Number).second);
+            NSUDO_TEST_CHECK(Processor.Core < Topology.CoreCount);
+            NSUDO_TEST_CHECK(Processor.Package < Topology.PackageCount);
+
+            if (i)
+            {
+                Mile::LogicalProcessorInformation const& Previous =
+                    Topology.LogicalProcessors[i - 1];
+                NSUDO_TEST_CHECK(
+                    std::make_pair(Previous.Group, Previous.Number) <
+                    std::make_pair(Processor.Group, Processor.Number));
+            }
+
+            // SMT siblings are in the same package.
+            for (Mile::LogicalProcessorInformation const& Other
+                : Topology.LogicalProcessors)
+            {
+                if (Other.Core == Processor.Core)
+                {
+                    NSUDO_TEST_CHECK_EQUAL(Other.Package, Processor.Package);
+                }
+            }
+        }
+
+        // Where there are processor groups, the logical processors are the
+        // bits of the active processor masks, which may have holes.
+        if (!Topology.GroupActiveProcessorMasks.empty())
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Topology.GroupActiveProcessorMasks.size(),
+                Topology.GroupCount);
+            std::size_t Bits = 0;
+            for (std::uint64_t Mask : Topology.GroupActiveProcessorMasks)
+            {
+                for (; Mask; Mask &= Mask - 1)
+                {
+                    ++Bits;
+                }
+            }
+            NSUDO_TEST_CHECK_EQUAL(Bits, Topology.LogicalProcessors.size());
+
+            for (Mile::LogicalProcessorInformation const& Processor
+                : Topology.LogicalProcessors)
+            {
+                NSUDO_TEST_CHECK(
+                    Processor.Group < Topology.GroupCount &&
+                    Processor.Number < 64 &&
+                    (Topology.GroupActiveProcessorMasks[Processor.Group] >>
+                        Processor.Number) & 1);
+            }
+        }
+
+        for (Mile::ProcessorCacheInformation const& Cache : Topology.Caches)
+        {
+            NSUDO_TEST_CHECK(Cache.Level >= 1 && Cache.Level <= 4);
+            for (std::uint32_t Index : Cache.LogicalProcessors)
+            {
+                NSUDO_TEST_CHECK(Index < Topology.LogicalProcessors.size());
+            }
+        }
+    }
+
+    /**
+     * Creates a copy of /sys/devices/system for a machine with two packages
+     * of two cores with two threads each, which is eight logical processors
+     * in two NUMA nodes. The processor 5 is offline.
+     */
+    void CreateSystemDirectory(
+        NSudoTest::TemporaryDirectory const& Directory)
+    {
+        NSudoTest::WriteFile(Directory.Join("cpu/online"), "0-4,6-7\n");
+        NSudoTest::WriteFile(Directory.Join("cpu/possible"), "0-7\n");
+
+        for (unsigned Cpu = 0; Cpu < 8; ++Cpu)
+        {
+            unsigned Package = Cpu / 4;
+            unsigned Core = (Cpu % 4) / 2;
+            unsigned FirstSibling = Cpu & ~1U;
+            unsigned FirstInPackage = Package * 4;
+
+            std::string Path = "cpu/cpu" + std::to_string(Cpu) + "/";
+
+            // The core_id is only unique in its package.
+            NSudoTest::WriteFile(
+                Directory.Join(Path + "topology/physical_package_id"),
+                std::to_string(Package) + "\n");
+            NSudoTest::WriteFile(
+                Directory.Join(Path + "topology/core_id"),
+                std::to_string(Core) + "\n");
+
+            std::string CoreList =
+                std::to_string(FirstSibling) + "-" +
+                std::to_string(FirstSibling + 1) + "\n";
+            std::string PackageList =
+                std::to_string(FirstInPackage) + "-" +
+                std::to_string(FirstInPackage + 3) + "\n";
+
+            struct
+            {
+                char const* Level;
+                char const* Type;
+                char const* Size;
+                std::string const& SharedList;
+            } const Caches[] =
+            {
+                { "1\n", "Data\n", "48K\n", CoreList },
+                { "1\n", "Instruction\n", "32K\n", CoreList },
+                { "2\n", "Unified\n", "1280K\n", CoreList },
+                { "3\n", "Unified\n", "24M\n", PackageList },
+            };
+
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                std::string CachePath =
+                    Path + "cache/index" + std::to_string(i) + "/";
+                NSudoTest::WriteFile(
+                    Directory.Join(CachePath + "level"),
+                    Caches[i].Level);
+                NSudoTest::WriteFile(
+                    Directory.Join(CachePath + "type"),
+                    Caches[i].Type);
+                NSudoTest::WriteFile(
+                    Directory.Join(CachePath + "size"),
+                    Caches[i].Size);
+                NSudoTest::WriteFile(
+                    Directory.Join(CachePath + "shared_cpu_list"),
+                    Caches[i].SharedList);
+            }
+        }
+
+        NSudoTest::WriteFile(Directory.Join("node/node0/cpulist"), "0-3\n");
+        NSudoTest::WriteFile(Directory.Join("node/node1/cpulist"), "4-7\n");
+        NSudoTest::WriteFile(Directory.Join("node/possible"), "0-1\n");
+    }
+}
+
+NSUDO_TEST_CASE(CurrentMachine)
+{
+    Mile::ProcessorTopology Topology = Mile::GetProcessorTopology();
+
+    ::CheckInvariants(Topology);
+
+    // The topology covers every processor the thread pool would use.
+    unsigned HardwareThreads = std::thread::hardware_concurrency();
+    if (HardwareThreads)
+    {
+        NSUDO_TEST_CHECK(
+            Topology.LogicalProcessors.size() >= HardwareThreads);
+    }
+
+    NSUDO_TEST_CHECK(Mile::SetCurrentThreadProcessorGroup(Topology, 0));
+    NSUDO_TEST_CHECK(!Mile::SetCurrentThreadProcessorGroup(
+        Topology,
+        static_cast<std::uint16_t>(Topology.GroupCount)));
+}
+
+#if defined(__linux__)
+
+NSUDO_TEST_CASE(TwoPackagesWithSmtAndNuma)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    ::CreateSystemDirectory(Directory);
+
+    Mile::ProcessorTopology Topology =
+        Mile::GetProcessorTopologyFromSystemPath(Directory.GetPath() + "/");
+
+    ::CheckInvariants(Topology);
+
+    NSUDO_TEST_CHECK_EQUAL(Topology.LogicalProcessors.size(), 7U);
+    NSUDO_TEST_CHECK_EQUAL(Topology.GroupCount, 1U);
+    NSUDO_TEST_CHECK(Topology.GroupActiveProcessorMasks.empty());
+    NSUDO_TEST_CHECK_EQUAL(Topology.CoreCount, 4U);
+    NSUDO_TEST_CHECK_EQUAL(Topology.PackageCount, 2U);
+    NSUDO_TEST_CHECK_EQUAL(Topology.NumaNodeCount, 2U);
+
+    const std::uint32_t ExpectedNumbers[] = { 0, 1, 2, 3, 4, 6, 7 };
+    const std::uint32_t ExpectedCores[] = { 0, 0, 1, 1, 2, 3, 3 };
+    const std::uint32_t ExpectedPackages[] = { 0, 0, 0, 0, 1, 1, 1 };
+    std::size_t Count = (std::min)(
+        Topology.LogicalProcessors.size(),
+        static_cast<std::size_t>(7));
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        Mile::LogicalProcessorInformation const& Processor =
+            Topology.LogicalProcessors[i];
+        NSUDO_TEST_CHECK_EQUAL(Processor.Number, ExpectedNumbers[i]);
+        NSUDO_TEST_CHECK_EQUAL(Processor.Core, ExpectedCores[i]);
+        NSUDO_TEST_CHECK_EQUAL(Processor.Package, ExpectedPackages[i]);
+        NSUDO_TEST_CHECK_EQUAL(Processor.NumaNode, ExpectedPackages[i]);
+    }
+
+    // Three caches per core and one per package, each reported once
+    // although every logical processor lists it.
+    NSUDO_TEST_CHECK_EQUAL(Topology.Caches.size(), 14U);
+
+    std::size_t L3Count = 0;
+    for (Mile::ProcessorCacheInformation const& Cache : Topology.Caches)
+    {
+        if (Cache.Level == 3)
+        {
+            ++L3Count;
+            NSUDO_TEST_CHECK(Cache.Type == Mile::ProcessorCacheType::Unified);
+            NSUDO_TEST_CHECK_EQUAL(Cache.Size, 24ULL * 1024 * 1024);
+        }
+        else if (Cache.Level == 2)
+        {
+            NSUDO_TEST_CHECK_EQUAL(Cache.Size, 1280ULL * 1024);
+        }
+        else if (Cache.Type == Mile::ProcessorCacheType::Data)
+        {
+            NSUDO_TEST_CHECK_EQUAL(Cache.Size, 48ULL * 1024);
+        }
+        else
+        {
+            NSUDO_TEST_CHECK(
+                Cache.Type == Mile::ProcessorCacheType::Instruction);
+            NSUDO_TEST_CHECK_EQUAL(Cache.Size, 32ULL * 1024);
+        }
+
+        // The offline processor 5 is not in the caches of the core it
+        // shares with the processor 4.
+        std::vector<std::uint32_t> Indices = Cache.LogicalProcessors;
+        std::sort(Indices.begin(), Indices.end());
+        if (Cache.Level == 3)
+        {
+            NSUDO_TEST_CHECK_EQUAL(Indices.size(), Indices[0] ? 3U : 4U);
+        }
+        else if (Indices == std::vector<std::uint32_t>{ 4 })
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Topology.LogicalProcessors[4].Number,
+                4U);
+        }
+        else
+        {
+            NSUDO_TEST_CHECK_EQUAL(Indices.size(), 2U);
+        }
+    }
+    NSUDO_TEST_CHECK_EQUAL(L3Count, 2U);
+}
+
+NSUDO_TEST_CASE(MissingSystemDirectoryFallsBack)
+{
+    NSudoTest::TemporaryDirectory Directory;
+
+    Mile::ProcessorTopology Topology =
+        Mile::GetProcessorTopologyFromSystemPath(Directory.GetPath() + "/");
+
+    ::CheckInvariants(Topology);
+
+    // Every logical processor is a separate core of a single package.
+    NSUDO_TEST_CHECK_EQUAL(
+        Topology.CoreCount,
+        Topology.LogicalProcessors.size());
+    NSUDO_TEST_CHECK_EQUAL(Topology.PackageCount, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Topology.NumaNodeCount, 1U);
+    NSUDO_TEST_CHECK(Topology.Caches.empty());
+}
+
+#endif
@@ -0,0 +1,548 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.Synchronization.Tests.cpp
+ * PURPOSE:   Implementation for the portable synchronization primitive tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.Synchronization.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define NSUDO_TEST_NOINLINE __declspec(noinline)
+#else
+#define NSUDO_TEST_NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+    const std::size_t ThreadCount = 8;
+
+    /**
+     * Runs a function on several threads at once, and waits for them.
+     */
+    template<typename FunctionType>
+    void RunOnThreads(
+        std::size_t Count,
+        FunctionType&& Function)
+    {
+        std::atomic<std::size_t> Ready{ 0 };
+        std::vector<std::thread> Threads;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Threads.emplace_back([&, i]()
+            {
+                // Start together, so the threads contend from the start.
+                Ready.fetch_add(1);
+                while (Ready.load() < Count)
+                {
+                    std::this_thread::yield();
+                }
+                Function(i);
+            });
+        }
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+    }
+
+    /**
+     * Counts the threads inside a critical section, and remembers the
+     * largest count.
+     */
+    class Occupancy
+    {
+    private:
+
+        std::atomic<std::size_t> m_Current{ 0 };
+        std::atomic<std::size_t> m_Maximum{ 0 };
+
+    public:
+
+        void Enter()
+        {
+            std::size_t Current = this->m_Current.fetch_add(1) + 1;
+            std::size_t Maximum = this->m_Maximum.load();
+            while (Maximum < Current &&
+                !this->m_Maximum.compare_exchange_weak(Maximum, Current))
+            {
+            }
+        }
+
+        void Leave()
+        {
+            this->m_Current.fetch_sub(1);
+        }
+
+        std::size_t GetCurrent() const
+        {
+            return this->m_Current.load();
+        }
+
+        std::size_t GetMaximum() const
+        {
+            return this->m_Maximum.load();
+        }
+    };
+
+    /**
+     * Locks a mutex from a call site of its own, so the owner sites of the
+     * profile can tell the two functions apart. The site is the return
+     * address of the profiled call, so they do some work after it, which
+     * keeps the compiler from turning the call into a jump or from merging
+     * the two functions.
+     */
+    NSUDO_TEST_NOINLINE int LockFromFirstSite(
+        Mile::Mutex& Lock)
+    {
+        Lock.Lock();
+        return 1;
+    }
+
+    NSUDO_TEST_NOINLINE int LockFromSecondSite(
+        Mile::Mutex& Lock)
+    {
+        Lock.Lock();
+        return 2;
+    }
+
+    /**
+     * Makes another thread wait for a mutex which the calling thread owns,
+     * and then releases it.
+     */
+    void ContendWhileOwned(
+        Mile::Mutex& Lock)
+    {
+        std::atomic<bool> Started{ false };
+        std::thread Waiter([&]()
+        {
+            Started.store(true);
+            Lock.Lock();
+            Lock.Unlock();
+        });
+        while (!Started.load())
+        {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        Lock.Unlock();
+        Waiter.join();
+    }
+
+    std::size_t GetBucket(
+        std::uint64_t WaitNanoseconds)
+    {
+        std::size_t Bucket = 0;
+        for (; WaitNanoseconds > 1; WaitNanoseconds >>= 1)
+        {
+            ++Bucket;
+        }
+        return (std::min)(Bucket, Mile::LockProfile::HistogramBuckets - 1);
+    }
+
+    std::uint64_t SumHistogram(
+        Mile::LockProfileSnapshot const& Snapshot)
+    {
+        std::uint64_t Sum = 0;
+        for (std::uint64_t Count : Snapshot.WaitHistogram)
+        {
+            Sum += Count;
+        }
+        return Sum;
+    }
+}
+
+NSUDO_TEST_CASE(MutexExcludesUnderContention)
+{
+    // The profiled path takes other code than the raw one.
+    Mile::LockProfile Profile("MutexExcludesUnderContention");
+    Mile::LockProfile* const Profiles[] = { nullptr, &Profile };
+    for (Mile::LockProfile* CurrentProfile : Profiles)
+    {
+        Mile::Mutex Lock(CurrentProfile);
+        Occupancy Inside;
+        const std::size_t Iterations = 20000;
+        std::uint64_t Counter = 0;
+        ::RunOnThreads(ThreadCount, [&](std::size_t)
+        {
+            for (std::size_t i = 0; i < Iterations; ++i)
+            {
+                Mile::AutoLock<Mile::Mutex> Guard(Lock);
+                Inside.Enter();
+                ++Counter;
+                Inside.Leave();
+            }
+        });
+
+        NSUDO_TEST_CHECK_EQUAL(Counter, ThreadCount * Iterations);
+        NSUDO_TEST_CHECK_EQUAL(Inside.GetMaximum(), 1U);
+    }
+
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, ThreadCount * 20000U);
+    NSUDO_TEST_CHECK_EQUAL(::SumHistogram(Snapshot), Snapshot.Contentions);
+}
+
+NSUDO_TEST_CASE(SharedMutexExcludesWritersFromEveryone)
+{
+    Mile::LockProfile Profile("SharedMutexExcludesWritersFromEveryone");
+    Mile::LockProfile* const Profiles[] = { nullptr, &Profile };
+    for (Mile::LockProfile* CurrentProfile : Profiles)
+    {
+        Mile::SharedMutex Lock(CurrentProfile);
+        Occupancy Readers;
+        Occupancy Writers;
+        std::atomic<std::size_t> Violations{ 0 };
+        std::uint64_t Counter = 0;
+        std::atomic<std::uint64_t> ReadSum{ 0 };
+        const std::size_t Iterations = 5000;
+        ::RunOnThreads(ThreadCount, [&](std::size_t Index)
+        {
+            for (std::size_t i = 0; i < Iterations; ++i)
+            {
+                if ((i + Index) % 4 == 0)
+                {
+                    Mile::AutoExclusiveLock<Mile::SharedMutex> Guard(Lock);
+                    Writers.Enter();
+                    if (Readers.GetCurrent() || Writers.GetCurrent() != 1)
+                    {
+                        Violations.fetch_add(1);
+                    }
+                    ++Counter;
+                    Writers.Leave();
+                }
+                else
+                {
+                    Mile::AutoSharedLock<Mile::SharedMutex> Guard(Lock);
+                    Readers.Enter();
+                    if (Writers.GetCurrent())
+                    {
+                        Violations.fetch_add(1);
+                    }
+                    ReadSum.fetch_add(Counter);
+                    Readers.Leave();
+                }
+            }
+        });
+
+        NSUDO_TEST_CHECK_EQUAL(Violations.load(), 0U);
+        NSUDO_TEST_CHECK_EQUAL(Counter, ThreadCount * Iterations / 4);
+        NSUDO_TEST_CHECK_EQUAL(Writers.GetMaximum(), 1U);
+    }
+
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, ThreadCount * 5000U);
+    NSUDO_TEST_CHECK_EQUAL(::SumHistogram(Snapshot), Snapshot.Contentions);
+}
+
+NSUDO_TEST_CASE(ReadersShareTheLock)
+{
+    // Each reader waits inside the lock until all of them are inside,
+    // which only ends if they hold it at the same time.
+    Mile::SharedMutex Lock;
+    Occupancy Readers;
+    ::RunOnThreads(4, [&](std::size_t)
+    {
+        Mile::AutoSharedLock<Mile::SharedMutex> Guard(Lock);
+        Readers.Enter();
+        while (Readers.GetMaximum() < 4)
+        {
+            std::this_thread::yield();
+        }
+    });
+    NSUDO_TEST_CHECK_EQUAL(Readers.GetMaximum(), 4U);
+}
+
+NSUDO_TEST_CASE(WaitingWriterBlocksNewReaders)
+{
+    Mile::SharedMutex Lock;
+    Lock.LockShared();
+
+    std::atomic<std::size_t> Order{ 0 };
+    std::size_t WriterOrder = 0;
+    std::thread Writer([&]()
+    {
+        Lock.LockExclusive();
+        WriterOrder = Order.fetch_add(1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        Lock.UnlockExclusive();
+    });
+
+    // A new reader gets in until the writer has given up spinning and
+    // marked itself as pending.
+    bool Pending = false;
+    auto Deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!Pending && std::chrono::steady_clock::now() < Deadline)
+    {
+        if (Lock.TryLockShared())
+        {
+            Lock.UnlockShared();
+            std::this_thread::yield();
+        }
+        else
+        {
+            Pending = true;
+        }
+    }
+    NSUDO_TEST_CHECK(Pending);
+
+    // The reader which comes after the writer gets in after it, although
+    // the lock is only held in shared mode.
+    std::size_t ReaderOrder = 0;
+    std::thread Reader([&]()
+    {
+        Lock.LockShared();
+        ReaderOrder = Order.fetch_add(1);
+        Lock.UnlockShared();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    NSUDO_TEST_CHECK_EQUAL(Order.load(), 0U);
+
+    Lock.UnlockShared();
+    Writer.join();
+    Reader.join();
+    NSUDO_TEST_CHECK_EQUAL(WriterOrder, 0U);
+    NSUDO_TEST_CHECK_EQUAL(ReaderOrder, 1U);
+
+    // The lock is free again.
+    NSUDO_TEST_CHECK(Lock.TryLockExclusive());
+    Lock.UnlockExclusive();
+}
+
+NSUDO_TEST_CASE(TryLockDoesNotWait)
+{
+    Mile::LockProfile Profile("TryLockDoesNotWait");
+    Mile::LockProfile* const Profiles[] = { nullptr, &Profile };
+    for (Mile::LockProfile* CurrentProfile : Profiles)
+    {
+        Mile::Mutex Lock(CurrentProfile);
+        {
+            Mile::AutoTryLock<Mile::Mutex> Guard(Lock);
+            NSUDO_TEST_CHECK(Guard.IsLocked());
+
+            // The lock is not recursive, and a failed guard does not unlock
+            // it when it is destroyed.
+            {
+                Mile::AutoTryLock<Mile::Mutex> Second(Lock);
+                NSUDO_TEST_CHECK(!Second.IsLocked());
+            }
+            bool Locked = true;
+            std::thread([&]() { Locked = Lock.TryLock(); }).join();
+            NSUDO_TEST_CHECK(!Locked);
+        }
+        NSUDO_TEST_CHECK(Lock.TryLock());
+        Lock.Unlock();
+
+        Mile::SharedMutex SharedLock(CurrentProfile);
+        SharedLock.LockShared();
+        {
+            Mile::AutoSharedTryLock<Mile::SharedMutex> Shared(SharedLock);
+            NSUDO_TEST_CHECK(Shared.IsLocked());
+            Mile::AutoExclusiveTryLock<Mile::SharedMutex> Exclusive(
+                SharedLock);
+            NSUDO_TEST_CHECK(!Exclusive.IsLocked());
+        }
+        SharedLock.UnlockShared();
+
+        {
+            Mile::AutoExclusiveTryLock<Mile::SharedMutex> Exclusive(
+                SharedLock);
+            NSUDO_TEST_CHECK(Exclusive.IsLocked());
+            Mile::AutoSharedTryLock<Mile::SharedMutex> Shared(SharedLock);
+            NSUDO_TEST_CHECK(!Shared.IsLocked());
+            NSUDO_TEST_CHECK(!SharedLock.TryLockExclusive());
+        }
+
+        // Both guards released what they acquired.
+        NSUDO_TEST_CHECK(SharedLock.TryLockExclusive());
+        SharedLock.UnlockExclusive();
+    }
+
+    // Only the successful attempts count as acquisitions, and none of them
+    // waited.
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, 6U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Contentions, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.TotalWaitNanoseconds, 0U);
+    NSUDO_TEST_CHECK_EQUAL(::SumHistogram(Snapshot), 0U);
+    NSUDO_TEST_CHECK(Snapshot.OwnerSites.empty());
+}
+
+NSUDO_TEST_CASE(LockProfileCountsWaits)
+{
+    Mile::LockProfile Profile("LockProfileCountsWaits");
+
+    const std::uint64_t Waits[] =
+    {
+        1, 2, 3, 4, 1023, 1024, 1000000, UINT64_MAX
+    };
+    std::uint64_t Total = 0;
+    for (std::uint64_t Wait : Waits)
+    {
+        Profile.RecordAcquisition(Wait, 0);
+        Total += Wait;
+    }
+    Profile.RecordAcquisition(0, 0);
+    Profile.RecordAcquisition(0, 0);
+
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Name, "LockProfileCountsWaits");
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, 10U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Contentions, 8U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.TotalWaitNanoseconds, Total);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.MaximumWaitNanoseconds, UINT64_MAX);
+
+    // The bucket N counts the waits in [2^N, 2^(N+1)), and the last one
+    // also the longer waits.
+    std::uint64_t Expected[Mile::LockProfile::HistogramBuckets] = {};
+    Expected[0] = 1;
+    Expected[1] = 2;
+    Expected[2] = 1;
+    Expected[9] = 1;
+    Expected[10] = 1;
+    Expected[19] = 1;
+    Expected[31] = 1;
+    for (std::size_t i = 0; i < Mile::LockProfile::HistogramBuckets; ++i)
+    {
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.WaitHistogram[i], Expected[i]);
+    }
+    NSUDO_TEST_CHECK(Snapshot.OwnerSites.empty());
+}
+
+NSUDO_TEST_CASE(LockProfileKeepsTheBusiestOwnerSites)
+{
+    Mile::LockProfile Profile("LockProfileKeepsTheBusiestOwnerSites");
+    for (std::uintptr_t Site = 1; Site <= 20; ++Site)
+    {
+        for (std::uintptr_t i = 0; i < Site; ++i)
+        {
+            Profile.RecordAcquisition(10, 0x1000 + Site);
+        }
+    }
+
+    // The first sites take the slots, and the later ones are not tracked.
+    const std::size_t MaximumOwnerSites = Mile::LockProfile::MaximumOwnerSites;
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites.size(), MaximumOwnerSites);
+    for (std::size_t i = 0; i < Snapshot.OwnerSites.size(); ++i)
+    {
+        std::uintptr_t Site = MaximumOwnerSites - i;
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[i].first, 0x1000 + Site);
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[i].second, Site);
+    }
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Contentions, 210U);
+}
+
+NSUDO_TEST_CASE(LockProfileRecordsTheOwnerOfContendedLocks)
+{
+    Mile::LockProfile Profile("LockProfileRecordsTheOwnerOfContendedLocks");
+    Mile::Mutex Lock(&Profile);
+
+    // Two waits while the first site owns the lock, and one while the
+    // second does.
+    int Sites = ::LockFromFirstSite(Lock);
+    ::ContendWhileOwned(Lock);
+    Sites += ::LockFromFirstSite(Lock);
+    ::ContendWhileOwned(Lock);
+    Sites += ::LockFromSecondSite(Lock);
+    ::ContendWhileOwned(Lock);
+    NSUDO_TEST_CHECK_EQUAL(Sites, 4);
+
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, 6U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Contentions, 3U);
+    NSUDO_TEST_CHECK(Snapshot.MaximumWaitNanoseconds > 0);
+    NSUDO_TEST_CHECK(
+        Snapshot.TotalWaitNanoseconds >= Snapshot.MaximumWaitNanoseconds);
+    NSUDO_TEST_CHECK_EQUAL(::SumHistogram(Snapshot), 3U);
+    NSUDO_TEST_CHECK(Snapshot.WaitHistogram[
+        ::GetBucket(Snapshot.MaximumWaitNanoseconds)] >= 1);
+
+    // The waiters themselves are not owners when the others wait, since
+    // nobody waits for them. Without optimizations Lock is not inlined, so
+    // its own call of the profiled path is the only site.
+    if (1 == Snapshot.OwnerSites.size())
+    {
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[0].second, 3U);
+        NSUDO_TEST_CHECK(Snapshot.OwnerSites[0].first != 0);
+    }
+    else if (NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites.size(), 2U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[0].second, 2U);
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[1].second, 1U);
+        NSUDO_TEST_CHECK(Snapshot.OwnerSites[0].first != 0);
+        NSUDO_TEST_CHECK(Snapshot.OwnerSites[1].first != 0);
+        NSUDO_TEST_CHECK(
+            Snapshot.OwnerSites[0].first != Snapshot.OwnerSites[1].first);
+    }
+}
+
+NSUDO_TEST_CASE(ReaderBlockedByWriterReportsTheWriter)
+{
+    Mile::LockProfile Profile("ReaderBlockedByWriterReportsTheWriter");
+    Mile::SharedMutex Lock(&Profile);
+    Lock.LockExclusive();
+
+    std::atomic<bool> Started{ false };
+    std::thread Reader([&]()
+    {
+        Started.store(true);
+        Lock.LockShared();
+        Lock.UnlockShared();
+    });
+    while (!Started.load())
+    {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    Lock.UnlockExclusive();
+    Reader.join();
+
+    Mile::LockProfileSnapshot Snapshot = Profile.GetSnapshot();
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Acquisitions, 2U);
+    NSUDO_TEST_CHECK_EQUAL(Snapshot.Contentions, 1U);
+    if (NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites.size(), 1U))
+    {
+        NSUDO_TEST_CHECK(Snapshot.OwnerSites[0].first != 0);
+        NSUDO_TEST_CHECK_EQUAL(Snapshot.OwnerSites[0].second, 1U);
+    }
+}
+
+NSUDO_TEST_CASE(ProfilesAreRegisteredWhileTheyLive)
+{
+    auto CountProfiles = [](std::string const& Name)
+    {
+        std::size_t Count = 0;
+        for (Mile::LockProfileSnapshot const& Snapshot
+            : Mile::LockProfile::GetAllSnapshots())
+        {
+            Count += Snapshot.Name == Name;
+        }
+        return Count;
+    };
+
+    {
+        Mile::LockProfile First("ProfilesAreRegisteredWhileTheyLive");
+        Mile::LockProfile Second("ProfilesAreRegisteredWhileTheyLive");
+        NSUDO_TEST_CHECK_EQUAL(
+            CountProfiles("ProfilesAreRegisteredWhileTheyLive"),
+            2U);
+    }
+    NSUDO_TEST_CHECK_EQUAL(
+        CountProfiles("ProfilesAreRegisteredWhileTheyLive"),
+        0U);
+}
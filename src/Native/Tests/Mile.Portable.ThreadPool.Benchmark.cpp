@@ -0,0 +1,222 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ThreadPool.Benchmark.cpp
+ * PURPOSE:   Implementation for the thread pool scaling benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.ThreadPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**
+     * A few hundred cycles of work which the compiler cannot remove.
+     */
+    std::uint64_t Mix(
+        std::uint64_t Value)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            Value ^= Value >> 33;
+            Value *= 0xFF51AFD7ED558CCDULL;
+            Value ^= Value >> 29;
+        }
+        return Value;
+    }
+
+    std::uint64_t MixRange(
+        std::size_t Begin,
+        std::size_t End)
+    {
+        std::uint64_t Result = 0;
+        for (std::size_t i = Begin; i < End; ++i)
+        {
+            Result += ::Mix(i);
+        }
+        return Result;
+    }
+
+    /**
+     * Spawns FanOut tasks at each level of a tree of Depth levels, which is
+     * what a directory walk does, and counts the visited nodes.
+     */
+    void Spawn(
+        Mile::ThreadPool& Pool,
+        Mile::TaskGroup& Group,
+        std::atomic<std::uint64_t>& Nodes,
+        unsigned Depth,
+        unsigned FanOut)
+    {
+        Nodes.fetch_add(1, std::memory_order_relaxed);
+        if (!Depth)
+        {
+            return;
+        }
+
+        for (unsigned i = 0; i < FanOut; ++i)
+        {
+            Pool.Submit(Group, [&Pool, &Group, &Nodes, Depth, FanOut]()
+            {
+                ::Spawn(Pool, Group, Nodes, Depth - 1, FanOut);
+            });
+        }
+    }
+
+    std::uint64_t CountNodes(
+        unsigned Depth,
+        unsigned FanOut)
+    {
+        std::uint64_t Result = 0;
+        std::uint64_t Level = 1;
+        for (unsigned i = 0; i <= Depth; ++i)
+        {
+            Result += Level;
+            Level *= FanOut;
+        }
+        return Result;
+    }
+
+    struct Measurement
+    {
+        double ParallelFor;
+        double ForkJoin;
+        double Submit;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t LoopCount = Options.Quick ? 20000 : 4000000;
+    const unsigned TreeDepth = Options.Quick ? 5 : 8;
+    const unsigned TreeFanOut = 4;
+    const std::size_t SubmitCount = Options.Quick ? 10000 : 1000000;
+    const std::vector<std::size_t> ThreadCounts = Options.Quick
+        ? std::vector<std::size_t>{ 1, 2, 4 }
+        : std::vector<std::size_t>{ 1, 2, 4, 8, 16, 32, 64 };
+
+    const std::uint64_t ExpectedSum = ::MixRange(0, LoopCount);
+    const std::uint64_t ExpectedNodes = ::CountNodes(TreeDepth, TreeFanOut);
+
+    std::printf(
+        "%zu logical processors, %zu loop iterations, %llu tree nodes, "
+        "%zu submitted tasks\n\n",
+        static_cast<std::size_t>(std::thread::hardware_concurrency()),
+        LoopCount,
+        static_cast<unsigned long long>(ExpectedNodes),
+        SubmitCount);
+
+    std::vector<Measurement> Measurements;
+    for (std::size_t Threads : ThreadCounts)
+    {
+        Mile::ThreadPool Pool(Threads);
+        Measurement Current = {};
+
+        {
+            std::vector<std::uint64_t> Sums(
+                Pool.GetNumberOfThreads() + 1,
+                0);
+            std::uint64_t Sum = 0;
+
+            NSudoTest::Stopwatch Timer;
+            Mile::ParallelFor(
+                Pool,
+                0,
+                LoopCount,
+                1024,
+                [&](std::size_t Index)
+            {
+                // Sum per worker rather than with one atomic, which would
+                // only measure cache line ping-pong.
+                Sums[Pool.GetCurrentWorkerIndex()] += ::Mix(Index);
+            });
+            Current.ParallelFor = Timer.GetSeconds();
+
+            for (std::uint64_t const& Value : Sums)
+            {
+                Sum += Value;
+            }
+            NSUDO_TEST_CHECK_EQUAL(Sum, ExpectedSum);
+        }
+
+        {
+            Mile::TaskGroup Group;
+            std::atomic<std::uint64_t> Nodes{ 0 };
+
+            NSudoTest::Stopwatch Timer;
+            ::Spawn(Pool, Group, Nodes, TreeDepth, TreeFanOut);
+            Pool.Wait(Group);
+            Current.ForkJoin = Timer.GetSeconds();
+
+            NSUDO_TEST_CHECK_EQUAL(Nodes.load(), ExpectedNodes);
+        }
+
+        {
+            Mile::TaskGroup Group;
+            std::atomic<std::size_t> Completed{ 0 };
+
+            NSudoTest::Stopwatch Timer;
+            for (std::size_t i = 0; i < SubmitCount; ++i)
+            {
+                Pool.Submit(Group, [&Completed]()
+                {
+                    Completed.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            Pool.Wait(Group);
+            Current.Submit = Timer.GetSeconds();
+
+            NSUDO_TEST_CHECK_EQUAL(Completed.load(), SubmitCount);
+        }
+
+        Measurements.push_back(Current);
+
+        std::string Suffix = " (" + std::to_string(Threads) + " threads)";
+        NSudoTest::PrintMeasurement(
+            "ParallelFor" + Suffix,
+            Current.ParallelFor,
+            static_cast<double>(LoopCount),
+            "iterations");
+        NSudoTest::PrintMeasurement(
+            "Fork-join tree" + Suffix,
+            Current.ForkJoin,
+            static_cast<double>(ExpectedNodes),
+            "tasks");
+        NSudoTest::PrintMeasurement(
+            "Submit from outside" + Suffix,
+            Current.Submit,
+            static_cast<double>(SubmitCount),
+            "tasks");
+    }
+
+    std::printf("\n%-10s %12s %12s %12s\n",
+        "Threads", "ParallelFor", "Fork-join", "Submit");
+    for (std::size_t i = 0; i < Measurements.size(); ++i)
+    {
+        std::printf(
+            "%-10zu %11.2fx %11.2fx %11.2fx\n",
+            ThreadCounts[i],
+            Measurements[0].ParallelFor / Measurements[i].ParallelFor,
+            Measurements[0].ForkJoin / Measurements[i].ForkJoin,
+            Measurements[0].Submit / Measurements[i].Submit);
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+﻿/*
+ * PROJECT:   Mouri Internal Library Essentials
+ * FILE:      Mile.Portable.ThreadPool.Tests.cpp
+ * PURPOSE:   Implementation for the work-stealing thread pool tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "Mile.Portable.ThreadPool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**
+     * Occupies a worker until it is released, so the tasks queued behind it
+     * cannot start.
+     */
+    class Blocker
+    {
+    private:
+
+        std::atomic<bool> m_Started{ false };
+        std::atomic<bool> m_Released{ false };
+
+    public:
+
+        void Run()
+        {
+            this->m_Started.store(true);
+            while (!this->m_Released.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void WaitUntilStarted()
+        {
+            while (!this->m_Started.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void Release()
+        {
+            this->m_Released.store(true);
+        }
+    };
+
+    /**
+     * Computes a Fibonacci number with a task for each call, each of which
+     * waits for its children, like a recursive divide and conquer.
+     */
+    std::size_t Fibonacci(
+        Mile::ThreadPool& Pool,
+        std::size_t Index)
+    {
+        if (Index < 2)
+        {
+            return Index;
+        }
+
+        std::size_t Left = 0;
+        Mile::TaskGroup Group;
+        Pool.Submit(Group, [&Pool, &Left, Index]()
+        {
+            Left = ::Fibonacci(Pool, Index - 1);
+        });
+        std::size_t Right = ::Fibonacci(Pool, Index - 2);
+        Pool.Wait(Group);
+        return Left + Right;
+    }
+
+    /**
+     * Runs a ParallelFor and counts how often each index of the range is
+     * visited.
+     */
+    std::vector<std::size_t> CountVisits(
+        Mile::ThreadPool& Pool,
+        std::size_t Begin,
+        std::size_t End,
+        std::size_t Grain)
+    {
+        std::unique_ptr<std::atomic<std::size_t>[]> Visits(
+            new std::atomic<std::size_t>[End]);
+        for (std::size_t i = 0; i < End; ++i)
+        {
+            Visits[i].store(0);
+        }
+
+        Mile::ParallelFor(Pool, Begin, End, Grain, [&](std::size_t Index)
+        {
+            Visits[Index].fetch_add(1);
+        });
+
+        std::vector<std::size_t> Result;
+        for (std::size_t i = 0; i < End; ++i)
+        {
+            Result.push_back(Visits[i].load());
+        }
+        return Result;
+    }
+}
+
+NSUDO_TEST_CASE(CancelSkipsQueuedTasks)
+{
+    // With one worker, which the blocker occupies, nothing of the group can
+    // start before it is canceled.
+    Mile::ThreadPool Pool(1);
+    Blocker Worker;
+    Mile::TaskGroup BlockerGroup;
+    Pool.Submit(BlockerGroup, [&Worker]() { Worker.Run(); });
+    Worker.WaitUntilStarted();
+
+    std::atomic<std::size_t> Executed{ 0 };
+    Mile::TaskGroup Group;
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        Pool.Submit(Group, [&Executed]() { Executed.fetch_add(1); });
+    }
+    NSUDO_TEST_CHECK(!Group.IsCompleted());
+
+    Group.Cancel();
+    Worker.Release();
+    Pool.Wait(Group);
+    Pool.Wait(BlockerGroup);
+
+    NSUDO_TEST_CHECK(Group.IsCanceled());
+    NSUDO_TEST_CHECK(Group.IsCompleted());
+    NSUDO_TEST_CHECK_EQUAL(Executed.load(), 0U);
+}
+
+NSUDO_TEST_CASE(RunningTasksSeeTheCancellation)
+{
+    Mile::ThreadPool Pool(2);
+    std::atomic<std::size_t> Started{ 0 };
+    Mile::TaskGroup Group;
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        Pool.Submit(Group, [&Group, &Started]()
+        {
+            Started.fetch_add(1);
+            while (!Group.IsCanceled())
+            {
+                std::this_thread::yield();
+            }
+        });
+    }
+    while (Started.load() < 2)
+    {
+        std::this_thread::yield();
+    }
+
+    NSUDO_TEST_CHECK(!Group.IsCompleted());
+    Group.Cancel();
+    Pool.Wait(Group);
+    NSUDO_TEST_CHECK(Group.IsCompleted());
+}
+
+NSUDO_TEST_CASE(ExceptionIsRethrownFromWait)
+{
+    Mile::ThreadPool Pool(4);
+    Mile::TaskGroup Group;
+    std::atomic<std::size_t> Executed{ 0 };
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        Pool.Submit(Group, [&Executed, i]()
+        {
+            Executed.fetch_add(1);
+            if (i % 50 == 10)
+            {
+                throw std::runtime_error("Task " + std::to_string(i));
+            }
+        });
+    }
+
+    // Only the first exception is kept, and the group is canceled so the
+    // remaining tasks are skipped.
+    std::size_t Caught = 0;
+    try
+    {
+        Pool.Wait(Group);
+    }
+    catch (std::runtime_error const& Exception)
+    {
+        ++Caught;
+        std::string Message = Exception.what();
+        NSUDO_TEST_CHECK(
+            Message == "Task 10" ||
+            Message == "Task 60" ||
+            Message == "Task 110" ||
+            Message == "Task 160");
+    }
+    NSUDO_TEST_CHECK_EQUAL(Caught, 1U);
+    NSUDO_TEST_CHECK(Group.IsCanceled());
+    NSUDO_TEST_CHECK(Group.IsCompleted());
+    NSUDO_TEST_CHECK(Executed.load() >= 1 && Executed.load() <= 200);
+
+    // The exception is rethrown once.
+    try
+    {
+        Pool.Wait(Group);
+    }
+    catch (...)
+    {
+        ++Caught;
+    }
+    NSUDO_TEST_CHECK_EQUAL(Caught, 1U);
+}
+
+NSUDO_TEST_CASE(ExceptionOfTheCallingThreadCancelsParallelFor)
+{
+    Mile::ThreadPool Pool(3);
+    std::atomic<std::size_t> Visited{ 0 };
+    bool Caught = false;
+    try
+    {
+        Mile::ParallelFor(Pool, 0, 100000, 10, [&](std::size_t Index)
+        {
+            Visited.fetch_add(1);
+            if (Index == 5000)
+            {
+                throw std::out_of_range("Index 5000");
+            }
+        });
+    }
+    catch (std::out_of_range const& Exception)
+    {
+        Caught = (std::string(Exception.what()) == "Index 5000");
+    }
+    NSUDO_TEST_CHECK(Caught);
+    NSUDO_TEST_CHECK(Visited.load() < 100000U);
+}
+
+NSUDO_TEST_CASE(NestedWaitDoesNotDeadlock)
+{
+    // A task which waits for the tasks it queues runs them itself, so even
+    // a pool whose only worker is waiting completes them.
+    {
+        Mile::ThreadPool Pool(1);
+        std::atomic<std::size_t> Inner{ 0 };
+        Mile::TaskGroup Outer;
+        Pool.Submit(Outer, [&Pool, &Inner]()
+        {
+            Mile::TaskGroup Group;
+            for (std::size_t i = 0; i < 64; ++i)
+            {
+                Pool.Submit(Group, [&Inner]() { Inner.fetch_add(1); });
+            }
+            Pool.Wait(Group);
+        });
+        Pool.Wait(Outer);
+        NSUDO_TEST_CHECK_EQUAL(Inner.load(), 64U);
+    }
+
+    // Every worker waits in a recursion much deeper than the number of
+    // workers.
+    for (std::size_t Threads : { 1, 2, 4 })
+    {
+        Mile::ThreadPool Pool(Threads);
+        std::size_t Result = 0;
+        Mile::TaskGroup Group;
+        Pool.Submit(Group, [&Pool, &Result]()
+        {
+            Result = ::Fibonacci(Pool, 18);
+        });
+        Pool.Wait(Group);
+        NSUDO_TEST_CHECK_EQUAL(Result, 2584U);
+    }
+
+    // ParallelFor from inside a ParallelFor.
+    {
+        Mile::ThreadPool Pool(2);
+        std::atomic<std::size_t> Sum{ 0 };
+        Mile::ParallelFor(Pool, 0, 16, 1, [&](std::size_t Outer)
+        {
+            Mile::ParallelFor(Pool, 0, 100, 7, [&](std::size_t Inner)
+            {
+                Sum.fetch_add(Outer * 100 + Inner);
+            });
+        });
+        NSUDO_TEST_CHECK_EQUAL(Sum.load(), 1600U * 1599U / 2U);
+    }
+}
+
+NSUDO_TEST_CASE(ParallelForVisitsEachIndexOnce)
+{
+    Mile::ThreadPool Pool(4);
+    struct Range
+    {
+        std::size_t Begin;
+        std::size_t End;
+        std::size_t Grain;
+    };
+    const Range Ranges[] =
+    {
+        { 0, 1000, 0 },
+        { 0, 1000, 1 },
+        { 0, 1000, 7 },
+        { 0, 1000, 1000 },
+        { 0, 1000, 5000 },
+        { 13, 1000, 64 },
+        { 999, 1000, 3 },
+        { 0, 3, 0 },
+        { 0, 100000, 0 },
+        { 5, 100000, 333 },
+    };
+    for (Range const& Current : Ranges)
+    {
+        std::vector<std::size_t> Visits = ::CountVisits(
+            Pool,
+            Current.Begin,
+            Current.End,
+            Current.Grain);
+        std::size_t Wrong = 0;
+        for (std::size_t i = 0; i < Visits.size(); ++i)
+        {
+            Wrong += Visits[i] != (i >= Current.Begin ? 1U : 0U);
+        }
+        NSUDO_TEST_CHECK_EQUAL(Wrong, 0U);
+    }
+
+    // Empty ranges call nothing.
+    std::atomic<std::size_t> Calls{ 0 };
+    auto Count = [&Calls](std::size_t) { Calls.fetch_add(1); };
+    Mile::ParallelFor(Pool, 10, 10, 0, Count);
+    Mile::ParallelFor(Pool, 10, 5, 0, Count);
+    NSUDO_TEST_CHECK_EQUAL(Calls.load(), 0U);
+}
+
+NSUDO_TEST_CASE(ParallelForStopsAfterCancellation)
+{
+    // The chunks which are claimed before the cancellation complete, and
+    // none is claimed after it, so each worker finishes one chunk at most.
+    Mile::ThreadPool Pool(4);
+    const std::size_t Count = 1000000;
+    const std::size_t Grain = 100;
+    std::unique_ptr<std::atomic<bool>[]> Visited(
+        new std::atomic<bool>[Count]);
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        Visited[i].store(false);
+    }
+
+    Mile::TaskGroup Group;
+    Mile::ParallelFor(Pool, 0, Count, Grain, [&](std::size_t Index)
+    {
+        Visited[Index].store(true);
+        Group.Cancel();
+    }, &Group);
+    NSUDO_TEST_CHECK(Group.IsCanceled());
+    NSUDO_TEST_CHECK(Group.IsCompleted());
+
+    std::size_t VisitedChunks = 0;
+    std::size_t PartialChunks = 0;
+    for (std::size_t Chunk = 0; Chunk < Count / Grain; ++Chunk)
+    {
+        std::size_t VisitedIndexes = 0;
+        for (std::size_t i = Chunk * Grain; i < (Chunk + 1) * Grain; ++i)
+        {
+            VisitedIndexes += Visited[i].load();
+        }
+        VisitedChunks += VisitedIndexes != 0;
+        PartialChunks += VisitedIndexes != 0 && VisitedIndexes != Grain;
+    }
+    NSUDO_TEST_CHECK(VisitedChunks >= 1);
+    NSUDO_TEST_CHECK(VisitedChunks <= Pool.GetNumberOfThreads() + 1);
+    NSUDO_TEST_CHECK_EQUAL(PartialChunks, 0U);
+
+    // A group which is canceled before the loop skips all of it.
+    std::atomic<std::size_t> Calls{ 0 };
+    Mile::ParallelFor(Pool, 0, Count, Grain, [&](std::size_t)
+    {
+        Calls.fetch_add(1);
+    }, &Group);
+    NSUDO_TEST_CHECK_EQUAL(Calls.load(), 0U);
+}
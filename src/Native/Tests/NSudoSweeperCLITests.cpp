@@ -0,0 +1,1180 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperCLITests.cpp
+ * PURPOSE:   Implementation for the headless front end tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace
+{
+    /**
+     * A JSON value. Numbers are integers, which are all the front end
+     * writes.
+     */
+    struct JsonValue
+    {
+        enum class ValueType
+        {
+            Null,
+            Boolean,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+        ValueType Type = ValueType::Null;
+        bool Boolean = false;
+        std::int64_t Number = 0;
+        std::string String;
+        std::vector<JsonValue> Elements;
+        std::map<std::string, JsonValue> Members;
+
+        JsonValue const* Find(
+            std::string const& Name) const
+        {
+            auto Iterator = this->Members.find(Name);
+            return Iterator == this->Members.end()
+                ? nullptr
+                : &Iterator->second;
+        }
+    };
+
+    /**
+     * A strict parser of RFC 8259 which rejects what a consumer of JSON
+     * lines would: trailing characters, duplicate names, unescaped control
+     * characters and ill-formed UTF-8.
+     */
+    class JsonParser
+    {
+    private:
+
+        std::string const& m_Text;
+        std::size_t m_Position = 0;
+
+        bool IsEnd() const
+        {
+            return this->m_Position == this->m_Text.size();
+        }
+
+        char Peek() const
+        {
+            return this->IsEnd() ? '\0' : this->m_Text[this->m_Position];
+        }
+
+        void SkipWhitespace()
+        {
+            while (!this->IsEnd() &&
+                (this->Peek() == ' ' || this->Peek() == '\t' ||
+                    this->Peek() == '\r' || this->Peek() == '\n'))
+            {
+                ++this->m_Position;
+            }
+        }
+
+        bool Expect(
+            std::string const& Literal)
+        {
+            if (this->m_Text.compare(
+                this->m_Position,
+                Literal.size(),
+                Literal) != 0)
+            {
+                return false;
+            }
+            this->m_Position += Literal.size();
+            return true;
+        }
+
+        static void AppendUtf8(
+            std::string& Output,
+            std::uint32_t Character)
+        {
+            if (Character < 0x80)
+            {
+                Output.push_back(static_cast<char>(Character));
+            }
+            else if (Character < 0x800)
+            {
+                Output.push_back(static_cast<char>(0xC0 | (Character >> 6)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else if (Character < 0x10000)
+            {
+                Output.push_back(static_cast<char>(0xE0 | (Character >> 12)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 6) & 0x3F)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+            else
+            {
+                Output.push_back(static_cast<char>(0xF0 | (Character >> 18)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 12) & 0x3F)));
+                Output.push_back(static_cast<char>(
+                    0x80 | ((Character >> 6) & 0x3F)));
+                Output.push_back(static_cast<char>(0x80 | (Character & 0x3F)));
+            }
+        }
+
+        bool ParseHex(
+            std::uint32_t& Value)
+        {
+            Value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char Character = this->Peek();
+                std::uint32_t Digit;
+                if (Character >= '0' && Character <= '9')
+                {
+                    Digit = static_cast<std::uint32_t>(Character - '0');
+                }
+                else if (Character >= 'a' && Character <= 'f')
+                {
+                    Digit = static_cast<std::uint32_t>(Character - 'a' + 10);
+                }
+                else if (Character >= 'A' && Character <= 'F')
+                {
+                    Digit = static_cast<std::uint32_t>(Character - 'A' + 10);
+                }
+                else
+                {
+                    return false;
+                }
+                Value = Value * 16 + Digit;
+                ++this->m_Position;
+            }
+            return true;
+        }
+
+        /**
+         * Copies a well-formed UTF-8 sequence.
+         */
+        bool ParseUtf8(
+            std::string& Output)
+        {
+            std::uint8_t First = static_cast<std::uint8_t>(this->Peek());
+            std::size_t Length;
+            std::uint32_t Character;
+            std::uint32_t Minimum;
+            if (First >= 0xC2 && First <= 0xDF)
+            {
+                Length = 1;
+                Character = First & 0x1F;
+                Minimum = 0x80;
+            }
+            else if (First >= 0xE0 && First <= 0xEF)
+            {
+                Length = 2;
+                Character = First & 0x0F;
+                Minimum = 0x800;
+            }
+            else if (First >= 0xF0 && First <= 0xF4)
+            {
+                Length = 3;
+                Character = First & 0x07;
+                Minimum = 0x10000;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (this->m_Text.size() - this->m_Position - 1 < Length)
+            {
+                return false;
+            }
+            for (std::size_t i = 1; i <= Length; ++i)
+            {
+                std::uint8_t Next = static_cast<std::uint8_t>(
+                    this->m_Text[this->m_Position + i]);
+                if ((Next & 0xC0) != 0x80)
+                {
+                    return false;
+                }
+                Character = (Character << 6) | (Next & 0x3F);
+            }
+            if (Character < Minimum ||
+                Character > 0x10FFFF ||
+                (Character >= 0xD800 && Character <= 0xDFFF))
+            {
+                return false;
+            }
+
+            Output.append(this->m_Text, this->m_Position, Length + 1);
+            this->m_Position += Length + 1;
+            return true;
+        }
+
+        bool ParseString(
+            std::string& Output)
+        {
+            if (!this->Expect("\""))
+            {
+                return false;
+            }
+
+            for (;;)
+            {
+                if (this->IsEnd())
+                {
+                    return false;
+                }
+
+                char Character = this->Peek();
+                if (Character == '"')
+                {
+                    ++this->m_Position;
+                    return true;
+                }
+                if (static_cast<std::uint8_t>(Character) < 0x20)
+                {
+                    return false;
+                }
+                if (static_cast<std::uint8_t>(Character) >= 0x80)
+                {
+                    if (!this->ParseUtf8(Output))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                ++this->m_Position;
+                if (Character != '\\')
+                {
+                    Output.push_back(Character);
+                    continue;
+                }
+
+                Character = this->Peek();
+                ++this->m_Position;
+                switch (Character)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    Output.push_back(Character);
+                    break;
+                case 'b':
+                    Output.push_back('\b');
+                    break;
+                case 'f':
+                    Output.push_back('\f');
+                    break;
+                case 'n':
+                    Output.push_back('\n');
+                    break;
+                case 'r':
+                    Output.push_back('\r');
+                    break;
+                case 't':
+                    Output.push_back('\t');
+                    break;
+                case 'u':
+                {
+                    std::uint32_t Value;
+                    if (!this->ParseHex(Value))
+                    {
+                        return false;
+                    }
+                    if (Value >= 0xD800 && Value <= 0xDBFF)
+                    {
+                        std::uint32_t Low;
+                        if (!this->Expect("\\u") ||
+                            !this->ParseHex(Low) ||
+                            Low < 0xDC00 ||
+                            Low > 0xDFFF)
+                        {
+                            return false;
+                        }
+                        Value = 0x10000 + ((Value - 0xD800) << 10) +
+                            (Low - 0xDC00);
+                    }
+                    else if (Value >= 0xDC00 && Value <= 0xDFFF)
+                    {
+                        return false;
+                    }
+                    JsonParser::AppendUtf8(Output, Value);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+        }
+
+        bool ParseNumber(
+            std::int64_t& Output)
+        {
+            bool Negative = this->Peek() == '-';
+            if (Negative)
+            {
+                ++this->m_Position;
+            }
+
+            std::size_t First = this->m_Position;
+            std::uint64_t Value = 0;
+            while (this->Peek() >= '0' && this->Peek() <= '9')
+            {
+                std::uint64_t Digit =
+                    static_cast<std::uint64_t>(this->Peek() - '0');
+                if (Value > (UINT64_MAX - Digit) / 10)
+                {
+                    return false;
+                }
+                Value = Value * 10 + Digit;
+                ++this->m_Position;
+            }
+            std::size_t Length = this->m_Position - First;
+            if (!Length || (Length > 1 && this->m_Text[First] == '0'))
+            {
+                return false;
+            }
+
+            // The sizes are unsigned 64-bit values, which are kept in their
+            // two's complement.
+            Output = Negative
+                ? -static_cast<std::int64_t>(Value)
+                : static_cast<std::int64_t>(Value);
+            return true;
+        }
+
+        bool ParseValue(
+            JsonValue& Value,
+            std::size_t Depth)
+        {
+            if (Depth > 32)
+            {
+                return false;
+            }
+
+            this->SkipWhitespace();
+            char Character = this->Peek();
+            if (Character == '{')
+            {
+                ++this->m_Position;
+                Value.Type = JsonValue::ValueType::Object;
+                this->SkipWhitespace();
+                if (this->Expect("}"))
+                {
+                    return true;
+                }
+                for (;;)
+                {
+                    std::string Name;
+                    this->SkipWhitespace();
+                    if (!this->ParseString(Name))
+                    {
+                        return false;
+                    }
+                    this->SkipWhitespace();
+                    if (!this->Expect(":"))
+                    {
+                        return false;
+                    }
+                    JsonValue Member;
+                    if (!this->ParseValue(Member, Depth + 1) ||
+                        !Value.Members.emplace(
+                            std::move(Name),
+                            std::move(Member)).second)
+                    {
+                        return false;
+                    }
+                    this->SkipWhitespace();
+                    if (this->Expect("}"))
+                    {
+                        return true;
+                    }
+                    if (!this->Expect(","))
+                    {
+                        return false;
+                    }
+                }
+            }
+            if (Character == '[')
+            {
+                ++this->m_Position;
+                Value.Type = JsonValue::ValueType::Array;
+                this->SkipWhitespace();
+                if (this->Expect("]"))
+                {
+                    return true;
+                }
+                for (;;)
+                {
+                    Value.Elements.emplace_back();
+                    if (!this->ParseValue(Value.Elements.back(), Depth + 1))
+                    {
+                        return false;
+                    }
+                    this->SkipWhitespace();
+                    if (this->Expect("]"))
+                    {
+                        return true;
+                    }
+                    if (!this->Expect(","))
+                    {
+                        return false;
+                    }
+                }
+            }
+            if (Character == '"')
+            {
+                Value.Type = JsonValue::ValueType::String;
+                return this->ParseString(Value.String);
+            }
+            if (this->Expect("true"))
+            {
+                Value.Type = JsonValue::ValueType::Boolean;
+                Value.Boolean = true;
+                return true;
+            }
+            if (this->Expect("false"))
+            {
+                Value.Type = JsonValue::ValueType::Boolean;
+                return true;
+            }
+            if (this->Expect("null"))
+            {
+                Value.Type = JsonValue::ValueType::Null;
+                return true;
+            }
+            Value.Type = JsonValue::ValueType::Number;
+            return this->ParseNumber(Value.Number);
+        }
+
+    public:
+
+        explicit JsonParser(
+            std::string const& Text) :
+            m_Text(Text)
+        {
+        }
+
+        bool Parse(
+            JsonValue& Value)
+        {
+            if (!this->ParseValue(Value, 0))
+            {
+                return false;
+            }
+            this->SkipWhitespace();
+            return this->IsEnd();
+        }
+    };
+
+    /**
+     * The records of a run, with the exit code of the front end.
+     */
+    struct RunResult
+    {
+        int ExitCode = -1;
+        std::string Output;
+        std::string Error;
+        std::vector<JsonValue> Records;
+        bool Valid = true;
+    };
+
+    /**
+     * Runs the front end with its output and error redirected to files, and
+     * parses each line of the output.
+     */
+    RunResult RunCommand(
+        NSudoTest::TemporaryDirectory const& Directory,
+        std::vector<std::string> const& Arguments)
+    {
+        RunResult Result;
+
+        std::string OutputPath = Directory.Join("Stdout.txt");
+        std::string ErrorPath = Directory.Join("Stderr.txt");
+
+        std::vector<char*> Argv;
+        std::string Program = NSUDO_SWEEPER_CLI_PATH;
+        Argv.push_back(&Program[0]);
+        std::vector<std::string> Copies = Arguments;
+        for (std::string& Argument : Copies)
+        {
+            Argv.push_back(&Argument[0]);
+        }
+        Argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t Actions;
+        ::posix_spawn_file_actions_init(&Actions);
+        ::posix_spawn_file_actions_addopen(
+            &Actions,
+            STDOUT_FILENO,
+            OutputPath.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC,
+            0644);
+        ::posix_spawn_file_actions_addopen(
+            &Actions,
+            STDERR_FILENO,
+            ErrorPath.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC,
+            0644);
+
+        pid_t Process = 0;
+        int Error = ::posix_spawn(
+            &Process,
+            Program.c_str(),
+            &Actions,
+            nullptr,
+            Argv.data(),
+            environ);
+        ::posix_spawn_file_actions_destroy(&Actions);
+        if (!NSUDO_TEST_CHECK_EQUAL(Error, 0))
+        {
+            return Result;
+        }
+
+        int Status = 0;
+        NSUDO_TEST_CHECK_EQUAL(::waitpid(Process, &Status, 0), Process);
+        if (NSUDO_TEST_CHECK(WIFEXITED(Status)))
+        {
+            Result.ExitCode = WEXITSTATUS(Status);
+        }
+
+        NSudoTest::ReadFile(OutputPath, Result.Output);
+        NSudoTest::ReadFile(ErrorPath, Result.Error);
+        return Result;
+    }
+
+    /**
+     * Parses the records of an output, each of which must be an object on
+     * a line of its own.
+     */
+    bool ParseRecords(
+        std::string const& Output,
+        std::vector<JsonValue>& Records)
+    {
+        Records.clear();
+        if (!NSUDO_TEST_CHECK(Output.empty() || Output.back() == '\n'))
+        {
+            return false;
+        }
+
+        std::size_t Start = 0;
+        while (Start < Output.size())
+        {
+            std::size_t End = Output.find('\n', Start);
+            std::string Line = Output.substr(Start, End - Start);
+            Start = End + 1;
+
+            JsonValue Record;
+            if (!JsonParser(Line).Parse(Record) ||
+                Record.Type != JsonValue::ValueType::Object ||
+                !Record.Find("type") ||
+                Record.Find("type")->Type != JsonValue::ValueType::String)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "a JSON object with a type",
+                    Line);
+                return false;
+            }
+            Records.push_back(std::move(Record));
+        }
+        return true;
+    }
+
+    std::string GetString(
+        JsonValue const& Record,
+        std::string const& Name)
+    {
+        JsonValue const* Member = Record.Find(Name);
+        return Member && Member->Type == JsonValue::ValueType::String
+            ? Member->String
+            : std::string("<missing>");
+    }
+
+    std::int64_t GetNumber(
+        JsonValue const& Record,
+        std::string const& Name)
+    {
+        JsonValue const* Member = Record.Find(Name);
+        return Member && Member->Type == JsonValue::ValueType::Number
+            ? Member->Number
+            : -1;
+    }
+
+    std::vector<JsonValue const*> GetRecords(
+        std::vector<JsonValue> const& Records,
+        std::string const& Type)
+    {
+        std::vector<JsonValue const*> Result;
+        for (JsonValue const& Record : Records)
+        {
+            if (::GetString(Record, "type") == Type)
+            {
+                Result.push_back(&Record);
+            }
+        }
+        return Result;
+    }
+
+    std::string EscapeTomlString(
+        std::string const& Value)
+    {
+        std::string Result;
+        for (char Character : Value)
+        {
+            if (Character == '"' || Character == '\\')
+            {
+                Result.push_back('\\');
+            }
+            Result.push_back(Character);
+        }
+        return Result;
+    }
+
+    /**
+     * Writes a configuration file of the standard handler which selects
+     * the .tmp files of a directory.
+     */
+    std::string CreateConfiguration(
+        std::string const& Path,
+        std::string const& Name,
+        std::string const& Directory,
+        std::string const& Plugin = "NSudoSweeperCore.dll",
+        std::string const& Handler = "NSudoSweeperStandardCleanupHandler")
+    {
+        NSudoTest::WriteFile(
+            Path,
+            "[Metadata.en]\n"
+            "Name = \"" + ::EscapeTomlString(Name) + "\"\n"
+            "Description = \"Test\"\n"
+            "[Configuration]\n"
+            "Plugin = \"" + Plugin + "\"\n"
+            "Handler = \"" + Handler + "\"\n"
+            "Detect = [ \"File|" + Directory + "\" ]\n"
+            "Include = [ \"File|" + Directory + "/*.tmp\" ]\n");
+        return Path;
+    }
+
+    /**
+     * The names of the files whose paths need escapes or replacements, and
+     * the names the records have for them.
+     */
+    std::vector<std::pair<std::string, std::string>> GetSpecialNames()
+    {
+        return
+        {
+            { "Quote\"Backslash\\.tmp", "Quote\"Backslash\\.tmp" },
+            { "Control\x01Tab\t.tmp", "Control\x01Tab\t.tmp" },
+            { "Unicode \xC3\x9C\xE6\x96\x87\xF0\x9F\x98\x80.tmp",
+                "Unicode \xC3\x9C\xE6\x96\x87\xF0\x9F\x98\x80.tmp" },
+            { "Invalid\xFF\xC3.tmp", "Invalid\xEF\xBF\xBD\xEF\xBF\xBD.tmp" },
+            { "Surrogate\xED\xA0\x80.tmp",
+                "Surrogate\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD.tmp" },
+        };
+    }
+
+    /**
+     * Creates the files of a scan: enough plain files that the output is
+     * written in several parts, and the files with special names.
+     *
+     * @return The expected paths of the records and their sizes.
+     */
+    std::map<std::string, std::int64_t> CreateFiles(
+        std::string const& Directory,
+        std::size_t Count)
+    {
+        std::map<std::string, std::int64_t> Expected;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::string Name = "File" + std::to_string(i) + ".tmp";
+            NSudoTest::WriteFile(
+                Directory + "/" + Name,
+                std::string(i % 100, 'a'));
+            Expected[Directory + "/" + Name] =
+                static_cast<std::int64_t>(i % 100);
+        }
+        for (auto const& Name : ::GetSpecialNames())
+        {
+            NSudoTest::WriteFile(Directory + "/" + Name.first, "special");
+            Expected[Directory + "/" + Name.second] = 7;
+        }
+        NSudoTest::WriteFile(Directory + "/Other.txt", "other");
+        return Expected;
+    }
+
+    bool Exists(
+        std::string const& Path)
+    {
+        struct stat Status;
+        return 0 == ::lstat(Path.c_str(), &Status);
+    }
+}
+
+NSUDO_TEST_CASE(ScanWritesOneRecordPerLine)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Cleanup = Directory.Join("Cleanup");
+    std::map<std::string, std::int64_t> Expected =
+        ::CreateFiles(Cleanup, 2000);
+    std::string Configuration = ::CreateConfiguration(
+        Directory.Join("Test.toml"),
+        "Scan \"Test\"",
+        Cleanup);
+
+    // The records of small batches go through the buffer of the output in
+    // several writes, to a file and to the standard output.
+    std::string OutputPath = Directory.Join("Output.jsonl");
+    ::RunResult ToFile = ::RunCommand(Directory, {
+        "--batch-size", "64",
+        "--stats",
+        "--output=" + OutputPath,
+        Configuration });
+    NSUDO_TEST_CHECK_EQUAL(ToFile.ExitCode, 0);
+    NSUDO_TEST_CHECK(ToFile.Output.empty());
+    NSUDO_TEST_CHECK(ToFile.Error.find("1 of 1 handlers succeeded") !=
+        std::string::npos);
+    std::string FileOutput;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(OutputPath, FileOutput));
+
+    ::RunResult ToStandardOutput = ::RunCommand(Directory, {
+        "--batch-size", "64",
+        Configuration });
+    NSUDO_TEST_CHECK_EQUAL(ToStandardOutput.ExitCode, 0);
+
+    for (std::string const* Output : { &FileOutput, &ToStandardOutput.Output })
+    {
+        bool HasStatistics = Output == &FileOutput;
+
+        std::vector<JsonValue> Records;
+        if (!::ParseRecords(*Output, Records))
+        {
+            continue;
+        }
+
+        std::vector<JsonValue const*> Items = ::GetRecords(Records, "item");
+        NSUDO_TEST_CHECK_EQUAL(Items.size(), Expected.size());
+        std::map<std::string, std::int64_t> Actual;
+        std::set<std::int64_t> Indexes;
+        for (JsonValue const* Item : Items)
+        {
+            Actual[::GetString(*Item, "path")] = ::GetNumber(*Item, "size");
+            Indexes.insert(::GetNumber(*Item, "index"));
+            NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Item, "handler"), 0);
+            NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Item, "reason"), 0);
+            NSUDO_TEST_CHECK(::GetNumber(*Item, "allocation_size") >= 0);
+            NSUDO_TEST_CHECK(::GetNumber(*Item, "file_id") > 0);
+        }
+        NSUDO_TEST_CHECK(Actual == Expected);
+        if (NSUDO_TEST_CHECK_EQUAL(Indexes.size(), Expected.size()))
+        {
+            NSUDO_TEST_CHECK_EQUAL(*Indexes.begin(), 0);
+            NSUDO_TEST_CHECK_EQUAL(
+                *Indexes.rbegin(),
+                static_cast<std::int64_t>(Expected.size() - 1));
+        }
+
+        // The handler record follows the items, and the stats record comes
+        // last.
+        std::size_t HandlerPosition = Items.size();
+        std::size_t Count = HandlerPosition + 1 + (HasStatistics ? 1 : 0);
+        if (!NSUDO_TEST_CHECK_EQUAL(Records.size(), Count))
+        {
+            continue;
+        }
+
+        JsonValue const& Handler = Records[HandlerPosition];
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Handler, "type"), "handler");
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Handler, "name"), "Scan \"Test\"");
+        NSUDO_TEST_CHECK_EQUAL(
+            ::GetString(Handler, "configuration"),
+            Configuration);
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Handler, "state"), "completed");
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Handler, "result"), "0x00000000");
+        NSUDO_TEST_CHECK_EQUAL(
+            ::GetNumber(Handler, "items"),
+            static_cast<std::int64_t>(Expected.size()));
+        std::int64_t Size = 0;
+        for (auto const& Current : Expected)
+        {
+            Size += Current.second;
+        }
+        NSUDO_TEST_CHECK_EQUAL(::GetNumber(Handler, "size"), Size);
+
+        if (HasStatistics)
+        {
+            JsonValue const& Statistics = Records.back();
+            NSUDO_TEST_CHECK_EQUAL(::GetString(Statistics, "type"), "stats");
+            NSUDO_TEST_CHECK_EQUAL(::GetString(Statistics, "phase"), "scan");
+            NSUDO_TEST_CHECK_EQUAL(::GetNumber(Statistics, "handlers"), 1);
+            NSUDO_TEST_CHECK_EQUAL(::GetNumber(Statistics, "succeeded"), 1);
+            NSUDO_TEST_CHECK(!Statistics.Find("interrupted")->Boolean);
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetNumber(Statistics, "items"),
+                static_cast<std::int64_t>(Expected.size()));
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetNumber(Statistics, "records"),
+                static_cast<std::int64_t>(Records.size() - 1));
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetNumber(Statistics, "output_bytes"),
+                static_cast<std::int64_t>(Output->rfind(
+                    '\n',
+                    Output->size() - 2) + 1));
+        }
+    }
+}
+
+NSUDO_TEST_CASE(EstimateAndCleanRecords)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Cleanup = Directory.Join("Cleanup");
+    std::map<std::string, std::int64_t> Expected =
+        ::CreateFiles(Cleanup, 100);
+    std::string Configuration = ::CreateConfiguration(
+        Directory.Join("Test.toml"),
+        "Test",
+        Cleanup);
+
+    {
+        ::RunResult Estimate = ::RunCommand(Directory, {
+            "--phase", "estimate",
+            Configuration });
+        NSUDO_TEST_CHECK_EQUAL(Estimate.ExitCode, 0);
+
+        std::vector<JsonValue> Records;
+        if (::ParseRecords(Estimate.Output, Records))
+        {
+            std::vector<JsonValue const*> Estimates =
+                ::GetRecords(Records, "estimate");
+            std::vector<JsonValue const*> Handlers =
+                ::GetRecords(Records, "handler");
+            if (NSUDO_TEST_CHECK(!Estimates.empty()) &&
+                NSUDO_TEST_CHECK_EQUAL(Handlers.size(), 1U))
+            {
+                JsonValue const& Last = *Estimates.back();
+                NSUDO_TEST_CHECK(Last.Find("exact")->Boolean);
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(Last, "items"),
+                    static_cast<std::int64_t>(Expected.size()));
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(Last, "size"),
+                    ::GetNumber(*Handlers[0], "allocation_size"));
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(Last, "lower"),
+                    ::GetNumber(Last, "size"));
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(Last, "upper"),
+                    ::GetNumber(Last, "size"));
+            }
+        }
+        NSUDO_TEST_CHECK(::Exists(Cleanup + "/File0.tmp"));
+    }
+
+    {
+        ::RunResult Clean = ::RunCommand(Directory, {
+            "--phase", "clean",
+            "--stats",
+            Configuration });
+        NSUDO_TEST_CHECK_EQUAL(Clean.ExitCode, 0);
+
+        std::vector<JsonValue> Records;
+        if (::ParseRecords(Clean.Output, Records))
+        {
+            std::vector<JsonValue const*> Results =
+                ::GetRecords(Records, "clean");
+            std::vector<JsonValue const*> Handlers =
+                ::GetRecords(Records, "handler");
+            NSUDO_TEST_CHECK_EQUAL(Results.size(), Expected.size());
+
+            std::int64_t Freed = 0;
+            for (JsonValue const* Result : Results)
+            {
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetString(*Result, "result"),
+                    "0x00000000");
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(*Result, "system_error"),
+                    0);
+                Freed += ::GetNumber(*Result, "freed");
+            }
+            if (NSUDO_TEST_CHECK_EQUAL(Handlers.size(), 1U))
+            {
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(*Handlers[0], "freed"),
+                    Freed);
+                NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Handlers[0], "failed"), 0);
+            }
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetString(Records.back(), "phase"),
+                "clean");
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetNumber(Records.back(), "freed"),
+                Freed);
+        }
+
+        NSUDO_TEST_CHECK(!::Exists(Cleanup + "/File0.tmp"));
+        NSUDO_TEST_CHECK(::Exists(Cleanup + "/Other.txt"));
+    }
+}
+
+NSUDO_TEST_CASE(CleanRemovesTheItemsOfASnapshot)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Cleanup = Directory.Join("Cleanup");
+    std::string Other = Directory.Join("Other");
+    NSudoTest::WriteFile(Cleanup + "/A.tmp", "a");
+    NSudoTest::WriteFile(Cleanup + "/B.tmp", "bb");
+    NSudoTest::WriteFile(Cleanup + "/C.tmp", "ccc");
+    NSudoTest::WriteFile(Other + "/D.tmp", "dddd");
+    std::string First = ::CreateConfiguration(
+        Directory.Join("Handlers/1-First.toml"),
+        "First",
+        Cleanup);
+    std::string Second = ::CreateConfiguration(
+        Directory.Join("Handlers/2-Second.toml"),
+        "Second",
+        Other);
+    std::string Snapshot = Directory.Join("Scan.snapshot");
+
+    ::RunResult Scan = ::RunCommand(Directory, {
+        "--save-snapshot", Snapshot,
+        Directory.Join("Handlers") });
+    NSUDO_TEST_CHECK_EQUAL(Scan.ExitCode, 0);
+    NSUDO_TEST_CHECK(::Exists(Snapshot));
+
+    // A.tmp is unchanged, B.tmp grows, C.tmp is removed, and New.tmp is
+    // not in the snapshot. The configuration of the second handler
+    // changes, so its items are not removed.
+    NSudoTest::WriteFile(Cleanup + "/B.tmp", "bbbbbb");
+    NSUDO_TEST_CHECK_EQUAL(::unlink((Cleanup + "/C.tmp").c_str()), 0);
+    NSudoTest::WriteFile(Cleanup + "/New.tmp", "new");
+    ::CreateConfiguration(Second, "Second (Changed)", Other);
+
+    ::RunResult Clean = ::RunCommand(Directory, {
+        "--from-snapshot", Snapshot,
+        Directory.Join("Handlers") });
+    NSUDO_TEST_CHECK_EQUAL(Clean.ExitCode, 0);
+    NSUDO_TEST_CHECK(Clean.Error.find("2-Second.toml") != std::string::npos);
+
+    std::vector<JsonValue> Records;
+    if (::ParseRecords(Clean.Output, Records))
+    {
+        NSUDO_TEST_CHECK(::GetRecords(Records, "item").empty());
+
+        // The snapshot sorts the items of a handler by their paths.
+        std::vector<JsonValue const*> Results =
+            ::GetRecords(Records, "clean");
+        if (NSUDO_TEST_CHECK_EQUAL(Results.size(), 3U))
+        {
+            char const* const Expected[] =
+            {
+                "0x00000000",
+                "0x8007000D",
+                "0x80070002",
+            };
+            for (std::size_t i = 0; i < Results.size(); ++i)
+            {
+                NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Results[i], "handler"), 0);
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetNumber(*Results[i], "index"),
+                    static_cast<std::int64_t>(i));
+                NSUDO_TEST_CHECK_EQUAL(
+                    ::GetString(*Results[i], "result"),
+                    Expected[i]);
+            }
+        }
+
+        std::vector<JsonValue const*> Handlers =
+            ::GetRecords(Records, "handler");
+        if (NSUDO_TEST_CHECK_EQUAL(Handlers.size(), 2U))
+        {
+            NSUDO_TEST_CHECK(::GetNumber(*Handlers[0], "freed") > 0);
+            NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Handlers[1], "items"), 0);
+        }
+    }
+
+    NSUDO_TEST_CHECK(!::Exists(Cleanup + "/A.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Cleanup + "/B.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Cleanup + "/New.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Other + "/D.tmp"));
+
+    // A snapshot is only cleaned, and only a complete scan is saved.
+    std::vector<std::vector<std::string>> const InvalidCommandLines =
+    {
+        { "--from-snapshot", Snapshot, "--phase", "scan", First },
+        { "--save-snapshot", Snapshot, "--phase", "clean", First },
+        { "--from-snapshot", Snapshot, "--save-snapshot", Snapshot, First },
+        { "--from-snapshot", Directory.Join("Missing.snapshot"), First },
+        { "--from-snapshot", Snapshot, "--root", Cleanup, First },
+    };
+    for (std::vector<std::string> const& Arguments : InvalidCommandLines)
+    {
+        ::RunResult Result = ::RunCommand(Directory, Arguments);
+        NSUDO_TEST_CHECK_EQUAL(Result.ExitCode, 2);
+        NSUDO_TEST_CHECK(Result.Output.empty());
+        NSUDO_TEST_CHECK(!Result.Error.empty());
+    }
+
+    std::string Failed = Directory.Join("Failed.snapshot");
+    ::RunResult FailedScan = ::RunCommand(Directory, {
+        "--save-snapshot", Failed,
+        "--root", Directory.GetPath(),
+        First });
+    NSUDO_TEST_CHECK_EQUAL(FailedScan.ExitCode, 1);
+    NSUDO_TEST_CHECK(!::Exists(Failed));
+}
+
+NSUDO_TEST_CASE(DirectoriesRunTheirConfigurationsInNameOrder)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::WriteFile(Directory.Join("A/One.tmp"), "1");
+    NSudoTest::WriteFile(Directory.Join("B/Two.tmp"), "22");
+    ::CreateConfiguration(
+        Directory.Join("Handlers/2-Second.toml"),
+        "Second",
+        Directory.Join("B"));
+    ::CreateConfiguration(
+        Directory.Join("Handlers/1-First.TOML"),
+        "First",
+        Directory.Join("A"));
+    NSudoTest::WriteFile(Directory.Join("Handlers/Readme.txt"), "skipped");
+
+    ::RunResult Result = ::RunCommand(Directory, {
+        "--concurrency", "1",
+        Directory.Join("Handlers") });
+    NSUDO_TEST_CHECK_EQUAL(Result.ExitCode, 0);
+
+    std::vector<JsonValue> Records;
+    if (!::ParseRecords(Result.Output, Records))
+    {
+        return;
+    }
+
+    std::vector<JsonValue const*> Handlers = ::GetRecords(Records, "handler");
+    if (NSUDO_TEST_CHECK_EQUAL(Handlers.size(), 2U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Handlers[0], "handler"), 0);
+        NSUDO_TEST_CHECK_EQUAL(::GetString(*Handlers[0], "name"), "First");
+        NSUDO_TEST_CHECK_EQUAL(::GetNumber(*Handlers[1], "handler"), 1);
+        NSUDO_TEST_CHECK_EQUAL(::GetString(*Handlers[1], "name"), "Second");
+    }
+
+    std::vector<JsonValue const*> Items = ::GetRecords(Records, "item");
+    if (NSUDO_TEST_CHECK_EQUAL(Items.size(), 2U))
+    {
+        for (JsonValue const* Item : Items)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                ::GetString(*Item, "path"),
+                ::GetNumber(*Item, "handler")
+                ? Directory.Join("B/Two.tmp")
+                : Directory.Join("A/One.tmp"));
+        }
+    }
+}
+
+NSUDO_TEST_CASE(InvalidCommandLinesAndFailures)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Configuration = ::CreateConfiguration(
+        Directory.Join("Test.toml"),
+        "Test",
+        Directory.Join("Cleanup"));
+
+    ::RunResult Help = ::RunCommand(Directory, { "--help" });
+    NSUDO_TEST_CHECK_EQUAL(Help.ExitCode, 0);
+    NSUDO_TEST_CHECK_EQUAL(Help.Output.find("Usage: NSudoSC"), 0U);
+
+    // The command line is invalid, so nothing is written to the output.
+    std::vector<std::vector<std::string>> const InvalidCommandLines =
+    {
+        { },
+        { "--bogus", Configuration },
+        { "--phase", "purge", Configuration },
+        { "--batch-size", "many", Configuration },
+        { Configuration, "--output" },
+        { Directory.Join("Missing.toml") },
+    };
+    for (std::vector<std::string> const& Arguments : InvalidCommandLines)
+    {
+        ::RunResult Result = ::RunCommand(Directory, Arguments);
+        NSUDO_TEST_CHECK_EQUAL(Result.ExitCode, 2);
+        NSUDO_TEST_CHECK(Result.Output.empty());
+        NSUDO_TEST_CHECK(!Result.Error.empty());
+    }
+
+    // A handler which cannot be found invalidates the configuration file.
+    ::RunResult MissingPlugin = ::RunCommand(Directory, {
+        ::CreateConfiguration(
+            Directory.Join("Plugin.toml"),
+            "Plugin",
+            Directory.Join("Cleanup"),
+            "Missing.so",
+            "MissingHandler") });
+    NSUDO_TEST_CHECK_EQUAL(MissingPlugin.ExitCode, 2);
+    NSUDO_TEST_CHECK(MissingPlugin.Error.find("Missing.so") !=
+        std::string::npos);
+
+    // A plugin which only exports the version 1 handler is not loaded,
+    // such as the C library which exports "printf" but not "printfV2".
+    Dl_info Library = {};
+    if (NSUDO_TEST_CHECK(::dladdr(
+        reinterpret_cast<void*>(&::printf),
+        &Library) && Library.dli_fname && Library.dli_fname[0] == '/'))
+    {
+        ::RunResult Version1 = ::RunCommand(Directory, {
+            ::CreateConfiguration(
+                Directory.Join("Version1.toml"),
+                "Version1",
+                Directory.Join("Cleanup"),
+                Library.dli_fname,
+                "printf") });
+        NSUDO_TEST_CHECK_EQUAL(Version1.ExitCode, 2);
+        NSUDO_TEST_CHECK(Version1.Error.find("\"printfV2\"") !=
+            std::string::npos);
+        NSUDO_TEST_CHECK(Version1.Error.find("version 1") !=
+            std::string::npos);
+    }
+
+    // An output which cannot be created fails the run.
+    ::RunResult MissingOutput = ::RunCommand(Directory, {
+        "--output", Directory.Join("Missing/Output.jsonl"),
+        Configuration });
+    NSUDO_TEST_CHECK_EQUAL(MissingOutput.ExitCode, 1);
+
+    // A handler which fails is reported in its record and fails the run,
+    // such as the standard handler with an offline image it does not
+    // support.
+    ::RunResult Failed = ::RunCommand(Directory, {
+        "--root", Directory.GetPath(),
+        Configuration });
+    NSUDO_TEST_CHECK_EQUAL(Failed.ExitCode, 1);
+    std::vector<JsonValue> Records;
+    if (::ParseRecords(Failed.Output, Records) &&
+        NSUDO_TEST_CHECK_EQUAL(Records.size(), 1U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Records[0], "type"), "handler");
+        NSUDO_TEST_CHECK_EQUAL(::GetString(Records[0], "state"), "completed");
+        NSUDO_TEST_CHECK_EQUAL(
+            ::GetString(Records[0], "result"),
+            "0x80004001");
+    }
+}
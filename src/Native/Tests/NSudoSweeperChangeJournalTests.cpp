@@ -0,0 +1,605 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperChangeJournalTests.cpp
+ * PURPOSE:   Implementation for the USN change journal decoder tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperChangeJournal.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * The dumps of Data/ChangeJournal are written by GenerateDumps.py, and each
+ * has an expected listing of its records and of the changes they fold into.
+ */
+
+namespace
+{
+    typedef std::vector<std::uint8_t> Bytes;
+
+    std::uint64_t FileId(
+        std::uint64_t Record,
+        std::uint64_t Sequence)
+    {
+        return Record | (Sequence << 48);
+    }
+
+    const std::uint64_t Root = ::FileId(5, 5);
+    const std::uint64_t Docs = ::FileId(40, 1);
+    const std::uint64_t Archive = ::FileId(41, 1);
+    const std::uint64_t Cache = ::FileId(42, 2);
+    const std::uint64_t Links = ::FileId(43, 1);
+
+    /**
+     * The USN of the first record of each dump.
+     */
+    const std::uint64_t FirstUsn = 0x20000000;
+
+    std::uint64_t LoadUInt64(
+        std::uint8_t const* Source)
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(Source[i]) << (i * 8);
+        }
+        return Value;
+    }
+
+    void StoreUInt16(
+        Bytes& Data,
+        std::size_t Offset,
+        std::uint16_t Value)
+    {
+        Data[Offset] = static_cast<std::uint8_t>(Value);
+        Data[Offset + 1] = static_cast<std::uint8_t>(Value >> 8);
+    }
+
+    void StoreUInt32(
+        Bytes& Data,
+        std::size_t Offset,
+        std::uint32_t Value)
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Data[Offset + i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    std::string FormatFileId(
+        std::uint64_t FileId)
+    {
+        return std::to_string(FileId & 0xFFFFFFFFFFFF) +
+            ":" +
+            std::to_string(FileId >> 48);
+    }
+
+    std::string FormatFileId(
+        NSudoSweeper::ChangeJournalFileId const& FileId)
+    {
+        if (!FileId.High)
+        {
+            return ::FormatFileId(FileId.Low);
+        }
+
+        char Buffer[40];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "%016" PRIx64 "%016" PRIx64,
+            FileId.High,
+            FileId.Low);
+        return Buffer;
+    }
+
+    std::string FormatHex(
+        std::uint32_t Value)
+    {
+        char Buffer[16];
+        std::snprintf(Buffer, sizeof(Buffer), "%08" PRIx32, Value);
+        return Buffer;
+    }
+
+    Bytes ReadDump(
+        std::string const& Name)
+    {
+        std::string Content;
+        NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+            NSudoTest::GetDataPath("ChangeJournal/" + Name + ".bin"),
+            Content));
+        return Bytes(Content.begin(), Content.end());
+    }
+
+    /**
+     * Reads an expected listing of Data/ChangeJournal, without its
+     * comments.
+     */
+    std::vector<std::string> ReadListing(
+        std::string const& Name)
+    {
+        std::vector<std::string> Lines;
+        std::string Content;
+        if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+            NSudoTest::GetDataPath("ChangeJournal/" + Name + ".txt"),
+            Content)))
+        {
+            return Lines;
+        }
+
+        std::size_t Start = 0;
+        while (Start < Content.size())
+        {
+            std::size_t End = Content.find('\n', Start);
+            if (End == std::string::npos)
+            {
+                End = Content.size();
+            }
+            std::string Line = Content.substr(Start, End - Start);
+            if (!Line.empty() && Line[0] != '#')
+            {
+                Lines.push_back(Line);
+            }
+            Start = End + 1;
+        }
+        std::sort(Lines.begin(), Lines.end());
+        return Lines;
+    }
+
+    /**
+     * Decodes the records of a dump one by one, and lists them with the
+     * file IDs of the records whose IDs have 64 bits.
+     */
+    std::vector<std::string> DescribeRecords(
+        Bytes const& Dump,
+        std::vector<std::uint64_t>& FileIds)
+    {
+        std::vector<std::string> Lines;
+        std::size_t Offset = 0;
+        while (Offset < Dump.size())
+        {
+            NSudoSweeper::ChangeJournalRecord Record;
+            std::size_t Length = NSudoSweeper::DecodeChangeJournalRecord(
+                Dump.data() + Offset,
+                Dump.size() - Offset,
+                Record);
+            if (!NSUDO_TEST_CHECK(Length) ||
+                !NSUDO_TEST_CHECK_EQUAL(Length % 8, 0U))
+            {
+                break;
+            }
+            Offset += Length;
+
+            std::string Line = std::to_string(Record.Usn) +
+                " " + std::to_string(Record.MajorVersion) +
+                "." + std::to_string(Record.MinorVersion) +
+                " " + ::FormatFileId(Record.FileId) +
+                " " + ::FormatFileId(Record.ParentFileId) +
+                " " + ::FormatHex(Record.Reason);
+            if (Record.MajorVersion == 4)
+            {
+                Line += " " + std::to_string(Record.RemainingExtents);
+                for (std::size_t i = 0; i < Record.ExtentCount; ++i)
+                {
+                    std::uint8_t const* Extent =
+                        Record.Extents + i * Record.ExtentSize;
+                    Line += " " + std::to_string(::LoadUInt64(Extent)) +
+                        "+" + std::to_string(::LoadUInt64(Extent + 8));
+                }
+            }
+            else
+            {
+                Line += " " + ::FormatHex(Record.Attributes) +
+                    " " + NSudoSweeper::GetChangeJournalRecordName(Record);
+            }
+            Lines.push_back(Line);
+
+            if (!Record.FileId.High)
+            {
+                FileIds.push_back(Record.FileId.Low);
+            }
+        }
+        return Lines;
+    }
+
+    /**
+     * Lists the changes of a change set, and the directories of FileIds
+     * which are moved.
+     */
+    std::vector<std::string> DescribeChanges(
+        NSudoSweeper::ChangeJournalChangeSet const& Changes,
+        std::vector<std::uint64_t> const& FileIds)
+    {
+        std::vector<std::string> Lines;
+        for (NSudoSweeper::ChangeJournalChange const& Change
+            : Changes.GetChanges())
+        {
+            static const char* const TypeNames[] =
+            {
+                "Create",
+                "Delete",
+                "Rename",
+                "Modify",
+            };
+            std::string Line =
+                TypeNames[static_cast<std::size_t>(Change.Type)];
+            Line += Change.IsDirectory ? " Directory " : " File ";
+            Line += ::FormatFileId(Change.FileId) + " ";
+            if (Change.Type == NSudoSweeper::ChangeJournalChangeType::Rename)
+            {
+                Line += ::FormatFileId(Change.OldParentId) +
+                    "/" + Change.OldName + " ";
+            }
+            Line += ::FormatFileId(Change.ParentId) + "/" + Change.Name;
+            if (Change.Type == NSudoSweeper::ChangeJournalChangeType::Modify)
+            {
+                Line += " " + std::to_string(Change.WrittenBytes);
+            }
+            Lines.push_back(Line);
+        }
+
+        for (auto const& Directory : Changes.GetDirectories())
+        {
+            NSudoSweeper::ChangeJournalDirectoryChanges const& Current =
+                Directory.second;
+            Lines.push_back(
+                "Directory " + ::FormatFileId(Directory.first) +
+                " " + std::to_string(Current.Created) +
+                " " + std::to_string(Current.Deleted) +
+                " " + std::to_string(Current.RenamedIn) +
+                " " + std::to_string(Current.RenamedOut) +
+                " " + std::to_string(Current.Relinked) +
+                " " + std::to_string(Current.Modified) +
+                " " + std::to_string(Current.Extended) +
+                " " + std::to_string(Current.Truncated) +
+                " " + std::to_string(Current.WrittenBytes));
+        }
+
+        std::vector<std::uint64_t> Moved;
+        for (std::uint64_t FileId : FileIds)
+        {
+            if (Changes.IsDirectoryMoved(FileId))
+            {
+                Moved.push_back(FileId);
+            }
+        }
+        std::sort(Moved.begin(), Moved.end());
+        Moved.erase(std::unique(Moved.begin(), Moved.end()), Moved.end());
+        for (std::uint64_t FileId : Moved)
+        {
+            Lines.push_back("Moved " + ::FormatFileId(FileId));
+        }
+
+        Lines.push_back(
+            Changes.IsComplete() ? "Complete yes" : "Complete no");
+        std::sort(Lines.begin(), Lines.end());
+        return Lines;
+    }
+
+    /**
+     * Checks the lines are the expected ones, and reports each missing and
+     * unexpected line.
+     */
+    void CheckLines(
+        std::vector<std::string> const& Lines,
+        std::vector<std::string> const& Expected,
+        std::string const& Name)
+    {
+        if (NSUDO_TEST_CHECK(Lines == Expected))
+        {
+            return;
+        }
+        for (std::string const& Line : Expected)
+        {
+            if (!std::binary_search(Lines.begin(), Lines.end(), Line))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Missing",
+                    Name + ": " + Line);
+            }
+        }
+        for (std::string const& Line : Lines)
+        {
+            if (!std::binary_search(Expected.begin(), Expected.end(), Line))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Unexpected",
+                    Name + ": " + Line);
+            }
+        }
+    }
+
+    /**
+     * Adds the records of a dump in buffers of a size, as if each buffer
+     * was the output of one read of the journal, and folds them.
+     *
+     * @return true if every buffer is added, otherwise false.
+     */
+    bool AddInBuffers(
+        NSudoSweeper::ChangeJournalChangeSet& Changes,
+        Bytes const& Dump,
+        std::size_t BufferSize,
+        std::uint64_t UsnLimit = UINT64_MAX)
+    {
+        bool Succeeded = true;
+        for (std::size_t Offset = 0; Offset < Dump.size(); Offset += BufferSize)
+        {
+            std::size_t Size = (std::min)(BufferSize, Dump.size() - Offset);
+            if (!Changes.AddRecords(Dump.data() + Offset, Size, UsnLimit))
+            {
+                Succeeded = false;
+                break;
+            }
+        }
+        Changes.Fold();
+        return Succeeded;
+    }
+
+    /**
+     * Finds the offset of the index-th record of a dump.
+     */
+    std::size_t GetRecordOffset(
+        Bytes const& Dump,
+        std::size_t Index)
+    {
+        std::size_t Offset = 0;
+        for (std::size_t i = 0; i < Index; ++i)
+        {
+            NSudoSweeper::ChangeJournalRecord Record;
+            Offset += NSudoSweeper::DecodeChangeJournalRecord(
+                Dump.data() + Offset,
+                Dump.size() - Offset,
+                Record);
+        }
+        return Offset;
+    }
+
+    const char* const DumpNames[] = { "V2", "V3", "V4", "ReFS" };
+}
+
+NSUDO_TEST_CASE(DumpsAreDecodedAndFolded)
+{
+    for (const char* Name : ::DumpNames)
+    {
+        ::Bytes Dump = ::ReadDump(Name);
+        std::vector<std::uint64_t> FileIds;
+        std::vector<std::string> Records = ::DescribeRecords(Dump, FileIds);
+
+        NSudoSweeper::ChangeJournalChangeSet Changes;
+        NSUDO_TEST_CHECK(Changes.AddRecords(Dump.data(), Dump.size()));
+        Changes.Fold();
+        NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), Records.size());
+
+        std::vector<std::string> Lines = ::DescribeChanges(Changes, FileIds);
+        Lines.insert(Lines.end(), Records.begin(), Records.end());
+        std::sort(Lines.begin(), Lines.end());
+        ::CheckLines(Lines, ::ReadListing(Name), Name);
+
+        // The changes are in the order of their directories.
+        std::vector<NSudoSweeper::ChangeJournalChange> const& Folded =
+            Changes.GetChanges();
+        NSUDO_TEST_CHECK(std::is_sorted(
+            Folded.begin(),
+            Folded.end(),
+            [](NSudoSweeper::ChangeJournalChange const& Left,
+                NSudoSweeper::ChangeJournalChange const& Right)
+        {
+            return Left.ParentId < Right.ParentId;
+        }));
+    }
+}
+
+NSUDO_TEST_CASE(RecordsSplitAcrossBuffersAreJoined)
+{
+    for (const char* Name : ::DumpNames)
+    {
+        ::Bytes Dump = ::ReadDump(Name);
+        std::vector<std::uint64_t> FileIds;
+        ::DescribeRecords(Dump, FileIds);
+
+        NSudoSweeper::ChangeJournalChangeSet Whole;
+        NSUDO_TEST_CHECK(::AddInBuffers(Whole, Dump, Dump.size()));
+        std::vector<std::string> Expected =
+            ::DescribeChanges(Whole, FileIds);
+
+        // Buffers which cut the first 8 bytes of the records, their
+        // headers, their names, and the records of a single byte.
+        for (std::size_t BufferSize : { 1, 3, 7, 8, 9, 60, 61, 64, 100, 333 })
+        {
+            NSudoSweeper::ChangeJournalChangeSet Changes;
+            NSUDO_TEST_CHECK(::AddInBuffers(Changes, Dump, BufferSize));
+            NSUDO_TEST_CHECK_EQUAL(
+                Changes.GetRecordCount(),
+                Whole.GetRecordCount());
+            ::CheckLines(
+                ::DescribeChanges(Changes, FileIds),
+                Expected,
+                std::string(Name) +
+                    ", buffers of " + std::to_string(BufferSize) + " bytes");
+        }
+    }
+}
+
+NSUDO_TEST_CASE(RenamesAreFoldedByFile)
+{
+    ::Bytes Dump = ::ReadDump("V2");
+    NSudoSweeper::ChangeJournalChangeSet Changes;
+    NSUDO_TEST_CHECK(Changes.AddRecords(Dump.data(), Dump.size()));
+    Changes.Fold();
+
+    // The old and new names of a move to another directory become one
+    // rename, from the first old name to the last new name.
+    bool Found = false;
+    for (NSudoSweeper::ChangeJournalChange const& Change
+        : Changes.GetChanges())
+    {
+        if (Change.FileId != ::FileId(102, 1))
+        {
+            continue;
+        }
+        Found = true;
+        NSUDO_TEST_CHECK(
+            Change.Type == NSudoSweeper::ChangeJournalChangeType::Rename);
+        NSUDO_TEST_CHECK_EQUAL(Change.OldParentId, ::Docs);
+        NSUDO_TEST_CHECK_EQUAL(Change.OldName, std::string("old.txt"));
+        NSUDO_TEST_CHECK_EQUAL(Change.ParentId, ::Archive);
+        NSUDO_TEST_CHECK_EQUAL(Change.Name, std::string("new.txt"));
+        NSUDO_TEST_CHECK_EQUAL(
+            Change.Reasons,
+            NSudoSweeper::ChangeJournalReasonRenameOldName |
+            NSudoSweeper::ChangeJournalReasonRenameNewName |
+            NSudoSweeper::ChangeJournalReasonClose);
+    }
+    NSUDO_TEST_CHECK(Found);
+
+    NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Docs));
+    NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Archive));
+    NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Links));
+    NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Root));
+    NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Cache));
+    NSUDO_TEST_CHECK(!Changes.IsDirectoryChanged(::FileId(45, 1)));
+    NSUDO_TEST_CHECK(Changes.HasMovedDirectories());
+
+    NSUDO_TEST_CHECK(Changes.HasModifiedFiles(::Archive));
+    NSUDO_TEST_CHECK(!Changes.HasModifiedFiles(::Docs));
+    NSUDO_TEST_CHECK(Changes.IsFileModified(::FileId(106, 1)));
+    NSUDO_TEST_CHECK(Changes.IsFileModified(::FileId(112, 1)));
+    NSUDO_TEST_CHECK(!Changes.IsFileModified(::FileId(100, 1)));
+    NSUDO_TEST_CHECK(!Changes.IsFileModified(::FileId(108, 1)));
+
+    Changes.Clear();
+    NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), 0U);
+    NSUDO_TEST_CHECK(Changes.GetChanges().empty());
+    NSUDO_TEST_CHECK(Changes.GetDirectories().empty());
+    NSUDO_TEST_CHECK(!Changes.HasMovedDirectories());
+    NSUDO_TEST_CHECK(!Changes.IsFileModified(::FileId(106, 1)));
+}
+
+NSUDO_TEST_CASE(DamagedRecordsStopTheRecords)
+{
+    ::Bytes Dump = ::ReadDump("V2");
+    std::size_t Offset = ::GetRecordOffset(Dump, 3);
+
+    struct Damage
+    {
+        const char* Name;
+        std::size_t Field;
+        std::uint32_t Value;
+        bool Wide;
+    };
+    const Damage Damages[] =
+    {
+        { "Too short", 0, 4, true },
+        { "Shorter than its header", 0, 56, true },
+        { "Too long", 0, 0x7FFFFFFF, true },
+        { "Unknown version", 4, 5, false },
+        { "Odd name length", 56, 7, false },
+        { "Name before the header", 58, 40, false },
+        { "Name after the record", 58, 200, false },
+    };
+    for (Damage const& Current : Damages)
+    {
+        ::Bytes Damaged = Dump;
+        if (Current.Wide)
+        {
+            ::StoreUInt32(Damaged, Offset + Current.Field, Current.Value);
+        }
+        else
+        {
+            ::StoreUInt16(
+                Damaged,
+                Offset + Current.Field,
+                static_cast<std::uint16_t>(Current.Value));
+        }
+
+        // The records before the damaged one are kept, whether it is
+        // found in one buffer or joined from many.
+        for (std::size_t BufferSize : { Damaged.size(), std::size_t(1) })
+        {
+            NSudoSweeper::ChangeJournalChangeSet Changes;
+            bool Succeeded = ::AddInBuffers(Changes, Damaged, BufferSize);
+            if (!NSUDO_TEST_CHECK(!Succeeded))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Damaged",
+                    Current.Name);
+            }
+            NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), 3U);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(CutRecordsMakeTheChangesIncomplete)
+{
+    ::Bytes Dump = ::ReadDump("V2");
+    std::size_t LastOffset = ::GetRecordOffset(Dump, 46);
+
+    // The last record, which makes Junction a reparse point, is cut in its
+    // header and in its name.
+    for (std::size_t Cut : { std::size_t(4), std::size_t(30), std::size_t(64) })
+    {
+        ::Bytes Truncated(Dump.begin(), Dump.begin() + LastOffset + Cut);
+
+        NSudoSweeper::ChangeJournalChangeSet Changes;
+        NSUDO_TEST_CHECK(::AddInBuffers(Changes, Truncated, 100));
+        NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), 46U);
+        NSUDO_TEST_CHECK(!Changes.IsComplete());
+        NSUDO_TEST_CHECK(!Changes.IsDirectoryMoved(::FileId(113, 1)));
+        NSUDO_TEST_CHECK(Changes.IsDirectoryMoved(::Cache));
+
+        // The cut record is dropped by Fold, so the next journal starts
+        // with a record of its own.
+        ::Bytes Next = ::ReadDump("V4");
+        NSUDO_TEST_CHECK(Changes.AddRecords(Next.data(), Next.size()));
+        Changes.Fold();
+        NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), 54U);
+        NSUDO_TEST_CHECK(Changes.IsFileModified(::FileId(121, 1)));
+
+        Changes.Clear();
+        NSUDO_TEST_CHECK(Changes.IsComplete());
+    }
+}
+
+NSUDO_TEST_CASE(RecordsFromTheUsnLimitAreIgnored)
+{
+    ::Bytes Dump = ::ReadDump("V2");
+    std::size_t Offset = ::GetRecordOffset(Dump, 9);
+    NSudoSweeper::ChangeJournalRecord Record;
+    NSUDO_TEST_CHECK(NSudoSweeper::DecodeChangeJournalRecord(
+        Dump.data() + Offset,
+        Dump.size() - Offset,
+        Record));
+    NSUDO_TEST_CHECK_EQUAL(Record.Usn, ::FirstUsn + Offset);
+
+    for (std::size_t BufferSize : { Dump.size(), std::size_t(7) })
+    {
+        // a.tmp is created, temp.txt is created and deleted, and old.txt is
+        // moved before the limit.
+        NSudoSweeper::ChangeJournalChangeSet Changes;
+        NSUDO_TEST_CHECK(::AddInBuffers(
+            Changes,
+            Dump,
+            BufferSize,
+            Record.Usn));
+        NSUDO_TEST_CHECK_EQUAL(Changes.GetRecordCount(), 9U);
+        NSUDO_TEST_CHECK_EQUAL(Changes.GetChanges().size(), 2U);
+        NSUDO_TEST_CHECK(Changes.IsDirectoryChanged(::Archive));
+        NSUDO_TEST_CHECK(!Changes.IsDirectoryChanged(::Root));
+    }
+}
@@ -0,0 +1,280 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateFinderBenchmark.cpp
+ * PURPOSE:   Implementation for the content-hash duplicate finder benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperDuplicateFinder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace
+{
+    /**
+     * What a file of the corpus contains. The files with the same content
+     * have the same seed and size, and a changed file has its last byte
+     * changed.
+     */
+    struct CorpusFile
+    {
+        std::string Path;
+        std::uint32_t Seed = 0;
+        std::size_t Size = 0;
+        bool Changed = false;
+    };
+
+    std::string CreateContent(
+        CorpusFile const& File)
+    {
+        std::string Content(File.Size, '\0');
+        std::mt19937 Generator(File.Seed);
+        for (std::size_t i = 0; i < File.Size; i += 4)
+        {
+            std::uint32_t Value = Generator();
+            for (std::size_t j = 0; j < 4 && i + j < File.Size; ++j)
+            {
+                Content[i + j] = static_cast<char>(Value >> (j * 8));
+            }
+        }
+        if (File.Changed)
+        {
+            Content.back() = static_cast<char>(Content.back() ^ 0x5A);
+        }
+        return Content;
+    }
+
+    /**
+     * Creates a corpus like a package cache, with sizes spread evenly on a
+     * logarithmic scale. About a third of the files are copies of earlier
+     * files, and a tenth differ from an earlier file in their last byte
+     * only, so their prefixes match and they are hashed completely.
+     */
+    std::vector<CorpusFile> CreateCorpus(
+        NSudoTest::TemporaryDirectory const& Directory,
+        std::size_t Count,
+        std::size_t MaximumSize,
+        std::uint64_t& TotalSize)
+    {
+        std::vector<CorpusFile> Files;
+        std::vector<std::size_t> Originals;
+        std::mt19937 Generator(1);
+        std::uniform_real_distribution<double> PickExponent(
+            10.0,
+            std::log2(static_cast<double>(MaximumSize)));
+        std::uniform_int_distribution<int> PickKind(0, 9);
+
+        TotalSize = 0;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            CorpusFile File;
+            File.Path = Directory.Join(
+                "Package" + std::to_string(i % 50) +
+                "/File" + std::to_string(i) + ".bin");
+
+            int Kind = PickKind(Generator);
+            if (Kind < 3 && !Originals.empty())
+            {
+                CorpusFile const& Original = Files[Originals[
+                    Generator() % Originals.size()]];
+                File.Seed = Original.Seed;
+                File.Size = Original.Size;
+            }
+            else if (Kind == 3 && !Originals.empty())
+            {
+                CorpusFile const& Original = Files[Originals[
+                    Generator() % Originals.size()]];
+                File.Seed = Original.Seed;
+                File.Size = Original.Size;
+                File.Changed = true;
+            }
+            else
+            {
+                File.Seed = static_cast<std::uint32_t>(i + 1);
+                File.Size = static_cast<std::size_t>(
+                    std::exp2(PickExponent(Generator)));
+                Originals.push_back(Files.size());
+            }
+
+            NSudoTest::WriteFile(File.Path, ::CreateContent(File));
+            TotalSize += File.Size;
+            Files.push_back(std::move(File));
+        }
+        return Files;
+    }
+
+    /**
+     * Counts the sets of files with the same content, and the files which
+     * are not the first of their sets.
+     */
+    std::pair<std::size_t, std::size_t> CountDuplicates(
+        std::vector<CorpusFile> const& Files)
+    {
+        std::map<std::tuple<std::uint32_t, std::size_t, bool>, std::size_t>
+            Contents;
+        for (CorpusFile const& File : Files)
+        {
+            ++Contents[std::make_tuple(File.Seed, File.Size, File.Changed)];
+        }
+
+        std::pair<std::size_t, std::size_t> Result;
+        for (auto const& Content : Contents)
+        {
+            if (Content.second > 1)
+            {
+                ++Result.first;
+                Result.second += Content.second - 1;
+            }
+        }
+        return Result;
+    }
+
+    void AddFiles(
+        NSudoSweeper::DuplicateFinder& Finder,
+        std::vector<CorpusFile> const& Files)
+    {
+        for (CorpusFile const& Corpus : Files)
+        {
+            NSudoSweeper::DuplicateFile File;
+            File.Path = Corpus.Path;
+            struct stat Status;
+            if (0 == ::lstat(File.Path.c_str(), &Status))
+            {
+                File.Size = static_cast<std::uint64_t>(Status.st_size);
+                File.AllocationSize =
+                    static_cast<std::uint64_t>(Status.st_blocks) * 512;
+                File.FileId = static_cast<std::uint64_t>(Status.st_ino);
+            }
+            Finder.Add(std::move(File));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t Count = Options.Quick ? 300 : 4000;
+    const std::size_t MaximumSize =
+        Options.Quick ? 256 * 1024 : 1024 * 1024;
+
+    NSudoTest::TemporaryDirectory Directory;
+    std::uint64_t TotalSize = 0;
+    std::vector<CorpusFile> Files = ::CreateCorpus(
+        Directory,
+        Count,
+        MaximumSize,
+        TotalSize);
+    std::pair<std::size_t, std::size_t> Duplicates =
+        ::CountDuplicates(Files);
+    std::printf(
+        "%zu files, %llu bytes, %zu sets of duplicates\n\n",
+        Files.size(),
+        static_cast<unsigned long long>(TotalSize),
+        Duplicates.first);
+
+    // The files are in the page cache after they are written, so these are
+    // the costs of hashing and of the reads from the cache.
+    struct Variant
+    {
+        const char* Name;
+        std::size_t ChunkSize;
+        std::size_t QueueDepth;
+        bool VerifyContents;
+    };
+    const Variant Variants[] =
+    {
+        { "Find", 1024 * 1024, 16, false },
+        { "Find, chunks of 64 KiB", 64 * 1024, 16, false },
+        { "Find, queue depth 2", 1024 * 1024, 2, false },
+        { "Find, verified", 1024 * 1024, 16, true },
+    };
+    for (Variant const& Current : Variants)
+    {
+        NSudoSweeper::DuplicateFinderOptions FinderOptions;
+        FinderOptions.ChunkSize = Current.ChunkSize;
+        FinderOptions.QueueDepth = Current.QueueDepth;
+        FinderOptions.VerifyContents = Current.VerifyContents;
+        NSudoSweeper::DuplicateFinder Finder(FinderOptions);
+        ::AddFiles(Finder, Files);
+
+        NSudoTest::Stopwatch Timer;
+        NSUDO_TEST_CHECK(Finder.Find());
+        double Seconds = Timer.GetSeconds();
+
+        NSudoSweeper::DuplicateFinderStatistics Statistics =
+            Finder.GetStatistics();
+        NSudoTest::PrintMeasurement(
+            Current.Name,
+            Seconds,
+            static_cast<double>(Files.size()),
+            "files");
+        NSudoTest::PrintMeasurement(
+            std::string(Current.Name) + ", bytes read",
+            Seconds,
+            static_cast<double>(Statistics.BytesRead),
+            "B");
+        NSUDO_TEST_CHECK_EQUAL(Statistics.DuplicateSets, Duplicates.first);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.DuplicateFiles, Duplicates.second);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.FailedFiles, 0U);
+    }
+
+    // Hashing every file completely, which the size groups and the prefix
+    // hashes avoid.
+    {
+        NSudoTest::Stopwatch Timer;
+        std::map<std::pair<std::uint64_t, std::uint64_t>, std::size_t> Hashes;
+        std::uint64_t BytesRead = 0;
+        for (CorpusFile const& File : Files)
+        {
+            std::string Content;
+            NSUDO_TEST_CHECK(NSudoTest::ReadFile(File.Path, Content));
+            Mile::Hash128 Hash = Mile::ComputeFastHash(
+                Content.data(),
+                Content.size(),
+                Content.size());
+            ++Hashes[std::make_pair(Hash.High, Hash.Low)];
+            BytesRead += Content.size();
+        }
+        double Seconds = Timer.GetSeconds();
+
+        NSudoTest::PrintMeasurement(
+            "Hash every file",
+            Seconds,
+            static_cast<double>(Files.size()),
+            "files");
+        NSudoTest::PrintMeasurement(
+            "Hash every file, bytes read",
+            Seconds,
+            static_cast<double>(BytesRead),
+            "B");
+
+        std::size_t Sets = 0;
+        for (auto const& Hash : Hashes)
+        {
+            Sets += Hash.second > 1;
+        }
+        NSUDO_TEST_CHECK_EQUAL(Sets, Duplicates.first);
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
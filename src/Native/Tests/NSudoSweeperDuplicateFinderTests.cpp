@@ -0,0 +1,622 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperDuplicateFinderTests.cpp
+ * PURPOSE:   Implementation for the content-hash duplicate finder tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperDuplicateFinder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::size_t KiB = 1024;
+
+    std::string CreateContent(
+        std::size_t Size,
+        std::uint32_t Seed)
+    {
+        std::string Content(Size, '\0');
+        std::mt19937 Generator(Seed);
+        for (char& Byte : Content)
+        {
+            Byte = static_cast<char>(Generator() & 0xFF);
+        }
+        return Content;
+    }
+
+    std::string ChangeByte(
+        std::string Content,
+        std::size_t Offset)
+    {
+        Content[Offset] = static_cast<char>(Content[Offset] ^ 0x5A);
+        return Content;
+    }
+
+    /**
+     * Computes the content hash the duplicate finder documents: the hash,
+     * seeded with the length, of the hashes of the chunks, each seeded with
+     * the index of its chunk and stored as 16 little-endian bytes.
+     */
+    Mile::Hash128 ComputeContentHash(
+        std::string const& Content,
+        std::size_t ChunkSize)
+    {
+        Mile::FastHasher Hasher(Content.size());
+        for (std::size_t Offset = 0; Offset < Content.size();
+            Offset += ChunkSize)
+        {
+            Mile::Hash128 Hash = Mile::ComputeFastHash(
+                Content.data() + Offset,
+                (std::min)(ChunkSize, Content.size() - Offset),
+                Offset / ChunkSize);
+            std::uint8_t Bytes[16];
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                Bytes[i] = static_cast<std::uint8_t>(Hash.Low >> (i * 8));
+                Bytes[i + 8] = static_cast<std::uint8_t>(Hash.High >> (i * 8));
+            }
+            Hasher.Update(Bytes, sizeof(Bytes));
+        }
+        return Hasher.Finalize();
+    }
+
+    /**
+     * A directory of files whose contents the tests know.
+     */
+    class Corpus
+    {
+    private:
+
+        NSudoTest::TemporaryDirectory m_Directory;
+        std::map<std::string, std::string> m_Contents;
+
+        /**
+         * The first name of the data of each file, which differs from its
+         * name for the hard links.
+         */
+        std::map<std::string, std::string> m_DataNames;
+
+    public:
+
+        void Write(
+            std::string const& Name,
+            std::string const& Content)
+        {
+            NSudoTest::WriteFile(this->m_Directory.Join(Name), Content);
+            this->m_Contents[Name] = Content;
+            this->m_DataNames[Name] = Name;
+        }
+
+        void Link(
+            std::string const& Name,
+            std::string const& Target)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                ::link(
+                    this->m_Directory.Join(Target).c_str(),
+                    this->m_Directory.Join(Name).c_str()),
+                0);
+            this->m_Contents[Name] = this->m_Contents[Target];
+            this->m_DataNames[Name] = this->m_DataNames[Target];
+        }
+
+        std::string GetPath(
+            std::string const& Name) const
+        {
+            return this->m_Directory.Join(Name);
+        }
+
+        std::string GetName(
+            NSudoSweeper::DuplicateFile const& File) const
+        {
+            return File.Path.substr(this->m_Directory.GetPath().size() + 1);
+        }
+
+        std::string const& GetContent(
+            std::string const& Name) const
+        {
+            return this->m_Contents.at(Name);
+        }
+
+        /**
+         * Adds every file to a finder with its size, allocation size and
+         * file ID, as a scan finds them.
+         */
+        void AddTo(
+            NSudoSweeper::DuplicateFinder& Finder) const
+        {
+            for (auto const& Current : this->m_Contents)
+            {
+                NSudoSweeper::DuplicateFile File;
+                File.Path = this->GetPath(Current.first);
+                struct stat Status;
+                if (NSUDO_TEST_CHECK_EQUAL(
+                    ::lstat(File.Path.c_str(), &Status),
+                    0))
+                {
+                    File.Size = static_cast<std::uint64_t>(Status.st_size);
+                    File.AllocationSize =
+                        static_cast<std::uint64_t>(Status.st_blocks) * 512;
+                    File.FileId = static_cast<std::uint64_t>(Status.st_ino);
+                }
+                Finder.Add(std::move(File));
+            }
+        }
+
+        /**
+         * Groups the files by their contents, which is what the finder
+         * must find. Of the links to the same data, the first by path is
+         * compared.
+         */
+        std::vector<std::vector<std::string>> GroupByContent(
+            std::uint64_t MinimumSize) const
+        {
+            std::map<std::string, std::string> FirstLinks;
+            for (auto const& Current : this->m_DataNames)
+            {
+                FirstLinks.emplace(Current.second, Current.first);
+            }
+
+            std::map<std::string, std::vector<std::string>> Groups;
+            for (auto const& Current : this->m_Contents)
+            {
+                bool IsFirstLink =
+                    FirstLinks[this->m_DataNames.at(Current.first)] ==
+                    Current.first;
+                if (IsFirstLink &&
+                    !Current.second.empty() &&
+                    Current.second.size() >= MinimumSize)
+                {
+                    Groups[Current.second].push_back(Current.first);
+                }
+            }
+
+            std::vector<std::vector<std::string>> Result;
+            for (auto& Group : Groups)
+            {
+                if (Group.second.size() > 1)
+                {
+                    Result.push_back(std::move(Group.second));
+                }
+            }
+            std::sort(Result.begin(), Result.end());
+            return Result;
+        }
+    };
+
+    /**
+     * Checks the sets of a finder are the groups of the same content, and
+     * checks their hashes, orders and sizes.
+     */
+    void CheckSets(
+        Corpus const& Files,
+        NSudoSweeper::DuplicateFinder const& Finder,
+        NSudoSweeper::DuplicateFinderOptions const& Options,
+        std::string const& Name)
+    {
+        std::vector<std::vector<std::string>> Sets;
+        std::uint64_t ReclaimableSize = 0;
+        std::uint64_t DuplicateFiles = 0;
+        std::uint64_t PreviousSize = UINT64_MAX;
+        for (NSudoSweeper::DuplicateSet const& Set : Finder.GetSets())
+        {
+            std::vector<std::string> Names;
+            std::uint64_t SetReclaimableSize = 0;
+            for (std::size_t Index : Set.Files)
+            {
+                NSudoSweeper::DuplicateFile const& File =
+                    Finder.GetFiles()[Index];
+                NSUDO_TEST_CHECK_EQUAL(File.Size, Set.Size);
+                if (!Names.empty())
+                {
+                    SetReclaimableSize += File.AllocationSize
+                        ? File.AllocationSize
+                        : File.Size;
+                }
+                Names.push_back(Files.GetName(File));
+            }
+            NSUDO_TEST_CHECK(std::is_sorted(Names.begin(), Names.end()));
+            NSUDO_TEST_CHECK_EQUAL(Set.ReclaimableSize, SetReclaimableSize);
+            NSUDO_TEST_CHECK(Set.ReclaimableSize <= PreviousSize);
+            PreviousSize = Set.ReclaimableSize;
+
+            Mile::Hash128 Expected = ::ComputeContentHash(
+                Files.GetContent(Names[0]),
+                Options.ChunkSize);
+            if (!NSUDO_TEST_CHECK(Set.Hash == Expected))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Hash",
+                    Name + ": " + Names[0]);
+            }
+
+            ReclaimableSize += Set.ReclaimableSize;
+            DuplicateFiles += Set.Files.size() - 1;
+            Sets.push_back(std::move(Names));
+        }
+        std::sort(Sets.begin(), Sets.end());
+
+        std::vector<std::vector<std::string>> Expected =
+            Files.GroupByContent(Options.MinimumSize);
+        if (!NSUDO_TEST_CHECK(Sets == Expected))
+        {
+            for (std::vector<std::string> const& Set : Sets)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Found",
+                    Name + ": " + Set[0] + " and " +
+                        std::to_string(Set.size() - 1) + " more");
+            }
+        }
+
+        NSudoSweeper::DuplicateFinderStatistics Statistics =
+            Finder.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.DuplicateSets, Sets.size());
+        NSUDO_TEST_CHECK_EQUAL(Statistics.DuplicateFiles, DuplicateFiles);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.ReclaimableSize, ReclaimableSize);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.FailedFiles, 0U);
+    }
+
+    /**
+     * Creates files which match in size, in prefix, in every chunk but
+     * one, and in content, with hard links and empty files.
+     */
+    void CreateMixedCorpus(
+        Corpus& Files)
+    {
+        std::string A = ::CreateContent(10000, 1);
+        Files.Write("a1.bin", A);
+        Files.Write("a2.bin", A);
+        Files.Write("sub/a3.bin", A);
+        Files.Link("a0-link.bin", "a2.bin");
+        Files.Write("a-tail.bin", ::ChangeByte(A, A.size() - 1));
+        Files.Write("a-head.bin", ::ChangeByte(A, 0));
+
+        std::string D = ::CreateContent(5000, 2);
+        Files.Write("d1.bin", D);
+        Files.Write("d2.bin", D);
+        Files.Write("e.bin", ::CreateContent(5000, 3));
+
+        Files.Write("x1.txt", "x");
+        Files.Write("x2.txt", "x");
+        Files.Write("y.txt", "y");
+
+        // The size of the default prefix, and one byte more.
+        std::string P = ::CreateContent(4 * KiB, 4);
+        Files.Write("p1.bin", P);
+        Files.Write("p2.bin", P);
+        Files.Write("p3.bin", P);
+        std::string Q = ::CreateContent(4 * KiB + 1, 5);
+        Files.Write("q1.bin", Q);
+        Files.Write("q2.bin", ::ChangeByte(Q, Q.size() - 1));
+
+        // Several chunks of 64 KiB, which are hashed in parallel, and
+        // copies which differ on either side of a boundary.
+        std::string L = ::CreateContent(200 * KiB + 3, 6);
+        Files.Write("l1.bin", L);
+        Files.Write("l2.bin", L);
+        Files.Write("l3.bin", L);
+        Files.Write("l-before.bin", ::ChangeByte(L, 64 * KiB - 1));
+        Files.Write("l-after.bin", ::ChangeByte(L, 64 * KiB));
+        Files.Write("l-before2.bin", ::ChangeByte(L, 64 * KiB - 1));
+
+        Files.Write("empty1", "");
+        Files.Write("empty2", "");
+    }
+}
+
+NSUDO_TEST_CASE(DuplicatesAreGroupedByContent)
+{
+    ::Corpus Files;
+    ::CreateMixedCorpus(Files);
+
+    struct Variant
+    {
+        std::size_t ChunkSize;
+        std::size_t PrefixSize;
+        std::size_t QueueDepth;
+        std::uint64_t MinimumSize;
+        bool VerifyContents;
+    };
+    const Variant Variants[] =
+    {
+        { 1024 * KiB, 4 * KiB, 16, 1, false },
+        { 1024 * KiB, 4 * KiB, 16, 1, true },
+        { 64 * KiB, 4 * KiB, 3, 1, false },
+        { 64 * KiB, 4 * KiB, 3, 1, true },
+        { 4 * KiB, 1, 2, 1, false },
+        { 5000, 100, 4, 1, true },
+        { 4 * KiB, 4 * KiB, 16, 4 * KiB + 1, false },
+        { 64 * KiB, 64 * KiB, 2, 5000, true },
+    };
+    for (Variant const& Current : Variants)
+    {
+        NSudoSweeper::DuplicateFinderOptions Options;
+        Options.ChunkSize = Current.ChunkSize;
+        Options.PrefixSize = Current.PrefixSize;
+        Options.QueueDepth = Current.QueueDepth;
+        Options.MinimumSize = Current.MinimumSize;
+        Options.VerifyContents = Current.VerifyContents;
+        std::string Name =
+            "chunks of " + std::to_string(Current.ChunkSize) +
+            ", prefix of " + std::to_string(Current.PrefixSize) +
+            ", depth " + std::to_string(Current.QueueDepth) +
+            ", minimum " + std::to_string(Current.MinimumSize) +
+            (Current.VerifyContents ? ", verified" : "");
+
+        NSudoSweeper::DuplicateFinder Finder(Options);
+        Files.AddTo(Finder);
+        NSUDO_TEST_CHECK(Finder.Find());
+        ::CheckSets(Files, Finder, Options, Name);
+
+        NSudoSweeper::DuplicateFinderStatistics Statistics =
+            Finder.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.Files, Finder.GetFiles().size());
+        NSUDO_TEST_CHECK_EQUAL(Statistics.LinkedFiles, 1U);
+        if (Current.VerifyContents)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Statistics.VerifiedFiles,
+                Statistics.DuplicateSets + Statistics.DuplicateFiles);
+        }
+        else
+        {
+            NSUDO_TEST_CHECK_EQUAL(Statistics.VerifiedFiles, 0U);
+        }
+
+        // A second search of the same files finds the same sets.
+        NSUDO_TEST_CHECK(Finder.Find());
+        ::CheckSets(Files, Finder, Options, Name + ", again");
+    }
+}
+
+NSUDO_TEST_CASE(ContentHashIsStableAcrossChunkBoundaries)
+{
+    // The chunks are read and hashed in any order, with any number in
+    // flight, and each size around a chunk boundary hashes as documented.
+    for (std::size_t ChunkSize : { 4 * KiB, 64 * KiB })
+    {
+        ::Corpus Files;
+        for (std::size_t Size : {
+            ChunkSize - 1,
+            ChunkSize,
+            ChunkSize + 1,
+            3 * ChunkSize,
+            3 * ChunkSize + 17 })
+        {
+            std::string Content = ::CreateContent(
+                Size,
+                static_cast<std::uint32_t>(Size));
+            std::string Prefix = std::to_string(Size);
+            Files.Write(Prefix + "-1.bin", Content);
+            Files.Write(Prefix + "-2.bin", Content);
+
+            // One byte changed at each end of the chunks.
+            for (std::size_t Offset : {
+                std::size_t(0),
+                ChunkSize - 1,
+                ChunkSize,
+                2 * ChunkSize,
+                Size - 1 })
+            {
+                if (Offset < Size)
+                {
+                    Files.Write(
+                        Prefix + "-changed-" + std::to_string(Offset) +
+                            ".bin",
+                        ::ChangeByte(Content, Offset));
+                }
+            }
+        }
+
+        std::vector<Mile::Hash128> FirstHashes;
+        for (std::size_t QueueDepth : { 2, 5, 16 })
+        {
+            for (int Round = 0; Round < 3; ++Round)
+            {
+                NSudoSweeper::DuplicateFinderOptions Options;
+                Options.ChunkSize = ChunkSize;
+                Options.QueueDepth = QueueDepth;
+                NSudoSweeper::DuplicateFinder Finder(Options);
+                Files.AddTo(Finder);
+                NSUDO_TEST_CHECK(Finder.Find());
+                ::CheckSets(
+                    Files,
+                    Finder,
+                    Options,
+                    "chunks of " + std::to_string(ChunkSize) +
+                        ", depth " + std::to_string(QueueDepth));
+                NSUDO_TEST_CHECK_EQUAL(Finder.GetSets().size(), 5U);
+
+                std::vector<Mile::Hash128> Hashes;
+                for (NSudoSweeper::DuplicateSet const& Set : Finder.GetSets())
+                {
+                    Hashes.push_back(Set.Hash);
+                }
+                std::sort(Hashes.begin(), Hashes.end());
+                if (FirstHashes.empty())
+                {
+                    FirstHashes = Hashes;
+                }
+                NSUDO_TEST_CHECK(Hashes == FirstHashes);
+            }
+        }
+    }
+}
+
+NSUDO_TEST_CASE(OnlyCollidingFilesAreRead)
+{
+    ::Corpus Files;
+
+    // Sizes of their own, which are never read.
+    for (std::size_t i = 0; i < 5; ++i)
+    {
+        Files.Write(
+            "unique" + std::to_string(i) + ".bin",
+            ::CreateContent(20000 + i, static_cast<std::uint32_t>(i)));
+    }
+
+    // The same size and other prefixes, whose prefixes are read.
+    Files.Write("head1.bin", ::CreateContent(30000, 10));
+    Files.Write("head2.bin", ::CreateContent(30000, 11));
+
+    // The same prefix, which are read completely.
+    std::string Content = ::CreateContent(40000, 12);
+    Files.Write("full1.bin", Content);
+    Files.Write("full2.bin", Content);
+    Files.Write("full3.bin", ::ChangeByte(Content, 30000));
+
+    NSudoSweeper::DuplicateFinderOptions Options;
+    Options.PrefixSize = 4 * KiB;
+    NSudoSweeper::DuplicateFinder Finder(Options);
+    Files.AddTo(Finder);
+
+    std::uint64_t LastRead = 0;
+    std::uint64_t LastPlanned = 0;
+    bool Monotonic = true;
+    Finder.SetProgressHandler([&](
+        std::uint64_t BytesRead,
+        std::uint64_t BytesPlanned)
+    {
+        Monotonic = Monotonic &&
+            BytesRead >= LastRead &&
+            BytesPlanned >= LastPlanned &&
+            BytesRead <= BytesPlanned;
+        LastRead = BytesRead;
+        LastPlanned = BytesPlanned;
+    });
+    NSUDO_TEST_CHECK(Finder.Find());
+    ::CheckSets(Files, Finder, Options, "stages");
+
+    NSudoSweeper::DuplicateFinderStatistics Statistics =
+        Finder.GetStatistics();
+    NSUDO_TEST_CHECK_EQUAL(Statistics.SizeCollisions, 5U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.PrefixHashedFiles, 5U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.FullHashedFiles, 3U);
+    NSUDO_TEST_CHECK_EQUAL(
+        Statistics.BytesRead,
+        5 * 4 * KiB + 3 * Content.size());
+    NSUDO_TEST_CHECK(Monotonic);
+    NSUDO_TEST_CHECK_EQUAL(LastRead, Statistics.BytesRead);
+    NSUDO_TEST_CHECK_EQUAL(LastPlanned, Statistics.BytesRead);
+}
+
+NSUDO_TEST_CASE(ChangedFilesAreDropped)
+{
+    ::Corpus Files;
+    std::string Content = ::CreateContent(50000, 20);
+    for (const char* Name : { "c1.bin", "c2.bin", "c3.bin", "c4.bin" })
+    {
+        Files.Write(Name, Content);
+    }
+
+    for (bool VerifyContents : { false, true })
+    {
+        NSudoSweeper::DuplicateFinderOptions Options;
+        Options.VerifyContents = VerifyContents;
+        NSudoSweeper::DuplicateFinder Finder(Options);
+        Files.AddTo(Finder);
+
+        // One file grows and one is removed after the scan.
+        NSudoTest::WriteFile(Files.GetPath("c2.bin"), Content + "more");
+        NSUDO_TEST_CHECK_EQUAL(
+            ::unlink(Files.GetPath("c4.bin").c_str()),
+            0);
+
+        NSUDO_TEST_CHECK(Finder.Find());
+        NSudoSweeper::DuplicateFinderStatistics Statistics =
+            Finder.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.FailedFiles, 2U);
+        if (NSUDO_TEST_CHECK_EQUAL(Finder.GetSets().size(), 1U))
+        {
+            NSudoSweeper::DuplicateSet const& Set = Finder.GetSets()[0];
+            if (NSUDO_TEST_CHECK_EQUAL(Set.Files.size(), 2U))
+            {
+                NSUDO_TEST_CHECK_EQUAL(
+                    Files.GetName(Finder.GetFiles()[Set.Files[0]]),
+                    std::string("c1.bin"));
+                NSUDO_TEST_CHECK_EQUAL(
+                    Files.GetName(Finder.GetFiles()[Set.Files[1]]),
+                    std::string("c3.bin"));
+            }
+        }
+
+        NSudoTest::WriteFile(Files.GetPath("c2.bin"), Content);
+        NSudoTest::WriteFile(Files.GetPath("c4.bin"), Content);
+    }
+}
+
+NSUDO_TEST_CASE(FindCanBeCanceled)
+{
+    ::Corpus Files;
+    ::CreateMixedCorpus(Files);
+
+    NSudoSweeper::DuplicateFinderOptions Options;
+    Options.ChunkSize = 4 * KiB;
+    Options.QueueDepth = 2;
+    NSudoSweeper::DuplicateFinder Finder(Options);
+    Files.AddTo(Finder);
+
+    std::size_t Calls = 0;
+    Finder.SetProgressHandler([&](
+        std::uint64_t BytesRead,
+        std::uint64_t BytesPlanned)
+    {
+        static_cast<void>(BytesRead);
+        static_cast<void>(BytesPlanned);
+        if (++Calls == 3)
+        {
+            Finder.Cancel();
+        }
+    });
+    NSUDO_TEST_CHECK(!Finder.Find());
+    NSUDO_TEST_CHECK(Finder.GetSets().empty());
+
+    // A handler which throws stops the finder, and the exception reaches
+    // the caller.
+    Finder.SetProgressHandler([](
+        std::uint64_t BytesRead,
+        std::uint64_t BytesPlanned)
+    {
+        if (BytesRead > 0 && BytesRead < BytesPlanned)
+        {
+            throw std::runtime_error("Stop");
+        }
+    });
+    bool Thrown = false;
+    try
+    {
+        Finder.Find();
+    }
+    catch (std::runtime_error const&)
+    {
+        Thrown = true;
+    }
+    NSUDO_TEST_CHECK(Thrown);
+
+    // The finder can search again afterwards.
+    Finder.SetProgressHandler(nullptr);
+    NSUDO_TEST_CHECK(Finder.Find());
+    ::CheckSets(Files, Finder, Options, "after cancel");
+}
@@ -0,0 +1,258 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperEstimatorTests.cpp
+ * PURPOSE:   Implementation for the freed size estimator tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperEstimator.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace
+{
+    /**
+     * The totals the estimator counts for the files of a tree.
+     */
+    struct ExpectedTotals
+    {
+        std::uint64_t Files = 0;
+        std::uint64_t Size = 0;
+        std::uint64_t DataSize = 0;
+    };
+
+    /**
+     * Sums the .tmp files of a tree outside Pruned the way the estimator
+     * counts them, where the freed size is the allocation size, or the size
+     * of a sparse file without blocks.
+     */
+    ExpectedTotals GetExpectedTotals(
+        std::string const& Root)
+    {
+        ExpectedTotals Totals;
+        for (auto Iterator =
+            std::filesystem::recursive_directory_iterator(Root);
+            Iterator != std::filesystem::recursive_directory_iterator();
+            ++Iterator)
+        {
+            std::filesystem::directory_entry const& Entry = *Iterator;
+            if (Entry.path().filename() == "Pruned")
+            {
+                Iterator.disable_recursion_pending();
+                continue;
+            }
+
+            struct stat Status;
+            if (0 != ::lstat(Entry.path().c_str(), &Status) ||
+                !S_ISREG(Status.st_mode) ||
+                Entry.path().extension() != ".tmp")
+            {
+                continue;
+            }
+
+            std::uint64_t AllocationSize =
+                static_cast<std::uint64_t>(Status.st_blocks) * 512;
+            std::uint64_t DataSize =
+                static_cast<std::uint64_t>(Status.st_size);
+            ++Totals.Files;
+            Totals.DataSize += DataSize;
+            Totals.Size += AllocationSize ? AllocationSize : DataSize;
+        }
+        return Totals;
+    }
+
+    /**
+     * Creates a synthetic tree with a few files which are not sparse, a
+     * file the filter skips and a directory the filter prunes.
+     */
+    NSudoTest::SyntheticTreeTotals CreateTree(
+        std::string const& Root,
+        NSudoTest::SyntheticTreeOptions const& Options)
+    {
+        NSudoTest::SyntheticTreeTotals Totals =
+            NSudoTest::CreateSyntheticTree(Root, Options);
+
+        NSudoTest::WriteFile(Root + "/Dense1.tmp", std::string(10000, 'a'));
+        NSudoTest::WriteFile(Root + "/Dense2.tmp", std::string(70000, 'b'));
+        Totals.Files += 2;
+        Totals.Size += 80000;
+
+        NSudoTest::WriteFile(Root + "/Skipped.log", std::string(5000, 'c'));
+        NSudoTest::WriteFile(
+            Root + "/Pruned/Hidden.tmp",
+            std::string(5000, 'd'));
+        return Totals;
+    }
+
+    void AddFilter(
+        NSudoSweeper::SizeEstimator& Estimator)
+    {
+        Estimator.AddFilter([](
+            Mile::NativeStringView DirectoryPath,
+            Mile::FileEnumeratorEntry const& Entry,
+            std::uint32_t Depth)
+        {
+            static_cast<void>(DirectoryPath);
+            static_cast<void>(Depth);
+
+            Mile::NativeStringView Name = Entry.GetName();
+            if (Name == "Pruned")
+            {
+                return NSudoSweeper::TreeWalkerFilterResult::Prune;
+            }
+            if (Name.size() >= 4 && Name.substr(Name.size() - 4) == ".log")
+            {
+                return NSudoSweeper::TreeWalkerFilterResult::Skip;
+            }
+            return NSudoSweeper::TreeWalkerFilterResult::Include;
+        });
+    }
+
+    std::vector<NSudoSweeper::TreeWalkerRoot> MakeRoots(
+        std::string const& Root)
+    {
+        std::vector<NSudoSweeper::TreeWalkerRoot> Roots(1);
+        Roots[0].Path = Root;
+        return Roots;
+    }
+
+    void CheckExact(
+        NSudoSweeper::SizeEstimate const& Estimate,
+        ExpectedTotals const& Expected)
+    {
+        NSUDO_TEST_CHECK(Estimate.Exact);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.Files, Expected.Files);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.Size, Expected.Size);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.DataSize, Expected.DataSize);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.ExactSize, Expected.Size);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.LowerBound, Expected.Size);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.UpperBound, Expected.Size);
+    }
+}
+
+NSUDO_TEST_CASE(SmallTreesAreCountedExactly)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+
+    NSudoTest::SyntheticTreeOptions Options;
+    Options.Depth = 2;
+    Options.FanOut = 3;
+    Options.FilesPerDirectory = 5;
+    NSudoTest::SyntheticTreeTotals Totals = ::CreateTree(Root, Options);
+
+    ::ExpectedTotals Expected = ::GetExpectedTotals(Root);
+    NSUDO_TEST_CHECK_EQUAL(Expected.Files, Totals.Files);
+    NSUDO_TEST_CHECK_EQUAL(Expected.DataSize, Totals.Size);
+
+    // The whole tree is within the expansion limit, so it is counted while
+    // the top of the tree is expanded.
+    NSudoSweeper::SizeEstimator Estimator;
+    ::AddFilter(Estimator);
+    NSUDO_TEST_CHECK(Estimator.Estimate(
+        ::MakeRoots(Root),
+        std::chrono::milliseconds(10000)));
+
+    NSudoSweeper::SizeEstimate Estimate = Estimator.GetEstimate();
+    ::CheckExact(Estimate, Expected);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Probes, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Strata, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Directories, Totals.Directories + 1);
+    NSUDO_TEST_CHECK(Estimator.Refine(std::chrono::milliseconds(1000)));
+}
+
+NSUDO_TEST_CASE(SamplesConvergeToTheTotals)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+
+    NSudoTest::SyntheticTreeOptions Options;
+    Options.Depth = 3;
+    Options.FanOut = 4;
+    Options.FilesPerDirectory = 8;
+    Options.Seed = 42;
+    NSudoTest::SyntheticTreeTotals Totals = ::CreateTree(Root, Options);
+    ::ExpectedTotals Expected = ::GetExpectedTotals(Root);
+    NSUDO_TEST_CHECK_EQUAL(Expected.Files, Totals.Files);
+
+    // Only the root is counted exactly, and the subtrees below it are
+    // sampled.
+    NSudoSweeper::SizeEstimatorOptions EstimatorOptions;
+    EstimatorOptions.ExpansionLimit = 1;
+    EstimatorOptions.Seed = 7;
+    NSudoSweeper::SizeEstimator Estimator(EstimatorOptions);
+    ::AddFilter(Estimator);
+    NSUDO_TEST_CHECK(Estimator.Estimate(
+        ::MakeRoots(Root),
+        std::chrono::milliseconds(200)));
+
+    NSudoSweeper::SizeEstimate Estimate = Estimator.GetEstimate();
+    NSUDO_TEST_CHECK(!Estimate.Exact);
+    NSUDO_TEST_CHECK(Estimate.Probes > 0);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Strata, 1U);
+    NSUDO_TEST_CHECK(Estimate.ExactSize < Expected.Size);
+    NSUDO_TEST_CHECK(Estimate.LowerBound >= Estimate.ExactSize);
+    NSUDO_TEST_CHECK(Estimate.LowerBound <= Estimate.Size);
+    NSUDO_TEST_CHECK(Estimate.Size <= Estimate.UpperBound);
+
+    // Every subtree has the same shape, so each descent counts the files
+    // of a subtree exactly, while the sizes are random.
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Files, Expected.Files);
+    NSUDO_TEST_CHECK(Estimate.Size > 0);
+    NSUDO_TEST_CHECK(Estimate.DataSize > 0);
+
+    bool Exact = false;
+    for (int i = 0; i < 1000 && !Exact; ++i)
+    {
+        Exact = Estimator.Refine(std::chrono::milliseconds(5));
+
+        NSudoSweeper::SizeEstimate Current = Estimator.GetEstimate();
+        NSUDO_TEST_CHECK(Current.ExactSize >= Estimate.ExactSize);
+        NSUDO_TEST_CHECK(Current.ExactSize <= Expected.Size);
+        Estimate = Current;
+    }
+    NSUDO_TEST_CHECK(Exact);
+    ::CheckExact(Estimator.GetEstimate(), Expected);
+}
+
+NSUDO_TEST_CASE(CancellationAndMissingRoots)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+
+    NSudoTest::SyntheticTreeOptions Options;
+    ::CreateTree(Root, Options);
+
+    // A canceled estimator reads nothing, so it has no estimate.
+    {
+        NSudoSweeper::SizeEstimator Estimator;
+        Estimator.Cancel();
+        NSUDO_TEST_CHECK(!Estimator.Estimate(
+            ::MakeRoots(Root),
+            std::chrono::milliseconds(1000)));
+
+        NSudoSweeper::SizeEstimate Estimate = Estimator.GetEstimate();
+        NSUDO_TEST_CHECK(!Estimate.Exact);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.Directories, 0U);
+        NSUDO_TEST_CHECK_EQUAL(Estimate.Size, 0U);
+    }
+
+    // A root which does not exist is empty.
+    {
+        NSudoSweeper::SizeEstimator Estimator;
+        NSUDO_TEST_CHECK(Estimator.Estimate(
+            ::MakeRoots(Root + "/Missing"),
+            std::chrono::milliseconds(1000)));
+        ::CheckExact(Estimator.GetEstimate(), ::ExpectedTotals());
+    }
+}
@@ -0,0 +1,262 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperHandlerDescriptorTests.cpp
+ * PURPOSE:   Implementation for the cleanup handler descriptor tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperHandlerDescriptor.h"
+
+#include <string>
+
+namespace
+{
+    /**
+     * Creates a configuration file with a DetectOS line.
+     */
+    std::string CreateConfiguration(
+        std::string const& DetectOS)
+    {
+        return
+            "[Metadata.en]\n"
+            "Name = \"Test\"\n"
+            "Description = \"Test\"\n"
+            "[Configuration]\n"
+            "Plugin = \"NSudoSweeperCore.dll\"\n"
+            "Handler = \"NSudoSweeperStandardCleanupHandler\"\n" +
+            DetectOS + "\n";
+    }
+
+    NSudoSweeper::HandlerVersion MakeVersion(
+        std::uint32_t Major,
+        std::uint32_t Minor,
+        std::uint32_t Build)
+    {
+        NSudoSweeper::HandlerVersion Result;
+        Result.Major = Major;
+        Result.Minor = Minor;
+        Result.Build = Build;
+        return Result;
+    }
+
+    bool IsEqual(
+        NSudoSweeper::HandlerVersion const& Left,
+        NSudoSweeper::HandlerVersion const& Right)
+    {
+        return NSudoSweeper::CompareHandlerVersion(Left, Right) == 0;
+    }
+}
+
+NSUDO_TEST_CASE(DetectOSVersions)
+{
+    NSudoSweeper::HandlerDescriptor Descriptor;
+    NSudoSweeper::HandlerDescriptorError Error;
+
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration(""),
+        Descriptor,
+        Error));
+    NSUDO_TEST_CHECK(!Descriptor.HasDetectOS);
+
+    // The missing parts of the maximum include every later build.
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration(
+            "DetectOS = { Minimum = \"6.1\", Maximum = \"10.0\" }"),
+        Descriptor,
+        Error));
+    NSUDO_TEST_CHECK(Descriptor.HasDetectOS);
+    NSUDO_TEST_CHECK(::IsEqual(Descriptor.MinimumOS, ::MakeVersion(6, 1, 0)));
+    NSUDO_TEST_CHECK(::IsEqual(
+        Descriptor.MaximumOS,
+        ::MakeVersion(10, 0, UINT32_MAX)));
+
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration("DetectOS = { Minimum = \"10.0.22000\" }"),
+        Descriptor,
+        Error));
+    NSUDO_TEST_CHECK(::IsEqual(
+        Descriptor.MinimumOS,
+        ::MakeVersion(10, 0, 22000)));
+    NSUDO_TEST_CHECK(::IsEqual(
+        Descriptor.MaximumOS,
+        ::MakeVersion(UINT32_MAX, UINT32_MAX, UINT32_MAX)));
+
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration("DetectOS = { Maximum = \"6\" }"),
+        Descriptor,
+        Error));
+    NSUDO_TEST_CHECK(::IsEqual(Descriptor.MinimumOS, ::MakeVersion(0, 0, 0)));
+    NSUDO_TEST_CHECK(::IsEqual(
+        Descriptor.MaximumOS,
+        ::MakeVersion(6, UINT32_MAX, UINT32_MAX)));
+
+    for (char const* Invalid :
+        {
+            "DetectOS = { Minimum = \"\" }",
+            "DetectOS = { Minimum = \"6.\" }",
+            "DetectOS = { Minimum = \".1\" }",
+            "DetectOS = { Minimum = \"6..1\" }",
+            "DetectOS = { Minimum = \"6.1.2.3\" }",
+            "DetectOS = { Minimum = \"6.x\" }",
+            "DetectOS = { Minimum = \"4294967296\" }",
+            "DetectOS = { Minimum = 6 }",
+            "DetectOS = \"6.1\"",
+        })
+    {
+        NSUDO_TEST_CHECK(!NSudoSweeper::ParseHandlerDescriptor(
+            ::CreateConfiguration(Invalid),
+            Descriptor,
+            Error));
+        NSUDO_TEST_CHECK(Error.Message != nullptr);
+        NSUDO_TEST_CHECK_EQUAL(Error.Line, 7U);
+    }
+}
+
+NSUDO_TEST_CASE(SupportedVersions)
+{
+    NSudoSweeper::HandlerDescriptor Descriptor;
+    NSudoSweeper::HandlerDescriptorError Error;
+
+    // Without DetectOS, every version is supported.
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration(""),
+        Descriptor,
+        Error));
+    NSUDO_TEST_CHECK(NSudoSweeper::IsHandlerVersionSupported(
+        Descriptor,
+        ::MakeVersion(5, 1, 2600)));
+
+    NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+        ::CreateConfiguration(
+            "DetectOS = { Minimum = \"6.1.7601\", Maximum = \"6.3\" }"),
+        Descriptor,
+        Error));
+
+    struct
+    {
+        NSudoSweeper::HandlerVersion Version;
+        bool Supported;
+    } const Cases[] =
+    {
+        { ::MakeVersion(6, 0, 6002), false },
+        { ::MakeVersion(6, 1, 7600), false },
+        { ::MakeVersion(6, 1, 7601), true },
+        { ::MakeVersion(6, 2, 9200), true },
+        { ::MakeVersion(6, 3, 9600), true },
+        { ::MakeVersion(6, 4, 0), false },
+        { ::MakeVersion(10, 0, 19045), false },
+    };
+    for (auto const& Case : Cases)
+    {
+        NSUDO_TEST_CHECK_EQUAL(
+            NSudoSweeper::IsHandlerVersionSupported(Descriptor, Case.Version),
+            Case.Supported);
+    }
+
+    NSUDO_TEST_CHECK(NSudoSweeper::CompareHandlerVersion(
+        ::MakeVersion(6, 1, 0),
+        ::MakeVersion(10, 0, 0)) < 0);
+    NSUDO_TEST_CHECK(NSudoSweeper::CompareHandlerVersion(
+        ::MakeVersion(10, 0, 22000),
+        ::MakeVersion(10, 0, 19045)) > 0);
+
+    // DetectOS only applies to Windows.
+    NSudoSweeper::HandlerVersion Current;
+#if defined(_WIN32)
+    NSUDO_TEST_CHECK(NSudoSweeper::GetCurrentHandlerVersion(Current));
+    NSUDO_TEST_CHECK(Current.Major >= 6);
+#else
+    NSUDO_TEST_CHECK(!NSudoSweeper::GetCurrentHandlerVersion(Current));
+#endif
+}
+
+NSUDO_TEST_CASE(ShippedConfigurations)
+{
+    for (char const* Name :
+        {
+            "NSudoSweeperStandardCleanupHandler.toml",
+            "NSudoSweeperDuplicateCleanupHandler.toml",
+        })
+    {
+        std::string Content;
+        if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+            std::string(NSUDO_SWEEPER_SOURCE_DIRECTORY "/") + Name,
+            Content)))
+        {
+            continue;
+        }
+
+        NSudoSweeper::HandlerDescriptor Descriptor;
+        NSudoSweeper::HandlerDescriptorError Error;
+        if (!NSUDO_TEST_CHECK(NSudoSweeper::ParseHandlerDescriptor(
+            Content,
+            Descriptor,
+            Error)))
+        {
+            continue;
+        }
+
+        NSUDO_TEST_CHECK(Descriptor.GetLocalizedText("en") != nullptr);
+        NSUDO_TEST_CHECK(Descriptor.GetLocalizedText("zh-Hans") != nullptr);
+        NSUDO_TEST_CHECK(!Descriptor.Include.empty());
+        NSUDO_TEST_CHECK(
+            NSudoSweeper::CompareHandlerVersion(
+                Descriptor.MinimumOS,
+                Descriptor.MaximumOS) <= 0);
+    }
+}
+
+NSUDO_TEST_CASE(CacheComparesTheContent)
+{
+    NSudoSweeper::HandlerDescriptorCache Cache;
+    NSudoSweeper::HandlerDescriptorError Error;
+
+    // Two files of the same size which differ in one character.
+    std::string First = ::CreateConfiguration(
+        "DetectOS = { Minimum = \"6.1\" }");
+    std::string Second = ::CreateConfiguration(
+        "DetectOS = { Minimum = \"6.2\" }");
+    NSUDO_TEST_CHECK_EQUAL(First.size(), Second.size());
+
+    auto FirstDescriptor = Cache.Parse(First, Error);
+    auto SecondDescriptor = Cache.Parse(Second, Error);
+    if (!NSUDO_TEST_CHECK(FirstDescriptor && SecondDescriptor))
+    {
+        return;
+    }
+    NSUDO_TEST_CHECK(FirstDescriptor != SecondDescriptor);
+    NSUDO_TEST_CHECK(::IsEqual(
+        FirstDescriptor->MinimumOS,
+        ::MakeVersion(6, 1, 0)));
+    NSUDO_TEST_CHECK(::IsEqual(
+        SecondDescriptor->MinimumOS,
+        ::MakeVersion(6, 2, 0)));
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 2U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetMisses(), 2U);
+
+    // The cache keeps a copy of the content, so a buffer which is reused
+    // for other content does not change what it hits.
+    std::string Buffer = First;
+    NSUDO_TEST_CHECK(Cache.Parse(Buffer, Error) == FirstDescriptor);
+    Buffer = Second;
+    NSUDO_TEST_CHECK(Cache.Parse(Buffer, Error) == SecondDescriptor);
+    NSUDO_TEST_CHECK(Cache.Parse(First, Error) == FirstDescriptor);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetHits(), 3U);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 2U);
+
+    // Content which is not valid is not cached.
+    std::string Invalid = First;
+    Invalid.replace(Invalid.find("[Configuration]"), 15, "[Configuratio_]");
+    NSUDO_TEST_CHECK(!Cache.Parse(Invalid, Error));
+    NSUDO_TEST_CHECK(Error.Message != nullptr);
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 2U);
+
+    Cache.Clear();
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetSize(), 0U);
+    NSUDO_TEST_CHECK(Cache.Parse(First, Error) != FirstDescriptor);
+}
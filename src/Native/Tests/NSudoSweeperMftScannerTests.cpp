@@ -0,0 +1,1477 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperMftScannerTests.cpp
+ * PURPOSE:   Implementation for the NTFS master file table scanner tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperMftScanner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * The images are built by ImageBuilder, which writes the boot sector, the
+ * file records of the master file table with their update sequence arrays,
+ * and the attributes the scanner reads, in the layout described in
+ * NSudoSweeperMftScanner.cpp. The file data is never read, so the data
+ * runs of the files are sparse. The expected listings are in Data/Ntfs.
+ */
+
+namespace
+{
+    const std::uint32_t RecordSize = 1024;
+    const std::uint32_t SectorSize = 512;
+
+    const std::uint32_t StandardInformationType = 0x10;
+    const std::uint32_t AttributeListType = 0x20;
+    const std::uint32_t FileNameType = 0x30;
+    const std::uint32_t DataType = 0x80;
+
+    const std::uint8_t PosixNamespace = 0;
+    const std::uint8_t Win32Namespace = 1;
+    const std::uint8_t DosNamespace = 2;
+    const std::uint8_t Win32AndDosNamespace = 3;
+
+    const std::uint16_t CompressedAttribute = 0x0001;
+    const std::uint16_t SparseAttribute = 0x8000;
+
+    const std::uint32_t HiddenSystemFileAttributes = 0x00000006;
+    const std::uint32_t ReparsePointFileAttribute = 0x00000400;
+
+    const std::size_t RootDirectory = 5;
+    const std::size_t ExtendDirectory = 11;
+    const std::size_t FirstUserRecord = 16;
+
+    /**
+     * The LCN of a sparse run.
+     */
+    const std::uint64_t SparseLcn = UINT64_MAX;
+
+    typedef std::vector<std::uint8_t> Bytes;
+
+    void Store(
+        Bytes& Target,
+        std::size_t Offset,
+        std::uint64_t Value,
+        std::size_t Size)
+    {
+        if (Target.size() < Offset + Size)
+        {
+            Target.resize(Offset + Size);
+        }
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            Target[Offset + i] = static_cast<std::uint8_t>(Value >> (i * 8));
+        }
+    }
+
+    std::size_t AlignUp(
+        std::size_t Value,
+        std::size_t Alignment)
+    {
+        return (Value + Alignment - 1) / Alignment * Alignment;
+    }
+
+    std::u16string ToName(
+        std::string const& Text)
+    {
+        return std::u16string(Text.begin(), Text.end());
+    }
+
+    /**
+     * A run of clusters of an attribute.
+     */
+    struct Extent
+    {
+        std::uint64_t Lcn;
+        std::uint64_t Length;
+    };
+
+    /**
+     * Encodes the mapping pairs array of runs, with the smallest sizes of
+     * the lengths and of the signed offsets.
+     */
+    Bytes EncodeRuns(
+        std::vector<Extent> const& Runs)
+    {
+        Bytes Result;
+        std::int64_t Previous = 0;
+        for (Extent const& Current : Runs)
+        {
+            std::size_t LengthSize = 1;
+            while (LengthSize < 8 && (Current.Length >> (LengthSize * 8)))
+            {
+                ++LengthSize;
+            }
+
+            std::size_t DeltaSize = 0;
+            std::int64_t Delta = 0;
+            if (Current.Lcn != SparseLcn)
+            {
+                Delta = static_cast<std::int64_t>(Current.Lcn) - Previous;
+                Previous = static_cast<std::int64_t>(Current.Lcn);
+                DeltaSize = 1;
+                while (DeltaSize < 8)
+                {
+                    std::int64_t Limit = std::int64_t(1) << (DeltaSize * 8 - 1);
+                    if (Delta >= -Limit && Delta < Limit)
+                    {
+                        break;
+                    }
+                    ++DeltaSize;
+                }
+            }
+
+            Result.push_back(static_cast<std::uint8_t>(
+                LengthSize | (DeltaSize << 4)));
+            for (std::size_t i = 0; i < LengthSize; ++i)
+            {
+                Result.push_back(
+                    static_cast<std::uint8_t>(Current.Length >> (i * 8)));
+            }
+            for (std::size_t i = 0; i < DeltaSize; ++i)
+            {
+                Result.push_back(static_cast<std::uint8_t>(
+                    static_cast<std::uint64_t>(Delta) >> (i * 8)));
+            }
+        }
+        Result.push_back(0);
+        return Result;
+    }
+
+    Bytes CreateResidentAttribute(
+        std::uint32_t Type,
+        Bytes const& Value,
+        std::u16string const& Name = std::u16string())
+    {
+        const std::size_t ValueOffset = ::AlignUp(24 + Name.size() * 2, 8);
+        Bytes Attribute(::AlignUp(ValueOffset + Value.size(), 8));
+        ::Store(Attribute, 0, Type, 4);
+        ::Store(Attribute, 4, Attribute.size(), 4);
+        ::Store(Attribute, 9, Name.size(), 1);
+        ::Store(Attribute, 10, 24, 2);
+        ::Store(Attribute, 16, Value.size(), 4);
+        ::Store(Attribute, 20, ValueOffset, 2);
+        for (std::size_t i = 0; i < Name.size(); ++i)
+        {
+            ::Store(Attribute, 24 + i * 2, Name[i], 2);
+        }
+        std::copy(Value.begin(), Value.end(), Attribute.begin() + ValueOffset);
+        return Attribute;
+    }
+
+    Bytes CreateNonResidentAttribute(
+        std::uint32_t Type,
+        std::uint64_t FirstVcn,
+        std::vector<Extent> const& Runs,
+        std::uint64_t AllocationSize,
+        std::uint64_t Size,
+        std::uint16_t Flags = 0,
+        std::uint64_t CompressedSize = 0)
+    {
+        std::uint64_t Clusters = 0;
+        for (Extent const& Current : Runs)
+        {
+            Clusters += Current.Length;
+        }
+
+        const std::size_t HeaderSize =
+            (Flags & (CompressedAttribute | SparseAttribute)) ? 72 : 64;
+        Bytes Encoded = ::EncodeRuns(Runs);
+        Bytes Attribute(::AlignUp(HeaderSize + Encoded.size(), 8));
+        ::Store(Attribute, 0, Type, 4);
+        ::Store(Attribute, 4, Attribute.size(), 4);
+        ::Store(Attribute, 8, 1, 1);
+        ::Store(Attribute, 10, HeaderSize, 2);
+        ::Store(Attribute, 12, Flags, 2);
+        ::Store(Attribute, 16, FirstVcn, 8);
+        ::Store(Attribute, 24, FirstVcn + Clusters - 1, 8);
+        ::Store(Attribute, 32, HeaderSize, 2);
+        ::Store(Attribute, 34, (Flags & CompressedAttribute) ? 4 : 0, 2);
+        ::Store(Attribute, 40, AllocationSize, 8);
+        ::Store(Attribute, 48, Size, 8);
+        ::Store(Attribute, 56, Size, 8);
+        if (HeaderSize == 72)
+        {
+            ::Store(Attribute, 64, CompressedSize, 8);
+        }
+        std::copy(Encoded.begin(), Encoded.end(), Attribute.begin() + HeaderSize);
+        return Attribute;
+    }
+
+    /**
+     * Creates an entry of an attribute list, which names the record holding
+     * an attribute or the part of it starting at a VCN.
+     */
+    Bytes CreateAttributeListEntry(
+        std::uint32_t Type,
+        std::uint64_t FirstVcn,
+        std::uint64_t Reference)
+    {
+        Bytes Entry(32);
+        ::Store(Entry, 0, Type, 4);
+        ::Store(Entry, 4, Entry.size(), 2);
+        ::Store(Entry, 7, 26, 1);
+        ::Store(Entry, 8, FirstVcn, 8);
+        ::Store(Entry, 16, Reference, 8);
+        return Entry;
+    }
+
+    /**
+     * A file record of an image.
+     */
+    struct ImageRecord
+    {
+        bool InUse = false;
+        bool Directory = false;
+        std::uint16_t Sequence = 1;
+
+        /**
+         * The reference to the base record of an extension record.
+         */
+        std::uint64_t Base = 0;
+
+        std::vector<Bytes> Attributes;
+
+        /**
+         * Breaks the update sequence of the second sector, as a write which
+         * has been interrupted does.
+         */
+        bool Torn = false;
+
+        /**
+         * The bytes of a record which is not built from the fields above.
+         */
+        Bytes Raw;
+    };
+
+    /**
+     * Builds an NTFS image with 512-byte sectors and 1024-byte records.
+     */
+    class ImageBuilder
+    {
+    private:
+
+        std::uint32_t m_ClusterSize;
+        std::vector<Extent> m_Table;
+        std::vector<ImageRecord> m_Records;
+        std::vector<std::pair<std::uint64_t, Bytes>> m_Clusters;
+
+        /**
+         * Retrieves the extent and the offset in it of a byte of the table.
+         */
+        Extent const& Locate(
+            std::uint64_t Offset,
+            std::uint64_t& ExtentOffset) const
+        {
+            std::uint64_t Start = 0;
+            for (Extent const& Current : this->m_Table)
+            {
+                std::uint64_t Size = Current.Length * this->m_ClusterSize;
+                if (Offset < Start + Size)
+                {
+                    ExtentOffset = Offset - Start;
+                    return Current;
+                }
+                Start += Size;
+            }
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "Offset < TableSize");
+            ExtentOffset = 0;
+            return this->m_Table.front();
+        }
+
+        bool IsSparseRecord(
+            std::size_t Number) const
+        {
+            for (std::uint64_t Offset = Number * RecordSize;
+                Offset < (Number + 1) * RecordSize;
+                Offset += SectorSize)
+            {
+                std::uint64_t ExtentOffset = 0;
+                if (this->Locate(Offset, ExtentOffset).Lcn == SparseLcn)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        Bytes BuildRecord(
+            ImageRecord const& Record) const
+        {
+            if (!Record.Raw.empty())
+            {
+                Bytes Result = Record.Raw;
+                Result.resize(RecordSize);
+                return Result;
+            }
+
+            Bytes Result(RecordSize);
+            if (!Record.InUse && Record.Attributes.empty())
+            {
+                return Result;
+            }
+
+            const std::size_t UpdateSequenceOffset = 48;
+            const std::size_t UpdateSequenceCount = RecordSize / 512 + 1;
+            std::size_t Offset = ::AlignUp(
+                UpdateSequenceOffset + UpdateSequenceCount * 2,
+                8);
+
+            ::Store(Result, 0, 0x454C4946, 4);
+            ::Store(Result, 4, UpdateSequenceOffset, 2);
+            ::Store(Result, 6, UpdateSequenceCount, 2);
+            ::Store(Result, 16, Record.Sequence, 2);
+            ::Store(Result, 18, 1, 2);
+            ::Store(Result, 20, Offset, 2);
+            ::Store(
+                Result,
+                22,
+                (Record.InUse ? 0x0001 : 0) | (Record.Directory ? 0x0002 : 0),
+                2);
+            ::Store(Result, 28, RecordSize, 4);
+            ::Store(Result, 32, Record.Base, 8);
+
+            for (Bytes const& Attribute : Record.Attributes)
+            {
+                if (Offset + Attribute.size() + 8 > RecordSize)
+                {
+                    NSudoTest::ReportFailure(
+                        __FILE__,
+                        __LINE__,
+                        "The attributes fit in the record");
+                    break;
+                }
+                std::copy(
+                    Attribute.begin(),
+                    Attribute.end(),
+                    Result.begin() + Offset);
+                Offset += Attribute.size();
+            }
+            ::Store(Result, Offset, 0xFFFFFFFF, 4);
+            ::Store(Result, 24, Offset + 8, 4);
+
+            // The last two bytes of every 512 bytes are moved to the array,
+            // and replaced by the update sequence number.
+            const std::uint16_t UpdateSequenceNumber = 0x0003;
+            ::Store(Result, UpdateSequenceOffset, UpdateSequenceNumber, 2);
+            for (std::size_t i = 1; i < UpdateSequenceCount; ++i)
+            {
+                std::size_t End = i * 512 - 2;
+                Result[UpdateSequenceOffset + i * 2] = Result[End];
+                Result[UpdateSequenceOffset + i * 2 + 1] = Result[End + 1];
+                ::Store(Result, End, UpdateSequenceNumber, 2);
+            }
+            if (Record.Torn)
+            {
+                Result[RecordSize - 2] ^= 0xFF;
+            }
+            return Result;
+        }
+
+    public:
+
+        /**
+         * Creates an image with the metadata files and the root directory.
+         *
+         * @param ClusterSize The size of a cluster, in bytes.
+         * @param RecordCount The number of records of the table.
+         * @param Table The extents of the table, or an empty vector for a
+         *              table in one extent after the boot sector.
+         */
+        ImageBuilder(
+            std::uint32_t ClusterSize,
+            std::size_t RecordCount,
+            std::vector<Extent> const& Table = std::vector<Extent>()) :
+            m_ClusterSize(ClusterSize),
+            m_Table(Table),
+            m_Records(RecordCount)
+        {
+            if (this->m_Table.empty())
+            {
+                this->m_Table.push_back(Extent{
+                    8192 / ClusterSize,
+                    (RecordCount * RecordSize + ClusterSize - 1) /
+                        ClusterSize });
+            }
+
+            static char16_t const* const MetadataNames[] =
+            {
+                u"$MFT",
+                u"$MFTMirr",
+                u"$LogFile",
+                u"$Volume",
+                u"$AttrDef",
+                u".",
+                u"$Bitmap",
+                u"$Boot",
+                u"$BadClus",
+                u"$Secure",
+                u"$UpCase",
+                u"$Extend",
+            };
+            for (std::size_t i = 0; i <= ExtendDirectory; ++i)
+            {
+                ImageRecord& Record = this->m_Records[i];
+                Record.InUse = true;
+                Record.Directory =
+                    i == RootDirectory || i == ExtendDirectory;
+                if (i)
+                {
+                    this->AddStandardInformation(
+                        i,
+                        HiddenSystemFileAttributes);
+                    this->AddName(
+                        i,
+                        this->GetReference(RootDirectory),
+                        MetadataNames[i],
+                        Win32AndDosNamespace);
+                }
+            }
+        }
+
+        std::uint32_t GetClusterSize() const
+        {
+            return this->m_ClusterSize;
+        }
+
+        std::vector<Extent> const& GetTable() const
+        {
+            return this->m_Table;
+        }
+
+        ImageRecord& GetRecord(
+            std::size_t Number)
+        {
+            return this->m_Records[Number];
+        }
+
+        std::uint64_t GetReference(
+            std::size_t Number) const
+        {
+            return Number |
+                (static_cast<std::uint64_t>(
+                    this->m_Records[Number].Sequence) << 48);
+        }
+
+        /**
+         * Marks a record as used.
+         *
+         * @param Number The number of the record, or 0 for the first record
+         *               of a user file which is not used and not in a sparse
+         *               run of the table.
+         * @return The number of the record.
+         */
+        std::size_t AllocateRecord(
+            std::size_t Number = 0)
+        {
+            if (!Number)
+            {
+                Number = FirstUserRecord;
+                while (this->m_Records[Number].InUse ||
+                    !this->m_Records[Number].Attributes.empty() ||
+                    this->IsSparseRecord(Number))
+                {
+                    ++Number;
+                }
+            }
+            this->m_Records[Number].InUse = true;
+            return Number;
+        }
+
+        void AddStandardInformation(
+            std::size_t Number,
+            std::uint32_t FileAttributes)
+        {
+            Bytes Value(48);
+            ::Store(Value, 32, FileAttributes, 4);
+            this->m_Records[Number].Attributes.push_back(
+                ::CreateResidentAttribute(StandardInformationType, Value));
+        }
+
+        void AddName(
+            std::size_t Number,
+            std::uint64_t ParentReference,
+            std::u16string const& Name,
+            std::uint8_t Namespace = Win32Namespace)
+        {
+            Bytes Value(66 + Name.size() * 2);
+            ::Store(Value, 0, ParentReference, 8);
+            ::Store(Value, 64, Name.size(), 1);
+            ::Store(Value, 65, Namespace, 1);
+            for (std::size_t i = 0; i < Name.size(); ++i)
+            {
+                ::Store(Value, 66 + i * 2, Name[i], 2);
+            }
+            this->m_Records[Number].Attributes.push_back(
+                ::CreateResidentAttribute(FileNameType, Value));
+        }
+
+        void AddResidentData(
+            std::size_t Number,
+            std::size_t Size,
+            std::u16string const& StreamName = std::u16string())
+        {
+            this->m_Records[Number].Attributes.push_back(
+                ::CreateResidentAttribute(
+                    DataType,
+                    Bytes(Size, 'x'),
+                    StreamName));
+        }
+
+        /**
+         * Adds a non-resident $DATA attribute, whose clusters are sparse.
+         */
+        void AddNonResidentData(
+            std::size_t Number,
+            std::uint64_t Size,
+            std::uint16_t Flags = 0,
+            std::uint64_t CompressedSize = 0)
+        {
+            std::uint64_t Clusters =
+                (Size + this->m_ClusterSize - 1) / this->m_ClusterSize;
+            this->m_Records[Number].Attributes.push_back(
+                ::CreateNonResidentAttribute(
+                    DataType,
+                    0,
+                    { Extent{ SparseLcn, Clusters } },
+                    Clusters * this->m_ClusterSize,
+                    Size,
+                    Flags,
+                    CompressedSize));
+        }
+
+        std::size_t AddDirectory(
+            std::size_t Parent,
+            std::u16string const& Name,
+            std::uint32_t FileAttributes = 0)
+        {
+            std::size_t Number = this->AllocateRecord();
+            this->m_Records[Number].Directory = true;
+            this->AddStandardInformation(Number, FileAttributes);
+            this->AddName(Number, this->GetReference(Parent), Name);
+            return Number;
+        }
+
+        /**
+         * Adds a file, whose data is in its record if it is small.
+         */
+        std::size_t AddFile(
+            std::size_t Parent,
+            std::u16string const& Name,
+            std::uint64_t Size,
+            std::size_t Number = 0)
+        {
+            Number = this->AllocateRecord(Number);
+            this->AddStandardInformation(Number, 0);
+            this->AddName(Number, this->GetReference(Parent), Name);
+            if (Size <= 256)
+            {
+                this->AddResidentData(Number, static_cast<std::size_t>(Size));
+            }
+            else
+            {
+                this->AddNonResidentData(Number, Size);
+            }
+            return Number;
+        }
+
+        /**
+         * Creates the $DATA attribute of the table, or the part of it which
+         * maps some of its extents.
+         */
+        Bytes CreateTableData(
+            std::size_t FirstExtent,
+            std::size_t ExtentCount) const
+        {
+            std::uint64_t FirstVcn = 0;
+            for (std::size_t i = 0; i < FirstExtent; ++i)
+            {
+                FirstVcn += this->m_Table[i].Length;
+            }
+            std::uint64_t Clusters = 0;
+            for (Extent const& Current : this->m_Table)
+            {
+                Clusters += Current.Length;
+            }
+
+            // Only the first part has the sizes of the attribute.
+            return ::CreateNonResidentAttribute(
+                DataType,
+                FirstVcn,
+                std::vector<Extent>(
+                    this->m_Table.begin() + FirstExtent,
+                    this->m_Table.begin() + FirstExtent + ExtentCount),
+                FirstVcn ? 0 : Clusters * this->m_ClusterSize,
+                FirstVcn ? 0 : this->m_Records.size() * RecordSize);
+        }
+
+        /**
+         * Writes data which is not in the table, such as a non-resident
+         * attribute list.
+         */
+        void WriteClusters(
+            std::uint64_t Lcn,
+            Bytes const& Data)
+        {
+            this->m_Clusters.emplace_back(Lcn, Data);
+        }
+
+        /**
+         * Writes the image. The record of the table has a $DATA attribute
+         * which maps all extents unless it has attributes.
+         */
+        void Write(
+            std::string const& Path) const
+        {
+            Bytes Image(4096);
+            ::Store(Image, 0, 0x9052EB, 3);
+            std::copy_n("NTFS    ", 8, Image.begin() + 3);
+            ::Store(Image, 11, SectorSize, 2);
+            ::Store(Image, 13, this->m_ClusterSize / SectorSize, 1);
+            ::Store(Image, 48, this->m_Table.front().Lcn, 8);
+            ::Store(Image, 64, 0xF6, 1);
+            ::Store(Image, 510, 0xAA55, 2);
+
+            auto WriteAt = [&Image](
+                std::uint64_t Offset,
+                std::uint8_t const* Data,
+                std::size_t Size)
+            {
+                if (Image.size() < Offset + Size)
+                {
+                    Image.resize(static_cast<std::size_t>(Offset + Size));
+                }
+                std::copy(Data, Data + Size, Image.begin() + Offset);
+            };
+
+            for (std::size_t Number = 0;
+                Number < this->m_Records.size();
+                ++Number)
+            {
+                ImageRecord Record = this->m_Records[Number];
+                if (!Number && Record.Attributes.empty())
+                {
+                    Bytes Value(48);
+                    ::Store(Value, 32, HiddenSystemFileAttributes, 4);
+                    Record.Attributes.push_back(::CreateResidentAttribute(
+                        StandardInformationType,
+                        Value));
+                    Value.assign(66 + 8, 0);
+                    ::Store(Value, 0, this->GetReference(RootDirectory), 8);
+                    ::Store(Value, 64, 4, 1);
+                    ::Store(Value, 65, Win32AndDosNamespace, 1);
+                    for (std::size_t i = 0; i < 4; ++i)
+                    {
+                        ::Store(Value, 66 + i * 2, "$MFT"[i], 2);
+                    }
+                    Record.Attributes.push_back(::CreateResidentAttribute(
+                        FileNameType,
+                        Value));
+                    Record.Attributes.push_back(
+                        this->CreateTableData(0, this->m_Table.size()));
+                }
+
+                Bytes Content = this->BuildRecord(Record);
+                for (std::size_t Offset = 0; Offset < RecordSize;)
+                {
+                    std::uint64_t ExtentOffset = 0;
+                    Extent const& Current = this->Locate(
+                        Number * RecordSize + Offset,
+                        ExtentOffset);
+                    std::size_t Size = static_cast<std::size_t>((std::min)(
+                        static_cast<std::uint64_t>(RecordSize - Offset),
+                        Current.Length * this->m_ClusterSize - ExtentOffset));
+                    if (Current.Lcn == SparseLcn)
+                    {
+                        // A sparse run of the table reads as unused records.
+                        NSUDO_TEST_CHECK(std::all_of(
+                            Content.begin() + Offset,
+                            Content.begin() + Offset + Size,
+                            [](std::uint8_t Value) { return !Value; }));
+                    }
+                    else
+                    {
+                        WriteAt(
+                            Current.Lcn * this->m_ClusterSize + ExtentOffset,
+                            Content.data() + Offset,
+                            Size);
+                    }
+                    Offset += Size;
+                }
+            }
+
+            for (auto const& Current : this->m_Clusters)
+            {
+                WriteAt(
+                    Current.first * this->m_ClusterSize,
+                    Current.second.data(),
+                    Current.second.size());
+            }
+
+            Image.resize(::AlignUp(Image.size(), this->m_ClusterSize));
+            NSudoTest::WriteFile(Path, std::string(Image.begin(), Image.end()));
+        }
+    };
+
+    /**
+     * The volume of Basic.txt: nested directories, resident, non-resident,
+     * compressed and sparse data, named streams, hard links, the name
+     * namespaces, reparse points and a deleted file.
+     */
+    ImageBuilder CreateBasicImage()
+    {
+        ImageBuilder Image(4096, 64);
+
+        std::size_t Documents = Image.AddDirectory(RootDirectory, u"Documents");
+        std::size_t Report = Image.AddFile(Documents, u"Report.docx", 20000);
+        Image.AddFile(Documents, u"Notes.txt", 100);
+        Image.AddFile(Documents, u"Ünïcödé 文件 "
+            u"\U0001F600.txt", 0);
+        Image.AddFile(Documents, u"Bad\xD800Name.txt", 1);
+
+        // Each hard link is an entry of its directory.
+        std::size_t Shared = Image.AddDirectory(RootDirectory, u"Shared");
+        Image.AddName(Report, Image.GetReference(Shared), u"Report.docx");
+        Image.AddName(
+            Report,
+            Image.GetReference(RootDirectory),
+            u"Report (Link).docx",
+            PosixNamespace);
+
+        // The short name comes first in the record.
+        std::size_t LongName = Image.AllocateRecord();
+        Image.AddStandardInformation(LongName, 0);
+        Image.AddName(
+            LongName,
+            Image.GetReference(RootDirectory),
+            u"LONGFI~1.TXT",
+            DosNamespace);
+        Image.AddName(
+            LongName,
+            Image.GetReference(RootDirectory),
+            u"Long File Name.txt");
+        Image.AddResidentData(LongName, 5);
+
+        std::size_t ShortName = Image.AllocateRecord();
+        Image.AddStandardInformation(ShortName, 0);
+        Image.AddName(
+            ShortName,
+            Image.GetReference(RootDirectory),
+            u"SHORT.TXT",
+            DosNamespace);
+        Image.AddResidentData(ShortName, 7);
+
+        std::size_t Both = Image.AllocateRecord();
+        Image.AddStandardInformation(Both, 0);
+        Image.AddName(
+            Both,
+            Image.GetReference(RootDirectory),
+            u"BOTH.TXT",
+            Win32AndDosNamespace);
+        Image.AddResidentData(Both, 8);
+
+        std::size_t Compressed = Image.AllocateRecord();
+        Image.AddStandardInformation(Compressed, 0);
+        Image.AddName(
+            Compressed,
+            Image.GetReference(RootDirectory),
+            u"Compressed.bin");
+        Image.AddNonResidentData(
+            Compressed,
+            1048576,
+            CompressedAttribute,
+            65536);
+
+        std::size_t Sparse = Image.AllocateRecord();
+        Image.AddStandardInformation(Sparse, 0);
+        Image.AddName(
+            Sparse,
+            Image.GetReference(RootDirectory),
+            u"Sparse.vhd");
+        Image.AddNonResidentData(Sparse, 1ULL << 30, SparseAttribute, 4096);
+
+        // Only the unnamed stream is the size of the file.
+        std::size_t Stream = Image.AllocateRecord();
+        Image.AddStandardInformation(Stream, 0);
+        Image.AddName(
+            Stream,
+            Image.GetReference(RootDirectory),
+            u"Stream.txt");
+        Image.AddResidentData(Stream, 26, u"Zone.Identifier");
+        Image.AddResidentData(Stream, 10);
+
+        // The target of a junction is not walked.
+        std::size_t Junction = Image.AddDirectory(
+            RootDirectory,
+            u"Junction",
+            ReparsePointFileAttribute);
+        Image.AddFile(Junction, u"Hidden.txt", 1);
+
+        std::size_t Link = Image.AllocateRecord();
+        Image.AddStandardInformation(Link, ReparsePointFileAttribute);
+        Image.AddName(Link, Image.GetReference(RootDirectory), u"Symlink.txt");
+
+        std::size_t Deleted = Image.AddFile(RootDirectory, u"Deleted.txt", 1);
+        Image.GetRecord(Deleted).InUse = false;
+
+        Image.AddDirectory(RootDirectory, u"Empty");
+        Image.AddFile(ExtendDirectory, u"$ObjId", 0);
+
+        return Image;
+    }
+
+    /**
+     * The volume of Fragmented.txt, whose table has 512-byte clusters in
+     * extents out of order, a sparse run, and records which cross the end
+     * of an extent.
+     */
+    ImageBuilder CreateFragmentedImage()
+    {
+        // The records 2 and 19 cross the ends of extents, and the records
+        // 16 and 17 are in the sparse run.
+        ImageBuilder Image(512, 64, {
+            Extent{ 200, 5 },
+            Extent{ 40, 7 },
+            Extent{ 300, 20 },
+            Extent{ SparseLcn, 4 },
+            Extent{ 500, 3 },
+            Extent{ 1000, 89 } });
+
+        std::size_t Logs = Image.AddDirectory(RootDirectory, u"Logs");
+        for (std::uint64_t i = 1; i <= 10; ++i)
+        {
+            Image.AddFile(
+                Logs,
+                u"Log" + ::ToName(std::to_string(i)) + u".txt",
+                i * 1000);
+        }
+        std::size_t Archive = Image.AddDirectory(Logs, u"Archive");
+        for (std::uint64_t i = 1; i <= 10; ++i)
+        {
+            Image.AddFile(
+                Archive,
+                u"Old" + ::ToName(std::to_string(i)) + u".txt",
+                i * 100);
+        }
+        Image.AddFile(RootDirectory, u"Last.bin", 65536, 63);
+        Image.AddFile(Archive, u"BeforeLast.bin", 512, 62);
+
+        return Image;
+    }
+
+    /**
+     * The volume of AttributeList.txt, whose table is mapped by an
+     * attribute list, and whose files have attributes in extension records.
+     */
+    ImageBuilder CreateAttributeListImage(
+        bool ResidentList)
+    {
+        // The first extent holds the records 0 to 31.
+        ImageBuilder Image(4096, 256, {
+            Extent{ 10, 8 },
+            Extent{ 100, 20 },
+            Extent{ 50, 16 },
+            Extent{ 200, 20 } });
+
+        // The other extents are mapped by two extension records, the
+        // second of which has two parts of the attribute.
+        const std::size_t FirstExtension = 20;
+        const std::size_t SecondExtension = 21;
+        for (std::size_t Number : { FirstExtension, SecondExtension })
+        {
+            ImageRecord& Record = Image.GetRecord(Image.AllocateRecord(Number));
+            Record.Base = Image.GetReference(0);
+        }
+        Image.GetRecord(FirstExtension).Attributes.push_back(
+            Image.CreateTableData(1, 1));
+        Image.GetRecord(SecondExtension).Attributes.push_back(
+            Image.CreateTableData(2, 1));
+        Image.GetRecord(SecondExtension).Attributes.push_back(
+            Image.CreateTableData(3, 1));
+
+        Bytes List;
+        auto AddEntry = [&List](
+            std::uint32_t Type,
+            std::uint64_t FirstVcn,
+            std::uint64_t Reference)
+        {
+            Bytes Entry = ::CreateAttributeListEntry(Type, FirstVcn, Reference);
+            List.insert(List.end(), Entry.begin(), Entry.end());
+        };
+        AddEntry(StandardInformationType, 0, Image.GetReference(0));
+        AddEntry(FileNameType, 0, Image.GetReference(0));
+        AddEntry(DataType, 0, Image.GetReference(0));
+        AddEntry(DataType, 8, Image.GetReference(FirstExtension));
+        AddEntry(DataType, 28, Image.GetReference(SecondExtension));
+        AddEntry(DataType, 44, Image.GetReference(SecondExtension));
+
+        ImageRecord& Table = Image.GetRecord(0);
+        Bytes Value(48);
+        Table.Attributes.push_back(
+            ::CreateResidentAttribute(StandardInformationType, Value));
+        if (ResidentList)
+        {
+            Table.Attributes.push_back(
+                ::CreateResidentAttribute(AttributeListType, List));
+        }
+        else
+        {
+            const std::uint64_t ListLcn = 300;
+            Image.WriteClusters(ListLcn, List);
+            Table.Attributes.push_back(::CreateNonResidentAttribute(
+                AttributeListType,
+                0,
+                { Extent{ ListLcn, 1 } },
+                Image.GetClusterSize(),
+                List.size()));
+        }
+        Image.AddName(0, Image.GetReference(RootDirectory), u"$MFT");
+        Table.Attributes.push_back(Image.CreateTableData(0, 1));
+
+        Image.AddFile(RootDirectory, u"First.txt", 1);
+        std::size_t Directory = Image.AddDirectory(RootDirectory, u"Far");
+        Image.AddFile(Directory, u"Second.txt", 2, 100);
+        Image.AddFile(Directory, u"Third.txt", 3, 190);
+        Image.AddFile(RootDirectory, u"Fourth.txt", 4, 255);
+
+        // The name of a file is in an extension record, which comes after
+        // its base record.
+        std::size_t Base = Image.AllocateRecord(120);
+        Image.AddStandardInformation(Base, 0);
+        Image.AddNonResidentData(Base, 50000);
+        std::size_t Extension = Image.AllocateRecord(121);
+        Image.GetRecord(Extension).Base = Image.GetReference(Base);
+        Image.AddName(Extension, Image.GetReference(RootDirectory), u"Split.bin");
+
+        // The data of a file is in an extension record, which comes before
+        // its base record.
+        Extension = Image.AllocateRecord(130);
+        Base = Image.AllocateRecord(131);
+        Image.GetRecord(Extension).Base = Image.GetReference(Base);
+        Image.AddNonResidentData(Extension, 7000);
+        Image.AddStandardInformation(Base, 0);
+        Image.AddName(Base, Image.GetReference(Directory), u"SplitData.bin");
+
+        // A directory whose name is in an extension record.
+        Base = Image.AllocateRecord(140);
+        Image.GetRecord(Base).Directory = true;
+        Image.AddStandardInformation(Base, 0);
+        Extension = Image.AllocateRecord(141);
+        Image.GetRecord(Extension).Base = Image.GetReference(Base);
+        Image.AddName(Extension, Image.GetReference(Directory), u"Deep");
+        Image.AddFile(Base, u"Fifth.txt", 5, 230);
+
+        return Image;
+    }
+
+    /**
+     * The volume of Damaged.txt, whose records fail their checks or have
+     * names whose parents do not exist.
+     */
+    ImageBuilder CreateDamagedImage()
+    {
+        ImageBuilder Image(4096, 64);
+
+        std::size_t Good = Image.AddFile(RootDirectory, u"Good.txt", 5);
+
+        // The records of an interrupted write are skipped, and so are the
+        // names whose parent is one of them.
+        std::size_t Torn = Image.AddFile(RootDirectory, u"Torn.txt", 1);
+        Image.GetRecord(Torn).Torn = true;
+        std::size_t TornDirectory = Image.AddDirectory(
+            RootDirectory,
+            u"TornDirectory");
+        Image.GetRecord(TornDirectory).Torn = true;
+        Image.AddFile(TornDirectory, u"Child.txt", 1);
+
+        // A directory whose record has been reused since the name of a file
+        // was written.
+        std::size_t Reused = Image.AllocateRecord();
+        Image.GetRecord(Reused).Sequence = 5;
+        Image.GetRecord(Reused).Directory = true;
+        Image.AddStandardInformation(Reused, 0);
+        Image.AddName(Reused, Image.GetReference(RootDirectory), u"Reused");
+        Image.AddFile(Reused, u"Fresh.txt", 3);
+        std::size_t Stale = Image.AllocateRecord();
+        Image.AddStandardInformation(Stale, 0);
+        Image.AddName(
+            Stale,
+            (Image.GetReference(Reused) & 0x0000FFFFFFFFFFFFULL) |
+                (4ULL << 48),
+            u"Stale.txt");
+
+        // Parents which are not in use, beyond the table, or files.
+        Image.AddFile(60, u"Lost.txt", 1);
+        std::size_t Beyond = Image.AllocateRecord();
+        Image.AddStandardInformation(Beyond, 0);
+        Image.AddName(Beyond, (1ULL << 48) | 1000, u"Beyond.txt");
+        Image.AddFile(Good, u"UnderFile.txt", 1);
+
+        // Directories which are each other's parent are never reached.
+        std::size_t First = Image.AllocateRecord();
+        std::size_t Second = Image.AllocateRecord();
+        for (std::size_t Number : { First, Second })
+        {
+            Image.GetRecord(Number).Directory = true;
+            Image.AddStandardInformation(Number, 0);
+        }
+        Image.AddName(First, Image.GetReference(Second), u"LoopA");
+        Image.AddName(Second, Image.GetReference(First), u"LoopB");
+        Image.AddFile(First, u"InLoop.txt", 1);
+
+        // A record whose signature is not FILE.
+        std::size_t Bad = Image.AllocateRecord();
+        Image.GetRecord(Bad).Raw = Bytes{ 'B', 'A', 'A', 'D' };
+
+        // An attribute whose length is not a multiple of 8, before the name.
+        std::size_t Malformed = Image.AllocateRecord();
+        Image.AddStandardInformation(Malformed, 0);
+        Bytes Attribute(24);
+        ::Store(Attribute, 0, 0x40, 4);
+        ::Store(Attribute, 4, 20, 4);
+        Image.GetRecord(Malformed).Attributes.push_back(Attribute);
+        Image.AddName(
+            Malformed,
+            Image.GetReference(RootDirectory),
+            u"Malformed.txt");
+
+        // An extension record of a base record beyond the table.
+        std::size_t Extension = Image.AllocateRecord();
+        Image.GetRecord(Extension).Base = (1ULL << 48) | 5000;
+        Image.AddName(
+            Extension,
+            Image.GetReference(RootDirectory),
+            u"BadBase.txt");
+
+        // A name longer than its attribute.
+        std::size_t LongName = Image.AllocateRecord();
+        Image.AddStandardInformation(LongName, 0);
+        Image.AddName(
+            LongName,
+            Image.GetReference(RootDirectory),
+            u"BadName.txt");
+        Image.GetRecord(LongName).Attributes.back()[24 + 64] = 200;
+
+        return Image;
+    }
+
+    /**
+     * The entries a scan reports, one line each in the form of the expected
+     * listings.
+     */
+    struct ScanOutput
+    {
+        bool Completed = false;
+        NSudoSweeper::MftScannerError Error;
+        NSudoSweeper::MftScannerStatistics Statistics;
+        std::vector<std::string> Lines;
+    };
+
+    std::string FormatItem(
+        NSudoSweeper::TreeWalkerItem const& Item)
+    {
+        char const* Type = "Other";
+        switch (Item.Type)
+        {
+        case Mile::FileEntryType::File:
+            Type = "File";
+            break;
+        case Mile::FileEntryType::Directory:
+            Type = "Directory";
+            break;
+        case Mile::FileEntryType::Link:
+            Type = "Link";
+            break;
+        default:
+            break;
+        }
+
+        char Buffer[128];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "%llu:%llu %s %llu %llu ",
+            static_cast<unsigned long long>(Item.FileId & 0xFFFFFFFFFFFFULL),
+            static_cast<unsigned long long>(Item.FileId >> 48),
+            Type,
+            static_cast<unsigned long long>(Item.Size),
+            static_cast<unsigned long long>(Item.AllocationSize));
+        return Buffer + Item.Path;
+    }
+
+    ScanOutput ScanImage(
+        std::string const& Path,
+        NSudoSweeper::MftScannerOptions const& Options =
+            NSudoSweeper::MftScannerOptions(),
+        NSudoSweeper::MftScannerFilter Filter = nullptr)
+    {
+        ScanOutput Output;
+        NSudoSweeper::MftScanner Scanner(Options);
+        if (!NSUDO_TEST_CHECK(Scanner.Open(Path, Output.Error)))
+        {
+            return Output;
+        }
+        if (Filter)
+        {
+            Scanner.AddFilter(Filter);
+        }
+        Scanner.SetBatchHandler([&Output, &Options](
+            std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+        {
+            NSUDO_TEST_CHECK(Batch.size() <= Options.BatchSize);
+            for (NSudoSweeper::TreeWalkerItem const& Item : Batch)
+            {
+                Output.Lines.push_back(::FormatItem(Item));
+            }
+        });
+        Output.Completed = Scanner.Scan(Output.Error);
+        Output.Statistics = Scanner.GetStatistics();
+        std::sort(Output.Lines.begin(), Output.Lines.end());
+        return Output;
+    }
+
+    /**
+     * Reads an expected listing of Data/Ntfs, without its comments.
+     */
+    std::vector<std::string> ReadListing(
+        std::string const& Name)
+    {
+        std::vector<std::string> Lines;
+        std::string Content;
+        if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+            NSudoTest::GetDataPath("Ntfs/" + Name + ".txt"),
+            Content)))
+        {
+            return Lines;
+        }
+
+        std::size_t Start = 0;
+        while (Start < Content.size())
+        {
+            std::size_t End = Content.find('\n', Start);
+            if (End == std::string::npos)
+            {
+                End = Content.size();
+            }
+            std::string Line = Content.substr(Start, End - Start);
+            if (!Line.empty() && Line[0] != '#')
+            {
+                Lines.push_back(Line);
+            }
+            Start = End + 1;
+        }
+        std::sort(Lines.begin(), Lines.end());
+        return Lines;
+    }
+
+    /**
+     * Checks the lines of a scan are the expected ones, and reports each
+     * missing and unexpected line.
+     */
+    void CheckLines(
+        std::vector<std::string> const& Lines,
+        std::vector<std::string> const& Expected,
+        std::string const& Name)
+    {
+        if (NSUDO_TEST_CHECK(Lines == Expected))
+        {
+            return;
+        }
+        for (std::string const& Line : Expected)
+        {
+            if (!std::binary_search(Lines.begin(), Lines.end(), Line))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Missing",
+                    Name + ": " + Line);
+            }
+        }
+        for (std::string const& Line : Lines)
+        {
+            if (!std::binary_search(Expected.begin(), Expected.end(), Line))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Unexpected",
+                    Name + ": " + Line);
+            }
+        }
+    }
+
+    /**
+     * Scans an image with reads of the default size, of one record, and of
+     * a size which is not a multiple of the clusters, and checks each scan
+     * lists the expected entries.
+     */
+    ScanOutput CheckListing(
+        ImageBuilder const& Image,
+        std::string const& Name)
+    {
+        NSudoTest::TemporaryDirectory Directory;
+        std::string Path = Directory.Join(Name + ".img");
+        Image.Write(Path);
+        std::vector<std::string> Expected = ::ReadListing(Name);
+
+        ScanOutput Output;
+        for (std::size_t ReadSize : { std::size_t(4 * 1024 * 1024),
+            std::size_t(1), std::size_t(3000) })
+        {
+            NSudoSweeper::MftScannerOptions Options;
+            Options.ReadSize = ReadSize;
+            Options.BatchSize = 4;
+            Output = ::ScanImage(Path, Options);
+            NSUDO_TEST_CHECK(Output.Completed);
+            NSUDO_TEST_CHECK(!Output.Error.Message);
+            ::CheckLines(
+                Output.Lines,
+                Expected,
+                Name + ", reads of " + std::to_string(ReadSize) + " bytes");
+            NSUDO_TEST_CHECK_EQUAL(
+                Output.Statistics.ReportedEntries,
+                Expected.size());
+        }
+        NSUDO_TEST_CHECK_EQUAL(Output.Statistics.RecordSize, RecordSize);
+        NSUDO_TEST_CHECK_EQUAL(
+            Output.Statistics.ClusterSize,
+            Image.GetClusterSize());
+        return Output;
+    }
+
+    void CheckOpenFails(
+        std::string const& Path,
+        std::string const& Message,
+        int SystemError = 0)
+    {
+        NSudoSweeper::MftScanner Scanner;
+        NSudoSweeper::MftScannerError Error;
+        NSUDO_TEST_CHECK(!Scanner.Open(Path, Error));
+        if (NSUDO_TEST_CHECK(Error.Message != nullptr))
+        {
+            NSUDO_TEST_CHECK_EQUAL(std::string(Error.Message), Message);
+        }
+        if (SystemError)
+        {
+            NSUDO_TEST_CHECK_EQUAL(Error.SystemError, SystemError);
+        }
+    }
+
+    void CheckScanFails(
+        std::string const& Path,
+        std::string const& Message)
+    {
+        NSudoSweeper::MftScanner Scanner;
+        NSudoSweeper::MftScannerError Error;
+        if (!NSUDO_TEST_CHECK(Scanner.Open(Path, Error)))
+        {
+            return;
+        }
+        NSUDO_TEST_CHECK(!Scanner.Scan(Error));
+        if (NSUDO_TEST_CHECK(Error.Message != nullptr))
+        {
+            NSUDO_TEST_CHECK_EQUAL(std::string(Error.Message), Message);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(BasicVolumeIsListed)
+{
+    ::ScanOutput Output = ::CheckListing(::CreateBasicImage(), "Basic");
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.Records, 64U);
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.DamagedRecords, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.OrphanedNames, 0U);
+}
+
+NSUDO_TEST_CASE(MetadataFilesAreListedOnRequest)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Basic.img");
+    ::CreateBasicImage().Write(Path);
+
+    NSudoSweeper::MftScannerOptions Options;
+    Options.IncludeMetadata = true;
+    ::ScanOutput Output = ::ScanImage(Path, Options);
+    NSUDO_TEST_CHECK(Output.Completed);
+
+    // The root directory is not an entry of itself, and the files below
+    // $Extend are only reached through it.
+    std::vector<std::string> Expected = ::ReadListing("Basic");
+    Expected.push_back("0:1 File 65536 65536 /$MFT");
+    Expected.push_back("1:1 File 0 0 /$MFTMirr");
+    Expected.push_back("2:1 File 0 0 /$LogFile");
+    Expected.push_back("3:1 File 0 0 /$Volume");
+    Expected.push_back("4:1 File 0 0 /$AttrDef");
+    Expected.push_back("6:1 File 0 0 /$Bitmap");
+    Expected.push_back("7:1 File 0 0 /$Boot");
+    Expected.push_back("8:1 File 0 0 /$BadClus");
+    Expected.push_back("9:1 File 0 0 /$Secure");
+    Expected.push_back("10:1 File 0 0 /$UpCase");
+    Expected.push_back("11:1 Directory 0 0 /$Extend");
+    Expected.push_back("33:1 File 0 0 /$Extend/$ObjId");
+    std::sort(Expected.begin(), Expected.end());
+    ::CheckLines(Output.Lines, Expected, "metadata");
+}
+
+NSUDO_TEST_CASE(FragmentedTableIsListed)
+{
+    ::ScanOutput Output = ::CheckListing(
+        ::CreateFragmentedImage(),
+        "Fragmented");
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.Records, 64U);
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.DamagedRecords, 0U);
+}
+
+NSUDO_TEST_CASE(AttributeListIsFollowed)
+{
+    for (bool ResidentList : { true, false })
+    {
+        ::ScanOutput Output = ::CheckListing(
+            ::CreateAttributeListImage(ResidentList),
+            "AttributeList");
+        NSUDO_TEST_CHECK_EQUAL(Output.Statistics.Records, 256U);
+        NSUDO_TEST_CHECK_EQUAL(Output.Statistics.DamagedRecords, 0U);
+        NSUDO_TEST_CHECK_EQUAL(Output.Statistics.OrphanedNames, 0U);
+    }
+}
+
+NSUDO_TEST_CASE(DamagedRecordsAreSkipped)
+{
+    ::ScanOutput Output = ::CheckListing(::CreateDamagedImage(), "Damaged");
+
+    // Torn.txt, TornDirectory, BAAD, Malformed.txt, BadBase.txt and
+    // BadName.txt.
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.DamagedRecords, 6U);
+
+    // Child.txt, Stale.txt, Lost.txt, Beyond.txt and UnderFile.txt.
+    NSUDO_TEST_CHECK_EQUAL(Output.Statistics.OrphanedNames, 5U);
+}
+
+NSUDO_TEST_CASE(DamagedVolumesAreRejected)
+{
+    NSudoTest::TemporaryDirectory Directory;
+
+    ::CheckOpenFails(
+        Directory.Join("Missing.img"),
+        "The volume cannot be opened",
+        ENOENT);
+
+    std::string Path = Directory.Join("Small.img");
+    NSudoTest::WriteFile(Path, std::string(100, '\0'));
+    ::CheckOpenFails(Path, "The boot sector cannot be read");
+
+    Path = Directory.Join("Zero.img");
+    NSudoTest::WriteFile(Path, std::string(65536, '\0'));
+    ::CheckOpenFails(Path, "The volume is not an NTFS volume");
+
+    // A table whose record is torn.
+    ::ImageBuilder Image = ::CreateBasicImage();
+    Image.GetRecord(0).Torn = true;
+    Path = Directory.Join("TornTable.img");
+    Image.Write(Path);
+    ::CheckOpenFails(Path, "The master file table is damaged");
+
+    // A table whose record maps the first of its extents.
+    Image = ::CreateFragmentedImage();
+    Image.GetRecord(0).Attributes.push_back(Image.CreateTableData(0, 1));
+    Path = Directory.Join("Unmapped.img");
+    Image.Write(Path);
+    ::CheckOpenFails(Path, "The master file table is damaged");
+
+    // A table which ends after the image.
+    Path = Directory.Join("Truncated.img");
+    ::CreateBasicImage().Write(Path);
+    std::string Content;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Content));
+    NSudoTest::WriteFile(Path, Content.substr(0, 40000));
+    ::CheckScanFails(Path, "The master file table cannot be read");
+
+    Image = ::CreateBasicImage();
+    Image.GetRecord(RootDirectory).Directory = false;
+    Path = Directory.Join("NoRoot.img");
+    Image.Write(Path);
+    ::CheckScanFails(Path, "The root directory is damaged");
+
+    NSudoSweeper::MftScanner Scanner;
+    NSudoSweeper::MftScannerError Error;
+    NSUDO_TEST_CHECK(!Scanner.Scan(Error));
+    if (NSUDO_TEST_CHECK(Error.Message != nullptr))
+    {
+        NSUDO_TEST_CHECK_EQUAL(
+            std::string(Error.Message),
+            "The volume is not open");
+    }
+}
+
+NSUDO_TEST_CASE(FiltersAndCancellationAreApplied)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Basic.img");
+    ::CreateBasicImage().Write(Path);
+
+    // A pruned directory is neither reported nor walked, and a skipped one
+    // is walked.
+    ::ScanOutput Output = ::ScanImage(
+        Path,
+        NSudoSweeper::MftScannerOptions(),
+        [](
+            Mile::NativeStringView DirectoryPath,
+            Mile::NativeStringView Name,
+            Mile::FileEntryType Type)
+    {
+        static_cast<void>(Type);
+        if (DirectoryPath == "/" && Name == "Documents")
+        {
+            return NSudoSweeper::TreeWalkerFilterResult::Prune;
+        }
+        if (DirectoryPath == "/" && Name == "Shared")
+        {
+            return NSudoSweeper::TreeWalkerFilterResult::Skip;
+        }
+        return NSudoSweeper::TreeWalkerFilterResult::Include;
+    });
+    std::vector<std::string> Expected;
+    for (std::string const& Line : ::ReadListing("Basic"))
+    {
+        if (Line.find(" /Documents") == std::string::npos &&
+            Line.compare(Line.size() - 8, 8, " /Shared") != 0)
+        {
+            Expected.push_back(Line);
+        }
+    }
+    NSUDO_TEST_CHECK(Output.Completed);
+    ::CheckLines(Output.Lines, Expected, "filtered");
+
+    // A canceled scan reports no error.
+    NSudoSweeper::MftScannerOptions Options;
+    Options.BatchSize = 1;
+    NSudoSweeper::MftScanner Scanner(Options);
+    NSudoSweeper::MftScannerError Error;
+    NSUDO_TEST_CHECK(Scanner.Open(Path, Error));
+    std::size_t Batches = 0;
+    Scanner.SetBatchHandler([&](
+        std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+    {
+        static_cast<void>(Batch);
+        ++Batches;
+        Scanner.Cancel();
+    });
+    NSUDO_TEST_CHECK(!Scanner.Scan(Error));
+    NSUDO_TEST_CHECK(!Error.Message);
+    NSUDO_TEST_CHECK(Batches < ::ReadListing("Basic").size());
+}
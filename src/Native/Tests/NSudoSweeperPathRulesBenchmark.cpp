@@ -0,0 +1,302 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRulesBenchmark.cpp
+ * PURPOSE:   Implementation for the compiled path rule automaton benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+#include "NSudoSweeperPathRulesReference.h"
+
+#include "NSudoSweeperPathRules.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char* const Components[] =
+    {
+        "home", "user", ".cache", "mozilla", "firefox", "profile", "cache2",
+        "entries", "var", "log", "journal", "tmp", "usr", "share", "doc",
+        "lib", "python3", "site-packages", "__pycache__", "node_modules",
+        "build", "obj", "Debug", "Release", "thumbnails", "large", "Trash",
+    };
+
+    const char* const Extensions[] =
+    {
+        ".log", ".tmp", ".pyc", ".o", ".png", ".json", ".txt", ".1", ".gz",
+        ".old", ".bak", ".dmp", ".etl", ".cab", ".so", ".js",
+    };
+
+    struct ReferenceRule
+    {
+        NSudoSweeper::PathRuleKind Kind;
+        std::uint32_t Group;
+        std::regex Expression;
+    };
+
+    /**
+     * Creates the rules of a set of cleanup handlers, which mostly select
+     * files by their directory and extension.
+     */
+    std::vector<std::pair<std::uint32_t, std::string>> CreateRules(
+        std::size_t Count)
+    {
+        std::mt19937 Generator(1);
+        std::uniform_int_distribution<std::size_t> PickComponent(
+            0,
+            sizeof(Components) / sizeof(*Components) - 1);
+        std::uniform_int_distribution<std::size_t> PickExtension(
+            0,
+            sizeof(Extensions) / sizeof(*Extensions) - 1);
+        std::uniform_int_distribution<int> PickShape(0, 4);
+
+        std::vector<std::pair<std::uint32_t, std::string>> Result;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::string Directory = std::string("/") +
+                Components[PickComponent(Generator)] + "/" +
+                Components[PickComponent(Generator)];
+            std::string Extension = Extensions[PickExtension(Generator)];
+
+            std::string Pattern;
+            switch (PickShape(Generator))
+            {
+            case 0:
+                Pattern = Directory + "/**";
+                break;
+            case 1:
+                Pattern = Directory + "/*" + Extension;
+                break;
+            case 2:
+                Pattern = Directory + "/**/*" + Extension;
+                break;
+            case 3:
+                Pattern = "**/" +
+                    std::string(Components[PickComponent(Generator)]) +
+                    "/*" + Extension;
+                break;
+            default:
+                Pattern = Directory + "/*/[0-9][0-9]*" + Extension;
+                break;
+            }
+            Result.emplace_back(static_cast<std::uint32_t>(i / 4), Pattern);
+        }
+        return Result;
+    }
+
+    std::vector<std::string> CreatePaths(
+        std::size_t Count)
+    {
+        std::mt19937 Generator(2);
+        std::uniform_int_distribution<std::size_t> PickComponent(
+            0,
+            sizeof(Components) / sizeof(*Components) - 1);
+        std::uniform_int_distribution<std::size_t> PickExtension(
+            0,
+            sizeof(Extensions) / sizeof(*Extensions) - 1);
+        std::uniform_int_distribution<int> PickDepth(2, 8);
+
+        std::vector<std::string> Result;
+        Result.reserve(Count);
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::string Path;
+            for (int Depth = PickDepth(Generator); Depth; --Depth)
+            {
+                Path += '/';
+                Path += Components[PickComponent(Generator)];
+            }
+            Path += '/';
+            Path += std::to_string(Generator() % 100000);
+            Path += Extensions[PickExtension(Generator)];
+            Result.push_back(std::move(Path));
+        }
+        return Result;
+    }
+
+    bool IsSelectedByReference(
+        std::vector<ReferenceRule> const& Rules,
+        std::string const& Path)
+    {
+        // The rules of a group are next to each other.
+        for (std::size_t i = 0; i < Rules.size();)
+        {
+            std::uint32_t Group = Rules[i].Group;
+            bool Included = false;
+            bool Excluded = false;
+            for (; i < Rules.size() && Rules[i].Group == Group; ++i)
+            {
+                if (Rules[i].Kind == NSudoSweeper::PathRuleKind::Detect ||
+                    (Rules[i].Kind == NSudoSweeper::PathRuleKind::Include &&
+                        Included) ||
+                    (Rules[i].Kind == NSudoSweeper::PathRuleKind::Exclude &&
+                        (!Included || Excluded)))
+                {
+                    continue;
+                }
+                if (std::regex_match(Path, Rules[i].Expression))
+                {
+                    Included = Included ||
+                        Rules[i].Kind == NSudoSweeper::PathRuleKind::Include;
+                    Excluded = Excluded ||
+                        Rules[i].Kind == NSudoSweeper::PathRuleKind::Exclude;
+                }
+            }
+            if (Included && !Excluded)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename FunctionType>
+    std::size_t Measure(
+        std::string const& Name,
+        std::size_t Count,
+        FunctionType&& Function)
+    {
+        NSudoTest::Stopwatch Timer;
+        std::size_t Result = Function();
+        NSudoTest::PrintMeasurement(
+            Name,
+            Timer.GetSeconds(),
+            static_cast<double>(Count),
+            "paths");
+        return Result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t PathCount = Options.Quick ? 5000 : 200000;
+    const std::size_t RegexPathCount = Options.Quick ? 500 : 20000;
+    std::vector<std::string> Paths = ::CreatePaths(PathCount);
+
+    for (std::size_t RuleCount : { 16, 256 })
+    {
+        std::vector<std::pair<std::uint32_t, std::string>> Patterns =
+            ::CreateRules(RuleCount);
+
+        NSudoSweeper::PathRuleSet Rules;
+        std::vector<ReferenceRule> Reference;
+        for (std::size_t i = 0; i < Patterns.size(); ++i)
+        {
+            // The last rule of every group excludes files.
+            NSudoSweeper::PathRuleKind Kind = i % 4 == 3
+                ? NSudoSweeper::PathRuleKind::Exclude
+                : NSudoSweeper::PathRuleKind::Include;
+            Rules.AddRule(Patterns[i].first, Kind, Patterns[i].second);
+            Reference.push_back(ReferenceRule{
+                Kind,
+                Patterns[i].first,
+                NSudoTest::CompilePathRule(Patterns[i].second) });
+        }
+        Rules.Compile();
+
+        std::string Suffix = ", " + std::to_string(RuleCount) + " rules";
+
+        // The first pass builds the deterministic states it visits.
+        std::size_t Selected = ::Measure(
+            "PathRuleSet::IsSelected, cold" + Suffix,
+            Paths.size(),
+            [&]()
+        {
+            std::size_t Result = 0;
+            for (std::string const& Path : Paths)
+            {
+                Result += Rules.IsSelected(Path);
+            }
+            return Result;
+        });
+        std::printf(
+            "  %zu states, %zu of %zu paths selected\n",
+            Rules.GetStateCount(),
+            Selected,
+            Paths.size());
+
+        NSUDO_TEST_CHECK_EQUAL(::Measure(
+            "PathRuleSet::IsSelected, warm" + Suffix,
+            Paths.size(),
+            [&]()
+        {
+            std::size_t Result = 0;
+            for (std::string const& Path : Paths)
+            {
+                Result += Rules.IsSelected(Path);
+            }
+            return Result;
+        }), Selected);
+
+        ::Measure(
+            "PathRuleSet::Match" + Suffix,
+            Paths.size(),
+            [&]()
+        {
+            std::size_t Result = 0;
+            NSudoSweeper::PathRuleMatch Match;
+            for (std::string const& Path : Paths)
+            {
+                Result += Rules.Match(Path, Match);
+            }
+            return Result;
+        });
+
+        ::Measure(
+            "PathRuleSet::MayMatchBelow" + Suffix,
+            Paths.size(),
+            [&]()
+        {
+            std::size_t Result = 0;
+            for (std::string const& Path : Paths)
+            {
+                Result += Rules.MayMatchBelow(
+                    Mile::NativeStringView(Path).substr(
+                        0,
+                        Path.rfind('/')));
+            }
+            return Result;
+        });
+
+        // A regular expression per rule is far slower, so it only sees
+        // the first paths, which are also checked against the automaton.
+        ::Measure(
+            "std::regex per rule" + Suffix,
+            RegexPathCount,
+            [&]()
+        {
+            std::size_t Result = 0;
+            for (std::size_t i = 0; i < RegexPathCount; ++i)
+            {
+                bool Expected = ::IsSelectedByReference(Reference, Paths[i]);
+                if (Expected != Rules.IsSelected(Paths[i]))
+                {
+                    NSUDO_TEST_CHECK_EQUAL(
+                        Rules.IsSelected(Paths[i]),
+                        Expected);
+                }
+                Result += Expected;
+            }
+            return Result;
+        });
+
+        std::printf("\n");
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
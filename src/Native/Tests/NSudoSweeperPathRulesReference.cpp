@@ -0,0 +1,144 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRulesReference.cpp
+ * PURPOSE:   Implementation for the regular expression reference of path
+ *            rules
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperPathRulesReference.h"
+
+#include <cstdio>
+
+namespace
+{
+    /**
+     * Escapes a character, so it is literal both inside and outside of a
+     * bracket expression.
+     */
+    std::string Escape(
+        char Character)
+    {
+        char Buffer[8];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "\\x%02X",
+            static_cast<unsigned char>(Character));
+        return Buffer;
+    }
+}
+
+std::string NSudoTest::TranslatePathRule(
+    std::string const& Pattern)
+{
+    std::string Result;
+
+    for (std::size_t i = 0; i < Pattern.size(); ++i)
+    {
+        char Character = Pattern[i];
+
+        if (Character == '*')
+        {
+            std::size_t End = Pattern.find_first_not_of('*', i);
+            if (End == std::string::npos)
+            {
+                End = Pattern.size();
+            }
+
+            if (End - i == 1)
+            {
+                Result += "[^/]*";
+            }
+            else if (End < Pattern.size() && Pattern[End] == '/')
+            {
+                // "**/" also matches nothing.
+                Result += "(?:[\\s\\S]*/)?";
+                ++End;
+            }
+            else
+            {
+                Result += "[\\s\\S]*";
+            }
+
+            i = End - 1;
+        }
+        else if (Character == '?')
+        {
+            Result += "[^/]";
+        }
+        else if (Character == '[')
+        {
+            std::size_t Start = i + 1;
+            bool Negated = Start < Pattern.size() && Pattern[Start] == '!';
+            if (Negated)
+            {
+                ++Start;
+            }
+
+            // The first character of the set is never its end.
+            std::size_t End = Start < Pattern.size()
+                ? Pattern.find(']', Start + 1)
+                : std::string::npos;
+            if (End == std::string::npos)
+            {
+                Result += ::Escape(Character);
+                continue;
+            }
+
+            std::string Set;
+            for (std::size_t j = Start; j < End; ++j)
+            {
+                if (j + 2 < End && Pattern[j + 1] == '-')
+                {
+                    // A range whose ends are reversed matches nothing.
+                    if (static_cast<unsigned char>(Pattern[j]) <=
+                        static_cast<unsigned char>(Pattern[j + 2]))
+                    {
+                        Set += ::Escape(Pattern[j]);
+                        Set += '-';
+                        Set += ::Escape(Pattern[j + 2]);
+                    }
+                    j += 2;
+                }
+                else
+                {
+                    Set += ::Escape(Pattern[j]);
+                }
+            }
+
+            // A set never matches the path separator.
+            if (Negated)
+            {
+                Result += "[^/" + Set + "]";
+            }
+            else if (Set.empty())
+            {
+                Result += "(?!)";
+            }
+            else
+            {
+                Result += "(?!/)[" + Set + "]";
+            }
+
+            i = End;
+        }
+        else
+        {
+            Result += ::Escape(Character);
+        }
+    }
+
+    return Result;
+}
+
+std::regex NSudoTest::CompilePathRule(
+    std::string const& Pattern)
+{
+    return std::regex(
+        NSudoTest::TranslatePathRule(Pattern),
+        std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+}
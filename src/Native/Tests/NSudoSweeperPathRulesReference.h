@@ -0,0 +1,43 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRulesReference.h
+ * PURPOSE:   Definition for the regular expression reference of path rules
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_TEST_PATH_RULES_REFERENCE
+#define NSUDO_TEST_PATH_RULES_REFERENCE
+
+#include <regex>
+#include <string>
+
+namespace NSudoTest
+{
+    /**
+     * Translates a path rule pattern into an ECMAScript regular expression
+     * which matches the same paths, following the syntax documented in
+     * NSudoSweeperPathRules.h. The translation is written separately from
+     * the automaton, so the two can be compared against each other.
+     *
+     * @param Pattern The glob pattern, whose path separator is "/".
+     * @return The regular expression, without the case-insensitive flag.
+     */
+    std::string TranslatePathRule(
+        std::string const& Pattern);
+
+    /**
+     * Compiles a path rule pattern into a case-insensitive regular
+     * expression, which is matched against whole paths with
+     * std::regex_match.
+     *
+     * @param Pattern The glob pattern, whose path separator is "/".
+     * @return The regular expression.
+     */
+    std::regex CompilePathRule(
+        std::string const& Pattern);
+}
+
+#endif // !NSUDO_TEST_PATH_RULES_REFERENCE
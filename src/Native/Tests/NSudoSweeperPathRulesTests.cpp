@@ -0,0 +1,525 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperPathRulesTests.cpp
+ * PURPOSE:   Implementation for the compiled path rule automaton tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+#include "NSudoSweeperPathRulesReference.h"
+
+#include "NSudoSweeperPathRules.h"
+
+#include <Mile.Portable.ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct ReferenceRule
+    {
+        std::uint32_t Group;
+        NSudoSweeper::PathRuleKind Kind;
+        std::string Pattern;
+        std::regex Expression;
+    };
+
+    /**
+     * Matches a path against every rule with the regular expressions.
+     */
+    NSudoSweeper::PathRuleMatch MatchReference(
+        std::vector<ReferenceRule> const& Rules,
+        std::string const& Path)
+    {
+        NSudoSweeper::PathRuleMatch Result;
+
+        std::vector<std::uint32_t> IncludedGroups;
+        std::vector<std::uint32_t> ExcludedGroups;
+        for (std::size_t i = 0; i < Rules.size(); ++i)
+        {
+            if (!std::regex_match(Path, Rules[i].Expression))
+            {
+                continue;
+            }
+
+            Result.Rules.push_back(static_cast<std::uint32_t>(i));
+            if (Rules[i].Kind == NSudoSweeper::PathRuleKind::Include)
+            {
+                IncludedGroups.push_back(Rules[i].Group);
+            }
+            else if (Rules[i].Kind == NSudoSweeper::PathRuleKind::Exclude)
+            {
+                ExcludedGroups.push_back(Rules[i].Group);
+            }
+        }
+
+        for (std::uint32_t Group : IncludedGroups)
+        {
+            if (std::find(
+                ExcludedGroups.begin(),
+                ExcludedGroups.end(),
+                Group) == ExcludedGroups.end())
+            {
+                Result.SelectedGroups.push_back(Group);
+            }
+        }
+        std::sort(Result.SelectedGroups.begin(), Result.SelectedGroups.end());
+        Result.SelectedGroups.erase(
+            std::unique(
+                Result.SelectedGroups.begin(),
+                Result.SelectedGroups.end()),
+            Result.SelectedGroups.end());
+
+        return Result;
+    }
+
+    /**
+     * Generates the patterns from a small alphabet, so the special cases of
+     * the syntax appear often.
+     */
+    std::string CreatePattern(
+        std::mt19937& Generator)
+    {
+        static const char Alphabet[] = "aAbBz/*?[]!-.";
+        std::uniform_int_distribution<std::size_t> PickLength(0, 10);
+        std::uniform_int_distribution<std::size_t> PickCharacter(
+            0,
+            sizeof(Alphabet) - 2);
+
+        std::string Result;
+        for (std::size_t Length = PickLength(Generator); Length; --Length)
+        {
+            Result.push_back(Alphabet[PickCharacter(Generator)]);
+        }
+        return Result;
+    }
+
+    /**
+     * Generates a path which a pattern probably matches, by replacing its
+     * wildcards with random characters and changing the case of the
+     * others.
+     */
+    std::string CreatePath(
+        std::mt19937& Generator,
+        std::string const& Pattern)
+    {
+        static const char Alphabet[] = "aAbBzZ/.-[]!_";
+        std::uniform_int_distribution<std::size_t> PickLength(0, 3);
+        std::uniform_int_distribution<std::size_t> PickCharacter(
+            0,
+            sizeof(Alphabet) - 2);
+        std::bernoulli_distribution PickMutation(0.05);
+
+        std::string Result;
+        for (char Character : Pattern)
+        {
+            if (PickMutation(Generator))
+            {
+                continue;
+            }
+
+            if (Character == '*' || Character == '?' || Character == '[')
+            {
+                std::size_t Length = Character == '*'
+                    ? PickLength(Generator)
+                    : 1;
+                for (; Length; --Length)
+                {
+                    Result.push_back(Alphabet[PickCharacter(Generator)]);
+                }
+            }
+            else if (PickMutation(Generator))
+            {
+                Result.push_back(Alphabet[PickCharacter(Generator)]);
+            }
+            else
+            {
+                Result.push_back(Generator() % 2
+                    ? static_cast<char>(std::toupper(Character))
+                    : static_cast<char>(std::tolower(Character)));
+            }
+        }
+        return Result;
+    }
+
+    bool IsEqual(
+        NSudoSweeper::PathRuleMatch const& Left,
+        NSudoSweeper::PathRuleMatch const& Right)
+    {
+        return Left.Rules == Right.Rules &&
+            Left.SelectedGroups == Right.SelectedGroups;
+    }
+
+    void PrintRules(
+        std::vector<ReferenceRule> const& Rules)
+    {
+        for (ReferenceRule const& Rule : Rules)
+        {
+            std::printf(
+                "  Rule %u/%d \"%s\" -> %s\n",
+                Rule.Group,
+                static_cast<int>(Rule.Kind),
+                Rule.Pattern.c_str(),
+                NSudoTest::TranslatePathRule(Rule.Pattern).c_str());
+        }
+    }
+}
+
+NSUDO_TEST_CASE(DocumentedSyntax)
+{
+    struct Case
+    {
+        char const* Pattern;
+        char const* Path;
+        bool Expected;
+    };
+
+    const Case Cases[] =
+    {
+        { "/a/*.log", "/a/B.LOG", true },
+        { "/a/*.log", "/a/b/c.log", false },
+        { "/a/**/*.log", "/a/b.log", true },
+        { "/a/**/*.log", "/a/b/c/d.log", true },
+        { "/a/**", "/a/", true },
+        { "/a/**", "/a", false },
+        { "/a/?", "/a/b", true },
+        { "/a/?", "/a//", false },
+        { "/a/[0-9]", "/a/7", true },
+        { "/a/[!0-9]", "/a/7", false },
+        { "/a/[!0-9]", "/a/x", true },
+        { "/a/[!0-9]", "/a//", false },
+        { "/a/[*]", "/a/*", true },
+        { "/a/[*]", "/a/b", false },
+        { "/a/[[]", "/a/[", true },
+        { "/a/[]]", "/a/]", true },
+        { "/a/[A-C]", "/a/b", true },
+        { "/a/[", "/a/[", true },
+        { "/a/[!", "/a/[!", true },
+        { "/a/[z-a]", "/a/b", false },
+        { "", "", true },
+    };
+
+    for (Case const& Current : Cases)
+    {
+        NSudoSweeper::PathRuleSet Rules;
+        Rules.AddRule(0, NSudoSweeper::PathRuleKind::Include, Current.Pattern);
+        Rules.Compile();
+
+        bool Reference = std::regex_match(
+            std::string(Current.Path),
+            NSudoTest::CompilePathRule(Current.Pattern));
+        if (!NSUDO_TEST_CHECK_EQUAL(
+            Rules.IsSelected(Current.Path),
+            Current.Expected) ||
+            !NSUDO_TEST_CHECK_EQUAL(Reference, Current.Expected))
+        {
+            std::printf(
+                "  \"%s\" against \"%s\"\n",
+                Current.Pattern,
+                Current.Path);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(GroupsAndExclusions)
+{
+    NSudoSweeper::PathRuleSet Rules;
+    Rules.AddRule(0, NSudoSweeper::PathRuleKind::Detect, "/a");
+    Rules.AddRule(0, NSudoSweeper::PathRuleKind::Include, "/a/*.dll");
+    Rules.AddRule(0, NSudoSweeper::PathRuleKind::Exclude, "/a/Important.dll");
+    Rules.AddRule(1, NSudoSweeper::PathRuleKind::Include, "/a/**");
+    Rules.Compile();
+
+    NSudoSweeper::PathRuleMatch Match;
+    NSUDO_TEST_CHECK(Rules.Match("/a/Other.dll", Match));
+    NSUDO_TEST_CHECK((Match.Rules == std::vector<std::uint32_t>{ 1, 3 }));
+    NSUDO_TEST_CHECK((Match.SelectedGroups == std::vector<std::uint32_t>{ 0, 1 }));
+
+    // The exclusion only affects its own group.
+    NSUDO_TEST_CHECK(Rules.Match("/a/important.DLL", Match));
+    NSUDO_TEST_CHECK((Match.Rules == std::vector<std::uint32_t>{ 1, 2, 3 }));
+    NSUDO_TEST_CHECK((Match.SelectedGroups == std::vector<std::uint32_t>{ 1 }));
+
+    // A Detect rule matches, but selects nothing.
+    NSUDO_TEST_CHECK(!Rules.Match("/A", Match));
+    NSUDO_TEST_CHECK((Match.Rules == std::vector<std::uint32_t>{ 0 }));
+
+    // One exclusion removes a group which two inclusions select.
+    NSudoSweeper::PathRuleSet Overlapping;
+    Overlapping.AddRule(2, NSudoSweeper::PathRuleKind::Include, "/b/a/b/**");
+    Overlapping.AddRule(2, NSudoSweeper::PathRuleKind::Exclude, "/b/**");
+    Overlapping.AddRule(2, NSudoSweeper::PathRuleKind::Include, "/b/?/*/a");
+    Overlapping.Compile();
+    NSUDO_TEST_CHECK(!Overlapping.Match("/b/a/b/a", Match));
+    NSUDO_TEST_CHECK((Match.Rules == std::vector<std::uint32_t>{ 0, 1, 2 }));
+    NSUDO_TEST_CHECK(Match.SelectedGroups.empty());
+
+    NSUDO_TEST_CHECK(Rules.MayMatchBelow("/a"));
+    NSUDO_TEST_CHECK(Rules.MayMatchBelow("/a/b/"));
+    NSUDO_TEST_CHECK(!Rules.MayMatchBelow("/b"));
+    NSUDO_TEST_CHECK(Rules.MayMatchBelow(""));
+}
+
+NSUDO_TEST_CASE(DifferentialAgainstRegex)
+{
+    std::mt19937 Generator(20240601);
+    std::uniform_int_distribution<std::size_t> PickRuleCount(1, 6);
+    std::uniform_int_distribution<std::uint32_t> PickGroup(0, 2);
+    std::uniform_int_distribution<int> PickKind(0, 2);
+    std::bernoulli_distribution PickOverlap(0.2);
+
+    const std::size_t SetCount = 1500;
+    const std::size_t PathCount = 60;
+    std::size_t Matches = 0;
+    std::size_t Comparisons = 0;
+
+    for (std::size_t Set = 0; Set < SetCount; ++Set)
+    {
+        std::vector<ReferenceRule> Reference;
+
+        // The same rules with the default limit, and with a limit so low
+        // that matching falls back to the nondeterministic automaton.
+        NSudoSweeper::PathRuleSet Rules;
+        NSudoSweeper::PathRuleSet LimitedRules(3);
+
+        for (std::size_t Count = PickRuleCount(Generator); Count; --Count)
+        {
+            ReferenceRule Rule;
+            Rule.Group = PickGroup(Generator);
+            Rule.Kind = static_cast<NSudoSweeper::PathRuleKind>(
+                PickKind(Generator));
+            Rule.Pattern = ::CreatePattern(Generator);
+
+            // Rules which overlap an earlier one, so a path often matches
+            // several rules of a group.
+            if (!Reference.empty() && PickOverlap(Generator))
+            {
+                Rule.Pattern = Generator() % 2
+                    ? Reference.back().Pattern
+                    : "**";
+            }
+            Rule.Expression = NSudoTest::CompilePathRule(Rule.Pattern);
+
+            Rules.AddRule(Rule.Group, Rule.Kind, Rule.Pattern);
+            LimitedRules.AddRule(Rule.Group, Rule.Kind, Rule.Pattern);
+            Reference.push_back(std::move(Rule));
+        }
+        Rules.Compile();
+        LimitedRules.Compile();
+
+        std::uniform_int_distribution<std::size_t> PickRule(
+            0,
+            Reference.size() - 1);
+        for (std::size_t i = 0; i < PathCount; ++i)
+        {
+            std::string Path = ::CreatePath(
+                Generator,
+                Reference[PickRule(Generator)].Pattern);
+
+            NSudoSweeper::PathRuleMatch Expected =
+                ::MatchReference(Reference, Path);
+            NSudoSweeper::PathRuleMatch Actual;
+            NSudoSweeper::PathRuleMatch LimitedActual;
+            Rules.Match(Path, Actual);
+            LimitedRules.Match(Path, LimitedActual);
+            ++Comparisons;
+            Matches += !Expected.Rules.empty();
+
+            if (!NSUDO_TEST_CHECK(::IsEqual(Actual, Expected)) ||
+                !NSUDO_TEST_CHECK(::IsEqual(LimitedActual, Expected)) ||
+                !NSUDO_TEST_CHECK_EQUAL(
+                    Rules.IsSelected(Path),
+                    !Expected.SelectedGroups.empty()))
+            {
+                std::printf("  Path \"%s\"\n", Path.c_str());
+                ::PrintRules(Reference);
+                return;
+            }
+
+            // Every directory above a path which a Detect or Include rule
+            // matches may contain a match.
+            bool Reachable = false;
+            for (std::uint32_t Index : Expected.Rules)
+            {
+                Reachable = Reachable ||
+                    Reference[Index].Kind != NSudoSweeper::PathRuleKind::Exclude;
+            }
+            for (std::size_t Slash = Path.find('/');
+                Reachable && Slash != std::string::npos;
+                Slash = Path.find('/', Slash + 1))
+            {
+                std::string Directory = Path.substr(0, Slash);
+                if (!NSUDO_TEST_CHECK(Rules.MayMatchBelow(Directory)) ||
+                    !NSUDO_TEST_CHECK(LimitedRules.MayMatchBelow(Directory)))
+                {
+                    std::printf(
+                        "  Path \"%s\" below \"%s\"\n",
+                        Path.c_str(),
+                        Directory.c_str());
+                    ::PrintRules(Reference);
+                    return;
+                }
+            }
+        }
+
+        NSUDO_TEST_CHECK(LimitedRules.GetStateCount() <= 3);
+    }
+
+    // Most of the generated paths should match a rule, or the comparison
+    // says little.
+    NSUDO_TEST_CHECK(Matches * 3 > Comparisons);
+    std::printf(
+        "  %zu paths compared, %zu of them matched\n",
+        Comparisons,
+        Matches);
+}
+
+NSUDO_TEST_CASE(ConcurrentMatching)
+{
+    std::mt19937 Generator(7);
+
+    std::vector<ReferenceRule> Reference;
+    NSudoSweeper::PathRuleSet Rules;
+    for (std::uint32_t i = 0; i < 32; ++i)
+    {
+        ReferenceRule Rule;
+        Rule.Group = i % 4;
+        Rule.Kind = i % 5 == 4
+            ? NSudoSweeper::PathRuleKind::Exclude
+            : NSudoSweeper::PathRuleKind::Include;
+        Rule.Pattern = "/" + ::CreatePattern(Generator);
+        Rule.Expression = NSudoTest::CompilePathRule(Rule.Pattern);
+        Rules.AddRule(Rule.Group, Rule.Kind, Rule.Pattern);
+        Reference.push_back(std::move(Rule));
+    }
+    Rules.Compile();
+
+    std::vector<std::string> Paths;
+    std::vector<NSudoSweeper::PathRuleMatch> Expected;
+    for (std::size_t i = 0; i < 4000; ++i)
+    {
+        Paths.push_back(::CreatePath(
+            Generator,
+            Reference[i % Reference.size()].Pattern));
+        Expected.push_back(::MatchReference(Reference, Paths.back()));
+    }
+
+    // The states are built by whichever thread reaches them first.
+    std::unique_ptr<std::atomic<bool>[]> Results(
+        new std::atomic<bool>[Paths.size()]);
+    Mile::ThreadPool Pool(8);
+    Mile::ParallelFor(
+        Pool,
+        0,
+        Paths.size(),
+        16,
+        [&](std::size_t Index)
+    {
+        NSudoSweeper::PathRuleMatch Actual;
+        Rules.Match(Paths[Index], Actual);
+        Results[Index].store(::IsEqual(Actual, Expected[Index]));
+    });
+
+    std::size_t Mismatches = 0;
+    for (std::size_t i = 0; i < Paths.size(); ++i)
+    {
+        Mismatches += !Results[i].load();
+    }
+    NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+}
+
+NSUDO_TEST_CASE(FullCacheIsReset)
+{
+    std::mt19937 Generator(11);
+
+    // The same rules with a limit which the paths cross many times, and
+    // with the lowest limit, which simulates the nondeterministic automaton
+    // for almost every character.
+    const std::size_t MaximumStates = 24;
+    std::vector<ReferenceRule> Reference;
+    NSudoSweeper::PathRuleSet Rules(MaximumStates);
+    NSudoSweeper::PathRuleSet NfaRules(2);
+    for (std::uint32_t i = 0; i < 32; ++i)
+    {
+        ReferenceRule Rule;
+        Rule.Group = i % 4;
+        Rule.Kind = i % 5 == 4
+            ? NSudoSweeper::PathRuleKind::Exclude
+            : NSudoSweeper::PathRuleKind::Include;
+        Rule.Pattern = "/" + ::CreatePattern(Generator);
+        Rule.Expression = NSudoTest::CompilePathRule(Rule.Pattern);
+        Rules.AddRule(Rule.Group, Rule.Kind, Rule.Pattern);
+        NfaRules.AddRule(Rule.Group, Rule.Kind, Rule.Pattern);
+        Reference.push_back(std::move(Rule));
+    }
+    Rules.Compile();
+    NfaRules.Compile();
+
+    std::vector<std::string> Paths;
+    for (std::size_t i = 0; i < 2000; ++i)
+    {
+        Paths.push_back(::CreatePath(
+            Generator,
+            Reference[i % Reference.size()].Pattern));
+    }
+
+    std::size_t Mismatches = 0;
+    for (std::string const& Path : Paths)
+    {
+        NSudoSweeper::PathRuleMatch Expected;
+        NSudoSweeper::PathRuleMatch Actual;
+        NfaRules.Match(Path, Expected);
+        Rules.Match(Path, Actual);
+        Mismatches += !::IsEqual(Actual, Expected);
+        Mismatches += !::IsEqual(Expected, ::MatchReference(Reference, Path));
+        Mismatches += Rules.IsSelected(Path) != NfaRules.IsSelected(Path);
+        Mismatches +=
+            Rules.MayMatchBelow(Path) != NfaRules.MayMatchBelow(Path);
+        Mismatches += Rules.GetStateCount() > MaximumStates;
+    }
+    NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+    NSUDO_TEST_CHECK(Rules.GetCacheResetCount() > 0);
+    NSUDO_TEST_CHECK(NfaRules.GetStateCount() <= 2);
+
+    // The states are reset while other threads walk them.
+    std::unique_ptr<std::atomic<bool>[]> Results(
+        new std::atomic<bool>[Paths.size()]);
+    const std::size_t Resets = Rules.GetCacheResetCount();
+    Mile::ThreadPool Pool(8);
+    for (std::size_t Round = 0; Round < 4; ++Round)
+    {
+        Mile::ParallelFor(
+            Pool,
+            0,
+            Paths.size(),
+            4,
+            [&](std::size_t Index)
+        {
+            NSudoSweeper::PathRuleMatch Expected;
+            NSudoSweeper::PathRuleMatch Actual;
+            NfaRules.Match(Paths[Index], Expected);
+            Rules.Match(Paths[Index], Actual);
+            Results[Index].store(::IsEqual(Actual, Expected));
+        });
+
+        for (std::size_t i = 0; i < Paths.size(); ++i)
+        {
+            Mismatches += !Results[i].load();
+        }
+    }
+    NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+    NSUDO_TEST_CHECK(Rules.GetCacheResetCount() > Resets);
+    NSUDO_TEST_CHECK(Rules.GetStateCount() <= MaximumStates);
+}
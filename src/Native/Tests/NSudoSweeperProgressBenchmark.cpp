@@ -0,0 +1,330 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperProgressBenchmark.cpp
+ * PURPOSE:   Implementation for the progress aggregator benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperHandlerV2.h"
+#include "NSudoSweeperProgress.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**
+     * What the host does for a progress message: it takes its lock and
+     * formats the text of its progress bar, which is the least a repaint
+     * costs.
+     */
+    class Host
+    {
+    public:
+
+        std::mutex Mutex;
+        std::uint64_t Calls = 0;
+        std::uint32_t LastProgress = 0;
+        bool Decreased = false;
+        char Text[64];
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API Callback(
+            std::uint32_t Message,
+            void* Parameter,
+            void* UserData)
+        {
+            Host& Target = *reinterpret_cast<Host*>(UserData);
+            if (Message != NSUDO_SWEEPER_PROGRESS_MESSAGE)
+            {
+                return NSUDO_SWEEPER_S_OK;
+            }
+
+            std::uint32_t Progress =
+                *reinterpret_cast<std::uint32_t*>(Parameter);
+
+            std::lock_guard<std::mutex> Lock(Target.Mutex);
+            ++Target.Calls;
+            if (Progress < Target.LastProgress)
+            {
+                Target.Decreased = true;
+            }
+            Target.LastProgress = Progress;
+            std::snprintf(
+                Target.Text,
+                sizeof(Target.Text),
+                "%u%%",
+                Progress);
+            return NSUDO_SWEEPER_S_OK;
+        }
+    };
+
+    /**
+     * The callback is read through a volatile pointer, so the compiler
+     * calls it like a function in another module.
+     */
+    NSudoSweeperCallbackV2 volatile g_Callback = Host::Callback;
+
+    /**
+     * The size of the index-th file a thread sees.
+     */
+    std::uint64_t GetFileSize(
+        std::size_t Index)
+    {
+        return 512 + (Index & 0xFFF);
+    }
+
+    std::uint64_t GetTotalSize(
+        std::size_t Files)
+    {
+        std::uint64_t Result = 0;
+        for (std::size_t i = 0; i < Files; ++i)
+        {
+            Result += ::GetFileSize(i);
+        }
+        return Result;
+    }
+
+    /**
+     * Runs Threads threads which each see Files files.
+     */
+    template<typename WorkerType>
+    double RunThreads(
+        std::size_t Threads,
+        WorkerType Worker)
+    {
+        std::vector<std::thread> Workers;
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < Threads; ++i)
+        {
+            Workers.emplace_back(Worker);
+        }
+        for (std::thread& Current : Workers)
+        {
+            Current.join();
+        }
+        return Timer.GetSeconds();
+    }
+
+    /**
+     * The handler counts in shared atomics and calls back the host for
+     * every file, which is what it did before the aggregator.
+     */
+    double RunDirect(
+        std::size_t Threads,
+        std::size_t Files,
+        Host& Target)
+    {
+        std::uint64_t const TotalFiles = Threads * Files;
+        std::atomic<std::uint64_t> SeenFiles{ 0 };
+        std::atomic<std::uint64_t> SeenBytes{ 0 };
+
+        double Seconds = ::RunThreads(Threads, [&]()
+        {
+            for (std::size_t i = 0; i < Files; ++i)
+            {
+                SeenBytes.fetch_add(
+                    ::GetFileSize(i),
+                    std::memory_order_relaxed);
+                std::uint64_t Seen = SeenFiles.fetch_add(
+                    1,
+                    std::memory_order_relaxed) + 1;
+                std::uint32_t Progress = static_cast<std::uint32_t>(
+                    Seen * 100 / TotalFiles);
+                g_Callback(
+                    NSUDO_SWEEPER_PROGRESS_MESSAGE,
+                    &Progress,
+                    &Target);
+            }
+        });
+
+        NSUDO_TEST_CHECK_EQUAL(SeenFiles.load(), TotalFiles);
+        NSUDO_TEST_CHECK_EQUAL(
+            SeenBytes.load(),
+            Threads * ::GetTotalSize(Files));
+        return Seconds;
+    }
+
+    /**
+     * The handler reports every file to the aggregator, which publishes to
+     * the host once per interval.
+     */
+    double RunAggregated(
+        std::size_t Threads,
+        std::size_t Files,
+        bool CacheCounter,
+        Host& Target)
+    {
+        std::uint64_t const TotalFiles = Threads * Files;
+
+        NSudoSweeper::ProgressAggregatorOptions Options;
+        Options.Interval = std::chrono::milliseconds(10);
+        NSudoSweeper::ProgressAggregator Aggregator(Options);
+        Aggregator.SetTotalWork(TotalFiles);
+
+        NSudoSweeper::ProgressSnapshot Last;
+        std::uint64_t Published = 0;
+        bool Decreased = false;
+        NSudoTest::Stopwatch PublisherTimer;
+        Aggregator.Start([&](NSudoSweeper::ProgressSnapshot const& Snapshot)
+        {
+            ++Published;
+            if (Snapshot.Percentage < Last.Percentage)
+            {
+                Decreased = true;
+            }
+            Last = Snapshot;
+            std::uint32_t Progress = Snapshot.Percentage;
+            g_Callback(NSUDO_SWEEPER_PROGRESS_MESSAGE, &Progress, &Target);
+        });
+
+        double Seconds = ::RunThreads(Threads, [&]()
+        {
+            if (CacheCounter)
+            {
+                NSudoSweeper::ProgressAggregator::Counter Counter =
+                    Aggregator.GetCounter();
+                for (std::size_t i = 0; i < Files; ++i)
+                {
+                    Counter.AddFiles();
+                    Counter.AddBytes(::GetFileSize(i));
+                    Counter.AddWork();
+                }
+            }
+            else
+            {
+                for (std::size_t i = 0; i < Files; ++i)
+                {
+                    Aggregator.AddFiles();
+                    Aggregator.AddBytes(::GetFileSize(i));
+                    Aggregator.AddWork();
+                }
+            }
+        });
+        Aggregator.Stop();
+        double Lifetime = PublisherTimer.GetSeconds();
+
+        NSUDO_TEST_CHECK(!Decreased);
+        NSUDO_TEST_CHECK(Last.Completed);
+        NSUDO_TEST_CHECK_EQUAL(Last.Percentage, 100U);
+        NSUDO_TEST_CHECK_EQUAL(Last.Files, TotalFiles);
+        NSUDO_TEST_CHECK_EQUAL(Last.Work, TotalFiles);
+        NSUDO_TEST_CHECK_EQUAL(Last.Bytes, Threads * ::GetTotalSize(Files));
+        NSUDO_TEST_CHECK_EQUAL(Last.Errors, 0U);
+
+        // Each interval publishes at most once, and the final snapshot is
+        // published by Stop.
+        std::uint64_t Intervals = static_cast<std::uint64_t>(
+            Lifetime / 0.010) + 2;
+        NSUDO_TEST_CHECK(Published <= Intervals);
+        return Seconds;
+    }
+
+    struct Measurement
+    {
+        double Direct;
+        double Aggregated;
+        double Cached;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t FilesPerThread = Options.Quick ? 20000 : 1000000;
+    const std::vector<std::size_t> ThreadCounts = Options.Quick
+        ? std::vector<std::size_t>{ 1, 2 }
+        : std::vector<std::size_t>{ 1, 2, 4, 8, 16 };
+
+    std::printf(
+        "%zu logical processors, %zu files per thread, a snapshot every "
+        "10 ms\n\n",
+        static_cast<std::size_t>(std::thread::hardware_concurrency()),
+        FilesPerThread);
+
+    std::vector<Measurement> Measurements;
+    for (std::size_t Threads : ThreadCounts)
+    {
+        Measurement Current = {};
+        double const Files = static_cast<double>(Threads * FilesPerThread);
+        std::string Suffix = " (" + std::to_string(Threads) + " threads)";
+
+        {
+            Host Target;
+            Current.Direct = ::RunDirect(Threads, FilesPerThread, Target);
+            NSUDO_TEST_CHECK_EQUAL(
+                Target.Calls,
+                static_cast<std::uint64_t>(Threads * FilesPerThread));
+            NSudoTest::PrintMeasurement(
+                "Direct callback" + Suffix,
+                Current.Direct,
+                Files,
+                "files");
+        }
+
+        {
+            Host Target;
+            Current.Aggregated = ::RunAggregated(
+                Threads,
+                FilesPerThread,
+                false,
+                Target);
+            NSUDO_TEST_CHECK(!Target.Decreased);
+            NSUDO_TEST_CHECK_EQUAL(Target.LastProgress, 100U);
+            NSudoTest::PrintMeasurement(
+                "Aggregator" + Suffix,
+                Current.Aggregated,
+                Files,
+                "files");
+            std::printf(
+                "  %llu callbacks\n",
+                static_cast<unsigned long long>(Target.Calls));
+        }
+
+        {
+            Host Target;
+            Current.Cached = ::RunAggregated(
+                Threads,
+                FilesPerThread,
+                true,
+                Target);
+            NSUDO_TEST_CHECK(!Target.Decreased);
+            NSUDO_TEST_CHECK_EQUAL(Target.LastProgress, 100U);
+            NSudoTest::PrintMeasurement(
+                "Aggregator, cached counter" + Suffix,
+                Current.Cached,
+                Files,
+                "files");
+        }
+
+        Measurements.push_back(Current);
+    }
+
+    // The speedups over the direct callbacks.
+    std::printf("\n%-10s %12s %12s\n", "Threads", "Aggregator", "Cached");
+    for (std::size_t i = 0; i < Measurements.size(); ++i)
+    {
+        std::printf(
+            "%-10zu %11.2fx %11.2fx\n",
+            ThreadCounts[i],
+            Measurements[i].Direct / Measurements[i].Aggregated,
+            Measurements[i].Direct / Measurements[i].Cached);
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
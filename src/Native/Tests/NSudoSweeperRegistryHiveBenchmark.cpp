@@ -0,0 +1,275 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHiveBenchmark.cpp
+ * PURPOSE:   Implementation for the offline registry hive reader benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+#include "NSudoSweeperRegistryHiveBuilder.h"
+
+#include "NSudoSweeperRegistryHive.h"
+
+#include <Mile.Portable.CaseInsensitive.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * Writes the name of the index-th class, a GUID as those of CLSID.
+     */
+    std::string GetClassName(
+        std::size_t Index)
+    {
+        char Buffer[64];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "{%08X-0000-4000-8000-%012zX}",
+            static_cast<unsigned int>(Index * 2654435761U),
+            Index);
+        return Buffer;
+    }
+
+    std::vector<std::size_t> GetRandomIndices(
+        std::size_t Count,
+        std::size_t Range)
+    {
+        std::vector<std::size_t> Indices(Count);
+        std::mt19937_64 Random(1);
+        for (std::size_t& Index : Indices)
+        {
+            Index = std::uniform_int_distribution<std::size_t>(
+                0,
+                Range - 1)(Random);
+        }
+        return Indices;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t Count = Options.Quick ? 20000 : 500000;
+    const std::size_t Lookups = Options.Quick ? 20000 : 1000000;
+    const std::size_t LinearLookups = Options.Quick ? 200 : 1000;
+    const std::size_t Opens = Options.Quick ? 100 : 1000;
+
+    // A SOFTWARE hive whose CLSID key has many subkeys, as that of a
+    // Windows installation has tens of thousands.
+    NSudoTest::RegistryHiveBuilder Builder;
+    NSudoTest::RegistryHiveKey& Classes =
+        Builder.CreateKey("Classes\\CLSID");
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        NSudoTest::RegistryHiveKey& Class = Classes.AddKey(
+            ::GetClassName(i));
+        Class.SetString("", "Class " + std::to_string(i));
+        NSudoTest::RegistryHiveKey& Server = Class.AddKey("InprocServer32");
+        Server.SetString("", "C:\\Windows\\System32\\Class.dll");
+        Server.SetString("ThreadingModel", "Both");
+    }
+    Builder.CreateKey("Microsoft\\Windows NT\\CurrentVersion").SetString(
+        "CurrentBuildNumber",
+        "19045");
+
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    std::string Path = Root + "/Windows/System32/config/SOFTWARE";
+    std::string Content = Builder.Build();
+    NSudoTest::WriteFile(Path, Content);
+    std::printf(
+        "%zu classes, %zu bytes\n\n",
+        Count,
+        Content.size());
+    Content = std::string();
+
+    NSudoSweeper::RegistryHive Hive;
+    NSudoSweeper::RegistryHiveError Error;
+    {
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < Opens; ++i)
+        {
+            NSUDO_TEST_CHECK(Hive.Open(Path, Error));
+        }
+        NSudoTest::PrintMeasurement(
+            "Open",
+            Timer.GetSeconds(),
+            static_cast<double>(Opens),
+            "hives");
+    }
+    std::uint32_t RootKey = Hive.GetRootKey();
+    std::uint32_t ClassesKey = Hive.OpenKey(RootKey, "Classes\\CLSID");
+    if (!NSUDO_TEST_CHECK(ClassesKey != NSudoSweeper::RegistryHiveNoKey))
+    {
+        return 1;
+    }
+
+    std::vector<std::size_t> Indices = ::GetRandomIndices(Lookups, Count);
+    std::vector<std::string> Paths;
+    std::vector<std::string> MissingPaths;
+    for (std::size_t Index : Indices)
+    {
+        Paths.push_back(
+            "Classes\\CLSID\\" + ::GetClassName(Index) + "\\InprocServer32");
+        MissingPaths.push_back(
+            "Classes\\CLSID\\" + ::GetClassName(Count + Index));
+    }
+
+    std::vector<std::uint32_t> Keys(Lookups);
+    {
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < Lookups; ++i)
+        {
+            Keys[i] = Hive.OpenKey(RootKey, Paths[i]);
+        }
+        NSudoTest::PrintMeasurement(
+            "OpenKey, existing",
+            Timer.GetSeconds(),
+            static_cast<double>(Lookups),
+            "keys");
+    }
+    std::size_t Missed = 0;
+    for (std::uint32_t Key : Keys)
+    {
+        Missed += Key == NSudoSweeper::RegistryHiveNoKey;
+    }
+    NSUDO_TEST_CHECK_EQUAL(Missed, 0U);
+
+    {
+        std::size_t Found = 0;
+        NSudoTest::Stopwatch Timer;
+        for (std::string const& Current : MissingPaths)
+        {
+            Found += Hive.OpenKey(RootKey, Current) !=
+                NSudoSweeper::RegistryHiveNoKey;
+        }
+        NSudoTest::PrintMeasurement(
+            "OpenKey, missing",
+            Timer.GetSeconds(),
+            static_cast<double>(Lookups),
+            "keys");
+        NSUDO_TEST_CHECK_EQUAL(Found, 0U);
+    }
+
+    {
+        std::size_t Failed = 0;
+        std::uint32_t Type = 0;
+        std::vector<std::uint8_t> Data;
+        NSudoTest::Stopwatch Timer;
+        for (std::uint32_t Key : Keys)
+        {
+            Failed += !Hive.QueryValue(Key, "ThreadingModel", Type, Data);
+        }
+        NSudoTest::PrintMeasurement(
+            "QueryValue",
+            Timer.GetSeconds(),
+            static_cast<double>(Lookups),
+            "values");
+        NSUDO_TEST_CHECK_EQUAL(Failed, 0U);
+    }
+
+    std::printf("\n");
+
+    // Comparing the names one by one, which the binary search of the
+    // sorted lists replaces, even with the names already enumerated.
+    std::vector<std::string> Names;
+    {
+        NSudoTest::Stopwatch Timer;
+        NSUDO_TEST_CHECK(Hive.EnumerateSubkeys(ClassesKey, Names));
+        NSudoTest::PrintMeasurement(
+            "EnumerateSubkeys",
+            Timer.GetSeconds(),
+            static_cast<double>(Names.size()),
+            "names");
+        NSUDO_TEST_CHECK_EQUAL(Names.size(), Count);
+    }
+    {
+        std::size_t Found = 0;
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < LinearLookups; ++i)
+        {
+            std::string Name = ::GetClassName(Indices[i]);
+            for (std::string const& Current : Names)
+            {
+                if (Mile::CaseInsensitiveEquals(Current, Name))
+                {
+                    ++Found;
+                    break;
+                }
+            }
+        }
+        NSudoTest::PrintMeasurement(
+            "Linear search of the names",
+            Timer.GetSeconds(),
+            static_cast<double>(LinearLookups),
+            "keys");
+        NSUDO_TEST_CHECK_EQUAL(Found, LinearLookups);
+    }
+    {
+        std::size_t Found = 0;
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < LinearLookups; ++i)
+        {
+            Found += Hive.OpenKey(ClassesKey, ::GetClassName(Indices[i])) !=
+                NSudoSweeper::RegistryHiveNoKey;
+        }
+        NSudoTest::PrintMeasurement(
+            "Binary search of the list",
+            Timer.GetSeconds(),
+            static_cast<double>(LinearLookups),
+            "keys");
+        NSUDO_TEST_CHECK_EQUAL(Found, LinearLookups);
+    }
+
+    std::printf("\n");
+
+    // The Detect rules of many handlers test the same keys, whose answers
+    // the offline registry remembers.
+    {
+        std::vector<std::string> RegistryPaths;
+        for (std::size_t Index : Indices)
+        {
+            RegistryPaths.push_back(
+                "HKLM\\SOFTWARE\\Classes\\CLSID\\" + ::GetClassName(Index));
+        }
+
+        NSudoSweeper::OfflineRegistry Registry(Root);
+        for (int Pass = 0; Pass < 2; ++Pass)
+        {
+            std::size_t Found = 0;
+            NSudoTest::Stopwatch Timer;
+            for (std::string const& Current : RegistryPaths)
+            {
+                Found += Registry.KeyExists(Current);
+            }
+            NSudoTest::PrintMeasurement(
+                Pass ? "KeyExists, remembered" : "KeyExists, first",
+                Timer.GetSeconds(),
+                static_cast<double>(Lookups),
+                "keys");
+            NSUDO_TEST_CHECK_EQUAL(Found, Lookups);
+        }
+
+        NSudoSweeper::OfflineRegistryStatistics Statistics =
+            Registry.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.Queries, 2 * Lookups);
+        NSUDO_TEST_CHECK(Statistics.CacheHits >= Lookups);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.OpenedHives, 1U);
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
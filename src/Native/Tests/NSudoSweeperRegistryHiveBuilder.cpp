@@ -0,0 +1,651 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHiveBuilder.cpp
+ * PURPOSE:   Implementation for the registry hive builder of the tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoSweeperRegistryHiveBuilder.h"
+
+#include "NSudoTest.h"
+
+#include <Mile.Portable.CaseInsensitive.h>
+
+#include <algorithm>
+
+namespace
+{
+    const std::size_t BaseBlockSize = 4096;
+    const std::size_t HiveBinSize = 4096;
+    const std::size_t HiveBinHeaderSize = 32;
+    const std::size_t ChecksumOffset = 508;
+
+    const std::size_t KeyNameOffset = 76;
+    const std::size_t ValueNameOffset = 20;
+    const std::size_t BigDataSegmentSize = 16344;
+
+    const std::uint16_t KeyCompressedName = 0x0020;
+    const std::uint16_t KeyHiveEntry = 0x0004;
+    const std::uint16_t KeyNoDelete = 0x0008;
+    const std::uint16_t ValueCompressedName = 0x0001;
+    const std::uint32_t ValueDataInline = 0x80000000;
+    const std::uint32_t NoCell = 0xFFFFFFFF;
+
+    /**
+     * 2020-01-01 00:00:00 UTC as a FILETIME.
+     */
+    const std::uint64_t Timestamp = 132223104000000000;
+
+    void StoreUInt16(
+        std::string& Target,
+        std::size_t Offset,
+        std::uint32_t Value)
+    {
+        Target[Offset] = static_cast<char>(Value & 0xFF);
+        Target[Offset + 1] = static_cast<char>((Value >> 8) & 0xFF);
+    }
+
+    void StoreUInt32(
+        std::string& Target,
+        std::size_t Offset,
+        std::uint32_t Value)
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Target[Offset + i] = static_cast<char>((Value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    void StoreUInt64(
+        std::string& Target,
+        std::size_t Offset,
+        std::uint64_t Value)
+    {
+        ::StoreUInt32(Target, Offset, static_cast<std::uint32_t>(Value));
+        ::StoreUInt32(Target, Offset + 4, static_cast<std::uint32_t>(
+            Value >> 32));
+    }
+
+    std::uint32_t LoadUInt32(
+        std::string const& Source,
+        std::size_t Offset)
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(
+                static_cast<std::uint8_t>(Source[Offset + i])) << (i * 8);
+        }
+        return Value;
+    }
+
+    /**
+     * Converts valid UTF-8 text to UTF-16.
+     */
+    std::u16string ToUtf16(
+        std::string const& Source)
+    {
+        std::u16string Target;
+        for (std::size_t i = 0; i < Source.size();)
+        {
+            std::uint32_t Character = static_cast<std::uint8_t>(Source[i]);
+            std::size_t Extra = Character >= 0xF0
+                ? 3
+                : (Character >= 0xE0 ? 2 : (Character >= 0xC0 ? 1 : 0));
+            Character &= Extra ? (0x3F >> Extra) : 0x7F;
+            for (std::size_t j = 1; j <= Extra && i + j < Source.size(); ++j)
+            {
+                Character = (Character << 6) |
+                    (static_cast<std::uint8_t>(Source[i + j]) & 0x3F);
+            }
+            i += Extra + 1;
+
+            if (Character >= 0x10000)
+            {
+                Character -= 0x10000;
+                Target.push_back(static_cast<char16_t>(
+                    0xD800 + (Character >> 10)));
+                Target.push_back(static_cast<char16_t>(
+                    0xDC00 + (Character & 0x3FF)));
+            }
+            else
+            {
+                Target.push_back(static_cast<char16_t>(Character));
+            }
+        }
+        return Target;
+    }
+
+    char16_t FoldUnit(
+        char16_t Unit)
+    {
+        return static_cast<char16_t>(
+            Mile::CaseInsensitiveFold(static_cast<wchar_t>(Unit)));
+    }
+
+    bool IsFoldedLess(
+        std::u16string const& Left,
+        std::u16string const& Right)
+    {
+        return std::lexicographical_compare(
+            Left.begin(),
+            Left.end(),
+            Right.begin(),
+            Right.end(),
+            [](char16_t LeftUnit, char16_t RightUnit)
+        {
+            return ::FoldUnit(LeftUnit) < ::FoldUnit(RightUnit);
+        });
+    }
+
+    /**
+     * Appends the cells of a hive to its bins.
+     */
+    class HiveWriter
+    {
+    private:
+
+        NSudoTest::RegistryHiveOptions const& m_Options;
+        std::string& m_Bins;
+
+        /**
+         * Allocates a cell and returns its offset. The cells are aligned to
+         * 8 bytes as the system aligns them.
+         */
+        std::uint32_t Allocate(
+            std::size_t Size)
+        {
+            std::size_t Offset = this->m_Bins.size();
+            std::size_t Length = (Size + 4 + 7) & ~static_cast<std::size_t>(7);
+            this->m_Bins.resize(Offset + Length, '\0');
+            ::StoreUInt32(
+                this->m_Bins,
+                Offset,
+                static_cast<std::uint32_t>(-static_cast<std::int32_t>(
+                    Length)));
+            return static_cast<std::uint32_t>(Offset);
+        }
+
+        bool IsCompressed(
+            std::u16string const& Name) const
+        {
+            if (!this->m_Options.CompressedNames)
+            {
+                return false;
+            }
+            for (char16_t Unit : Name)
+            {
+                if (Unit > 0xFF)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void StoreName(
+            std::size_t Offset,
+            std::u16string const& Name,
+            bool Compressed)
+        {
+            for (std::size_t i = 0; i < Name.size(); ++i)
+            {
+                if (Compressed)
+                {
+                    this->m_Bins[Offset + i] = static_cast<char>(Name[i]);
+                }
+                else
+                {
+                    ::StoreUInt16(this->m_Bins, Offset + i * 2, Name[i]);
+                }
+            }
+        }
+
+        std::uint32_t WriteData(
+            std::string const& Data)
+        {
+            if (Data.size() <= BigDataSegmentSize ||
+                this->m_Options.MinorVersion < 4)
+            {
+                std::uint32_t Cell = this->Allocate(Data.size());
+                this->m_Bins.replace(Cell + 4, Data.size(), Data);
+                return Cell;
+            }
+
+            std::vector<std::uint32_t> Segments;
+            for (std::size_t Offset = 0;
+                Offset < Data.size();
+                Offset += BigDataSegmentSize)
+            {
+                std::size_t Size = (std::min)(
+                    BigDataSegmentSize,
+                    Data.size() - Offset);
+                std::uint32_t Segment = this->Allocate(Size);
+                this->m_Bins.replace(Segment + 4, Size, Data, Offset, Size);
+                Segments.push_back(Segment);
+            }
+
+            std::uint32_t List = this->Allocate(Segments.size() * 4);
+            for (std::size_t i = 0; i < Segments.size(); ++i)
+            {
+                ::StoreUInt32(this->m_Bins, List + 4 + i * 4, Segments[i]);
+            }
+
+            std::uint32_t Cell = this->Allocate(8);
+            this->m_Bins.replace(Cell + 4, 2, "db");
+            ::StoreUInt16(
+                this->m_Bins,
+                Cell + 6,
+                static_cast<std::uint32_t>(Segments.size()));
+            ::StoreUInt32(this->m_Bins, Cell + 8, List);
+            return Cell;
+        }
+
+        std::uint32_t WriteValue(
+            NSudoTest::RegistryHiveValue const& Value)
+        {
+            bool Compressed = this->IsCompressed(Value.Name);
+            std::size_t NameLength = Value.Name.size() * (Compressed ? 1 : 2);
+            std::uint32_t Cell = this->Allocate(ValueNameOffset + NameLength);
+            std::size_t Base = Cell + 4;
+
+            this->m_Bins.replace(Base, 2, "vk");
+            ::StoreUInt16(
+                this->m_Bins,
+                Base + 2,
+                static_cast<std::uint32_t>(NameLength));
+            std::uint32_t DataSize = static_cast<std::uint32_t>(
+                Value.Data.size());
+            if (DataSize <= 4)
+            {
+                ::StoreUInt32(
+                    this->m_Bins,
+                    Base + 4,
+                    DataSize | ValueDataInline);
+                this->m_Bins.replace(Base + 8, DataSize, Value.Data);
+            }
+            else
+            {
+                std::uint32_t Data = this->WriteData(Value.Data);
+                ::StoreUInt32(this->m_Bins, Base + 4, DataSize);
+                ::StoreUInt32(this->m_Bins, Base + 8, Data);
+            }
+            ::StoreUInt32(this->m_Bins, Base + 12, Value.Type);
+            ::StoreUInt16(
+                this->m_Bins,
+                Base + 16,
+                Compressed ? ValueCompressedName : 0);
+            this->StoreName(Base + ValueNameOffset, Value.Name, Compressed);
+            return Cell;
+        }
+
+        std::uint32_t WriteLeaf(
+            std::vector<NSudoTest::RegistryHiveKey const*> const& Keys,
+            std::vector<std::uint32_t> const& Cells,
+            std::size_t First,
+            std::size_t Count)
+        {
+            bool IndexLeaf = this->m_Options.ListType ==
+                NSudoTest::RegistryHiveListType::IndexLeaf;
+            std::size_t Stride = IndexLeaf ? 4 : 8;
+            std::uint32_t Leaf = this->Allocate(4 + Count * Stride);
+            std::size_t Base = Leaf + 4;
+
+            char const* Signature = "lh";
+            if (this->m_Options.ListType ==
+                NSudoTest::RegistryHiveListType::FastLeaf)
+            {
+                Signature = "lf";
+            }
+            else if (IndexLeaf)
+            {
+                Signature = "li";
+            }
+            this->m_Bins.replace(Base, 2, Signature);
+            ::StoreUInt16(
+                this->m_Bins,
+                Base + 2,
+                static_cast<std::uint32_t>(Count));
+
+            for (std::size_t i = 0; i < Count; ++i)
+            {
+                std::size_t Entry = Base + 4 + i * Stride;
+                std::u16string const& Name = Keys[First + i]->Name;
+                ::StoreUInt32(this->m_Bins, Entry, Cells[First + i]);
+                if (this->m_Options.ListType ==
+                    NSudoTest::RegistryHiveListType::FastLeaf)
+                {
+                    for (std::size_t j = 0; j < 4 && j < Name.size(); ++j)
+                    {
+                        this->m_Bins[Entry + 4 + j] =
+                            static_cast<char>(Name[j]);
+                    }
+                }
+                else if (!IndexLeaf)
+                {
+                    std::uint32_t Hash = 0;
+                    for (char16_t Unit : Name)
+                    {
+                        Hash = Hash * 37 + ::FoldUnit(Unit);
+                    }
+                    ::StoreUInt32(this->m_Bins, Entry + 4, Hash);
+                }
+            }
+            return Leaf;
+        }
+
+        std::uint32_t WriteList(
+            std::vector<NSudoTest::RegistryHiveKey const*> const& Keys,
+            std::vector<std::uint32_t> const& Cells)
+        {
+            std::size_t LeafSize = (std::max)(
+                this->m_Options.LeafSize,
+                static_cast<std::size_t>(1));
+            if (Keys.size() <= LeafSize)
+            {
+                return this->WriteLeaf(Keys, Cells, 0, Keys.size());
+            }
+
+            std::vector<std::uint32_t> Leaves;
+            for (std::size_t First = 0; First < Keys.size(); First += LeafSize)
+            {
+                Leaves.push_back(this->WriteLeaf(
+                    Keys,
+                    Cells,
+                    First,
+                    (std::min)(LeafSize, Keys.size() - First)));
+            }
+
+            std::uint32_t Root = this->Allocate(4 + Leaves.size() * 4);
+            this->m_Bins.replace(Root + 4, 2, "ri");
+            ::StoreUInt16(
+                this->m_Bins,
+                Root + 6,
+                static_cast<std::uint32_t>(Leaves.size()));
+            for (std::size_t i = 0; i < Leaves.size(); ++i)
+            {
+                ::StoreUInt32(this->m_Bins, Root + 8 + i * 4, Leaves[i]);
+            }
+            return Root;
+        }
+
+    public:
+
+        HiveWriter(
+            NSudoTest::RegistryHiveOptions const& Options,
+            std::string& Bins) :
+            m_Options(Options),
+            m_Bins(Bins)
+        {
+        }
+
+        std::uint32_t WriteKey(
+            NSudoTest::RegistryHiveKey const& Key,
+            std::uint32_t Parent,
+            bool IsRoot)
+        {
+            bool Compressed = this->IsCompressed(Key.Name);
+            std::size_t NameLength = Key.Name.size() * (Compressed ? 1 : 2);
+            std::uint32_t Cell = this->Allocate(KeyNameOffset + NameLength);
+            std::size_t Base = Cell + 4;
+
+            std::uint32_t Flags = Compressed ? KeyCompressedName : 0;
+            if (IsRoot)
+            {
+                Flags |= KeyHiveEntry | KeyNoDelete;
+            }
+            this->m_Bins.replace(Base, 2, "nk");
+            ::StoreUInt16(this->m_Bins, Base + 2, Flags);
+            ::StoreUInt64(this->m_Bins, Base + 4, Timestamp);
+            ::StoreUInt32(this->m_Bins, Base + 16, Parent);
+            ::StoreUInt32(this->m_Bins, Base + 32, NoCell);
+            ::StoreUInt32(this->m_Bins, Base + 44, NoCell);
+            ::StoreUInt32(this->m_Bins, Base + 48, NoCell);
+            ::StoreUInt16(
+                this->m_Bins,
+                Base + 72,
+                static_cast<std::uint32_t>(NameLength));
+            this->StoreName(Base + KeyNameOffset, Key.Name, Compressed);
+
+            std::vector<std::uint32_t> Values;
+            std::size_t MaximumValueName = 0;
+            std::size_t MaximumValueData = 0;
+            for (NSudoTest::RegistryHiveValue const& Value : Key.Values)
+            {
+                Values.push_back(this->WriteValue(Value));
+                MaximumValueName = (std::max)(
+                    MaximumValueName,
+                    Value.Name.size() * 2);
+                MaximumValueData = (std::max)(
+                    MaximumValueData,
+                    Value.Data.size());
+            }
+            std::uint32_t ValueList = NoCell;
+            if (!Values.empty())
+            {
+                ValueList = this->Allocate(Values.size() * 4);
+                for (std::size_t i = 0; i < Values.size(); ++i)
+                {
+                    ::StoreUInt32(
+                        this->m_Bins,
+                        ValueList + 4 + i * 4,
+                        Values[i]);
+                }
+            }
+
+            std::vector<NSudoTest::RegistryHiveKey const*> Subkeys;
+            std::size_t MaximumSubkeyName = 0;
+            for (auto const& Subkey : Key.Subkeys)
+            {
+                Subkeys.push_back(Subkey.get());
+                MaximumSubkeyName = (std::max)(
+                    MaximumSubkeyName,
+                    Subkey->Name.size() * 2);
+            }
+            std::stable_sort(
+                Subkeys.begin(),
+                Subkeys.end(),
+                [](
+                    NSudoTest::RegistryHiveKey const* Left,
+                    NSudoTest::RegistryHiveKey const* Right)
+            {
+                return ::IsFoldedLess(Left->Name, Right->Name);
+            });
+
+            std::vector<std::uint32_t> Cells;
+            for (NSudoTest::RegistryHiveKey const* Subkey : Subkeys)
+            {
+                Cells.push_back(this->WriteKey(*Subkey, Cell, false));
+            }
+            std::uint32_t SubkeyList = Subkeys.empty()
+                ? NoCell
+                : this->WriteList(Subkeys, Cells);
+
+            ::StoreUInt32(
+                this->m_Bins,
+                Base + 20,
+                static_cast<std::uint32_t>(Subkeys.size()));
+            ::StoreUInt32(this->m_Bins, Base + 28, SubkeyList);
+            ::StoreUInt32(
+                this->m_Bins,
+                Base + 36,
+                static_cast<std::uint32_t>(Values.size()));
+            ::StoreUInt32(this->m_Bins, Base + 40, ValueList);
+            ::StoreUInt32(
+                this->m_Bins,
+                Base + 52,
+                static_cast<std::uint32_t>(MaximumSubkeyName));
+            ::StoreUInt32(
+                this->m_Bins,
+                Base + 60,
+                static_cast<std::uint32_t>(MaximumValueName));
+            ::StoreUInt32(
+                this->m_Bins,
+                Base + 64,
+                static_cast<std::uint32_t>(MaximumValueData));
+            return Cell;
+        }
+    };
+}
+
+NSudoTest::RegistryHiveKey& NSudoTest::RegistryHiveKey::AddKey(
+    std::string const& Name)
+{
+    this->Subkeys.emplace_back(new RegistryHiveKey());
+    this->Subkeys.back()->Name = ::ToUtf16(Name);
+    return *this->Subkeys.back();
+}
+
+void NSudoTest::RegistryHiveKey::SetValue(
+    std::string const& Name,
+    std::uint32_t Type,
+    std::string const& Data)
+{
+    std::u16string ValueName = ::ToUtf16(Name);
+    for (RegistryHiveValue& Value : this->Values)
+    {
+        if (Value.Name == ValueName)
+        {
+            Value.Type = Type;
+            Value.Data = Data;
+            return;
+        }
+    }
+
+    RegistryHiveValue Value;
+    Value.Name = ValueName;
+    Value.Type = Type;
+    Value.Data = Data;
+    this->Values.push_back(std::move(Value));
+}
+
+void NSudoTest::RegistryHiveKey::SetString(
+    std::string const& Name,
+    std::string const& Text)
+{
+    std::string Data;
+    for (char16_t Unit : ::ToUtf16(Text) + u'\0')
+    {
+        Data.push_back(static_cast<char>(Unit & 0xFF));
+        Data.push_back(static_cast<char>(Unit >> 8));
+    }
+    this->SetValue(Name, RegistryStringType, Data);
+}
+
+void NSudoTest::RegistryHiveKey::SetDword(
+    std::string const& Name,
+    std::uint32_t Value)
+{
+    std::string Data(4, '\0');
+    ::StoreUInt32(Data, 0, Value);
+    this->SetValue(Name, RegistryDwordType, Data);
+}
+
+NSudoTest::RegistryHiveBuilder::RegistryHiveBuilder()
+{
+    this->m_Root.Name = u"ROOT";
+}
+
+NSudoTest::RegistryHiveKey& NSudoTest::RegistryHiveBuilder::CreateKey(
+    std::string const& Path)
+{
+    RegistryHiveKey* Key = &this->m_Root;
+    std::size_t Start = 0;
+    while (Start < Path.size())
+    {
+        std::size_t End = Path.find('\\', Start);
+        if (End == std::string::npos)
+        {
+            End = Path.size();
+        }
+
+        std::u16string Name = ::ToUtf16(Path.substr(Start, End - Start));
+        RegistryHiveKey* Subkey = nullptr;
+        for (auto const& Current : Key->Subkeys)
+        {
+            if (Current->Name == Name)
+            {
+                Subkey = Current.get();
+                break;
+            }
+        }
+        if (!Subkey)
+        {
+            Subkey = &Key->AddKey(Path.substr(Start, End - Start));
+        }
+
+        Key = Subkey;
+        Start = End + 1;
+    }
+    return *Key;
+}
+
+std::string NSudoTest::RegistryHiveBuilder::Build(
+    RegistryHiveOptions const& Options) const
+{
+    std::string Bins(HiveBinHeaderSize, '\0');
+    ::HiveWriter Writer(Options, Bins);
+    std::uint32_t Root = Writer.WriteKey(this->m_Root, NoCell, true);
+
+    // The rest of the bin is a free cell.
+    std::size_t Size = (Bins.size() + HiveBinSize - 1) / HiveBinSize *
+        HiveBinSize;
+    if (Size > Bins.size())
+    {
+        std::size_t FreeCell = Bins.size();
+        Bins.resize(Size, '\0');
+        ::StoreUInt32(
+            Bins,
+            FreeCell,
+            static_cast<std::uint32_t>(Size - FreeCell));
+    }
+    Bins.replace(0, 4, "hbin");
+    ::StoreUInt32(Bins, 4, 0);
+    ::StoreUInt32(Bins, 8, static_cast<std::uint32_t>(Size));
+    ::StoreUInt64(Bins, 20, Timestamp);
+
+    std::string Hive(BaseBlockSize, '\0');
+    Hive.replace(0, 4, "regf");
+    ::StoreUInt32(Hive, 4, 2);
+    ::StoreUInt32(Hive, 8, Options.Dirty ? 1 : 2);
+    ::StoreUInt64(Hive, 12, Timestamp);
+    ::StoreUInt32(Hive, 20, 1);
+    ::StoreUInt32(Hive, 24, Options.MinorVersion);
+    ::StoreUInt32(Hive, 28, 0);
+    ::StoreUInt32(Hive, 32, 1);
+    ::StoreUInt32(Hive, 36, Root);
+    ::StoreUInt32(Hive, 40, static_cast<std::uint32_t>(Size));
+    ::StoreUInt32(Hive, 44, 1);
+    NSudoTest::UpdateRegistryHiveChecksum(Hive);
+
+    return Hive + Bins;
+}
+
+void NSudoTest::RegistryHiveBuilder::Write(
+    std::string const& Path,
+    RegistryHiveOptions const& Options) const
+{
+    NSudoTest::WriteFile(Path, this->Build(Options));
+}
+
+void NSudoTest::UpdateRegistryHiveChecksum(
+    std::string& Hive)
+{
+    std::uint32_t Checksum = 0;
+    for (std::size_t i = 0; i < ChecksumOffset; i += 4)
+    {
+        Checksum ^= ::LoadUInt32(Hive, i);
+    }
+    if (Checksum == 0xFFFFFFFF)
+    {
+        Checksum = 0xFFFFFFFE;
+    }
+    else if (Checksum == 0)
+    {
+        Checksum = 1;
+    }
+    ::StoreUInt32(Hive, ChecksumOffset, Checksum);
+}
@@ -0,0 +1,193 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHiveBuilder.h
+ * PURPOSE:   Definition for the registry hive builder of the tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_TEST_REGISTRY_HIVE_BUILDER
+#define NSUDO_TEST_REGISTRY_HIVE_BUILDER
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NSudoTest
+{
+    /**
+     * The REG_* value types the tests use.
+     */
+    const std::uint32_t RegistryStringType = 1;
+    const std::uint32_t RegistryBinaryType = 3;
+    const std::uint32_t RegistryDwordType = 4;
+    const std::uint32_t RegistryQwordType = 11;
+
+    /**
+     * The leaves of the subkey lists of a hive.
+     */
+    enum class RegistryHiveListType
+    {
+        /**
+         * lf, whose entries have the first four characters of the names.
+         */
+        FastLeaf,
+
+        /**
+         * lh, whose entries have the hashes of the names.
+         */
+        HashLeaf,
+
+        /**
+         * li, whose entries only have the keys.
+         */
+        IndexLeaf,
+    };
+
+    /**
+     * How a hive is written.
+     */
+    struct RegistryHiveOptions
+    {
+        RegistryHiveListType ListType = RegistryHiveListType::HashLeaf;
+
+        /**
+         * The most keys of a leaf. The subkeys of a key with more are
+         * split into leaves of an ri list, as the system does after 1012.
+         */
+        std::size_t LeafSize = 1012;
+
+        /**
+         * The minor version of the format. Values larger than 16344 bytes
+         * are split into db segments from 4 on.
+         */
+        std::uint32_t MinorVersion = 5;
+
+        /**
+         * Whether the names which fit in Latin-1 are stored compressed.
+         */
+        bool CompressedNames = true;
+
+        /**
+         * Whether the sequence numbers differ, as if the last write of the
+         * hive was interrupted.
+         */
+        bool Dirty = false;
+    };
+
+    struct RegistryHiveValue
+    {
+        std::u16string Name;
+        std::uint32_t Type = 0;
+        std::string Data;
+    };
+
+    struct RegistryHiveKey
+    {
+        std::u16string Name;
+        std::vector<RegistryHiveValue> Values;
+        std::vector<std::unique_ptr<RegistryHiveKey>> Subkeys;
+
+        /**
+         * Adds a subkey without looking for one of the same name, which
+         * the callers must not add twice.
+         *
+         * @param Name The UTF-8 name of the subkey.
+         * @return The subkey.
+         */
+        RegistryHiveKey& AddKey(
+            std::string const& Name);
+
+        /**
+         * Sets a value, replacing the one of the same name.
+         *
+         * @param Name The UTF-8 name of the value, or an empty string for
+         *             the default value.
+         * @param Type The REG_* type of the value.
+         * @param Data The data of the value.
+         */
+        void SetValue(
+            std::string const& Name,
+            std::uint32_t Type,
+            std::string const& Data);
+
+        /**
+         * Sets a REG_SZ value, whose data is the UTF-16LE text with its
+         * null character.
+         */
+        void SetString(
+            std::string const& Name,
+            std::string const& Text);
+
+        /**
+         * Sets a REG_DWORD value.
+         */
+        void SetDword(
+            std::string const& Name,
+            std::uint32_t Value);
+    };
+
+    /**
+     * Writes registry hive files in the regf format, with the cells laid
+     * out one after another in a single hive bin. The subkeys are sorted
+     * by their names folded with Mile::CaseInsensitiveFold, as the system
+     * sorts them by their uppercase names. The keys have no security
+     * descriptors or classes, which the reader does not use.
+     */
+    class RegistryHiveBuilder
+    {
+    private:
+
+        RegistryHiveKey m_Root;
+
+    public:
+
+        RegistryHiveBuilder();
+
+        RegistryHiveKey& GetRootKey() noexcept
+        {
+            return this->m_Root;
+        }
+
+        /**
+         * Creates a key and the keys above it, or retrieves it if it exists.
+         *
+         * @param Path The UTF-8 path of the key below the root, separated
+         *             by backslashes. Its names are compared exactly.
+         * @return The key.
+         */
+        RegistryHiveKey& CreateKey(
+            std::string const& Path);
+
+        /**
+         * Writes the hive.
+         *
+         * @param Options How the hive is written.
+         * @return The content of the hive file.
+         */
+        std::string Build(
+            RegistryHiveOptions const& Options = RegistryHiveOptions()) const;
+
+        /**
+         * Writes the hive to a file, creating the directories above it.
+         */
+        void Write(
+            std::string const& Path,
+            RegistryHiveOptions const& Options = RegistryHiveOptions()) const;
+    };
+
+    /**
+     * Stores the checksum of the base block of a hive, after a test has
+     * changed its fields.
+     *
+     * @param Hive The content of the hive file, of at least 512 bytes.
+     */
+    void UpdateRegistryHiveChecksum(
+        std::string& Hive);
+}
+
+#endif // !NSUDO_TEST_REGISTRY_HIVE_BUILDER
@@ -0,0 +1,964 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperRegistryHiveTests.cpp
+ * PURPOSE:   Implementation for the offline registry hive reader tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+#include "NSudoSweeperRegistryHiveBuilder.h"
+
+#include "NSudoSweeperRegistryHive.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * The keys of the sample hive in the order of a depth-first walk,
+     * with the subkeys of each key sorted by their uppercase names.
+     */
+    char const* const SampleKeys[] =
+    {
+        "Software",
+        "Software\\Letters",
+        "Software\\Letters\\AAB",
+        "Software\\Letters\\alpha",
+        "Software\\Letters\\a[b",
+        "Software\\Letters\\a_b",
+        "Software\\Letters\\Beta",
+        "Software\\Letters\\Zeta",
+        "Software\\NSudo",
+        "Software\\\xC3\x9Cn\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9",
+        "Software\\\xC3\x9Cn\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9\\Sub",
+        "Software\\\xCE\xA9mega",
+        "System",
+        "System\\ControlSet001",
+        "System\\ControlSet001\\Services",
+        "System\\ControlSet001\\Services\\NSudo",
+        "System\\Select",
+    };
+
+    /**
+     * The value names of Software\NSudo.
+     */
+    char const* const SampleValues[] =
+    {
+        "",
+        "Version",
+        "Short",
+        "Empty",
+        "Eight",
+        "Name",
+        "Large",
+        "\xCE\xA9mega",
+    };
+
+    std::string CreateLargeData(
+        std::size_t Size)
+    {
+        std::string Data(Size, '\0');
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            Data[i] = static_cast<char>(i * 7 + i / 251);
+        }
+        return Data;
+    }
+
+    std::string ToUtf16Data(
+        std::string const& Text)
+    {
+        NSudoTest::RegistryHiveKey Key;
+        Key.SetString("", Text);
+        return Key.Values[0].Data;
+    }
+
+    /**
+     * Creates the keys of SampleKeys, with values of every storage in
+     * Software\NSudo.
+     */
+    void CreateSampleHive(
+        NSudoTest::RegistryHiveBuilder& Builder,
+        std::size_t LargeSize = 40000)
+    {
+        // Added out of order, so the builder has to sort them.
+        char const* const Letters[] =
+        {
+            "Zeta",
+            "alpha",
+            "a_b",
+            "Beta",
+            "AAB",
+            "a[b",
+        };
+        for (char const* Name : Letters)
+        {
+            Builder.CreateKey(std::string("Software\\Letters\\") + Name);
+        }
+
+        NSudoTest::RegistryHiveKey& NSudo =
+            Builder.CreateKey("Software\\NSudo");
+        NSudo.SetString("", "Default");
+        NSudo.SetDword("Version", 9);
+        NSudo.SetValue(
+            "Short",
+            NSudoTest::RegistryBinaryType,
+            std::string("\x01\x02", 2));
+        NSudo.SetValue("Empty", NSudoTest::RegistryBinaryType, std::string());
+        NSudo.SetValue("Eight", NSudoTest::RegistryQwordType, "12345678");
+        NSudo.SetString("Name", "NSudo Sweeper");
+        NSudo.SetValue(
+            "Large",
+            NSudoTest::RegistryBinaryType,
+            ::CreateLargeData(LargeSize));
+        NSudo.SetString("\xCE\xA9mega", "\xCE\xA9");
+
+        Builder.CreateKey("Software\\\xCE\xA9mega");
+        Builder.CreateKey(
+            "Software\\\xC3\x9Cn\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9\\Sub");
+        Builder.CreateKey("System\\Select").SetDword("Current", 1);
+        Builder.CreateKey("System\\ControlSet001\\Services\\NSudo");
+    }
+
+    std::uint32_t LoadUInt32(
+        std::string const& Source,
+        std::size_t Offset)
+    {
+        std::uint32_t Value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Value |= static_cast<std::uint32_t>(
+                static_cast<std::uint8_t>(Source[Offset + i])) << (i * 8);
+        }
+        return Value;
+    }
+
+    void StoreUInt32(
+        std::string& Target,
+        std::size_t Offset,
+        std::uint32_t Value)
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Target[Offset + i] = static_cast<char>((Value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    bool OpenHive(
+        NSudoSweeper::RegistryHive& Hive,
+        std::string const& Path,
+        std::string const& Content)
+    {
+        NSudoTest::WriteFile(Path, Content);
+        NSudoSweeper::RegistryHiveError Error;
+        if (!Hive.Open(Path, Error))
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "Hive.Open(Path, Error)",
+                Error.Message ? Error.Message : "");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Walks the keys below a key depth first, up to a number of keys, so a
+     * damaged hive whose lists loop back is still walked in bounded time.
+     */
+    void ListKeys(
+        NSudoSweeper::RegistryHive const& Hive,
+        std::uint32_t Key,
+        std::string const& Prefix,
+        std::size_t Depth,
+        std::size_t Limit,
+        std::vector<std::string>& Paths)
+    {
+        std::vector<std::string> Names;
+        if (Depth > 8 || !Hive.EnumerateSubkeys(Key, Names))
+        {
+            return;
+        }
+
+        for (std::string const& Name : Names)
+        {
+            if (Paths.size() >= Limit)
+            {
+                return;
+            }
+            std::string Path = Prefix.empty() ? Name : Prefix + "\\" + Name;
+            Paths.push_back(Path);
+            std::uint32_t Subkey = Hive.OpenKey(Key, Name);
+            if (Subkey != NSudoSweeper::RegistryHiveNoKey)
+            {
+                ::ListKeys(Hive, Subkey, Path, Depth + 1, Limit, Paths);
+            }
+        }
+    }
+
+    std::string ToUpperAscii(
+        std::string Text)
+    {
+        for (char& Character : Text)
+        {
+            if (Character >= 'a' && Character <= 'z')
+            {
+                Character = static_cast<char>(Character - 'a' + 'A');
+            }
+        }
+        return Text;
+    }
+
+    std::string ToLowerAscii(
+        std::string Text)
+    {
+        for (char& Character : Text)
+        {
+            if (Character >= 'A' && Character <= 'Z')
+            {
+                Character = static_cast<char>(Character - 'A' + 'a');
+            }
+        }
+        return Text;
+    }
+
+    bool CheckValue(
+        NSudoSweeper::RegistryHive const& Hive,
+        std::uint32_t Key,
+        std::string const& Name,
+        std::uint32_t ExpectedType,
+        std::string const& ExpectedData)
+    {
+        std::uint32_t Type = 0;
+        std::vector<std::uint8_t> Data;
+        return
+            NSUDO_TEST_CHECK(Hive.ValueExists(Key, Name)) &&
+            NSUDO_TEST_CHECK(Hive.QueryValue(Key, Name, Type, Data)) &&
+            NSUDO_TEST_CHECK_EQUAL(Type, ExpectedType) &&
+            NSUDO_TEST_CHECK(std::string(Data.begin(), Data.end()) ==
+                ExpectedData);
+    }
+
+    /**
+     * Checks the keys and the values of a hive created by CreateSampleHive.
+     */
+    void CheckSampleHive(
+        NSudoSweeper::RegistryHive const& Hive,
+        std::size_t LargeSize)
+    {
+        std::uint32_t Root = Hive.GetRootKey();
+
+        std::vector<std::string> Paths;
+        ::ListKeys(Hive, Root, std::string(), 0, 1000, Paths);
+        std::vector<std::string> Expected(
+            std::begin(SampleKeys),
+            std::end(SampleKeys));
+        NSUDO_TEST_CHECK(Paths == Expected);
+
+        // The names are compared without regard to case, and the empty
+        // segments of a path are skipped.
+        for (char const* Path : SampleKeys)
+        {
+            std::uint32_t Key = Hive.OpenKey(Root, Path);
+            NSUDO_TEST_CHECK(Key != NSudoSweeper::RegistryHiveNoKey);
+            NSUDO_TEST_CHECK_EQUAL(
+                Hive.OpenKey(Root, ::ToUpperAscii(Path)),
+                Key);
+            NSUDO_TEST_CHECK_EQUAL(
+                Hive.OpenKey(Root, ::ToLowerAscii(Path)),
+                Key);
+            NSUDO_TEST_CHECK_EQUAL(
+                Hive.OpenKey(Root, std::string("\\") + Path + "\\\\"),
+                Key);
+        }
+        NSUDO_TEST_CHECK_EQUAL(Hive.OpenKey(Root, ""), Root);
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.OpenKey(
+                Root,
+                "Software\\\xC3\xBCN\xC3\x8F" "C\xC3\x96" "D\xC3\x89"),
+            Hive.OpenKey(Root, SampleKeys[9]));
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.OpenKey(Root, "Software\\\xCF\x89MEGA"),
+            Hive.OpenKey(Root, SampleKeys[11]));
+
+        char const* const MissingKeys[] =
+        {
+            "Software\\Missing",
+            "Software\\Letters\\AA",
+            "Software\\Letters\\AABB",
+            "Software\\Letters\\a`b",
+            "Software\\Letters\\ZZZ",
+            "Software\\Letters\\0",
+            "Software\\NSudo\\Deeper",
+            "Software\\\xCE\xA9",
+            "Missing\\Software",
+        };
+        for (char const* Path : MissingKeys)
+        {
+            if (!NSUDO_TEST_CHECK_EQUAL(
+                Hive.OpenKey(Root, Path),
+                NSudoSweeper::RegistryHiveNoKey))
+            {
+                std::printf("    %s\n", Path);
+            }
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.OpenKey(NSudoSweeper::RegistryHiveNoKey, "Software"),
+            NSudoSweeper::RegistryHiveNoKey);
+
+        std::uint32_t NSudo = Hive.OpenKey(Root, "Software\\NSudo");
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "",
+            NSudoTest::RegistryStringType,
+            ::ToUtf16Data("Default"));
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "VERSION",
+            NSudoTest::RegistryDwordType,
+            std::string("\x09\x00\x00\x00", 4));
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "Short",
+            NSudoTest::RegistryBinaryType,
+            std::string("\x01\x02", 2));
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "Empty",
+            NSudoTest::RegistryBinaryType,
+            std::string());
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "eight",
+            NSudoTest::RegistryQwordType,
+            "12345678");
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "Name",
+            NSudoTest::RegistryStringType,
+            ::ToUtf16Data("NSudo Sweeper"));
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "Large",
+            NSudoTest::RegistryBinaryType,
+            ::CreateLargeData(LargeSize));
+        ::CheckValue(
+            Hive,
+            NSudo,
+            "\xCF\x89MEGA",
+            NSudoTest::RegistryStringType,
+            ::ToUtf16Data("\xCE\xA9"));
+
+        std::uint32_t Type = 0;
+        std::vector<std::uint8_t> Data(1);
+        NSUDO_TEST_CHECK(!Hive.ValueExists(NSudo, "Missing"));
+        NSUDO_TEST_CHECK(!Hive.QueryValue(NSudo, "Missing", Type, Data));
+        NSUDO_TEST_CHECK(Data.empty());
+        NSUDO_TEST_CHECK(!Hive.ValueExists(NSudo, "Versio"));
+        NSUDO_TEST_CHECK(!Hive.ValueExists(Root, ""));
+        NSUDO_TEST_CHECK(!Hive.ValueExists(
+            NSudoSweeper::RegistryHiveNoKey,
+            "Version"));
+        ::CheckValue(
+            Hive,
+            Hive.OpenKey(Root, "System\\Select"),
+            "Current",
+            NSudoTest::RegistryDwordType,
+            std::string("\x01\x00\x00\x00", 4));
+    }
+}
+
+NSUDO_TEST_CASE(KeysAndValuesAreRead)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::RegistryHiveBuilder Builder;
+    ::CreateSampleHive(Builder);
+
+    struct Variant
+    {
+        char const* Name;
+        NSudoTest::RegistryHiveListType ListType;
+        std::size_t LeafSize;
+        std::uint32_t MinorVersion;
+        bool CompressedNames;
+        bool Dirty;
+    };
+    const auto FastLeaf = NSudoTest::RegistryHiveListType::FastLeaf;
+    const auto HashLeaf = NSudoTest::RegistryHiveListType::HashLeaf;
+    const auto IndexLeaf = NSudoTest::RegistryHiveListType::IndexLeaf;
+    const Variant Variants[] =
+    {
+        { "lh", HashLeaf, 1012, 5, true, false },
+        { "lf", FastLeaf, 1012, 5, true, false },
+        { "li", IndexLeaf, 1012, 5, true, false },
+        { "ri of lh", HashLeaf, 2, 5, true, false },
+        { "ri of li", IndexLeaf, 1, 5, true, false },
+        { "UTF-16 names", HashLeaf, 1012, 5, false, false },
+        { "Version 1.3", FastLeaf, 1012, 3, true, false },
+        { "Dirty", HashLeaf, 1012, 6, true, true },
+    };
+
+    for (Variant const& Current : Variants)
+    {
+        std::printf("  %s\n", Current.Name);
+
+        NSudoTest::RegistryHiveOptions Options;
+        Options.ListType = Current.ListType;
+        Options.LeafSize = Current.LeafSize;
+        Options.MinorVersion = Current.MinorVersion;
+        Options.CompressedNames = Current.CompressedNames;
+        Options.Dirty = Current.Dirty;
+
+        NSudoSweeper::RegistryHive Hive;
+        if (!::OpenHive(Hive, Directory.Join("Sample"), Builder.Build(Options)))
+        {
+            continue;
+        }
+        NSUDO_TEST_CHECK_EQUAL(Hive.IsDirty(), Current.Dirty);
+        ::CheckSampleHive(Hive, 40000);
+
+        // The same data in one cell is only read as a version 1.3 hive.
+        if (Current.MinorVersion == 3)
+        {
+            std::uint32_t Type = 0;
+            std::vector<std::uint8_t> Data;
+            std::string Content = Builder.Build(Options);
+            ::StoreUInt32(Content, 24, 5);
+            NSudoTest::UpdateRegistryHiveChecksum(Content);
+            if (::OpenHive(Hive, Directory.Join("Sample"), Content))
+            {
+                NSUDO_TEST_CHECK(!Hive.QueryValue(
+                    Hive.OpenKey(Hive.GetRootKey(), "Software\\NSudo"),
+                    "Large",
+                    Type,
+                    Data));
+            }
+        }
+    }
+}
+
+NSUDO_TEST_CASE(LargeListsAreSearched)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::RegistryHiveBuilder Builder;
+
+    // The names alternate their case, so their order is only right if the
+    // builder and the reader both fold them.
+    const std::size_t Count = 2500;
+    NSudoTest::RegistryHiveKey& Many = Builder.CreateKey("Many");
+    std::vector<std::string> Names;
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        char Name[32];
+        std::snprintf(Name, sizeof(Name), i % 2 ? "key%04zu" : "KEY%04zu", i);
+        Names.push_back(Name);
+    }
+    for (std::size_t i = 0; i < Count; ++i)
+    {
+        Many.AddKey(Names[(i * 7919) % Count]);
+    }
+
+    const NSudoTest::RegistryHiveListType ListTypes[] =
+    {
+        NSudoTest::RegistryHiveListType::FastLeaf,
+        NSudoTest::RegistryHiveListType::HashLeaf,
+        NSudoTest::RegistryHiveListType::IndexLeaf,
+    };
+    const std::size_t LeafSizes[] = { 1012, 100, 4000 };
+
+    for (NSudoTest::RegistryHiveListType ListType : ListTypes)
+    {
+        for (std::size_t LeafSize : LeafSizes)
+        {
+            NSudoTest::RegistryHiveOptions Options;
+            Options.ListType = ListType;
+            Options.LeafSize = LeafSize;
+
+            NSudoSweeper::RegistryHive Hive;
+            if (!::OpenHive(
+                Hive,
+                Directory.Join("Many"),
+                Builder.Build(Options)))
+            {
+                continue;
+            }
+
+            std::uint32_t Key = Hive.OpenKey(Hive.GetRootKey(), "Many");
+            std::vector<std::string> Enumerated;
+            NSUDO_TEST_CHECK(Hive.EnumerateSubkeys(Key, Enumerated));
+            NSUDO_TEST_CHECK(Enumerated == Names);
+
+            std::size_t Missed = 0;
+            for (std::string const& Name : Names)
+            {
+                std::uint32_t Subkey = Hive.OpenKey(Key, Name);
+                Missed += Subkey == NSudoSweeper::RegistryHiveNoKey;
+                Missed += Hive.OpenKey(Key, ::ToLowerAscii(Name)) != Subkey;
+            }
+            NSUDO_TEST_CHECK_EQUAL(Missed, 0U);
+
+            char const* const MissingNames[] =
+            {
+                "A",
+                "Key",
+                "Key00000",
+                "Key0999x",
+                "Key2500",
+                "Key9999",
+                "Zzz",
+            };
+            for (char const* Name : MissingNames)
+            {
+                NSUDO_TEST_CHECK_EQUAL(
+                    Hive.OpenKey(Key, Name),
+                    NSudoSweeper::RegistryHiveNoKey);
+            }
+        }
+    }
+}
+
+NSUDO_TEST_CASE(DamagedListsAreSearchedOneByOne)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::RegistryHiveBuilder Builder;
+    for (char Name = '1'; Name <= '9'; ++Name)
+    {
+        Builder.CreateKey(std::string("Key") + Name);
+    }
+
+    const NSudoTest::RegistryHiveListType ListTypes[] =
+    {
+        NSudoTest::RegistryHiveListType::FastLeaf,
+        NSudoTest::RegistryHiveListType::HashLeaf,
+        NSudoTest::RegistryHiveListType::IndexLeaf,
+    };
+    for (NSudoTest::RegistryHiveListType ListType : ListTypes)
+    {
+        NSudoTest::RegistryHiveOptions Options;
+        Options.ListType = ListType;
+        std::string Content = Builder.Build(Options);
+
+        // The middle entry, where the binary search starts, points to the
+        // header of the bin, which is not a cell.
+        std::size_t Stride =
+            ListType == NSudoTest::RegistryHiveListType::IndexLeaf ? 4 : 8;
+        std::size_t RootKey = 4096 + ::LoadUInt32(Content, 36) + 4;
+        std::size_t List = 4096 + ::LoadUInt32(Content, RootKey + 28) + 4;
+        ::StoreUInt32(Content, List + 4 + 4 * Stride, 0);
+
+        NSudoSweeper::RegistryHive Hive;
+        if (!::OpenHive(Hive, Directory.Join("Damaged"), Content))
+        {
+            continue;
+        }
+
+        std::uint32_t Root = Hive.GetRootKey();
+        for (char Name = '1'; Name <= '9'; ++Name)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Hive.OpenKey(Root, std::string("KEY") + Name) ==
+                NSudoSweeper::RegistryHiveNoKey,
+                Name == '5');
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.OpenKey(Root, "Key0"),
+            NSudoSweeper::RegistryHiveNoKey);
+
+        std::vector<std::string> Names;
+        NSUDO_TEST_CHECK(Hive.EnumerateSubkeys(Root, Names));
+        NSUDO_TEST_CHECK_EQUAL(Names.size(), 8U);
+    }
+}
+
+NSUDO_TEST_CASE(DamagedHivesAreRejected)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::RegistryHiveBuilder Builder;
+    ::CreateSampleHive(Builder);
+    const std::string Original = Builder.Build();
+    const std::string Path = Directory.Join("Hive");
+
+    NSudoSweeper::RegistryHive Hive;
+    NSudoSweeper::RegistryHiveError Error;
+    NSUDO_TEST_CHECK(!Hive.Open(Directory.Join("Missing"), Error));
+    NSUDO_TEST_CHECK(Error.SystemError != 0);
+    NSUDO_TEST_CHECK_EQUAL(
+        std::string(Error.Message ? Error.Message : ""),
+        std::string("The hive cannot be opened"));
+
+    struct Damage
+    {
+        char const* Name;
+        std::size_t Offset;
+        std::uint32_t Value;
+        bool UpdateChecksum;
+        char const* Message;
+    };
+    char const* const NotHive = "The file is not a registry hive";
+    char const* const BaseBlock = "The base block of the hive is damaged";
+    char const* const RootKey = "The root key of the hive is damaged";
+    const Damage Damages[] =
+    {
+        { "Signature", 0, 0x66676571, true, NotHive },
+        { "Major version", 20, 2, true, NotHive },
+        { "Minor version 2", 24, 2, true, NotHive },
+        { "Minor version 7", 24, 7, true, NotHive },
+        { "Type", 28, 1, true, NotHive },
+        { "Format", 32, 2, true, NotHive },
+        { "Bin signature", 4096, 0x6E696269, false, NotHive },
+        { "Checksum", 12, 0, false, BaseBlock },
+        { "Root key offset", 36, 0x1000000, true, RootKey },
+        { "Unaligned root key", 36, 34, true, RootKey },
+        { "Root key header", 36, 0, true, RootKey },
+        { "Bins size", 40, 32, true, RootKey },
+    };
+    for (Damage const& Current : Damages)
+    {
+        std::string Content = Original;
+        ::StoreUInt32(Content, Current.Offset, Current.Value);
+        if (Current.UpdateChecksum)
+        {
+            NSudoTest::UpdateRegistryHiveChecksum(Content);
+        }
+        NSudoTest::WriteFile(Path, Content);
+        if (!NSUDO_TEST_CHECK(!Hive.Open(Path, Error)) ||
+            !NSUDO_TEST_CHECK_EQUAL(
+                std::string(Error.Message ? Error.Message : ""),
+                std::string(Current.Message)))
+        {
+            std::printf("    %s\n", Current.Name);
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.GetRootKey(),
+            NSudoSweeper::RegistryHiveNoKey);
+        NSUDO_TEST_CHECK_EQUAL(
+            Hive.OpenKey(Hive.GetRootKey(), "Software"),
+            NSudoSweeper::RegistryHiveNoKey);
+    }
+
+    // The smallest hive is a base block and a bin.
+    NSudoTest::WriteFile(Path, Original.substr(0, 8191));
+    NSUDO_TEST_CHECK(!Hive.Open(Path, Error));
+    NSudoTest::WriteFile(Path, std::string());
+    NSUDO_TEST_CHECK(!Hive.Open(Path, Error));
+
+    // A checksum of 0 is stored as 1, so the base block is never all zeros.
+    std::string Content = Original;
+    ::StoreUInt32(Content, 48, 0);
+    std::uint32_t Checksum = 0;
+    for (std::size_t i = 0; i < 508; i += 4)
+    {
+        Checksum ^= ::LoadUInt32(Content, i);
+    }
+    ::StoreUInt32(Content, 48, Checksum);
+    NSudoTest::UpdateRegistryHiveChecksum(Content);
+    NSUDO_TEST_CHECK_EQUAL(::LoadUInt32(Content, 508), 1U);
+    if (::OpenHive(Hive, Path, Content))
+    {
+        ::CheckSampleHive(Hive, 40000);
+    }
+    ::StoreUInt32(Content, 508, 0);
+    NSudoTest::WriteFile(Path, Content);
+    NSUDO_TEST_CHECK(!Hive.Open(Path, Error));
+
+    // A size of the bins beyond the end of the file is cut to the file.
+    Content = Original;
+    ::StoreUInt32(Content, 40, 0x10000000);
+    NSudoTest::UpdateRegistryHiveChecksum(Content);
+    if (::OpenHive(Hive, Path, Content))
+    {
+        ::CheckSampleHive(Hive, 40000);
+    }
+}
+
+NSUDO_TEST_CASE(CorruptedHivesAreHandled)
+{
+    // The hives are damaged at random, and whatever the reader makes of
+    // them it has to stay within the file, which the sanitizers check.
+    NSudoTest::TemporaryDirectory Directory;
+    NSudoTest::RegistryHiveBuilder Builder;
+    ::CreateSampleHive(Builder, 20000);
+    NSudoTest::RegistryHiveOptions Options;
+    Options.LeafSize = 2;
+    const std::string Original = Builder.Build(Options);
+    const std::string Path = Directory.Join("Hive");
+
+    std::mt19937 Random(48);
+    auto GetRandom = [&Random](
+        std::size_t Range)
+    {
+        return std::uniform_int_distribution<std::size_t>(0, Range - 1)(
+            Random);
+    };
+
+    const std::size_t Iterations = 3000;
+    std::size_t Opened = 0;
+    std::size_t Found = 0;
+    for (std::size_t i = 0; i < Iterations; ++i)
+    {
+        std::string Content = Original;
+        std::size_t BinsSize = Content.size() - 4096;
+        switch (GetRandom(6))
+        {
+        case 0:
+        case 1:
+        {
+            std::size_t Flips = 1 + GetRandom(8);
+            for (std::size_t j = 0; j < Flips; ++j)
+            {
+                Content[4096 + GetRandom(BinsSize)] ^=
+                    static_cast<char>(1 << GetRandom(8));
+            }
+            break;
+        }
+        case 2:
+        {
+            // Sizes, counts and offsets near their limits.
+            const std::uint32_t Values[] =
+            {
+                0,
+                1,
+                0x7FFFFFFF,
+                0x80000000,
+                0x80000005,
+                0xFFFFFFFF,
+                0xFFFFFFF8,
+                0xFFFF,
+                static_cast<std::uint32_t>(BinsSize),
+                static_cast<std::uint32_t>(BinsSize - 4),
+            };
+            std::uint32_t Value = GetRandom(2)
+                ? Values[GetRandom(sizeof(Values) / sizeof(*Values))]
+                : static_cast<std::uint32_t>(GetRandom(BinsSize) & ~3);
+            ::StoreUInt32(Content, 4096 + (GetRandom(BinsSize / 4) * 4), Value);
+            break;
+        }
+        case 3:
+        {
+            std::size_t Offset = 4096 + GetRandom(BinsSize);
+            std::size_t Length = (std::min)(
+                1 + GetRandom(64),
+                Content.size() - Offset);
+            for (std::size_t j = 0; j < Length; ++j)
+            {
+                Content[Offset + j] = static_cast<char>(GetRandom(256));
+            }
+            break;
+        }
+        case 4:
+            Content.resize(GetRandom(Content.size()));
+            break;
+        default:
+        {
+            const std::size_t Fields[] = { 4, 24, 36, 40 };
+            ::StoreUInt32(
+                Content,
+                Fields[GetRandom(sizeof(Fields) / sizeof(*Fields))],
+                static_cast<std::uint32_t>(GetRandom(BinsSize + 64)));
+            NSudoTest::UpdateRegistryHiveChecksum(Content);
+            break;
+        }
+        }
+
+        NSudoTest::WriteFile(Path, Content);
+        NSudoSweeper::RegistryHive Hive;
+        NSudoSweeper::RegistryHiveError Error;
+        if (!Hive.Open(Path, Error))
+        {
+            NSUDO_TEST_CHECK(Error.Message != nullptr);
+            continue;
+        }
+        ++Opened;
+
+        std::uint32_t Root = Hive.GetRootKey();
+        std::vector<std::string> Paths;
+        ::ListKeys(Hive, Root, std::string(), 0, 256, Paths);
+        Paths.insert(Paths.end(), std::begin(SampleKeys), std::end(SampleKeys));
+        for (std::string const& KeyPath : Paths)
+        {
+            std::uint32_t Key = Hive.OpenKey(Root, KeyPath);
+            Found += Key != NSudoSweeper::RegistryHiveNoKey;
+            for (char const* Name : SampleValues)
+            {
+                std::uint32_t Type = 0;
+                std::vector<std::uint8_t> Data;
+                if (Hive.QueryValue(Key, Name, Type, Data))
+                {
+                    NSUDO_TEST_CHECK(Hive.ValueExists(Key, Name));
+                    NSUDO_TEST_CHECK(Data.size() <= Content.size());
+                }
+            }
+        }
+    }
+
+    // Most damage leaves the hive readable, and the rest is rejected.
+    std::printf(
+        "  %zu of %zu damaged hives opened, %zu keys found\n",
+        Opened,
+        Iterations,
+        Found);
+    NSUDO_TEST_CHECK(Opened > Iterations / 2);
+    NSUDO_TEST_CHECK(Opened < Iterations);
+    NSUDO_TEST_CHECK(Found > Opened);
+}
+
+NSUDO_TEST_CASE(OfflineRegistryMapsTheImage)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    std::string Config = Root + "/Windows/System32/config/";
+
+    NSudoTest::RegistryHiveBuilder Software;
+    Software.CreateKey("NSudo").SetDword("Version", 9);
+    Software.CreateKey("Classes\\.tmp");
+    Software.Write(Config + "SOFTWARE");
+
+    NSudoTest::RegistryHiveBuilder System;
+    System.CreateKey("Select").SetDword("Current", 2);
+    System.CreateKey("ControlSet001\\Services\\Old");
+    System.CreateKey("ControlSet002\\Services\\New");
+    System.Write(Config + "SYSTEM");
+
+    NSudoTest::RegistryHiveBuilder Default;
+    Default.CreateKey("Software\\DefaultUser");
+    Default.Write(Config + "DEFAULT");
+
+    NSudoTest::RegistryHiveBuilder Alice;
+    Alice.CreateKey("Software\\Alice");
+    Alice.CreateKey("Software\\Shared").SetDword("Owner", 1);
+    Alice.Write(Root + "/Users/Alice/NTUSER.DAT");
+
+    NSudoTest::RegistryHiveBuilder AliceClasses;
+    AliceClasses.CreateKey(".alice");
+    AliceClasses.Write(
+        Root + "/Users/Alice/AppData/Local/Microsoft/Windows/UsrClass.dat");
+
+    NSudoTest::RegistryHiveBuilder Bob;
+    Bob.CreateKey("Software\\Bob");
+    Bob.CreateKey("Software\\Shared").SetDword("Owner", 2);
+    Bob.Write(Root + "/Users/Bob/NTUSER.DAT");
+
+    // A profile without hives, and a damaged hive.
+    NSudoTest::WriteFile(Root + "/Users/Public/Desktop/File.txt", "File");
+    NSudoTest::WriteFile(Config + "SAM", std::string(8192, 'x'));
+
+    NSudoSweeper::OfflineRegistry Registry(Root);
+
+    struct
+    {
+        char const* Path;
+        bool Exists;
+    } const Keys[] =
+    {
+        { "HKLM", true },
+        { "HKLM\\SOFTWARE", true },
+        { "HKLM\\SOFTWARE\\NSudo", true },
+        { "hklm\\software\\nsudo", true },
+        { "HKEY_LOCAL_MACHINE\\SOFTWARE\\NSudo", true },
+        { "HKLM\\SOFTWARE\\Missing", false },
+        { "HKLM\\SYSTEM\\CurrentControlSet\\Services\\New", true },
+        { "HKLM\\SYSTEM\\CurrentControlSet\\Services\\Old", false },
+        { "HKLM\\SYSTEM\\ControlSet001\\Services\\Old", true },
+        { "HKLM\\SYSTEM\\CurrentControlSet", true },
+        { "HKLM\\SAM\\SAM", false },
+        { "HKLM\\SECURITY", false },
+        { "HKLM\\Missing", false },
+        { "HKU\\.DEFAULT\\Software\\DefaultUser", true },
+        { "HKEY_USERS\\S-1-5-18\\Software\\DefaultUser", true },
+        { "HKU\\S-1-5-19\\Software", false },
+        { "HKCU", true },
+        { "HKCU\\Software\\Alice", true },
+        { "HKCU\\Software\\Bob", true },
+        { "HKEY_CURRENT_USER\\Software\\Shared", true },
+        { "HKCU\\Software\\Carol", false },
+        { "HKCU\\Software\\Classes\\.alice", true },
+        { "HKCU\\Software\\Classes\\.tmp", false },
+        { "HKCR\\.tmp", true },
+        { "HKCR\\.alice", true },
+        { "HKEY_CLASSES_ROOT\\.missing", false },
+        { "HKXX\\Software", false },
+        { "", false },
+    };
+    for (auto const& Current : Keys)
+    {
+        if (!NSUDO_TEST_CHECK_EQUAL(
+            Registry.KeyExists(Current.Path),
+            Current.Exists))
+        {
+            std::printf("    %s\n", Current.Path);
+        }
+    }
+
+    // The answers are remembered, and every hive is opened once.
+    NSudoSweeper::OfflineRegistryStatistics Statistics =
+        Registry.GetStatistics();
+    NSUDO_TEST_CHECK_EQUAL(
+        Statistics.Queries,
+        static_cast<std::uint64_t>(sizeof(Keys) / sizeof(*Keys)));
+    NSUDO_TEST_CHECK_EQUAL(Statistics.OpenedHives, 6U);
+    for (auto const& Current : Keys)
+    {
+        NSUDO_TEST_CHECK_EQUAL(
+            Registry.KeyExists(::ToUpperAscii(Current.Path)),
+            Current.Exists);
+    }
+    NSUDO_TEST_CHECK_EQUAL(
+        Registry.GetStatistics().CacheHits,
+        Statistics.CacheHits + sizeof(Keys) / sizeof(*Keys));
+
+    NSUDO_TEST_CHECK(Registry.ValueExists("HKLM\\SOFTWARE\\NSudo", "Version"));
+    NSUDO_TEST_CHECK(!Registry.ValueExists("HKLM\\SOFTWARE\\NSudo", "Missing"));
+    NSUDO_TEST_CHECK(!Registry.ValueExists("HKLM\\SOFTWARE\\Missing", ""));
+
+    // The profiles are read in the order of their names.
+    std::uint32_t Type = 0;
+    std::vector<std::uint8_t> Data;
+    if (NSUDO_TEST_CHECK(Registry.QueryValue(
+        "HKCU\\Software\\Shared",
+        "Owner",
+        Type,
+        Data)))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Type, NSudoTest::RegistryDwordType);
+        NSUDO_TEST_CHECK(Data == std::vector<std::uint8_t>({ 1, 0, 0, 0 }));
+    }
+    NSUDO_TEST_CHECK(!Registry.QueryValue(
+        "HKCU\\Software\\Alice",
+        "Owner",
+        Type,
+        Data));
+
+    std::vector<std::string> Names;
+    NSUDO_TEST_CHECK(Registry.EnumerateSubkeys("HKCU\\Software", Names));
+    NSUDO_TEST_CHECK(Names == std::vector<std::string>(
+        { "Alice", "Shared", "Bob" }));
+    NSUDO_TEST_CHECK(Registry.EnumerateSubkeys("HKCR", Names));
+    NSUDO_TEST_CHECK(Names == std::vector<std::string>({ ".tmp", ".alice" }));
+    NSUDO_TEST_CHECK(!Registry.EnumerateSubkeys("HKCR\\.missing", Names));
+    NSUDO_TEST_CHECK(Names.empty());
+
+    // The handlers of a scan share the registry of their image.
+    std::shared_ptr<NSudoSweeper::OfflineRegistry> First =
+        NSudoSweeper::OfflineRegistry::Acquire(Root);
+    std::shared_ptr<NSudoSweeper::OfflineRegistry> Second =
+        NSudoSweeper::OfflineRegistry::Acquire(Root);
+    NSUDO_TEST_CHECK(First == Second);
+    NSUDO_TEST_CHECK(First.get() != &Registry);
+    NSUDO_TEST_CHECK(First != NSudoSweeper::OfflineRegistry::Acquire(
+        Root + "/Users"));
+}
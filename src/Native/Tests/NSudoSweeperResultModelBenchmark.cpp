@@ -0,0 +1,273 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultModelBenchmark.cpp
+ * PURPOSE:   Implementation for the indexed scan result model benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperResultModel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * Writes the path of the index-th item, with 64 files per directory.
+     */
+    void GetItemPath(
+        std::size_t Index,
+        std::string& Path)
+    {
+        char Buffer[128];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "/home/user/.cache/Application/Directory%zu/Sub%zu/File%zu.tmp",
+            Index / 1024,
+            Index / 64 % 16,
+            Index % 64);
+        Path = Buffer;
+    }
+
+    /**
+     * Fills a store with items of random sizes in four groups.
+     */
+    void FillStore(
+        NSudoSweeper::ResultStore& Store,
+        std::size_t Count)
+    {
+        std::mt19937_64 Random(1);
+        std::string Path;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            ::GetItemPath(i, Path);
+            NSudoSweeper::ResultStoreItem Item;
+            Item.Reason = static_cast<std::uint32_t>(Random() % 4);
+            Item.Size = Random() % (64 * 1024 * 1024);
+            Store.Add(Path, Item);
+        }
+    }
+
+    std::vector<std::size_t> GetRandomPositions(
+        std::size_t Count,
+        std::size_t Range)
+    {
+        std::vector<std::size_t> Positions(Count);
+        std::mt19937_64 Random(2);
+        for (std::size_t& Position : Positions)
+        {
+            Position = std::uniform_int_distribution<std::size_t>(
+                0,
+                Range - 1)(Random);
+        }
+        return Positions;
+    }
+
+    /**
+     * Measures what a list view does with a view: it fetches a screen of
+     * rows at random positions, and finds the position of the selected row
+     * after the order changes.
+     */
+    void MeasureView(
+        NSudoSweeper::ResultModel const& Model,
+        NSudoSweeper::ResultModelQuery const& Query,
+        std::string const& Name,
+        std::size_t Screens)
+    {
+        NSudoTest::Stopwatch Timer;
+        NSudoSweeper::ResultModelView View = Model.Find(Query);
+        NSudoTest::PrintMeasurement(
+            Name + ", find",
+            Timer.GetSeconds(),
+            1.0,
+            "queries");
+        if (!NSUDO_TEST_CHECK(View.Count > 0))
+        {
+            return;
+        }
+
+        std::vector<std::size_t> Positions =
+            ::GetRandomPositions(Screens, View.Count);
+        std::vector<std::size_t> Rows;
+        std::uint64_t Checksum = 0;
+        Timer.Restart();
+        for (std::size_t Position : Positions)
+        {
+            Model.GetRows(View, Position, 50, Rows);
+            for (std::size_t Row : Rows)
+            {
+                Checksum += Row;
+            }
+        }
+        NSudoTest::PrintMeasurement(
+            Name + ", screen of 50 rows",
+            Timer.GetSeconds(),
+            static_cast<double>(Screens),
+            "screens");
+
+        std::size_t Mismatches = 0;
+        Timer.Restart();
+        for (std::size_t Position : Positions)
+        {
+            std::size_t Row = Model.GetRow(View, Position);
+            Mismatches += Model.GetPosition(View, Row) != Position;
+        }
+        NSudoTest::PrintMeasurement(
+            Name + ", row and position",
+            Timer.GetSeconds(),
+            static_cast<double>(Screens),
+            "rows");
+        NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+        NSUDO_TEST_CHECK(Checksum > 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t Count = Options.Quick ? 100000 : 5000000;
+    const std::size_t Screens = Options.Quick ? 1000 : 100000;
+
+    std::printf("%zu rows\n\n", Count);
+
+    NSudoSweeper::ResultStore Store;
+    ::FillStore(Store, Count);
+
+    // The rows of a finished scan are added at once, so the trees are built
+    // from the sorted rows.
+    {
+        NSudoSweeper::ResultModel Model(Store);
+        NSudoTest::Stopwatch Timer;
+        NSUDO_TEST_CHECK_EQUAL(Model.Update(), Count);
+        NSudoTest::PrintMeasurement(
+            "Update, all rows",
+            Timer.GetSeconds(),
+            static_cast<double>(Count),
+            "rows");
+    }
+
+    // The rows of a running scan are added by batches, most of which are
+    // inserted one by one.
+    NSudoSweeper::ResultStore BatchStore;
+    NSudoSweeper::ResultModel Model(BatchStore);
+    {
+        const std::size_t BatchSize = 4096;
+        std::mt19937_64 Random(1);
+        std::string Path;
+        double Seconds = 0.0;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            ::GetItemPath(i, Path);
+            NSudoSweeper::ResultStoreItem Item;
+            Item.Reason = static_cast<std::uint32_t>(Random() % 4);
+            Item.Size = Random() % (64 * 1024 * 1024);
+            BatchStore.Add(Path, Item);
+            if ((i + 1) % BatchSize == 0 || i + 1 == Count)
+            {
+                NSudoTest::Stopwatch Timer;
+                Model.Update();
+                Seconds += Timer.GetSeconds();
+            }
+        }
+        NSudoTest::PrintMeasurement(
+            "Update, batches of 4096 rows",
+            Seconds,
+            static_cast<double>(Count),
+            "rows");
+        NSUDO_TEST_CHECK_EQUAL(Model.GetCount(), Count);
+    }
+
+    // Sorting the rows on each click of a column header, which is what the
+    // model replaces. A descending view is the ascending order reversed, so
+    // the later of two rows of a size comes first.
+    {
+        std::vector<std::uint32_t> Rows(Count);
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Rows[i] = static_cast<std::uint32_t>(i);
+        }
+        NSudoTest::Stopwatch Timer;
+        std::sort(
+            Rows.begin(),
+            Rows.end(),
+            [&](std::uint32_t Left, std::uint32_t Right)
+        {
+            std::uint64_t LeftSize = Model.GetRowSize(Left);
+            std::uint64_t RightSize = Model.GetRowSize(Right);
+            return LeftSize != RightSize
+                ? LeftSize > RightSize
+                : Left > Right;
+        });
+        NSudoTest::PrintMeasurement(
+            "std::sort by size",
+            Timer.GetSeconds(),
+            1.0,
+            "sorts");
+
+        std::vector<std::size_t> Top;
+        Model.GetTop(100, Top);
+        std::size_t Mismatches = 0;
+        for (std::size_t i = 0; i < Top.size(); ++i)
+        {
+            Mismatches += Top[i] != Rows[i];
+        }
+        NSUDO_TEST_CHECK_EQUAL(Top.size(), 100U);
+        NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+    }
+
+    std::printf("\n");
+
+    NSudoSweeper::ResultModelQuery Query;
+    Query.Order = NSudoSweeper::ResultModelOrder::Size;
+    ::MeasureView(Model, Query, "Size", Screens);
+
+    Query.MinimumSize = 1024 * 1024;
+    Query.MaximumSize = 2 * 1024 * 1024;
+    ::MeasureView(Model, Query, "Size range", Screens);
+
+    Query = NSudoSweeper::ResultModelQuery();
+    Query.Order = NSudoSweeper::ResultModelOrder::Group;
+    Query.Group = 2;
+    ::MeasureView(Model, Query, "Group", Screens);
+
+    Query = NSudoSweeper::ResultModelQuery();
+    Query.Order = NSudoSweeper::ResultModelOrder::Path;
+    Query.Descending = false;
+    ::MeasureView(Model, Query, "Path", Screens);
+
+    // The subtree of the directory of the middle row.
+    Query.Directory = BatchStore.GetNodeParent(
+        BatchStore.GetNodeParent(Model.GetRowNode(Count / 2)));
+    ::MeasureView(Model, Query, "Directory", Screens);
+
+    {
+        std::vector<std::size_t> Top;
+        NSudoTest::Stopwatch Timer;
+        for (std::size_t i = 0; i < Screens; ++i)
+        {
+            Model.GetTop(100, Top);
+        }
+        NSudoTest::PrintMeasurement(
+            "Top 100",
+            Timer.GetSeconds(),
+            static_cast<double>(Screens),
+            "queries");
+    }
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
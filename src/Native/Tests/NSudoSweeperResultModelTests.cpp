@@ -0,0 +1,659 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultModelTests.cpp
+ * PURPOSE:   Implementation for the indexed scan result model tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperResultModel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::vector<std::string> SplitPath(
+        std::string const& Path)
+    {
+        std::vector<std::string> Segments;
+        std::size_t Start = 0;
+        for (;;)
+        {
+            std::size_t End = Path.find('/', Start);
+            Segments.push_back(Path.substr(
+                Start,
+                End == std::string::npos ? std::string::npos : End - Start));
+            if (End == std::string::npos)
+            {
+                break;
+            }
+            Start = End + 1;
+        }
+        return Segments;
+    }
+
+    /**
+     * Compares two names of letters, digits, dots and dashes the way the
+     * model does: by their lowercase characters, then by their characters.
+     */
+    int CompareNames(
+        std::string const& Left,
+        std::string const& Right)
+    {
+        std::size_t Length = (std::min)(Left.size(), Right.size());
+        for (std::size_t i = 0; i < Length; ++i)
+        {
+            int LeftFolded = std::tolower(
+                static_cast<unsigned char>(Left[i]));
+            int RightFolded = std::tolower(
+                static_cast<unsigned char>(Right[i]));
+            if (LeftFolded != RightFolded)
+            {
+                return LeftFolded < RightFolded ? -1 : 1;
+            }
+        }
+        if (Left.size() != Right.size())
+        {
+            return Left.size() < Right.size() ? -1 : 1;
+        }
+        return Left.compare(Right);
+    }
+
+    /**
+     * The brute-force model: it keeps the rows in a vector, and sorts and
+     * filters all of them for every query.
+     */
+    class ReferenceModel
+    {
+    private:
+
+        struct Row
+        {
+            std::vector<std::string> Segments;
+            std::uint64_t Size;
+            std::uint32_t Group;
+        };
+
+        std::vector<Row> m_Rows;
+
+        int ComparePaths(
+            std::size_t Left,
+            std::size_t Right) const
+        {
+            std::vector<std::string> const& LeftSegments =
+                this->m_Rows[Left].Segments;
+            std::vector<std::string> const& RightSegments =
+                this->m_Rows[Right].Segments;
+            std::size_t Length = (std::min)(
+                LeftSegments.size(),
+                RightSegments.size());
+            for (std::size_t i = 0; i < Length; ++i)
+            {
+                int Result = ::CompareNames(
+                    LeftSegments[i],
+                    RightSegments[i]);
+                if (Result)
+                {
+                    return Result;
+                }
+            }
+            if (LeftSegments.size() != RightSegments.size())
+            {
+                return LeftSegments.size() < RightSegments.size() ? -1 : 1;
+            }
+            return 0;
+        }
+
+        bool IsLess(
+            NSudoSweeper::ResultModelOrder Order,
+            std::size_t Left,
+            std::size_t Right) const
+        {
+            Row const& LeftRow = this->m_Rows[Left];
+            Row const& RightRow = this->m_Rows[Right];
+            if (Order == NSudoSweeper::ResultModelOrder::Path)
+            {
+                int Result = this->ComparePaths(Left, Right);
+                return Result ? Result < 0 : Left < Right;
+            }
+            if (Order == NSudoSweeper::ResultModelOrder::Group &&
+                LeftRow.Group != RightRow.Group)
+            {
+                return LeftRow.Group < RightRow.Group;
+            }
+            if (LeftRow.Size != RightRow.Size)
+            {
+                return LeftRow.Size < RightRow.Size;
+            }
+            return Left < Right;
+        }
+
+        bool IsSelected(
+            NSudoSweeper::ResultModelQuery const& Query,
+            std::vector<std::string> const& Directory,
+            std::size_t Index) const
+        {
+            Row const& Current = this->m_Rows[Index];
+            bool InSizeRange =
+                Current.Size >= Query.MinimumSize &&
+                Current.Size <= Query.MaximumSize;
+
+            switch (Query.Order)
+            {
+            case NSudoSweeper::ResultModelOrder::Size:
+                return InSizeRange;
+            case NSudoSweeper::ResultModelOrder::Group:
+                return Query.Group == NSudoSweeper::ResultModelAllGroups ||
+                    (Current.Group == Query.Group && InSizeRange);
+            default:
+                return Query.Directory == NSudoSweeper::ResultStoreNoNode ||
+                    (Current.Segments.size() >= Directory.size() &&
+                        std::equal(
+                            Directory.begin(),
+                            Directory.end(),
+                            Current.Segments.begin()));
+            }
+        }
+
+    public:
+
+        void Add(
+            std::string const& Path,
+            NSudoSweeper::ResultStoreItem const& Item)
+        {
+            Row Current;
+            Current.Segments = ::SplitPath(Path);
+            Current.Size = Item.AllocationSize
+                ? Item.AllocationSize
+                : Item.Size;
+            Current.Group = Item.Reason;
+            this->m_Rows.push_back(Current);
+        }
+
+        void Clear()
+        {
+            this->m_Rows.clear();
+        }
+
+        std::size_t GetCount() const
+        {
+            return this->m_Rows.size();
+        }
+
+        std::uint64_t GetSize(
+            std::size_t Index) const
+        {
+            return this->m_Rows[Index].Size;
+        }
+
+        /**
+         * Retrieves the rows a query selects in the order of its view.
+         *
+         * @param Directory The path of Query.Directory.
+         */
+        std::vector<std::size_t> Find(
+            NSudoSweeper::ResultModelQuery const& Query,
+            std::string const& Directory) const
+        {
+            std::vector<std::string> DirectorySegments =
+                ::SplitPath(Directory);
+
+            std::vector<std::size_t> Rows;
+            for (std::size_t i = 0; i < this->m_Rows.size(); ++i)
+            {
+                if (this->IsSelected(Query, DirectorySegments, i))
+                {
+                    Rows.push_back(i);
+                }
+            }
+            std::sort(
+                Rows.begin(),
+                Rows.end(),
+                [&](std::size_t Left, std::size_t Right)
+            {
+                return this->IsLess(Query.Order, Left, Right);
+            });
+            if (Query.Descending)
+            {
+                std::reverse(Rows.begin(), Rows.end());
+            }
+            return Rows;
+        }
+    };
+
+    /**
+     * Checks the rows of a view, and reports the first difference only.
+     */
+    bool CheckRows(
+        std::vector<std::size_t> const& Actual,
+        std::vector<std::size_t> const& Expected,
+        std::string const& Context)
+    {
+        if (Actual.size() != Expected.size())
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "Actual.size() == Expected.size()",
+                Context + ": " + std::to_string(Actual.size()) + " != " +
+                std::to_string(Expected.size()));
+            return false;
+        }
+        for (std::size_t i = 0; i < Actual.size(); ++i)
+        {
+            if (Actual[i] != Expected[i])
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Actual[i] == Expected[i]",
+                    Context + ": position " + std::to_string(i) + ", " +
+                    std::to_string(Actual[i]) + " != " +
+                    std::to_string(Expected[i]));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string DescribeQuery(
+        NSudoSweeper::ResultModelQuery const& Query)
+    {
+        static char const* const OrderNames[] = { "Size", "Group", "Path" };
+        return std::string(OrderNames[static_cast<int>(Query.Order)]) +
+            (Query.Descending ? " descending" : " ascending") +
+            ", group " + std::to_string(Query.Group) +
+            ", sizes " + std::to_string(Query.MinimumSize) +
+            "-" + std::to_string(Query.MaximumSize) +
+            ", directory " + std::to_string(Query.Directory);
+    }
+
+    /**
+     * Generates paths, sizes and groups with many ties: the names are short,
+     * differ in case only, and are shared by several directories, and the
+     * sizes are few.
+     */
+    class ItemGenerator
+    {
+    private:
+
+        std::mt19937_64 m_Random;
+
+        std::size_t Pick(
+            std::size_t Count)
+        {
+            return std::uniform_int_distribution<std::size_t>(
+                0,
+                Count - 1)(this->m_Random);
+        }
+
+    public:
+
+        explicit ItemGenerator(
+            std::uint64_t Seed) :
+            m_Random(Seed)
+        {
+        }
+
+        std::string GetPath()
+        {
+            static char const* const Names[] =
+            {
+                "a", "A", "b", "B", "ab", "aB", "Ab", "a.b", "a-b", "0", "10",
+                "Cache", "cache", "CACHE", "Temp", "temp.log", "x"
+            };
+            const std::size_t NameCount = sizeof(Names) / sizeof(*Names);
+
+            std::string Path;
+            std::size_t Depth = 1 + this->Pick(4);
+            for (std::size_t i = 0; i < Depth; ++i)
+            {
+                Path += '/';
+                Path += Names[this->Pick(NameCount)];
+            }
+            return Path;
+        }
+
+        NSudoSweeper::ResultStoreItem GetItem()
+        {
+            static std::uint64_t const Sizes[] =
+            {
+                0, 1, 4095, 4096, 8192, 65536, 1048576, UINT64_MAX
+            };
+            const std::size_t SizeCount = sizeof(Sizes) / sizeof(*Sizes);
+
+            NSudoSweeper::ResultStoreItem Item;
+            Item.Reason = static_cast<std::uint32_t>(this->Pick(4));
+            Item.Size = this->Pick(2)
+                ? Sizes[this->Pick(SizeCount)]
+                : 1 + this->Pick(100000);
+            Item.AllocationSize = this->Pick(3)
+                ? 0
+                : Sizes[this->Pick(SizeCount)];
+            return Item;
+        }
+
+        NSudoSweeper::ResultModelQuery GetQuery(
+            ReferenceModel const& Reference,
+            std::size_t NodeCount)
+        {
+            NSudoSweeper::ResultModelQuery Query;
+            Query.Order = static_cast<NSudoSweeper::ResultModelOrder>(
+                this->Pick(3));
+            Query.Descending = this->Pick(2) != 0;
+
+            // The filters of the other orders are set too, which the model
+            // ignores.
+            if (this->Pick(4))
+            {
+                Query.Group = static_cast<std::uint32_t>(this->Pick(5));
+            }
+            if (this->Pick(4) && Reference.GetCount())
+            {
+                std::uint64_t First = Reference.GetSize(
+                    this->Pick(Reference.GetCount()));
+                std::uint64_t Second = Reference.GetSize(
+                    this->Pick(Reference.GetCount()));
+                Query.MinimumSize = (std::min)(First, Second);
+                Query.MaximumSize = (std::max)(First, Second);
+                if (!this->Pick(8))
+                {
+                    std::swap(Query.MinimumSize, Query.MaximumSize);
+                }
+            }
+            if (this->Pick(4) && NodeCount)
+            {
+                Query.Directory = static_cast<std::uint32_t>(
+                    this->Pick(NodeCount));
+            }
+            return Query;
+        }
+
+        std::size_t GetPosition(
+            std::size_t Count)
+        {
+            return this->Pick(Count + 1);
+        }
+    };
+
+    /**
+     * Compares a view of the model with the rows of the brute-force model.
+     */
+    void CheckQuery(
+        NSudoSweeper::ResultStore const& Store,
+        NSudoSweeper::ResultModel const& Model,
+        ReferenceModel const& Reference,
+        NSudoSweeper::ResultModelQuery const& Query,
+        ItemGenerator& Generator)
+    {
+        std::string Context = ::DescribeQuery(Query);
+
+        Mile::NativeString Directory;
+        if (Query.Directory != NSudoSweeper::ResultStoreNoNode)
+        {
+            Store.GetNodePath(Query.Directory, Directory);
+        }
+        std::vector<std::size_t> Expected = Reference.Find(Query, Directory);
+
+        NSudoSweeper::ResultModelView View = Model.Find(Query);
+        if (!NSUDO_TEST_CHECK_EQUAL(View.Count, Expected.size()))
+        {
+            NSudoTest::ReportFailure(__FILE__, __LINE__, "View", Context);
+            return;
+        }
+
+        std::vector<std::size_t> Rows;
+        Model.GetRows(View, 0, SIZE_MAX, Rows);
+        if (!::CheckRows(Rows, Expected, Context + ", GetRows"))
+        {
+            return;
+        }
+
+        // A window at a random position, as a list view fetches its rows.
+        std::size_t Position = Generator.GetPosition(Expected.size());
+        std::size_t Count = Generator.GetPosition(64);
+        Model.GetRows(View, Position, Count, Rows);
+        std::vector<std::size_t> Window;
+        for (std::size_t i = Position;
+            i < Expected.size() && Window.size() < Count;
+            ++i)
+        {
+            Window.push_back(Expected[i]);
+        }
+        ::CheckRows(Rows, Window, Context + ", window");
+
+        // Every row of a small view, and a sample of a large one.
+        std::size_t Step = Expected.size() / 256 + 1;
+        for (std::size_t i = 0; i < Expected.size(); i += Step)
+        {
+            if (Model.GetRow(View, i) != Expected[i] ||
+                Model.GetPosition(View, Expected[i]) != i)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "GetRow and GetPosition",
+                    Context + ": position " + std::to_string(i));
+                return;
+            }
+        }
+
+        // The rows the view does not select have no position.
+        std::vector<bool> Selected(Reference.GetCount());
+        for (std::size_t Row : Expected)
+        {
+            Selected[Row] = true;
+        }
+        for (std::size_t Row = 0; Row < Selected.size(); Row += Step)
+        {
+            if (!Selected[Row] && Model.GetPosition(View, Row) != SIZE_MAX)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "Model.GetPosition(View, Row) == SIZE_MAX",
+                    Context + ": row " + std::to_string(Row));
+                return;
+            }
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            Model.GetPosition(View, Reference.GetCount()),
+            SIZE_MAX);
+    }
+
+    /**
+     * Adds the batches of items to a store, updates the model after each
+     * batch, and compares the model with the brute-force model.
+     */
+    void RunDifferential(
+        std::uint64_t Seed,
+        std::vector<std::size_t> const& Batches,
+        std::size_t QueriesPerBatch)
+    {
+        ItemGenerator Generator(Seed);
+        NSudoSweeper::ResultStore Store;
+        NSudoSweeper::ResultModel Model(Store);
+        ReferenceModel Reference;
+
+        for (std::size_t Batch : Batches)
+        {
+            for (std::size_t i = 0; i < Batch; ++i)
+            {
+                std::string Path = Generator.GetPath();
+                NSudoSweeper::ResultStoreItem Item = Generator.GetItem();
+                Store.Add(Path, Item);
+                Reference.Add(Path, Item);
+            }
+            NSUDO_TEST_CHECK_EQUAL(Model.Update(), Batch);
+            NSUDO_TEST_CHECK_EQUAL(Model.Update(), 0U);
+            if (!NSUDO_TEST_CHECK_EQUAL(
+                Model.GetCount(),
+                Reference.GetCount()))
+            {
+                return;
+            }
+
+            std::size_t const Failures = NSudoTest::GetFailureCount();
+
+            // The unfiltered views of each order.
+            for (int Order = 0; Order < 3; ++Order)
+            {
+                for (int Descending = 0; Descending < 2; ++Descending)
+                {
+                    NSudoSweeper::ResultModelQuery Query;
+                    Query.Order =
+                        static_cast<NSudoSweeper::ResultModelOrder>(Order);
+                    Query.Descending = Descending != 0;
+                    ::CheckQuery(Store, Model, Reference, Query, Generator);
+                }
+            }
+
+            for (std::size_t i = 0; i < QueriesPerBatch; ++i)
+            {
+                ::CheckQuery(
+                    Store,
+                    Model,
+                    Reference,
+                    Generator.GetQuery(Reference, Store.GetNodeCount()),
+                    Generator);
+            }
+
+            // The top rows are the first rows of the largest sizes.
+            NSudoSweeper::ResultModelQuery Largest;
+            std::vector<std::size_t> Expected = Reference.Find(
+                Largest,
+                std::string());
+            Expected.resize((std::min)(Expected.size(), std::size_t(10)));
+            std::vector<std::size_t> Top;
+            Model.GetTop(10, Top);
+            ::CheckRows(Top, Expected, "GetTop");
+
+            if (NSudoTest::GetFailureCount() != Failures)
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "RunDifferential",
+                    "seed " + std::to_string(Seed) + ", " +
+                    std::to_string(Reference.GetCount()) + " rows");
+                return;
+            }
+        }
+    }
+}
+
+NSUDO_TEST_CASE(EmptyModel)
+{
+    NSudoSweeper::ResultStore Store;
+    NSudoSweeper::ResultModel Model(Store);
+    NSUDO_TEST_CHECK_EQUAL(Model.Update(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Model.GetCount(), 0U);
+
+    for (int Order = 0; Order < 3; ++Order)
+    {
+        NSudoSweeper::ResultModelQuery Query;
+        Query.Order = static_cast<NSudoSweeper::ResultModelOrder>(Order);
+        NSudoSweeper::ResultModelView View = Model.Find(Query);
+        NSUDO_TEST_CHECK_EQUAL(View.Count, 0U);
+
+        std::vector<std::size_t> Rows;
+        Model.GetRows(View, 0, 10, Rows);
+        NSUDO_TEST_CHECK(Rows.empty());
+        NSUDO_TEST_CHECK_EQUAL(Model.GetPosition(View, 0), SIZE_MAX);
+    }
+
+    std::vector<std::size_t> Top;
+    Model.GetTop(10, Top);
+    NSUDO_TEST_CHECK(Top.empty());
+
+    // A directory the model does not know selects nothing.
+    NSudoSweeper::ResultModelQuery Query;
+    Query.Order = NSudoSweeper::ResultModelOrder::Path;
+    Query.Directory = 0;
+    NSUDO_TEST_CHECK_EQUAL(Model.Find(Query).Count, 0U);
+}
+
+NSUDO_TEST_CASE(SmallBatchesAreInserted)
+{
+    // Each batch is less than an eighth of the rows, so after the first
+    // batches the rows are inserted one by one and the leaves and branches
+    // split.
+    std::vector<std::size_t> Batches = { 1, 1, 2, 5, 40 };
+    for (int i = 0; i < 60; ++i)
+    {
+        Batches.push_back(1 + i * 7 % 150);
+    }
+    for (std::uint64_t Seed = 1; Seed <= 4; ++Seed)
+    {
+        ::RunDifferential(Seed, Batches, 8);
+    }
+}
+
+NSUDO_TEST_CASE(LargeBatchesAreMerged)
+{
+    // Each batch is at least an eighth of the rows, so the trees are built
+    // from the sorted rows, and the smaller batches after them are inserted
+    // into the built trees.
+    std::vector<std::size_t> const Batches =
+    {
+        3000, 2000, 30, 9000, 1, 2500, 20000, 100, 5
+    };
+    for (std::uint64_t Seed = 11; Seed <= 12; ++Seed)
+    {
+        ::RunDifferential(Seed, Batches, 16);
+    }
+}
+
+NSUDO_TEST_CASE(ClearAndSpilledChunks)
+{
+    NSudoTest::TemporaryDirectory Directory;
+
+    // Every full chunk of the store is spilled, so the model reads them
+    // back.
+    NSudoSweeper::ResultStoreOptions Options;
+    Options.MemoryBudget = 1;
+    Options.SpillDirectory = Directory.GetPath();
+    NSudoSweeper::ResultStore Store(Options);
+    NSudoSweeper::ResultModel Model(Store);
+
+    ItemGenerator Generator(21);
+    for (int Round = 0; Round < 2; ++Round)
+    {
+        ReferenceModel Reference;
+        std::size_t const Count =
+            NSudoSweeper::ResultStoreChunkSize * 2 + 100;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            std::string Path = Generator.GetPath();
+            NSudoSweeper::ResultStoreItem Item = Generator.GetItem();
+            Store.Add(Path, Item);
+            Reference.Add(Path, Item);
+        }
+        NSUDO_TEST_CHECK(Store.GetStatistics().SpilledChunks > 0);
+        NSUDO_TEST_CHECK_EQUAL(Model.Update(), Count);
+
+        for (int i = 0; i < 12; ++i)
+        {
+            ::CheckQuery(
+                Store,
+                Model,
+                Reference,
+                Generator.GetQuery(Reference, Store.GetNodeCount()),
+                Generator);
+        }
+
+        Store.Clear();
+        Model.Clear();
+        NSUDO_TEST_CHECK_EQUAL(Model.GetCount(), 0U);
+        NSUDO_TEST_CHECK_EQUAL(Model.Update(), 0U);
+    }
+    NSUDO_TEST_CHECK_EQUAL(Store.GetSpillError(), 0);
+}
@@ -0,0 +1,262 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultStoreBenchmark.cpp
+ * PURPOSE:   Implementation for the scan result store benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperResultStore.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * Writes the path of the index-th item, with 64 files per directory.
+     * The file names are either unique, like the files of a cache, or
+     * repeated in every directory, like the files of a package store.
+     */
+    void GetItemPath(
+        std::size_t Index,
+        bool UniqueNames,
+        std::string& Path)
+    {
+        char Buffer[160];
+        std::snprintf(
+            Buffer,
+            sizeof(Buffer),
+            "/home/user/.cache/Application/Directory%zu/Sub%zu/%s%zu.tmp",
+            Index / 1024,
+            Index / 64 % 16,
+            UniqueNames ? "Document-3f2a9c71-" : "File",
+            UniqueNames ? Index : Index % 64);
+        Path = Buffer;
+    }
+
+    NSudoSweeper::ResultStoreItem GetItem(
+        std::size_t Index)
+    {
+        NSudoSweeper::ResultStoreItem Item;
+        Item.Size = 512 + (Index & 0xFFFF);
+        Item.AllocationSize = (Item.Size + 4095) & ~4095ULL;
+        Item.FileId = Index + 1;
+        Item.Attributes = 0100644;
+        Item.LastWriteTime = 133000000000000000ULL + Index;
+        return Item;
+    }
+
+    /**
+     * What a scan kept before the store: the path and the metadata of each
+     * item in a vector.
+     */
+    struct PlainItem
+    {
+        std::string Path;
+        NSudoSweeper::ResultStoreItem Item;
+    };
+
+    std::size_t GetPlainMemoryUsage(
+        std::vector<PlainItem> const& Items)
+    {
+        std::size_t Usage = Items.capacity() * sizeof(PlainItem);
+        for (PlainItem const& Current : Items)
+        {
+            // The characters of a short string are inside the object.
+            if (Current.Path.capacity() >= sizeof(std::string))
+            {
+                Usage += Current.Path.capacity() + 1;
+            }
+        }
+        return Usage;
+    }
+
+    void PrintMemory(
+        char const* Name,
+        std::size_t Usage,
+        std::size_t Count)
+    {
+        std::printf(
+            "%-48s %10.1f MiB %10.1f B/item\n",
+            Name,
+            static_cast<double>(Usage) / (1024.0 * 1024.0),
+            static_cast<double>(Usage) / static_cast<double>(Count));
+    }
+
+    void Run(
+        std::size_t Count,
+        bool UniqueNames,
+        std::size_t SpillBudget,
+        std::string const& SpillDirectory)
+    {
+        std::string const Suffix = UniqueNames
+            ? " (unique names)"
+            : " (repeated names)";
+        std::string Path;
+
+        std::uint64_t ExpectedSize = 0;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            ExpectedSize += ::GetItem(i).Size;
+        }
+
+        std::vector<std::size_t> RandomIndexes(Count / 10 + 1);
+        std::mt19937_64 Random(1);
+        for (std::size_t& Index : RandomIndexes)
+        {
+            Index = std::uniform_int_distribution<std::size_t>(
+                0,
+                Count - 1)(Random);
+        }
+
+        {
+            std::vector<PlainItem> Items;
+
+            NSudoTest::Stopwatch Timer;
+            for (std::size_t i = 0; i < Count; ++i)
+            {
+                ::GetItemPath(i, UniqueNames, Path);
+                Items.push_back(PlainItem{ Path, ::GetItem(i) });
+            }
+            NSudoTest::PrintMeasurement(
+                "Vector of paths, add" + Suffix,
+                Timer.GetSeconds(),
+                static_cast<double>(Count),
+                "items");
+            ::PrintMemory(
+                "  memory",
+                ::GetPlainMemoryUsage(Items),
+                Count);
+        }
+
+        for (int Spill = 0; Spill < 2; ++Spill)
+        {
+            NSudoSweeper::ResultStoreOptions Options;
+            if (Spill)
+            {
+                Options.MemoryBudget = SpillBudget;
+                Options.SpillDirectory = SpillDirectory;
+            }
+            NSudoSweeper::ResultStore Store(Options);
+            std::string Name = Spill
+                ? "Spilled store"
+                : "Result store";
+
+            NSudoTest::Stopwatch Timer;
+            for (std::size_t i = 0; i < Count; ++i)
+            {
+                ::GetItemPath(i, UniqueNames, Path);
+                Store.Add(Path, ::GetItem(i));
+            }
+            NSudoTest::PrintMeasurement(
+                Name + ", add" + Suffix,
+                Timer.GetSeconds(),
+                static_cast<double>(Count),
+                "items");
+
+            NSudoSweeper::ResultStoreStatistics Statistics =
+                Store.GetStatistics();
+            ::PrintMemory("  memory", Statistics.MemoryUsage, Count);
+            std::printf(
+                "  %zu nodes, %zu names, %zu spilled chunks\n",
+                Statistics.Nodes,
+                Statistics.Names,
+                Statistics.SpilledChunks);
+            NSUDO_TEST_CHECK_EQUAL(Store.GetSpillError(), 0);
+            if (Spill)
+            {
+                NSUDO_TEST_CHECK(Statistics.SpilledChunks > 0);
+            }
+
+            std::uint64_t Size = 0;
+            Timer.Restart();
+            for (std::size_t i = 0; i < Store.GetChunkCount(); ++i)
+            {
+                NSudoSweeper::ResultStoreChunk Columns;
+                if (!NSUDO_TEST_CHECK(Store.GetChunk(i, Columns)))
+                {
+                    break;
+                }
+                for (std::size_t Row = 0; Row < Columns.Count; ++Row)
+                {
+                    Size += Columns.Sizes[Row];
+                }
+            }
+            NSudoTest::PrintMeasurement(
+                Name + ", read chunks" + Suffix,
+                Timer.GetSeconds(),
+                static_cast<double>(Count),
+                "items");
+            NSUDO_TEST_CHECK_EQUAL(Size, ExpectedSize);
+
+            std::uint64_t FileIds = 0;
+            std::uint64_t ExpectedFileIds = 0;
+            Timer.Restart();
+            for (std::size_t Index : RandomIndexes)
+            {
+                NSudoSweeper::ResultStoreItem Item;
+                Store.GetItem(Index, Item);
+                FileIds += Item.FileId;
+            }
+            NSudoTest::PrintMeasurement(
+                Name + ", random items" + Suffix,
+                Timer.GetSeconds(),
+                static_cast<double>(RandomIndexes.size()),
+                "items");
+            for (std::size_t Index : RandomIndexes)
+            {
+                ExpectedFileIds += Index + 1;
+            }
+            NSUDO_TEST_CHECK_EQUAL(FileIds, ExpectedFileIds);
+
+            std::size_t Mismatches = 0;
+            Mile::NativeString StoredPath;
+            Timer.Restart();
+            for (std::size_t Index : RandomIndexes)
+            {
+                Store.GetPath(Index, StoredPath);
+                ::GetItemPath(Index, UniqueNames, Path);
+                Mismatches += StoredPath != Path;
+            }
+            NSudoTest::PrintMeasurement(
+                Name + ", random paths" + Suffix,
+                Timer.GetSeconds(),
+                static_cast<double>(RandomIndexes.size()),
+                "items");
+            NSUDO_TEST_CHECK_EQUAL(Mismatches, 0U);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    const std::size_t Count = Options.Quick ? 100000 : 5000000;
+    const std::size_t SpillBudget =
+        (Options.Quick ? 2 : 64) * 1024 * 1024;
+
+    std::printf(
+        "%zu items, a spill budget of %zu MiB\n\n",
+        Count,
+        SpillBudget / (1024 * 1024));
+
+    NSudoTest::TemporaryDirectory SpillDirectory;
+    ::Run(Count, true, SpillBudget, SpillDirectory.GetPath());
+    std::printf("\n");
+    ::Run(Count, false, SpillBudget, SpillDirectory.GetPath());
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
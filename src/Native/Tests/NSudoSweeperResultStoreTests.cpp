@@ -0,0 +1,339 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperResultStoreTests.cpp
+ * PURPOSE:   Implementation for the scan result store tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperResultStore.h"
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * The path of the index-th item, with 16 files per directory and 8
+     * directories per parent, so the directories repeat in a row.
+     */
+    std::string GetItemPath(
+        std::size_t Index)
+    {
+        return
+            "/Root/Directory" + std::to_string(Index / 128) +
+            "/Sub" + std::to_string(Index / 16 % 8) +
+            "/File" + std::to_string(Index % 16) + ".tmp";
+    }
+
+    /**
+     * The metadata of the index-th item, whose every field differs from the
+     * ones of the other items.
+     */
+    NSudoSweeper::ResultStoreItem GetItem(
+        std::size_t Index)
+    {
+        std::uint64_t Value = static_cast<std::uint64_t>(Index);
+
+        NSudoSweeper::ResultStoreItem Item;
+        Item.Reason = static_cast<std::uint32_t>(Index % 7);
+        Item.Attributes = static_cast<std::uint32_t>(Index * 3 + 1);
+        Item.Size = Value * 1000 + 1;
+        Item.AllocationSize = Value * 4096 + 2;
+        Item.FileId = Value * 0x100000001ULL + 3;
+        Item.CreationTime = Value * 10000000 + 4;
+        Item.LastWriteTime = Value * 20000000 + 5;
+        return Item;
+    }
+
+    bool IsSameItem(
+        NSudoSweeper::ResultStoreItem const& Left,
+        NSudoSweeper::ResultStoreItem const& Right)
+    {
+        return Left.Reason == Right.Reason &&
+            Left.Attributes == Right.Attributes &&
+            Left.Size == Right.Size &&
+            Left.AllocationSize == Right.AllocationSize &&
+            Left.FileId == Right.FileId &&
+            Left.CreationTime == Right.CreationTime &&
+            Left.LastWriteTime == Right.LastWriteTime;
+    }
+
+    void AddItems(
+        NSudoSweeper::ResultStore& Store,
+        std::size_t Begin,
+        std::size_t End)
+    {
+        for (std::size_t i = Begin; i < End; ++i)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Store.Add(::GetItemPath(i), ::GetItem(i)),
+                i);
+        }
+    }
+
+    /**
+     * Checks an item through GetItem and GetPath.
+     */
+    void CheckItem(
+        NSudoSweeper::ResultStore& Store,
+        std::size_t Index)
+    {
+        NSudoSweeper::ResultStoreItem Item;
+        if (NSUDO_TEST_CHECK(Store.GetItem(Index, Item)))
+        {
+            if (!::IsSameItem(Item, ::GetItem(Index)))
+            {
+                NSudoTest::ReportFailure(
+                    __FILE__,
+                    __LINE__,
+                    "IsSameItem(Item, GetItem(Index))",
+                    std::to_string(Index));
+            }
+
+            Mile::NativeString NodePath;
+            Store.GetNodePath(Item.Node, NodePath);
+            NSUDO_TEST_CHECK_EQUAL(NodePath, ::GetItemPath(Index));
+        }
+
+        Mile::NativeString Path;
+        if (NSUDO_TEST_CHECK(Store.GetPath(Index, Path)))
+        {
+            NSUDO_TEST_CHECK_EQUAL(Path, ::GetItemPath(Index));
+        }
+    }
+
+    /**
+     * Checks all items through GetChunk.
+     */
+    void CheckChunks(
+        NSudoSweeper::ResultStore& Store)
+    {
+        std::size_t Expected = 0;
+        for (std::size_t i = 0; i < Store.GetChunkCount(); ++i)
+        {
+            NSudoSweeper::ResultStoreChunk Columns;
+            if (!NSUDO_TEST_CHECK(Store.GetChunk(i, Columns)))
+            {
+                return;
+            }
+            NSUDO_TEST_CHECK_EQUAL(Columns.FirstIndex, Expected);
+
+            for (std::size_t Row = 0; Row < Columns.Count; ++Row)
+            {
+                NSudoSweeper::ResultStoreItem Item;
+                Item.Reason = Columns.Reasons[Row];
+                Item.Attributes = Columns.Attributes[Row];
+                Item.Size = Columns.Sizes[Row];
+                Item.AllocationSize = Columns.AllocationSizes[Row];
+                Item.FileId = Columns.FileIds[Row];
+                Item.CreationTime = Columns.CreationTimes[Row];
+                Item.LastWriteTime = Columns.LastWriteTimes[Row];
+                if (!::IsSameItem(Item, ::GetItem(Expected)))
+                {
+                    NSudoTest::ReportFailure(
+                        __FILE__,
+                        __LINE__,
+                        "IsSameItem(Item, GetItem(Expected))",
+                        std::to_string(Expected));
+                    return;
+                }
+                ++Expected;
+            }
+        }
+        NSUDO_TEST_CHECK_EQUAL(Expected, Store.GetCount());
+    }
+
+    std::size_t CountFiles(
+        std::string const& Directory)
+    {
+        std::size_t Count = 0;
+        for (auto const& Entry :
+            std::filesystem::directory_iterator(Directory))
+        {
+            static_cast<void>(Entry);
+            ++Count;
+        }
+        return Count;
+    }
+}
+
+NSUDO_TEST_CASE(PathsAndNodes)
+{
+    NSudoSweeper::ResultStore Store;
+
+    char const* const Paths[] =
+    {
+        "/Root/A/File.tmp",
+        "/Root/A/Other.tmp",
+        "/Root/B/File.tmp",
+        "/Root/A/Sub/File.tmp",
+        "/Top.tmp",
+        "Relative.tmp",
+        "/Root/A/File.tmp",
+    };
+    for (std::size_t i = 0; i < sizeof(Paths) / sizeof(*Paths); ++i)
+    {
+        Store.Add(Paths[i], ::GetItem(i));
+    }
+
+    for (std::size_t i = 0; i < sizeof(Paths) / sizeof(*Paths); ++i)
+    {
+        Mile::NativeString Path;
+        NSUDO_TEST_CHECK(Store.GetPath(i, Path));
+        NSUDO_TEST_CHECK_EQUAL(Path, std::string(Paths[i]));
+    }
+
+    // The same path is the same node, and the parent of a node always
+    // precedes it.
+    NSudoSweeper::ResultStoreItem First;
+    NSudoSweeper::ResultStoreItem Last;
+    NSUDO_TEST_CHECK(Store.GetItem(0, First));
+    NSUDO_TEST_CHECK(Store.GetItem(6, Last));
+    NSUDO_TEST_CHECK_EQUAL(First.Node, Last.Node);
+    for (std::uint32_t Node = 0; Node < Store.GetNodeCount(); ++Node)
+    {
+        std::uint32_t Parent = Store.GetNodeParent(Node);
+        NSUDO_TEST_CHECK(
+            Parent == NSudoSweeper::ResultStoreNoNode || Parent < Node);
+    }
+    NSUDO_TEST_CHECK_EQUAL(
+        std::string(Store.GetNodeName(First.Node)),
+        std::string("File.tmp"));
+
+    // "", Root, A, B, Sub, File.tmp, Other.tmp, Top.tmp and Relative.tmp.
+    NSudoSweeper::ResultStoreStatistics Statistics = Store.GetStatistics();
+    NSUDO_TEST_CHECK_EQUAL(Statistics.Items, 7U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.Names, 9U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.Nodes, 11U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.SpilledChunks, 0U);
+
+    NSudoSweeper::ResultStoreItem Item;
+    Mile::NativeString Path;
+    NSUDO_TEST_CHECK(!Store.GetItem(7, Item));
+    NSUDO_TEST_CHECK(!Store.GetPath(7, Path));
+    NSudoSweeper::ResultStoreChunk Columns;
+    NSUDO_TEST_CHECK(!Store.GetChunk(1, Columns));
+
+    Store.Clear();
+    NSUDO_TEST_CHECK_EQUAL(Store.GetCount(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetNodeCount(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetChunkCount(), 0U);
+    NSUDO_TEST_CHECK_EQUAL(Store.Add("/Again.tmp", ::GetItem(0)), 0U);
+    NSUDO_TEST_CHECK(Store.GetPath(0, Path));
+    NSUDO_TEST_CHECK_EQUAL(Path, std::string("/Again.tmp"));
+}
+
+NSUDO_TEST_CASE(ItemsInMemory)
+{
+    const std::size_t Count = 2 * NSudoSweeper::ResultStoreChunkSize + 100;
+
+    NSudoSweeper::ResultStore Store;
+    ::AddItems(Store, 0, Count);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetCount(), Count);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetChunkCount(), 3U);
+
+    ::CheckChunks(Store);
+    for (std::size_t i = 0; i < Count; i += 97)
+    {
+        ::CheckItem(Store, i);
+    }
+
+    // 16 distinct file names, the directories, the subdirectories and the
+    // two top segments.
+    NSudoSweeper::ResultStoreStatistics Statistics = Store.GetStatistics();
+    std::size_t Directories = (Count + 127) / 128;
+    NSUDO_TEST_CHECK_EQUAL(Statistics.Names, 16 + Directories + 8 + 2);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.SpilledChunks, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.SpilledBytes, 0U);
+}
+
+NSUDO_TEST_CASE(SpillRoundTrip)
+{
+    const std::size_t ChunkSize = NSudoSweeper::ResultStoreChunkSize;
+    const std::size_t Count = 5 * ChunkSize + ChunkSize / 2;
+
+    NSudoTest::TemporaryDirectory Directory;
+
+    // A budget of 1 byte spills every full chunk.
+    NSudoSweeper::ResultStoreOptions Options;
+    Options.MemoryBudget = 1;
+    Options.SpillDirectory = Directory.GetPath();
+    NSudoSweeper::ResultStore Store(Options);
+    ::AddItems(Store, 0, Count);
+
+    NSUDO_TEST_CHECK_EQUAL(Store.GetSpillError(), 0);
+    NSudoSweeper::ResultStoreStatistics Statistics = Store.GetStatistics();
+    NSUDO_TEST_CHECK_EQUAL(Statistics.Items, Count);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.SpilledChunks, 5U);
+    NSUDO_TEST_CHECK(Statistics.SpilledBytes > 0);
+    NSUDO_TEST_CHECK_EQUAL(
+        Statistics.SpilledBytes % Statistics.SpilledChunks,
+        0U);
+
+    // The spill file is unlinked as soon as it is created.
+    NSUDO_TEST_CHECK_EQUAL(::CountFiles(Directory.GetPath()), 0U);
+
+    // Sequential reads load whole chunks, single reads read the fields,
+    // and reads which alternate between chunks reload them.
+    ::CheckChunks(Store);
+    for (std::size_t i = 0; i < Count; i += 31)
+    {
+        ::CheckItem(Store, i);
+    }
+    std::mt19937 Random(1);
+    for (int i = 0; i < 2000; ++i)
+    {
+        ::CheckItem(Store, std::uniform_int_distribution<std::size_t>(
+            0,
+            Count - 1)(Random));
+    }
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+        ::CheckItem(Store, i);
+        ::CheckItem(Store, 3 * ChunkSize + i);
+    }
+
+    // Items added after the reads spill too, and the cached chunk stays
+    // valid.
+    ::CheckItem(Store, 1);
+    ::AddItems(Store, Count, 7 * ChunkSize + 1);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetSpillError(), 0);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetStatistics().SpilledChunks, 7U);
+    ::CheckItem(Store, 1);
+    ::CheckItem(Store, 7 * ChunkSize);
+    ::CheckChunks(Store);
+
+    // Clear deletes the spill file, and the store can spill again.
+    Store.Clear();
+    NSUDO_TEST_CHECK_EQUAL(Store.GetStatistics().SpilledBytes, 0U);
+    ::AddItems(Store, 0, 2 * ChunkSize + 1);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetStatistics().SpilledChunks, 2U);
+    ::CheckChunks(Store);
+    ::CheckItem(Store, ChunkSize + 5);
+}
+
+NSUDO_TEST_CASE(FailedSpillsKeepTheItems)
+{
+    const std::size_t Count = 2 * NSudoSweeper::ResultStoreChunkSize + 1;
+
+    NSudoTest::TemporaryDirectory Directory;
+
+    NSudoSweeper::ResultStoreOptions Options;
+    Options.MemoryBudget = 1;
+    Options.SpillDirectory = Directory.Join("Missing");
+    NSudoSweeper::ResultStore Store(Options);
+    ::AddItems(Store, 0, Count);
+
+    NSUDO_TEST_CHECK(Store.GetSpillError() != 0);
+    NSUDO_TEST_CHECK_EQUAL(Store.GetStatistics().SpilledChunks, 0U);
+    ::CheckChunks(Store);
+    ::CheckItem(Store, 0);
+    ::CheckItem(Store, Count - 1);
+}
@@ -0,0 +1,629 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperScanCacheTests.cpp
+ * PURPOSE:   Implementation for the incremental scan cache tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperScanCache.h"
+#include "NSudoSweeperStandardHandler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+
+namespace
+{
+    /**
+     * The difference between January 1, 1601 and January 1, 1970, in
+     * 100-nanosecond intervals.
+     */
+    const std::uint64_t UnixEpochOffset = 116444736000000000ULL;
+
+    /**
+     * Retrieves a time before now, in 100-nanosecond intervals since
+     * January 1, 1601 (UTC).
+     */
+    std::uint64_t GetFileTime(
+        std::chrono::seconds Ago)
+    {
+        return UnixEpochOffset + static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch() -
+                Ago).count() / 100);
+    }
+
+    NSudoSweeper::DirectoryFingerprint MakeFingerprint(
+        std::uint64_t ChangeTime,
+        std::uint64_t FileId)
+    {
+        NSudoSweeper::DirectoryFingerprint Fingerprint;
+        Fingerprint.ChangeTime = ChangeTime;
+        Fingerprint.FileId = FileId;
+        return Fingerprint;
+    }
+
+    NSudoSweeper::ScanCacheItem MakeItem(
+        std::uint64_t Size,
+        std::uint64_t FileId)
+    {
+        NSudoSweeper::ScanCacheItem Item;
+        Item.Size = Size;
+        Item.AllocationSize = (Size + 4095) / 4096 * 4096;
+        Item.FileId = FileId;
+        return Item;
+    }
+
+    const char Identity[] = "Include = [ \"File|/Root/*.tmp\" ]";
+
+    /**
+     * The fingerprints of the directories of the scan which
+     * SaveScan writes, an hour before the scan.
+     */
+    struct ScannedDirectories
+    {
+        NSudoSweeper::DirectoryFingerprint Root;
+        NSudoSweeper::DirectoryFingerprint Sub;
+    };
+
+    /**
+     * Writes the cache of a scan of /Root, whose items are A.tmp and
+     * Sub/B.tmp.
+     */
+    ScannedDirectories SaveScan(
+        std::string const& Path)
+    {
+        ScannedDirectories Directories;
+        std::uint64_t ChangeTime = ::GetFileTime(std::chrono::hours(1));
+        Directories.Root = ::MakeFingerprint(ChangeTime, 100);
+        Directories.Sub = ::MakeFingerprint(ChangeTime + 1, 101);
+
+        NSudoSweeper::ScanCache Cache;
+        Cache.SetIdentity(Identity);
+        Cache.BeginScan();
+
+        Cache.AddDirectory("/Root", Directories.Root);
+        Cache.AddDirectory("/Root/Sub", Directories.Sub);
+        Cache.AddItem("/Root/A.tmp", ::MakeItem(10, 1));
+        Cache.AddItem("/Root/Sub/B.tmp", ::MakeItem(5000, 2));
+        Cache.CompleteDirectory("/Root", 3, { "/Root/Sub" });
+        Cache.CompleteDirectory("/Root/Sub", 1, { });
+
+        NSudoSweeper::ScanCacheStatistics Statistics = Cache.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.CachedDirectories, 0U);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.EnumeratedDirectories, 2U);
+
+        NSudoSweeper::ScanCacheError Error;
+        NSUDO_TEST_CHECK(Cache.Save(Path, Error));
+        NSUDO_TEST_CHECK(!Error.Message);
+        return Directories;
+    }
+
+    bool LoadScan(
+        NSudoSweeper::ScanCache& Cache,
+        std::string const& Path,
+        NSudoSweeper::ScanCacheError& Error)
+    {
+        Cache.SetIdentity(Identity);
+        bool Result = Cache.Load(Path, Error);
+        Cache.BeginScan();
+        return Result;
+    }
+
+    NSudoSweeper::ScanCacheDecision Decide(
+        NSudoSweeper::ScanCache const& Cache,
+        char const* Path,
+        NSudoSweeper::DirectoryFingerprint const& Fingerprint)
+    {
+        NSudoSweeper::ScanCacheDirectory const* Previous = nullptr;
+        NSudoSweeper::ScanCacheDecision Decision = Cache.Decide(
+            Path,
+            Fingerprint,
+            Previous);
+        NSUDO_TEST_CHECK_EQUAL(
+            Previous != nullptr,
+            Decision != NSudoSweeper::ScanCacheDecision::Enumerate);
+        return Decision;
+    }
+
+    /**
+     * Checks a cache which cannot be loaded is empty, so every directory
+     * is enumerated.
+     */
+    void CheckNotLoaded(
+        std::string const& Path,
+        char const* Identity,
+        std::string const& Message)
+    {
+        NSudoSweeper::ScanCache Cache;
+        Cache.SetIdentity(Identity);
+        NSudoSweeper::ScanCacheError Error;
+        NSUDO_TEST_CHECK(!Cache.Load(Path, Error));
+        if (NSUDO_TEST_CHECK(Error.Message != nullptr))
+        {
+            NSUDO_TEST_CHECK_EQUAL(std::string(Error.Message), Message);
+        }
+        NSUDO_TEST_CHECK_EQUAL(Cache.GetStatistics().CachedDirectories, 0U);
+
+        Cache.BeginScan();
+        NSUDO_TEST_CHECK(::Decide(
+            Cache,
+            "/Root",
+            ::MakeFingerprint(::GetFileTime(std::chrono::hours(1)), 100)) ==
+            NSudoSweeper::ScanCacheDecision::Enumerate);
+    }
+
+    /**
+     * Runs scans of the standard handler and records their items.
+     */
+    class HandlerScan
+    {
+    public:
+
+        std::map<std::string, std::uint64_t> Items;
+
+        NSUDO_SWEEPER_RESULT Run(
+            std::string const& Configuration,
+            std::string const& CachePath = std::string())
+        {
+            this->Items.clear();
+
+            NSUDO_SWEEPER_HANDLER_REQUEST Request = {};
+            Request.Size = sizeof(Request);
+            Request.Phase = NSUDO_SWEEPER_PHASE_SCAN;
+            Request.Configuration = Configuration.c_str();
+            Request.Callback = HandlerScan::Callback;
+            Request.UserData = this;
+            Request.ScanCachePath = CachePath.empty()
+                ? nullptr
+                : CachePath.c_str();
+
+            NSUDO_SWEEPER_HANDLER_SUMMARY Summary = {};
+            Summary.Size = sizeof(Summary);
+            return ::NSudoSweeperStandardCleanupHandlerV2(&Request, &Summary);
+        }
+
+    private:
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API Callback(
+            uint32_t Message,
+            void* Parameter,
+            void* UserData)
+        {
+            HandlerScan* Self = static_cast<HandlerScan*>(UserData);
+            if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+            {
+                NSUDO_SWEEPER_ITEM_BATCH const& Batch =
+                    *static_cast<NSUDO_SWEEPER_ITEM_BATCH*>(Parameter);
+                for (std::uint32_t i = 0; i < Batch.Count; ++i)
+                {
+                    NSUDO_SWEEPER_ITEM const& Item = Batch.Items[i];
+                    Self->Items[std::string(Item.Path, Item.PathLength)] =
+                        Item.Size;
+                }
+            }
+            return NSUDO_SWEEPER_S_OK;
+        }
+    };
+
+    std::string CreateConfiguration(
+        std::string const& Root,
+        std::string const& Include)
+    {
+        return
+            "[Metadata.en]\n"
+            "Name = \"Test\"\n"
+            "Description = \"Test\"\n"
+            "[Configuration]\n"
+            "Plugin = \"NSudoSweeperCore.dll\"\n"
+            "Handler = \"NSudoSweeperStandardCleanupHandler\"\n"
+            "Detect = [ \"File|" + Root + "\" ]\n"
+            "Include = [ \"File|" + Root + "/**/" + Include + "\" ]\n";
+    }
+
+    /**
+     * Checks a scan with the cache reports what a scan without it does.
+     */
+    void CheckCachedScan(
+        std::string const& Configuration,
+        std::string const& CachePath,
+        char const* Step)
+    {
+        HandlerScan Uncached;
+        HandlerScan Cached;
+        NSUDO_TEST_CHECK_EQUAL(
+            Uncached.Run(Configuration),
+            NSUDO_SWEEPER_S_OK);
+        NSUDO_TEST_CHECK_EQUAL(
+            Cached.Run(Configuration, CachePath),
+            NSUDO_SWEEPER_S_OK);
+        if (!NSUDO_TEST_CHECK(Cached.Items == Uncached.Items))
+        {
+            NSudoTest::ReportFailure(__FILE__, __LINE__, "Step", Step);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(UnchangedDirectoriesAreSkipped)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Test.scancache");
+    ::ScannedDirectories Directories = ::SaveScan(Path);
+
+    NSudoSweeper::ScanCache Cache;
+    NSudoSweeper::ScanCacheError Error;
+    NSUDO_TEST_CHECK(::LoadScan(Cache, Path, Error));
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetStatistics().CachedDirectories, 2U);
+    NSUDO_TEST_CHECK(Cache.NeedsFingerprints());
+
+    // The entries of an unchanged directory are used, and the sizes of its
+    // items are queried again.
+    NSudoSweeper::ScanCacheDirectory const* Previous = nullptr;
+    NSUDO_TEST_CHECK(
+        Cache.Decide("/Root", Directories.Root, Previous) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+    if (NSUDO_TEST_CHECK(Previous != nullptr))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Previous->Fingerprint.EntryCount, 3U);
+        NSUDO_TEST_CHECK_EQUAL(Previous->Fingerprint.AggregateSize, 10U);
+        if (NSUDO_TEST_CHECK_EQUAL(Previous->Subdirectories.size(), 1U))
+        {
+            NSUDO_TEST_CHECK_EQUAL(Previous->Subdirectories[0], "Sub");
+        }
+        if (NSUDO_TEST_CHECK_EQUAL(Previous->Items.size(), 1U))
+        {
+            NSUDO_TEST_CHECK_EQUAL(Previous->Items[0].Name, "A.tmp");
+            NSUDO_TEST_CHECK_EQUAL(Previous->Items[0].Size, 10U);
+            NSUDO_TEST_CHECK_EQUAL(Previous->Items[0].AllocationSize, 4096U);
+            NSUDO_TEST_CHECK_EQUAL(Previous->Items[0].FileId, 1U);
+        }
+    }
+    NSUDO_TEST_CHECK(Cache.IsItemChanged(
+        NSudoSweeper::ScanCacheDecision::Refresh,
+        1));
+    NSUDO_TEST_CHECK(!Cache.IsItemChanged(
+        NSudoSweeper::ScanCacheDecision::Enumerate,
+        1));
+
+    // A trailing separator names the same directory.
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root/Sub/", Directories.Sub) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+
+    // The entry count and the aggregate size are compared when they are
+    // known.
+    NSudoSweeper::DirectoryFingerprint Counted = Directories.Root;
+    Counted.EntryCount = 3;
+    Counted.AggregateSize = 10;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Counted) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+
+    // A reused directory and its reported items are saved again, so the
+    // scan after the next one skips it too.
+    Cache.ReuseDirectory(
+        "/Root",
+        NSudoSweeper::ScanCacheDecision::Refresh,
+        *Previous);
+    Cache.AddItem("/Root/A.tmp", ::MakeItem(20, 1));
+    NSudoSweeper::ScanCacheStatistics Statistics = Cache.GetStatistics();
+    NSUDO_TEST_CHECK_EQUAL(Statistics.RefreshedDirectories, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.ReusedDirectories, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Statistics.EnumeratedDirectories, 0U);
+    NSUDO_TEST_CHECK(Cache.Save(Path, Error));
+
+    NSudoSweeper::ScanCache Next;
+    NSUDO_TEST_CHECK(::LoadScan(Next, Path, Error));
+    NSUDO_TEST_CHECK_EQUAL(Next.GetStatistics().CachedDirectories, 1U);
+    NSUDO_TEST_CHECK(
+        Next.Decide("/Root", Directories.Root, Previous) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+    if (NSUDO_TEST_CHECK(Previous != nullptr) &&
+        NSUDO_TEST_CHECK_EQUAL(Previous->Items.size(), 1U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Previous->Items[0].Size, 20U);
+        NSUDO_TEST_CHECK_EQUAL(Previous->Subdirectories.size(), 1U);
+    }
+
+    // The subdirectory was not walked by that scan, so it is enumerated.
+    NSUDO_TEST_CHECK(
+        ::Decide(Next, "/Root/Sub", Directories.Sub) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+}
+
+NSUDO_TEST_CASE(ChangedDirectoriesAreRescanned)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Test.scancache");
+    ::ScannedDirectories Directories = ::SaveScan(Path);
+
+    NSudoSweeper::ScanCache Cache;
+    NSudoSweeper::ScanCacheError Error;
+    NSUDO_TEST_CHECK(::LoadScan(Cache, Path, Error));
+
+    // A new modification or change time.
+    NSudoSweeper::DirectoryFingerprint Changed = Directories.Root;
+    Changed.ChangeTime += 10000000;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // A time which goes back, such as after a restore.
+    Changed.ChangeTime = Directories.Root.ChangeTime - 1;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // Another directory with the same path and time.
+    Changed = Directories.Root;
+    Changed.FileId = 200;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // A file system without times.
+    Changed = Directories.Root;
+    Changed.ChangeTime = 0;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // Known entry counts and sizes which differ.
+    Changed = Directories.Root;
+    Changed.EntryCount = 4;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+    Changed = Directories.Root;
+    Changed.AggregateSize = 11;
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Changed) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // A directory the previous scan did not walk.
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root/New", Directories.Root) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // The enumerated directories are counted, and only the complete ones
+    // are saved. A directory without a time is never complete.
+    Cache.AddDirectory("/Root", Directories.Root);
+    Cache.AddDirectory("/Root/Sub", Directories.Sub);
+    Cache.AddDirectory("/Root/NoTime", ::MakeFingerprint(0, 102));
+    Cache.CompleteDirectory("/Root", 3, { "/Root/Sub", "/Root/NoTime" });
+    Cache.CompleteDirectory("/Root/NoTime", 0, { });
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetStatistics().EnumeratedDirectories, 3U);
+    NSUDO_TEST_CHECK(Cache.Save(Path, Error));
+
+    NSudoSweeper::ScanCache Next;
+    NSUDO_TEST_CHECK(::LoadScan(Next, Path, Error));
+    NSUDO_TEST_CHECK_EQUAL(Next.GetStatistics().CachedDirectories, 1U);
+    NSUDO_TEST_CHECK(
+        ::Decide(Next, "/Root", Directories.Root) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+    NSUDO_TEST_CHECK(
+        ::Decide(Next, "/Root/Sub", Directories.Sub) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+    NSUDO_TEST_CHECK(
+        ::Decide(Next, "/Root/NoTime", ::MakeFingerprint(0, 102)) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+}
+
+NSUDO_TEST_CASE(RecentChangeTimesAreNotTrusted)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Test.scancache");
+
+    // The directory changed in the second before the scan started, so it
+    // may have changed again in the same tick of a coarse clock.
+    NSudoSweeper::DirectoryFingerprint Recent =
+        ::MakeFingerprint(::GetFileTime(std::chrono::seconds(1)), 100);
+    {
+        NSudoSweeper::ScanCache Cache;
+        Cache.SetIdentity(Identity);
+        Cache.BeginScan();
+        Cache.AddDirectory("/Root", Recent);
+        Cache.CompleteDirectory("/Root", 0, { });
+        NSudoSweeper::ScanCacheError Error;
+        NSUDO_TEST_CHECK(Cache.Save(Path, Error));
+    }
+
+    NSudoSweeper::ScanCache Cache;
+    NSudoSweeper::ScanCacheError Error;
+    NSUDO_TEST_CHECK(::LoadScan(Cache, Path, Error));
+    NSUDO_TEST_CHECK(
+        ::Decide(Cache, "/Root", Recent) ==
+        NSudoSweeper::ScanCacheDecision::Enumerate);
+
+    // A file system with exact times can trust it.
+    NSudoSweeper::ScanCacheOptions Options;
+    Options.TimestampGranularity = 0;
+    NSudoSweeper::ScanCache Exact(Options);
+    NSUDO_TEST_CHECK(::LoadScan(Exact, Path, Error));
+    NSUDO_TEST_CHECK(
+        ::Decide(Exact, "/Root", Recent) ==
+        NSudoSweeper::ScanCacheDecision::Refresh);
+}
+
+NSUDO_TEST_CASE(StaleAndDamagedCachesAreNotLoaded)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Test.scancache");
+    ::SaveScan(Path);
+
+    std::string Content;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Content));
+    NSUDO_TEST_CHECK(Content.size() > 72);
+    NSUDO_TEST_CHECK_EQUAL(Content.substr(0, 8), "NSSCACHE");
+
+    // A missing file reports the system error.
+    {
+        NSudoSweeper::ScanCache Cache;
+        NSudoSweeper::ScanCacheError Error;
+        NSUDO_TEST_CHECK(!Cache.Load(Directory.Join("Missing"), Error));
+        NSUDO_TEST_CHECK_EQUAL(Error.SystemError, ENOENT);
+    }
+
+    struct Damage
+    {
+        char const* Name;
+        std::string Content;
+        char const* Message;
+    };
+    std::vector<Damage> Damages;
+
+    Damages.push_back({ "empty", std::string(), "The file is not a scan cache" });
+    Damages.push_back({
+        "truncated header",
+        Content.substr(0, 71),
+        "The file is not a scan cache" });
+
+    std::string Changed = Content;
+    Changed[0] = 'X';
+    Damages.push_back({ "magic", Changed, "The file is not a scan cache" });
+
+    Changed = Content;
+    Changed[8] = 2;
+    Damages.push_back({
+        "version",
+        Changed,
+        "The version of the scan cache is not supported" });
+
+    Damages.push_back({
+        "truncated",
+        Content.substr(0, Content.size() - 1),
+        "The scan cache is damaged" });
+    Damages.push_back({
+        "appended",
+        Content + "X",
+        "The scan cache is damaged" });
+
+    // A flipped bit of the body, the key and the hash.
+    for (std::size_t Offset : { Content.size() - 3, std::size_t(24),
+        std::size_t(64) })
+    {
+        Changed = Content;
+        Changed[Offset] ^= 0x10;
+        Damages.push_back({ "flipped", Changed, "The scan cache is damaged" });
+    }
+
+    for (Damage const& Current : Damages)
+    {
+        NSudoTest::WriteFile(Path, Current.Content);
+        std::size_t Failures = NSudoTest::GetFailureCount();
+        ::CheckNotLoaded(Path, Identity, Current.Message);
+        if (NSudoTest::GetFailureCount() != Failures)
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "Damage",
+                Current.Name);
+        }
+    }
+
+    // A cache which fails to load forgets the one loaded before.
+    NSudoTest::WriteFile(Path, Content);
+    NSudoSweeper::ScanCache Cache;
+    NSudoSweeper::ScanCacheError Error;
+    NSUDO_TEST_CHECK(::LoadScan(Cache, Path, Error));
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetStatistics().CachedDirectories, 2U);
+    NSUDO_TEST_CHECK(!Cache.Load(Directory.Join("Missing"), Error));
+    NSUDO_TEST_CHECK_EQUAL(Cache.GetStatistics().CachedDirectories, 0U);
+}
+
+NSUDO_TEST_CASE(DescriptorChangesInvalidateTheCache)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Test.scancache");
+    ::SaveScan(Path);
+
+    // The rules of another configuration select other items.
+    ::CheckNotLoaded(
+        Path,
+        "Include = [ \"File|/Root/*.log\" ]",
+        "The scan cache belongs to another configuration");
+
+    NSudoSweeper::ScanCache Cache;
+    NSudoSweeper::ScanCacheError Error;
+    NSUDO_TEST_CHECK(::LoadScan(Cache, Path, Error));
+    NSUDO_TEST_CHECK(!Error.Message);
+}
+
+NSUDO_TEST_CASE(HandlerScansWithTheCacheStayExact)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.Join("Root");
+    std::string CachePath = Directory.Join("Test.scancache");
+
+    NSudoTest::WriteFile(Root + "/A.tmp", std::string(10, 'a'));
+    NSudoTest::WriteFile(Root + "/Keep.log", "log");
+    NSudoTest::WriteFile(Root + "/Sub/B.tmp", std::string(20, 'b'));
+    NSudoTest::WriteFile(Root + "/Sub/Deep/C.tmp", std::string(30, 'c'));
+    NSudoTest::WriteFile(Root + "/Other/D.tmp", std::string(40, 'd'));
+
+    // The directories must be older than the 2 seconds the cache does not
+    // trust, or every scan enumerates them.
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+
+    std::string Configuration = ::CreateConfiguration(Root, "*.tmp");
+    ::CheckCachedScan(Configuration, CachePath, "first scan");
+    ::CheckCachedScan(Configuration, CachePath, "unchanged");
+
+    // A file which grows does not change its directory, so the size of a
+    // cached item is queried again.
+    NSudoTest::WriteFile(Root + "/Sub/B.tmp", std::string(25000, 'b'));
+    ::CheckCachedScan(Configuration, CachePath, "grown file");
+
+    // The directories whose entries change are enumerated.
+    NSudoTest::WriteFile(Root + "/Sub/Deep/E.tmp", "new");
+    std::remove((Root + "/Other/D.tmp").c_str());
+    std::rename(
+        (Root + "/A.tmp").c_str(),
+        (Root + "/Renamed.tmp").c_str());
+    ::CheckCachedScan(Configuration, CachePath, "changed directories");
+
+    // The cache of the previous rules does not hide the items of the new
+    // ones.
+    ::CheckCachedScan(
+        ::CreateConfiguration(Root, "*.log"),
+        CachePath,
+        "changed configuration");
+    ::CheckCachedScan(Configuration, CachePath, "restored configuration");
+
+    // A damaged cache is replaced by a full scan.
+    std::string Content;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(CachePath, Content));
+    if (NSUDO_TEST_CHECK(Content.size() > 72))
+    {
+        Content[Content.size() / 2] ^= 0x55;
+        NSudoTest::WriteFile(CachePath, Content);
+    }
+    ::CheckCachedScan(Configuration, CachePath, "damaged cache");
+    std::string Rewritten;
+    NSUDO_TEST_CHECK(NSudoTest::ReadFile(CachePath, Rewritten));
+    NSUDO_TEST_CHECK(Rewritten != Content);
+
+    HandlerScan Final;
+    NSUDO_TEST_CHECK_EQUAL(
+        Final.Run(Configuration, CachePath),
+        NSUDO_SWEEPER_S_OK);
+    std::map<std::string, std::uint64_t> const Expected =
+    {
+        { Root + "/Renamed.tmp", 10 },
+        { Root + "/Sub/B.tmp", 25000 },
+        { Root + "/Sub/Deep/C.tmp", 30 },
+        { Root + "/Sub/Deep/E.tmp", 3 },
+    };
+    NSUDO_TEST_CHECK(Final.Items == Expected);
+}
@@ -0,0 +1,671 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperSchedulerTests.cpp
+ * PURPOSE:   Implementation for the cleanup handler scheduler tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**
+     * What a synthetic handler does. The handler finds it by the
+     * configuration of its request, which is the name of the behavior.
+     */
+    struct Behavior
+    {
+        /**
+         * The number of progress callbacks, each after a sleep of StepTime.
+         * If it is 0, the handler calls back until the callback fails.
+         */
+        std::uint32_t Steps = 4;
+        std::chrono::milliseconds StepTime{ 5 };
+
+        /**
+         * The name of the volume whose running handlers are counted.
+         */
+        std::string Group;
+
+        /**
+         * The number of items the handler reports in one batch.
+         */
+        std::uint32_t ItemCount = 0;
+
+        /**
+         * Set when the handler starts.
+         */
+        std::atomic<bool> Started{ false };
+
+        /**
+         * The request the handler has received.
+         */
+        std::uint32_t Phase = 0;
+        bool HasCleanItems = false;
+        std::size_t CleanItemCount = 0;
+        std::string FirstCleanItem;
+    };
+
+    /**
+     * The behaviors and the handlers which are running.
+     */
+    class SyntheticHandlers
+    {
+    public:
+
+        std::map<std::string, Behavior> Behaviors;
+
+        std::mutex Mutex;
+        std::size_t Running = 0;
+        std::size_t MaximumRunning = 0;
+        std::map<std::string, std::size_t> RunningInGroup;
+        std::map<std::string, std::size_t> MaximumRunningInGroup;
+        std::vector<std::string> StartOrder;
+
+        void Enter(
+            std::string const& Name,
+            Behavior const& Current)
+        {
+            std::lock_guard<std::mutex> Lock(this->Mutex);
+            this->StartOrder.push_back(Name);
+            this->MaximumRunning = (std::max)(
+                this->MaximumRunning,
+                ++this->Running);
+            if (!Current.Group.empty())
+            {
+                std::size_t& Maximum =
+                    this->MaximumRunningInGroup[Current.Group];
+                Maximum = (std::max)(
+                    Maximum,
+                    ++this->RunningInGroup[Current.Group]);
+            }
+        }
+
+        void Leave(
+            Behavior const& Current)
+        {
+            std::lock_guard<std::mutex> Lock(this->Mutex);
+            --this->Running;
+            if (!Current.Group.empty())
+            {
+                --this->RunningInGroup[Current.Group];
+            }
+        }
+    };
+
+    SyntheticHandlers* g_Handlers = nullptr;
+
+    NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API SyntheticHandler(
+        NSUDO_SWEEPER_HANDLER_REQUEST const* Request,
+        NSUDO_SWEEPER_HANDLER_SUMMARY* Summary)
+    {
+        std::string Name = Request->Configuration;
+        Behavior& Current = g_Handlers->Behaviors.at(Name);
+
+        Current.Phase = Request->Phase;
+        Current.HasCleanItems =
+            (Request->Flags & NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS) != 0;
+        Current.CleanItemCount = static_cast<std::size_t>(
+            Request->CleanItemCount);
+        if (Request->CleanItemCount)
+        {
+            Current.FirstCleanItem.assign(
+                Request->CleanItems[0].Path,
+                Request->CleanItems[0].PathLength);
+        }
+
+        g_Handlers->Enter(Name, Current);
+        Current.Started.store(true);
+
+        NSUDO_SWEEPER_RESULT Result = NSUDO_SWEEPER_S_OK;
+
+        if (Current.ItemCount)
+        {
+            std::vector<NSUDO_SWEEPER_ITEM> Items(Current.ItemCount);
+            for (NSUDO_SWEEPER_ITEM& Item : Items)
+            {
+                Item.Path = Request->Configuration;
+                Item.PathLength = static_cast<std::uint32_t>(Name.size());
+                Item.Size = 1;
+            }
+
+            NSUDO_SWEEPER_ITEM_BATCH Batch = {};
+            Batch.Items = Items.data();
+            Batch.Count = Current.ItemCount;
+            Result = Request->Callback(
+                NSUDO_SWEEPER_ITEM_BATCH_MESSAGE,
+                &Batch,
+                Request->UserData);
+        }
+
+        // A handler without steps runs until the callback stops it, but
+        // no longer than ten seconds, so a broken scheduler fails the test
+        // instead of hanging it.
+        for (std::uint32_t Step = 1;
+            NSUDO_SWEEPER_S_OK == Result &&
+            (!Current.Steps || Step <= Current.Steps) &&
+            Step <= 2000;
+            ++Step)
+        {
+            std::this_thread::sleep_for(Current.StepTime);
+
+            std::uint32_t Progress = Current.Steps
+                ? Step * 100 / Current.Steps
+                : 0;
+            Result = Request->Callback(
+                NSUDO_SWEEPER_PROGRESS_MESSAGE,
+                &Progress,
+                Request->UserData);
+        }
+
+        Summary->ItemCount = Current.ItemCount;
+
+        g_Handlers->Leave(Current);
+        return Result;
+    }
+
+    /**
+     * Creates a job of a behavior.
+     */
+    NSudoSweeper::SchedulerJob MakeJob(
+        SyntheticHandlers& Handlers,
+        std::string const& Name,
+        std::string const& Group = std::string(),
+        std::uint32_t Steps = 4)
+    {
+        Behavior& Current = Handlers.Behaviors[Name];
+        Current.Steps = Steps;
+        Current.Group = Group;
+
+        NSudoSweeper::SchedulerJob Job;
+        Job.Handler = ::SyntheticHandler;
+        Job.Configuration = Name;
+        if (!Group.empty())
+        {
+            // POSIX uses a path which does not exist as its own volume key.
+            Job.Volumes.push_back("/NSudoSweeperSchedulerTests/" + Group);
+        }
+        return Job;
+    }
+
+    /**
+     * Waits until a handler starts, for up to ten seconds.
+     */
+    bool WaitForStart(
+        Behavior const& Current)
+    {
+        for (int i = 0; i < 10000 && !Current.Started.load(); ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return Current.Started.load();
+    }
+
+    NSudoSweeper::SchedulerOptions MakeOptions(
+        std::size_t MaximumConcurrency,
+        std::size_t VolumeConcurrency)
+    {
+        NSudoSweeper::SchedulerOptions Options;
+        Options.MaximumConcurrency = MaximumConcurrency;
+        Options.SolidStateVolumeConcurrency = VolumeConcurrency;
+        Options.RotationalVolumeConcurrency = VolumeConcurrency;
+        return Options;
+    }
+}
+
+NSUDO_TEST_CASE(JobsRunAndReportTheirResults)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(4);
+
+    NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(4, 4));
+
+    std::mutex MessageMutex;
+    std::map<std::size_t, std::uint32_t> ItemCounts;
+    Scheduler.SetMessageHandler([&](
+        std::size_t Job,
+        std::uint32_t Message,
+        void* Parameter) -> NSUDO_SWEEPER_RESULT
+    {
+        if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+        {
+            std::lock_guard<std::mutex> Lock(MessageMutex);
+            ItemCounts[Job] += reinterpret_cast<NSUDO_SWEEPER_ITEM_BATCH*>(
+                Parameter)->Count;
+        }
+        return NSUDO_SWEEPER_S_OK;
+    });
+
+    std::atomic<bool> Reporting{ false };
+    std::atomic<bool> Overlapped{ false };
+    std::vector<std::uint32_t> Progresses;
+    Scheduler.SetProgressHandler([&](std::uint32_t Progress)
+    {
+        if (Reporting.exchange(true))
+        {
+            Overlapped.store(true);
+        }
+        Progresses.push_back(Progress);
+        Reporting.store(false);
+    });
+
+    for (std::uint32_t i = 0; i < 6; ++i)
+    {
+        std::string Name = "Job" + std::to_string(i);
+        Handlers.Behaviors[Name].ItemCount = i + 1;
+        NSUDO_TEST_CHECK_EQUAL(
+            Scheduler.AddJob(::MakeJob(Handlers, Name)),
+            static_cast<std::size_t>(i));
+    }
+    NSUDO_TEST_CHECK_EQUAL(Scheduler.GetJobCount(), 6U);
+
+    NSUDO_TEST_CHECK(Scheduler.Start());
+    NSUDO_TEST_CHECK(!Scheduler.Start());
+    NSUDO_TEST_CHECK_EQUAL(
+        Scheduler.AddJob(::MakeJob(Handlers, "Late")),
+        SIZE_MAX);
+    Scheduler.Wait();
+
+    for (std::size_t i = 0; i < 6; ++i)
+    {
+        NSudoSweeper::SchedulerJobResult Result = Scheduler.GetResult(i);
+        NSUDO_TEST_CHECK(
+            Result.State == NSudoSweeper::SchedulerJobState::Completed);
+        NSUDO_TEST_CHECK_EQUAL(Result.Result, NSUDO_SWEEPER_S_OK);
+        NSUDO_TEST_CHECK_EQUAL(Result.Summary.ItemCount, i + 1);
+        NSUDO_TEST_CHECK_EQUAL(ItemCounts[i], i + 1);
+    }
+    NSUDO_TEST_CHECK(
+        Scheduler.GetResult(6).State ==
+        NSudoSweeper::SchedulerJobState::Pending);
+    NSUDO_TEST_CHECK(!Handlers.Behaviors["Late"].Started.load());
+
+    // The combined progress only increases, ends at 100 and is never
+    // reported concurrently.
+    NSUDO_TEST_CHECK_EQUAL(Scheduler.GetProgress(), 100U);
+    NSUDO_TEST_CHECK(!Overlapped.load());
+    NSUDO_TEST_CHECK(!Progresses.empty());
+    NSUDO_TEST_CHECK(Progresses.end() == std::adjacent_find(
+        Progresses.begin(),
+        Progresses.end(),
+        [](std::uint32_t Left, std::uint32_t Right)
+    {
+        return Left >= Right;
+    }));
+    NSUDO_TEST_CHECK(!Progresses.empty() && Progresses.back() == 100);
+
+    g_Handlers = nullptr;
+}
+
+NSUDO_TEST_CASE(RequestsCarryThePhaseAndTheItems)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(2);
+
+    std::vector<NSudoSweeper::HandlerHostItem> Items(1);
+    Items[0].Path = "/tmp/Item";
+    std::vector<NSudoSweeper::HandlerHostItem> NoItems;
+
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(2, 2));
+
+        NSudoSweeper::SchedulerJob Scan = ::MakeJob(Handlers, "Scan");
+        Scheduler.AddJob(Scan);
+
+        NSudoSweeper::SchedulerJob Clean = ::MakeJob(Handlers, "Clean");
+        Clean.Phase = NSUDO_SWEEPER_PHASE_CLEAN;
+        Clean.CleanItems = &Items;
+        Scheduler.AddJob(Clean);
+
+        NSudoSweeper::SchedulerJob Empty = ::MakeJob(Handlers, "Empty");
+        Empty.Phase = NSUDO_SWEEPER_PHASE_CLEAN;
+        Empty.CleanItems = &NoItems;
+        Scheduler.AddJob(Empty);
+
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+    }
+
+    Behavior const& Scan = Handlers.Behaviors["Scan"];
+    NSUDO_TEST_CHECK_EQUAL(Scan.Phase, NSUDO_SWEEPER_PHASE_SCAN);
+    NSUDO_TEST_CHECK(!Scan.HasCleanItems);
+
+    Behavior const& Clean = Handlers.Behaviors["Clean"];
+    NSUDO_TEST_CHECK_EQUAL(Clean.Phase, NSUDO_SWEEPER_PHASE_CLEAN);
+    NSUDO_TEST_CHECK(Clean.HasCleanItems);
+    NSUDO_TEST_CHECK_EQUAL(Clean.CleanItemCount, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Clean.FirstCleanItem, std::string("/tmp/Item"));
+
+    // An empty selection removes nothing rather than everything.
+    Behavior const& Empty = Handlers.Behaviors["Empty"];
+    NSUDO_TEST_CHECK(Empty.HasCleanItems);
+    NSUDO_TEST_CHECK_EQUAL(Empty.CleanItemCount, 0U);
+
+    g_Handlers = nullptr;
+}
+
+NSUDO_TEST_CASE(ConcurrencyLimits)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(8);
+
+    // Without volumes, only the number of running jobs is limited.
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(3, 1));
+        for (int i = 0; i < 8; ++i)
+        {
+            Scheduler.AddJob(::MakeJob(
+                Handlers,
+                "Free" + std::to_string(i)));
+        }
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+    }
+    NSUDO_TEST_CHECK(Handlers.MaximumRunning <= 3);
+    NSUDO_TEST_CHECK_EQUAL(Handlers.StartOrder.size(), 8U);
+
+    // The jobs on one volume run in turn, while the jobs on another volume
+    // run beside them.
+    Handlers.MaximumRunning = 0;
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(8, 1));
+        for (int i = 0; i < 4; ++i)
+        {
+            Scheduler.AddJob(::MakeJob(
+                Handlers,
+                "A" + std::to_string(i),
+                "A"));
+            Scheduler.AddJob(::MakeJob(
+                Handlers,
+                "B" + std::to_string(i),
+                "B"));
+        }
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+
+        for (std::size_t i = 0; i < Scheduler.GetJobCount(); ++i)
+        {
+            NSUDO_TEST_CHECK(
+                Scheduler.GetResult(i).State ==
+                NSudoSweeper::SchedulerJobState::Completed);
+        }
+    }
+    NSUDO_TEST_CHECK_EQUAL(Handlers.MaximumRunningInGroup["A"], 1U);
+    NSUDO_TEST_CHECK_EQUAL(Handlers.MaximumRunningInGroup["B"], 1U);
+    NSUDO_TEST_CHECK(Handlers.MaximumRunning <= 2);
+
+    // A volume admits as many jobs as its limit.
+    Handlers.MaximumRunningInGroup.clear();
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(8, 2));
+        for (int i = 0; i < 6; ++i)
+        {
+            Scheduler.AddJob(::MakeJob(
+                Handlers,
+                "C" + std::to_string(i),
+                "C"));
+        }
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+    }
+    NSUDO_TEST_CHECK(Handlers.MaximumRunningInGroup["C"] <= 2);
+
+    // A job which uses two volumes waits for both, and a job which waits
+    // for a busy volume does not hold back the jobs on other volumes.
+    Handlers.StartOrder.clear();
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(8, 1));
+
+        NSudoSweeper::SchedulerJob Blocker =
+            ::MakeJob(Handlers, "Blocker", "D", 0);
+        Blocker.Weight = 3;
+        Scheduler.AddJob(Blocker);
+
+        NSudoSweeper::SchedulerJob Both = ::MakeJob(Handlers, "Both", "E");
+        Both.Volumes.push_back("/NSudoSweeperSchedulerTests/D");
+        Both.Weight = 2;
+        Scheduler.AddJob(Both);
+
+        Scheduler.AddJob(::MakeJob(Handlers, "Other", "F"));
+
+        NSUDO_TEST_CHECK(Scheduler.Start());
+
+        // The job on the free volume completes while the blocker runs.
+        NSUDO_TEST_CHECK(::WaitForStart(Handlers.Behaviors["Blocker"]));
+        for (int i = 0; i < 10000; ++i)
+        {
+            if (Scheduler.GetResult(2).State ==
+                NSudoSweeper::SchedulerJobState::Completed)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        NSUDO_TEST_CHECK(
+            Scheduler.GetResult(2).State ==
+            NSudoSweeper::SchedulerJobState::Completed);
+        NSUDO_TEST_CHECK(
+            Scheduler.GetResult(1).State ==
+            NSudoSweeper::SchedulerJobState::Pending);
+        NSUDO_TEST_CHECK(!Handlers.Behaviors["Both"].Started.load());
+
+        Scheduler.Cancel();
+        Scheduler.Wait();
+
+        NSUDO_TEST_CHECK(
+            Scheduler.GetResult(1).State ==
+            NSudoSweeper::SchedulerJobState::Skipped);
+    }
+    NSUDO_TEST_CHECK(!Handlers.Behaviors["Both"].Started.load());
+
+    g_Handlers = nullptr;
+}
+
+NSUDO_TEST_CASE(HeavierJobsStartFirst)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(2);
+
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(1, 1));
+
+        std::uint64_t const Weights[] = { 1, 5, 0, 5, 9 };
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            NSudoSweeper::SchedulerJob Job = ::MakeJob(
+                Handlers,
+                "W" + std::to_string(i),
+                std::string(),
+                1);
+            Job.Weight = Weights[i];
+            Scheduler.AddJob(Job);
+        }
+
+        // The progress of a job counts by its weight, and a weight of 0
+        // counts as 1.
+        std::vector<std::uint32_t> Progresses;
+        Scheduler.SetProgressHandler([&](std::uint32_t Progress)
+        {
+            Progresses.push_back(Progress);
+        });
+
+        NSUDO_TEST_CHECK_EQUAL(Scheduler.GetProgress(), 0U);
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+
+        std::vector<std::uint32_t> const Expected = { 42, 66, 90, 95, 100 };
+        NSUDO_TEST_CHECK(Progresses == Expected);
+    }
+
+    // Equal weights keep the order in which they are added.
+    std::vector<std::string> const Expected =
+    {
+        "W4", "W1", "W3", "W0", "W2",
+    };
+    NSUDO_TEST_CHECK(Handlers.StartOrder == Expected);
+
+    g_Handlers = nullptr;
+}
+
+NSUDO_TEST_CASE(Cancellation)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(2);
+
+    // Cancel stops the running job through its callback and skips the
+    // pending ones.
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(1, 1));
+        Scheduler.AddJob(::MakeJob(Handlers, "Endless", std::string(), 0));
+        Scheduler.AddJob(::MakeJob(Handlers, "Pending1"));
+        Scheduler.AddJob(::MakeJob(Handlers, "Pending2"));
+
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        NSUDO_TEST_CHECK(::WaitForStart(Handlers.Behaviors["Endless"]));
+
+        std::thread Canceler([&Scheduler]()
+        {
+            Scheduler.Cancel();
+        });
+        Canceler.join();
+        Scheduler.Wait();
+
+        NSudoSweeper::SchedulerJobResult Result = Scheduler.GetResult(0);
+        NSUDO_TEST_CHECK(
+            Result.State == NSudoSweeper::SchedulerJobState::Completed);
+        NSUDO_TEST_CHECK_EQUAL(Result.Result, NSUDO_SWEEPER_E_ABORT);
+        for (std::size_t i = 1; i < 3; ++i)
+        {
+            Result = Scheduler.GetResult(i);
+            NSUDO_TEST_CHECK(
+                Result.State == NSudoSweeper::SchedulerJobState::Skipped);
+            NSUDO_TEST_CHECK_EQUAL(Result.Result, NSUDO_SWEEPER_E_ABORT);
+        }
+        NSUDO_TEST_CHECK(!Handlers.Behaviors["Pending1"].Started.load());
+        NSUDO_TEST_CHECK(!Handlers.Behaviors["Pending2"].Started.load());
+
+        // The skipped jobs count as done.
+        NSUDO_TEST_CHECK_EQUAL(Scheduler.GetProgress(), 100U);
+    }
+
+    // A scheduler which is canceled before it starts skips every job.
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(2, 2));
+        Scheduler.AddJob(::MakeJob(Handlers, "Never"));
+        Scheduler.Cancel();
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+
+        NSUDO_TEST_CHECK(
+            Scheduler.GetResult(0).State ==
+            NSudoSweeper::SchedulerJobState::Skipped);
+        NSUDO_TEST_CHECK(!Handlers.Behaviors["Never"].Started.load());
+    }
+
+    // The destructor cancels and waits for a running job.
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(1, 1));
+        Scheduler.AddJob(::MakeJob(Handlers, "Destroyed", std::string(), 0));
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        NSUDO_TEST_CHECK(::WaitForStart(Handlers.Behaviors["Destroyed"]));
+    }
+    NSUDO_TEST_CHECK_EQUAL(Handlers.Running, 0U);
+
+    // A failing or throwing message handler cancels only its own job.
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(2, 2));
+        Scheduler.SetMessageHandler([](
+            std::size_t Job,
+            std::uint32_t Message,
+            void* Parameter) -> NSUDO_SWEEPER_RESULT
+        {
+            static_cast<void>(Message);
+            static_cast<void>(Parameter);
+            if (Job == 0)
+            {
+                return NSUDO_SWEEPER_E_ABORT;
+            }
+            if (Job == 1)
+            {
+                throw std::runtime_error("Job 1");
+            }
+            return NSUDO_SWEEPER_S_OK;
+        });
+
+        for (char const* Name : { "Refused", "Thrown", "Accepted" })
+        {
+            Handlers.Behaviors[Name].ItemCount = 1;
+            Scheduler.AddJob(::MakeJob(Handlers, Name));
+        }
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+
+        NSUDO_TEST_CHECK_EQUAL(
+            Scheduler.GetResult(0).Result,
+            NSUDO_SWEEPER_E_ABORT);
+        NSUDO_TEST_CHECK_EQUAL(
+            Scheduler.GetResult(1).Result,
+            NSUDO_SWEEPER_E_FAIL);
+        NSUDO_TEST_CHECK_EQUAL(
+            Scheduler.GetResult(2).Result,
+            NSUDO_SWEEPER_S_OK);
+    }
+
+    g_Handlers = nullptr;
+}
+
+NSUDO_TEST_CASE(Timeouts)
+{
+    SyntheticHandlers Handlers;
+    g_Handlers = &Handlers;
+    Mile::ThreadPool Pool(2);
+
+    {
+        NSudoSweeper::HandlerScheduler Scheduler(Pool, ::MakeOptions(2, 2));
+
+        NSudoSweeper::SchedulerJob Slow =
+            ::MakeJob(Handlers, "Slow", std::string(), 0);
+        Slow.Timeout = std::chrono::milliseconds(50);
+        Scheduler.AddJob(Slow);
+
+        NSudoSweeper::SchedulerJob Fast = ::MakeJob(Handlers, "Fast");
+        Fast.Timeout = std::chrono::milliseconds(10000);
+        Scheduler.AddJob(Fast);
+
+        NSUDO_TEST_CHECK(Scheduler.Start());
+        Scheduler.Wait();
+
+        NSudoSweeper::SchedulerJobResult Result = Scheduler.GetResult(0);
+        NSUDO_TEST_CHECK(
+            Result.State == NSudoSweeper::SchedulerJobState::TimedOut);
+        NSUDO_TEST_CHECK_EQUAL(Result.Result, NSUDO_SWEEPER_E_TIMEOUT);
+        NSUDO_TEST_CHECK(Result.Duration.count() >= 50);
+
+        Result = Scheduler.GetResult(1);
+        NSUDO_TEST_CHECK(
+            Result.State == NSudoSweeper::SchedulerJobState::Completed);
+        NSUDO_TEST_CHECK_EQUAL(Result.Result, NSUDO_SWEEPER_S_OK);
+    }
+
+    g_Handlers = nullptr;
+}
@@ -0,0 +1,534 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperSnapshotTests.cpp
+ * PURPOSE:   Implementation for the scan result snapshot tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperSnapshot.h"
+
+#include <algorithm>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * The size of the header and the offset of its hash, which are
+     * described in NSudoSweeperSnapshot.cpp.
+     */
+    const std::size_t HeaderSize = 112;
+    const std::size_t HashOffset = 104;
+
+    /**
+     * An item with the index of its handler, in the order of a snapshot.
+     */
+    struct ExpectedItem
+    {
+        std::uint32_t Handler;
+        NSudoSweeper::HandlerHostItem Item;
+    };
+
+    /**
+     * Creates the items of a handler, whose paths share long prefixes and
+     * sometimes nothing, and which are not sorted.
+     */
+    std::vector<NSudoSweeper::HandlerHostItem> CreateItems(
+        std::mt19937& Generator,
+        std::size_t Count)
+    {
+        const char* const Components[] =
+        {
+            "Cache", "Temp", "Logs", "\xE4\xB8\xB4\xE6\x97\xB6", "a", "ab",
+            "Windows", "System32", "LogFiles",
+        };
+        std::uniform_int_distribution<std::size_t> PickComponent(
+            0,
+            sizeof(Components) / sizeof(*Components) - 1);
+        std::uniform_int_distribution<int> PickDepth(0, 6);
+
+        std::vector<NSudoSweeper::HandlerHostItem> Result;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            NSudoSweeper::HandlerHostItem Item;
+            for (int Depth = PickDepth(Generator); Depth; --Depth)
+            {
+                Item.Path += '/';
+                Item.Path += Components[PickComponent(Generator)];
+            }
+            // The paths of a handler are unique, as the ones of a scan.
+            Item.Path += '/' + std::to_string(Generator() % 1000) + "-" +
+                std::to_string(i) + ".tmp";
+            Item.Index = i;
+            Item.Size = Generator();
+            Item.AllocationSize = (static_cast<std::uint64_t>(Generator()) <<
+                32) | Generator();
+            Item.FileId = i % 7 ? Generator() : 0;
+            Item.Reason = i % 5 ? Generator() % 4 : UINT32_MAX;
+            Result.push_back(std::move(Item));
+        }
+        return Result;
+    }
+
+    bool IsSameItem(
+        NSudoSweeper::HandlerHostItem const& Left,
+        NSudoSweeper::HandlerHostItem const& Right)
+    {
+        return Left.Path == Right.Path &&
+            Left.Size == Right.Size &&
+            Left.AllocationSize == Right.AllocationSize &&
+            Left.FileId == Right.FileId &&
+            Left.Reason == Right.Reason;
+    }
+
+    /**
+     * Writes a snapshot of three handlers, the second of which has no
+     * item, and returns its items in the order of the snapshot.
+     */
+    std::vector<ExpectedItem> WriteSnapshot(
+        std::string const& Path,
+        std::string const* SessionRootPath,
+        std::vector<std::string>& Configurations)
+    {
+        std::mt19937 Generator(1);
+        NSudoSweeper::SnapshotWriter Writer;
+        Writer.SetSessionRootPath(SessionRootPath);
+
+        Configurations =
+        {
+            "[Configuration]\nHandler = \"First\"\n",
+            "",
+            "[Configuration]\nHandler = \"\xE4\xB8\x89\"\n",
+        };
+        std::size_t const Counts[] = { 1000, 0, 37 };
+
+        std::vector<ExpectedItem> Expected;
+        for (std::size_t i = 0; i < Configurations.size(); ++i)
+        {
+            std::uint32_t Handler = Writer.AddHandler(Configurations[i]);
+            NSUDO_TEST_CHECK_EQUAL(Handler, i);
+
+            std::vector<NSudoSweeper::HandlerHostItem> Items =
+                ::CreateItems(Generator, Counts[i]);
+
+            // The items of a handler may be added in several calls.
+            std::size_t Half = Items.size() / 2;
+            Writer.AddItems(Handler, std::vector<
+                NSudoSweeper::HandlerHostItem>(
+                    Items.begin(),
+                    Items.begin() + Half));
+            Writer.AddItems(Handler, std::vector<
+                NSudoSweeper::HandlerHostItem>(
+                    Items.begin() + Half,
+                    Items.end()));
+
+            std::sort(Items.begin(), Items.end(), [](
+                NSudoSweeper::HandlerHostItem const& Left,
+                NSudoSweeper::HandlerHostItem const& Right)
+            {
+                return Left.Path < Right.Path;
+            });
+            for (std::size_t j = 0; j < Items.size(); ++j)
+            {
+                Items[j].Index = j;
+                Expected.push_back(ExpectedItem{ Handler, Items[j] });
+            }
+        }
+
+        NSudoSweeper::SnapshotError Error;
+        NSUDO_TEST_CHECK(Writer.Save(Path, Error));
+        NSUDO_TEST_CHECK(Error.Message == nullptr);
+        return Expected;
+    }
+
+    /**
+     * Computes the hash of a snapshot, which skips its own member.
+     */
+    std::uint64_t HashSnapshot(
+        std::string const& Content)
+    {
+        std::uint64_t Hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < Content.size(); ++i)
+        {
+            if (i == HashOffset)
+            {
+                i += 7;
+                continue;
+            }
+            Hash ^= static_cast<std::uint8_t>(Content[i]);
+            Hash *= 1099511628211ULL;
+        }
+        return Hash;
+    }
+
+    std::uint64_t LoadUInt64(
+        std::string const& Content,
+        std::size_t Offset)
+    {
+        std::uint64_t Value = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Value |= static_cast<std::uint64_t>(
+                static_cast<std::uint8_t>(Content[Offset + i])) << (i * 8);
+        }
+        return Value;
+    }
+
+    void StoreUInt64(
+        std::string& Content,
+        std::size_t Offset,
+        std::uint64_t Value)
+    {
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            Content[Offset + i] = static_cast<char>(Value >> (i * 8));
+        }
+    }
+
+    /**
+     * Writes a modified snapshot whose hash is updated, so the reader has
+     * to notice the damage by other means.
+     */
+    void WriteRehashed(
+        std::string const& Path,
+        std::string Content)
+    {
+        ::StoreUInt64(Content, HashOffset, ::HashSnapshot(Content));
+        NSudoTest::WriteFile(Path, Content);
+    }
+
+    /**
+     * Reads every item of a snapshot, which must not crash whatever the
+     * content is.
+     *
+     * @return The number of items which are read.
+     */
+    std::uint64_t ReadAll(
+        NSudoSweeper::SnapshotReader const& Reader)
+    {
+        std::uint64_t Result = 0;
+        NSudoSweeper::HandlerHostItem Item;
+        std::uint32_t Handler = 0;
+        for (std::uint64_t i = 0; i < Reader.GetItemCount(); ++i)
+        {
+            Result += Reader.GetItem(i, Item, Handler);
+        }
+
+        std::vector<NSudoSweeper::HandlerHostItem> Items;
+        for (std::uint32_t i = 0; i < Reader.GetHandlerCount(); ++i)
+        {
+            Reader.GetConfiguration(i);
+            Reader.GetHandlerItems(i, Items);
+        }
+        return Result;
+    }
+}
+
+NSUDO_TEST_CASE(RoundTrip)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Snapshot.bin");
+
+    for (bool Offline : { false, true })
+    {
+        std::string SessionRootPath = "/mnt/\xE9\x95\x9C\xE5\x83\x8F/";
+        std::vector<std::string> Configurations;
+        std::uint64_t Before = static_cast<std::uint64_t>(std::time(nullptr));
+        std::vector<::ExpectedItem> Expected = ::WriteSnapshot(
+            Path,
+            Offline ? &SessionRootPath : nullptr,
+            Configurations);
+        std::uint64_t After = static_cast<std::uint64_t>(std::time(nullptr));
+
+        // The temporary file has been renamed.
+        std::string Content;
+        NSUDO_TEST_CHECK(!NSudoTest::ReadFile(Path + ".tmp", Content));
+
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        if (!NSUDO_TEST_CHECK(Reader.Open(Path, Error)))
+        {
+            continue;
+        }
+
+        NSUDO_TEST_CHECK(Reader.GetCreationTime() >= Before);
+        NSUDO_TEST_CHECK(Reader.GetCreationTime() <= After);
+
+        std::string ReadRootPath;
+        NSUDO_TEST_CHECK_EQUAL(
+            Reader.GetSessionRootPath(ReadRootPath),
+            Offline);
+        NSUDO_TEST_CHECK_EQUAL(
+            ReadRootPath,
+            Offline ? SessionRootPath : std::string());
+
+        NSUDO_TEST_CHECK_EQUAL(
+            Reader.GetHandlerCount(),
+            Configurations.size());
+        for (std::uint32_t i = 0; i < Configurations.size(); ++i)
+        {
+            NSUDO_TEST_CHECK_EQUAL(
+                Reader.GetConfiguration(i),
+                Configurations[i]);
+        }
+        NSUDO_TEST_CHECK_EQUAL(
+            Reader.GetConfiguration(Reader.GetHandlerCount()),
+            std::string());
+
+        // The items are decoded one by one in a random order.
+        if (!NSUDO_TEST_CHECK_EQUAL(Reader.GetItemCount(), Expected.size()))
+        {
+            continue;
+        }
+        std::vector<std::uint64_t> Order(Expected.size());
+        for (std::size_t i = 0; i < Order.size(); ++i)
+        {
+            Order[i] = i;
+        }
+        std::shuffle(Order.begin(), Order.end(), std::mt19937(2));
+        for (std::uint64_t Index : Order)
+        {
+            NSudoSweeper::HandlerHostItem Item;
+            std::uint32_t Handler = 0;
+            if (NSUDO_TEST_CHECK(Reader.GetItem(Index, Item, Handler)))
+            {
+                NSUDO_TEST_CHECK_EQUAL(Handler, Expected[Index].Handler);
+                NSUDO_TEST_CHECK_EQUAL(Item.Index, Expected[Index].Item.Index);
+                NSUDO_TEST_CHECK(::IsSameItem(Item, Expected[Index].Item));
+            }
+        }
+        NSudoSweeper::HandlerHostItem Item;
+        std::uint32_t Handler = 0;
+        NSUDO_TEST_CHECK(!Reader.GetItem(Expected.size(), Item, Handler));
+
+        // And in order for each handler.
+        std::size_t Next = 0;
+        for (std::uint32_t i = 0; i < Reader.GetHandlerCount(); ++i)
+        {
+            std::vector<NSudoSweeper::HandlerHostItem> Items;
+            NSUDO_TEST_CHECK(Reader.GetHandlerItems(i, Items));
+            for (NSudoSweeper::HandlerHostItem const& Current : Items)
+            {
+                if (NSUDO_TEST_CHECK(Next < Expected.size()))
+                {
+                    NSUDO_TEST_CHECK_EQUAL(Expected[Next].Handler, i);
+                    NSUDO_TEST_CHECK_EQUAL(
+                        Current.Index,
+                        Expected[Next].Item.Index);
+                    NSUDO_TEST_CHECK(::IsSameItem(
+                        Current,
+                        Expected[Next].Item));
+                }
+                ++Next;
+            }
+        }
+        NSUDO_TEST_CHECK_EQUAL(Next, Expected.size());
+
+        std::vector<NSudoSweeper::HandlerHostItem> Items;
+        NSUDO_TEST_CHECK(!Reader.GetHandlerItems(
+            Reader.GetHandlerCount(),
+            Items));
+    }
+}
+
+NSUDO_TEST_CASE(EmptyAndInvalidWriters)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Snapshot.bin");
+
+    NSudoSweeper::SnapshotWriter Writer;
+    NSudoSweeper::SnapshotError Error;
+    NSUDO_TEST_CHECK(Writer.Save(Path, Error));
+
+    NSudoSweeper::SnapshotReader Reader;
+    if (NSUDO_TEST_CHECK(Reader.Open(Path, Error)))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Reader.GetHandlerCount(), 0U);
+        NSUDO_TEST_CHECK_EQUAL(Reader.GetItemCount(), 0U);
+    }
+    Reader.Close();
+
+    // An item of an unknown handler.
+    Writer.AddItems(0, std::vector<NSudoSweeper::HandlerHostItem>(1));
+    NSUDO_TEST_CHECK(!Writer.Save(Path, Error));
+    NSUDO_TEST_CHECK(Error.Message != nullptr);
+
+    // The file of a missing directory cannot be written, and the previous
+    // snapshot is kept.
+    Writer.Clear();
+    Writer.AddHandler("");
+    NSUDO_TEST_CHECK(!Writer.Save(
+        Directory.Join("Missing/Snapshot.bin"),
+        Error));
+    NSUDO_TEST_CHECK(Error.SystemError != 0);
+    NSUDO_TEST_CHECK(Reader.Open(Path, Error));
+    NSUDO_TEST_CHECK_EQUAL(Reader.GetHandlerCount(), 0U);
+
+    NSUDO_TEST_CHECK(!Reader.Open(Directory.Join("Missing.bin"), Error));
+    NSUDO_TEST_CHECK(Error.SystemError != 0);
+}
+
+NSUDO_TEST_CASE(TruncatedSnapshots)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Snapshot.bin");
+    std::vector<std::string> Configurations;
+    ::WriteSnapshot(Path, nullptr, Configurations);
+
+    std::string Content;
+    if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Content)))
+    {
+        return;
+    }
+
+    std::string Truncated = Directory.Join("Truncated.bin");
+    for (std::size_t Size = 0; Size < Content.size();
+        Size += Size < 256 ? 1 : 997)
+    {
+        NSudoTest::WriteFile(Truncated, Content.substr(0, Size));
+
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        if (Reader.Open(Truncated, Error))
+        {
+            NSUDO_TEST_CHECK_EQUAL(Size, Content.size());
+            continue;
+        }
+        NSUDO_TEST_CHECK(Error.Message != nullptr);
+        NSUDO_TEST_CHECK_EQUAL(Reader.GetItemCount(), 0U);
+    }
+
+    // A truncated file whose header claims the new size still fails the
+    // range checks, since the records no longer fit.
+    std::string Short = Content.substr(0, Content.size() / 2);
+    ::StoreUInt64(Short, 16, Short.size());
+    ::WriteRehashed(Truncated, Short);
+    NSudoSweeper::SnapshotReader Reader;
+    NSudoSweeper::SnapshotError Error;
+    NSUDO_TEST_CHECK(!Reader.Open(Truncated, Error));
+}
+
+NSUDO_TEST_CASE(CorruptedSnapshots)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Path = Directory.Join("Snapshot.bin");
+    std::vector<std::string> Configurations;
+    std::vector<::ExpectedItem> Expected =
+        ::WriteSnapshot(Path, nullptr, Configurations);
+
+    std::string Content;
+    if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Content)))
+    {
+        return;
+    }
+    std::string Corrupted = Directory.Join("Corrupted.bin");
+
+    // Any flipped bit is caught by the hash.
+    std::mt19937 Generator(3);
+    for (std::size_t i = 0; i < 2000; ++i)
+    {
+        std::string Copy = Content;
+        std::size_t Offset = i < HeaderSize
+            ? i
+            : Generator() % Copy.size();
+        Copy[Offset] ^= static_cast<char>(1 << (Generator() % 8));
+        NSudoTest::WriteFile(Corrupted, Copy);
+
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        NSUDO_TEST_CHECK(!Reader.Open(Corrupted, Error));
+    }
+
+    // A wrong version is reported as such.
+    {
+        std::string Copy = Content;
+        Copy[8] = 2;
+        ::WriteRehashed(Corrupted, Copy);
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        NSUDO_TEST_CHECK(!Reader.Open(Corrupted, Error));
+        NSUDO_TEST_CHECK_EQUAL(
+            std::string(Error.Message),
+            "The version of the snapshot is not supported");
+    }
+
+    // Counts and offsets outside of the file are rejected even if the hash
+    // matches.
+    for (std::size_t Member : { 40, 48, 56, 64, 72, 80, 88 })
+    {
+        std::string Copy = Content;
+        ::StoreUInt64(Copy, Member, UINT64_MAX / 2);
+        ::WriteRehashed(Corrupted, Copy);
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        NSUDO_TEST_CHECK(!Reader.Open(Corrupted, Error));
+    }
+
+    // Damaged records with a matching hash are opened, but reading them
+    // fails or returns other values rather than crashing.
+    std::size_t ItemsOffset =
+        static_cast<std::size_t>(::LoadUInt64(Content, 72));
+    std::size_t PathsOffset =
+        static_cast<std::size_t>(::LoadUInt64(Content, 80));
+    std::size_t HandlersOffset =
+        static_cast<std::size_t>(::LoadUInt64(Content, 64));
+    for (std::size_t i = 0; i < 500; ++i)
+    {
+        std::string Copy = Content;
+        for (int Count = 1 + Generator() % 4; Count; --Count)
+        {
+            std::size_t Offset = HandlersOffset +
+                Generator() % (Copy.size() - HandlersOffset);
+            Copy[Offset] = static_cast<char>(Generator());
+        }
+        ::WriteRehashed(Corrupted, Copy);
+
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        if (NSUDO_TEST_CHECK(Reader.Open(Corrupted, Error)))
+        {
+            NSUDO_TEST_CHECK(::ReadAll(Reader) <= Expected.size());
+        }
+    }
+
+    // An entry which shares more than the previous path has is rejected.
+    {
+        std::string Copy = Content;
+        std::size_t Entry = PathsOffset +
+            static_cast<std::size_t>(::LoadUInt64(Copy, ItemsOffset + 24));
+        Copy[Entry] = 0x7F;
+        ::WriteRehashed(Corrupted, Copy);
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        NSudoSweeper::HandlerHostItem Item;
+        std::uint32_t Handler = 0;
+        if (NSUDO_TEST_CHECK(Reader.Open(Corrupted, Error)))
+        {
+            NSUDO_TEST_CHECK(!Reader.GetItem(0, Item, Handler));
+            NSUDO_TEST_CHECK(!Reader.GetItem(1, Item, Handler));
+        }
+    }
+
+    // An item of a handler which does not exist.
+    {
+        std::string Copy = Content;
+        Copy[ItemsOffset + 36] = 9;
+        ::WriteRehashed(Corrupted, Copy);
+        NSudoSweeper::SnapshotReader Reader;
+        NSudoSweeper::SnapshotError Error;
+        NSudoSweeper::HandlerHostItem Item;
+        std::uint32_t Handler = 0;
+        if (NSUDO_TEST_CHECK(Reader.Open(Corrupted, Error)))
+        {
+            NSUDO_TEST_CHECK(!Reader.GetItem(0, Item, Handler));
+            NSUDO_TEST_CHECK(Reader.GetItem(1, Item, Handler));
+        }
+    }
+}
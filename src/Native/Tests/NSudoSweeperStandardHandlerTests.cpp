@@ -0,0 +1,677 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperStandardHandlerTests.cpp
+ * PURPOSE:   Implementation for the standard cleanup handler tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+#include "NSudoSweeperRegistryHiveBuilder.h"
+
+#include "NSudoSweeperStandardHandler.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * A scanned item, whose path is copied out of the batch.
+     */
+    struct ScannedItem
+    {
+        std::string Path;
+        NSUDO_SWEEPER_ITEM Item;
+    };
+
+    /**
+     * Runs the handler and records what it reports.
+     */
+    class Harness
+    {
+    public:
+
+        std::vector<ScannedItem> Items;
+        std::map<std::uint64_t, NSUDO_SWEEPER_CLEAN_RESULT> Results;
+        NSUDO_SWEEPER_HANDLER_SUMMARY Summary;
+        std::size_t ProgressCount = 0;
+
+        /**
+         * The last estimate and the number of estimates.
+         */
+        NSUDO_SWEEPER_ESTIMATE Estimate;
+        std::size_t EstimateCount = 0;
+
+        /**
+         * The number of item and result batches after which the callback
+         * cancels the handler, or 0 to never cancel it.
+         */
+        std::size_t CancelAfterBatches = 0;
+        std::size_t BatchCount = 0;
+
+        NSUDO_SWEEPER_RESULT Run(
+            std::uint32_t Phase,
+            std::string const& Configuration,
+            char const* SessionRootPath = nullptr,
+            std::vector<NSUDO_SWEEPER_ITEM> const* CleanItems = nullptr,
+            std::uint32_t MaximumBatchSize = 0)
+        {
+            this->Items.clear();
+            this->Results.clear();
+            this->BatchCount = 0;
+            this->Estimate = NSUDO_SWEEPER_ESTIMATE();
+            this->EstimateCount = 0;
+
+            NSUDO_SWEEPER_HANDLER_REQUEST Request = {};
+            Request.Size = sizeof(Request);
+            Request.Phase = Phase;
+            Request.Configuration = Configuration.c_str();
+            Request.SessionRootPath = SessionRootPath;
+            Request.Callback = Harness::Callback;
+            Request.UserData = this;
+            if (CleanItems)
+            {
+                Request.Flags = NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+                Request.CleanItems = CleanItems->empty()
+                    ? nullptr
+                    : CleanItems->data();
+                Request.CleanItemCount = CleanItems->size();
+            }
+            Request.MaximumBatchSize = MaximumBatchSize;
+
+            this->Summary = NSUDO_SWEEPER_HANDLER_SUMMARY();
+            this->Summary.Size = sizeof(this->Summary);
+            return ::NSudoSweeperStandardCleanupHandlerV2(
+                &Request,
+                &this->Summary);
+        }
+
+        /**
+         * Creates the items of a clean from the scanned items, whose paths
+         * stay owned by this harness.
+         */
+        std::vector<NSUDO_SWEEPER_ITEM> GetCleanItems() const
+        {
+            std::vector<NSUDO_SWEEPER_ITEM> Result;
+            for (ScannedItem const& Current : this->Items)
+            {
+                NSUDO_SWEEPER_ITEM Item = Current.Item;
+                Item.Path = Current.Path.c_str();
+                Item.PathLength = static_cast<std::uint32_t>(
+                    Current.Path.size());
+                Result.push_back(Item);
+            }
+            return Result;
+        }
+
+        ScannedItem const* Find(
+            std::string const& Path) const
+        {
+            for (ScannedItem const& Current : this->Items)
+            {
+                if (Current.Path == Path)
+                {
+                    return &Current;
+                }
+            }
+            return nullptr;
+        }
+
+        static NSUDO_SWEEPER_RESULT NSUDO_SWEEPER_API Callback(
+            uint32_t Message,
+            void* Parameter,
+            void* UserData)
+        {
+            Harness* Self = static_cast<Harness*>(UserData);
+
+            if (Message == NSUDO_SWEEPER_PROGRESS_MESSAGE)
+            {
+                ++Self->ProgressCount;
+                return NSUDO_SWEEPER_S_OK;
+            }
+
+            if (Message == NSUDO_SWEEPER_ESTIMATE_MESSAGE)
+            {
+                Self->Estimate =
+                    *static_cast<NSUDO_SWEEPER_ESTIMATE const*>(Parameter);
+                ++Self->EstimateCount;
+                return NSUDO_SWEEPER_S_OK;
+            }
+
+            if (Message == NSUDO_SWEEPER_ITEM_BATCH_MESSAGE)
+            {
+                NSUDO_SWEEPER_ITEM_BATCH const* Batch =
+                    static_cast<NSUDO_SWEEPER_ITEM_BATCH const*>(Parameter);
+                NSUDO_TEST_CHECK_EQUAL(Batch->FirstIndex, Self->Items.size());
+                for (std::uint32_t i = 0; i < Batch->Count; ++i)
+                {
+                    ScannedItem Current;
+                    Current.Path.assign(
+                        Batch->Items[i].Path,
+                        Batch->Items[i].PathLength);
+                    Current.Item = Batch->Items[i];
+                    Current.Item.Path = nullptr;
+                    Self->Items.push_back(std::move(Current));
+                }
+            }
+            else if (Message == NSUDO_SWEEPER_CLEAN_RESULT_BATCH_MESSAGE)
+            {
+                NSUDO_SWEEPER_CLEAN_RESULT_BATCH const* Batch =
+                    static_cast<NSUDO_SWEEPER_CLEAN_RESULT_BATCH const*>(
+                        Parameter);
+                for (std::uint32_t i = 0; i < Batch->Count; ++i)
+                {
+                    NSUDO_TEST_CHECK(Self->Results.emplace(
+                        Batch->Results[i].Index,
+                        Batch->Results[i]).second);
+                }
+            }
+            else
+            {
+                return NSUDO_SWEEPER_S_OK;
+            }
+
+            ++Self->BatchCount;
+            if (Self->CancelAfterBatches &&
+                Self->BatchCount >= Self->CancelAfterBatches)
+            {
+                return NSUDO_SWEEPER_E_ABORT;
+            }
+            return NSUDO_SWEEPER_S_OK;
+        }
+    };
+
+    /**
+     * Creates a configuration file whose rules select the .tmp files of
+     * Cleanup except Keep.tmp, and every file below Logs.
+     */
+    std::string CreateConfiguration(
+        std::string const& Root,
+        std::string const& Extra = std::string())
+    {
+        return
+            "[Metadata.en]\n"
+            "Name = \"Test\"\n"
+            "Description = \"Test\"\n"
+            "[Configuration]\n"
+            "Plugin = \"NSudoSweeperCore.dll\"\n"
+            "Handler = \"NSudoSweeperStandardCleanupHandler\"\n" +
+            Extra +
+            "Detect = [ \"File|" + Root + "/Cleanup\" ]\n"
+            "Include = [\n"
+            "    \"File|" + Root + "/Cleanup/*.tmp\",\n"
+            "    \"File|" + Root + "/Logs/**\"\n"
+            "]\n"
+            "Exclude = [ \"File|" + Root + "/Cleanup/Keep.tmp\" ]\n";
+    }
+
+    void CreateFiles(
+        std::string const& Root)
+    {
+        NSudoTest::WriteFile(Root + "/Cleanup/A.tmp", std::string(100, 'a'));
+        NSudoTest::WriteFile(Root + "/Cleanup/B.tmp", std::string(200, 'b'));
+        NSudoTest::WriteFile(Root + "/Cleanup/D.tmp", std::string(300, 'd'));
+        NSudoTest::WriteFile(Root + "/Cleanup/Keep.tmp", "keep");
+        NSudoTest::WriteFile(Root + "/Cleanup/Other.txt", "other");
+        NSudoTest::WriteFile(Root + "/Logs/Sub/C.log", std::string(50, 'c'));
+    }
+
+    bool Exists(
+        std::string const& Path)
+    {
+        struct stat Status;
+        return 0 == ::lstat(Path.c_str(), &Status);
+    }
+}
+
+NSUDO_TEST_CASE(ScanReportsTheSelectedItems)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+
+    ::Harness Harness;
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            ::CreateConfiguration(Root),
+            nullptr,
+            nullptr,
+            2),
+        NSUDO_SWEEPER_S_OK);
+
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 4U);
+    NSUDO_TEST_CHECK(Harness.ProgressCount >= 1);
+
+    struct
+    {
+        char const* Name;
+        std::uint64_t Size;
+        std::uint32_t Reason;
+    } const Expected[] =
+    {
+        { "/Cleanup/A.tmp", 100, 0 },
+        { "/Cleanup/B.tmp", 200, 0 },
+        { "/Cleanup/D.tmp", 300, 0 },
+        { "/Logs/Sub/C.log", 50, 1 },
+    };
+    for (auto const& Current : Expected)
+    {
+        std::string Path = Root + Current.Name;
+        ::ScannedItem const* Item = Harness.Find(Path);
+        if (!NSUDO_TEST_CHECK(Item != nullptr))
+        {
+            continue;
+        }
+
+        struct stat Status;
+        NSUDO_TEST_CHECK_EQUAL(::lstat(Path.c_str(), &Status), 0);
+        NSUDO_TEST_CHECK_EQUAL(Item->Item.PathLength, Path.size());
+        NSUDO_TEST_CHECK_EQUAL(Item->Item.Size, Current.Size);
+        NSUDO_TEST_CHECK_EQUAL(Item->Item.Reason, Current.Reason);
+        NSUDO_TEST_CHECK_EQUAL(
+            Item->Item.FileId,
+            static_cast<std::uint64_t>(Status.st_ino));
+    }
+
+    // A scan removes nothing.
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/A.tmp"));
+    NSUDO_TEST_CHECK(Harness.Results.empty());
+    NSUDO_TEST_CHECK_EQUAL(Harness.Summary.ItemCount, 4U);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Summary.TotalSize, 650U);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Summary.FreedSize, 0U);
+}
+
+NSUDO_TEST_CASE(CleanRevalidatesTheItems)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+    std::string Configuration = ::CreateConfiguration(Root);
+
+    ::Harness Scan;
+    NSUDO_TEST_CHECK_EQUAL(
+        Scan.Run(NSUDO_SWEEPER_PHASE_SCAN, Configuration),
+        NSUDO_SWEEPER_S_OK);
+    if (!NSUDO_TEST_CHECK_EQUAL(Scan.Items.size(), 4U))
+    {
+        return;
+    }
+
+    // The caller also passes an item the rules exclude.
+    ::ScannedItem Excluded = Scan.Items.front();
+    Excluded.Path = Root + "/Cleanup/Keep.tmp";
+    Excluded.Item.Size = 4;
+    Excluded.Item.FileId = 0;
+    Scan.Items.push_back(Excluded);
+
+    // A.tmp is unchanged, B.tmp grows, C.log is removed, and D.tmp is
+    // replaced by another file of the same size.
+    NSudoTest::WriteFile(Root + "/Cleanup/B.tmp", std::string(201, 'b'));
+    NSUDO_TEST_CHECK_EQUAL(::unlink((Root + "/Logs/Sub/C.log").c_str()), 0);
+    NSudoTest::WriteFile(Root + "/Cleanup/D.new", std::string(300, 'e'));
+    NSUDO_TEST_CHECK_EQUAL(::rename(
+        (Root + "/Cleanup/D.new").c_str(),
+        (Root + "/Cleanup/D.tmp").c_str()), 0);
+
+    std::vector<NSUDO_SWEEPER_ITEM> CleanItems = Scan.GetCleanItems();
+
+    // An empty selection removes nothing rather than everything.
+    std::vector<NSUDO_SWEEPER_ITEM> NoItems;
+    ::Harness Empty;
+    NSUDO_TEST_CHECK_EQUAL(
+        Empty.Run(
+            NSUDO_SWEEPER_PHASE_CLEAN,
+            Configuration,
+            nullptr,
+            &NoItems),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK(Empty.Items.empty());
+    NSUDO_TEST_CHECK(Empty.Results.empty());
+    NSUDO_TEST_CHECK_EQUAL(Empty.Summary.ItemCount, 0U);
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/A.tmp"));
+
+    ::Harness Clean;
+    NSUDO_TEST_CHECK_EQUAL(
+        Clean.Run(
+            NSUDO_SWEEPER_PHASE_CLEAN,
+            Configuration,
+            nullptr,
+            &CleanItems,
+            2),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK(Clean.Items.empty());
+    if (!NSUDO_TEST_CHECK_EQUAL(Clean.Results.size(), CleanItems.size()))
+    {
+        return;
+    }
+
+    std::map<std::string, NSUDO_SWEEPER_RESULT> Expected =
+    {
+        { "/Cleanup/A.tmp", NSUDO_SWEEPER_S_OK },
+        { "/Cleanup/B.tmp", NSUDO_SWEEPER_E_ITEM_CHANGED },
+        { "/Cleanup/D.tmp", NSUDO_SWEEPER_E_ITEM_CHANGED },
+        { "/Logs/Sub/C.log", NSUDO_SWEEPER_E_ITEM_NOT_FOUND },
+        { "/Cleanup/Keep.tmp", NSUDO_SWEEPER_E_ITEM_NOT_SELECTED },
+    };
+    std::uint64_t FreedSize = 0;
+    for (std::size_t i = 0; i < Scan.Items.size(); ++i)
+    {
+        NSUDO_SWEEPER_CLEAN_RESULT const& Result = Clean.Results[i];
+        std::string Name = Scan.Items[i].Path.substr(Root.size());
+        NSUDO_TEST_CHECK_EQUAL(
+            Name + ": " + std::to_string(Result.Result),
+            Name + ": " + std::to_string(Expected[Name]));
+        FreedSize += Result.FreedSize;
+    }
+
+    NSUDO_TEST_CHECK(!::Exists(Root + "/Cleanup/A.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/B.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/D.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/Keep.tmp"));
+
+    NSUDO_TEST_CHECK_EQUAL(Clean.Summary.ItemCount, 5U);
+    NSUDO_TEST_CHECK_EQUAL(Clean.Summary.FailedItemCount, 4U);
+    NSUDO_TEST_CHECK_EQUAL(Clean.Summary.TotalSize, 100U);
+    NSUDO_TEST_CHECK(FreedSize >= 100);
+    NSUDO_TEST_CHECK_EQUAL(Clean.Summary.FreedSize, FreedSize);
+}
+
+NSUDO_TEST_CASE(CleanWithoutItemsRemovesWhatAScanFinds)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+
+    ::Harness Harness;
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(NSUDO_SWEEPER_PHASE_CLEAN, ::CreateConfiguration(Root)),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 4U);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Results.size(), 4U);
+    for (auto const& Result : Harness.Results)
+    {
+        NSUDO_TEST_CHECK_EQUAL(Result.second.Result, NSUDO_SWEEPER_S_OK);
+    }
+
+    NSUDO_TEST_CHECK(!::Exists(Root + "/Cleanup/A.tmp"));
+    NSUDO_TEST_CHECK(!::Exists(Root + "/Cleanup/B.tmp"));
+    NSUDO_TEST_CHECK(!::Exists(Root + "/Cleanup/D.tmp"));
+    NSUDO_TEST_CHECK(!::Exists(Root + "/Logs/Sub/C.log"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/Keep.tmp"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/Other.txt"));
+    NSUDO_TEST_CHECK(::Exists(Root + "/Logs/Sub"));
+    NSUDO_TEST_CHECK_EQUAL(Harness.Summary.FailedItemCount, 0U);
+}
+
+NSUDO_TEST_CASE(EstimateReportsTheSizesOfAScan)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+    std::string Configuration = ::CreateConfiguration(Root);
+
+    ::Harness Scan;
+    NSUDO_TEST_CHECK_EQUAL(
+        Scan.Run(NSUDO_SWEEPER_PHASE_SCAN, Configuration),
+        NSUDO_SWEEPER_S_OK);
+
+    // The tree is small enough to be counted exactly at once.
+    ::Harness Estimate;
+    NSUDO_TEST_CHECK_EQUAL(
+        Estimate.Run(NSUDO_SWEEPER_PHASE_ESTIMATE, Configuration),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK(Estimate.Items.empty());
+    NSUDO_TEST_CHECK_EQUAL(Estimate.EstimateCount, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Estimate.Exact, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Estimate.ItemCount, 4U);
+    NSUDO_TEST_CHECK_EQUAL(
+        Estimate.Estimate.Size,
+        Scan.Summary.TotalAllocationSize);
+
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Summary.ItemCount, 4U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Summary.TotalSize, 650U);
+    NSUDO_TEST_CHECK_EQUAL(
+        Estimate.Summary.TotalSize,
+        Scan.Summary.TotalSize);
+    NSUDO_TEST_CHECK_EQUAL(
+        Estimate.Summary.TotalAllocationSize,
+        Scan.Summary.TotalAllocationSize);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.Summary.FreedSize, 0U);
+    NSUDO_TEST_CHECK(::Exists(Root + "/Cleanup/A.tmp"));
+}
+
+NSUDO_TEST_CASE(DetectionAndOfflineImages)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+
+    // No Detect rule matches.
+    ::Harness Harness;
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            ::CreateConfiguration(Root + "/Missing")),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK(Harness.Items.empty());
+
+    // The version of Windows is unknown here, so DetectOS does not apply.
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            ::CreateConfiguration(
+                Root,
+                "DetectOS = { Minimum = \"6.0\", Maximum = \"6.0\" }\n")),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 4U);
+
+    // The rules of an offline image are rebased onto its root, and an image
+    // without a SOFTWARE hive has no known version either.
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            ::CreateConfiguration("", "OfflineImageSupport = false\n"),
+            Root.c_str()),
+        NSUDO_SWEEPER_E_NOTIMPL);
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            ::CreateConfiguration(
+                "",
+                "OfflineImageSupport = true\n"
+                "DetectOS = { Minimum = \"10.0\" }\n"),
+            Root.c_str()),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 4U);
+    NSUDO_TEST_CHECK(Harness.Find(Root + "/Cleanup/A.tmp") != nullptr);
+}
+
+NSUDO_TEST_CASE(DetectionOfOfflineWindowsVersions)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+    std::string SoftwarePath = Root + "/Windows/System32/config/SOFTWARE";
+
+    // Windows 10 and later keep "6.3" in CurrentVersion.
+    NSudoTest::RegistryHiveBuilder Windows10;
+    NSudoTest::RegistryHiveKey& Current10 = Windows10.CreateKey(
+        "Microsoft\\Windows NT\\CurrentVersion");
+    Current10.SetString("CurrentVersion", "6.3");
+    Current10.SetDword("CurrentMajorVersionNumber", 10);
+    Current10.SetDword("CurrentMinorVersionNumber", 0);
+    Current10.SetString("CurrentBuildNumber", "19045");
+    Windows10.CreateKey("NSudo");
+
+    NSudoTest::RegistryHiveBuilder Windows7;
+    NSudoTest::RegistryHiveKey& Current7 = Windows7.CreateKey(
+        "Microsoft\\Windows NT\\CurrentVersion");
+    Current7.SetString("CurrentVersion", "6.1");
+    Current7.SetString("CurrentBuildNumber", "7601");
+
+    // The version of an image whose SOFTWARE hive is damaged is unknown,
+    // so DetectOS does not apply to it.
+    struct
+    {
+        NSudoTest::RegistryHiveBuilder const* Software;
+        char const* DetectOS;
+        bool Detected;
+    } const Cases[] =
+    {
+        { &Windows10, "Minimum = \"10.0\"", true },
+        { &Windows10, "Minimum = \"10.0.19041\"", true },
+        { &Windows10, "Minimum = \"10.0.22000\"", false },
+        { &Windows10, "Minimum = \"6.1\", Maximum = \"6.3\"", false },
+        { &Windows10, "Maximum = \"10.0\"", true },
+        { &Windows7, "Minimum = \"6.1\", Maximum = \"6.1\"", true },
+        { &Windows7, "Minimum = \"6.2\"", false },
+        { &Windows7, "Maximum = \"6.1.7600\"", false },
+        { nullptr, "Minimum = \"10.0\"", true },
+    };
+
+    ::Harness Harness;
+    for (auto const& Case : Cases)
+    {
+        if (Case.Software)
+        {
+            Case.Software->Write(SoftwarePath);
+        }
+        else
+        {
+            NSudoTest::WriteFile(SoftwarePath, std::string(8192, 'x'));
+        }
+
+        NSUDO_TEST_CHECK_EQUAL(
+            Harness.Run(
+                NSUDO_SWEEPER_PHASE_SCAN,
+                ::CreateConfiguration(
+                    "",
+                    "OfflineImageSupport = true\n"
+                    "DetectOS = { " + std::string(Case.DetectOS) + " }\n"),
+                Root.c_str()),
+            NSUDO_SWEEPER_S_OK);
+        if (!NSUDO_TEST_CHECK_EQUAL(
+            Harness.Items.size(),
+            Case.Detected ? 4U : 0U))
+        {
+            std::printf("    %s\n", Case.DetectOS);
+        }
+    }
+
+    // The Registry rules of an image are answered from its hives.
+    Windows10.Write(SoftwarePath);
+    std::string Configuration = ::CreateConfiguration(
+        "",
+        "OfflineImageSupport = true\n");
+    std::string FileRule = "\"File|/Cleanup\" ]";
+    std::size_t Rule = Configuration.find(FileRule);
+    Configuration.replace(
+        Rule,
+        FileRule.size(),
+        "\"Registry|HKLM\\\\SOFTWARE\\\\NSudo\" ]");
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(NSUDO_SWEEPER_PHASE_SCAN, Configuration, Root.c_str()),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 4U);
+
+    Windows7.Write(SoftwarePath);
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(NSUDO_SWEEPER_PHASE_SCAN, Configuration, Root.c_str()),
+        NSUDO_SWEEPER_S_OK);
+    NSUDO_TEST_CHECK(Harness.Items.empty());
+}
+
+NSUDO_TEST_CASE(CancellationAndInvalidRequests)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.GetPath();
+    ::CreateFiles(Root);
+    std::string Configuration = ::CreateConfiguration(Root);
+
+    // The scan stops at the first batch.
+    ::Harness Harness;
+    Harness.CancelAfterBatches = 1;
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(
+            NSUDO_SWEEPER_PHASE_SCAN,
+            Configuration,
+            nullptr,
+            nullptr,
+            1),
+        NSUDO_SWEEPER_E_ABORT);
+    NSUDO_TEST_CHECK_EQUAL(Harness.Items.size(), 1U);
+
+    // The clean stops after the results of its first batch, so it removes
+    // the first item only.
+    Harness.CancelAfterBatches = 0;
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(NSUDO_SWEEPER_PHASE_SCAN, Configuration),
+        NSUDO_SWEEPER_S_OK);
+    std::vector<NSUDO_SWEEPER_ITEM> CleanItems = Harness.GetCleanItems();
+    std::vector<::ScannedItem> Scanned = Harness.Items;
+
+    ::Harness Clean;
+    Clean.CancelAfterBatches = 1;
+    NSUDO_TEST_CHECK_EQUAL(
+        Clean.Run(
+            NSUDO_SWEEPER_PHASE_CLEAN,
+            Configuration,
+            nullptr,
+            &CleanItems,
+            1),
+        NSUDO_SWEEPER_E_ABORT);
+    NSUDO_TEST_CHECK_EQUAL(Clean.Results.size(), 1U);
+    std::size_t Remaining = 0;
+    for (::ScannedItem const& Item : Scanned)
+    {
+        Remaining += ::Exists(Item.Path);
+    }
+    NSUDO_TEST_CHECK_EQUAL(Remaining, Scanned.size() - 1);
+
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(NSUDO_SWEEPER_PHASE_SCAN, "[Configuration"),
+        NSUDO_SWEEPER_E_INVALIDARG);
+    NSUDO_TEST_CHECK_EQUAL(
+        Harness.Run(0xFF, Configuration),
+        NSUDO_SWEEPER_E_INVALIDARG);
+    NSUDO_TEST_CHECK_EQUAL(
+        ::NSudoSweeperStandardCleanupHandlerV2(nullptr, nullptr),
+        NSUDO_SWEEPER_E_INVALIDARG);
+
+    // The items of a clean need the flag, and the flag needs the items.
+    NSUDO_SWEEPER_HANDLER_REQUEST Request = {};
+    Request.Size = sizeof(Request);
+    Request.Phase = NSUDO_SWEEPER_PHASE_CLEAN;
+    Request.Configuration = Configuration.c_str();
+    Request.Callback = ::Harness::Callback;
+    Request.UserData = &Harness;
+    Request.CleanItems = CleanItems.data();
+    Request.CleanItemCount = CleanItems.size();
+    NSUDO_TEST_CHECK_EQUAL(
+        ::NSudoSweeperStandardCleanupHandlerV2(&Request, nullptr),
+        NSUDO_SWEEPER_E_INVALIDARG);
+    Request.Flags = NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+    Request.CleanItems = nullptr;
+    NSUDO_TEST_CHECK_EQUAL(
+        ::NSudoSweeperStandardCleanupHandlerV2(&Request, nullptr),
+        NSUDO_SWEEPER_E_INVALIDARG);
+    Request.CleanItemCount = 0;
+    Request.Flags = 0x80000000 | NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+    NSUDO_TEST_CHECK_EQUAL(
+        ::NSudoSweeperStandardCleanupHandlerV2(&Request, nullptr),
+        NSUDO_SWEEPER_E_INVALIDARG);
+    Request.Flags = NSUDO_SWEEPER_REQUEST_CLEAN_ITEMS;
+    Request.Reserved = 1;
+    NSUDO_TEST_CHECK_EQUAL(
+        ::NSudoSweeperStandardCleanupHandlerV2(&Request, nullptr),
+        NSUDO_SWEEPER_E_INVALIDARG);
+}
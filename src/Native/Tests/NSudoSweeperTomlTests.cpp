@@ -0,0 +1,315 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperTomlTests.cpp
+ * PURPOSE:   Implementation for the TOML document parser tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperToml.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * Appends a string in the form of json.dumps with ensure_ascii=False.
+     */
+    void AppendString(
+        std::string& Result,
+        std::string_view Value)
+    {
+        Result += '"';
+        for (char Character : Value)
+        {
+            switch (Character)
+            {
+            case '"':
+                Result += "\\\"";
+                break;
+            case '\\':
+                Result += "\\\\";
+                break;
+            case '\b':
+                Result += "\\b";
+                break;
+            case '\f':
+                Result += "\\f";
+                break;
+            case '\n':
+                Result += "\\n";
+                break;
+            case '\r':
+                Result += "\\r";
+                break;
+            case '\t':
+                Result += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(Character) < 0x20)
+                {
+                    char Buffer[8];
+                    std::snprintf(
+                        Buffer,
+                        sizeof(Buffer),
+                        "\\u%04x",
+                        static_cast<unsigned char>(Character));
+                    Result += Buffer;
+                }
+                else
+                {
+                    Result += Character;
+                }
+                break;
+            }
+        }
+        Result += '"';
+    }
+
+    /**
+     * Converts a node to the JSON which GenerateExpected.py writes for it.
+     */
+    std::string ToJson(
+        NSudoSweeper::TomlDocument const& Document,
+        NSudoSweeper::TomlNode const* Node)
+    {
+        std::string Result;
+        char Buffer[32];
+
+        switch (Node->Type)
+        {
+        case NSudoSweeper::TomlType::Table:
+        {
+            // The keys are sorted by their bytes, which is the order of
+            // their code points in UTF-8.
+            std::map<std::string, std::string> Children;
+            for (NSudoSweeper::TomlNode const* Child =
+                Document.GetFirstChild(Node);
+                Child;
+                Child = Document.GetNextSibling(Child))
+            {
+                NSUDO_TEST_CHECK(Children.emplace(
+                    Child->Key,
+                    ::ToJson(Document, Child)).second);
+            }
+
+            Result += '{';
+            for (auto const& Child : Children)
+            {
+                if (Result.size() > 1)
+                {
+                    Result += ',';
+                }
+                ::AppendString(Result, Child.first);
+                Result += ':';
+                Result += Child.second;
+            }
+            Result += '}';
+            break;
+        }
+        case NSudoSweeper::TomlType::Array:
+            Result += '[';
+            for (NSudoSweeper::TomlNode const* Child =
+                Document.GetFirstChild(Node);
+                Child;
+                Child = Document.GetNextSibling(Child))
+            {
+                if (Result.size() > 1)
+                {
+                    Result += ',';
+                }
+                Result += ::ToJson(Document, Child);
+            }
+            Result += ']';
+            break;
+        case NSudoSweeper::TomlType::String:
+            Result += "{\"s\":";
+            ::AppendString(Result, Node->String);
+            Result += '}';
+            break;
+        case NSudoSweeper::TomlType::Integer:
+            std::snprintf(
+                Buffer,
+                sizeof(Buffer),
+                "{\"i\":%lld}",
+                static_cast<long long>(Node->Integer));
+            Result += Buffer;
+            break;
+        case NSudoSweeper::TomlType::Float:
+            if (std::isnan(Node->Float))
+            {
+                Result += "{\"f\":\"nan\"}";
+            }
+            else if (std::isinf(Node->Float))
+            {
+                Result += Node->Float < 0
+                    ? "{\"f\":\"-inf\"}"
+                    : "{\"f\":\"inf\"}";
+            }
+            else
+            {
+                std::snprintf(
+                    Buffer,
+                    sizeof(Buffer),
+                    "{\"f\":\"%.17g\"}",
+                    Node->Float);
+                Result += Buffer;
+            }
+            break;
+        case NSudoSweeper::TomlType::Boolean:
+            Result += Node->Boolean ? "{\"b\":true}" : "{\"b\":false}";
+            break;
+        default:
+            // The text of date-times is checked by DateTimesKeepTheirText.
+            Result += "{\"d\":null}";
+            break;
+        }
+
+        return Result;
+    }
+
+    /**
+     * Retrieves the paths of the documents in a directory of the corpus,
+     * sorted by their names.
+     */
+    std::vector<std::string> GetDocuments(
+        std::string const& Name)
+    {
+        std::vector<std::string> Result;
+        for (auto const& Entry : std::filesystem::directory_iterator(
+            NSudoTest::GetDataPath("Toml/" + Name)))
+        {
+            if (Entry.path().extension() == ".toml")
+            {
+                Result.push_back(Entry.path().string());
+            }
+        }
+        std::sort(Result.begin(), Result.end());
+        return Result;
+    }
+}
+
+NSUDO_TEST_CASE(ValidDocuments)
+{
+    std::vector<std::string> Documents = ::GetDocuments("Valid");
+    NSUDO_TEST_CHECK(!Documents.empty());
+
+    for (std::string const& Path : Documents)
+    {
+        std::string Source;
+        std::string Expected;
+        if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Source)) ||
+            !NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+                Path.substr(0, Path.size() - 5) + ".json",
+                Expected)))
+        {
+            continue;
+        }
+
+        NSudoSweeper::TomlDocument Document;
+        NSudoSweeper::TomlParseError Error;
+        if (!Document.Parse(Source, Error))
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "Document.Parse(Source, Error)",
+                Path + ":" + std::to_string(Error.Line) + ":" +
+                std::to_string(Error.Column) + ": " + Error.Message);
+            continue;
+        }
+
+        std::string Actual = ::ToJson(Document, Document.GetRoot()) + "\n";
+        if (Actual != Expected)
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "ToJson(Document) == Expected",
+                Path + "\n  " + Actual + "  " + Expected);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(InvalidDocuments)
+{
+    std::vector<std::string> Documents = ::GetDocuments("Invalid");
+    NSUDO_TEST_CHECK(!Documents.empty());
+
+    for (std::string const& Path : Documents)
+    {
+        std::string Source;
+        if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(Path, Source)))
+        {
+            continue;
+        }
+
+        NSudoSweeper::TomlDocument Document;
+        NSudoSweeper::TomlParseError Error;
+        if (Document.Parse(Source, Error))
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "!Document.Parse(Source, Error)",
+                Path);
+            continue;
+        }
+
+        // The error has a position and a reason, and the document is empty.
+        NSUDO_TEST_CHECK(Error.Line > 0);
+        NSUDO_TEST_CHECK(Error.Column > 0);
+        NSUDO_TEST_CHECK(Error.Message != nullptr);
+        NSUDO_TEST_CHECK(Document.GetRoot() == nullptr);
+    }
+}
+
+NSUDO_TEST_CASE(DateTimesKeepTheirText)
+{
+    std::string Source;
+    if (!NSUDO_TEST_CHECK(NSudoTest::ReadFile(
+        NSudoTest::GetDataPath("Toml/Valid/DateTimes.toml"),
+        Source)))
+    {
+        return;
+    }
+
+    NSudoSweeper::TomlDocument Document;
+    NSudoSweeper::TomlParseError Error;
+    if (!NSUDO_TEST_CHECK(Document.Parse(Source, Error)))
+    {
+        return;
+    }
+
+    std::pair<char const*, char const*> const Expected[] =
+    {
+        { "odt1", "1979-05-27T07:32:00Z" },
+        { "odt2", "1979-05-27T00:32:00-07:00" },
+        { "odt3", "1979-05-27T00:32:00.999999-07:00" },
+        { "odt4", "1979-05-27 07:32:00Z" },
+        { "ldt1", "1979-05-27T07:32:00" },
+        { "ld1", "1979-05-27" },
+        { "lt1", "07:32:00" },
+        { "lt2", "00:32:00.999999" },
+    };
+    for (auto const& Item : Expected)
+    {
+        NSudoSweeper::TomlNode const* Node =
+            Document.GetChild(Document.GetRoot(), Item.first);
+        if (NSUDO_TEST_CHECK(Node != nullptr) &&
+            NSUDO_TEST_CHECK(Node->Type == NSudoSweeper::TomlType::DateTime))
+        {
+            NSUDO_TEST_CHECK_EQUAL(std::string(Node->String), Item.second);
+        }
+    }
+}
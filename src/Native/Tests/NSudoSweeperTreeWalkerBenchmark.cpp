@@ -0,0 +1,145 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperTreeWalkerBenchmark.cpp
+ * PURPOSE:   Implementation for the parallel directory tree walker benchmark
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+    struct WalkTotals
+    {
+        std::uint64_t Files = 0;
+        std::uint64_t Size = 0;
+    };
+
+    WalkTotals WalkWithTreeWalker(
+        std::string const& Root,
+        std::size_t Threads)
+    {
+        WalkTotals Totals;
+
+        Mile::ThreadPool Pool(Threads);
+        NSudoSweeper::TreeWalker Walker(Pool);
+        Walker.SetBatchHandler([&Totals](
+            std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+        {
+            for (NSudoSweeper::TreeWalkerItem const& Item : Batch)
+            {
+                if (Item.Type == Mile::FileEntryType::File)
+                {
+                    ++Totals.Files;
+                    Totals.Size += Item.Size;
+                }
+            }
+        });
+        Walker.Walk(std::vector<Mile::NativeString>{ Root });
+
+        return Totals;
+    }
+
+    WalkTotals WalkWithDirectoryIterator(
+        std::string const& Root)
+    {
+        WalkTotals Totals;
+
+        for (std::filesystem::directory_entry const& Entry
+            : std::filesystem::recursive_directory_iterator(Root))
+        {
+            std::error_code ErrorCode;
+            if (Entry.is_regular_file(ErrorCode))
+            {
+                ++Totals.Files;
+                Totals.Size += Entry.file_size(ErrorCode);
+            }
+        }
+
+        return Totals;
+    }
+
+    template<typename FunctionType>
+    void Measure(
+        std::string const& Name,
+        NSudoTest::SyntheticTreeTotals const& Expected,
+        FunctionType&& Function)
+    {
+        NSudoTest::Stopwatch Timer;
+        WalkTotals Totals = Function();
+        double Seconds = Timer.GetSeconds();
+
+        NSUDO_TEST_CHECK_EQUAL(Totals.Files, Expected.Files);
+        NSUDO_TEST_CHECK_EQUAL(Totals.Size, Expected.Size);
+
+        NSudoTest::PrintMeasurement(
+            Name,
+            Seconds,
+            static_cast<double>(Totals.Files),
+            "files");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    NSudoTest::BenchmarkOptions Options;
+    if (!NSudoTest::ParseBenchmarkOptions(argc, argv, Options))
+    {
+        return 1;
+    }
+
+    // 1,111 directories with 900 files each is 999,900 files.
+    NSudoTest::SyntheticTreeOptions TreeOptions;
+    TreeOptions.Depth = 3;
+    TreeOptions.FanOut = Options.Quick ? 3 : 10;
+    TreeOptions.FilesPerDirectory = Options.Quick ? 20 : 900;
+
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.Join("Tree");
+
+    NSudoTest::Stopwatch CreateTimer;
+    NSudoTest::SyntheticTreeTotals Expected =
+        NSudoTest::CreateSyntheticTree(Root, TreeOptions);
+    std::printf(
+        "Created %llu files in %llu directories, %llu bytes, in %.1f s\n\n",
+        static_cast<unsigned long long>(Expected.Files),
+        static_cast<unsigned long long>(Expected.Directories + 1),
+        static_cast<unsigned long long>(Expected.Size),
+        CreateTimer.GetSeconds());
+
+    // Warm the caches of the file system, so every walk reads from them.
+    ::WalkWithTreeWalker(Root, 1);
+
+    const std::size_t ThreadCounts[] = { 1, 2, 4, 8, 16 };
+    for (std::size_t Threads : ThreadCounts)
+    {
+        ::Measure(
+            "TreeWalker (" + std::to_string(Threads) + " threads)",
+            Expected,
+            [&]()
+        {
+            return ::WalkWithTreeWalker(Root, Threads);
+        });
+    }
+
+    ::Measure(
+        "std::filesystem::recursive_directory_iterator",
+        Expected,
+        [&]()
+    {
+        return ::WalkWithDirectoryIterator(Root);
+    });
+
+    return NSudoTest::GetFailureCount() ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperTreeWalkerTests.cpp
+ * PURPOSE:   Implementation for the parallel directory tree walker tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperTreeWalker.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    std::map<std::string, NSudoSweeper::TreeWalkerItem> Walk(
+        NSudoSweeper::TreeWalker& Walker,
+        std::string const& Root)
+    {
+        std::map<std::string, NSudoSweeper::TreeWalkerItem> Result;
+        Walker.SetBatchHandler([&Result](
+            std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+        {
+            for (NSudoSweeper::TreeWalkerItem& Item : Batch)
+            {
+                NSUDO_TEST_CHECK(Result.emplace(Item.Path, Item).second);
+            }
+        });
+        NSUDO_TEST_CHECK(Walker.Walk(std::vector<Mile::NativeString>{ Root }));
+        return Result;
+    }
+}
+
+NSUDO_TEST_CASE(ReportsEveryEntryWithItsSize)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.Join("Tree");
+
+    NSudoTest::SyntheticTreeOptions TreeOptions;
+    TreeOptions.Depth = 3;
+    TreeOptions.FanOut = 3;
+    TreeOptions.FilesPerDirectory = 10;
+    NSudoTest::SyntheticTreeTotals Expected =
+        NSudoTest::CreateSyntheticTree(Root, TreeOptions);
+
+    // Files with allocated blocks, which the sparse files of the tree do
+    // not have.
+    NSudoTest::WriteFile(Root + "/Data.bin", std::string(10000, 'x'));
+    NSudoTest::WriteFile(Root + "/Directory1/Data.bin", std::string(1, 'x'));
+    Expected.Files += 2;
+    Expected.Size += 10001;
+
+    for (std::size_t Threads : { 1, 4 })
+    {
+        Mile::ThreadPool Pool(Threads);
+        NSudoSweeper::TreeWalkerOptions Options;
+        Options.BatchSize = 7;
+        NSudoSweeper::TreeWalker Walker(Pool, Options);
+
+        std::map<std::string, NSudoSweeper::TreeWalkerItem> Items =
+            ::Walk(Walker, Root);
+
+        std::uint64_t Files = 0;
+        std::uint64_t Directories = 0;
+        std::uint64_t Size = 0;
+        for (auto const& Entry : Items)
+        {
+            NSudoSweeper::TreeWalkerItem const& Item = Entry.second;
+            if (Item.Type == Mile::FileEntryType::Directory)
+            {
+                ++Directories;
+                NSUDO_TEST_CHECK_EQUAL(Item.Size, 0U);
+                continue;
+            }
+
+            NSUDO_TEST_CHECK(Item.Type == Mile::FileEntryType::File);
+            ++Files;
+            Size += Item.Size;
+
+#if !defined(_WIN32)
+            struct stat Status;
+            NSUDO_TEST_CHECK(0 == ::lstat(Item.Path.c_str(), &Status));
+            NSUDO_TEST_CHECK_EQUAL(
+                Item.Size,
+                static_cast<std::uint64_t>(Status.st_size));
+            NSUDO_TEST_CHECK_EQUAL(
+                Item.AllocationSize,
+                static_cast<std::uint64_t>(Status.st_blocks) * 512);
+            NSUDO_TEST_CHECK_EQUAL(
+                Item.FileId,
+                static_cast<std::uint64_t>(Status.st_ino));
+#endif
+        }
+
+        NSUDO_TEST_CHECK_EQUAL(Files, Expected.Files);
+        NSUDO_TEST_CHECK_EQUAL(Directories, Expected.Directories);
+        NSUDO_TEST_CHECK_EQUAL(Size, Expected.Size);
+
+        auto Data = Items.find(Root + "/Data.bin");
+        if (NSUDO_TEST_CHECK(Data != Items.end()))
+        {
+            NSUDO_TEST_CHECK_EQUAL(Data->second.Size, 10000U);
+            NSUDO_TEST_CHECK(Data->second.AllocationSize >= 10000U);
+            NSUDO_TEST_CHECK_EQUAL(Data->second.Depth, 0U);
+        }
+
+        NSudoSweeper::TreeWalkerStatistics Statistics =
+            Walker.GetStatistics();
+        NSUDO_TEST_CHECK_EQUAL(Statistics.Directories, Directories + 1);
+        NSUDO_TEST_CHECK_EQUAL(Statistics.ReportedEntries, Items.size());
+        NSUDO_TEST_CHECK_EQUAL(Statistics.Errors, 0U);
+    }
+}
+
+NSUDO_TEST_CASE(FiltersAndDepthLimits)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.Join("Tree");
+
+    NSudoTest::SyntheticTreeOptions TreeOptions;
+    TreeOptions.Depth = 3;
+    TreeOptions.FanOut = 2;
+    TreeOptions.FilesPerDirectory = 3;
+    NSudoTest::CreateSyntheticTree(Root, TreeOptions);
+
+    Mile::ThreadPool Pool(2);
+
+    {
+        // Directory0 is pruned, and the other directories are skipped but
+        // walked, so only the files below Directory1 are reported.
+        NSudoSweeper::TreeWalker Walker(Pool);
+        Walker.AddFilter([](
+            Mile::NativeStringView,
+            Mile::FileEnumeratorEntry const& Entry,
+            std::uint32_t Depth)
+        {
+            if (Entry.GetType() != Mile::FileEntryType::Directory)
+            {
+                return NSudoSweeper::TreeWalkerFilterResult::Include;
+            }
+            return (Depth == 0 && Entry.GetName() == "Directory0")
+                ? NSudoSweeper::TreeWalkerFilterResult::Prune
+                : NSudoSweeper::TreeWalkerFilterResult::Skip;
+        });
+
+        std::map<std::string, NSudoSweeper::TreeWalkerItem> Items =
+            ::Walk(Walker, Root);
+
+        // 3 files in the root, and 7 directories with 3 files below
+        // Directory1.
+        NSUDO_TEST_CHECK_EQUAL(Items.size(), 24U);
+        for (auto const& Entry : Items)
+        {
+            NSUDO_TEST_CHECK(
+                Entry.second.Type == Mile::FileEntryType::File);
+            NSUDO_TEST_CHECK(
+                Entry.first.find("/Directory0") == std::string::npos ||
+                Entry.first.find("/Directory1/") != std::string::npos);
+        }
+    }
+
+    {
+        NSudoSweeper::TreeWalkerOptions Options;
+        Options.MaximumDepth = 1;
+        NSudoSweeper::TreeWalker Walker(Pool, Options);
+
+        std::map<std::string, NSudoSweeper::TreeWalkerItem> Items =
+            ::Walk(Walker, Root);
+
+        // The root and its 2 subdirectories with 3 files each, and the 4
+        // directories of the second level.
+        NSUDO_TEST_CHECK_EQUAL(Items.size(), 15U);
+        for (auto const& Entry : Items)
+        {
+            NSUDO_TEST_CHECK(Entry.second.Depth <= 1);
+        }
+    }
+}
+
+NSUDO_TEST_CASE(MissingRootIsAnError)
+{
+    NSudoTest::TemporaryDirectory Directory;
+
+    Mile::ThreadPool Pool(1);
+    NSudoSweeper::TreeWalker Walker(Pool);
+
+    std::size_t Errors = 0;
+    Walker.SetErrorHandler([&Errors](Mile::NativeStringView, int)
+    {
+        ++Errors;
+    });
+
+    std::map<std::string, NSudoSweeper::TreeWalkerItem> Items =
+        ::Walk(Walker, Directory.Join("Missing"));
+    NSUDO_TEST_CHECK(Items.empty());
+    NSUDO_TEST_CHECK_EQUAL(Errors, 1U);
+    NSUDO_TEST_CHECK_EQUAL(Walker.GetStatistics().Errors, 1U);
+}
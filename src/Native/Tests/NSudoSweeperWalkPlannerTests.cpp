@@ -0,0 +1,429 @@
+﻿/*
+ * PROJECT:   NSudo Sweeper
+ * FILE:      NSudoSweeperWalkPlannerTests.cpp
+ * PURPOSE:   Implementation for the walk root planner tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include "NSudoSweeperPathRules.h"
+#include "NSudoSweeperTreeWalker.h"
+#include "NSudoSweeperWalkPlanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::size_t CountComponents(
+        std::string const& Path)
+    {
+        std::size_t Result = 0;
+        for (std::size_t i = 0; i < Path.size(); ++i)
+        {
+            if (Path[i] != '/' && (i == 0 || Path[i - 1] == '/'))
+            {
+                ++Result;
+            }
+        }
+        return Result;
+    }
+
+    /**
+     * Checks whether a walk from a root reaches a path, which is the case if
+     * the root is an ancestor of the path and the path is not deeper than
+     * the maximum depth of the root.
+     */
+    bool IsReachedBy(
+        NSudoSweeper::WalkPlanRoot const& Root,
+        std::string const& Path,
+        bool IsDirectory)
+    {
+        std::string Prefix = Root.Path;
+        if (Prefix.back() != '/')
+        {
+            Prefix.push_back('/');
+        }
+        if (Path.compare(0, Prefix.size(), Prefix) != 0)
+        {
+            return false;
+        }
+
+        // The entries of the root have the depth 0, and a directory is
+        // enumerated if its depth does not exceed the maximum one.
+        std::size_t Depth = ::CountComponents(Path.substr(Prefix.size()));
+        if (!IsDirectory)
+        {
+            --Depth;
+        }
+        return Root.MaximumDepth == UINT32_MAX || Depth <= Root.MaximumDepth;
+    }
+
+    void PrintPlan(
+        NSudoSweeper::WalkPlan const& Plan)
+    {
+        for (NSudoSweeper::WalkPlanRoot const& Root : Plan.Roots)
+        {
+            std::printf(
+                "  Root \"%s\", depth %d, groups",
+                Root.Path.c_str(),
+                static_cast<int>(Root.MaximumDepth));
+            for (std::uint32_t Group : Root.Groups)
+            {
+                std::printf(" %u", Group);
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+NSUDO_TEST_CASE(LiteralPrefixAndDepth)
+{
+    NSudoSweeper::WalkPlanner Planner;
+    Planner.AddInclude(0, "/a/*/*.log");
+    Planner.AddInclude(1, "/b/c/**/*.tmp");
+    Planner.AddInclude(2, "/d/*.txt");
+    Planner.AddInclude(3, "**/*.pyc");
+    Planner.AddInclude(4, "*.o");
+
+    NSudoSweeper::WalkPlan Plan = Planner.Plan();
+    NSUDO_TEST_CHECK_EQUAL(Plan.UnplannablePatterns, 2U);
+    NSUDO_TEST_CHECK_EQUAL(Plan.ExcludedRoots, 0U);
+    if (!NSUDO_TEST_CHECK_EQUAL(Plan.Roots.size(), 3U))
+    {
+        return;
+    }
+
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].Path, std::string("/a"));
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].MaximumDepth, 1U);
+    NSUDO_TEST_CHECK((Plan.Roots[0].Groups == std::vector<std::uint32_t>{ 0 }));
+
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[1].Path, std::string("/b/c"));
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[1].MaximumDepth, UINT32_MAX);
+
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[2].Path, std::string("/d"));
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[2].MaximumDepth, 0U);
+
+    std::vector<NSudoSweeper::TreeWalkerRoot> WalkerRoots =
+        Plan.GetTreeWalkerRoots();
+    NSUDO_TEST_CHECK_EQUAL(WalkerRoots.size(), 3U);
+    NSUDO_TEST_CHECK_EQUAL(WalkerRoots[1].Path, std::string("/b/c"));
+    NSUDO_TEST_CHECK_EQUAL(WalkerRoots[1].MaximumDepth, UINT32_MAX);
+
+    // A file directly below the root of a POSIX path keeps the separator.
+    NSudoSweeper::WalkPlanner RootPlanner;
+    RootPlanner.AddInclude(0, "/*.log");
+    Plan = RootPlanner.Plan();
+    if (NSUDO_TEST_CHECK_EQUAL(Plan.Roots.size(), 1U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].Path, std::string("/"));
+        NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].MaximumDepth, 0U);
+    }
+}
+
+NSUDO_TEST_CASE(MergesAcrossGroups)
+{
+    NSudoSweeper::WalkPlanner Planner;
+    Planner.AddInclude(2, "/a/b/c/*.log");
+    Planner.AddInclude(0, "/a/*/*");
+    Planner.AddInclude(1, "/a/b/**");
+
+    // Stops above /x/y/z, so the two never enumerate the same directory.
+    Planner.AddInclude(3, "/x/*.log");
+    Planner.AddInclude(4, "/x/y/z/*.log");
+
+    NSudoSweeper::WalkPlan Plan = Planner.Plan();
+    NSUDO_TEST_CHECK_EQUAL(Plan.CandidateRoots.size(), 5U);
+    if (!NSUDO_TEST_CHECK_EQUAL(Plan.Roots.size(), 3U))
+    {
+        ::PrintPlan(Plan);
+        return;
+    }
+
+    // "/a" reaches "/a/b", whose "**" extends the depth of "/a".
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].Path, std::string("/a"));
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].MaximumDepth, UINT32_MAX);
+    NSUDO_TEST_CHECK((
+        Plan.Roots[0].Groups == std::vector<std::uint32_t>{ 0, 1, 2 }));
+
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[1].Path, std::string("/x"));
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[1].MaximumDepth, 0U);
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots[2].Path, std::string("/x/y/z"));
+}
+
+NSUDO_TEST_CASE(ExcludedSubtrees)
+{
+    NSudoSweeper::WalkPlanner Planner;
+    Planner.AddInclude(0, "/a/b/*.log");
+    Planner.AddInclude(1, "/a/b/*.tmp");
+    Planner.AddInclude(0, "/a/c/*.log");
+
+    // Removes the root of group 0 only.
+    Planner.AddExclude(0, "/a/b/**");
+
+    // Ignored, because they do not end with "**" or do not start with
+    // literal directories.
+    Planner.AddExclude(0, "/a/c/*.log");
+    Planner.AddExclude(0, "/*/c/**");
+
+    NSudoSweeper::WalkPlan Plan = Planner.Plan();
+    NSUDO_TEST_CHECK_EQUAL(Plan.ExcludedRoots, 1U);
+    if (NSUDO_TEST_CHECK_EQUAL(Plan.Roots.size(), 2U))
+    {
+        NSUDO_TEST_CHECK_EQUAL(Plan.Roots[0].Path, std::string("/a/b"));
+        NSUDO_TEST_CHECK((
+            Plan.Roots[0].Groups == std::vector<std::uint32_t>{ 1 }));
+        NSUDO_TEST_CHECK_EQUAL(Plan.Roots[1].Path, std::string("/a/c"));
+    }
+}
+
+NSUDO_TEST_CASE(Estimate)
+{
+    NSudoSweeper::WalkPlanner Planner;
+    Planner.AddInclude(0, "/a/*.log");
+    Planner.AddInclude(1, "/a/b/*.log");
+    Planner.AddInclude(2, "/c/**");
+
+    // Every directory has 10 subdirectories, and a volume has 10,000
+    // directories.
+    std::vector<std::string> Calls;
+    NSudoSweeper::WalkPlanEstimate Estimate =
+        NSudoSweeper::EstimateVisitedDirectories(
+            Planner.Plan(),
+            [&Calls](Mile::NativeStringView Path, std::uint32_t Depth)
+    {
+        Calls.emplace_back(Path);
+        if (Depth == UINT32_MAX)
+        {
+            return Path == "/" ? 10000U : 100U;
+        }
+        return Depth == 0 ? 1U : 11U;
+    });
+
+    NSUDO_TEST_CHECK_EQUAL(Estimate.PlannedDirectories, 102U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.UnmergedDirectories, 102U);
+    NSUDO_TEST_CHECK_EQUAL(Estimate.VolumeDirectories, 10000U);
+
+    // The three roots are counted as planned and as unmerged, and the
+    // volume which contains them once.
+    NSUDO_TEST_CHECK_EQUAL(Calls.size(), 7U);
+}
+
+NSUDO_TEST_CASE(RandomPatternsReachEverySelectedPath)
+{
+    std::mt19937 Generator(36);
+    std::uniform_int_distribution<int> PickComponentCount(1, 5);
+    std::uniform_int_distribution<int> PickPatternCount(1, 6);
+    std::uniform_int_distribution<std::uint32_t> PickGroup(0, 2);
+
+    const char* const Names[] = { "a", "b", "c" };
+    const char* const Wildcards[] = { "*", "**", "?", "[ab]", "a*" };
+    std::uniform_int_distribution<std::size_t> PickName(0, 2);
+    std::uniform_int_distribution<std::size_t> PickWildcard(0, 4);
+    std::bernoulli_distribution PickLiteral(0.7);
+    std::bernoulli_distribution PickExclude(0.25);
+
+    // Every path of up to 5 components over the names.
+    std::vector<std::string> Paths;
+    std::vector<std::string> Level = { "" };
+    for (int Depth = 0; Depth < 5; ++Depth)
+    {
+        std::vector<std::string> Next;
+        for (std::string const& Parent : Level)
+        {
+            for (char const* Name : Names)
+            {
+                Next.push_back(Parent + "/" + Name);
+            }
+        }
+        Paths.insert(Paths.end(), Next.begin(), Next.end());
+        Level.swap(Next);
+    }
+
+    std::size_t Selected = 0;
+    for (int Iteration = 0; Iteration < 400; ++Iteration)
+    {
+        NSudoSweeper::WalkPlanner Planner;
+        NSudoSweeper::PathRuleSet Rules;
+        std::vector<std::string> Patterns;
+
+        for (int Count = PickPatternCount(Generator); Count; --Count)
+        {
+            std::string Pattern;
+            for (int i = PickComponentCount(Generator); i; --i)
+            {
+                Pattern += '/';
+                Pattern += PickLiteral(Generator)
+                    ? Names[PickName(Generator)]
+                    : Wildcards[PickWildcard(Generator)];
+            }
+
+            std::uint32_t Group = PickGroup(Generator);
+            bool Exclude = PickExclude(Generator);
+            if (Exclude)
+            {
+                Pattern += "/**";
+                Planner.AddExclude(Group, Pattern);
+                Rules.AddRule(
+                    Group,
+                    NSudoSweeper::PathRuleKind::Exclude,
+                    Pattern);
+            }
+            else
+            {
+                Planner.AddInclude(Group, Pattern);
+                Rules.AddRule(
+                    Group,
+                    NSudoSweeper::PathRuleKind::Include,
+                    Pattern);
+            }
+            Patterns.push_back(
+                (Exclude ? "Exclude " : "Include ") +
+                std::to_string(Group) + " \"" + Pattern + "\"");
+        }
+        Rules.Compile();
+
+        // Every pattern starts with the root of the volume.
+        NSudoSweeper::WalkPlan Plan = Planner.Plan();
+        NSUDO_TEST_CHECK_EQUAL(Plan.UnplannablePatterns, 0U);
+        bool Failed = false;
+
+        // No directory is enumerated by two roots.
+        for (NSudoSweeper::WalkPlanRoot const& Ancestor : Plan.Roots)
+        {
+            for (NSudoSweeper::WalkPlanRoot const& Descendant : Plan.Roots)
+            {
+                if (&Ancestor != &Descendant &&
+                    ::IsReachedBy(Ancestor, Descendant.Path, true))
+                {
+                    Failed = !NSUDO_TEST_CHECK(!"A root reaches another.");
+                }
+            }
+        }
+
+        // Every selected path is reached by a root of its group.
+        NSudoSweeper::PathRuleMatch Match;
+        for (std::string const& Path : Paths)
+        {
+            if (!Rules.Match(Path, Match))
+            {
+                continue;
+            }
+            ++Selected;
+
+            for (std::uint32_t Group : Match.SelectedGroups)
+            {
+                bool Reached = false;
+                for (NSudoSweeper::WalkPlanRoot const& Root : Plan.Roots)
+                {
+                    Reached = Reached ||
+                        (::IsReachedBy(Root, Path, false) &&
+                            std::binary_search(
+                                Root.Groups.begin(),
+                                Root.Groups.end(),
+                                Group));
+                }
+                if (!NSUDO_TEST_CHECK(Reached))
+                {
+                    std::printf(
+                        "  \"%s\" of group %u\n",
+                        Path.c_str(),
+                        Group);
+                    Failed = true;
+                }
+            }
+        }
+
+        if (Failed)
+        {
+            for (std::string const& Pattern : Patterns)
+            {
+                std::printf("  %s\n", Pattern.c_str());
+            }
+            ::PrintPlan(Plan);
+            return;
+        }
+    }
+
+    NSUDO_TEST_CHECK(Selected > 1000);
+}
+
+NSUDO_TEST_CASE(WalkingThePlanFindsTheSameFiles)
+{
+    NSudoTest::TemporaryDirectory Directory;
+    std::string Root = Directory.Join("Tree");
+
+    NSudoTest::SyntheticTreeOptions TreeOptions;
+    TreeOptions.Depth = 3;
+    TreeOptions.FanOut = 3;
+    TreeOptions.FilesPerDirectory = 4;
+    NSudoTest::CreateSyntheticTree(Root, TreeOptions);
+
+    const std::string Patterns[] =
+    {
+        Root + "/Directory0/*/File1.tmp",
+        Root + "/Directory1/**/File[02].tmp",
+        Root + "/Directory1/Directory2/*",
+        Root + "/Directory2/Directory0/Directory1/*.tmp",
+        Root + "/Directory2/*.tmp",
+    };
+
+    NSudoSweeper::WalkPlanner Planner;
+    NSudoSweeper::PathRuleSet Rules;
+    for (std::string const& Pattern : Patterns)
+    {
+        Planner.AddInclude(0, Pattern);
+        Rules.AddRule(0, NSudoSweeper::PathRuleKind::Include, Pattern);
+    }
+    Rules.Compile();
+
+    NSudoSweeper::WalkPlan Plan = Planner.Plan();
+    NSUDO_TEST_CHECK_EQUAL(Plan.Roots.size(), 4U);
+
+    auto Walk = [&Rules](
+        std::vector<NSudoSweeper::TreeWalkerRoot> const& Roots,
+        std::uint64_t& Directories)
+    {
+        std::multiset<std::string> Result;
+
+        Mile::ThreadPool Pool(2);
+        NSudoSweeper::TreeWalker Walker(Pool);
+        Walker.SetBatchHandler([&](
+            std::vector<NSudoSweeper::TreeWalkerItem>& Batch)
+        {
+            for (NSudoSweeper::TreeWalkerItem const& Item : Batch)
+            {
+                if (Rules.IsSelected(Item.Path))
+                {
+                    Result.insert(Item.Path);
+                }
+            }
+        });
+        Walker.Walk(Roots);
+        Directories = Walker.GetStatistics().Directories;
+
+        return Result;
+    };
+
+    std::uint64_t PlannedDirectories = 0;
+    std::multiset<std::string> Planned = Walk(
+        Plan.GetTreeWalkerRoots(),
+        PlannedDirectories);
+
+    std::uint64_t AllDirectories = 0;
+    std::multiset<std::string> All = Walk(
+        { NSudoSweeper::TreeWalkerRoot{ Root, UINT32_MAX } },
+        AllDirectories);
+
+    NSUDO_TEST_CHECK(!All.empty());
+    NSUDO_TEST_CHECK(Planned == All);
+    NSUDO_TEST_CHECK(PlannedDirectories < AllDirectories);
+}
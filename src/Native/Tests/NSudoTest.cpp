@@ -0,0 +1,373 @@
+﻿/*
+ * PROJECT:   NSudo
+ * FILE:      NSudoTest.cpp
+ * PURPOSE:   Implementation for the helpers of the tests and benchmarks
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    struct TestEntry
+    {
+        char const* Name;
+        NSudoTest::TestFunction Function;
+    };
+
+    std::vector<TestEntry>& GetTests()
+    {
+        static std::vector<TestEntry> Tests;
+        return Tests;
+    }
+
+    std::size_t g_FailureCount = 0;
+
+    bool IsSelected(
+        char const* Name,
+        int argc,
+        char** argv)
+    {
+        if (argc < 2)
+        {
+            return true;
+        }
+
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strstr(Name, argv[i]))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+NSudoTest::Registration::Registration(
+    char const* Name,
+    TestFunction Function)
+{
+    ::GetTests().push_back(TestEntry{ Name, Function });
+}
+
+int NSudoTest::RunTests(
+    int argc,
+    char** argv)
+{
+    std::size_t RunCount = 0;
+    std::size_t FailedCount = 0;
+
+    for (TestEntry const& Test : ::GetTests())
+    {
+        if (!::IsSelected(Test.Name, argc, argv))
+        {
+            continue;
+        }
+
+        std::printf("[ RUN  ] %s\n", Test.Name);
+        std::fflush(stdout);
+
+        std::size_t PreviousFailureCount = ::g_FailureCount;
+        try
+        {
+            Test.Function();
+        }
+        catch (std::exception const& Exception)
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "unexpected exception",
+                Exception.what());
+        }
+        catch (...)
+        {
+            NSudoTest::ReportFailure(
+                __FILE__,
+                __LINE__,
+                "unexpected exception");
+        }
+
+        ++RunCount;
+        if (PreviousFailureCount == ::g_FailureCount)
+        {
+            std::printf("[  OK  ] %s\n", Test.Name);
+        }
+        else
+        {
+            ++FailedCount;
+            std::printf("[ FAIL ] %s\n", Test.Name);
+        }
+        std::fflush(stdout);
+    }
+
+    std::printf(
+        "%zu of %zu tests passed.\n",
+        RunCount - FailedCount,
+        RunCount);
+
+    return (RunCount && !FailedCount) ? 0 : 1;
+}
+
+void NSudoTest::ReportFailure(
+    char const* File,
+    int Line,
+    char const* Expression,
+    std::string const& Details)
+{
+    ++::g_FailureCount;
+
+    if (Details.empty())
+    {
+        std::printf("%s:%d: check failed: %s\n", File, Line, Expression);
+    }
+    else
+    {
+        std::printf(
+            "%s:%d: check failed: %s (%s)\n",
+            File,
+            Line,
+            Expression,
+            Details.c_str());
+    }
+    std::fflush(stdout);
+}
+
+std::size_t NSudoTest::GetFailureCount() noexcept
+{
+    return ::g_FailureCount;
+}
+
+std::string NSudoTest::GetDataPath(
+    std::string const& Name)
+{
+    return std::string(NSUDO_TEST_DATA_DIRECTORY) + "/" + Name;
+}
+
+bool NSudoTest::ReadFile(
+    std::string const& Path,
+    std::string& Content)
+{
+    std::ifstream Stream(Path, std::ios::binary);
+    if (!Stream)
+    {
+        return false;
+    }
+
+    Content.assign(
+        std::istreambuf_iterator<char>(Stream),
+        std::istreambuf_iterator<char>());
+
+    return !Stream.bad();
+}
+
+void NSudoTest::WriteFile(
+    std::string const& Path,
+    std::string const& Content)
+{
+    std::filesystem::path FilePath(Path);
+    if (FilePath.has_parent_path())
+    {
+        std::filesystem::create_directories(FilePath.parent_path());
+    }
+
+    std::ofstream Stream(
+        FilePath,
+        std::ios::binary | std::ios::trunc);
+    Stream.write(Content.data(), static_cast<std::streamsize>(
+        Content.size()));
+    if (!Stream)
+    {
+        throw std::runtime_error("Failed to write " + Path);
+    }
+}
+
+NSudoTest::TemporaryDirectory::TemporaryDirectory()
+{
+    std::filesystem::path Root = std::filesystem::temp_directory_path();
+
+    std::random_device Device;
+    std::mt19937_64 Generator(
+        (static_cast<std::uint64_t>(Device()) << 32) ^ Device());
+
+    for (;;)
+    {
+        char Name[32];
+        std::snprintf(
+            Name,
+            sizeof(Name),
+            "NSudoTest-%016llx",
+            static_cast<unsigned long long>(Generator()));
+
+        std::filesystem::path Candidate = Root / Name;
+        if (std::filesystem::create_directory(Candidate))
+        {
+            this->m_Path = Candidate.string();
+            break;
+        }
+    }
+}
+
+NSudoTest::TemporaryDirectory::~TemporaryDirectory()
+{
+    std::error_code ErrorCode;
+    std::filesystem::remove_all(this->m_Path, ErrorCode);
+}
+
+namespace
+{
+    void CreateSizedFile(
+        std::string const& Path,
+        std::uint64_t Size)
+    {
+#if defined(_WIN32)
+        std::ofstream(Path, std::ios::binary | std::ios::trunc);
+        std::filesystem::resize_file(Path, Size);
+#else
+        int Handle = ::open(
+            Path.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+        if (Handle == -1)
+        {
+            throw std::runtime_error("Failed to create " + Path);
+        }
+        int Result = ::ftruncate(Handle, static_cast<off_t>(Size));
+        ::close(Handle);
+        if (Result == -1)
+        {
+            throw std::runtime_error("Failed to resize " + Path);
+        }
+#endif
+    }
+
+    void CreateSyntheticDirectory(
+        std::string const& Path,
+        std::uint32_t Level,
+        NSudoTest::SyntheticTreeOptions const& Options,
+        std::mt19937& Generator,
+        NSudoTest::SyntheticTreeTotals& Totals)
+    {
+        std::filesystem::create_directories(Path);
+
+        std::uniform_int_distribution<std::uint32_t> PickSize(
+            0,
+            Options.MaximumFileSize);
+        for (std::uint32_t i = 0; i < Options.FilesPerDirectory; ++i)
+        {
+            std::uint64_t Size = PickSize(Generator);
+            ::CreateSizedFile(
+                Path + "/File" + std::to_string(i) + ".tmp",
+                Size);
+            ++Totals.Files;
+            Totals.Size += Size;
+        }
+
+        if (Level >= Options.Depth)
+        {
+            return;
+        }
+
+        for (std::uint32_t i = 0; i < Options.FanOut; ++i)
+        {
+            ++Totals.Directories;
+            ::CreateSyntheticDirectory(
+                Path + "/Directory" + std::to_string(i),
+                Level + 1,
+                Options,
+                Generator,
+                Totals);
+        }
+    }
+}
+
+NSudoTest::SyntheticTreeTotals NSudoTest::CreateSyntheticTree(
+    std::string const& Root,
+    SyntheticTreeOptions const& Options)
+{
+    SyntheticTreeTotals Totals;
+    std::mt19937 Generator(Options.Seed);
+    ::CreateSyntheticDirectory(Root, 0, Options, Generator, Totals);
+    return Totals;
+}
+
+bool NSudoTest::ParseBenchmarkOptions(
+    int argc,
+    char** argv,
+    BenchmarkOptions& Options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--quick"))
+        {
+            Options.Quick = true;
+        }
+        else
+        {
+            std::printf(
+                "Usage: %s [--quick]\n"
+                "\n"
+                "  --quick  Runs on small inputs, which only checks that "
+                "the benchmark works.\n",
+                argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void NSudoTest::PrintMeasurement(
+    std::string const& Name,
+    double Seconds,
+    double Count,
+    char const* Unit)
+{
+    double Rate = (Seconds > 0.0) ? Count / Seconds : 0.0;
+    char const* Prefix = "";
+    if (Rate >= 1e9)
+    {
+        Rate /= 1e9;
+        Prefix = "G";
+    }
+    else if (Rate >= 1e6)
+    {
+        Rate /= 1e6;
+        Prefix = "M";
+    }
+    else if (Rate >= 1e3)
+    {
+        Rate /= 1e3;
+        Prefix = "k";
+    }
+
+    std::printf(
+        "%-48s %10.3f ms %10.2f %s%s/s\n",
+        Name.c_str(),
+        Seconds * 1000.0,
+        Rate,
+        Prefix,
+        Unit);
+    std::fflush(stdout);
+}
@@ -0,0 +1,380 @@
+﻿/*
+ * PROJECT:   NSudo
+ * FILE:      NSudoTest.h
+ * PURPOSE:   Definition for the helpers of the tests and benchmarks
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#ifndef NSUDO_TEST
+#define NSUDO_TEST
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace NSudoTest
+{
+    typedef void(*TestFunction)();
+
+    /**
+     * Registers a test, which is what NSUDO_TEST_CASE does.
+     */
+    class Registration
+    {
+    public:
+
+        Registration(
+            char const* Name,
+            TestFunction Function);
+    };
+
+    /**
+     * Runs the registered tests whose names contain one of the arguments,
+     * or all of them if there is no argument.
+     *
+     * @return 0 if all tests pass, otherwise 1.
+     */
+    int RunTests(
+        int argc,
+        char** argv);
+
+    /**
+     * Records a failed check and prints it.
+     */
+    void ReportFailure(
+        char const* File,
+        int Line,
+        char const* Expression,
+        std::string const& Details = std::string());
+
+    /**
+     * Retrieves the number of failed checks so far.
+     *
+     * @return The number of failed checks.
+     */
+    std::size_t GetFailureCount() noexcept;
+
+    template<typename Type, typename = void>
+    struct IsPrintable : std::false_type
+    {
+    };
+
+    template<typename Type>
+    struct IsPrintable<Type, decltype(void(
+        std::declval<std::ostream&>() << std::declval<Type const&>()))> :
+        std::true_type
+    {
+    };
+
+    template<typename Type>
+    std::string ToString(
+        Type const& Value)
+    {
+        if constexpr (IsPrintable<Type>::value)
+        {
+            std::ostringstream Stream;
+            Stream << Value;
+            return Stream.str();
+        }
+        else
+        {
+            return "?";
+        }
+    }
+
+    /**
+     * Compares two values. Integers of different signedness are equal only
+     * if the signed one is not negative and the values are the same, which
+     * the built-in comparison gets wrong and warns about.
+     */
+    template<typename LeftType, typename RightType>
+    bool AreEqual(
+        LeftType const& Left,
+        RightType const& Right)
+    {
+        if constexpr (
+            std::is_integral_v<LeftType> &&
+            std::is_integral_v<RightType> &&
+            std::is_signed_v<LeftType> != std::is_signed_v<RightType>)
+        {
+            if constexpr (std::is_signed_v<LeftType>)
+            {
+                if (Left < 0)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                if (Right < 0)
+                {
+                    return false;
+                }
+            }
+
+            using CommonType = std::make_unsigned_t<
+                std::common_type_t<LeftType, RightType>>;
+            return static_cast<CommonType>(Left) ==
+                static_cast<CommonType>(Right);
+        }
+        else
+        {
+            return Left == Right;
+        }
+    }
+
+    template<typename LeftType, typename RightType>
+    bool CheckEqual(
+        char const* File,
+        int Line,
+        char const* Expression,
+        LeftType const& Left,
+        RightType const& Right)
+    {
+        if (NSudoTest::AreEqual(Left, Right))
+        {
+            return true;
+        }
+
+        NSudoTest::ReportFailure(
+            File,
+            Line,
+            Expression,
+            NSudoTest::ToString(Left) + " != " + NSudoTest::ToString(Right));
+        return false;
+    }
+
+    /**
+     * Retrieves the path of a file in Tests/Data.
+     *
+     * @param Name The relative path of the file.
+     * @return The path of the file.
+     */
+    std::string GetDataPath(
+        std::string const& Name);
+
+    /**
+     * Reads a whole file.
+     *
+     * @param Path The path of the file.
+     * @param Content The content of the file.
+     * @return true if successful, otherwise false.
+     */
+    bool ReadFile(
+        std::string const& Path,
+        std::string& Content);
+
+    /**
+     * Creates or replaces a file, and the directories which contain it.
+     *
+     * @param Path The path of the file.
+     * @param Content The content of the file.
+     */
+    void WriteFile(
+        std::string const& Path,
+        std::string const& Content);
+
+    /**
+     * A directory which is created empty and removed with its content.
+     */
+    class TemporaryDirectory
+    {
+    private:
+
+        std::string m_Path;
+
+    public:
+
+        TemporaryDirectory();
+
+        ~TemporaryDirectory();
+
+        TemporaryDirectory(
+            TemporaryDirectory const&) = delete;
+
+        TemporaryDirectory& operator=(
+            TemporaryDirectory const&) = delete;
+
+        /**
+         * Retrieves the path of the directory, without a trailing
+         * separator.
+         *
+         * @return The path of the directory.
+         */
+        std::string const& GetPath() const noexcept
+        {
+            return this->m_Path;
+        }
+
+        /**
+         * Retrieves the path of an entry of the directory.
+         *
+         * @param Name The relative path of the entry.
+         * @return The path of the entry.
+         */
+        std::string Join(
+            std::string const& Name) const
+        {
+            return this->m_Path + "/" + Name;
+        }
+    };
+
+    /**
+     * The shape of a synthetic directory tree.
+     */
+    struct SyntheticTreeOptions
+    {
+        /**
+         * The number of directory levels below the root.
+         */
+        std::uint32_t Depth = 2;
+
+        /**
+         * The number of subdirectories of each directory above the deepest
+         * level.
+         */
+        std::uint32_t FanOut = 4;
+
+        /**
+         * The number of files in each directory, including the root.
+         */
+        std::uint32_t FilesPerDirectory = 16;
+
+        /**
+         * The largest size of a file. The sizes are random up to it, and the
+         * files are sparse, so large trees are quick to create.
+         */
+        std::uint32_t MaximumFileSize = 65536;
+
+        /**
+         * The seed of the sizes.
+         */
+        std::uint32_t Seed = 1;
+    };
+
+    /**
+     * The totals of a synthetic directory tree.
+     */
+    struct SyntheticTreeTotals
+    {
+        /**
+         * The number of directories, without the root.
+         */
+        std::uint64_t Directories = 0;
+
+        std::uint64_t Files = 0;
+
+        /**
+         * The sum of the sizes of the files, in bytes.
+         */
+        std::uint64_t Size = 0;
+    };
+
+    /**
+     * Creates a synthetic directory tree with known totals. The directories
+     * are named "Directory<n>" and the files "File<n>.tmp".
+     *
+     * @param Root The path of the root directory, which is created if it
+     *             does not exist.
+     * @param Options The shape of the tree.
+     * @return The totals of the tree.
+     */
+    SyntheticTreeTotals CreateSyntheticTree(
+        std::string const& Root,
+        SyntheticTreeOptions const& Options);
+
+    /**
+     * The options every benchmark accepts.
+     */
+    struct BenchmarkOptions
+    {
+        /**
+         * Runs on small inputs, which only checks that the benchmark works.
+         */
+        bool Quick = false;
+    };
+
+    /**
+     * Parses the options of a benchmark, which are --quick and --help.
+     *
+     * @return true if the benchmark should run, otherwise false.
+     */
+    bool ParseBenchmarkOptions(
+        int argc,
+        char** argv,
+        BenchmarkOptions& Options);
+
+    class Stopwatch
+    {
+    private:
+
+        std::chrono::steady_clock::time_point m_Start;
+
+    public:
+
+        Stopwatch() :
+            m_Start(std::chrono::steady_clock::now())
+        {
+        }
+
+        void Restart()
+        {
+            this->m_Start = std::chrono::steady_clock::now();
+        }
+
+        double GetSeconds() const
+        {
+            return std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - this->m_Start).count();
+        }
+    };
+
+    /**
+     * Prints a measurement as a row of the result table.
+     *
+     * @param Name The name of the measurement.
+     * @param Seconds The time it takes.
+     * @param Count The amount of work done in that time.
+     * @param Unit The unit of the work, such as "files" or "B".
+     */
+    void PrintMeasurement(
+        std::string const& Name,
+        double Seconds,
+        double Count,
+        char const* Unit);
+}
+
+#define NSUDO_TEST_CONCATENATE_INNER(Left, Right) Left##Right
+#define NSUDO_TEST_CONCATENATE(Left, Right) \
+    NSUDO_TEST_CONCATENATE_INNER(Left, Right)
+
+/**
+ * Defines a test, which is run by the main function of the test program.
+ */
+#define NSUDO_TEST_CASE(Name) \
+    static void Name(); \
+    static NSudoTest::Registration NSUDO_TEST_CONCATENATE( \
+        Name, Registration)(#Name, Name); \
+    static void Name()
+
+#define NSUDO_TEST_CHECK(Expression) \
+    ((Expression) \
+        ? true \
+        : (NSudoTest::ReportFailure(__FILE__, __LINE__, #Expression), false))
+
+#define NSUDO_TEST_CHECK_EQUAL(Left, Right) \
+    NSudoTest::CheckEqual( \
+        __FILE__, \
+        __LINE__, \
+        #Left " == " #Right, \
+        (Left), \
+        (Right))
+
+#endif // !NSUDO_TEST
@@ -0,0 +1,16 @@
+﻿/*
+ * PROJECT:   NSudo
+ * FILE:      NSudoTestMain.cpp
+ * PURPOSE:   Implementation for the entry point of the tests
+ *
+ * LICENSE:   The MIT License
+ *
+ * DEVELOPER: Mouri_Naruto (Mouri_Naruto AT Outlook.com)
+ */
+
+#include "NSudoTest.h"
+
+int main(int argc, char** argv)
+{
+    return NSudoTest::RunTests(argc, argv);
+}